@@ -0,0 +1,1144 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * benchmark-libmongoc: time the driver's hot paths against the mock server.
+ *
+ *   ./benchmark-libmongoc [-n ITERATIONS] [-w WARMUP] [-t THREADS]
+ *                         [-s GRIDFS_BYTES] [-o OUTPUT] [NAME_FILTER]
+ *
+ * Every benchmark is run against an in-process mock server answering from
+ * prebuilt replies, so results depend only on the driver and the machine.
+ * Results are written as JSON to stdout or OUTPUT, with ops/sec and latency
+ * percentiles in microseconds per benchmark. Build with
+ * MONGOC_BENCHMARK_GRIDFS_CNV defined, and mongoc-gridfs-cnv-file.c and its
+ * zlib and eax dependencies linked in, for the compressed and encrypted
+ * GridFS benchmarks.
+ */
+
+#include <mongoc.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mongoc-array-private.h"
+#include "mongoc-client-private.h"
+#include "mongoc-thread-private.h"
+
+#include "../tests/mock_server/mock-server.h"
+#include "../tests/test-libmongoc.h"
+#include "../tests/TestSuite.h"
+
+#ifdef MONGOC_BENCHMARK_GRIDFS_CNV
+#include "mongoc-gridfs-cnv-file.h"
+#endif
+
+
+#define BENCH_DB                "bench"
+#define BENCH_DOCS_PER_BULK     1000
+#define BENCH_DOCS_PER_BATCH    1000
+#define BENCH_GETMORE_BATCHES   10
+#define BENCH_DOCS_PER_GETMORE  100
+#define BENCH_GRIDFS_FILENAME   "bench"
+#define BENCH_GRIDFS_PASSWORD   "bench"
+
+
+typedef struct
+{
+   int         iterations;
+   int         warmup;
+   int         threads;
+   int         gridfs_size;
+   const char *filter;      /* run only benchmarks whose names contain this */
+   FILE       *out;
+   int         n_results;
+} bench_opts_t;
+
+
+/* what the mock server answers with, and the GridFS file it stores */
+typedef struct
+{
+   mongoc_mutex_t lock;
+   bson_t         find_batch;     /* BENCH_DOCS_PER_BATCH documents */
+   bson_t         getmore_batch;  /* BENCH_DOCS_PER_GETMORE documents */
+   bson_t         empty_batch;
+   bson_t         files;          /* the last fs.files document saved */
+   mongoc_array_t chunks;         /* bson_t * per chunk n of that file */
+} bench_server_t;
+
+
+typedef struct
+{
+   mongoc_client_t     *client;
+   mongoc_collection_t *collection;
+   mongoc_gridfs_t     *gridfs;
+   bson_t               doc;
+   uint8_t             *payload;
+   uint8_t             *read_buf;
+   size_t               payload_len;
+} bench_ctx_t;
+
+
+typedef bool (*bench_op_t) (bench_ctx_t  *ctx,
+                            bson_error_t *error);
+
+
+/* the mock server and the futures it uses call into the test framework,
+ * which the benchmarks don't link */
+void
+test_error (const char *format,
+            ...)
+{
+   va_list ap;
+
+   va_start (ap, format);
+   vfprintf (stderr, format, ap);
+   fprintf (stderr, "\n");
+   fflush (stderr);
+   va_end (ap);
+   abort ();
+}
+
+
+void
+test_suite_mock_server_log (const char *msg,
+                            ...)
+{
+}
+
+
+int64_t
+get_future_timeout_ms (void)
+{
+   return 10 * 1000;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * The mock server --
+ *
+ *       A single autoresponder answers every command the benchmarks send,
+ *       from batches built once at startup, and keeps the last GridFS
+ *       file written so the download benchmarks can read it back.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_bench_make_batch (bson_t *batch,
+                   int     n)
+{
+   char str[16];
+   const char *key;
+   bson_t doc;
+   int i;
+
+   bson_init (batch);
+
+   for (i = 0; i < n; i++) {
+      bson_uint32_to_string ((uint32_t) i, &key, str, sizeof str);
+      bson_append_document_begin (batch, key, -1, &doc);
+      BSON_APPEND_INT32 (&doc, "_id", i);
+      BSON_APPEND_UTF8 (&doc, "name", "benchmark document");
+      BSON_APPEND_DOUBLE (&doc, "value", i * 1.5);
+      BSON_APPEND_BOOL (&doc, "flag", i % 2 == 0);
+      bson_append_document_end (batch, &doc);
+   }
+}
+
+
+static void
+_bench_reply (request_t    *request,
+              const bson_t *reply)
+{
+   mock_server_reply_multi (request, MONGOC_REPLY_NONE, reply, 1, 0);
+   request_destroy (request);
+}
+
+
+static void
+_bench_reply_cursor (request_t    *request,
+                     const char   *collection,
+                     const char   *field,
+                     const bson_t *batch,
+                     int64_t       cursor_id)
+{
+   char ns[MONGOC_NAMESPACE_MAX];
+   bson_t reply;
+   bson_t cursor;
+
+   bson_snprintf (ns, sizeof ns, "%s.%s", BENCH_DB, collection);
+
+   bson_init (&reply);
+   BSON_APPEND_DOCUMENT_BEGIN (&reply, "cursor", &cursor);
+   BSON_APPEND_INT64 (&cursor, "id", cursor_id);
+   BSON_APPEND_UTF8 (&cursor, "ns", ns);
+   BSON_APPEND_ARRAY (&cursor, field, batch);
+   bson_append_document_end (&reply, &cursor);
+   BSON_APPEND_INT32 (&reply, "ok", 1);
+
+   _bench_reply (request, &reply);
+   bson_destroy (&reply);
+}
+
+
+static void
+_bench_server_save_chunk (bench_server_t *server,
+                          const bson_t   *chunk)
+{
+   bson_iter_t iter;
+   bson_t *copy;
+   bson_t **chunks;
+   uint32_t n;
+   uint32_t i;
+
+   if (!bson_iter_init_find (&iter, chunk, "n") ||
+       !BSON_ITER_HOLDS_INT32 (&iter)) {
+      test_error ("GridFS chunk without \"n\"");
+   }
+
+   n = (uint32_t) bson_iter_int32 (&iter);
+   chunks = (bson_t **) server->chunks.data;
+
+   /* the first chunk of a new file replaces the old file's chunks */
+   if (n == 0) {
+      for (i = 0; i < server->chunks.len; i++) {
+         bson_destroy (chunks[i]);
+      }
+
+      server->chunks.len = 0;
+   }
+
+   copy = bson_copy (chunk);
+
+   if (n < server->chunks.len) {
+      bson_destroy (chunks[n]);
+      chunks[n] = copy;
+   } else if (n == server->chunks.len) {
+      _mongoc_array_append_val (&server->chunks, copy);
+   } else {
+      test_error ("GridFS chunk %u written out of order", n);
+   }
+}
+
+
+static void
+_bench_server_save_file (bench_server_t *server,
+                         const bson_t   *selector,
+                         const bson_t   *update)
+{
+   bson_iter_t iter;
+   bson_iter_t child;
+
+   bson_reinit (&server->files);
+
+   if (!bson_iter_init_find (&iter, selector, "_id")) {
+      test_error ("GridFS file without \"_id\"");
+   }
+
+   bson_append_value (&server->files, "_id", -1, bson_iter_value (&iter));
+
+   if (bson_iter_init_find (&iter, update, "$set") &&
+       bson_iter_recurse (&iter, &child)) {
+      while (bson_iter_next (&child)) {
+         bson_append_value (&server->files, bson_iter_key (&child), -1,
+                            bson_iter_value (&child));
+      }
+   }
+}
+
+
+static void
+_bench_server_update (bench_server_t *server,
+                      const char     *collection,
+                      const bson_t   *command)
+{
+   bson_iter_t iter;
+   bson_iter_t updates;
+   bson_iter_t field;
+   bson_t selector;
+   bson_t update;
+   const uint8_t *data;
+   uint32_t len;
+
+   if (!bson_iter_init_find (&iter, command, "updates") ||
+       !bson_iter_recurse (&iter, &updates)) {
+      return;
+   }
+
+   while (bson_iter_next (&updates)) {
+      bson_iter_recurse (&updates, &field);
+      if (!bson_iter_find (&field, "q")) {
+         continue;
+      }
+
+      bson_iter_document (&field, &len, &data);
+      bson_init_static (&selector, data, len);
+
+      bson_iter_recurse (&updates, &field);
+      if (!bson_iter_find (&field, "u")) {
+         continue;
+      }
+
+      bson_iter_document (&field, &len, &data);
+      bson_init_static (&update, data, len);
+
+      if (!strcmp (collection, "fs.chunks")) {
+         _bench_server_save_chunk (server, &update);
+      } else if (!strcmp (collection, "fs.files")) {
+         _bench_server_save_file (server, &selector, &update);
+      }
+   }
+}
+
+
+static void
+_bench_server_find_chunks (bench_server_t *server,
+                           request_t      *request,
+                           const bson_t   *command)
+{
+   bson_iter_t iter;
+   bson_iter_t gte;
+   bson_t **chunks;
+   bson_t batch;
+   char str[16];
+   const char *key;
+   uint32_t n = 0;
+   uint32_t i;
+
+   if (bson_iter_init (&iter, command) &&
+       bson_iter_find_descendant (&iter, "filter.n.$gte", &gte) &&
+       BSON_ITER_HOLDS_INT32 (&gte)) {
+      n = (uint32_t) bson_iter_int32 (&gte);
+   }
+
+   bson_init (&batch);
+   chunks = (bson_t **) server->chunks.data;
+
+   for (i = n; i < server->chunks.len; i++) {
+      bson_uint32_to_string (i - n, &key, str, sizeof str);
+      BSON_APPEND_DOCUMENT (&batch, key, chunks[i]);
+   }
+
+   _bench_reply_cursor (request, "fs.chunks", "firstBatch", &batch, 0);
+   bson_destroy (&batch);
+}
+
+
+static uint32_t
+_bench_count_keys (bson_iter_t *iter)
+{
+   bson_iter_t child;
+   uint32_t n = 0;
+
+   if (bson_iter_recurse (iter, &child)) {
+      while (bson_iter_next (&child)) {
+         n++;
+      }
+   }
+
+   return n;
+}
+
+
+static bool
+_bench_server_responder (request_t *request,
+                         void      *data)
+{
+   bench_server_t *server = (bench_server_t *) data;
+   const bson_t *command;
+   const char *name;
+   const char *collection = "";
+   bson_iter_t iter;
+   bson_t files_batch;
+   bson_t reply;
+   int64_t cursor_id;
+
+   if (!request->is_command) {
+      return false;
+   }
+
+   command = request_get_doc (request, 0);
+   name = request->command_name;
+
+   if (bson_iter_init (&iter, command) && bson_iter_next (&iter) &&
+       BSON_ITER_HOLDS_UTF8 (&iter)) {
+      collection = bson_iter_utf8 (&iter, NULL);
+   }
+
+   mongoc_mutex_lock (&server->lock);
+
+   if (!strcmp (name, "find")) {
+      if (!strcmp (collection, "fs.files")) {
+         bson_init (&files_batch);
+         BSON_APPEND_DOCUMENT (&files_batch, "0", &server->files);
+         _bench_reply_cursor (request, collection, "firstBatch",
+                              &files_batch, 0);
+         bson_destroy (&files_batch);
+      } else if (!strcmp (collection, "fs.chunks")) {
+         _bench_server_find_chunks (server, request, command);
+      } else if (!strcmp (collection, "stream")) {
+         /* the cursor id counts the getMores left */
+         _bench_reply_cursor (request, collection, "firstBatch",
+                              &server->empty_batch, BENCH_GETMORE_BATCHES);
+      } else {
+         _bench_reply_cursor (request, collection, "firstBatch",
+                              &server->find_batch, 0);
+      }
+   } else if (!strcmp (name, "getMore")) {
+      cursor_id = bson_iter_init_find (&iter, command, "getMore") ?
+                  bson_iter_as_int64 (&iter) : 0;
+      if (!bson_iter_init_find (&iter, command, "collection") ||
+          !BSON_ITER_HOLDS_UTF8 (&iter)) {
+         test_error ("getMore without \"collection\"");
+      }
+
+      _bench_reply_cursor (request, bson_iter_utf8 (&iter, NULL),
+                           "nextBatch", &server->getmore_batch,
+                           cursor_id > 0 ? cursor_id - 1 : 0);
+   } else {
+      bson_init (&reply);
+      BSON_APPEND_INT32 (&reply, "ok", 1);
+
+      if (!strcmp (name, "insert")) {
+         if (bson_iter_init_find (&iter, command, "documents") &&
+             BSON_ITER_HOLDS_ARRAY (&iter)) {
+            BSON_APPEND_INT32 (&reply, "n",
+                               (int32_t) _bench_count_keys (&iter));
+         }
+      } else if (!strcmp (name, "update")) {
+         _bench_server_update (server, collection, command);
+         BSON_APPEND_INT32 (&reply, "n", 1);
+         BSON_APPEND_INT32 (&reply, "nModified", 1);
+      }
+
+      _bench_reply (request, &reply);
+      bson_destroy (&reply);
+   }
+
+   mongoc_mutex_unlock (&server->lock);
+
+   return true;
+}
+
+
+static void
+_bench_server_init (bench_server_t *server)
+{
+   mongoc_mutex_init (&server->lock);
+   _bench_make_batch (&server->find_batch, BENCH_DOCS_PER_BATCH);
+   _bench_make_batch (&server->getmore_batch, BENCH_DOCS_PER_GETMORE);
+   bson_init (&server->empty_batch);
+   bson_init (&server->files);
+   _mongoc_array_init (&server->chunks, sizeof (bson_t *));
+}
+
+
+static void
+_bench_server_destroy (bench_server_t *server)
+{
+   bson_t **chunks = (bson_t **) server->chunks.data;
+   uint32_t i;
+
+   for (i = 0; i < server->chunks.len; i++) {
+      bson_destroy (chunks[i]);
+   }
+
+   _mongoc_array_destroy (&server->chunks);
+   bson_destroy (&server->files);
+   bson_destroy (&server->empty_batch);
+   bson_destroy (&server->getmore_batch);
+   bson_destroy (&server->find_batch);
+   mongoc_mutex_destroy (&server->lock);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * Reporting --
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static int
+_bench_cmp_samples (const void *a,
+                    const void *b)
+{
+   int64_t x = *(const int64_t *) a;
+   int64_t y = *(const int64_t *) b;
+
+   return x < y ? -1 : x > y ? 1 : 0;
+}
+
+
+/* the nearest-rank percentile of sorted samples */
+static int64_t
+_bench_percentile (const int64_t *samples,
+                   int            n,
+                   int            percent)
+{
+   int rank = (n * percent + 99) / 100;
+
+   return samples[rank > 0 ? rank - 1 : 0];
+}
+
+
+static void
+_bench_report (bench_opts_t *opts,
+               const char   *name,
+               int64_t      *samples,
+               int           n,
+               int64_t       elapsed_usec,
+               int64_t       items_per_op)
+{
+   double seconds = elapsed_usec / 1e6;
+   double ops_per_sec = seconds > 0 ? n / seconds : 0;
+
+   qsort (samples, (size_t) n, sizeof *samples, _bench_cmp_samples);
+
+   fprintf (opts->out,
+            "%s\n    {\"name\": \"%s\", \"ops\": %d, \"items_per_op\": %"
+            PRId64 ", \"seconds\": %.6f, \"ops_per_sec\": %.3f, "
+            "\"items_per_sec\": %.3f, \"latency_usec\": {\"min\": %" PRId64
+            ", \"p50\": %" PRId64 ", \"p90\": %" PRId64 ", \"p99\": %"
+            PRId64 ", \"max\": %" PRId64 "}}",
+            opts->n_results ? "," : "",
+            name, n, items_per_op, seconds, ops_per_sec,
+            ops_per_sec * items_per_op,
+            samples[0],
+            _bench_percentile (samples, n, 50),
+            _bench_percentile (samples, n, 90),
+            _bench_percentile (samples, n, 99),
+            samples[n - 1]);
+
+   opts->n_results++;
+}
+
+
+static bool
+_bench_selected (const bench_opts_t *opts,
+                 const char         *name)
+{
+   return !opts->filter || strstr (name, opts->filter);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bench_run --
+ *
+ *       Run @op opts->warmup times untimed, then opts->iterations times,
+ *       and report its latencies as @name. @items_per_op is how many
+ *       documents or bytes an op moves.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_bench_run (bench_opts_t *opts,
+            const char   *name,
+            bench_op_t    op,
+            bench_ctx_t  *ctx,
+            int64_t       items_per_op)
+{
+   bson_error_t error;
+   int64_t *samples;
+   int64_t started;
+   int64_t op_started;
+   int64_t now;
+   int i;
+
+   if (!_bench_selected (opts, name)) {
+      return;
+   }
+
+   samples = (int64_t *) bson_malloc (opts->iterations * sizeof *samples);
+
+   for (i = 0; i < opts->warmup; i++) {
+      if (!op (ctx, &error)) {
+         test_error ("%s: %s", name, error.message);
+      }
+   }
+
+   started = bson_get_monotonic_time ();
+
+   for (i = 0; i < opts->iterations; i++) {
+      op_started = bson_get_monotonic_time ();
+      if (!op (ctx, &error)) {
+         test_error ("%s: %s", name, error.message);
+      }
+
+      now = bson_get_monotonic_time ();
+      samples[i] = now - op_started;
+   }
+
+   _bench_report (opts, name, samples, opts->iterations,
+                  bson_get_monotonic_time () - started, items_per_op);
+
+   bson_free (samples);
+}
+
+
+/* run @op once, untimed, to set up the server for benchmark @name */
+static void
+_bench_seed (bench_opts_t *opts,
+             const char   *name,
+             bench_op_t    op,
+             bench_ctx_t  *ctx)
+{
+   bson_error_t error;
+
+   if (_bench_selected (opts, name) && !op (ctx, &error)) {
+      test_error ("%s: %s", name, error.message);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * The benchmarks --
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_bench_insert_one (bench_ctx_t  *ctx,
+                   bson_error_t *error)
+{
+   return mongoc_collection_insert (ctx->collection, MONGOC_INSERT_NONE,
+                                    &ctx->doc, NULL, error);
+}
+
+
+static bool
+_bench_insert_bulk (bench_ctx_t  *ctx,
+                    bson_error_t *error)
+{
+   mongoc_bulk_operation_t *bulk;
+   bool r;
+   int i;
+
+   bulk = mongoc_collection_create_bulk_operation (ctx->collection, true,
+                                                   NULL);
+
+   for (i = 0; i < BENCH_DOCS_PER_BULK; i++) {
+      mongoc_bulk_operation_insert (bulk, &ctx->doc);
+   }
+
+   r = mongoc_bulk_operation_execute (bulk, NULL, error) != 0;
+   mongoc_bulk_operation_destroy (bulk);
+
+   return r;
+}
+
+
+static bool
+_bench_drain (mongoc_cursor_t *cursor,
+              int              expected,
+              bson_error_t    *error)
+{
+   const bson_t *doc;
+   int n = 0;
+   bool r;
+
+   while (mongoc_cursor_next (cursor, &doc)) {
+      n++;
+   }
+
+   r = !mongoc_cursor_error (cursor, error);
+   mongoc_cursor_destroy (cursor);
+
+   if (r && n != expected) {
+      bson_set_error (error, MONGOC_ERROR_CURSOR, MONGOC_ERROR_CURSOR_INVALID_CURSOR,
+                      "expected %d documents, got %d", expected, n);
+      return false;
+   }
+
+   return r;
+}
+
+
+static bool
+_bench_find (bench_ctx_t  *ctx,
+             bson_error_t *error)
+{
+   bson_t filter = BSON_INITIALIZER;
+   mongoc_cursor_t *cursor;
+
+   cursor = mongoc_collection_find_with_opts (ctx->collection, &filter, NULL,
+                                              NULL);
+
+   return _bench_drain (cursor, BENCH_DOCS_PER_BATCH, error);
+}
+
+
+static bool
+_bench_getmore (bench_ctx_t  *ctx,
+                bson_error_t *error)
+{
+   bson_t filter = BSON_INITIALIZER;
+   mongoc_collection_t *collection;
+   mongoc_cursor_t *cursor;
+
+   collection = mongoc_client_get_collection (ctx->client, BENCH_DB,
+                                              "stream");
+   cursor = mongoc_collection_find_with_opts (collection, &filter, NULL,
+                                              NULL);
+   mongoc_collection_destroy (collection);
+
+   return _bench_drain (cursor,
+                        BENCH_GETMORE_BATCHES * BENCH_DOCS_PER_GETMORE,
+                        error);
+}
+
+
+static bool
+_bench_select_server (bench_ctx_t  *ctx,
+                      bson_error_t *error)
+{
+   mongoc_server_description_t *sd;
+
+   sd = mongoc_client_select_server (ctx->client, true, NULL, error);
+   if (!sd) {
+      return false;
+   }
+
+   mongoc_server_description_destroy (sd);
+
+   return true;
+}
+
+
+static bool
+_bench_gridfs_error (mongoc_gridfs_file_t *file,
+                     bson_error_t         *error)
+{
+   if (!mongoc_gridfs_file_error (file, error)) {
+      bson_set_error (error, MONGOC_ERROR_GRIDFS,
+                      MONGOC_ERROR_GRIDFS_CHUNK_MISSING,
+                      "short GridFS read or write");
+   }
+
+   return false;
+}
+
+
+static bool
+_bench_gridfs_upload (bench_ctx_t  *ctx,
+                      bson_error_t *error)
+{
+   mongoc_gridfs_file_opt_t opt = { 0 };
+   mongoc_gridfs_file_t *file;
+   mongoc_iovec_t iov;
+   bool r;
+
+   opt.filename = BENCH_GRIDFS_FILENAME;
+   file = mongoc_gridfs_create_file (ctx->gridfs, &opt);
+
+   iov.iov_base = (char *) ctx->payload;
+   iov.iov_len = ctx->payload_len;
+
+   r = mongoc_gridfs_file_writev (file, &iov, 1, 0) ==
+       (ssize_t) ctx->payload_len && mongoc_gridfs_file_save (file);
+
+   if (!r) {
+      _bench_gridfs_error (file, error);
+   }
+
+   mongoc_gridfs_file_destroy (file);
+
+   return r;
+}
+
+
+static bool
+_bench_gridfs_download (bench_ctx_t  *ctx,
+                        bson_error_t *error)
+{
+   mongoc_gridfs_file_t *file;
+   mongoc_iovec_t iov;
+   size_t total = 0;
+   ssize_t n;
+   bool r;
+
+   file = mongoc_gridfs_find_one_by_filename (ctx->gridfs,
+                                              BENCH_GRIDFS_FILENAME, error);
+   if (!file) {
+      return false;
+   }
+
+   do {
+      iov.iov_base = (char *) ctx->read_buf + total;
+      iov.iov_len = ctx->payload_len - total;
+      n = mongoc_gridfs_file_readv (file, &iov, 1, 0, 0);
+      total += n > 0 ? (size_t) n : 0;
+   } while (n > 0 && total < ctx->payload_len);
+
+   r = total == ctx->payload_len;
+   if (!r) {
+      _bench_gridfs_error (file, error);
+   }
+
+   mongoc_gridfs_file_destroy (file);
+
+   return r;
+}
+
+
+#ifdef MONGOC_BENCHMARK_GRIDFS_CNV
+static bool
+_bench_gridfs_cnv_error (mongoc_gridfs_cnv_file_t *file,
+                         bson_error_t             *error)
+{
+   if (!mongoc_gridfs_cnv_file_error (file, error)) {
+      bson_set_error (error, MONGOC_ERROR_GRIDFS,
+                      MONGOC_ERROR_GRIDFS_CHUNK_MISSING,
+                      "short GridFS read or write");
+   }
+
+   return false;
+}
+
+
+static bool
+_bench_gridfs_cnv_upload (bench_ctx_t  *ctx,
+                          bson_error_t *error)
+{
+   mongoc_gridfs_file_opt_t opt = { 0 };
+   mongoc_gridfs_cnv_file_t *file;
+   mongoc_iovec_t iov;
+   bool r;
+
+   opt.filename = BENCH_GRIDFS_FILENAME;
+   file = mongoc_gridfs_create_cnv_file (
+      ctx->gridfs, &opt, MONGOC_CNV_COMPRESS | MONGOC_CNV_ENCRYPT);
+   mongoc_gridfs_cnv_file_set_aes_key_from_password (
+      file, BENCH_GRIDFS_PASSWORD, sizeof BENCH_GRIDFS_PASSWORD - 1);
+
+   iov.iov_base = (char *) ctx->payload;
+   iov.iov_len = ctx->payload_len;
+
+   r = mongoc_gridfs_cnv_file_writev (file, &iov, 1, 0) ==
+       (ssize_t) ctx->payload_len && mongoc_gridfs_cnv_file_save (file);
+
+   if (!r) {
+      _bench_gridfs_cnv_error (file, error);
+   }
+
+   mongoc_gridfs_cnv_file_destroy (file);
+
+   return r;
+}
+
+
+static bool
+_bench_gridfs_cnv_download (bench_ctx_t  *ctx,
+                            bson_error_t *error)
+{
+   mongoc_gridfs_cnv_file_t *file;
+   mongoc_iovec_t iov;
+   size_t total = 0;
+   ssize_t n;
+   bool r;
+
+   file = mongoc_gridfs_find_one_cnv_by_filename (
+      ctx->gridfs, BENCH_GRIDFS_FILENAME, error,
+      MONGOC_CNV_UNCOMPRESS | MONGOC_CNV_DECRYPT);
+   if (!file) {
+      return false;
+   }
+
+   mongoc_gridfs_cnv_file_set_aes_key_from_password (
+      file, BENCH_GRIDFS_PASSWORD, sizeof BENCH_GRIDFS_PASSWORD - 1);
+
+   do {
+      iov.iov_base = (char *) ctx->read_buf + total;
+      iov.iov_len = ctx->payload_len - total;
+      n = mongoc_gridfs_cnv_file_readv (file, &iov, 1, 0, 0);
+      total += n > 0 ? (size_t) n : 0;
+   } while (n > 0 && total < ctx->payload_len);
+
+   r = total == ctx->payload_len;
+   if (!r) {
+      _bench_gridfs_cnv_error (file, error);
+   }
+
+   mongoc_gridfs_cnv_file_destroy (file);
+
+   return r;
+}
+#endif
+
+
+typedef struct
+{
+   mongoc_client_pool_t *pool;
+   int64_t              *samples;
+   int                   n;
+} bench_pool_worker_t;
+
+
+static void *
+_bench_pool_worker (void *data)
+{
+   bench_pool_worker_t *worker = (bench_pool_worker_t *) data;
+   mongoc_client_t *client;
+   int64_t started;
+   int i;
+
+   for (i = 0; i < worker->n; i++) {
+      started = bson_get_monotonic_time ();
+      client = mongoc_client_pool_pop (worker->pool);
+      mongoc_client_pool_push (worker->pool, client);
+      worker->samples[i] = bson_get_monotonic_time () - started;
+   }
+
+   return NULL;
+}
+
+
+/* pop and push a pooled client in opts->threads threads at once */
+static void
+_bench_pool_checkout (bench_opts_t       *opts,
+                      const mongoc_uri_t *uri)
+{
+   mongoc_client_pool_t *pool;
+   mongoc_client_t *client;
+   bench_pool_worker_t *workers;
+   mongoc_thread_t *threads;
+   int64_t *samples;
+   int64_t started;
+   int64_t elapsed;
+   int n = opts->iterations;
+   int i;
+
+   if (!_bench_selected (opts, "pool_checkout")) {
+      return;
+   }
+
+   pool = mongoc_client_pool_new (uri);
+   samples = (int64_t *) bson_malloc (
+      (size_t) opts->threads * n * sizeof *samples);
+   workers = (bench_pool_worker_t *) bson_malloc (
+      opts->threads * sizeof *workers);
+   threads = (mongoc_thread_t *) bson_malloc (
+      opts->threads * sizeof *threads);
+
+   for (i = 0; i < opts->warmup; i++) {
+      client = mongoc_client_pool_pop (pool);
+      mongoc_client_pool_push (pool, client);
+   }
+
+   started = bson_get_monotonic_time ();
+
+   for (i = 0; i < opts->threads; i++) {
+      workers[i].pool = pool;
+      workers[i].samples = samples + (size_t) i * n;
+      workers[i].n = n;
+      mongoc_thread_create (&threads[i], _bench_pool_worker, &workers[i]);
+   }
+
+   for (i = 0; i < opts->threads; i++) {
+      mongoc_thread_join (threads[i]);
+   }
+
+   elapsed = bson_get_monotonic_time () - started;
+   _bench_report (opts, "pool_checkout", samples, opts->threads * n,
+                  elapsed, 1);
+
+   bson_free (threads);
+   bson_free (workers);
+   bson_free (samples);
+   mongoc_client_pool_destroy (pool);
+}
+
+
+static void
+_bench_ctx_init (bench_ctx_t        *ctx,
+                 const bench_opts_t *opts,
+                 const mongoc_uri_t *uri)
+{
+   bson_error_t error;
+   uint32_t seed = 1;
+   size_t i;
+
+   ctx->client = mongoc_client_new_from_uri (uri);
+   ctx->collection = mongoc_client_get_collection (ctx->client, BENCH_DB,
+                                                   "bench");
+   ctx->gridfs = mongoc_client_get_gridfs (ctx->client, BENCH_DB, NULL,
+                                           &error);
+   if (!ctx->gridfs) {
+      test_error ("mongoc_client_get_gridfs: %s", error.message);
+   }
+
+   bson_init (&ctx->doc);
+   BSON_APPEND_UTF8 (&ctx->doc, "name", "benchmark document");
+   BSON_APPEND_DOUBLE (&ctx->doc, "value", 1.5);
+   BSON_APPEND_BOOL (&ctx->doc, "flag", true);
+
+   /* the same bytes every run, from a small alphabet so they compress */
+   ctx->payload_len = (size_t) opts->gridfs_size;
+   ctx->payload = (uint8_t *) bson_malloc (ctx->payload_len);
+   ctx->read_buf = (uint8_t *) bson_malloc (ctx->payload_len);
+
+   for (i = 0; i < ctx->payload_len; i++) {
+      seed = seed * 1103515245 + 12345;
+      ctx->payload[i] = (uint8_t) ('a' + (seed >> 16) % 16);
+   }
+}
+
+
+static void
+_bench_ctx_destroy (bench_ctx_t *ctx)
+{
+   bson_free (ctx->read_buf);
+   bson_free (ctx->payload);
+   bson_destroy (&ctx->doc);
+   mongoc_gridfs_destroy (ctx->gridfs);
+   mongoc_collection_destroy (ctx->collection);
+   mongoc_client_destroy (ctx->client);
+}
+
+
+static void
+_bench_usage (const char *prog)
+{
+   fprintf (stderr,
+            "usage: %s [-n ITERATIONS] [-w WARMUP] [-t THREADS] "
+            "[-s GRIDFS_BYTES] [-o OUTPUT] [NAME_FILTER]\n", prog);
+   exit (EXIT_FAILURE);
+}
+
+
+/* the integer after argv[*i], at least @min */
+static int
+_bench_int_arg (int    argc,
+                char **argv,
+                int   *i,
+                int    min)
+{
+   char *end;
+   long value;
+
+   if (++*i >= argc) {
+      _bench_usage (argv[0]);
+   }
+
+   value = strtol (argv[*i], &end, 10);
+   if (end == argv[*i] || *end || value < min || value > INT32_MAX) {
+      _bench_usage (argv[0]);
+   }
+
+   return (int) value;
+}
+
+
+int
+main (int    argc,
+      char **argv)
+{
+   bench_opts_t opts = { 0 };
+   bench_server_t server_state;
+   bench_ctx_t ctx;
+   mock_server_t *server;
+   const char *output = NULL;
+   int64_t gridfs_size;
+   int i;
+
+   opts.iterations = 1000;
+   opts.warmup = 100;
+   opts.threads = 4;
+   opts.gridfs_size = 1024 * 1024;
+
+   for (i = 1; i < argc; i++) {
+      if (!strcmp (argv[i], "-n")) {
+         opts.iterations = _bench_int_arg (argc, argv, &i, 1);
+      } else if (!strcmp (argv[i], "-w")) {
+         opts.warmup = _bench_int_arg (argc, argv, &i, 0);
+      } else if (!strcmp (argv[i], "-t")) {
+         opts.threads = _bench_int_arg (argc, argv, &i, 1);
+      } else if (!strcmp (argv[i], "-s")) {
+         opts.gridfs_size = _bench_int_arg (argc, argv, &i, 1);
+      } else if (!strcmp (argv[i], "-o") && i + 1 < argc) {
+         output = argv[++i];
+      } else if (argv[i][0] != '-' && !opts.filter) {
+         opts.filter = argv[i];
+      } else {
+         _bench_usage (argv[0]);
+      }
+   }
+
+   opts.out = output ? fopen (output, "w") : stdout;
+   if (!opts.out) {
+      perror (output);
+      return EXIT_FAILURE;
+   }
+
+   mongoc_init ();
+
+   _bench_server_init (&server_state);
+   server = mock_server_with_autoismaster (WIRE_VERSION_MAX);
+   mock_server_autoresponds (server, _bench_server_responder, &server_state,
+                             NULL);
+   mock_server_run (server);
+
+   _bench_ctx_init (&ctx, &opts, mock_server_get_uri (server));
+   gridfs_size = opts.gridfs_size;
+
+   fprintf (opts.out,
+            "{\"driver\": \"%s\", \"iterations\": %d, \"warmup\": %d, "
+            "\"threads\": %d, \"benchmarks\": [",
+            MONGOC_VERSION_S, opts.iterations, opts.warmup, opts.threads);
+
+   _bench_run (&opts, "insert_one", _bench_insert_one, &ctx, 1);
+   _bench_run (&opts, "insert_bulk", _bench_insert_bulk, &ctx,
+               BENCH_DOCS_PER_BULK);
+   _bench_run (&opts, "find", _bench_find, &ctx, BENCH_DOCS_PER_BATCH);
+   _bench_run (&opts, "getmore", _bench_getmore, &ctx,
+               BENCH_GETMORE_BATCHES * BENCH_DOCS_PER_GETMORE);
+   _bench_run (&opts, "gridfs_upload", _bench_gridfs_upload, &ctx,
+               gridfs_size);
+   _bench_seed (&opts, "gridfs_download", _bench_gridfs_upload, &ctx);
+   _bench_run (&opts, "gridfs_download", _bench_gridfs_download, &ctx,
+               gridfs_size);
+#ifdef MONGOC_BENCHMARK_GRIDFS_CNV
+   _bench_run (&opts, "gridfs_cnv_upload", _bench_gridfs_cnv_upload, &ctx,
+               gridfs_size);
+   _bench_seed (&opts, "gridfs_cnv_download", _bench_gridfs_cnv_upload, &ctx);
+   _bench_run (&opts, "gridfs_cnv_download", _bench_gridfs_cnv_download,
+               &ctx, gridfs_size);
+#endif
+   _bench_run (&opts, "server_selection", _bench_select_server, &ctx, 1);
+   _bench_pool_checkout (&opts, mock_server_get_uri (server));
+
+   fprintf (opts.out, "\n]}\n");
+
+   _bench_ctx_destroy (&ctx);
+   mock_server_destroy (server);
+   _bench_server_destroy (&server_state);
+
+   mongoc_cleanup ();
+
+   if (output) {
+      fclose (opts.out);
+   }
+
+   return EXIT_SUCCESS;
+}
@@ -26,3 +26,9 @@ fi
 
 AS_IF([test "$enable_tracing" = "yes"],
       [CPPFLAGS="$CPPFLAGS -DMONGOC_TRACE"])
+
+AS_IF([test "$enable_memory_accounting" = "yes"],
+      [CPPFLAGS="$CPPFLAGS -DMONGOC_ENABLE_MEMORY_ACCOUNTING"])
+
+AS_IF([test "$enable_trace_buffer" = "yes"],
+      [CPPFLAGS="$CPPFLAGS -DMONGOC_ENABLE_TRACE_BUFFER"])
@@ -39,6 +39,8 @@ Build configuration:
   Cross Compiling                                  : ${enable_crosscompile}
   Fast counters                                    : ${enable_rdtscp}
   Shared memory performance counters               : ${enable_shm_counters}
+  Memory accounting                                : ${enable_memory_accounting}
+  Trace buffer                                     : ${enable_trace_buffer}
   SASL                                             : ${sasl_mode}
   SSL                                              : ${enable_ssl}
   Libbson                                          : ${with_libbson}
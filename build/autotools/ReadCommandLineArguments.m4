@@ -10,6 +10,18 @@ AC_ARG_ENABLE(tracing,
     [],[enable_tracing="no"])
 AC_MSG_RESULT([$enable_tracing])
 
+AC_MSG_CHECKING([whether to enable memory accounting])
+AC_ARG_ENABLE(memory-accounting,
+    AC_HELP_STRING([--enable-memory-accounting], [count allocations per subsystem in the performance counters [default=no]]),
+    [],[enable_memory_accounting="no"])
+AC_MSG_RESULT([$enable_memory_accounting])
+
+AC_MSG_CHECKING([whether to enable the trace buffer])
+AC_ARG_ENABLE(trace-buffer,
+    AC_HELP_STRING([--enable-trace-buffer], [record trace events in per-thread binary ring buffers [default=no]]),
+    [],[enable_trace_buffer="no"])
+AC_MSG_RESULT([$enable_trace_buffer])
+
 AC_MSG_CHECKING([whether to automatic init and cleanup])
 AC_ARG_ENABLE(automatic-init-and-cleanup,
     AC_HELP_STRING([--enable-automatic-init-and-cleanup], [turn on automatic mongoc_init() and mongoc_cleanup() [default=yes]]),
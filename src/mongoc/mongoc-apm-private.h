@@ -23,6 +23,7 @@
 
 #include <bson.h>
 #include "mongoc-apm.h"
+#include "mongoc-iovec.h"
 
 BSON_BEGIN_DECLS
 
@@ -40,16 +41,28 @@ struct _mongoc_apm_callbacks_t
    mongoc_apm_server_heartbeat_started_cb_t   server_heartbeat_started;
    mongoc_apm_server_heartbeat_succeeded_cb_t server_heartbeat_succeeded;
    mongoc_apm_server_heartbeat_failed_cb_t    server_heartbeat_failed;
+   int                                        skip;  /* mongoc_apm_skip_t */
 };
 
 /*
  * command monitoring events
  */
 
+/*
+ * command and reply documents are borrowed from the caller and valid only
+ * during the callback. a NULL command or reply wasn't captured, see
+ * mongoc_apm_set_skip_flags.
+ */
+
 struct _mongoc_apm_command_started_t
 {
-   bson_t                   *command;
-   bool                      command_owned;
+   const bson_t             *command;
+   const mongoc_iovec_t     *payload;    /* elements appended to command */
+   size_t                    n_payload;
+   /* built on the first mongoc_apm_command_started_get_command */
+   bool                      command_built;
+   bson_t                    command_local;
+   uint8_t                  *command_buf;
    const char               *database_name;
    const char               *command_name;
    int64_t                   request_id;
@@ -63,6 +76,7 @@ struct _mongoc_apm_command_succeeded_t
 {
    int64_t                   duration;
    const bson_t             *reply;
+   bson_t                    reply_local;  /* empty, if reply is NULL */
    const char               *command_name;
    int64_t                   request_id;
    int64_t                   operation_id;
@@ -155,6 +169,8 @@ struct _mongoc_apm_server_heartbeat_failed_t
 void
 mongoc_apm_command_started_init (mongoc_apm_command_started_t *event,
                                  const bson_t                 *command,
+                                 const mongoc_iovec_t         *payload,
+                                 size_t                        n_payload,
                                  const char                   *database_name,
                                  const char                   *command_name,
                                  int64_t                       request_id,
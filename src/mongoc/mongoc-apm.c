@@ -15,6 +15,7 @@
  */
 
 #include "mongoc-apm-private.h"
+#include "mongoc-memory-private.h"
 
 /*
  * An Application Performance Management (APM) implementation, complying with
@@ -27,9 +28,15 @@
  * Private initializer / cleanup functions.
  */
 
+/* what get_command returns if the command wasn't captured */
+static const uint8_t gEmptyDocument[5] = { 5, 0, 0, 0, 0 };
+
+
 void
 mongoc_apm_command_started_init (mongoc_apm_command_started_t *event,
                                  const bson_t                 *command,
+                                 const mongoc_iovec_t         *payload,
+                                 size_t                        n_payload,
                                  const char                   *database_name,
                                  const char                   *command_name,
                                  int64_t                       request_id,
@@ -38,9 +45,95 @@ mongoc_apm_command_started_init (mongoc_apm_command_started_t *event,
                                  uint32_t                      server_id,
                                  void                         *context)
 {
+   BSON_ASSERT (payload || !n_payload);
+
+   /* borrowed, see _mongoc_apm_command_started_build */
+   event->command = command;
+   event->payload = payload;
+   event->n_payload = n_payload;
+   event->command_built = false;
+   event->command_buf = NULL;
+
+   event->database_name = database_name;
+   event->command_name = command_name;
+   event->request_id = request_id;
+   event->operation_id = operation_id;
+   event->host = host;
+   event->server_id = server_id;
+   event->context = context;
+}
+
+
+void
+mongoc_apm_command_started_cleanup (mongoc_apm_command_started_t *event)
+{
+   if (event->command_built) {
+      bson_destroy (&event->command_local);
+   }
+
+   _mongoc_memory_free (event->command_buf);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_apm_command_started_build --
+ *
+ *       Set event->command_local to the command the callback sees: the
+ *       borrowed command with its payload appended, and unwrapped from
+ *       "$query" if it has a read preference.
+ *
+ * Side effects:
+ *       Allocates event->command_buf if there is a payload, otherwise
+ *       command_local points into the borrowed command.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_apm_command_started_build (mongoc_apm_command_started_t *event)
+{
+   const bson_t *command = event->command;
+   bson_t full_command;
    bson_iter_t iter;
+   uint32_t payload_len = 0;
+   uint32_t u32_le;
    uint32_t len;
    const uint8_t *data;
+   size_t doc_len;
+   size_t i;
+
+   if (!command) {
+      bson_init_static (&event->command_local, gEmptyDocument,
+                        sizeof gEmptyDocument);
+      return;
+   }
+
+   if (event->n_payload) {
+      /* join the command and its payload into one document */
+      for (i = 0; i < event->n_payload; i++) {
+         payload_len += (uint32_t) event->payload[i].iov_len;
+      }
+
+      event->command_buf = (uint8_t *) _mongoc_memory_malloc (
+         APM, command->len + payload_len);
+      memcpy (event->command_buf, bson_get_data (command), command->len - 1);
+      doc_len = command->len - 1;
+      for (i = 0; i < event->n_payload; i++) {
+         memcpy (event->command_buf + doc_len, event->payload[i].iov_base,
+                 event->payload[i].iov_len);
+         doc_len += event->payload[i].iov_len;
+      }
+
+      event->command_buf[doc_len] = 0;
+      u32_le = BSON_UINT32_TO_LE (command->len + payload_len);
+      memcpy (event->command_buf, &u32_le, 4);
+
+      bson_init_static (&full_command, event->command_buf,
+                        command->len + payload_len);
+      command = &full_command;
+   }
 
    /* Command Monitoring Spec:
     *
@@ -55,35 +148,17 @@ mongoc_apm_command_started_init (mongoc_apm_command_started_t *event,
       if (bson_iter_init_find (&iter, command, "$query") &&
           BSON_ITER_HOLDS_DOCUMENT (&iter)) {
          bson_iter_document (&iter, &len, &data);
-         event->command = bson_new_from_data (data, len);
       } else {
          /* $query should exist, but user could provide us a misformatted doc */
-         event->command = bson_new ();
+         data = gEmptyDocument;
+         len = sizeof gEmptyDocument;
       }
-
-      event->command_owned = true;
    } else {
-      /* discard "const", we promise not to modify "command" */
-      event->command = (bson_t *) command;
-      event->command_owned = false;
+      data = bson_get_data (command);
+      len = command->len;
    }
 
-   event->database_name = database_name;
-   event->command_name = command_name;
-   event->request_id = request_id;
-   event->operation_id = operation_id;
-   event->host = host;
-   event->server_id = server_id;
-   event->context = context;
-}
-
-
-void
-mongoc_apm_command_started_cleanup (mongoc_apm_command_started_t *event)
-{
-   if (event->command_owned) {
-      bson_destroy (event->command);
-   }
+   bson_init_static (&event->command_local, data, len);
 }
 
 
@@ -98,8 +173,6 @@ mongoc_apm_command_succeeded_init (mongoc_apm_command_succeeded_t *event,
                                    uint32_t                        server_id,
                                    void                           *context)
 {
-   BSON_ASSERT (reply);
-
    event->duration = duration;
    event->reply = reply;
    event->command_name = command_name;
@@ -157,7 +230,17 @@ const bson_t *
 mongoc_apm_command_started_get_command (
    const mongoc_apm_command_started_t *event)
 {
-   return event->command;
+   /* the event belongs to the thread running the callback, so it can be
+    * updated in place */
+   mongoc_apm_command_started_t *mutable_event;
+
+   if (!event->command_built) {
+      mutable_event = (mongoc_apm_command_started_t *) event;
+      _mongoc_apm_command_started_build (mutable_event);
+      mutable_event->command_built = true;
+   }
+
+   return &event->command_local;
 }
 
 
@@ -229,7 +312,18 @@ const bson_t *
 mongoc_apm_command_succeeded_get_reply (
    const mongoc_apm_command_succeeded_t *event)
 {
-   return event->reply;
+   /* the event belongs to the thread running the callback */
+   mongoc_apm_command_succeeded_t *mutable_event;
+
+   if (event->reply) {
+      return event->reply;
+   }
+
+   mutable_event = (mongoc_apm_command_succeeded_t *) event;
+   bson_init_static (&mutable_event->reply_local, gEmptyDocument,
+                     sizeof gEmptyDocument);
+
+   return &event->reply_local;
 }
 
 
@@ -607,14 +701,14 @@ mongoc_apm_callbacks_new (void)
 {
    size_t s = sizeof (mongoc_apm_callbacks_t);
 
-   return (mongoc_apm_callbacks_t *) bson_malloc0 (s);
+   return (mongoc_apm_callbacks_t *) _mongoc_memory_malloc0 (APM, s);
 }
 
 
 void
 mongoc_apm_callbacks_destroy (mongoc_apm_callbacks_t *callbacks)
 {
-   bson_free (callbacks);
+   _mongoc_memory_free (callbacks);
 }
 
 
@@ -723,3 +817,11 @@ mongoc_apm_set_server_heartbeat_failed_cb (
 {
    callbacks->server_heartbeat_failed = cb;
 }
+
+
+void
+mongoc_apm_set_skip_flags (mongoc_apm_callbacks_t *callbacks,
+                           int                     flags)
+{
+   callbacks->skip = flags;
+}
@@ -46,6 +46,14 @@ BSON_BEGIN_DECLS
 
 typedef struct _mongoc_apm_callbacks_t mongoc_apm_callbacks_t;
 
+/* documents a subscriber doesn't need, see mongoc_apm_set_skip_flags */
+typedef enum
+{
+   MONGOC_APM_SKIP_NONE    = 0,
+   MONGOC_APM_SKIP_COMMAND = 1 << 0,
+   MONGOC_APM_SKIP_REPLY   = 1 << 1
+} mongoc_apm_skip_t;
+
 
 /*
  * command monitoring events
@@ -366,6 +374,10 @@ BSON_API
 void
 mongoc_apm_set_server_heartbeat_failed_cb    (mongoc_apm_callbacks_t                     *callbacks,
                                               mongoc_apm_server_heartbeat_failed_cb_t     cb);
+BSON_API
+void
+mongoc_apm_set_skip_flags                    (mongoc_apm_callbacks_t                     *callbacks,
+                                              int                                         flags);
 BSON_END_DECLS
 
 #endif /* MONGOC_APM_H */
@@ -34,6 +34,7 @@ BSON_BEGIN_DECLS
 
 typedef enum
 {
+   MONGOC_ASYNC_CMD_INITIATE,
    MONGOC_ASYNC_CMD_SETUP,
    MONGOC_ASYNC_CMD_SEND,
    MONGOC_ASYNC_CMD_RECV_LEN,
@@ -51,6 +52,9 @@ typedef struct _mongoc_async_cmd
    int                      events;
    mongoc_async_cmd_setup_t setup;
    void                    *setup_ctx;
+   mongoc_async_cmd_initiate_t initiator;
+   void                    *initiate_ctx;
+   int64_t                  initiate_at;
    mongoc_async_cmd_cb_t    cb;
    void                    *data;
    bson_error_t             error;
@@ -82,6 +86,19 @@ mongoc_async_cmd_new (mongoc_async_t           *async,
                       void                     *cb_data,
                       int64_t                   timeout_msec);
 
+mongoc_async_cmd_t *
+mongoc_async_cmd_new_with_initiator (mongoc_async_t              *async,
+                                     mongoc_async_cmd_initiate_t  initiator,
+                                     void                        *initiate_ctx,
+                                     int64_t                      initiate_delay_msec,
+                                     mongoc_async_cmd_setup_t     setup,
+                                     void                        *setup_ctx,
+                                     const char                  *dbname,
+                                     const bson_t                *cmd,
+                                     mongoc_async_cmd_cb_t        cb,
+                                     void                        *cb_data,
+                                     int64_t                      timeout_msec);
+
 void
 mongoc_async_cmd_destroy (mongoc_async_cmd_t *acmd);
 
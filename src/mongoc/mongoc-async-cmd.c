@@ -38,6 +38,8 @@
 typedef mongoc_async_cmd_result_t (*_mongoc_async_cmd_phase_t)(
    mongoc_async_cmd_t *cmd);
 
+mongoc_async_cmd_result_t
+_mongoc_async_cmd_phase_initiate (mongoc_async_cmd_t *cmd);
 mongoc_async_cmd_result_t
 _mongoc_async_cmd_phase_setup (mongoc_async_cmd_t *cmd);
 mongoc_async_cmd_result_t
@@ -48,6 +50,7 @@ mongoc_async_cmd_result_t
 _mongoc_async_cmd_phase_recv_rpc (mongoc_async_cmd_t *cmd);
 
 static const _mongoc_async_cmd_phase_t gMongocCMDPhases[] = {
+   _mongoc_async_cmd_phase_initiate,
    _mongoc_async_cmd_phase_setup,
    _mongoc_async_cmd_phase_send,
    _mongoc_async_cmd_phase_recv_len,
@@ -105,10 +108,11 @@ mongoc_async_cmd_run (mongoc_async_cmd_t *acmd)
    rtt_msec = (bson_get_monotonic_time () - acmd->start_time) / 1000;
 
    if (result == MONGOC_ASYNC_CMD_SUCCESS) {
-      acmd->cb (result, &acmd->reply, rtt_msec, acmd->data, &acmd->error);
+      acmd->cb (acmd, result, &acmd->reply, rtt_msec, acmd->data,
+                &acmd->error);
    } else {
       /* we're in ERROR, TIMEOUT, or CANCELED */
-      acmd->cb (result, NULL, rtt_msec, acmd->data, &acmd->error);
+      acmd->cb (acmd, result, NULL, rtt_msec, acmd->data, &acmd->error);
    }
 
    mongoc_async_cmd_destroy (acmd);
@@ -150,27 +154,32 @@ _mongoc_async_cmd_state_start (mongoc_async_cmd_t *acmd)
    acmd->events = POLLOUT;
 }
 
-mongoc_async_cmd_t *
-mongoc_async_cmd_new (mongoc_async_t           *async,
-                      mongoc_stream_t          *stream,
-                      mongoc_async_cmd_setup_t  setup,
-                      void                     *setup_ctx,
-                      const char               *dbname,
-                      const bson_t             *cmd,
-                      mongoc_async_cmd_cb_t     cb,
-                      void                     *cb_data,
-                      int64_t                   timeout_msec)
+static mongoc_async_cmd_t *
+_mongoc_async_cmd_new (mongoc_async_t              *async,
+                       mongoc_stream_t             *stream,
+                       mongoc_async_cmd_initiate_t  initiator,
+                       void                        *initiate_ctx,
+                       int64_t                      initiate_delay_msec,
+                       mongoc_async_cmd_setup_t     setup,
+                       void                        *setup_ctx,
+                       const char                  *dbname,
+                       const bson_t                *cmd,
+                       mongoc_async_cmd_cb_t        cb,
+                       void                        *cb_data,
+                       int64_t                      timeout_msec)
 {
    mongoc_async_cmd_t *acmd;
 
    BSON_ASSERT (cmd);
    BSON_ASSERT (dbname);
-   BSON_ASSERT (stream);
+   BSON_ASSERT (stream || initiator);
 
    acmd = (mongoc_async_cmd_t *)bson_malloc0 (sizeof (*acmd));
    acmd->async = async;
    acmd->timeout_msec = timeout_msec;
    acmd->stream = stream;
+   acmd->initiator = initiator;
+   acmd->initiate_ctx = initiate_ctx;
    acmd->setup = setup;
    acmd->setup_ctx = setup_ctx;
    acmd->cb = cb;
@@ -182,7 +191,14 @@ mongoc_async_cmd_new (mongoc_async_t           *async,
 
    _mongoc_async_cmd_init_send (acmd, dbname);
 
-   _mongoc_async_cmd_state_start (acmd);
+   if (initiator) {
+      /* mongoc_async_run creates the stream when initiate_at comes */
+      acmd->state = MONGOC_ASYNC_CMD_INITIATE;
+      acmd->start_time = bson_get_monotonic_time ();
+      acmd->initiate_at = acmd->start_time + initiate_delay_msec * 1000;
+   } else {
+      _mongoc_async_cmd_state_start (acmd);
+   }
 
    async->ncmds++;
    DL_APPEND (async->cmds, acmd);
@@ -190,6 +206,58 @@ mongoc_async_cmd_new (mongoc_async_t           *async,
    return acmd;
 }
 
+mongoc_async_cmd_t *
+mongoc_async_cmd_new (mongoc_async_t           *async,
+                      mongoc_stream_t          *stream,
+                      mongoc_async_cmd_setup_t  setup,
+                      void                     *setup_ctx,
+                      const char               *dbname,
+                      const bson_t             *cmd,
+                      mongoc_async_cmd_cb_t     cb,
+                      void                     *cb_data,
+                      int64_t                   timeout_msec)
+{
+   BSON_ASSERT (stream);
+
+   return _mongoc_async_cmd_new (async, stream, NULL, NULL, 0, setup,
+                                 setup_ctx, dbname, cmd, cb, cb_data,
+                                 timeout_msec);
+}
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_async_cmd_new_with_initiator --
+ *
+ *       Like mongoc_async_cmd_new, but the command has no stream until
+ *       @initiate_delay_msec has passed, then @initiator creates one.
+ *       The command owns that stream and destroys it along with itself,
+ *       unless its callback takes it by setting acmd->stream to NULL.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_async_cmd_t *
+mongoc_async_cmd_new_with_initiator (mongoc_async_t              *async,
+                                     mongoc_async_cmd_initiate_t  initiator,
+                                     void                        *initiate_ctx,
+                                     int64_t                      initiate_delay_msec,
+                                     mongoc_async_cmd_setup_t     setup,
+                                     void                        *setup_ctx,
+                                     const char                  *dbname,
+                                     const bson_t                *cmd,
+                                     mongoc_async_cmd_cb_t        cb,
+                                     void                        *cb_data,
+                                     int64_t                      timeout_msec)
+{
+   BSON_ASSERT (initiator);
+   BSON_ASSERT (initiate_delay_msec >= 0);
+
+   return _mongoc_async_cmd_new (async, NULL, initiator, initiate_ctx,
+                                 initiate_delay_msec, setup, setup_ctx,
+                                 dbname, cmd, cb, cb_data, timeout_msec);
+}
+
 
 void
 mongoc_async_cmd_destroy (mongoc_async_cmd_t *acmd)
@@ -208,9 +276,26 @@ mongoc_async_cmd_destroy (mongoc_async_cmd_t *acmd)
    _mongoc_array_destroy (&acmd->array);
    _mongoc_buffer_destroy (&acmd->buffer);
 
+   if (acmd->initiator && acmd->stream) {
+      mongoc_stream_destroy (acmd->stream);
+   }
+
    bson_free (acmd);
 }
 
+mongoc_async_cmd_result_t
+_mongoc_async_cmd_phase_initiate (mongoc_async_cmd_t *acmd)
+{
+   acmd->stream = acmd->initiator (acmd);
+   if (!acmd->stream) {
+      return MONGOC_ASYNC_CMD_ERROR;
+   }
+
+   _mongoc_async_cmd_state_start (acmd);
+
+   return MONGOC_ASYNC_CMD_IN_PROGRESS;
+}
+
 mongoc_async_cmd_result_t
 _mongoc_async_cmd_phase_setup (mongoc_async_cmd_t *acmd)
 {
@@ -43,7 +43,8 @@ typedef enum
    MONGOC_ASYNC_CMD_TIMEOUT,
 } mongoc_async_cmd_result_t;
 
-typedef void (*mongoc_async_cmd_cb_t)(mongoc_async_cmd_result_t result,
+typedef void (*mongoc_async_cmd_cb_t)(struct _mongoc_async_cmd *acmd,
+                                      mongoc_async_cmd_result_t result,
                                       const bson_t             *bson,
                                       int64_t                   rtt_msec,
                                       void                     *data,
@@ -56,6 +57,11 @@ typedef int
                             int32_t         timeout_msec,
                             bson_error_t    *error);
 
+/* create a stream for a command that connects once its turn comes; return
+ * NULL and set acmd->error on failure */
+typedef mongoc_stream_t *
+(*mongoc_async_cmd_initiate_t)(struct _mongoc_async_cmd *acmd);
+
 
 mongoc_async_t *
 mongoc_async_new ();
@@ -67,6 +73,10 @@ void
 mongoc_async_run (mongoc_async_t *async,
                   int64_t         timeout_msec);
 
+void
+mongoc_async_run_for (mongoc_async_t *async,
+                      int64_t         run_msec);
+
 struct _mongoc_async_cmd *
 mongoc_async_cmd (mongoc_async_t          *async,
                   mongoc_stream_t         *stream,
@@ -78,6 +88,19 @@ mongoc_async_cmd (mongoc_async_t          *async,
                   void                    *cb_data,
                   int64_t                  timeout_msec);
 
+struct _mongoc_async_cmd *
+mongoc_async_cmd_with_initiator (mongoc_async_t             *async,
+                                 mongoc_async_cmd_initiate_t initiator,
+                                 void                       *initiate_ctx,
+                                 int64_t                     initiate_delay_msec,
+                                 mongoc_async_cmd_setup_t    setup,
+                                 void                       *setup_ctx,
+                                 const char                 *dbname,
+                                 const bson_t               *cmd,
+                                 mongoc_async_cmd_cb_t       cb,
+                                 void                       *cb_data,
+                                 int64_t                     timeout_msec);
+
 BSON_END_DECLS
 
 #endif /* MONGOC_ASYNC_PRIVATE_H */
@@ -19,6 +19,7 @@
 
 #include "mongoc-async-private.h"
 #include "mongoc-async-cmd-private.h"
+#include "mongoc-util-private.h"
 #include "utlist.h"
 #include "mongoc.h"
 
@@ -40,6 +41,25 @@ mongoc_async_cmd (mongoc_async_t           *async,
                                 cb_data, timeout_msec);
 }
 
+mongoc_async_cmd_t *
+mongoc_async_cmd_with_initiator (mongoc_async_t             *async,
+                                 mongoc_async_cmd_initiate_t initiator,
+                                 void                       *initiate_ctx,
+                                 int64_t                     initiate_delay_msec,
+                                 mongoc_async_cmd_setup_t    setup,
+                                 void                       *setup_ctx,
+                                 const char                 *dbname,
+                                 const bson_t               *cmd,
+                                 mongoc_async_cmd_cb_t       cb,
+                                 void                       *cb_data,
+                                 int64_t                     timeout_msec)
+{
+   return mongoc_async_cmd_new_with_initiator (async, initiator, initiate_ctx,
+                                               initiate_delay_msec, setup,
+                                               setup_ctx, dbname, cmd, cb,
+                                               cb_data, timeout_msec);
+}
+
 mongoc_async_t *
 mongoc_async_new ()
 {
@@ -61,17 +81,42 @@ mongoc_async_destroy (mongoc_async_t *async)
    bson_free (async);
 }
 
-void
-mongoc_async_run (mongoc_async_t *async,
-                  int64_t         timeout_msec)
+static void
+_mongoc_async_cmd_timed_out (mongoc_async_cmd_t *acmd,
+                             int64_t             now)
+{
+   bson_set_error (&acmd->error,
+                   MONGOC_ERROR_STREAM,
+                   MONGOC_ERROR_STREAM_CONNECT,
+                   (acmd->state == MONGOC_ASYNC_CMD_SEND ||
+                    acmd->state == MONGOC_ASYNC_CMD_INITIATE) ?
+                   "connection timeout" :
+                   "socket timeout");
+
+   acmd->cb (acmd, MONGOC_ASYNC_CMD_TIMEOUT, NULL,
+             (now - acmd->start_time) / 1000, acmd->data, &acmd->error);
+   mongoc_async_cmd_destroy (acmd);
+}
+
+/* if @expire_all, commands still running after @timeout_msec time out.
+ * otherwise each command times out after its own timeout_msec and those
+ * that haven't are left running for the next call */
+static void
+_mongoc_async_run (mongoc_async_t *async,
+                   int64_t         timeout_msec,
+                   bool            expire_all)
 {
    mongoc_async_cmd_t *acmd, *tmp;
+   mongoc_async_cmd_t **acmds_polled = NULL;
    mongoc_stream_poll_t *poller = NULL;
    int i;
+   int nstreams;
    ssize_t nactive;
    int64_t now;
    int64_t expire_at;
+   int64_t wake_at;
    int64_t poll_timeout_msec;
+   int64_t cmd_expire_at;
    size_t poll_size;
 
    BSON_ASSERT (timeout_msec > 0);
@@ -81,64 +126,98 @@ mongoc_async_run (mongoc_async_t *async,
    poll_size = 0;
 
    while (async->ncmds) {
+      wake_at = expire_at;
+
+      /* finish canceled commands now rather than waiting for their streams,
+       * create streams for commands whose turn to connect has come, and
+       * time out commands whose own time is up if they may outlive the run */
+      DL_FOREACH_SAFE (async->cmds, acmd, tmp)
+      {
+         if (acmd->state == MONGOC_ASYNC_CMD_CANCELED_STATE) {
+            mongoc_async_cmd_run (acmd);
+         } else if (acmd->state == MONGOC_ASYNC_CMD_INITIATE) {
+            if (acmd->initiate_at <= now) {
+               mongoc_async_cmd_run (acmd);
+            } else {
+               wake_at = BSON_MIN (wake_at, acmd->initiate_at);
+            }
+         } else if (!expire_all) {
+            cmd_expire_at = acmd->start_time + acmd->timeout_msec * 1000;
+            if (cmd_expire_at <= now) {
+               _mongoc_async_cmd_timed_out (acmd, now);
+            } else {
+               wake_at = BSON_MIN (wake_at, cmd_expire_at);
+            }
+         }
+      }
+
+      if (!async->ncmds) {
+         break;
+      }
+
       /* ncmds grows if we discover a replica & start calling ismaster on it */
       if (poll_size < async->ncmds) {
          poller = (mongoc_stream_poll_t *) bson_realloc (
             poller, sizeof (*poller) * async->ncmds);
+         acmds_polled = (mongoc_async_cmd_t **) bson_realloc (
+            acmds_polled, sizeof (*acmds_polled) * async->ncmds);
 
          poll_size = async->ncmds;
       }
 
-      i = 0;
+      nstreams = 0;
       DL_FOREACH (async->cmds, acmd)
       {
-         poller[i].stream = acmd->stream;
-         poller[i].events = acmd->events;
-         poller[i].revents = 0;
-         i++;
+         if (acmd->state == MONGOC_ASYNC_CMD_INITIATE) {
+            continue;
+         }
+
+         poller[nstreams].stream = acmd->stream;
+         poller[nstreams].events = acmd->events;
+         poller[nstreams].revents = 0;
+         acmds_polled[nstreams] = acmd;
+         nstreams++;
       }
 
-      poll_timeout_msec = (expire_at - now) / 1000;
+      poll_timeout_msec = (wake_at - now) / 1000;
       BSON_ASSERT (poll_timeout_msec < INT32_MAX);
-      nactive = mongoc_stream_poll (poller, async->ncmds,
-                                    (int32_t) poll_timeout_msec);
-
-      if (nactive) {
-         i = 0;
-
-         DL_FOREACH_SAFE (async->cmds, acmd, tmp)
-         {
-            if (poller[i].revents & (POLLERR | POLLHUP)) {
-               int hup = poller[i].revents & POLLHUP;
-               if (acmd->state == MONGOC_ASYNC_CMD_SEND) {
-                  bson_set_error (
-                     &acmd->error,
-                     MONGOC_ERROR_STREAM,
-                     MONGOC_ERROR_STREAM_CONNECT,
-                     hup ? "connection refused" : "unknown connection error");
-               } else {
-                  bson_set_error (
-                     &acmd->error,
-                     MONGOC_ERROR_STREAM,
-                     MONGOC_ERROR_STREAM_SOCKET,
-                     hup ? "connection closed" : "unknown socket error");
-               }
-
-               acmd->state = MONGOC_ASYNC_CMD_ERROR_STATE;
-            }
 
-            if (acmd->state == MONGOC_ASYNC_CMD_ERROR_STATE
-                || (poller[i].revents & poller[i].events)) {
+      if (nstreams) {
+         nactive = mongoc_stream_poll (poller, (size_t) nstreams,
+                                       (int32_t) poll_timeout_msec);
+      } else {
+         /* nothing to poll until the next command connects */
+         _mongoc_usleep (wake_at - now);
+         nactive = 0;
+      }
 
-               mongoc_async_cmd_run (acmd);
-               nactive--;
+      for (i = 0; i < nstreams && nactive > 0; i++) {
+         acmd = acmds_polled[i];
 
-               if (!nactive) {
-                  break;
-               }
+         if (poller[i].revents & (POLLERR | POLLHUP)) {
+            int hup = poller[i].revents & POLLHUP;
+            if (acmd->state == MONGOC_ASYNC_CMD_SEND) {
+               bson_set_error (
+                  &acmd->error,
+                  MONGOC_ERROR_STREAM,
+                  MONGOC_ERROR_STREAM_CONNECT,
+                  hup ? "connection refused" : "unknown connection error");
+            } else {
+               bson_set_error (
+                  &acmd->error,
+                  MONGOC_ERROR_STREAM,
+                  MONGOC_ERROR_STREAM_SOCKET,
+                  hup ? "connection closed" : "unknown socket error");
             }
 
-            i++;
+            acmd->state = MONGOC_ASYNC_CMD_ERROR_STATE;
+         }
+
+         if (acmd->state == MONGOC_ASYNC_CMD_ERROR_STATE
+             || (poller[i].revents & poller[i].events)) {
+
+            mongoc_async_cmd_run (acmd);
+            nactive--;
          }
       }
 
@@ -150,20 +229,44 @@ mongoc_async_run (mongoc_async_t *async,
 
    if (poll_size) {
       bson_free (poller);
+      bson_free (acmds_polled);
+   }
+
+   if (!expire_all) {
+      return;
    }
 
    /* commands that succeeded or failed already have been removed from the
     * list and freed. therefore, all remaining commands have timed out. */
    DL_FOREACH_SAFE (async->cmds, acmd, tmp) {
-      bson_set_error (&acmd->error,
-                      MONGOC_ERROR_STREAM,
-                      MONGOC_ERROR_STREAM_CONNECT,
-                      acmd->state == MONGOC_ASYNC_CMD_SEND ?
-                      "connection timeout" :
-                      "socket timeout");
-
-      acmd->cb (MONGOC_ASYNC_CMD_TIMEOUT, NULL, (now - acmd->start_time) / 1000,
-                acmd->data, &acmd->error);
-      mongoc_async_cmd_destroy (acmd);
+      _mongoc_async_cmd_timed_out (acmd, now);
    }
 }
+
+void
+mongoc_async_run (mongoc_async_t *async,
+                  int64_t         timeout_msec)
+{
+   _mongoc_async_run (async, timeout_msec, true);
+}
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_async_run_for --
+ *
+ *       Like mongoc_async_run, but commands time out individually after
+ *       their own timeout_msec. Return after @run_msec or when no commands
+ *       are left, leaving any unfinished commands running for the next
+ *       call. For commands that are expected to outlive a single run,
+ *       like awaitable ismasters.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+mongoc_async_run_for (mongoc_async_t *async,
+                      int64_t         run_msec)
+{
+   _mongoc_async_run (async, run_msec, false);
+}
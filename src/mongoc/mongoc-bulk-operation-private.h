@@ -40,6 +40,7 @@ struct _mongoc_bulk_operation_t
    mongoc_write_result_t          result;
    bool                           executed;
    int64_t                        operation_id;
+   bool                           shard_aware;
 };
 
 
@@ -19,6 +19,7 @@
 #include "mongoc-bulk-operation-private.h"
 #include "mongoc-client-private.h"
 #include "mongoc-error.h"
+#include "mongoc-memory-private.h"
 #include "mongoc-trace-private.h"
 #include "mongoc-write-concern-private.h"
 
@@ -37,8 +38,6 @@
  *   - If there is no acknowledgement desired, keep a count of how many
  *     replies we need and ask the socket layer to skip that many bytes
  *     when reading.
- *   - Try to use iovec to send write commands with subdocuments rather than
- *     copying them into the write command document.
  */
 
 
@@ -47,7 +46,8 @@ mongoc_bulk_operation_new (bool ordered)
 {
    mongoc_bulk_operation_t *bulk;
 
-   bulk = (mongoc_bulk_operation_t *)bson_malloc0 (sizeof *bulk);
+   bulk = (mongoc_bulk_operation_t *) _mongoc_memory_malloc0 (BULK,
+                                                              sizeof *bulk);
    bulk->flags.bypass_document_validation = MONGOC_BYPASS_DOCUMENT_VALIDATION_DEFAULT;
    bulk->flags.ordered = ordered;
    bulk->server_id = 0;
@@ -105,7 +105,7 @@ mongoc_bulk_operation_destroy (mongoc_bulk_operation_t *bulk) /* IN */
          _mongoc_write_result_destroy (&bulk->result);
       }
 
-      bson_free (bulk);
+      _mongoc_memory_free (bulk);
    }
 }
 
@@ -297,7 +297,8 @@ mongoc_bulk_operation_insert (mongoc_bulk_operation_t *bulk,
                                    mongoc_write_command_t,
                                    bulk->commands.len - 1);
 
-      if (SHOULD_APPEND (last, MONGOC_WRITE_COMMAND_INSERT)) {
+      if (SHOULD_APPEND (last, MONGOC_WRITE_COMMAND_INSERT) &&
+          !last->u.insert.borrowed) {
          _mongoc_write_command_insert_append (last, document);
          EXIT;
       }
@@ -312,6 +313,55 @@ mongoc_bulk_operation_insert (mongoc_bulk_operation_t *bulk,
    EXIT;
 }
 
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_bulk_operation_insert_borrowed --
+ *
+ *       Like mongoc_bulk_operation_insert, but @document is not copied:
+ *       the bulk operation keeps a reference to it and sends it to the
+ *       server straight from the caller's buffer.
+ *
+ *       NOTE: @document must not be modified or freed until @bulk is
+ *       destroyed.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+mongoc_bulk_operation_insert_borrowed (mongoc_bulk_operation_t *bulk,
+                                       const bson_t            *document)
+{
+   mongoc_write_command_t command = { 0 };
+   mongoc_write_command_t *last;
+
+   ENTRY;
+
+   BSON_ASSERT (bulk);
+   BSON_ASSERT (document);
+
+   if (bulk->commands.len) {
+      last = &_mongoc_array_index (&bulk->commands,
+                                   mongoc_write_command_t,
+                                   bulk->commands.len - 1);
+
+      if (SHOULD_APPEND (last, MONGOC_WRITE_COMMAND_INSERT) &&
+          last->u.insert.borrowed) {
+         _mongoc_write_command_insert_append_borrowed (last, document);
+         EXIT;
+      }
+   }
+
+   _mongoc_write_command_init_insert_borrowed (
+      &command, document, bulk->flags, bulk->operation_id,
+      !mongoc_write_concern_is_acknowledged (bulk->write_concern));
+
+   _mongoc_array_append_val (&bulk->commands, command);
+
+   EXIT;
+}
+
 bool
 _mongoc_bulk_operation_replace_one_with_opts (mongoc_bulk_operation_t       *bulk,
                                               const bson_t                  *selector,
@@ -583,6 +633,152 @@ mongoc_bulk_operation_update_one (mongoc_bulk_operation_t *bulk,
    }
 }
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_bulk_operation_execute_sharded --
+ *
+ *       Execute an unordered bulk operation shard by shard: split each
+ *       command by the shard its documents target, so each batch is for
+ *       one shard, and pipeline each shard's batches on one mongos,
+ *       spreading shards across all the mongos we can reach. Writes we
+ *       can't route go through @server_stream, mongos routes them as
+ *       usual.
+ *
+ * Returns:
+ *       false if we can't route the collection, nothing was sent.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_bulk_operation_execute_sharded (mongoc_bulk_operation_t *bulk,
+                                        mongoc_server_stream_t  *server_stream)
+{
+   mongoc_cluster_t *cluster = &bulk->client->cluster;
+   mongoc_server_description_t **sds = NULL;
+   mongoc_server_stream_t **streams;
+   mongoc_server_stream_t *stream;
+   mongoc_array_t *stream_commands;
+   mongoc_write_command_t *commands;
+   mongoc_write_command_t *command;
+   mongoc_write_command_t *parts;
+   mongoc_shard_map_t *map;
+   bson_error_t error;
+   uint32_t n_streams = 1;
+   uint32_t n_parts;
+   uint32_t offset = 0;
+   size_t n_sds = 0;
+   size_t i, j;
+
+   ENTRY;
+
+   if (server_stream->sd->type != MONGOC_SERVER_MONGOS) {
+      RETURN (false);
+   }
+
+   map = _mongoc_shard_map_get (bulk->client, bulk->database,
+                                bulk->collection);
+   if (!map) {
+      RETURN (false);
+   }
+
+   commands = (mongoc_write_command_t *) bulk->commands.data;
+
+   /* with a hint, all writes go through the chosen mongos */
+   if (!bulk->server_id) {
+      sds = mongoc_client_get_server_descriptions (bulk->client, &n_sds);
+   }
+
+   streams = (mongoc_server_stream_t **) _mongoc_memory_malloc (
+      BULK, (n_sds + 1) * sizeof (mongoc_server_stream_t *));
+   streams[0] = server_stream;
+
+   for (i = 0; i < n_sds; i++) {
+      if (sds[i]->type != MONGOC_SERVER_MONGOS ||
+          sds[i]->id == server_stream->sd->id) {
+         continue;
+      }
+
+      stream = mongoc_cluster_stream_for_server (cluster, sds[i]->id,
+                                                 true /* reconnect_ok */,
+                                                 &error);
+      if (!stream) {
+         continue;
+      }
+
+      if (!_mongoc_write_command_can_pipeline (commands, bulk->commands.len,
+                                               bulk->client, stream,
+                                               bulk->write_concern)) {
+         mongoc_server_stream_cleanup (stream);
+         continue;
+      }
+
+      streams[n_streams++] = stream;
+   }
+
+   stream_commands = (mongoc_array_t *) _mongoc_memory_malloc (
+      BULK, n_streams * sizeof (mongoc_array_t));
+
+   for (i = 0; i < n_streams; i++) {
+      _mongoc_array_init (&stream_commands[i],
+                          sizeof (mongoc_write_command_t));
+   }
+
+   n_parts = (uint32_t) map->shards.len + 1;
+   parts = (mongoc_write_command_t *) _mongoc_memory_malloc (
+      BULK, n_parts * sizeof (mongoc_write_command_t));
+
+   for (i = 0; i < bulk->commands.len; i++) {
+      command = &commands[i];
+      _mongoc_write_command_partition (command, offset, map, parts);
+
+      for (j = 0; j < n_parts; j++) {
+         if (!parts[j].n_documents) {
+            _mongoc_write_command_destroy (&parts[j]);
+         } else if (j == n_parts - 1) {
+            /* unroutable */
+            _mongoc_array_append_val (&stream_commands[0], parts[j]);
+         } else {
+            /* a shard's writes always go through the same mongos */
+            _mongoc_array_append_val (&stream_commands[j % n_streams],
+                                      parts[j]);
+         }
+      }
+
+      offset += command->n_documents;
+   }
+
+   _mongoc_write_command_execute_sharded (stream_commands, streams, n_streams,
+                                          bulk->client, bulk->database,
+                                          bulk->collection,
+                                          bulk->write_concern, &bulk->result);
+
+   for (i = 0; i < n_streams; i++) {
+      for (j = 0; j < stream_commands[i].len; j++) {
+         _mongoc_write_command_destroy (
+            &_mongoc_array_index (&stream_commands[i],
+                                  mongoc_write_command_t, j));
+      }
+
+      _mongoc_array_destroy (&stream_commands[i]);
+
+      if (i > 0) {
+         mongoc_server_stream_cleanup (streams[i]);
+      }
+   }
+
+   if (sds) {
+      mongoc_server_descriptions_destroy_all (sds, n_sds);
+   }
+
+   _mongoc_memory_free (stream_commands);
+   _mongoc_memory_free (streams);
+   _mongoc_memory_free (parts);
+
+   RETURN (true);
+}
+
 uint32_t
 mongoc_bulk_operation_execute (mongoc_bulk_operation_t *bulk,  /* IN */
                                bson_t                  *reply, /* OUT */
@@ -657,6 +853,23 @@ mongoc_bulk_operation_execute (mongoc_bulk_operation_t *bulk,  /* IN */
       RETURN (false);
    }
 
+   if (!bulk->flags.ordered &&
+       _mongoc_write_command_can_pipeline (
+          (mongoc_write_command_t *) bulk->commands.data, bulk->commands.len,
+          bulk->client, server_stream, bulk->write_concern)) {
+      if (!bulk->shard_aware ||
+          !_mongoc_bulk_operation_execute_sharded (bulk, server_stream)) {
+         /* send all batches without waiting for each reply */
+         _mongoc_write_command_execute_pipelined (
+            (mongoc_write_command_t *) bulk->commands.data, bulk->commands.len,
+            bulk->client, server_stream, bulk->database, bulk->collection,
+            bulk->write_concern, offset, &bulk->result);
+      }
+
+      bulk->server_id = server_stream->sd->id;
+      GOTO (cleanup);
+   }
+
    for (i = 0; i < bulk->commands.len; i++) {
       command = &_mongoc_array_index (&bulk->commands,
                                       mongoc_write_command_t, i);
@@ -780,3 +993,13 @@ mongoc_bulk_operation_set_bypass_document_validation (mongoc_bulk_operation_t *b
       MONGOC_BYPASS_DOCUMENT_VALIDATION_TRUE :
       MONGOC_BYPASS_DOCUMENT_VALIDATION_FALSE;
 }
+
+
+void
+mongoc_bulk_operation_set_shard_aware (mongoc_bulk_operation_t *bulk,
+                                       bool                     shard_aware)
+{
+   BSON_ASSERT (bulk);
+
+   bulk->shard_aware = shard_aware;
+}
@@ -50,6 +50,9 @@ BSON_API
 void mongoc_bulk_operation_insert                (mongoc_bulk_operation_t       *bulk,
                                                   const bson_t                  *document);
 BSON_API
+void mongoc_bulk_operation_insert_borrowed       (mongoc_bulk_operation_t       *bulk,
+                                                  const bson_t                  *document);
+BSON_API
 void mongoc_bulk_operation_remove                (mongoc_bulk_operation_t       *bulk,
                                                   const bson_t                  *selector);
 BSON_API
@@ -101,6 +104,9 @@ bool mongoc_bulk_operation_update_one_with_opts  (mongoc_bulk_operation_t
 BSON_API
 void mongoc_bulk_operation_set_bypass_document_validation (mongoc_bulk_operation_t *bulk,
                                                            bool                     bypass);
+BSON_API
+void mongoc_bulk_operation_set_shard_aware       (mongoc_bulk_operation_t       *bulk,
+                                                  bool                           shard_aware);
 
 
 /*
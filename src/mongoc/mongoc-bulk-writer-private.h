@@ -0,0 +1,85 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_BULK_WRITER_PRIVATE_H
+#define MONGOC_BULK_WRITER_PRIVATE_H
+
+#if !defined (MONGOC_COMPILATION)
+#error "Only <mongoc.h> can be included directly."
+#endif
+
+#include "mongoc-bulk-writer.h"
+#include "mongoc-client.h"
+#include "mongoc-write-command-private.h"
+
+/* a batch that isn't full yet is sent after this long */
+#define MONGOC_BULK_WRITER_MAX_BATCH_AGE_MS 100
+
+
+BSON_BEGIN_DECLS
+
+
+/* a batch sent, waiting for its reply */
+typedef struct
+{
+   mongoc_write_command_t  command;
+   mongoc_write_batch_t   *batch;
+   int64_t                 first_op;
+} mongoc_bulk_writer_batch_t;
+
+
+struct _mongoc_bulk_writer_t
+{
+   mongoc_client_t             *client;
+   char                        *database;
+   char                        *collection;
+   mongoc_write_concern_t      *write_concern;
+   mongoc_bulk_write_flags_t    flags;
+   int64_t                      operation_id;
+
+   int32_t                      max_batch_docs;
+   int32_t                      max_batch_bytes;
+   int64_t                      max_batch_age_msec;
+   uint32_t                     max_in_flight;
+
+   mongoc_bulk_writer_cb_t      cb;
+   void                        *cb_ctx;
+
+   int64_t                      next_op;
+
+   /* operations not sent yet, all of one type */
+   bool                         has_pending;
+   mongoc_write_command_t       pending;
+   int64_t                      pending_first_op;
+   int64_t                      pending_since;
+
+   /* a ring of max_in_flight batches, oldest first, all sent on
+    * server_stream */
+   mongoc_bulk_writer_batch_t  *in_flight;
+   uint32_t                     oldest;
+   uint32_t                     n_in_flight;
+   mongoc_server_stream_t      *server_stream;
+
+   /* the first error since the last flush */
+   bool                         failed;
+   bson_error_t                 error;
+};
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_BULK_WRITER_PRIVATE_H */
@@ -0,0 +1,865 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mongoc-bulk-writer-private.h"
+#include "mongoc-client-private.h"
+#include "mongoc-collection-private.h"
+#include "mongoc-error.h"
+#include "mongoc-server-description-private.h"
+#include "mongoc-server-stream-private.h"
+#include "mongoc-trace-private.h"
+#include "mongoc-write-concern-private.h"
+
+#undef MONGOC_LOG_DOMAIN
+#define MONGOC_LOG_DOMAIN "bulk_writer"
+
+/* A bulk writer accepts operations continuously. It gathers consecutive
+ * operations of one type into a pending write command, and sends it as
+ * one batch once it is full or old enough, or when an operation of
+ * another type arrives. Up to max_in_flight batches are pipelined on one
+ * connection; when all are in flight, the next send first waits for the
+ * oldest reply, so a producer faster than the server is slowed down to
+ * its pace. Each operation's result is passed to the callback when its
+ * batch's reply is read. Batches are never larger than the selected
+ * server allows, whatever the writer's options say.
+ */
+
+
+static bool
+_mongoc_bulk_writer_parse_opts (mongoc_bulk_writer_t *writer,
+                                const bson_t         *opts,
+                                bson_error_t         *error)
+{
+   bson_iter_t iter;
+   const char *key;
+   int64_t value;
+
+   if (!opts || !bson_iter_init (&iter, opts)) {
+      return true;
+   }
+
+   while (bson_iter_next (&iter)) {
+      key = bson_iter_key (&iter);
+
+      if (!strcmp (key, "bypassDocumentValidation")) {
+         writer->flags.bypass_document_validation =
+            bson_iter_as_bool (&iter) ?
+            MONGOC_BYPASS_DOCUMENT_VALIDATION_TRUE :
+            MONGOC_BYPASS_DOCUMENT_VALIDATION_FALSE;
+         continue;
+      }
+
+      if (!BSON_ITER_HOLDS_INT32 (&iter) && !BSON_ITER_HOLDS_INT64 (&iter)) {
+         bson_set_error (error,
+                         MONGOC_ERROR_COMMAND,
+                         MONGOC_ERROR_COMMAND_INVALID_ARG,
+                         "Invalid bulk writer option \"%s\"", key);
+         return false;
+      }
+
+      value = bson_iter_as_int64 (&iter);
+
+      if (!strcmp (key, "maxBatchDocs") && value > 0 && value <= INT32_MAX) {
+         writer->max_batch_docs = (int32_t) value;
+      } else if (!strcmp (key, "maxBatchBytes") && value > 0 &&
+                 value <= INT32_MAX) {
+         writer->max_batch_bytes = (int32_t) value;
+      } else if (!strcmp (key, "maxBatchAgeMS") && value >= 0) {
+         writer->max_batch_age_msec = value;
+      } else if (!strcmp (key, "maxInFlight") && value > 0 &&
+                 value <= 1000) {
+         writer->max_in_flight = (uint32_t) value;
+      } else {
+         bson_set_error (error,
+                         MONGOC_ERROR_COMMAND,
+                         MONGOC_ERROR_COMMAND_INVALID_ARG,
+                         "Invalid bulk writer option \"%s\": %" PRId64,
+                         key, value);
+         return false;
+      }
+   }
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_bulk_writer_new --
+ *
+ *       Create a bulk writer for @collection, using its client and write
+ *       concern. @opts may set "maxBatchDocs", "maxBatchBytes",
+ *       "maxBatchAgeMS", "maxInFlight" and "bypassDocumentValidation".
+ *
+ * Returns:
+ *       A writer to free with mongoc_bulk_writer_destroy, or NULL and
+ *       sets @error if @opts is invalid.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_bulk_writer_t *
+mongoc_bulk_writer_new (mongoc_collection_t *collection,
+                        const bson_t        *opts,
+                        bson_error_t        *error)
+{
+   mongoc_bulk_writer_t *writer;
+   mongoc_bulk_write_flags_t flags = MONGOC_BULK_WRITE_FLAGS_INIT;
+   uint32_t i;
+
+   ENTRY;
+
+   BSON_ASSERT (collection);
+
+   writer = (mongoc_bulk_writer_t *) bson_malloc0 (sizeof *writer);
+   writer->client = collection->client;
+   writer->database = bson_strdup (collection->db);
+   writer->collection = bson_strdup (collection->collection);
+   writer->write_concern = mongoc_write_concern_copy (
+      mongoc_collection_get_write_concern (collection));
+   writer->flags = flags;
+   writer->flags.ordered = false;
+   writer->operation_id = ++collection->client->cluster.operation_id;
+   writer->max_batch_docs = MONGOC_DEFAULT_WRITE_BATCH_SIZE;
+   writer->max_batch_bytes = MONGOC_DEFAULT_BSON_OBJ_SIZE;
+   writer->max_batch_age_msec = MONGOC_BULK_WRITER_MAX_BATCH_AGE_MS;
+   writer->max_in_flight = MONGOC_WRITE_PIPELINE_DEPTH;
+
+   if (!_mongoc_bulk_writer_parse_opts (writer, opts, error)) {
+      mongoc_bulk_writer_destroy (writer);
+      RETURN (NULL);
+   }
+
+   writer->in_flight = (mongoc_bulk_writer_batch_t *) bson_malloc0 (
+      writer->max_in_flight * sizeof (mongoc_bulk_writer_batch_t));
+
+   for (i = 0; i < writer->max_in_flight; i++) {
+      writer->in_flight[i].batch = _mongoc_write_batch_new ();
+   }
+
+   RETURN (writer);
+}
+
+
+void
+mongoc_bulk_writer_set_callback (mongoc_bulk_writer_t    *writer,
+                                 mongoc_bulk_writer_cb_t  cb,
+                                 void                    *ctx)
+{
+   BSON_ASSERT (writer);
+
+   writer->cb = cb;
+   writer->cb_ctx = ctx;
+}
+
+
+static void
+_mongoc_bulk_writer_op_done (mongoc_bulk_writer_t *writer,
+                             int64_t               op_id,
+                             const bson_error_t   *error,
+                             const bson_t         *details)
+{
+   if (error && !writer->failed) {
+      writer->failed = true;
+      memcpy (&writer->error, error, sizeof (bson_error_t));
+   }
+
+   if (writer->cb) {
+      writer->cb (op_id, error, details, writer->cb_ctx);
+   }
+}
+
+
+/* the next {"index": n, ...} document in an array like "writeErrors" */
+static bool
+_mongoc_bulk_writer_next_indexed (bson_iter_t *ar,
+                                  int32_t     *index,
+                                  bson_t      *doc)
+{
+   bson_iter_t iter;
+   const uint8_t *data;
+   uint32_t len;
+
+   while (bson_iter_next (ar)) {
+      if (BSON_ITER_HOLDS_DOCUMENT (ar) &&
+          bson_iter_recurse (ar, &iter) &&
+          bson_iter_find (&iter, "index") &&
+          BSON_ITER_HOLDS_INT32 (&iter)) {
+         *index = bson_iter_int32 (&iter);
+         bson_iter_document (ar, &len, &data);
+         return bson_init_static (doc, data, len);
+      }
+   }
+
+   *index = -1;
+
+   return false;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_bulk_writer_report --
+ *
+ *       Pass the result of each operation in @command to the callback.
+ *       If @error is set the whole batch failed; otherwise each
+ *       operation failed if @reply has a write error for it, or a write
+ *       concern error. An upsert's details are its "upserted" entry, a
+ *       write error's are its "writeErrors" entry.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_bulk_writer_report (mongoc_bulk_writer_t         *writer,
+                            const mongoc_write_command_t *command,
+                            int64_t                       first_op,
+                            const bson_error_t           *error,
+                            const bson_t                 *reply)
+{
+   bson_iter_t write_errors;
+   bson_iter_t upserted;
+   bson_iter_t iter;
+   bson_iter_t citer;
+   bson_t write_error_doc;
+   bson_t upserted_doc;
+   int32_t write_error_idx = -1;
+   int32_t upserted_idx = -1;
+   bson_error_t op_error;
+   bson_error_t wc_error;
+   bool has_wc_error = false;
+   const bson_error_t *e;
+   const bson_t *details;
+   uint32_t i;
+
+   if (!error && reply) {
+      if (bson_iter_init_find (&write_errors, reply, "writeErrors") &&
+          BSON_ITER_HOLDS_ARRAY (&write_errors) &&
+          bson_iter_recurse (&write_errors, &write_errors)) {
+         _mongoc_bulk_writer_next_indexed (&write_errors, &write_error_idx,
+                                           &write_error_doc);
+      }
+
+      if (bson_iter_init_find (&upserted, reply, "upserted") &&
+          BSON_ITER_HOLDS_ARRAY (&upserted) &&
+          bson_iter_recurse (&upserted, &upserted)) {
+         _mongoc_bulk_writer_next_indexed (&upserted, &upserted_idx,
+                                           &upserted_doc);
+      }
+
+      if (bson_iter_init_find (&iter, reply, "writeConcernError") &&
+          BSON_ITER_HOLDS_DOCUMENT (&iter) &&
+          bson_iter_recurse (&iter, &citer)) {
+         has_wc_error = true;
+         bson_set_error (&wc_error, MONGOC_ERROR_WRITE_CONCERN, 0,
+                         "Write concern error");
+
+         while (bson_iter_next (&citer)) {
+            if (BSON_ITER_IS_KEY (&citer, "code")) {
+               wc_error.code = (uint32_t) bson_iter_as_int64 (&citer);
+            } else if (BSON_ITER_IS_KEY (&citer, "errmsg") &&
+                       BSON_ITER_HOLDS_UTF8 (&citer)) {
+               bson_strncpy (wc_error.message,
+                             bson_iter_utf8 (&citer, NULL),
+                             sizeof wc_error.message);
+            }
+         }
+      }
+   }
+
+   for (i = 0; i < command->n_documents; i++) {
+      e = error;
+      details = NULL;
+
+      if (!e && write_error_idx == (int32_t) i) {
+         bson_set_error (&op_error, MONGOC_ERROR_COMMAND, 0, "Write error");
+
+         if (bson_iter_init_find (&iter, &write_error_doc, "code")) {
+            op_error.code = (uint32_t) bson_iter_as_int64 (&iter);
+         }
+
+         if (bson_iter_init_find (&iter, &write_error_doc, "errmsg") &&
+             BSON_ITER_HOLDS_UTF8 (&iter)) {
+            bson_strncpy (op_error.message, bson_iter_utf8 (&iter, NULL),
+                          sizeof op_error.message);
+         }
+
+         e = &op_error;
+         details = &write_error_doc;
+         _mongoc_bulk_writer_next_indexed (&write_errors, &write_error_idx,
+                                           &write_error_doc);
+      } else if (!e && has_wc_error) {
+         e = &wc_error;
+      }
+
+      if (upserted_idx == (int32_t) i) {
+         if (!details) {
+            details = &upserted_doc;
+         }
+
+         _mongoc_bulk_writer_next_indexed (&upserted, &upserted_idx,
+                                           &upserted_doc);
+      }
+
+      _mongoc_bulk_writer_op_done (writer, first_op + i, e, details);
+   }
+}
+
+
+/* fail all batches in flight with @error, without reading: the
+ * connection they were sent on is closed and its stream freed */
+static void
+_mongoc_bulk_writer_fail_in_flight (mongoc_bulk_writer_t *writer,
+                                    const bson_error_t   *error)
+{
+   mongoc_bulk_writer_batch_t *entry;
+
+   while (writer->n_in_flight) {
+      entry = &writer->in_flight[writer->oldest];
+      _mongoc_write_batch_abandon (entry->batch, writer->client, error);
+      _mongoc_bulk_writer_report (writer, &entry->command, entry->first_op,
+                                  error, NULL);
+      _mongoc_write_command_destroy (&entry->command);
+      writer->oldest = (writer->oldest + 1) % writer->max_in_flight;
+      writer->n_in_flight--;
+   }
+
+   /* select a server again for the next batch */
+   mongoc_server_stream_cleanup (writer->server_stream);
+   writer->server_stream = NULL;
+}
+
+
+/* the connection was closed since we sent on it, maybe by another
+ * operation on the client. fail what's in flight and return false */
+static bool
+_mongoc_bulk_writer_check_stream (mongoc_bulk_writer_t *writer)
+{
+   bson_error_t error;
+
+   if (!writer->server_stream ||
+       mongoc_cluster_stream_valid (&writer->client->cluster,
+                                    writer->server_stream)) {
+      return true;
+   }
+
+   bson_set_error (&error,
+                   MONGOC_ERROR_STREAM,
+                   MONGOC_ERROR_STREAM_NOT_ESTABLISHED,
+                   "Connection closed with %u batches in flight",
+                   writer->n_in_flight);
+   _mongoc_bulk_writer_fail_in_flight (writer, &error);
+
+   return false;
+}
+
+
+/* read the oldest batch's reply. after a network error, fail all batches
+ * in flight */
+static void
+_mongoc_bulk_writer_recv (mongoc_bulk_writer_t *writer)
+{
+   mongoc_bulk_writer_batch_t *entry;
+   bson_error_t error;
+   bson_t reply;
+   bool disconnected;
+   bool r;
+
+   ENTRY;
+
+   BSON_ASSERT (writer->n_in_flight);
+
+   if (!_mongoc_bulk_writer_check_stream (writer)) {
+      EXIT;
+   }
+
+   entry = &writer->in_flight[writer->oldest];
+   r = _mongoc_write_batch_recv_reply (entry->batch, writer->client,
+                                       writer->server_stream, &reply, &error);
+
+   _mongoc_bulk_writer_report (writer, &entry->command, entry->first_op,
+                               r ? NULL : &error, &reply);
+
+   /* the roundtrip failed, not only the command */
+   disconnected = !r && bson_empty (&reply);
+   bson_destroy (&reply);
+
+   _mongoc_write_command_destroy (&entry->command);
+   writer->oldest = (writer->oldest + 1) % writer->max_in_flight;
+   writer->n_in_flight--;
+
+   if (disconnected) {
+      _mongoc_bulk_writer_fail_in_flight (writer, &error);
+   } else if (!writer->n_in_flight) {
+      /* select a server again for the next batch */
+      mongoc_server_stream_cleanup (writer->server_stream);
+      writer->server_stream = NULL;
+   }
+
+   EXIT;
+}
+
+
+/* select a server for the next batches if we haven't */
+static void
+_mongoc_bulk_writer_select (mongoc_bulk_writer_t *writer,
+                            bson_error_t         *error)
+{
+   if (_mongoc_bulk_writer_check_stream (writer) && !writer->server_stream) {
+      writer->server_stream = mongoc_cluster_stream_for_writes (
+         &writer->client->cluster, error);
+   }
+}
+
+
+/* the writer's batch limits, or the selected server's if smaller */
+static void
+_mongoc_bulk_writer_limits (mongoc_bulk_writer_t *writer,
+                            uint32_t             *max_docs,
+                            uint32_t             *max_bytes)
+{
+   *max_docs = (uint32_t) writer->max_batch_docs;
+   *max_bytes = (uint32_t) writer->max_batch_bytes;
+
+   if (writer->server_stream) {
+      *max_docs = BSON_MIN (*max_docs, (uint32_t) BSON_MAX (1,
+         mongoc_server_stream_max_write_batch_size (writer->server_stream)));
+      *max_bytes = BSON_MIN (*max_bytes, (uint32_t) BSON_MAX (1,
+         mongoc_server_stream_max_bson_obj_size (writer->server_stream)));
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_bulk_writer_send_pending --
+ *
+ *       Send the pending command as one batch. If max_in_flight batches
+ *       are already in flight, wait for the oldest reply first.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_bulk_writer_send_pending (mongoc_bulk_writer_t *writer)
+{
+   mongoc_bulk_writer_batch_t *entry;
+   bson_error_t error;
+
+   ENTRY;
+
+   if (!writer->has_pending) {
+      EXIT;
+   }
+
+   if (writer->n_in_flight == writer->max_in_flight) {
+      _mongoc_bulk_writer_recv (writer);
+   }
+
+   _mongoc_bulk_writer_select (writer, &error);
+
+   entry = &writer->in_flight[(writer->oldest + writer->n_in_flight) %
+                              writer->max_in_flight];
+
+   if (!writer->server_stream ||
+       !_mongoc_write_command_send (&writer->pending, entry->batch,
+                                    writer->client, writer->server_stream,
+                                    writer->database, writer->collection,
+                                    writer->write_concern, &error)) {
+      if (writer->server_stream &&
+          !mongoc_cluster_stream_valid (&writer->client->cluster,
+                                        writer->server_stream)) {
+         /* the send failed and the node was disconnected, the batches in
+          * flight are lost too */
+         _mongoc_bulk_writer_fail_in_flight (writer, &error);
+      } else {
+         /* results are reported in order */
+         while (writer->n_in_flight) {
+            _mongoc_bulk_writer_recv (writer);
+         }
+      }
+
+      _mongoc_bulk_writer_report (writer, &writer->pending,
+                                  writer->pending_first_op, &error, NULL);
+      _mongoc_write_command_destroy (&writer->pending);
+      writer->has_pending = false;
+
+      EXIT;
+   }
+
+   /* the batch owns the command now */
+   entry->command = writer->pending;
+   entry->first_op = writer->pending_first_op;
+   writer->n_in_flight++;
+   writer->has_pending = false;
+
+   EXIT;
+}
+
+
+/* send the pending command first if an operation of @type, about @len
+ * bytes, doesn't belong in it */
+static void
+_mongoc_bulk_writer_prepare (mongoc_bulk_writer_t *writer,
+                             int                   type,
+                             uint32_t              len)
+{
+   uint32_t max_docs;
+   uint32_t max_bytes;
+
+   _mongoc_bulk_writer_limits (writer, &max_docs, &max_bytes);
+
+   if (writer->has_pending &&
+       (writer->pending.type != type ||
+        writer->pending.documents->len + len > max_bytes)) {
+      _mongoc_bulk_writer_send_pending (writer);
+   }
+}
+
+
+/* an operation was added to the pending command, send it if it's full */
+static int64_t
+_mongoc_bulk_writer_added (mongoc_bulk_writer_t *writer)
+{
+   bson_error_t error;
+   uint32_t max_docs;
+   uint32_t max_bytes;
+   int64_t now;
+
+   now = bson_get_monotonic_time ();
+
+   if (writer->pending.n_documents == 1) {
+      writer->pending_first_op = writer->next_op;
+      writer->pending_since = now;
+      /* learn the server's limits before the batch fills. if selection
+       * fails, _mongoc_bulk_writer_send_pending reports it */
+      _mongoc_bulk_writer_select (writer, &error);
+   }
+
+   _mongoc_bulk_writer_limits (writer, &max_docs, &max_bytes);
+
+   if (writer->pending.n_documents >= max_docs ||
+       writer->pending.documents->len >= max_bytes ||
+       now - writer->pending_since >= writer->max_batch_age_msec * 1000) {
+      _mongoc_bulk_writer_send_pending (writer);
+   }
+
+   return writer->next_op++;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_bulk_writer_insert --
+ *
+ *       Queue an insert of @document, adding an "_id" if it has none.
+ *
+ * Returns:
+ *       The operation's id, passed to the callback with its result, or
+ *       -1 and sets @error if @document is invalid or too large.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+int64_t
+mongoc_bulk_writer_insert (mongoc_bulk_writer_t *writer,
+                           const bson_t         *document,
+                           bson_error_t         *error)
+{
+   int vflags = (BSON_VALIDATE_UTF8 | BSON_VALIDATE_UTF8_ALLOW_NULL |
+                 BSON_VALIDATE_DOLLAR_KEYS | BSON_VALIDATE_DOT_KEYS);
+   uint32_t max_docs;
+   uint32_t max_bytes;
+
+   ENTRY;
+
+   BSON_ASSERT (writer);
+   BSON_ASSERT (document);
+
+   if (!bson_validate (document, (bson_validate_flags_t) vflags, NULL)) {
+      bson_set_error (error,
+                      MONGOC_ERROR_BSON,
+                      MONGOC_ERROR_BSON_INVALID,
+                      "A document was corrupt or contained "
+                      "invalid characters . or $");
+      RETURN (-1);
+   }
+
+   _mongoc_bulk_writer_limits (writer, &max_docs, &max_bytes);
+
+   if (document->len > max_bytes) {
+      bson_set_error (error,
+                      MONGOC_ERROR_BSON,
+                      MONGOC_ERROR_BSON_INVALID,
+                      "Document is %u bytes, larger than a batch: %u",
+                      document->len, max_bytes);
+      RETURN (-1);
+   }
+
+   /* key, element header and a generated "_id" */
+   _mongoc_bulk_writer_prepare (writer, MONGOC_WRITE_COMMAND_INSERT,
+                                document->len + 32);
+
+   if (writer->has_pending) {
+      _mongoc_write_command_insert_append (&writer->pending, document);
+   } else {
+      _mongoc_write_command_init_insert (&writer->pending, document,
+                                         writer->flags, writer->operation_id,
+                                         false);
+      writer->has_pending = true;
+   }
+
+   RETURN (_mongoc_bulk_writer_added (writer));
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_bulk_writer_update --
+ *
+ *       Queue an update of documents matching @selector. @update is
+ *       either all update operators or a replacement document. @opts may
+ *       have "upsert", "multi" and "collation", as in an update command's
+ *       statements.
+ *
+ * Returns:
+ *       The operation's id, or -1 and sets @error if @update is invalid.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+int64_t
+mongoc_bulk_writer_update (mongoc_bulk_writer_t *writer,
+                           const bson_t         *selector,
+                           const bson_t         *update,
+                           const bson_t         *opts,
+                           bson_error_t         *error)
+{
+   bson_iter_t iter;
+   bool has_operators = false;
+   bool has_fields = false;
+
+   ENTRY;
+
+   BSON_ASSERT (writer);
+   BSON_ASSERT (selector);
+   BSON_ASSERT (update);
+
+   if (bson_iter_init (&iter, update)) {
+      while (bson_iter_next (&iter)) {
+         if (bson_iter_key (&iter)[0] == '$') {
+            has_operators = true;
+         } else {
+            has_fields = true;
+         }
+      }
+   }
+
+   if (has_operators && has_fields) {
+      bson_set_error (error,
+                      MONGOC_ERROR_COMMAND,
+                      MONGOC_ERROR_COMMAND_INVALID_ARG,
+                      "Update can't mix $ operators and replacement fields");
+      RETURN (-1);
+   }
+
+   if (has_fields &&
+       !bson_validate (update, (bson_validate_flags_t) (
+                          BSON_VALIDATE_DOT_KEYS | BSON_VALIDATE_DOLLAR_KEYS),
+                       NULL)) {
+      bson_set_error (error,
+                      MONGOC_ERROR_COMMAND,
+                      MONGOC_ERROR_COMMAND_INVALID_ARG,
+                      "Replacement document may not contain $ or . in keys");
+      RETURN (-1);
+   }
+
+   _mongoc_bulk_writer_prepare (writer, MONGOC_WRITE_COMMAND_UPDATE,
+                                selector->len + update->len +
+                                (opts ? opts->len : 0) + 32);
+
+   if (writer->has_pending) {
+      _mongoc_write_command_update_append (&writer->pending, selector, update,
+                                           opts);
+   } else {
+      _mongoc_write_command_init_update (&writer->pending, selector, update,
+                                         opts, writer->flags,
+                                         writer->operation_id);
+      writer->has_pending = true;
+   }
+
+   RETURN (_mongoc_bulk_writer_added (writer));
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_bulk_writer_remove --
+ *
+ *       Queue a delete of the documents matching @selector. @opts may
+ *       have "limit" and "collation", as in a delete command's
+ *       statements. Without "limit", all matching documents are deleted.
+ *
+ * Returns:
+ *       The operation's id, or -1 and sets @error if "limit" is not 0
+ *       or 1.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+int64_t
+mongoc_bulk_writer_remove (mongoc_bulk_writer_t *writer,
+                           const bson_t         *selector,
+                           const bson_t         *opts,
+                           bson_error_t         *error)
+{
+   bson_iter_t iter;
+   bson_t opts_dup;
+
+   ENTRY;
+
+   BSON_ASSERT (writer);
+   BSON_ASSERT (selector);
+
+   if (opts && bson_iter_init_find (&iter, opts, "limit") &&
+       (!BSON_ITER_HOLDS_NUMBER (&iter) ||
+        (bson_iter_as_int64 (&iter) != 0 &&
+         bson_iter_as_int64 (&iter) != 1))) {
+      bson_set_error (error,
+                      MONGOC_ERROR_COMMAND,
+                      MONGOC_ERROR_COMMAND_INVALID_ARG,
+                      "Delete \"limit\" must be 0 or 1");
+      RETURN (-1);
+   }
+
+   bson_init (&opts_dup);
+   if (!opts || !bson_has_field (opts, "limit")) {
+      BSON_APPEND_INT32 (&opts_dup, "limit", 0);
+   }
+   if (opts) {
+      bson_concat (&opts_dup, opts);
+   }
+
+   _mongoc_bulk_writer_prepare (writer, MONGOC_WRITE_COMMAND_DELETE,
+                                selector->len + opts_dup.len + 32);
+
+   if (writer->has_pending) {
+      _mongoc_write_command_delete_append (&writer->pending, selector,
+                                           &opts_dup);
+   } else {
+      _mongoc_write_command_init_delete (&writer->pending, selector, &opts_dup,
+                                         writer->flags, writer->operation_id);
+      writer->has_pending = true;
+   }
+
+   bson_destroy (&opts_dup);
+
+   RETURN (_mongoc_bulk_writer_added (writer));
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_bulk_writer_flush --
+ *
+ *       Send any pending operations and wait for all replies, passing
+ *       each operation's result to the callback.
+ *
+ * Returns:
+ *       false and sets @error to the first error if any operation failed
+ *       since the last flush.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+mongoc_bulk_writer_flush (mongoc_bulk_writer_t *writer,
+                          bson_error_t         *error)
+{
+   bool ret;
+
+   ENTRY;
+
+   BSON_ASSERT (writer);
+
+   _mongoc_bulk_writer_send_pending (writer);
+
+   while (writer->n_in_flight) {
+      _mongoc_bulk_writer_recv (writer);
+   }
+
+   ret = !writer->failed;
+
+   if (!ret && error) {
+      memcpy (error, &writer->error, sizeof (bson_error_t));
+   }
+
+   writer->failed = false;
+   memset (&writer->error, 0, sizeof (bson_error_t));
+
+   RETURN (ret);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_bulk_writer_destroy --
+ *
+ *       Flush @writer, then free it.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+mongoc_bulk_writer_destroy (mongoc_bulk_writer_t *writer)
+{
+   uint32_t i;
+
+   ENTRY;
+
+   if (!writer) {
+      EXIT;
+   }
+
+   if (writer->in_flight) {
+      mongoc_bulk_writer_flush (writer, NULL);
+
+      for (i = 0; i < writer->max_in_flight; i++) {
+         _mongoc_write_batch_free (writer->in_flight[i].batch);
+      }
+
+      bson_free (writer->in_flight);
+   }
+
+   if (writer->has_pending) {
+      _mongoc_write_command_destroy (&writer->pending);
+   }
+
+   mongoc_write_concern_destroy (writer->write_concern);
+   bson_free (writer->database);
+   bson_free (writer->collection);
+   bson_free (writer);
+
+   EXIT;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef MONGOC_BULK_WRITER_H
+#define MONGOC_BULK_WRITER_H
+
+
+#include <bson.h>
+
+#include "mongoc-collection.h"
+
+BSON_BEGIN_DECLS
+
+
+typedef struct _mongoc_bulk_writer_t mongoc_bulk_writer_t;
+
+typedef void (*mongoc_bulk_writer_cb_t) (int64_t             op_id,
+                                         const bson_error_t *error,
+                                         const bson_t       *details,
+                                         void               *ctx);
+
+
+BSON_API
+mongoc_bulk_writer_t *mongoc_bulk_writer_new          (mongoc_collection_t     *collection,
+                                                       const bson_t            *opts,
+                                                       bson_error_t            *error);
+BSON_API
+void                  mongoc_bulk_writer_destroy      (mongoc_bulk_writer_t    *writer);
+BSON_API
+void                  mongoc_bulk_writer_set_callback (mongoc_bulk_writer_t    *writer,
+                                                       mongoc_bulk_writer_cb_t  cb,
+                                                       void                    *ctx);
+BSON_API
+int64_t               mongoc_bulk_writer_insert       (mongoc_bulk_writer_t    *writer,
+                                                       const bson_t            *document,
+                                                       bson_error_t            *error);
+BSON_API
+int64_t               mongoc_bulk_writer_update       (mongoc_bulk_writer_t    *writer,
+                                                       const bson_t            *selector,
+                                                       const bson_t            *update,
+                                                       const bson_t            *opts,
+                                                       bson_error_t            *error);
+BSON_API
+int64_t               mongoc_bulk_writer_remove       (mongoc_bulk_writer_t    *writer,
+                                                       const bson_t            *selector,
+                                                       const bson_t            *opts,
+                                                       bson_error_t            *error);
+BSON_API
+bool                  mongoc_bulk_writer_flush        (mongoc_bulk_writer_t    *writer,
+                                                       bson_error_t            *error);
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_BULK_WRITER_H */
@@ -21,6 +21,7 @@
 #include "mongoc-client-pool-private.h"
 #include "mongoc-client-pool.h"
 #include "mongoc-client-private.h"
+#include "mongoc-connection-stats-private.h"
 #include "mongoc-queue-private.h"
 #include "mongoc-thread-private.h"
 #include "mongoc-topology-private.h"
@@ -47,6 +48,8 @@ struct _mongoc_client_pool_t
    bool                    apm_callbacks_set;
    mongoc_apm_callbacks_t  apm_callbacks;
    void                   *apm_context;
+   bool                    tracer_set;
+   mongoc_span_tracer_t    tracer;
    int32_t                 error_api_version;
    bool                    error_api_set;
 };
@@ -188,11 +191,14 @@ mongoc_client_t *
 mongoc_client_pool_pop (mongoc_client_pool_t *pool)
 {
    mongoc_client_t *client;
+   int64_t started;
+   int64_t now;
 
    ENTRY;
 
    BSON_ASSERT (pool);
 
+   started = bson_get_monotonic_time ();
    mongoc_mutex_lock(&pool->mutex);
 
 again:
@@ -210,6 +216,7 @@ again:
          _mongoc_client_set_apm_callbacks_private (client,
                                                    &pool->apm_callbacks,
                                                    pool->apm_context);
+         memcpy (&client->tracer, &pool->tracer, sizeof client->tracer);
 #ifdef MONGOC_ENABLE_SSL
          if (pool->ssl_opts_set) {
             mongoc_client_set_ssl_opts (client, &pool->ssl_opts);
@@ -225,6 +232,13 @@ again:
    _start_scanner_if_needed (pool);
    mongoc_mutex_unlock(&pool->mutex);
 
+   mongoc_cluster_set_in_use (&client->cluster, true);
+
+   now = bson_get_monotonic_time ();
+   mongoc_histogram_pool_checkout_record (now - started);
+   mongoc_cluster_span_phase (&client->cluster, MONGOC_SPAN_POOL_CHECKOUT,
+                              started, now);
+
    RETURN(client);
 }
 
@@ -257,6 +271,10 @@ mongoc_client_pool_try_pop (mongoc_client_pool_t *pool)
    }
    mongoc_mutex_unlock(&pool->mutex);
 
+   if (client) {
+      mongoc_cluster_set_in_use (&client->cluster, true);
+   }
+
    RETURN(client);
 }
 
@@ -270,6 +288,8 @@ mongoc_client_pool_push (mongoc_client_pool_t *pool,
    BSON_ASSERT (pool);
    BSON_ASSERT (client);
 
+   mongoc_cluster_set_in_use (&client->cluster, false);
+
    mongoc_mutex_lock(&pool->mutex);
    _mongoc_queue_push_head (&pool->queue, client);
 
@@ -332,6 +352,19 @@ mongoc_client_pool_num_pushed (mongoc_client_pool_t *pool)
 }
 
 
+void
+mongoc_client_pool_get_connection_stats (mongoc_client_pool_t *pool,
+                                         bson_t               *stats)
+{
+   BSON_ASSERT (pool);
+   BSON_ASSERT (stats);
+
+   bson_init (stats);
+   _mongoc_connection_stats_snapshot (pool->topology->connection_stats,
+                                      stats);
+}
+
+
 mongoc_topology_description_t *
 _mongoc_client_pool_get_topology_description (mongoc_client_pool_t *pool)
 {
@@ -398,6 +431,41 @@ mongoc_client_pool_set_apm_callbacks (mongoc_client_pool_t   *pool,
    return true;
 }
 
+bool
+mongoc_client_pool_set_span_cb (mongoc_client_pool_t *pool,
+                                mongoc_span_cb_t      cb,
+                                void                 *context,
+                                double                sample_rate)
+{
+   mongoc_mutex_lock (&pool->mutex);
+
+   if (pool->tracer_set) {
+      mongoc_mutex_unlock (&pool->mutex);
+      MONGOC_ERROR ("Can only set span callback once");
+      return false;
+   }
+
+   _mongoc_span_tracer_set (&pool->tracer, cb, context, sample_rate);
+   pool->tracer_set = true;
+
+   mongoc_mutex_unlock (&pool->mutex);
+
+   return true;
+}
+
+
+bool
+mongoc_client_pool_set_server_selection_policy (
+   mongoc_client_pool_t             *pool,
+   mongoc_server_selection_policy_t  policy,
+   void                             *context)
+{
+   mongoc_topology_set_server_selection_policy (pool->topology, policy,
+                                                context);
+
+   return true;
+}
+
 bool
 mongoc_client_pool_set_error_api (mongoc_client_pool_t *pool,
                                   int32_t               version)
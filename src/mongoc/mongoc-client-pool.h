@@ -24,6 +24,7 @@
 #include <bson.h>
 
 #include "mongoc-apm.h"
+#include "mongoc-span.h"
 #include "mongoc-client.h"
 #include "mongoc-config.h"
 #ifdef MONGOC_ENABLE_SSL
@@ -65,11 +66,23 @@ bool                  mongoc_client_pool_set_apm_callbacks (mongoc_client_pool_t
                                                             mongoc_apm_callbacks_t *callbacks,
                                                             void                   *context);
 BSON_API
+bool                  mongoc_client_pool_set_span_cb       (mongoc_client_pool_t   *pool,
+                                                            mongoc_span_cb_t        cb,
+                                                            void                   *context,
+                                                            double                  sample_rate);
+BSON_API
+bool                  mongoc_client_pool_set_server_selection_policy (mongoc_client_pool_t             *pool,
+                                                                      mongoc_server_selection_policy_t  policy,
+                                                                      void                             *context);
+BSON_API
 bool                  mongoc_client_pool_set_error_api     (mongoc_client_pool_t   *pool,
                                                             int32_t                 version);
 BSON_API
 bool                  mongoc_client_pool_set_appname       (mongoc_client_pool_t   *pool,
                                                             const char             *appname);
+BSON_API
+void                  mongoc_client_pool_get_connection_stats (mongoc_client_pool_t *pool,
+                                                               bson_t               *stats);
 BSON_END_DECLS
 
 
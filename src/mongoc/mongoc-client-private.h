@@ -32,6 +32,7 @@
 #include "mongoc-read-prefs.h"
 #include "mongoc-rpc-private.h"
 #include "mongoc-opcode.h"
+#include "mongoc-shard-map-private.h"
 #ifdef MONGOC_ENABLE_SSL
 #include "mongoc-ssl.h"
 #endif
@@ -66,6 +67,8 @@ BSON_BEGIN_DECLS
 #define WIRE_VERSION_CMD_WRITE_CONCERN 5
 /* first version to support collation */
 #define WIRE_VERSION_COLLATION 5
+/* first version to support OP_MSG, and with it unacknowledged commands */
+#define WIRE_VERSION_OP_MSG 6
 
 
 struct _mongoc_client_t
@@ -91,8 +94,13 @@ struct _mongoc_client_t
    mongoc_apm_callbacks_t     apm_callbacks;
    void                      *apm_context;
 
+   mongoc_span_tracer_t       tracer;
+
    int32_t                    error_api_version;
    bool                       error_api_set;
+
+   /* chunk ranges for shard-aware bulk operations */
+   mongoc_shard_map_t        *shard_maps;
 };
 
 
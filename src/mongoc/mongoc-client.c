@@ -25,8 +25,10 @@
 #include "mongoc-client-private.h"
 #include "mongoc-collection-private.h"
 #include "mongoc-config.h"
+#include "mongoc-connection-stats-private.h"
 #include "mongoc-counters-private.h"
 #include "mongoc-database-private.h"
+#include "mongoc-dns-cache-private.h"
 #include "mongoc-gridfs-private.h"
 #include "mongoc-error.h"
 #include "mongoc-log.h"
@@ -45,6 +47,7 @@
 
 #ifdef MONGOC_ENABLE_SSL
 #include "mongoc-stream-tls.h"
+#include "mongoc-stream-tls-private.h"
 #include "mongoc-ssl-private.h"
 #endif
 
@@ -96,12 +99,9 @@ mongoc_client_connect_tcp (const mongoc_uri_t       *uri,
                            bson_error_t             *error)
 {
    mongoc_socket_t *sock = NULL;
-   struct addrinfo hints;
    struct addrinfo *result, *rp;
    int32_t connecttimeoutms;
    int64_t expire_at;
-   char portstr [8];
-   int s;
 
    ENTRY;
 
@@ -113,28 +113,14 @@ mongoc_client_connect_tcp (const mongoc_uri_t       *uri,
 
    BSON_ASSERT (connecttimeoutms);
 
-   bson_snprintf (portstr, sizeof portstr, "%hu", host->port);
-
-   memset (&hints, 0, sizeof hints);
-   hints.ai_family = host->family;
-   hints.ai_socktype = SOCK_STREAM;
-   hints.ai_flags = 0;
-   hints.ai_protocol = 0;
-
-   s = getaddrinfo (host->host, portstr, &hints, &result);
-
-   if (s != 0) {
-      mongoc_counter_dns_failure_inc ();
-      bson_set_error(error,
-                     MONGOC_ERROR_STREAM,
-                     MONGOC_ERROR_STREAM_NAME_RESOLUTION,
-                     "Failed to resolve %s",
-                     host->host);
+   if (!_mongoc_dns_resolve (host,
+                             mongoc_uri_get_option_as_int32 (
+                                uri, "dnscachettlms", MONGOC_DNS_CACHE_TTL_MS),
+                             &result,
+                             error)) {
       RETURN (NULL);
    }
 
-   mongoc_counter_dns_success_inc ();
-
    for (rp = result; rp; rp = rp->ai_next) {
       /*
        * Create a new non-blocking socket.
@@ -179,11 +165,11 @@ mongoc_client_connect_tcp (const mongoc_uri_t       *uri,
                       MONGOC_ERROR_STREAM_CONNECT,
                       "Failed to connect to target host: %s",
                       host->host_and_port);
-      freeaddrinfo (result);
+      _mongoc_dns_results_destroy (result);
       RETURN (NULL);
    }
 
-   freeaddrinfo (result);
+   _mongoc_dns_results_destroy (result);
 
    return mongoc_stream_socket_new (sock);
 }
@@ -348,6 +334,8 @@ mongoc_client_default_stream_initiator (const mongoc_uri_t       *uri,
             return NULL;
          }
 
+         _mongoc_stream_tls_resume_session (base_stream, host);
+
          connecttimeoutms = mongoc_uri_get_option_as_int32 (
             uri, "connecttimeoutms", MONGOC_DEFAULT_CONNECTTIMEOUTMS);
 
@@ -811,6 +799,7 @@ mongoc_client_destroy (mongoc_client_t *client)
       mongoc_read_prefs_destroy (client->read_prefs);
       mongoc_cluster_destroy (&client->cluster);
       mongoc_uri_destroy (client->uri);
+      _mongoc_shard_maps_destroy (client->shard_maps);
 
 #ifdef MONGOC_ENABLE_SSL
       _mongoc_ssl_opts_cleanup (&client->ssl_opts);
@@ -1677,7 +1666,10 @@ _mongoc_client_monitor_op_killcursors (mongoc_cluster_t       *cluster,
    bson_init (&doc);
    _mongoc_client_prepare_killcursors_command (cursor_id, collection, &doc);
    mongoc_apm_command_started_init (&event,
-                                    &doc,
+                                    (client->apm_callbacks.skip &
+                                     MONGOC_APM_SKIP_COMMAND) ? NULL : &doc,
+                                    NULL,
+                                    0,
                                     db,
                                     "killCursors",
                                     cluster->request_id,
@@ -1724,7 +1716,8 @@ _mongoc_client_monitor_op_killcursors_succeeded (
 
    mongoc_apm_command_succeeded_init (&event,
                                       duration,
-                                      &doc,
+                                      (client->apm_callbacks.skip &
+                                       MONGOC_APM_SKIP_REPLY) ? NULL : &doc,
                                       "killCursors",
                                       cluster->request_id,
                                       operation_id,
@@ -2072,6 +2065,43 @@ mongoc_client_set_apm_callbacks (mongoc_client_t        *client,
 }
 
 
+bool
+mongoc_client_set_span_cb (mongoc_client_t  *client,
+                           mongoc_span_cb_t  cb,
+                           void             *context,
+                           double            sample_rate)
+{
+   if (!client->topology->single_threaded) {
+      MONGOC_ERROR ("Cannot set span callback on a pooled client, use "
+                    "mongoc_client_pool_set_span_cb");
+      return false;
+   }
+
+   _mongoc_span_tracer_set (&client->tracer, cb, context, sample_rate);
+
+   return true;
+}
+
+
+bool
+mongoc_client_set_server_selection_policy (
+   mongoc_client_t                  *client,
+   mongoc_server_selection_policy_t  policy,
+   void                             *context)
+{
+   if (!client->topology->single_threaded) {
+      MONGOC_ERROR ("Cannot set server selection policy on a pooled client, "
+                    "use mongoc_client_pool_set_server_selection_policy");
+      return false;
+   }
+
+   mongoc_topology_set_server_selection_policy (client->topology, policy,
+                                                context);
+
+   return true;
+}
+
+
 mongoc_server_description_t *
 mongoc_client_get_server_description (mongoc_client_t *client,
                                       uint32_t         server_id)
@@ -2081,6 +2111,20 @@ mongoc_client_get_server_description (mongoc_client_t *client,
 }
 
 
+void
+mongoc_client_get_connection_stats (mongoc_client_t *client,
+                                    bson_t          *stats)
+{
+   BSON_ASSERT (client);
+   BSON_ASSERT (stats);
+
+   /* a pooled client's topology and its stats are the pool's */
+   bson_init (stats);
+   _mongoc_connection_stats_snapshot (client->topology->connection_stats,
+                                      stats);
+}
+
+
 mongoc_server_description_t **
 mongoc_client_get_server_descriptions (
    const mongoc_client_t        *client,
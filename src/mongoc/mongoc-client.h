@@ -24,6 +24,7 @@
 #include <bson.h>
 
 #include "mongoc-apm.h"
+#include "mongoc-span.h"
 #include "mongoc-collection.h"
 #include "mongoc-config.h"
 #include "mongoc-cursor.h"
@@ -213,6 +214,15 @@ bool                           mongoc_client_set_apm_callbacks             (mong
                                                                             mongoc_apm_callbacks_t       *callbacks,
                                                                             void                         *context);
 BSON_API
+bool                           mongoc_client_set_span_cb                   (mongoc_client_t              *client,
+                                                                            mongoc_span_cb_t              cb,
+                                                                            void                         *context,
+                                                                            double                        sample_rate);
+BSON_API
+bool                           mongoc_client_set_server_selection_policy   (mongoc_client_t              *client,
+                                                                            mongoc_server_selection_policy_t policy,
+                                                                            void                         *context);
+BSON_API
 mongoc_server_description_t   *mongoc_client_get_server_description        (mongoc_client_t              *client,
                                                                             uint32_t                      server_id);
 BSON_API
@@ -232,6 +242,9 @@ bool                           mongoc_client_set_error_api                 (mong
 BSON_API
 bool                           mongoc_client_set_appname                   (mongoc_client_t              *client,
                                                                             const char                   *appname);
+BSON_API
+void                           mongoc_client_get_connection_stats          (mongoc_client_t              *client,
+                                                                            bson_t                       *stats);
 BSON_END_DECLS
 
 
@@ -27,12 +27,15 @@
 #include "mongoc-buffer-private.h"
 #include "mongoc-config.h"
 #include "mongoc-client.h"
+#include "mongoc-connection-stats-private.h"
+#include "mongoc-counters-private.h"
 #include "mongoc-list-private.h"
 #include "mongoc-opcode.h"
 #include "mongoc-read-prefs.h"
 #include "mongoc-rpc-private.h"
 #include "mongoc-server-stream-private.h"
 #include "mongoc-set-private.h"
+#include "mongoc-span-private.h"
 #include "mongoc-stream.h"
 #include "mongoc-topology-description-private.h"
 #include "mongoc-uri.h"
@@ -54,6 +57,10 @@ typedef struct _mongoc_cluster_node_t
    int32_t          max_msg_size;
 
    int64_t          timestamp;
+
+   mongoc_connection_stats_conn_t   conn;
+   mongoc_counter_slots_t          *keyed_counters;  /* on first use */
+   mongoc_connection_close_reason_t close_reason;  /* when destroyed */
 } mongoc_cluster_node_t;
 
 typedef struct _mongoc_cluster_t
@@ -62,15 +69,51 @@ typedef struct _mongoc_cluster_t
    uint32_t         request_id;
    uint32_t         sockettimeoutms;
    uint32_t         socketcheckintervalms;
+   uint32_t         slowopthresholdms;  /* 0 if the slow op log is off */
    mongoc_uri_t    *uri;
    unsigned         requires_auth : 1;
+   bool             in_use;  /* checked out of a client pool */
 
    mongoc_client_t *client;
 
    mongoc_set_t    *nodes;
+   /* per server id, when its connection last had a roundtrip after an
+    * unacknowledged command, see mongoc_cluster_send_unacknowledged */
+   mongoc_set_t    *unack_checked_at;
    mongoc_array_t   iov;
+   /* keyed counter groups of the RPCs in iov, see sendv_to_server */
+   mongoc_array_t   rpc_ns_counters;
+   /* phases before the next command is sent, if tracing or logging slow
+    * ops */
+   mongoc_span_t    span_pending;
+   /* the namespace last counted and its keyed counter group, usually the
+    * next command's too */
+   char                    keyed_ns[MONGOC_NAMESPACE_MAX];
+   mongoc_counter_slots_t *keyed_ns_counters;
 } mongoc_cluster_t;
 
+/* a command sent with mongoc_cluster_send_command, awaiting its reply */
+typedef struct _mongoc_cluster_request_t
+{
+   mongoc_stream_t          *stream;
+   uint32_t                  server_id;
+   const mongoc_host_list_t *host;
+   const char               *db_name;
+   const char               *command_name;
+   const bson_t             *command;
+   uint32_t                  request_id;
+   int64_t                   started;
+   bool                      monitored;
+   bool                      unacknowledged;  /* no reply, see OP_MSG */
+   bool                      traced;
+   mongoc_span_t             span;           /* if traced or slow ops on */
+   /* keyed counter groups, NULL if request has no host. the caller sets
+    * server_counters if it knows them, or NULL to look them up */
+   mongoc_counter_slots_t   *server_counters;
+   mongoc_counter_slots_t   *ns_counters;
+   mongoc_connection_stats_server_t *connection_stats;  /* NULL ok */
+} mongoc_cluster_request_t;
+
 void
 mongoc_cluster_init (mongoc_cluster_t   *cluster,
                      const mongoc_uri_t *uri,
@@ -80,8 +123,17 @@ void
 mongoc_cluster_destroy (mongoc_cluster_t *cluster);
 
 void
-mongoc_cluster_disconnect_node (mongoc_cluster_t *cluster,
-                                uint32_t          id);
+mongoc_cluster_disconnect_node (mongoc_cluster_t                 *cluster,
+                                uint32_t                          id,
+                                mongoc_connection_close_reason_t  reason);
+
+void
+mongoc_cluster_set_in_use (mongoc_cluster_t *cluster,
+                           bool              in_use);
+
+bool
+mongoc_cluster_stream_valid (mongoc_cluster_t       *cluster,
+                             mongoc_server_stream_t *server_stream);
 
 int32_t
 mongoc_cluster_get_max_bson_obj_size (mongoc_cluster_t *cluster);
@@ -132,6 +184,55 @@ mongoc_cluster_run_command_monitored (mongoc_cluster_t         *cluster,
                                       bson_t                   *reply,
                                       bson_error_t             *error);
 
+bool
+mongoc_cluster_run_command_payload (mongoc_cluster_t         *cluster,
+                                    mongoc_server_stream_t   *server_stream,
+                                    mongoc_query_flags_t      flags,
+                                    const char               *db_name,
+                                    const bson_t             *command,
+                                    const mongoc_iovec_t     *payload,
+                                    size_t                    n_payload,
+                                    bson_t                   *reply,
+                                    bson_error_t             *error);
+
+bool
+mongoc_cluster_send_command (mongoc_cluster_t         *cluster,
+                             mongoc_server_stream_t   *server_stream,
+                             mongoc_query_flags_t      flags,
+                             const char               *db_name,
+                             const bson_t             *command,
+                             const mongoc_iovec_t     *payload,
+                             size_t                    n_payload,
+                             mongoc_cluster_request_t *request,
+                             bson_error_t             *error);
+
+bool
+mongoc_cluster_send_unacknowledged (mongoc_cluster_t         *cluster,
+                                    mongoc_server_stream_t   *server_stream,
+                                    const char               *db_name,
+                                    const bson_t             *command,
+                                    const mongoc_iovec_t     *payload,
+                                    size_t                    n_payload,
+                                    bson_error_t             *error);
+
+bool
+mongoc_cluster_recv_reply (mongoc_cluster_t         *cluster,
+                           mongoc_server_stream_t   *server_stream,
+                           mongoc_cluster_request_t *request,
+                           bson_t                   *reply,
+                           bson_error_t             *error);
+
+void
+mongoc_cluster_abandon_request (mongoc_cluster_t         *cluster,
+                                mongoc_cluster_request_t *request,
+                                const bson_error_t       *error);
+
+void
+mongoc_cluster_span_phase (mongoc_cluster_t    *cluster,
+                           mongoc_span_phase_t  phase,
+                           int64_t              start,
+                           int64_t              end);
+
 bool
 mongoc_cluster_run_command (mongoc_cluster_t    *cluster,
                             mongoc_stream_t     *stream,
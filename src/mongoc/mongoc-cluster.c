@@ -27,9 +27,12 @@
 #include "mongoc-client-private.h"
 #include "mongoc-counters-private.h"
 #include "mongoc-config.h"
+#include "mongoc-errno-private.h"
 #include "mongoc-error.h"
 #include "mongoc-host-list-private.h"
 #include "mongoc-log.h"
+#include "mongoc-memory-private.h"
+#include "mongoc-slow-op-private.h"
 #ifdef MONGOC_ENABLE_SASL
 #include "mongoc-sasl-private.h"
 #endif
@@ -47,6 +50,7 @@
 #include "mongoc-stream-tls.h"
 #include "mongoc-thread-private.h"
 #include "mongoc-topology-private.h"
+#include "mongoc-topology-cache-private.h"
 #include "mongoc-trace-private.h"
 #include "mongoc-util-private.h"
 #include "mongoc-write-concern-private.h"
@@ -116,100 +120,394 @@ _bson_error_message_printf (bson_error_t *error,
          command_name, db_name, error->message); \
    } while (0)
 
+static void
+_mongoc_cluster_request_failed (mongoc_cluster_t         *cluster,
+                                mongoc_cluster_request_t *request,
+                                const bson_error_t       *error)
+{
+   mongoc_apm_callbacks_t *callbacks = &cluster->client->apm_callbacks;
+   mongoc_apm_command_failed_t failed_event;
+
+   if (!request->monitored || !callbacks->failed) {
+      return;
+   }
+
+   mongoc_apm_command_failed_init (&failed_event,
+                                   bson_get_monotonic_time () - request->started,
+                                   request->command_name,
+                                   error,
+                                   request->request_id,
+                                   cluster->operation_id,
+                                   request->host,
+                                   request->server_id,
+                                   cluster->client->apm_context);
+
+   callbacks->failed (&failed_event);
+   mongoc_apm_command_failed_cleanup (&failed_event);
+}
+
+
+/* pass a traced request's span to the client's span callback, once */
+static void
+_mongoc_cluster_span_finish (mongoc_cluster_t         *cluster,
+                             mongoc_cluster_request_t *request,
+                             bool                      succeeded)
+{
+   mongoc_span_tracer_t *tracer = &cluster->client->tracer;
+
+   if (!request->traced) {
+      return;
+   }
+
+   request->span.succeeded = succeeded;
+   tracer->cb (&request->span, tracer->context);
+   request->traced = false;
+}
+
+
+/*
+ * log a request in the slow op log if it took slowOpThresholdMS or more.
+ * @now is when its reply was read, 0 if it failed first: only then is the
+ * clock read again
+ */
+static void
+_mongoc_cluster_check_slow_op (mongoc_cluster_t         *cluster,
+                               mongoc_cluster_request_t *request,
+                               int64_t                   now,
+                               const bson_t             *reply,
+                               bool                      succeeded)
+{
+   if (!request->monitored) {
+      return;
+   }
+
+   if (!now) {
+      now = bson_get_monotonic_time ();
+   }
+
+   if (now - request->started < 1000 * (int64_t) cluster->slowopthresholdms) {
+      return;
+   }
+
+   request->span.succeeded = succeeded;
+   _mongoc_slow_op_record (now - request->started, &request->span,
+                           request->host, request->command,
+                           reply ? (int64_t) reply->len : 0);
+}
+
+
+/*
+ * the keyed counter group of namespace "@db.@coll", or of @db if @coll is
+ * NULL. the last one found is kept: a client's commands are usually on
+ * the same namespace as its previous one
+ */
+static mongoc_counter_slots_t *
+_mongoc_cluster_ns_counters (mongoc_cluster_t *cluster,
+                             const char       *db,
+                             const char       *coll)
+{
+   char *ns = cluster->keyed_ns;
+   size_t len = strlen (db);
+
+   if (cluster->keyed_ns_counters && !strncmp (ns, db, len) &&
+       (coll ? ns[len] == '.' && !strcmp (ns + len + 1, coll)
+             : ns[len] == '\0')) {
+      return cluster->keyed_ns_counters;
+   }
+
+   if (coll) {
+      bson_snprintf (ns, sizeof cluster->keyed_ns, "%s.%s", db, coll);
+   } else {
+      bson_strncpy (ns, db, sizeof cluster->keyed_ns);
+   }
+
+   cluster->keyed_ns_counters = _mongoc_counters_keyed (
+      MONGOC_KEYED_NAMESPACE, ns);
+
+   return cluster->keyed_ns_counters;
+}
+
+
+/*
+ * find a request's keyed counter groups: its server's, unless the caller
+ * set them, and its namespace's, the command's collection if its first
+ * value is one, otherwise "db.$cmd"
+ */
+static void
+_mongoc_cluster_keyed_begin (mongoc_cluster_t         *cluster,
+                             mongoc_cluster_request_t *request,
+                             const bson_t             *command)
+{
+   const char *coll = "$cmd";
+   bson_iter_t iter;
+
+   if (!request->host) {
+      /* handshake and auth commands */
+      request->server_counters = NULL;
+      request->ns_counters = NULL;
+      return;
+   }
+
+   if (bson_iter_init (&iter, command) && bson_iter_next (&iter)) {
+      if (BSON_ITER_HOLDS_UTF8 (&iter)) {
+         coll = bson_iter_utf8 (&iter, NULL);
+      } else if (!strcmp (bson_iter_key (&iter), "getMore") &&
+                 bson_iter_find (&iter, "collection") &&
+                 BSON_ITER_HOLDS_UTF8 (&iter)) {
+         coll = bson_iter_utf8 (&iter, NULL);
+      }
+   }
+
+   if (!request->server_counters) {
+      request->server_counters = _mongoc_counters_keyed (
+         MONGOC_KEYED_SERVER, request->host->host_and_port);
+   }
+
+   request->ns_counters = _mongoc_cluster_ns_counters (
+      cluster, request->db_name, coll);
+}
+
+
+static void
+_mongoc_cluster_keyed_add (mongoc_cluster_request_t *request,
+                           mongoc_keyed_slot_t       slot,
+                           int64_t                   val)
+{
+   if (request->server_counters) {
+      _mongoc_keyed_counter_add (request->server_counters, slot, val);
+      _mongoc_keyed_counter_add (request->ns_counters, slot, val);
+   }
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
- * mongoc_cluster_run_command_internal --
+ * mongoc_cluster_span_phase --
  *
- *       Internal function to run a command on a given stream.
- *       @error and @reply are optional out-pointers.
+ *       Record a phase that comes before the next command is sent, such
+ *       as server selection, if the client traces spans. The command's
+ *       span includes it.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+mongoc_cluster_span_phase (mongoc_cluster_t    *cluster,
+                           mongoc_span_phase_t  phase,
+                           int64_t              start,
+                           int64_t              end)
+{
+   mongoc_span_t *pending = &cluster->span_pending;
+
+   if (!cluster->client->tracer.cb && !cluster->slowopthresholdms) {
+      return;
+   }
+
+   /* an operation begins with checkout or selection: forget phases of one
+    * that failed before sending a command */
+   if (phase == MONGOC_SPAN_POOL_CHECKOUT) {
+      pending->phases = 0;
+   } else if (phase == MONGOC_SPAN_SERVER_SELECTION) {
+      pending->phases &= (1u << MONGOC_SPAN_POOL_CHECKOUT);
+   }
+
+   _mongoc_span_record (pending, phase, start, end);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_send_command --
+ *
+ *       Send a command on @request's stream without waiting for the
+ *       reply; see _mongoc_cluster_recv_reply. The caller fills out
+ *       @request's stream, server_id, host, db_name and monitored fields.
+ *
+ *       If @n_payload is nonzero, @payload holds more BSON elements that
+ *       are sent as part of @command, after its own elements, without
+ *       copying either into one buffer.
+ *
+ *       If @request is unacknowledged, the command is sent as an OP_MSG
+ *       with the moreToCome flag, and the server sends no reply.
  *
  * Returns:
  *       true if successful; otherwise false and @error is set.
  *
  * Side effects:
- *       @reply is set and should ALWAYS be released with bson_destroy().
- *       On failure, @error is filled out. If this was a network error
- *       and server_id is nonzero, the cluster disconnects from the server.
+ *       Sets @request's command, command_name, request_id and started
+ *       fields. @command must outlive the request. On a network error, if
+ *       server_id is nonzero, the cluster disconnects from the server.
+ *       Counts the request in its server's and namespace's keyed counter
+ *       groups; it is in flight until its reply is received.
  *
  *--------------------------------------------------------------------------
  */
 
-bool
-mongoc_cluster_run_command_internal (mongoc_cluster_t         *cluster,
-                                     mongoc_stream_t          *stream,
-                                     uint32_t                  server_id,
-                                     mongoc_query_flags_t      flags,
-                                     const char               *db_name,
-                                     const bson_t             *command,
-                                     bool                      monitored,
-                                     const mongoc_host_list_t *host,
-                                     bson_t                   *reply,
-                                     bson_error_t             *error)
+static bool
+_mongoc_cluster_send_command (mongoc_cluster_t         *cluster,
+                              mongoc_cluster_request_t *request,
+                              mongoc_query_flags_t      flags,
+                              const bson_t             *command,
+                              const mongoc_iovec_t     *payload,
+                              size_t                    n_payload,
+                              bson_error_t             *error)
 {
-   int64_t started;
    const char *command_name;
+   const char *db_name = request->db_name;
    mongoc_apm_callbacks_t *callbacks;
    mongoc_array_t ar;                /* data to server */
-   const size_t reply_header_size = sizeof (mongoc_rpc_reply_header_t);
-   uint8_t reply_header_buf[sizeof (mongoc_rpc_reply_header_t)];
-   uint8_t *reply_buf;               /* reply body */
    mongoc_rpc_t rpc;                 /* sent to server */
-   bson_error_t err_local;           /* in case the passed-in "error" is NULL */
-   bson_t reply_local;
-   bson_t *reply_ptr;
    char cmd_ns[MONGOC_NAMESPACE_MAX];
-   uint32_t request_id;
-   int32_t msg_len;
-   size_t doc_len;
    mongoc_apm_command_started_t started_event;
-   mongoc_apm_command_succeeded_t succeeded_event;
-   mongoc_apm_command_failed_t failed_event;
+   mongoc_iovec_t *query_iov;
+   mongoc_iovec_t iov;
+   const uint8_t zero = 0;
+   uint32_t payload_len = 0;
+   uint32_t command_len_le;
+   uint8_t op_msg_prefix[16 + 4 + 1];
+   bson_t db_element = BSON_INITIALIZER;
+   uint32_t u32_le;
+   int64_t msg_len;
+   int64_t sent;
+   size_t i;
+   bool timed_out = false;
    bool ret = false;
 
    ENTRY;
 
-   BSON_ASSERT(cluster);
-   BSON_ASSERT(stream);
+   BSON_ASSERT (request->stream);
+   BSON_ASSERT (payload || !n_payload);
 
-   started = bson_get_monotonic_time ();
+   request->started = bson_get_monotonic_time ();
 
    /*
     * setup
     */
-   reply_ptr = reply ? reply : &reply_local;
-   bson_init (reply_ptr);
    command_name = _mongoc_get_command_name (command);
    BSON_ASSERT (command_name);
+   request->command_name = command_name;
+   request->command = command;
    callbacks = &cluster->client->apm_callbacks;
    _mongoc_array_init (&ar, sizeof (mongoc_iovec_t));
 
-   if (!error) {
-      error = &err_local;
-   }
-
    error->code = 0;
 
+   for (i = 0; i < n_payload; i++) {
+      payload_len += (uint32_t) payload[i].iov_len;
+   }
+
    /*
     * prepare the request
     */
-   bson_snprintf (cmd_ns, sizeof cmd_ns, "%s.$cmd", db_name);
-   request_id = ++cluster->request_id;
-   _mongoc_rpc_prep_command (&rpc, cmd_ns, command, flags);
-   rpc.query.request_id = request_id;
-   _mongoc_rpc_gather (&rpc, &ar);
-   _mongoc_rpc_swab_to_le (&rpc);
-
-   if (monitored && callbacks->started) {
-      mongoc_apm_command_started_init (&started_event,
-                                       command,
-                                       db_name,
-                                       command_name,
-                                       request_id,
-                                       cluster->operation_id,
-                                       host,
-                                       server_id,
-                                       cluster->client->apm_context);
+   request->request_id = ++cluster->request_id;
+   request->traced = false;
+
+   _mongoc_cluster_keyed_begin (cluster, request, command);
+   _mongoc_cluster_keyed_add (request, MONGOC_KEYED_OPS, 1);
+   _mongoc_cluster_keyed_add (request, MONGOC_KEYED_IN_FLIGHT, 1);
+
+   if (request->monitored) {
+      request->traced = _mongoc_span_tracer_sample (&cluster->client->tracer);
+
+      /* the phases recorded since the last command are this one's */
+      if (request->traced || cluster->slowopthresholdms) {
+         memcpy (&request->span, &cluster->span_pending, sizeof request->span);
+         request->span.operation_id = cluster->operation_id;
+         request->span.request_id = request->request_id;
+         request->span.server_id = request->server_id;
+         request->span.command_name = command_name;
+         request->span.db_name = db_name;
+      }
+
+      cluster->span_pending.phases = 0;
+   }
+
+   if (request->unacknowledged) {
+      /* header, flagBits and a body section: the command's elements, the
+       * payload's, and "$db" */
+      BSON_APPEND_UTF8 (&db_element, "$db", db_name);
+
+      msg_len = (int64_t) (sizeof op_msg_prefix + command->len + payload_len +
+                           db_element.len - 5);
+      u32_le = BSON_UINT32_TO_LE ((uint32_t) msg_len);
+      memcpy (op_msg_prefix, &u32_le, 4);
+      u32_le = BSON_UINT32_TO_LE (request->request_id);
+      memcpy (op_msg_prefix + 4, &u32_le, 4);
+      u32_le = 0;
+      memcpy (op_msg_prefix + 8, &u32_le, 4);
+      u32_le = BSON_UINT32_TO_LE (MONGOC_OPCODE_OP_MSG);
+      memcpy (op_msg_prefix + 12, &u32_le, 4);
+      u32_le = BSON_UINT32_TO_LE (MONGOC_OP_MSG_MORE_TO_COME);
+      memcpy (op_msg_prefix + 16, &u32_le, 4);
+      op_msg_prefix[20] = 0;  /* section kind: body */
+
+      iov.iov_base = (void *) op_msg_prefix;
+      iov.iov_len = sizeof op_msg_prefix;
+      _mongoc_array_append_val (&ar, iov);
+
+      command_len_le = BSON_UINT32_TO_LE (command->len + payload_len +
+                                          db_element.len - 5);
+      iov.iov_base = (void *) &command_len_le;
+      iov.iov_len = 4;
+      _mongoc_array_append_val (&ar, iov);
+
+      iov.iov_base = (void *) (bson_get_data (command) + 4);
+      iov.iov_len = command->len - 5;
+      _mongoc_array_append_val (&ar, iov);
+      _mongoc_array_append_vals (&ar, payload, (uint32_t) n_payload);
+      iov.iov_base = (void *) (bson_get_data (&db_element) + 4);
+      iov.iov_len = db_element.len - 5;
+      _mongoc_array_append_val (&ar, iov);
+      iov.iov_base = (void *) &zero;
+      iov.iov_len = 1;
+      _mongoc_array_append_val (&ar, iov);
+   } else {
+      bson_snprintf (cmd_ns, sizeof cmd_ns, "%s.$cmd", db_name);
+      _mongoc_rpc_prep_command (&rpc, cmd_ns, command, flags);
+      rpc.query.request_id = request->request_id;
+      _mongoc_rpc_gather (&rpc, &ar);
+
+      if (n_payload) {
+         /* the last iovec is the command document: replace it with the new
+          * length and the command's elements, then the payload's elements
+          * and the document's terminating NUL */
+         query_iov = &_mongoc_array_index (&ar, mongoc_iovec_t, ar.len - 1);
+         command_len_le = BSON_UINT32_TO_LE (command->len + payload_len);
+         query_iov->iov_base = (void *) &command_len_le;
+         query_iov->iov_len = 4;
+
+         iov.iov_base = (void *) (bson_get_data (command) + 4);
+         iov.iov_len = command->len - 5;
+         _mongoc_array_append_val (&ar, iov);
+         _mongoc_array_append_vals (&ar, payload, (uint32_t) n_payload);
+         iov.iov_base = (void *) &zero;
+         iov.iov_len = 1;
+         _mongoc_array_append_val (&ar, iov);
+
+         rpc.query.msg_len += (int32_t) payload_len;
+      }
+
+      msg_len = rpc.query.msg_len;
+      _mongoc_rpc_swab_to_le (&rpc);
+   }
+
+   if (request->monitored && callbacks->started) {
+      /* the event borrows the command and payload, it only joins them into
+       * one document if the callback asks for it */
+      mongoc_apm_command_started_init (
+         &started_event,
+         (callbacks->skip & MONGOC_APM_SKIP_COMMAND) ? NULL : command,
+         payload,
+         n_payload,
+         db_name,
+         command_name,
+         request->request_id,
+         cluster->operation_id,
+         request->host,
+         request->server_id,
+         cluster->client->apm_context);
 
       callbacks->started (&started_event);
       mongoc_apm_command_started_cleanup (&started_event);
@@ -224,11 +522,16 @@ mongoc_cluster_run_command_internal (mongoc_cluster_t         *cluster,
    }
 
    /*
-    * send and receive
+    * send
     */
-   if (!_mongoc_stream_writev_full (stream, (mongoc_iovec_t *)ar.data, ar.len,
+   sent = request->traced ? bson_get_monotonic_time () : 0;
+   errno = 0;
+   if (!_mongoc_stream_writev_full (request->stream,
+                                    (mongoc_iovec_t *)ar.data, ar.len,
                                     cluster->sockettimeoutms, error)) {
-      mongoc_cluster_disconnect_node (cluster, server_id);
+      timed_out = MONGOC_ERRNO_IS_TIMEDOUT (errno);
+      mongoc_cluster_disconnect_node (cluster, request->server_id,
+                                      MONGOC_CONNECTION_CLOSED_NETWORK_ERROR);
 
       /* add info about the command to writev_full's error message */
       _bson_error_message_printf (
@@ -239,127 +542,666 @@ mongoc_cluster_run_command_internal (mongoc_cluster_t         *cluster,
       GOTO (done);
    }
 
-   if (reply_header_size != mongoc_stream_read (stream, &reply_header_buf,
-                                           reply_header_size, reply_header_size,
-                                           cluster->sockettimeoutms)) {
-      mongoc_cluster_disconnect_node (cluster, server_id);
-      RUN_CMD_ERR (MONGOC_ERROR_STREAM, MONGOC_ERROR_STREAM_SOCKET,
-                   "socket error or timeout");
+   if (request->traced) {
+      _mongoc_span_record (&request->span, MONGOC_SPAN_SEND, sent,
+                           bson_get_monotonic_time ());
+   }
+
+   _mongoc_cluster_keyed_add (request, MONGOC_KEYED_BYTES_OUT, msg_len);
+   _mongoc_connection_stats_add_bytes (request->connection_stats, msg_len, 0);
+
+   ret = true;
+
+done:
+   _mongoc_array_destroy (&ar);
+   bson_destroy (&db_element);
+
+   if (!ret) {
+      _mongoc_cluster_request_failed (cluster, request, error);
+      _mongoc_cluster_keyed_add (request, MONGOC_KEYED_ERRORS, 1);
+      _mongoc_cluster_keyed_add (request, MONGOC_KEYED_TIMEOUTS, timed_out);
+   }
+
+   if (!ret || request->unacknowledged) {
+      /* no reply to wait for */
+      _mongoc_cluster_keyed_add (request, MONGOC_KEYED_IN_FLIGHT, -1);
+      _mongoc_cluster_span_finish (cluster, request, ret);
+   }
+
+   RETURN (ret);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_recv_reply --
+ *
+ *       Receive the reply to a command sent with
+ *       _mongoc_cluster_send_command. Commands pipelined on one stream
+ *       must be received in the order they were sent.
+ *
+ * Returns:
+ *       true if successful; otherwise false and @error is set.
+ *
+ * Side effects:
+ *       @reply is set and should ALWAYS be released with bson_destroy().
+ *       On failure, @error is filled out. If this was a network error or
+ *       an invalid reply, the cluster disconnects from the server.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_cluster_recv_reply (mongoc_cluster_t         *cluster,
+                            mongoc_cluster_request_t *request,
+                            bson_t                   *reply,
+                            bson_error_t             *error)
+{
+   const char *command_name = request->command_name;
+   const char *db_name = request->db_name;
+   mongoc_apm_callbacks_t *callbacks;
+   const size_t reply_header_size = sizeof (mongoc_rpc_reply_header_t);
+   uint8_t reply_header_buf[sizeof (mongoc_rpc_reply_header_t)];
+   uint8_t *reply_buf;               /* reply body */
+   mongoc_rpc_t rpc;
+   bson_t reply_local;
+   bson_t *reply_ptr;
+   int32_t msg_len;
+   size_t doc_len;
+   mongoc_apm_command_succeeded_t succeeded_event;
+   int64_t header_received = 0;
+   int64_t now = 0;
+   bool timed_out = false;
+   bool ok;
+   bool ret = false;
+
+   ENTRY;
+
+   reply_ptr = reply ? reply : &reply_local;
+   bson_init (reply_ptr);
+   callbacks = &cluster->client->apm_callbacks;
+
+   error->code = 0;
+   errno = 0;
+
+   if (reply_header_size != mongoc_stream_read (request->stream,
+                                                &reply_header_buf,
+                                                reply_header_size,
+                                                reply_header_size,
+                                                cluster->sockettimeoutms)) {
+      timed_out = MONGOC_ERRNO_IS_TIMEDOUT (errno);
+      mongoc_cluster_disconnect_node (cluster, request->server_id,
+                                      MONGOC_CONNECTION_CLOSED_NETWORK_ERROR);
+      RUN_CMD_ERR (MONGOC_ERROR_STREAM, MONGOC_ERROR_STREAM_SOCKET,
+                   "socket error or timeout");
+
+      GOTO (done);
+   }
+
+   if (request->traced) {
+      header_received = bson_get_monotonic_time ();
+      _mongoc_span_record (&request->span, MONGOC_SPAN_SERVER,
+                           request->span.end[MONGOC_SPAN_SEND],
+                           header_received);
+   }
+
+   memcpy (&msg_len, reply_header_buf, 4);
+   msg_len = BSON_UINT32_FROM_LE (msg_len);
+   if ((msg_len < reply_header_size) ||
+       (msg_len > MONGOC_DEFAULT_MAX_MSG_SIZE) ||
+       !_mongoc_rpc_scatter_reply_header_only (&rpc, reply_header_buf,
+                                               reply_header_size)) {
+      GOTO (invalid_reply);
+   }
+
+   _mongoc_rpc_swab_from_le (&rpc);
+   if (rpc.header.opcode != MONGOC_OPCODE_REPLY ||
+       rpc.header.response_to != request->request_id ||
+       rpc.reply_header.n_returned != 1) {
+      GOTO (invalid_reply);
+   }
+
+   doc_len = (size_t) msg_len - reply_header_size;
+   reply_buf = bson_reserve_buffer (reply_ptr, (uint32_t) doc_len);
+   BSON_ASSERT (reply_buf);
+
+   if (doc_len != mongoc_stream_read (request->stream, (void *) reply_buf,
+                                      doc_len, doc_len,
+                                      cluster->sockettimeoutms)) {
+      timed_out = MONGOC_ERRNO_IS_TIMEDOUT (errno);
+      mongoc_cluster_disconnect_node (cluster, request->server_id,
+                                      MONGOC_CONNECTION_CLOSED_NETWORK_ERROR);
+      RUN_CMD_ERR (MONGOC_ERROR_STREAM, MONGOC_ERROR_STREAM_SOCKET,
+                   "socket error or timeout");
+
+      GOTO (done);
+   }
+
+   _mongoc_cluster_keyed_add (request, MONGOC_KEYED_BYTES_IN, msg_len);
+   _mongoc_connection_stats_add_bytes (request->connection_stats, 0, msg_len);
+
+   now = bson_get_monotonic_time ();
+   mongoc_histogram_command_rtt_record (now - request->started);
+
+   ok = !_mongoc_populate_cmd_error (reply_ptr,
+                                     cluster->client->error_api_version,
+                                     error);
+
+   if (request->traced) {
+      _mongoc_span_record (&request->span, MONGOC_SPAN_RECV, header_received,
+                           bson_get_monotonic_time ());
+   }
+
+   if (!ok) {
+      GOTO (done);
+   }
+
+   ret = true;
+   if (request->monitored && callbacks->succeeded) {
+      mongoc_apm_command_succeeded_init (&succeeded_event,
+                                         bson_get_monotonic_time () -
+                                            request->started,
+                                         (callbacks->skip &
+                                          MONGOC_APM_SKIP_REPLY) ? NULL
+                                                                 : reply_ptr,
+                                         command_name,
+                                         request->request_id,
+                                         cluster->operation_id,
+                                         request->host,
+                                         request->server_id,
+                                         cluster->client->apm_context);
+
+      callbacks->succeeded (&succeeded_event);
+      mongoc_apm_command_succeeded_cleanup (&succeeded_event);
+   }
+
+invalid_reply:
+   if (!ret) {
+      /* the rest of the reply is unread or not ours: the stream is out of
+       * sync with the server */
+      mongoc_cluster_disconnect_node (cluster, request->server_id,
+                                      MONGOC_CONNECTION_CLOSED_PROTOCOL_ERROR);
+      RUN_CMD_ERR (MONGOC_ERROR_PROTOCOL,
+                   MONGOC_ERROR_PROTOCOL_INVALID_REPLY,
+                   "Invalid reply from server.");
+   }
+
+done:
+   if (!ret) {
+      _mongoc_cluster_request_failed (cluster, request, error);
+      _mongoc_cluster_keyed_add (request, MONGOC_KEYED_ERRORS, 1);
+      _mongoc_cluster_keyed_add (request, MONGOC_KEYED_TIMEOUTS, timed_out);
+   }
+
+   _mongoc_cluster_keyed_add (request, MONGOC_KEYED_IN_FLIGHT, -1);
+
+   if (cluster->slowopthresholdms) {
+      _mongoc_cluster_check_slow_op (cluster, request, now, reply_ptr, ret);
+   }
+
+   _mongoc_cluster_span_finish (cluster, request, ret);
+
+   if (reply_ptr == &reply_local) {
+      bson_destroy (reply_ptr);
+   }
+
+   RETURN (ret);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_cluster_run_command_internal --
+ *
+ *       Internal function to run a command on a given stream.
+ *       @error and @reply are optional out-pointers.
+ *
+ * Returns:
+ *       true if successful; otherwise false and @error is set.
+ *
+ * Side effects:
+ *       @reply is set and should ALWAYS be released with bson_destroy().
+ *       On failure, @error is filled out. If this was a network error
+ *       and server_id is nonzero, the cluster disconnects from the server.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+mongoc_cluster_run_command_internal (mongoc_cluster_t         *cluster,
+                                     mongoc_stream_t          *stream,
+                                     uint32_t                  server_id,
+                                     mongoc_query_flags_t      flags,
+                                     const char               *db_name,
+                                     const bson_t             *command,
+                                     bool                      monitored,
+                                     const mongoc_host_list_t *host,
+                                     bson_t                   *reply,
+                                     bson_error_t             *error)
+{
+   mongoc_cluster_request_t request;
+   bson_error_t err_local;           /* in case the passed-in "error" is NULL */
+
+   ENTRY;
+
+   BSON_ASSERT(cluster);
+   BSON_ASSERT(stream);
+
+   if (!error) {
+      error = &err_local;
+   }
+
+   request.stream = stream;
+   request.server_id = server_id;
+   request.host = host;
+   request.connection_stats = NULL;
+   request.server_counters = NULL;
+   request.db_name = db_name;
+   request.monitored = monitored;
+   request.unacknowledged = false;
+
+   if (!_mongoc_cluster_send_command (cluster, &request, flags, command,
+                                      NULL, 0, error)) {
+      if (reply) {
+         bson_init (reply);
+      }
+
+      RETURN (false);
+   }
+
+   RETURN (_mongoc_cluster_recv_reply (cluster, &request, reply, error));
+}
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_cluster_run_command_monitored --
+ *
+ *       Internal function to run a command on a given stream.
+ *       @error and @reply are optional out-pointers.
+ *
+ * Returns:
+ *       true if successful; otherwise false and @error is set.
+ *
+ * Side effects:
+ *       If the client's APM callbacks are set, they are executed.
+ *       If a server selection policy is set, the server's load is updated.
+ *       @reply is set and should ALWAYS be released with bson_destroy().
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+mongoc_cluster_run_command_monitored (mongoc_cluster_t         *cluster,
+                                      mongoc_server_stream_t   *server_stream,
+                                      mongoc_query_flags_t      flags,
+                                      const char               *db_name,
+                                      const bson_t             *command,
+                                      bson_t                   *reply,
+                                      bson_error_t             *error)
+{
+   return mongoc_cluster_run_command_payload (cluster, server_stream, flags,
+                                              db_name, command, NULL, 0,
+                                              reply, error);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_cluster_run_command_payload --
+ *
+ *       Like mongoc_cluster_run_command_monitored, but the command sent
+ *       is @command's elements followed by the BSON elements in @payload,
+ *       which are gathered into the message without being copied.
+ *
+ * Returns:
+ *       true if successful; otherwise false and @error is set.
+ *
+ * Side effects:
+ *       If the client's APM callbacks are set, they are executed.
+ *       If a server selection policy is set, the server's load is updated.
+ *       @reply is set and should ALWAYS be released with bson_destroy().
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+mongoc_cluster_run_command_payload (mongoc_cluster_t         *cluster,
+                                    mongoc_server_stream_t   *server_stream,
+                                    mongoc_query_flags_t      flags,
+                                    const char               *db_name,
+                                    const bson_t             *command,
+                                    const mongoc_iovec_t     *payload,
+                                    size_t                    n_payload,
+                                    bson_t                   *reply,
+                                    bson_error_t             *error)
+{
+   mongoc_cluster_request_t request;
+
+   if (!mongoc_cluster_send_command (cluster, server_stream, flags, db_name,
+                                     command, payload, n_payload, &request,
+                                     error)) {
+      if (reply) {
+         bson_init (reply);
+      }
+
+      return false;
+   }
+
+   return mongoc_cluster_recv_reply (cluster, server_stream, &request,
+                                     reply, error);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_cluster_send_command --
+ *
+ *       Send a command to @server_stream's server without waiting for the
+ *       reply, which the caller must then receive with
+ *       mongoc_cluster_recv_reply. Several commands may be in flight on
+ *       one stream; their replies are received in the order sent.
+ *
+ *       @command and @payload are as for
+ *       mongoc_cluster_run_command_payload. @command and @db_name must
+ *       outlive @request.
+ *
+ * Returns:
+ *       true if successful; otherwise false and @error is set.
+ *
+ * Side effects:
+ *       If the client's APM callbacks are set, they are executed.
+ *       If a server selection policy is set, the server's load is updated.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+mongoc_cluster_send_command (mongoc_cluster_t         *cluster,
+                             mongoc_server_stream_t   *server_stream,
+                             mongoc_query_flags_t      flags,
+                             const char               *db_name,
+                             const bson_t             *command,
+                             const mongoc_iovec_t     *payload,
+                             size_t                    n_payload,
+                             mongoc_cluster_request_t *request,
+                             bson_error_t             *error)
+{
+   mongoc_topology_t *topology = cluster->client->topology;
+   bson_error_t err_local;
+
+   BSON_ASSERT (cluster);
+   BSON_ASSERT (server_stream);
+   BSON_ASSERT (request);
+
+   if (!error) {
+      error = &err_local;
+   }
+
+   request->stream = server_stream->stream;
+   request->server_id = server_stream->sd->id;
+   request->host = &server_stream->sd->host;
+   request->connection_stats = server_stream->connection_stats;
+   request->server_counters = server_stream->keyed_counters;
+   request->db_name = db_name;
+   request->monitored = true;
+   request->unacknowledged = false;
+
+   mongoc_topology_op_started (topology, request->server_id);
+
+   if (!_mongoc_cluster_send_command (cluster, request, flags, command,
+                                      payload, n_payload, error)) {
+      mongoc_topology_op_finished (
+         topology, request->server_id,
+         bson_get_monotonic_time () - request->started, false);
+
+      return false;
+   }
+
+   return true;
+}
+
+
+/*
+ * a connection that only sends unacknowledged commands never reads, so
+ * it wouldn't notice the server had gone away or rejected a message.
+ * verify it with a ping every socketCheckIntervalMS; the server answers
+ * after processing all the messages sent before it
+ */
+static bool
+_mongoc_cluster_check_unacknowledged (mongoc_cluster_t       *cluster,
+                                      mongoc_server_stream_t *server_stream,
+                                      bson_error_t           *error)
+{
+   uint32_t server_id = server_stream->sd->id;
+   int64_t *checked_at;
+   int64_t now;
+   bson_t command;
+   bool r;
+
+   now = bson_get_monotonic_time ();
+   checked_at = (int64_t *) mongoc_set_get (cluster->unack_checked_at,
+                                            server_id);
+
+   if (!checked_at) {
+      /* first unacknowledged send since the connection was made */
+      checked_at = (int64_t *) bson_malloc (sizeof *checked_at);
+      *checked_at = now;
+      mongoc_set_add (cluster->unack_checked_at, server_id, checked_at);
+      return true;
+   }
+
+   if (*checked_at + 1000 * (int64_t) cluster->socketcheckintervalms > now) {
+      return true;
+   }
+
+   /* set first, a failed ping disconnects and frees checked_at */
+   *checked_at = now;
 
-      GOTO (done);
-   }
+   bson_init (&command);
+   BSON_APPEND_INT32 (&command, "ping", 1);
+   r = mongoc_cluster_run_command (cluster, server_stream->stream, server_id,
+                                   MONGOC_QUERY_SLAVE_OK, "admin", &command,
+                                   NULL, error);
+   bson_destroy (&command);
 
-   memcpy (&msg_len, reply_header_buf, 4);
-   msg_len = BSON_UINT32_FROM_LE (msg_len);
-   if ((msg_len < reply_header_size) || (msg_len > MONGOC_DEFAULT_MAX_MSG_SIZE)) {
-      GOTO (done);
-   }
+   return r;
+}
 
-   if (!_mongoc_rpc_scatter_reply_header_only (&rpc, reply_header_buf,
-                                               reply_header_size)) {
-      GOTO (done);
-   }
 
-   _mongoc_rpc_swab_from_le (&rpc);
-   if (rpc.header.opcode != MONGOC_OPCODE_REPLY ||
-       rpc.reply_header.n_returned != 1) {
-      GOTO (done);
-   }
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_cluster_send_unacknowledged --
+ *
+ *       Send a command with an unacknowledged write concern, as an OP_MSG
+ *       the server won't reply to. @server_stream's server must support
+ *       OP_MSG, see WIRE_VERSION_OP_MSG. @command and @payload are as for
+ *       mongoc_cluster_run_command_payload.
+ *
+ *       Every socketCheckIntervalMS the connection is verified with a
+ *       roundtrip, which fails if the server has closed it.
+ *
+ * Returns:
+ *       true if the command was sent; otherwise false and @error is set.
+ *
+ * Side effects:
+ *       If the client's APM callbacks are set, they are executed, with
+ *       a reply of {ok: 1}.
+ *
+ *--------------------------------------------------------------------------
+ */
 
-   doc_len = (size_t) msg_len - reply_header_size;
-   reply_buf = bson_reserve_buffer (reply_ptr, (uint32_t) doc_len);
-   BSON_ASSERT (reply_buf);
+bool
+mongoc_cluster_send_unacknowledged (mongoc_cluster_t         *cluster,
+                                    mongoc_server_stream_t   *server_stream,
+                                    const char               *db_name,
+                                    const bson_t             *command,
+                                    const mongoc_iovec_t     *payload,
+                                    size_t                    n_payload,
+                                    bson_error_t             *error)
+{
+   mongoc_topology_t *topology = cluster->client->topology;
+   mongoc_apm_callbacks_t *callbacks = &cluster->client->apm_callbacks;
+   mongoc_apm_command_succeeded_t succeeded_event;
+   mongoc_cluster_request_t request;
+   bson_error_t err_local;
+   bson_t fake_reply = BSON_INITIALIZER;
+   bool ret;
 
-   if (doc_len != mongoc_stream_read (stream, (void *) reply_buf, doc_len,
-                                      doc_len, cluster->sockettimeoutms)) {
-      RUN_CMD_ERR (MONGOC_ERROR_STREAM, MONGOC_ERROR_STREAM_SOCKET,
-                   "socket error or timeout");
-   }
+   BSON_ASSERT (cluster);
+   BSON_ASSERT (server_stream);
+   BSON_ASSERT (server_stream->sd->max_wire_version >= WIRE_VERSION_OP_MSG);
 
-   if (_mongoc_populate_cmd_error (reply_ptr,
-                                   cluster->client->error_api_version,
-                                   error)) {
-      GOTO (done);
+   if (!error) {
+      error = &err_local;
    }
 
-   ret = true;
-   if (monitored && callbacks->succeeded) {
+   request.stream = server_stream->stream;
+   request.server_id = server_stream->sd->id;
+   request.host = &server_stream->sd->host;
+   request.connection_stats = server_stream->connection_stats;
+   request.server_counters = server_stream->keyed_counters;
+   request.db_name = db_name;
+   request.monitored = true;
+   request.unacknowledged = true;
+
+   mongoc_topology_op_started (topology, request.server_id);
+
+   ret = _mongoc_cluster_send_command (cluster, &request, MONGOC_QUERY_NONE,
+                                       command, payload, n_payload, error);
+
+   if (ret && callbacks->succeeded) {
+      /* as for legacy unacknowledged writes */
+      BSON_APPEND_INT32 (&fake_reply, "ok", 1);
       mongoc_apm_command_succeeded_init (&succeeded_event,
-                                         bson_get_monotonic_time () - started,
-                                         reply_ptr,
-                                         command_name,
-                                         request_id,
+                                         bson_get_monotonic_time () -
+                                            request.started,
+                                         &fake_reply,
+                                         request.command_name,
+                                         request.request_id,
                                          cluster->operation_id,
-                                         host,
-                                         server_id,
+                                         request.host,
+                                         request.server_id,
                                          cluster->client->apm_context);
 
       callbacks->succeeded (&succeeded_event);
       mongoc_apm_command_succeeded_cleanup (&succeeded_event);
    }
 
-done:
-   _mongoc_array_destroy (&ar);
-
-   if (!ret && error->code == 0) {
-      /* generic error */
-      RUN_CMD_ERR (MONGOC_ERROR_PROTOCOL,
-                   MONGOC_ERROR_PROTOCOL_INVALID_REPLY,
-                   "Invalid reply from server.");
-   }
-
-   if (!ret && monitored && callbacks->failed) {
-      mongoc_apm_command_failed_init (&failed_event,
-                                      bson_get_monotonic_time () - started,
-                                      command_name,
-                                      error,
-                                      request_id,
-                                      cluster->operation_id,
-                                      host,
-                                      server_id,
-                                      cluster->client->apm_context);
+   mongoc_topology_op_finished (topology, request.server_id,
+                                bson_get_monotonic_time () - request.started,
+                                ret);
 
-      callbacks->failed (&failed_event);
-      mongoc_apm_command_failed_cleanup (&failed_event);
+   if (ret) {
+      ret = _mongoc_cluster_check_unacknowledged (cluster, server_stream,
+                                                  error);
    }
 
-   if (reply_ptr == &reply_local) {
-      bson_destroy (reply_ptr);
-   }
+   bson_destroy (&fake_reply);
 
-   RETURN (ret);
+   return ret;
 }
 
+
 /*
  *--------------------------------------------------------------------------
  *
- * mongoc_cluster_run_command_monitored --
+ * mongoc_cluster_recv_reply --
  *
- *       Internal function to run a command on a given stream.
- *       @error and @reply are optional out-pointers.
+ *       Receive the reply to the oldest command in flight on
+ *       @server_stream, sent with mongoc_cluster_send_command as
+ *       @request.
  *
  * Returns:
  *       true if successful; otherwise false and @error is set.
  *
  * Side effects:
  *       If the client's APM callbacks are set, they are executed.
+ *       If a server selection policy is set, the server's load is updated.
  *       @reply is set and should ALWAYS be released with bson_destroy().
  *
  *--------------------------------------------------------------------------
  */
 
 bool
-mongoc_cluster_run_command_monitored (mongoc_cluster_t         *cluster,
-                                      mongoc_server_stream_t   *server_stream,
-                                      mongoc_query_flags_t      flags,
-                                      const char               *db_name,
-                                      const bson_t             *command,
-                                      bson_t                   *reply,
-                                      bson_error_t             *error)
+mongoc_cluster_recv_reply (mongoc_cluster_t         *cluster,
+                           mongoc_server_stream_t   *server_stream,
+                           mongoc_cluster_request_t *request,
+                           bson_t                   *reply,
+                           bson_error_t             *error)
+{
+   mongoc_topology_t *topology = cluster->client->topology;
+   bson_error_t err_local;
+   bool ret;
+
+   BSON_ASSERT (cluster);
+   BSON_ASSERT (server_stream);
+   BSON_ASSERT (request);
+   BSON_ASSERT (request->stream == server_stream->stream);
+
+   if (!error) {
+      error = &err_local;
+   }
+
+   ret = _mongoc_cluster_recv_reply (cluster, request, reply, error);
+
+   mongoc_topology_op_finished (topology, request->server_id,
+                                bson_get_monotonic_time () - request->started,
+                                ret);
+
+   return ret;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_cluster_abandon_request --
+ *
+ *       Give up on the reply to @request, sent with
+ *       mongoc_cluster_send_command, because its connection was closed
+ *       before it was read. Call this for each request still in flight
+ *       when a pipeline stops, instead of mongoc_cluster_recv_reply.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       The request fails with @error: the client's APM failed callback,
+ *       its span and its keyed counters see it as for a network error,
+ *       and it is no longer in flight. If a server selection policy is
+ *       set, the server's load is updated.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+mongoc_cluster_abandon_request (mongoc_cluster_t         *cluster,
+                                mongoc_cluster_request_t *request,
+                                const bson_error_t       *error)
 {
-   return mongoc_cluster_run_command_internal (
-      cluster, server_stream->stream, server_stream->sd->id, flags, db_name,
-      command, true, &server_stream->sd->host, reply, error);
+   BSON_ASSERT (cluster);
+   BSON_ASSERT (request);
+   BSON_ASSERT (error);
+
+   _mongoc_cluster_request_failed (cluster, request, error);
+   _mongoc_cluster_keyed_add (request, MONGOC_KEYED_ERRORS, 1);
+   _mongoc_cluster_keyed_add (request, MONGOC_KEYED_IN_FLIGHT, -1);
+
+   if (cluster->slowopthresholdms) {
+      _mongoc_cluster_check_slow_op (cluster, request, 0, NULL, false);
+   }
+
+   _mongoc_cluster_span_finish (cluster, request, false);
+
+   mongoc_topology_op_finished (cluster->client->topology, request->server_id,
+                                bson_get_monotonic_time () - request->started,
+                                false);
 }
 
 
@@ -1265,7 +2107,8 @@ _mongoc_cluster_auth_node (mongoc_cluster_t *cluster,
  * mongoc_cluster_disconnect_node --
  *
  *       Remove a node from the set of nodes. This should be done if
- *       a stream in the set is found to be invalid.
+ *       a stream in the set is found to be invalid. @reason is counted
+ *       in the connection stats, see mongoc_client_get_connection_stats.
  *
  *       WARNING: pointers to a disconnected mongoc_cluster_node_t or
  *       its stream are now invalid, be careful of dangling pointers.
@@ -1281,11 +2124,15 @@ _mongoc_cluster_auth_node (mongoc_cluster_t *cluster,
  */
 
 void
-mongoc_cluster_disconnect_node (mongoc_cluster_t *cluster, uint32_t server_id)
+mongoc_cluster_disconnect_node (mongoc_cluster_t                 *cluster,
+                                uint32_t                          server_id,
+                                mongoc_connection_close_reason_t  reason)
 {
    mongoc_topology_t *topology = cluster->client->topology;
    ENTRY;
 
+   mongoc_set_rm (cluster->unack_checked_at, server_id);
+
    if (topology->single_threaded) {
       mongoc_topology_scanner_node_t *scanner_node;
 
@@ -1293,25 +2140,73 @@ mongoc_cluster_disconnect_node (mongoc_cluster_t *cluster, uint32_t server_id)
 
       /* might never actually have connected */
       if (scanner_node && scanner_node->stream) {
+         _mongoc_connection_stats_closed (&scanner_node->conn, reason);
          mongoc_topology_scanner_node_disconnect (scanner_node, true);
          EXIT;
       }
       EXIT;
    } else {
-      mongoc_set_rm(cluster->nodes, server_id);
+      mongoc_cluster_node_t *cluster_node;
+
+      cluster_node = (mongoc_cluster_node_t *) mongoc_set_get (cluster->nodes,
+                                                               server_id);
+      if (cluster_node) {
+         cluster_node->close_reason = reason;
+         mongoc_set_rm (cluster->nodes, server_id);
+      }
    }
 
    EXIT;
 }
 
+
+static bool
+_mongoc_cluster_node_set_in_use_cb (void *item,
+                                    void *ctx)
+{
+   mongoc_cluster_node_t *node = (mongoc_cluster_node_t *) item;
+
+   _mongoc_connection_stats_set_in_use (&node->conn, *(bool *) ctx);
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_cluster_set_in_use --
+ *
+ *       Mark @cluster's connections in use when its client is popped from
+ *       a pool, or idle when it is pushed back.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       Connections made from now on are counted in use if @in_use.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+mongoc_cluster_set_in_use (mongoc_cluster_t *cluster,
+                           bool              in_use)
+{
+   cluster->in_use = in_use;
+   mongoc_set_for_each (cluster->nodes, _mongoc_cluster_node_set_in_use_cb,
+                        &in_use);
+}
+
 static void
 _mongoc_cluster_node_destroy (mongoc_cluster_node_t *node)
 {
    /* Failure, or Replica Set reconfigure without this node */
+   _mongoc_connection_stats_closed (&node->conn, node->close_reason);
    mongoc_stream_failed (node->stream);
    bson_free (node->connection_address);
 
-   bson_free (node);
+   _mongoc_memory_free (node);
 }
 
 static void
@@ -1323,6 +2218,13 @@ _mongoc_cluster_node_dtor (void *data_,
    _mongoc_cluster_node_destroy (node);
 }
 
+static void
+_mongoc_cluster_free_dtor (void *data_,
+                           void *ctx_)
+{
+   bson_free (data_);
+}
+
 static mongoc_cluster_node_t *
 _mongoc_cluster_node_new (mongoc_stream_t *stream,
                           const char      *connection_address)
@@ -1333,11 +2235,13 @@ _mongoc_cluster_node_new (mongoc_stream_t *stream,
       return NULL;
    }
 
-   node = (mongoc_cluster_node_t *)bson_malloc0(sizeof *node);
+   node = (mongoc_cluster_node_t *) _mongoc_memory_malloc0 (CLUSTER,
+                                                            sizeof *node);
 
    node->stream = stream;
    node->connection_address = bson_strdup (connection_address);
    node->timestamp = bson_get_monotonic_time ();
+   node->close_reason = MONGOC_CONNECTION_CLOSED_CLIENT;
 
    node->max_wire_version = MONGOC_DEFAULT_WIRE_VERSION;
    node->min_wire_version = MONGOC_DEFAULT_WIRE_VERSION;
@@ -1359,21 +2263,24 @@ _mongoc_cluster_node_new (mongoc_stream_t *stream,
  *       NOTE: does NOT check if this server is already in the cluster.
  *
  * Returns:
- *       A stream connected to the server, or NULL on failure.
+ *       A node connected to the server, or NULL on failure.
  *
  * Side effects:
  *       Adds a cluster node, or sets error on failure.
  *
  *--------------------------------------------------------------------------
  */
-static mongoc_stream_t *
+static mongoc_cluster_node_t *
 _mongoc_cluster_add_node (mongoc_cluster_t *cluster,
                           uint32_t          server_id,
                           bson_error_t     *error /* OUT */)
 {
+   mongoc_connection_stats_t *stats;
    mongoc_host_list_t *host = NULL;
    mongoc_cluster_node_t *cluster_node = NULL;
    mongoc_stream_t *stream;
+   int64_t started;
+   int64_t auth_started;
 
    ENTRY;
 
@@ -1389,11 +2296,15 @@ _mongoc_cluster_add_node (mongoc_cluster_t *cluster,
 
    TRACE ("Adding new server to cluster: %s", host->host_and_port);
 
+   stats = cluster->client->topology->connection_stats;
+   started = bson_get_monotonic_time ();
    stream = _mongoc_client_create_stream (cluster->client, host, error);
 
    if (!stream) {
       MONGOC_WARNING ("Failed connection to %s (%s)",
                       host->host_and_port, error->message);
+      _mongoc_connection_stats_connect_failed (stats, server_id,
+                                               host->host_and_port);
       GOTO (error);
    }
 
@@ -1402,22 +2313,36 @@ _mongoc_cluster_add_node (mongoc_cluster_t *cluster,
 
    if (!_mongoc_cluster_run_ismaster (cluster, cluster_node, server_id,
                                       error)) {
+      _mongoc_connection_stats_connect_failed (stats, server_id,
+                                               host->host_and_port);
       GOTO (error);
    }
 
+   mongoc_histogram_connect_record (bson_get_monotonic_time () - started);
+   _mongoc_connection_stats_opened (stats, &cluster_node->conn, server_id,
+                                    host->host_and_port, started,
+                                    cluster->in_use);
+
    if (cluster->requires_auth) {
+      auth_started = bson_get_monotonic_time ();
       if (!_mongoc_cluster_auth_node (cluster, cluster_node->stream, host->host,
                                       cluster_node->max_wire_version, error)) {
          MONGOC_WARNING ("Failed authentication to %s (%s)",
                          host->host_and_port, error->message);
+         cluster_node->close_reason = MONGOC_CONNECTION_CLOSED_HANDSHAKE;
          GOTO (error);
       }
+
+      _mongoc_connection_stats_auth (
+         &cluster_node->conn, bson_get_monotonic_time () - auth_started);
    }
 
+   mongoc_cluster_span_phase (cluster, MONGOC_SPAN_CONNECT, started,
+                              bson_get_monotonic_time ());
    mongoc_set_add (cluster->nodes, server_id, cluster_node);
    _mongoc_host_list_destroy_all (host);
 
-   RETURN (stream);
+   RETURN (cluster_node);
 
 error:
    _mongoc_host_list_destroy_all (host);  /* null ok */
@@ -1526,7 +2451,8 @@ _mongoc_cluster_stream_for_server (mongoc_cluster_t *cluster,
        *
        * error was filled by fetch_stream_single/pooled, pass it to invalidate()
        */
-      mongoc_cluster_disconnect_node (cluster, server_id);
+      mongoc_cluster_disconnect_node (cluster, server_id,
+                                      MONGOC_CONNECTION_CLOSED_HANDSHAKE);
       mongoc_topology_invalidate_server (topology, server_id, err_ptr);
    }
 
@@ -1572,13 +2498,58 @@ mongoc_cluster_stream_for_server (mongoc_cluster_t *cluster,
 
    if (!server_stream) {
       /* failed */
-      mongoc_cluster_disconnect_node (cluster, server_id);
+      mongoc_cluster_disconnect_node (cluster, server_id,
+                                      MONGOC_CONNECTION_CLOSED_HANDSHAKE);
    }
 
    RETURN (server_stream);
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_cluster_stream_valid --
+ *
+ *       Check that @server_stream's connection is still the cluster's
+ *       connection to its server, e.g. before reading replies to requests
+ *       sent on it earlier. Unlike mongoc_cluster_stream_for_server, never
+ *       checks, reconnects, or disconnects the node.
+ *
+ * Returns:
+ *       false if the node was disconnected since, so @server_stream's
+ *       stream is freed, or if @server_stream is NULL.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+mongoc_cluster_stream_valid (mongoc_cluster_t       *cluster,
+                             mongoc_server_stream_t *server_stream)
+{
+   mongoc_topology_t *topology = cluster->client->topology;
+   mongoc_topology_scanner_node_t *scanner_node;
+   mongoc_cluster_node_t *cluster_node;
+
+   if (!server_stream) {
+      return false;
+   }
+
+   if (topology->single_threaded) {
+      scanner_node = mongoc_topology_scanner_get_node (topology->scanner,
+                                                       server_stream->sd->id);
+
+      return scanner_node && !scanner_node->retired &&
+             scanner_node->stream == server_stream->stream;
+   }
+
+   cluster_node = (mongoc_cluster_node_t *) mongoc_set_get (
+      cluster->nodes, server_stream->sd->id);
+
+   return cluster_node && cluster_node->stream == server_stream->stream;
+}
+
+
 static mongoc_server_stream_t *
 mongoc_cluster_fetch_stream_single (mongoc_cluster_t *cluster,
                                     uint32_t          server_id,
@@ -1587,8 +2558,11 @@ mongoc_cluster_fetch_stream_single (mongoc_cluster_t *cluster,
 {
    mongoc_topology_t *topology;
    mongoc_server_description_t *sd;
+   mongoc_server_stream_t *server_stream;
    mongoc_stream_t *stream;
    mongoc_topology_scanner_node_t *scanner_node;
+   int64_t started = 0;
+   int64_t auth_started;
    int64_t expire_at;
 
    topology = cluster->client->topology;
@@ -1610,7 +2584,11 @@ mongoc_cluster_fetch_stream_single (mongoc_cluster_t *cluster,
          return NULL;
       }
 
+      started = bson_get_monotonic_time ();
       if (!mongoc_topology_scanner_node_setup (scanner_node, error)) {
+         _mongoc_connection_stats_connect_failed (
+            topology->connection_stats, server_id,
+            scanner_node->host.host_and_port);
          return NULL;
       }
       stream = scanner_node->stream;
@@ -1622,6 +2600,9 @@ mongoc_cluster_fetch_stream_single (mongoc_cluster_t *cluster,
                          MONGOC_ERROR_STREAM_CONNECT,
                          "Failed to connect to target host: '%s'",
                          scanner_node->host.host_and_port);
+         _mongoc_connection_stats_connect_failed (
+            topology->connection_stats, server_id,
+            scanner_node->host.host_and_port);
          return NULL;
       }
 
@@ -1639,6 +2620,9 @@ mongoc_cluster_fetch_stream_single (mongoc_cluster_t *cluster,
             (int32_t) topology->connect_timeout_msec * 1000, error);
 
          if (!r) {
+            _mongoc_connection_stats_connect_failed (
+               topology->connection_stats, server_id,
+               scanner_node->host.host_and_port);
             mongoc_topology_scanner_node_disconnect (scanner_node, true);
             return NULL;
          }
@@ -1648,6 +2632,18 @@ mongoc_cluster_fetch_stream_single (mongoc_cluster_t *cluster,
       sd = _mongoc_stream_run_ismaster (cluster, stream,
                                         scanner_node->host.host_and_port,
                                         server_id);
+
+      if (sd->type != MONGOC_SERVER_UNKNOWN) {
+         mongoc_histogram_connect_record (bson_get_monotonic_time () -
+                                          started);
+         _mongoc_connection_stats_opened (
+            topology->connection_stats, &scanner_node->conn, server_id,
+            scanner_node->host.host_and_port, started, false);
+      } else {
+         _mongoc_connection_stats_connect_failed (
+            topology->connection_stats, server_id,
+            scanner_node->host.host_and_port);
+      }
    }
 
    if (sd->type == MONGOC_SERVER_UNKNOWN) {
@@ -1658,6 +2654,11 @@ mongoc_cluster_fetch_stream_single (mongoc_cluster_t *cluster,
 
    /* stream open but not auth'ed: first use since connect or reconnect */
    if (cluster->requires_auth && !scanner_node->has_auth) {
+      auth_started = bson_get_monotonic_time ();
+      if (!started) {
+         started = auth_started;
+      }
+
       if (!_mongoc_cluster_auth_node (cluster, stream, sd->host.host,
                                       sd->max_wire_version, &sd->error)) {
          memcpy (error, &sd->error, sizeof *error);
@@ -1665,20 +2666,39 @@ mongoc_cluster_fetch_stream_single (mongoc_cluster_t *cluster,
          return NULL;
       }
 
+      _mongoc_connection_stats_auth (
+         &scanner_node->conn, bson_get_monotonic_time () - auth_started);
       scanner_node->has_auth = true;
    }
 
-   return mongoc_server_stream_new (topology->description.type, sd, stream);
+   if (started) {
+      mongoc_cluster_span_phase (cluster, MONGOC_SPAN_CONNECT, started,
+                                 bson_get_monotonic_time ());
+   }
+
+   server_stream = mongoc_server_stream_new (topology->description.type, sd,
+                                             stream);
+   server_stream->connection_stats = scanner_node->conn.server;
+
+   if (!scanner_node->keyed_counters) {
+      scanner_node->keyed_counters = _mongoc_counters_keyed (
+         MONGOC_KEYED_SERVER, sd->host.host_and_port);
+   }
+
+   server_stream->keyed_counters = scanner_node->keyed_counters;
+
+   return server_stream;
 }
 
 
 static mongoc_server_stream_t *
-_mongoc_cluster_create_server_stream (mongoc_topology_t *topology,
-                                      uint32_t           server_id,
-                                      mongoc_stream_t   *stream,
-                                      bson_error_t      *error /* OUT */)
+_mongoc_cluster_create_server_stream (mongoc_topology_t     *topology,
+                                      uint32_t               server_id,
+                                      mongoc_cluster_node_t *cluster_node,
+                                      bson_error_t          *error /* OUT */)
 {
    mongoc_server_description_t *sd;
+   mongoc_server_stream_t *server_stream;
 
    sd = mongoc_topology_server_by_id (topology, server_id, error);
 
@@ -1686,8 +2706,18 @@ _mongoc_cluster_create_server_stream (mongoc_topology_t *topology,
       return NULL;
    }
 
-   return mongoc_server_stream_new (_mongoc_topology_get_type (topology),
-                                    sd, stream);
+   server_stream = mongoc_server_stream_new (
+      _mongoc_topology_get_type (topology), sd, cluster_node->stream);
+   server_stream->connection_stats = cluster_node->conn.server;
+
+   if (!cluster_node->keyed_counters) {
+      cluster_node->keyed_counters = _mongoc_counters_keyed (
+         MONGOC_KEYED_SERVER, sd->host.host_and_port);
+   }
+
+   server_stream->keyed_counters = cluster_node->keyed_counters;
+
+   return server_stream;
 }
 
 
@@ -1698,7 +2728,6 @@ mongoc_cluster_fetch_stream_pooled (mongoc_cluster_t *cluster,
                                     bson_error_t     *error /* OUT */)
 {
    mongoc_topology_t *topology;
-   mongoc_stream_t *stream;
    mongoc_cluster_node_t *cluster_node;
    int64_t timestamp;
 
@@ -1714,11 +2743,11 @@ mongoc_cluster_fetch_stream_pooled (mongoc_cluster_t *cluster,
       if (timestamp == -1 || cluster_node->timestamp < timestamp) {
          /* topology change or net error during background scan made us remove
           * or replace server description since node's birth. destroy node. */
-         mongoc_cluster_disconnect_node (cluster, server_id);
+         mongoc_cluster_disconnect_node (cluster, server_id,
+                                         MONGOC_CONNECTION_CLOSED_STALE);
       } else {
          return _mongoc_cluster_create_server_stream (topology, server_id,
-                                                      cluster_node->stream,
-                                                      error);
+                                                      cluster_node, error);
       }
    }
 
@@ -1728,10 +2757,10 @@ mongoc_cluster_fetch_stream_pooled (mongoc_cluster_t *cluster,
       return NULL;
    }
 
-   stream = _mongoc_cluster_add_node (cluster, server_id, error);
-   if (stream) {
+   cluster_node = _mongoc_cluster_add_node (cluster, server_id, error);
+   if (cluster_node) {
       return _mongoc_cluster_create_server_stream (topology, server_id,
-                                                   stream, error);
+                                                   cluster_node, error);
    } else {
       return NULL;
    }
@@ -1779,10 +2808,17 @@ mongoc_cluster_init (mongoc_cluster_t   *cluster,
    cluster->socketcheckintervalms = mongoc_uri_get_option_as_int32(
       uri, "socketcheckintervalms", MONGOC_TOPOLOGY_SOCKET_CHECK_INTERVAL_MS);
 
+   cluster->slowopthresholdms = (uint32_t) BSON_MAX (
+      0, mongoc_uri_get_option_as_int32 (uri, "slowopthresholdms", 0));
+
    /* TODO for single-threaded case we don't need this */
    cluster->nodes = mongoc_set_new(8, _mongoc_cluster_node_dtor, NULL);
+   cluster->unack_checked_at = mongoc_set_new (8, _mongoc_cluster_free_dtor,
+                                               NULL);
 
    _mongoc_array_init (&cluster->iov, sizeof (mongoc_iovec_t));
+   _mongoc_array_init (&cluster->rpc_ns_counters,
+                       sizeof (mongoc_counter_slots_t *));
 
    cluster->operation_id = rand ();
 
@@ -1816,8 +2852,10 @@ mongoc_cluster_destroy (mongoc_cluster_t *cluster) /* INOUT */
    mongoc_uri_destroy(cluster->uri);
 
    mongoc_set_destroy(cluster->nodes);
+   mongoc_set_destroy (cluster->unack_checked_at);
 
    _mongoc_array_destroy(&cluster->iov);
+   _mongoc_array_destroy (&cluster->rpc_ns_counters);
 
    EXIT;
 }
@@ -1848,23 +2886,64 @@ _mongoc_cluster_stream_for_optype (mongoc_cluster_t *cluster,
                                    bson_error_t *error)
 {
    mongoc_server_stream_t *server_stream;
+   mongoc_server_description_type_t selected_type;
    uint32_t server_id;
    mongoc_topology_t *topology = cluster->client->topology;
+   int64_t started;
 
    ENTRY;
 
    BSON_ASSERT (cluster);
 
+   started = bson_get_monotonic_time ();
+   server_id = mongoc_topology_select_server_id (topology,
+                                                 optype,
+                                                 read_prefs,
+                                                 error);
+   mongoc_cluster_span_phase (cluster, MONGOC_SPAN_SERVER_SELECTION, started,
+                              bson_get_monotonic_time ());
+
+   if (!server_id) {
+      RETURN(NULL);
+   }
+
+   if (!_mongoc_topology_cache_unverified (topology, server_id,
+                                           &selected_type)) {
+      /* connect or reconnect to server if necessary */
+      server_stream = _mongoc_cluster_stream_for_server (cluster,
+                                                         server_id,
+                                                         true /* reconnect_ok */,
+                                                         error);
+
+      RETURN (server_stream);
+   }
+
+   /* selected from the topology cache: the first connection's handshake
+    * must agree with the cache, else select again after a real scan */
+   server_stream = _mongoc_cluster_stream_for_server (cluster,
+                                                      server_id,
+                                                      true /* reconnect_ok */,
+                                                      error);
+
+   if (server_stream && server_stream->sd->type == selected_type) {
+      RETURN (server_stream);
+   }
+
+   mongoc_server_stream_cleanup (server_stream);
+   _mongoc_topology_cache_distrust (topology);
+
+   started = bson_get_monotonic_time ();
    server_id = mongoc_topology_select_server_id (topology,
                                                  optype,
                                                  read_prefs,
                                                  error);
+   mongoc_cluster_span_phase (cluster, MONGOC_SPAN_SERVER_SELECTION, started,
+                              bson_get_monotonic_time ());
 
    if (!server_id) {
       RETURN(NULL);
    }
 
-   /* connect or reconnect to server if necessary */
    server_stream = _mongoc_cluster_stream_for_server (cluster,
                                                       server_id,
                                                       true /* reconnect_ok */,
@@ -2198,7 +3277,8 @@ _mongoc_cluster_check_interval (mongoc_cluster_t *cluster,
 
    if (scanner_node->last_used + (1000 * CHECK_CLOSED_DURATION_MSEC) < now) {
       if (mongoc_stream_check_closed (stream)) {
-         mongoc_cluster_disconnect_node (cluster, server_id);
+         mongoc_cluster_disconnect_node (cluster, server_id,
+                                         MONGOC_CONNECTION_CLOSED_CHECK_FAILED);
          bson_set_error (error, MONGOC_ERROR_STREAM, MONGOC_ERROR_STREAM_SOCKET,
                          "Stream is closed");
          return false;
@@ -2231,6 +3311,30 @@ _mongoc_cluster_check_interval (mongoc_cluster_t *cluster,
 }
 
 
+/* the namespace a legacy opcode operates on, NULL for OP_KILL_CURSORS */
+static const char *
+_mongoc_cluster_rpc_ns (const mongoc_rpc_t *rpc)
+{
+   switch (rpc->header.opcode) {
+   case MONGOC_OPCODE_QUERY:
+      return rpc->query.collection;
+   case MONGOC_OPCODE_GET_MORE:
+      return rpc->get_more.collection;
+   case MONGOC_OPCODE_INSERT:
+      return rpc->insert.collection;
+   case MONGOC_OPCODE_UPDATE:
+      return rpc->update.collection;
+   case MONGOC_OPCODE_DELETE:
+      return rpc->delete_.collection;
+   case MONGOC_OPCODE_REPLY:
+   case MONGOC_OPCODE_MSG:
+   case MONGOC_OPCODE_KILL_CURSORS:
+   default:
+      return NULL;
+   }
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -2247,6 +3351,9 @@ _mongoc_cluster_check_interval (mongoc_cluster_t *cluster,
  *
  *       @error may be set.
  *
+ *       Counts the RPCs in the server's and their namespaces' keyed
+ *       counter groups.
+ *
  *--------------------------------------------------------------------------
  */
 
@@ -2261,13 +3368,18 @@ mongoc_cluster_sendv_to_server (mongoc_cluster_t              *cluster,
    uint32_t server_id;
    mongoc_iovec_t *iov;
    mongoc_topology_scanner_node_t *scanner_node;
+   mongoc_counter_slots_t *server_counters;
+   mongoc_counter_slots_t *ns_counters;
    const bson_t *b;
+   const char *ns;
    mongoc_rpc_t gle;
    size_t iovcnt;
    size_t i;
    bool need_gle;
    char cmdname[140];
    int32_t max_msg_size;
+   int64_t msg_len;
+   bool timed_out;
 
    ENTRY;
 
@@ -2297,6 +3409,13 @@ mongoc_cluster_sendv_to_server (mongoc_cluster_t              *cluster,
    }
 
    _mongoc_array_clear(&cluster->iov);
+   _mongoc_array_clear (&cluster->rpc_ns_counters);
+
+   server_counters = server_stream->keyed_counters;
+   if (!server_counters) {
+      server_counters = _mongoc_counters_keyed (
+         MONGOC_KEYED_SERVER, server_stream->sd->host.host_and_port);
+   }
 
    /*
     * TODO: We can probably remove the need for sendv and just do send since
@@ -2323,6 +3442,12 @@ mongoc_cluster_sendv_to_server (mongoc_cluster_t              *cluster,
          RETURN(false);
       }
 
+      msg_len = rpcs[i].header.msg_len;
+      ns = _mongoc_cluster_rpc_ns (&rpcs[i]);
+      ns_counters = ns ? _mongoc_cluster_ns_counters (cluster, ns, NULL)
+                       : NULL;
+      _mongoc_array_append_val (&cluster->rpc_ns_counters, ns_counters);
+
       if (need_gle) {
          gle.query.msg_len = 0;
          gle.query.request_id = ++cluster->request_id;
@@ -2353,9 +3478,22 @@ mongoc_cluster_sendv_to_server (mongoc_cluster_t              *cluster,
          gle.query.query = bson_get_data(b);
          gle.query.fields = NULL;
          _mongoc_rpc_gather(&gle, &cluster->iov);
+         msg_len += gle.header.msg_len;
          _mongoc_rpc_swab_to_le(&gle);
       }
 
+      _mongoc_keyed_counter_add (server_counters, MONGOC_KEYED_OPS, 1);
+      _mongoc_keyed_counter_add (server_counters, MONGOC_KEYED_BYTES_OUT,
+                                 msg_len);
+      _mongoc_connection_stats_add_bytes (server_stream->connection_stats,
+                                          msg_len, 0);
+
+      if (ns_counters) {
+         _mongoc_keyed_counter_add (ns_counters, MONGOC_KEYED_OPS, 1);
+         _mongoc_keyed_counter_add (ns_counters, MONGOC_KEYED_BYTES_OUT,
+                                    msg_len);
+      }
+
       _mongoc_rpc_swab_to_le(&rpcs[i]);
    }
 
@@ -2364,8 +3502,25 @@ mongoc_cluster_sendv_to_server (mongoc_cluster_t              *cluster,
 
    BSON_ASSERT (cluster->iov.len);
 
+   errno = 0;
    if (!_mongoc_stream_writev_full (server_stream->stream, iov, iovcnt,
                                     cluster->sockettimeoutms, error)) {
+      timed_out = MONGOC_ERRNO_IS_TIMEDOUT (errno);
+      _mongoc_keyed_counter_add (server_counters, MONGOC_KEYED_ERRORS, 1);
+      _mongoc_keyed_counter_add (server_counters, MONGOC_KEYED_TIMEOUTS,
+                                 timed_out);
+
+      /* each RPC's namespace, they may differ */
+      for (i = 0; i < cluster->rpc_ns_counters.len; i++) {
+         ns_counters = _mongoc_array_index (&cluster->rpc_ns_counters,
+                                            mongoc_counter_slots_t *, i);
+         if (ns_counters) {
+            _mongoc_keyed_counter_add (ns_counters, MONGOC_KEYED_ERRORS, 1);
+            _mongoc_keyed_counter_add (ns_counters, MONGOC_KEYED_TIMEOUTS,
+                                       timed_out);
+         }
+      }
+
       RETURN (false);
    }
 
@@ -2402,6 +3557,8 @@ mongoc_cluster_sendv_to_server (mongoc_cluster_t              *cluster,
  * Side effects:
  *       @rpc is set on success, @error on failure.
  *       @buffer will be filled with the input data.
+ *       Counts the reply in the server's keyed counter group; it does not
+ *       know the namespace.
  *
  *--------------------------------------------------------------------------
  */
@@ -2413,6 +3570,7 @@ mongoc_cluster_try_recv (mongoc_cluster_t       *cluster,
                          mongoc_server_stream_t *server_stream,
                          bson_error_t           *error)
 {
+   mongoc_counter_slots_t *server_counters;
    uint32_t server_id;
    int32_t msg_len;
    int32_t max_msg_size;
@@ -2426,6 +3584,11 @@ mongoc_cluster_try_recv (mongoc_cluster_t       *cluster,
    BSON_ASSERT (server_stream);
 
    server_id = server_stream->sd->id;
+   server_counters = server_stream->keyed_counters;
+   if (!server_counters) {
+      server_counters = _mongoc_counters_keyed (
+         MONGOC_KEYED_SERVER, server_stream->sd->host.host_and_port);
+   }
 
    TRACE ("Waiting for reply from server_id \"%u\"", server_id);
 
@@ -2433,11 +3596,16 @@ mongoc_cluster_try_recv (mongoc_cluster_t       *cluster,
     * Buffer the message length to determine how much more to read.
     */
    pos = buffer->len;
+   errno = 0;
    if (!_mongoc_buffer_append_from_stream (buffer, server_stream->stream, 4,
                                            cluster->sockettimeoutms, error)) {
       MONGOC_DEBUG("Could not read 4 bytes, stream probably closed or timed out");
+      _mongoc_keyed_counter_add (server_counters, MONGOC_KEYED_ERRORS, 1);
+      _mongoc_keyed_counter_add (server_counters, MONGOC_KEYED_TIMEOUTS,
+                                 MONGOC_ERRNO_IS_TIMEDOUT (errno));
       mongoc_counter_protocol_ingress_error_inc ();
-      mongoc_cluster_disconnect_node(cluster, server_id);
+      mongoc_cluster_disconnect_node (cluster, server_id,
+                                      MONGOC_CONNECTION_CLOSED_NETWORK_ERROR);
       RETURN (false);
    }
 
@@ -2452,7 +3620,9 @@ mongoc_cluster_try_recv (mongoc_cluster_t       *cluster,
                       MONGOC_ERROR_PROTOCOL,
                       MONGOC_ERROR_PROTOCOL_INVALID_REPLY,
                       "Corrupt or malicious reply received.");
-      mongoc_cluster_disconnect_node(cluster, server_id);
+      mongoc_cluster_disconnect_node (cluster, server_id,
+                                      MONGOC_CONNECTION_CLOSED_PROTOCOL_ERROR);
+      _mongoc_keyed_counter_add (server_counters, MONGOC_KEYED_ERRORS, 1);
       mongoc_counter_protocol_ingress_error_inc ();
       RETURN (false);
    }
@@ -2463,7 +3633,11 @@ mongoc_cluster_try_recv (mongoc_cluster_t       *cluster,
    if (!_mongoc_buffer_append_from_stream (buffer, server_stream->stream,
                                            msg_len - 4,
                                            cluster->sockettimeoutms, error)) {
-      mongoc_cluster_disconnect_node (cluster, server_id);
+      _mongoc_keyed_counter_add (server_counters, MONGOC_KEYED_ERRORS, 1);
+      _mongoc_keyed_counter_add (server_counters, MONGOC_KEYED_TIMEOUTS,
+                                 MONGOC_ERRNO_IS_TIMEDOUT (errno));
+      mongoc_cluster_disconnect_node (cluster, server_id,
+                                      MONGOC_CONNECTION_CLOSED_NETWORK_ERROR);
       mongoc_counter_protocol_ingress_error_inc ();
       RETURN (false);
    }
@@ -2476,11 +3650,17 @@ mongoc_cluster_try_recv (mongoc_cluster_t       *cluster,
                       MONGOC_ERROR_PROTOCOL,
                       MONGOC_ERROR_PROTOCOL_INVALID_REPLY,
                       "Failed to decode reply from server.");
-      mongoc_cluster_disconnect_node (cluster, server_id);
+      mongoc_cluster_disconnect_node (cluster, server_id,
+                                      MONGOC_CONNECTION_CLOSED_PROTOCOL_ERROR);
+      _mongoc_keyed_counter_add (server_counters, MONGOC_KEYED_ERRORS, 1);
       mongoc_counter_protocol_ingress_error_inc ();
       RETURN (false);
    }
 
+   _mongoc_keyed_counter_add (server_counters, MONGOC_KEYED_BYTES_IN, msg_len);
+   _mongoc_connection_stats_add_bytes (server_stream->connection_stats, 0,
+                                       msg_len);
+
    _mongoc_rpc_swab_from_le (rpc);
 
    _mongoc_cluster_inc_ingress_rpc (rpc);
@@ -2402,6 +2402,109 @@ mongoc_collection_create_bulk_operation (
                                       write_concern);
 }
 
+/* build a findAndModify command for @server_stream's server */
+static bool
+_mongoc_collection_find_and_modify_command (
+   mongoc_collection_t                 *collection,
+   const bson_t                        *query,
+   const mongoc_find_and_modify_opts_t *opts,
+   mongoc_server_stream_t              *server_stream,
+   bson_t                              *command,
+   bson_error_t                        *error)
+{
+   bson_iter_t iter;
+   const char *name;
+
+   name = mongoc_collection_get_name (collection);
+   BSON_APPEND_UTF8 (command, "findAndModify", name);
+   BSON_APPEND_DOCUMENT (command, "query", query);
+
+   if (opts->sort) {
+      BSON_APPEND_DOCUMENT (command, "sort", opts->sort);
+   }
+
+   if (opts->update) {
+      BSON_APPEND_DOCUMENT (command, "update", opts->update);
+   }
+
+   if (opts->fields) {
+      BSON_APPEND_DOCUMENT (command, "fields", opts->fields);
+   }
+
+   if (opts->flags & MONGOC_FIND_AND_MODIFY_REMOVE) {
+      BSON_APPEND_BOOL (command, "remove", true);
+   }
+
+   if (opts->flags & MONGOC_FIND_AND_MODIFY_UPSERT) {
+      BSON_APPEND_BOOL (command, "upsert", true);
+   }
+
+   if (opts->flags & MONGOC_FIND_AND_MODIFY_RETURN_NEW) {
+      BSON_APPEND_BOOL (command, "new", true);
+   }
+
+   if (opts->bypass_document_validation != MONGOC_BYPASS_DOCUMENT_VALIDATION_DEFAULT) {
+      BSON_APPEND_BOOL (command, "bypassDocumentValidation",
+                        !!opts->bypass_document_validation);
+   }
+
+   if (opts->max_time_ms > 0) {
+      BSON_APPEND_INT32 (command, "maxTimeMS", opts->max_time_ms);
+   }
+
+   if (server_stream->sd->max_wire_version >= WIRE_VERSION_FAM_WRITE_CONCERN) {
+      if (!mongoc_write_concern_is_valid (collection->write_concern)) {
+         bson_set_error (error,
+                         MONGOC_ERROR_COMMAND,
+                         MONGOC_ERROR_COMMAND_INVALID_ARG,
+                         "The write concern is invalid.");
+         return false;
+      }
+
+      if (mongoc_write_concern_is_acknowledged (collection->write_concern)) {
+         _BSON_APPEND_WRITE_CONCERN (command, collection->write_concern);
+      }
+   }
+
+   if (bson_iter_init (&iter, &opts->extra)) {
+      return _mongoc_client_command_append_iterator_opts_to_command (
+         &iter, server_stream->sd->max_wire_version, command, error
+      );
+   }
+
+   return true;
+}
+
+
+/* if a findAndModify @reply has a writeConcernError, set @error from it */
+static bool
+_mongoc_collection_find_and_modify_wce (const bson_t *reply,
+                                        bson_error_t *error)
+{
+   bson_iter_t iter;
+   bson_iter_t inner;
+   const char *errmsg = NULL;
+   int32_t code = 0;
+
+   if (!bson_iter_init_find (&iter, reply, "writeConcernError") ||
+       !BSON_ITER_HOLDS_DOCUMENT (&iter)) {
+      return false;
+   }
+
+   bson_iter_recurse(&iter, &inner);
+   while (bson_iter_next (&inner)) {
+      if (BSON_ITER_IS_KEY (&inner, "code")) {
+         code = bson_iter_int32 (&inner);
+      } else if (BSON_ITER_IS_KEY (&inner, "errmsg")) {
+         errmsg = bson_iter_utf8 (&inner, NULL);
+      }
+   }
+   bson_set_error (error, MONGOC_ERROR_WRITE_CONCERN, code, "Write Concern error: %s", errmsg);
+
+   return true;
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -2433,9 +2536,6 @@ mongoc_collection_find_and_modify_with_opts (mongoc_collection_t
 {
    mongoc_cluster_t *cluster;
    mongoc_server_stream_t *server_stream;
-   bson_iter_t iter;
-   bson_iter_t inner;
-   const char *name;
    bson_t reply_local;
    bson_t *reply_ptr;
    bool ret;
@@ -2455,101 +2555,183 @@ mongoc_collection_find_and_modify_with_opts (mongoc_collection_t
       RETURN (false);
    }
 
-   name = mongoc_collection_get_name (collection);
-   BSON_APPEND_UTF8 (&command, "findAndModify", name);
-   BSON_APPEND_DOCUMENT (&command, "query", query);
-
-   if (opts->sort) {
-      BSON_APPEND_DOCUMENT (&command, "sort", opts->sort);
+   if (!_mongoc_collection_find_and_modify_command (collection, query, opts,
+                                                    server_stream, &command,
+                                                    error)) {
+      bson_destroy (&command);
+      mongoc_server_stream_cleanup (server_stream);
+      RETURN (false);
    }
 
-   if (opts->update) {
-      BSON_APPEND_DOCUMENT (&command, "update", opts->update);
-   }
+   ret = mongoc_cluster_run_command_monitored (cluster, server_stream,
+                                               MONGOC_QUERY_NONE,
+                                               collection->db, &command,
+                                               reply_ptr, error);
 
-   if (opts->fields) {
-      BSON_APPEND_DOCUMENT (&command, "fields", opts->fields);
+   if (_mongoc_collection_find_and_modify_wce (reply_ptr, error)) {
+      ret = false; 
    }
-
-   if (opts->flags & MONGOC_FIND_AND_MODIFY_REMOVE) {
-      BSON_APPEND_BOOL (&command, "remove", true);
+   if (reply_ptr == &reply_local) {
+      bson_destroy (reply_ptr);
    }
 
+   bson_destroy (&command);
+   mongoc_server_stream_cleanup (server_stream);
+
+   RETURN (ret);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_collection_find_and_modify_batch --
+ *
+ *       Run findAndModify with @query and @opts up to @max_documents
+ *       times, as for a queue: @opts must update or remove each matching
+ *       document so it no longer matches @query. The commands are
+ *       pipelined on one connection, MONGOC_FIND_AND_MODIFY_PIPELINE_DEPTH
+ *       at a time, and the server runs them in order, so each claims a
+ *       different document. Stops when one finds no document.
+ *
+ * Returns:
+ *       A cursor over the documents returned by each findAndModify. If one
+ *       fails, the cursor still returns the documents claimed before the
+ *       error is reported with mongoc_cursor_error ().
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_cursor_t *
+mongoc_collection_find_and_modify_batch (mongoc_collection_t                 *collection,
+                                         const bson_t                        *query,
+                                         const mongoc_find_and_modify_opts_t *opts,
+                                         uint32_t                             max_documents)
+{
+   mongoc_cluster_request_t requests[MONGOC_FIND_AND_MODIFY_PIPELINE_DEPTH];
+   mongoc_cluster_request_t *request;
+   mongoc_cluster_t *cluster;
+   mongoc_server_stream_t *server_stream;
+   mongoc_cursor_t *cursor;
+   bson_t command = BSON_INITIALIZER;
+   bson_t documents = BSON_INITIALIZER;
+   bson_t reply;
+   bson_error_t error = { 0 };
+   bson_error_t cmd_error;
+   bson_iter_t iter;
+   uint32_t n_sent = 0;
+   uint32_t n_recv = 0;
+   uint32_t n_documents = 0;
+   const char *key;
+   char keybuf[16];
+   bool stop = false;
+   bool ok;
+
+   ENTRY;
+
+   BSON_ASSERT (collection);
+   BSON_ASSERT (query);
+   BSON_ASSERT (opts);
+
+   cluster = &collection->client->cluster;
+   cursor = _mongoc_collection_cursor_new (collection, MONGOC_QUERY_NONE);
+   _mongoc_cursor_array_init (cursor, NULL, NULL);
+
    if (opts->flags & MONGOC_FIND_AND_MODIFY_UPSERT) {
-      BSON_APPEND_BOOL (&command, "upsert", true);
+      bson_set_error (&error,
+                      MONGOC_ERROR_COMMAND,
+                      MONGOC_ERROR_COMMAND_INVALID_ARG,
+                      "Cannot upsert in a findAndModify batch");
+      GOTO (done);
    }
 
-   if (opts->flags & MONGOC_FIND_AND_MODIFY_RETURN_NEW) {
-      BSON_APPEND_BOOL (&command, "new", true);
+   server_stream = mongoc_cluster_stream_for_writes (cluster, &error);
+   if (!server_stream) {
+      GOTO (done);
    }
 
-   if (opts->bypass_document_validation != MONGOC_BYPASS_DOCUMENT_VALIDATION_DEFAULT) {
-      BSON_APPEND_BOOL (&command, "bypassDocumentValidation",
-                        !!opts->bypass_document_validation);
+   if (!_mongoc_collection_find_and_modify_command (collection, query, opts,
+                                                    server_stream, &command,
+                                                    &error)) {
+      mongoc_server_stream_cleanup (server_stream);
+      GOTO (done);
    }
 
-   if (opts->max_time_ms > 0) {
-      BSON_APPEND_INT32 (&command, "maxTimeMS", opts->max_time_ms);
-   }
+   while (n_recv < n_sent || (!stop && n_sent < max_documents)) {
+      if (!stop && n_sent < max_documents &&
+          n_sent - n_recv < MONGOC_FIND_AND_MODIFY_PIPELINE_DEPTH) {
+         request = &requests[n_sent % MONGOC_FIND_AND_MODIFY_PIPELINE_DEPTH];
+         if (!mongoc_cluster_send_command (cluster, server_stream,
+                                           MONGOC_QUERY_NONE, collection->db,
+                                           &command, NULL, 0, request,
+                                           &cmd_error)) {
+            /* the node was disconnected, with the replies in flight */
+            if (!error.domain) {
+               memcpy (&error, &cmd_error, sizeof error);
+            }
+            break;
+         }
 
-   if (server_stream->sd->max_wire_version >= WIRE_VERSION_FAM_WRITE_CONCERN) {
-      if (!mongoc_write_concern_is_valid (collection->write_concern)) {
-         bson_set_error (error,
-                         MONGOC_ERROR_COMMAND,
-                         MONGOC_ERROR_COMMAND_INVALID_ARG,
-                         "The write concern is invalid.");
-         bson_destroy (&command);
-         mongoc_server_stream_cleanup (server_stream);
-         RETURN (false);
+         n_sent++;
+         continue;
       }
 
-      if (mongoc_write_concern_is_acknowledged (collection->write_concern)) {
-         _BSON_APPEND_WRITE_CONCERN (&command, collection->write_concern);
+      request = &requests[n_recv % MONGOC_FIND_AND_MODIFY_PIPELINE_DEPTH];
+      ok = mongoc_cluster_recv_reply (cluster, server_stream, request, &reply,
+                                      &cmd_error);
+      n_recv++;
+
+      if (ok && _mongoc_collection_find_and_modify_wce (&reply, &cmd_error)) {
+         ok = false;
       }
-   }
 
-   if (bson_iter_init (&iter, &opts->extra)) {
-      bool ok = _mongoc_client_command_append_iterator_opts_to_command (
-         &iter, server_stream->sd->max_wire_version, &command, error
-      );
       if (!ok) {
-         bson_destroy (&command);
-         mongoc_server_stream_cleanup (server_stream);
-         RETURN (false);
+         /* keep reading replies, commands in flight may claim documents */
+         if (!error.domain) {
+            memcpy (&error, &cmd_error, sizeof error);
+         }
+         stop = true;
+         if (bson_empty (&reply)) {
+            /* the roundtrip failed and the node was disconnected */
+            bson_destroy (&reply);
+            break;
+         }
       }
-   }
 
-   ret = mongoc_cluster_run_command_monitored (cluster, server_stream,
-                                               MONGOC_QUERY_NONE,
-                                               collection->db, &command,
-                                               reply_ptr, error);
-
-   if (bson_iter_init_find (&iter, reply_ptr, "writeConcernError") &&
-         BSON_ITER_HOLDS_DOCUMENT (&iter)) {
-      const char *errmsg = NULL;
-      int32_t code = 0;
-
-      bson_iter_recurse(&iter, &inner);
-      while (bson_iter_next (&inner)) {
-         if (BSON_ITER_IS_KEY (&inner, "code")) {
-            code = bson_iter_int32 (&inner);
-         } else if (BSON_ITER_IS_KEY (&inner, "errmsg")) {
-            errmsg = bson_iter_utf8 (&inner, NULL);
-         }
+      if (bson_iter_init_find (&iter, &reply, "value") &&
+          BSON_ITER_HOLDS_DOCUMENT (&iter)) {
+         bson_uint32_to_string (n_documents++, &key, keybuf, sizeof keybuf);
+         bson_append_iter (&documents, key, -1, &iter);
+      } else {
+         /* nothing left to claim */
+         stop = true;
       }
-      bson_set_error (error, MONGOC_ERROR_WRITE_CONCERN, code, "Write Concern error: %s", errmsg);
-      ret = false; 
+
+      bson_destroy (&reply);
    }
-   if (reply_ptr == &reply_local) {
-      bson_destroy (reply_ptr);
+
+   /* the node was disconnected: the replies in flight won't be read */
+   for (; n_recv < n_sent; n_recv++) {
+      mongoc_cluster_abandon_request (
+         cluster, &requests[n_recv % MONGOC_FIND_AND_MODIFY_PIPELINE_DEPTH],
+         &error);
    }
 
-   bson_destroy (&command);
    mongoc_server_stream_cleanup (server_stream);
 
-   RETURN (ret);
+done:
+   _mongoc_cursor_array_set_bson (cursor, &documents);
+   if (error.domain) {
+      _mongoc_cursor_array_set_error (cursor, &error);
+   }
+
+   bson_destroy (&documents);
+   bson_destroy (&command);
+
+   RETURN (cursor);
 }
 
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -213,6 +213,11 @@ bool                          mongoc_collection_find_and_modify_with_opts (mongo
                                                                            bson_t                              *reply,
                                                                            bson_error_t                        *error);
 BSON_API
+mongoc_cursor_t              *mongoc_collection_find_and_modify_batch     (mongoc_collection_t                 *collection,
+                                                                           const bson_t                        *query,
+                                                                           const mongoc_find_and_modify_opts_t *opts,
+                                                                           uint32_t                             max_documents);
+BSON_API
 bool                          mongoc_collection_find_and_modify      (mongoc_collection_t           *collection,
                                                                       const bson_t                  *query,
                                                                       const bson_t                  *sort,
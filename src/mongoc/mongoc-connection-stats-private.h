@@ -0,0 +1,149 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_CONNECTION_STATS_PRIVATE_H
+#define MONGOC_CONNECTION_STATS_PRIVATE_H
+
+#if !defined (MONGOC_COMPILATION)
+#error "Only <mongoc.h> can be included directly."
+#endif
+
+#include <bson.h>
+
+#include "mongoc-counters-private.h"
+#include "mongoc-set-private.h"
+#include "mongoc-thread-private.h"
+
+
+BSON_BEGIN_DECLS
+
+
+/* why a connection was closed, see mongoc_cluster_disconnect_node */
+typedef enum
+{
+   MONGOC_CONNECTION_CLOSED_NETWORK_ERROR,   /* send or receive failed */
+   MONGOC_CONNECTION_CLOSED_PROTOCOL_ERROR,  /* corrupt or unexpected reply */
+   MONGOC_CONNECTION_CLOSED_HANDSHAKE,       /* isMaster or auth failed */
+   MONGOC_CONNECTION_CLOSED_STALE,           /* server changed since connect */
+   MONGOC_CONNECTION_CLOSED_CHECK_FAILED,    /* idle socket check failed */
+   MONGOC_CONNECTION_CLOSED_EXHAUST_CURSOR,  /* exhaust cursor killed */
+   MONGOC_CONNECTION_CLOSED_REMOVED,         /* server left the topology */
+   MONGOC_CONNECTION_CLOSED_CLIENT,          /* client destroyed or reset */
+   MONGOC_CONNECTION_CLOSED_LAST
+} mongoc_connection_close_reason_t;
+
+
+/* one server's connections, kept until the topology is destroyed */
+typedef struct _mongoc_connection_stats_server_t
+{
+   struct _mongoc_connection_stats_t *stats;
+   uint32_t          server_id;
+   char             *host;
+
+   /* guarded by stats->mutex */
+   int64_t           n_open;
+   int64_t           n_in_use;
+   int64_t           n_created;
+   int64_t           n_connect_failed;
+   int64_t           n_closed[MONGOC_CONNECTION_CLOSED_LAST];
+   int64_t           opened_at_sum;   /* of open connections, for mean age */
+   int64_t           connect_buckets[MONGOC_HISTOGRAM_BUCKETS];
+   int64_t           connect_sum;
+   int64_t           connect_min;
+   int64_t           connect_max;
+   int64_t           n_auth;
+   int64_t           auth_sum;
+
+   /* atomic, updated without the mutex */
+   volatile int64_t  bytes_in;
+   volatile int64_t  bytes_out;
+} mongoc_connection_stats_server_t;
+
+
+/* all connections to a topology's servers, owned by the topology */
+typedef struct _mongoc_connection_stats_t
+{
+   mongoc_mutex_t  mutex;     /* a leaf: take no other lock while held */
+   mongoc_set_t   *servers;   /* mongoc_connection_stats_server_t by id */
+} mongoc_connection_stats_t;
+
+
+/* embedded in whatever owns a connection's stream */
+typedef struct
+{
+   mongoc_connection_stats_server_t *server;  /* NULL until opened */
+   int64_t                           opened_at;
+   bool                              in_use;
+} mongoc_connection_stats_conn_t;
+
+
+mongoc_connection_stats_t *
+_mongoc_connection_stats_new (void);
+
+void
+_mongoc_connection_stats_destroy (mongoc_connection_stats_t *stats);
+
+void
+_mongoc_connection_stats_opened (mongoc_connection_stats_t      *stats,
+                                 mongoc_connection_stats_conn_t *conn,
+                                 uint32_t                        server_id,
+                                 const char                     *host,
+                                 int64_t                         started,
+                                 bool                            in_use);
+
+void
+_mongoc_connection_stats_closed (mongoc_connection_stats_conn_t   *conn,
+                                 mongoc_connection_close_reason_t  reason);
+
+void
+_mongoc_connection_stats_connect_failed (mongoc_connection_stats_t *stats,
+                                         uint32_t                   server_id,
+                                         const char                *host);
+
+void
+_mongoc_connection_stats_auth (mongoc_connection_stats_conn_t *conn,
+                               int64_t                         usec);
+
+void
+_mongoc_connection_stats_set_in_use (mongoc_connection_stats_conn_t *conn,
+                                     bool                            in_use);
+
+void
+_mongoc_connection_stats_snapshot (mongoc_connection_stats_t *stats,
+                                   bson_t                    *snapshot);
+
+
+static BSON_INLINE void
+_mongoc_connection_stats_add_bytes (mongoc_connection_stats_server_t *server,
+                                    int64_t                           out,
+                                    int64_t                           in)
+{
+   if (server) {
+      if (out) {
+         bson_atomic_int64_add (&server->bytes_out, out);
+      }
+
+      if (in) {
+         bson_atomic_int64_add (&server->bytes_in, in);
+      }
+   }
+}
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_CONNECTION_STATS_PRIVATE_H */
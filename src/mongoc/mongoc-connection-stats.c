@@ -0,0 +1,395 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <bson.h>
+
+#include "mongoc-connection-stats-private.h"
+
+
+static const char *gCloseReasons[MONGOC_CONNECTION_CLOSED_LAST] = {
+   "networkError",
+   "protocolError",
+   "handshakeFailed",
+   "stale",
+   "checkFailed",
+   "exhaustCursor",
+   "removed",
+   "clientClosed",
+};
+
+
+static void
+_mongoc_connection_stats_server_dtor (void *data,
+                                      void *ctx)
+{
+   mongoc_connection_stats_server_t *server;
+
+   server = (mongoc_connection_stats_server_t *) data;
+   bson_free (server->host);
+   bson_free (server);
+}
+
+
+mongoc_connection_stats_t *
+_mongoc_connection_stats_new (void)
+{
+   mongoc_connection_stats_t *stats;
+
+   stats = (mongoc_connection_stats_t *) bson_malloc0 (sizeof *stats);
+   mongoc_mutex_init (&stats->mutex);
+   stats->servers = mongoc_set_new (8, _mongoc_connection_stats_server_dtor,
+                                    NULL);
+
+   return stats;
+}
+
+
+void
+_mongoc_connection_stats_destroy (mongoc_connection_stats_t *stats)
+{
+   if (stats) {
+      mongoc_set_destroy (stats->servers);
+      mongoc_mutex_destroy (&stats->mutex);
+      bson_free (stats);
+   }
+}
+
+
+/* the server's entry, created on first use. call with the mutex held */
+static mongoc_connection_stats_server_t *
+_mongoc_connection_stats_server (mongoc_connection_stats_t *stats,
+                                 uint32_t                   server_id,
+                                 const char                *host)
+{
+   mongoc_connection_stats_server_t *server;
+
+   server = (mongoc_connection_stats_server_t *) mongoc_set_get (
+      stats->servers, server_id);
+
+   if (!server) {
+      server = (mongoc_connection_stats_server_t *) bson_malloc0 (
+         sizeof *server);
+      server->stats = stats;
+      server->server_id = server_id;
+      server->host = bson_strdup (host);
+      server->connect_min = INT64_MAX;
+      mongoc_set_add (stats->servers, server_id, server);
+   }
+
+   return server;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_connection_stats_opened --
+ *
+ *       Count a connection to @server_id that is ready for use, having
+ *       begun connecting at @started, and remember its server in @conn.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       Does nothing if @stats is NULL or @conn is already open.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_connection_stats_opened (mongoc_connection_stats_t      *stats,
+                                 mongoc_connection_stats_conn_t *conn,
+                                 uint32_t                        server_id,
+                                 const char                     *host,
+                                 int64_t                         started,
+                                 bool                            in_use)
+{
+   mongoc_connection_stats_server_t *server;
+   int64_t now;
+   int64_t usec;
+
+   if (!stats || conn->server) {
+      return;
+   }
+
+   now = bson_get_monotonic_time ();
+   usec = BSON_MAX (0, now - started);
+
+   mongoc_mutex_lock (&stats->mutex);
+   server = _mongoc_connection_stats_server (stats, server_id, host);
+   server->n_open++;
+   server->n_created++;
+   server->n_in_use += in_use ? 1 : 0;
+   server->opened_at_sum += now;
+   server->connect_buckets[_mongoc_histogram_bucket (usec)]++;
+   server->connect_sum += usec;
+   server->connect_min = BSON_MIN (server->connect_min, usec);
+   server->connect_max = BSON_MAX (server->connect_max, usec);
+   mongoc_mutex_unlock (&stats->mutex);
+
+   conn->server = server;
+   conn->opened_at = now;
+   conn->in_use = in_use;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_connection_stats_closed --
+ *
+ *       Count @conn's close for @reason.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       Does nothing if @conn was never opened, clears it otherwise.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_connection_stats_closed (mongoc_connection_stats_conn_t   *conn,
+                                 mongoc_connection_close_reason_t  reason)
+{
+   mongoc_connection_stats_server_t *server = conn->server;
+
+   if (!server) {
+      return;
+   }
+
+   BSON_ASSERT (reason < MONGOC_CONNECTION_CLOSED_LAST);
+
+   mongoc_mutex_lock (&server->stats->mutex);
+   server->n_open--;
+   server->n_in_use -= conn->in_use ? 1 : 0;
+   server->n_closed[reason]++;
+   server->opened_at_sum -= conn->opened_at;
+   mongoc_mutex_unlock (&server->stats->mutex);
+
+   memset (conn, 0, sizeof *conn);
+}
+
+
+void
+_mongoc_connection_stats_connect_failed (mongoc_connection_stats_t *stats,
+                                         uint32_t                   server_id,
+                                         const char                *host)
+{
+   mongoc_connection_stats_server_t *server;
+
+   if (!stats) {
+      return;
+   }
+
+   mongoc_mutex_lock (&stats->mutex);
+   server = _mongoc_connection_stats_server (stats, server_id, host);
+   server->n_connect_failed++;
+   mongoc_mutex_unlock (&stats->mutex);
+}
+
+
+void
+_mongoc_connection_stats_auth (mongoc_connection_stats_conn_t *conn,
+                               int64_t                         usec)
+{
+   mongoc_connection_stats_server_t *server = conn->server;
+
+   if (!server) {
+      return;
+   }
+
+   mongoc_mutex_lock (&server->stats->mutex);
+   server->n_auth++;
+   server->auth_sum += BSON_MAX (0, usec);
+   mongoc_mutex_unlock (&server->stats->mutex);
+}
+
+
+void
+_mongoc_connection_stats_set_in_use (mongoc_connection_stats_conn_t *conn,
+                                     bool                            in_use)
+{
+   mongoc_connection_stats_server_t *server = conn->server;
+
+   if (!server || conn->in_use == in_use) {
+      return;
+   }
+
+   mongoc_mutex_lock (&server->stats->mutex);
+   server->n_in_use += in_use ? 1 : -1;
+   mongoc_mutex_unlock (&server->stats->mutex);
+
+   conn->in_use = in_use;
+}
+
+
+/* the smallest value in a histogram bucket */
+static int64_t
+_mongoc_connection_stats_bucket_min (uint32_t bucket)
+{
+   uint32_t shift;
+   uint32_t sub;
+
+   if (bucket < MONGOC_HISTOGRAM_SUB_BUCKETS) {
+      return bucket;
+   }
+
+   shift = (bucket - MONGOC_HISTOGRAM_SUB_BUCKETS) /
+           MONGOC_HISTOGRAM_SUB_BUCKETS;
+   sub = (bucket - MONGOC_HISTOGRAM_SUB_BUCKETS) %
+         MONGOC_HISTOGRAM_SUB_BUCKETS;
+
+   return (int64_t) (MONGOC_HISTOGRAM_SUB_BUCKETS + sub) << shift;
+}
+
+
+/* the connect latency at percentile @p, as its bucket's largest value but
+ * no more than the largest latency seen */
+static int64_t
+_mongoc_connection_stats_percentile (
+   const mongoc_connection_stats_server_t *server,
+   int64_t                                 count,
+   double                                  p)
+{
+   int64_t rank;
+   int64_t seen = 0;
+   uint32_t b;
+
+   rank = BSON_MAX (1, (int64_t) ((p / 100.0) * (double) count + 0.5));
+
+   for (b = 0; b < MONGOC_HISTOGRAM_BUCKETS - 1; b++) {
+      seen += server->connect_buckets[b];
+      if (seen >= rank) {
+         return BSON_MIN (_mongoc_connection_stats_bucket_min (b + 1) - 1,
+                          server->connect_max);
+      }
+   }
+
+   return server->connect_max;
+}
+
+
+static void
+_mongoc_connection_stats_append_server (
+   const mongoc_connection_stats_server_t *server,
+   int64_t                                 now,
+   bson_t                                 *doc)
+{
+   bson_t closed;
+   bson_t connect;
+   int64_t n_closed = 0;
+   int i;
+
+   BSON_APPEND_INT32 (doc, "serverId", (int32_t) server->server_id);
+   BSON_APPEND_UTF8 (doc, "host", server->host);
+   BSON_APPEND_INT64 (doc, "open", server->n_open);
+   BSON_APPEND_INT64 (doc, "inUse", server->n_in_use);
+   BSON_APPEND_INT64 (doc, "idle", server->n_open - server->n_in_use);
+   BSON_APPEND_INT64 (doc, "created", server->n_created);
+   BSON_APPEND_INT64 (doc, "connectFailures", server->n_connect_failed);
+
+   for (i = 0; i < MONGOC_CONNECTION_CLOSED_LAST; i++) {
+      n_closed += server->n_closed[i];
+   }
+
+   BSON_APPEND_INT64 (doc, "closed", n_closed);
+   BSON_APPEND_DOCUMENT_BEGIN (doc, "closeReasons", &closed);
+   for (i = 0; i < MONGOC_CONNECTION_CLOSED_LAST; i++) {
+      BSON_APPEND_INT64 (&closed, gCloseReasons[i], server->n_closed[i]);
+   }
+   bson_append_document_end (doc, &closed);
+
+   /* microseconds from starting to connect until ready, with isMaster */
+   BSON_APPEND_DOCUMENT_BEGIN (doc, "connectUsec", &connect);
+   BSON_APPEND_INT64 (&connect, "count", server->n_created);
+   if (server->n_created) {
+      BSON_APPEND_INT64 (&connect, "min", server->connect_min);
+      BSON_APPEND_INT64 (&connect, "mean",
+                         server->connect_sum / server->n_created);
+      BSON_APPEND_INT64 (&connect, "p50", _mongoc_connection_stats_percentile (
+                            server, server->n_created, 50.0));
+      BSON_APPEND_INT64 (&connect, "p90", _mongoc_connection_stats_percentile (
+                            server, server->n_created, 90.0));
+      BSON_APPEND_INT64 (&connect, "p99", _mongoc_connection_stats_percentile (
+                            server, server->n_created, 99.0));
+      BSON_APPEND_INT64 (&connect, "max", server->connect_max);
+   }
+   bson_append_document_end (doc, &connect);
+
+   BSON_APPEND_INT64 (doc, "auths", server->n_auth);
+   BSON_APPEND_INT64 (doc, "authUsec", server->auth_sum);
+   BSON_APPEND_INT64 (doc, "bytesOut", server->bytes_out);
+   BSON_APPEND_INT64 (doc, "bytesIn", server->bytes_in);
+   BSON_APPEND_INT64 (doc, "meanAgeUsec",
+                      server->n_open
+                         ? now - server->opened_at_sum / server->n_open
+                         : 0);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_connection_stats_snapshot --
+ *
+ *       Append a "servers" array to @snapshot, with a document per
+ *       server that has had a connection or a failed attempt. See
+ *       mongoc_client_get_connection_stats for the fields.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_connection_stats_snapshot (mongoc_connection_stats_t *stats,
+                                   bson_t                    *snapshot)
+{
+   mongoc_connection_stats_server_t *server;
+   bson_t servers;
+   bson_t doc;
+   const char *key;
+   char buf[16];
+   int64_t now;
+   size_t i;
+
+   BSON_APPEND_ARRAY_BEGIN (snapshot, "servers", &servers);
+
+   now = bson_get_monotonic_time ();
+   mongoc_mutex_lock (&stats->mutex);
+
+   for (i = 0; i < stats->servers->items_len; i++) {
+      server = (mongoc_connection_stats_server_t *) mongoc_set_get_item (
+         stats->servers, (int) i);
+
+      bson_uint32_to_string ((uint32_t) i, &key, buf, sizeof buf);
+      BSON_APPEND_DOCUMENT_BEGIN (&servers, key, &doc);
+      _mongoc_connection_stats_append_server (server, now, &doc);
+      bson_append_document_end (&servers, &doc);
+   }
+
+   mongoc_mutex_unlock (&stats->mutex);
+
+   bson_append_array_end (snapshot, &servers);
+}
@@ -23,6 +23,8 @@
 
 #include <bson.h>
 
+#include "mongoc-histogram-private.h"
+
 #ifdef __linux__
 # include <sched.h>
 # include <sys/sysinfo.h>
@@ -168,6 +170,112 @@ mongoc_counter_##ident##_reset (void) \
 #undef COUNTER
 
 
+typedef struct
+{
+   int64_t buckets [MONGOC_HISTOGRAM_BUCKETS];
+   int64_t sum;
+   int64_t padding [7];
+} mongoc_histogram_slots_t;
+
+
+typedef struct
+{
+   mongoc_histogram_slots_t *cpus;
+} mongoc_histogram_t;
+
+
+static BSON_INLINE void
+_mongoc_histogram_record (mongoc_histogram_t *histogram,
+                          int64_t             value)
+{
+   mongoc_histogram_slots_t *slots;
+
+   slots = &histogram->cpus[_mongoc_sched_getcpu()];
+   _mongoc_counter_add(slots->buckets[_mongoc_histogram_bucket (value)], 1);
+   _mongoc_counter_add(slots->sum, value);
+}
+
+
+#define HISTOGRAM(ident, Category, Name, Description) \
+   extern mongoc_histogram_t __mongoc_histogram_##ident;
+#include "mongoc-histograms.defs"
+#undef HISTOGRAM
+
+
+enum
+{
+#define HISTOGRAM(ident, Category, Name, Description) \
+   HISTOGRAM_##ident,
+#include "mongoc-histograms.defs"
+#undef HISTOGRAM
+   LAST_HISTOGRAM
+};
+
+
+#define HISTOGRAM(ident, Category, Name, Description) \
+static BSON_INLINE void \
+mongoc_histogram_##ident##_record (int64_t usec) \
+{ \
+   _mongoc_histogram_record (&__mongoc_histogram_##ident, usec); \
+}
+#include "mongoc-histograms.defs"
+#undef HISTOGRAM
+
+
+void _mongoc_histogram_read (uint32_t  num,
+                             int64_t  *buckets,
+                             int64_t  *sum);
+
+
+/*
+ * Keyed counter groups: the same few counters for each server and each
+ * namespace, registered in the shared memory segment the first time a key
+ * is counted. Each table is bounded; once it is full, further keys share
+ * its last group, named "(other)". Keys longer than
+ * MONGOC_KEYED_KEY_SIZE - 1 bytes are truncated.
+ */
+#define MONGOC_KEYED_SERVERS    32
+#define MONGOC_KEYED_NAMESPACES 128
+#define MONGOC_KEYED_KEY_SIZE   240
+
+
+typedef enum
+{
+   MONGOC_KEYED_SERVER,
+   MONGOC_KEYED_NAMESPACE,
+} mongoc_keyed_kind_t;
+
+
+/* a group's counters, one slot each in its mongoc_counter_slots_t */
+typedef enum
+{
+   MONGOC_KEYED_OPS,
+   MONGOC_KEYED_BYTES_OUT,
+   MONGOC_KEYED_BYTES_IN,
+   MONGOC_KEYED_ERRORS,
+   MONGOC_KEYED_TIMEOUTS,
+   MONGOC_KEYED_IN_FLIGHT,
+   MONGOC_KEYED_LAST
+} mongoc_keyed_slot_t;
+
+
+BSON_STATIC_ASSERT (MONGOC_KEYED_LAST <= SLOTS_PER_CACHELINE);
+
+
+mongoc_counter_slots_t *
+_mongoc_counters_keyed (mongoc_keyed_kind_t  kind,
+                        const char          *key);
+
+
+static BSON_INLINE void
+_mongoc_keyed_counter_add (mongoc_counter_slots_t *group,
+                           mongoc_keyed_slot_t     slot,
+                           int64_t                 val)
+{
+   _mongoc_counter_add(group[_mongoc_sched_getcpu()].slots[slot], val);
+}
+
+
 BSON_END_DECLS
 
 
@@ -23,6 +23,7 @@
 #include <string.h>
 
 #ifdef BSON_OS_UNIX
+#include <sched.h>
 #include <sys/mman.h>
 #include <sys/shm.h>
 #endif
@@ -33,6 +34,7 @@
 
 #include "mongoc-counters-private.h"
 #include "mongoc-log.h"
+#include "mongoc-slow-op-private.h"
 
 
 #pragma pack(1)
@@ -58,14 +60,66 @@ typedef struct
    uint32_t n_counters;
    uint32_t infos_offset;
    uint32_t values_offset;
-   uint8_t  padding[44];
+   uint32_t n_histograms;
+   uint32_t histogram_infos_offset;
+   uint32_t histograms_offset;
+   uint32_t n_slow_ops;
+   uint32_t slow_ops_offset;
+   uint32_t n_keyed;
+   uint32_t keyed_infos_offset;
+   uint8_t  padding[16];
 } mongoc_counters_t;
 #pragma pack()
 
 
 BSON_STATIC_ASSERT(sizeof(mongoc_counters_t) == 64);
 
+
+/* a latency histogram's counts for each CPU are at offset */
+#pragma pack(1)
+typedef struct
+{
+   uint32_t offset;
+   uint32_t n_buckets;
+   char          category[24];
+   char          name[32];
+   char          description[64];
+} mongoc_histogram_info_t;
+#pragma pack()
+
+
+BSON_STATIC_ASSERT(sizeof(mongoc_histogram_info_t) == 128);
+BSON_STATIC_ASSERT(sizeof(mongoc_histogram_slots_t) ==
+                   MONGOC_HISTOGRAM_CPU_SIZE(MONGOC_HISTOGRAM_BUCKETS));
+
+
+#define MONGOC_KEYED_FREE     0
+#define MONGOC_KEYED_CLAIMING 1
+#define MONGOC_KEYED_READY    2
+
+#define MONGOC_KEYED_GROUPS (MONGOC_KEYED_SERVERS + MONGOC_KEYED_NAMESPACES)
+
+
+/* a keyed counter group, its counters for each CPU are at offset. Readers
+ * must skip it until its state is MONGOC_KEYED_READY */
+#pragma pack(1)
+typedef struct
+{
+   uint32_t          kind;
+   volatile int32_t  state;
+   uint32_t          offset;
+   uint32_t          padding;
+   char              key[MONGOC_KEYED_KEY_SIZE];
+} mongoc_keyed_info_t;
+#pragma pack()
+
+
+BSON_STATIC_ASSERT(sizeof(mongoc_keyed_info_t) == 256);
+
 static void *gCounterFallback = NULL;
+static char *gCounterSegment = NULL;
+static char *gKeyedSegment = NULL;
+static mongoc_keyed_info_t *gKeyedInfos = NULL;
 
 
 #define COUNTER(ident, Category, Name, Description) \
@@ -74,6 +128,12 @@ static void *gCounterFallback = NULL;
 #undef COUNTER
 
 
+#define HISTOGRAM(ident, Category, Name, Description) \
+   mongoc_histogram_t __mongoc_histogram_##ident;
+#include "mongoc-histograms.defs"
+#undef HISTOGRAM
+
+
 /**
  * mongoc_counters_use_shm:
  *
@@ -110,7 +170,12 @@ mongoc_counters_calc_size (void)
    n_groups = (LAST_COUNTER / SLOTS_PER_CACHELINE) + 1;
    size = (sizeof(mongoc_counters_t) +
            (LAST_COUNTER * sizeof(mongoc_counter_info_t)) +
-           (n_cpu * n_groups * sizeof(mongoc_counter_slots_t)));
+           (n_cpu * n_groups * sizeof(mongoc_counter_slots_t)) +
+           (LAST_HISTOGRAM * sizeof(mongoc_histogram_info_t)) +
+           (n_cpu * LAST_HISTOGRAM * sizeof(mongoc_histogram_slots_t)) +
+           sizeof(mongoc_slow_op_log_t) +
+           (MONGOC_KEYED_GROUPS * sizeof(mongoc_keyed_info_t)) +
+           (n_cpu * MONGOC_KEYED_GROUPS * sizeof(mongoc_counter_slots_t)));
 
 #ifdef BSON_OS_UNIX
    return BSON_MAX(getpagesize(), size);
@@ -128,6 +193,12 @@ mongoc_counters_calc_size (void)
 void
 _mongoc_counters_cleanup (void)
 {
+   _mongoc_slow_ops_detach ();
+
+   gCounterSegment = NULL;
+   gKeyedSegment = NULL;
+   gKeyedInfos = NULL;
+
    if (gCounterFallback) {
       bson_free (gCounterFallback);
       gCounterFallback = NULL;
@@ -268,6 +339,223 @@ mongoc_counters_register (mongoc_counters_t *counters,
 }
 
 
+/**
+ * mongoc_counters_register_histogram:
+ * @counters: A mongoc_counter_t.
+ * @num: The histogram number.
+ * @category: The histogram category.
+ * @name: The histogram name.
+ * @description The histogram description.
+ *
+ * Registers a new latency histogram in the memory segment, like
+ * mongoc_counters_register().
+ *
+ * Returns: The offset to the histogram's buckets for the first CPU.
+ */
+static size_t
+mongoc_counters_register_histogram (mongoc_counters_t *counters,
+                                    uint32_t           num,
+                                    const char        *category,
+                                    const char        *name,
+                                    const char        *description)
+{
+   mongoc_histogram_info_t *infos;
+   char *segment;
+   int n_cpu;
+
+   BSON_ASSERT(counters);
+   BSON_ASSERT(category);
+   BSON_ASSERT(name);
+   BSON_ASSERT(description);
+
+   n_cpu = _mongoc_get_cpu_count();
+   segment = (char *)counters;
+
+   infos = (mongoc_histogram_info_t *)(segment +
+                                       counters->histogram_infos_offset);
+   infos = &infos[counters->n_histograms];
+   infos->n_buckets = MONGOC_HISTOGRAM_BUCKETS;
+   infos->offset = (counters->histograms_offset +
+                    (num * n_cpu * sizeof(mongoc_histogram_slots_t)));
+
+   bson_strncpy (infos->category, category, sizeof infos->category);
+   bson_strncpy (infos->name, name, sizeof infos->name);
+   bson_strncpy (infos->description, description, sizeof infos->description);
+
+   bson_memory_barrier ();
+
+   counters->n_histograms++;
+
+   return infos->offset;
+}
+
+
+/**
+ * mongoc_counters_init_keyed:
+ * @counters: A mongoc_counter_t.
+ *
+ * Lays out the keyed counter groups' tables, all free but for the
+ * "(other)" group that ends each.
+ */
+static void
+mongoc_counters_init_keyed (mongoc_counters_t *counters)
+{
+   mongoc_keyed_info_t *infos;
+   size_t values_offset;
+   uint32_t i;
+
+   infos = (mongoc_keyed_info_t *)((char *)counters +
+                                   counters->keyed_infos_offset);
+   values_offset = (counters->keyed_infos_offset +
+                    MONGOC_KEYED_GROUPS * sizeof(mongoc_keyed_info_t));
+
+   for (i = 0; i < MONGOC_KEYED_GROUPS; i++) {
+      infos[i].kind = (i < MONGOC_KEYED_SERVERS) ? MONGOC_KEYED_SERVER
+                                                 : MONGOC_KEYED_NAMESPACE;
+      infos[i].state = MONGOC_KEYED_FREE;
+      infos[i].offset = (uint32_t)(values_offset +
+                                   (i * counters->n_cpu *
+                                    sizeof(mongoc_counter_slots_t)));
+   }
+
+   bson_strncpy (infos[MONGOC_KEYED_SERVERS - 1].key, "(other)",
+                 MONGOC_KEYED_KEY_SIZE);
+   infos[MONGOC_KEYED_SERVERS - 1].state = MONGOC_KEYED_READY;
+   bson_strncpy (infos[MONGOC_KEYED_GROUPS - 1].key, "(other)",
+                 MONGOC_KEYED_KEY_SIZE);
+   infos[MONGOC_KEYED_GROUPS - 1].state = MONGOC_KEYED_READY;
+
+   gKeyedSegment = (char *)counters;
+   gKeyedInfos = infos;
+
+   bson_memory_barrier ();
+
+   counters->n_keyed = MONGOC_KEYED_GROUPS;
+}
+
+
+static bool
+mongoc_counters_keyed_cas (volatile int32_t *p,
+                           int32_t           old,
+                           int32_t           new_)
+{
+#if defined(__GNUC__)
+   return __sync_bool_compare_and_swap (p, old, new_);
+#elif defined(_WIN32)
+   return InterlockedCompareExchange ((volatile LONG *)p, new_, old) == old;
+#else
+   if (*p != old) {
+      return false;
+   }
+
+   *p = new_;
+   return true;
+#endif
+}
+
+
+/* wait for another thread to publish the group it claimed. claiming only
+ * copies the key, so this is brief unless the claimer is descheduled */
+static int32_t
+mongoc_counters_keyed_wait (mongoc_keyed_info_t *info)
+{
+   uint32_t spins = 0;
+   int32_t state;
+
+   while ((state = info->state) == MONGOC_KEYED_CLAIMING) {
+      if (++spins % 1000 == 0) {
+#ifdef _WIN32
+         SwitchToThread ();
+#else
+         sched_yield ();
+#endif
+      }
+   }
+
+   bson_memory_barrier ();
+
+   return state;
+}
+
+
+/**
+ * _mongoc_counters_keyed:
+ * @kind: Whether @key is a server's "host:port" or a namespace.
+ * @key: The group's key.
+ *
+ * Finds the counter group for @key, registering it if this is the first
+ * time @key is counted. This takes no lock: a group is claimed with a
+ * compare-and-swap on its state, in an open-addressed table, and a lookup
+ * that probes a group being claimed waits until its key is published.
+ *
+ * Returns: The group's counters for each CPU, pass them to
+ * _mongoc_keyed_counter_add(). If @kind's table is full, the "(other)"
+ * group's.
+ */
+mongoc_counter_slots_t *
+_mongoc_counters_keyed (mongoc_keyed_kind_t  kind,
+                        const char          *key)
+{
+   mongoc_keyed_info_t *table;
+   mongoc_keyed_info_t *info;
+   uint32_t size;
+   uint32_t hash = 2166136261u;
+   uint32_t i;
+   int32_t state;
+   size_t len;
+
+   BSON_ASSERT (gKeyedInfos);
+   BSON_ASSERT (key);
+
+   if (kind == MONGOC_KEYED_SERVER) {
+      table = gKeyedInfos;
+      size = MONGOC_KEYED_SERVERS;
+   } else {
+      table = gKeyedInfos + MONGOC_KEYED_SERVERS;
+      size = MONGOC_KEYED_NAMESPACES;
+   }
+
+   len = BSON_MIN (strlen (key), MONGOC_KEYED_KEY_SIZE - 1);
+
+   /* FNV-1a */
+   for (i = 0; i < len; i++) {
+      hash = (hash ^ (uint8_t)key[i]) * 16777619u;
+   }
+
+   /* the table's last group is "(other)", never probed */
+   for (i = 0; i < size - 1; i++) {
+      info = &table[(hash + i) % (size - 1)];
+      state = info->state;
+
+      if (state == MONGOC_KEYED_FREE &&
+          mongoc_counters_keyed_cas (&info->state, MONGOC_KEYED_FREE,
+                                     MONGOC_KEYED_CLAIMING)) {
+         memcpy (info->key, key, len);
+         info->key[len] = '\0';
+         bson_memory_barrier ();
+         info->state = MONGOC_KEYED_READY;
+         mongoc_counter_keyed_groups_inc ();
+
+         return (mongoc_counter_slots_t *)(gKeyedSegment + info->offset);
+      }
+
+      /* a group is never freed, so once published its key is final. a
+       * group still being claimed may be @key's, so it can't be skipped */
+      state = mongoc_counters_keyed_wait (info);
+
+      if (state == MONGOC_KEYED_READY &&
+          0 == memcmp (info->key, key, len) &&
+          info->key[len] == '\0') {
+         return (mongoc_counter_slots_t *)(gKeyedSegment + info->offset);
+      }
+   }
+
+   mongoc_counter_keyed_overflow_inc ();
+
+   return (mongoc_counter_slots_t *)(gKeyedSegment + table[size - 1].offset);
+}
+
+
 /**
  * mongoc_counters_init:
  *
@@ -293,8 +581,27 @@ _mongoc_counters_init (void)
    counters->n_counters = 0;
    counters->infos_offset = sizeof *counters;
    counters->values_offset = (uint32_t)(counters->infos_offset + infos_size);
+   counters->n_histograms = 0;
+   counters->histogram_infos_offset = (uint32_t)(
+      counters->values_offset +
+      (counters->n_cpu * ((LAST_COUNTER / SLOTS_PER_CACHELINE) + 1) *
+       sizeof(mongoc_counter_slots_t)));
+   counters->histograms_offset = (uint32_t)(
+      counters->histogram_infos_offset +
+      LAST_HISTOGRAM * sizeof(mongoc_histogram_info_t));
+   counters->n_slow_ops = MONGOC_SLOW_OPS;
+   counters->slow_ops_offset = (uint32_t)(
+      counters->histograms_offset +
+      (counters->n_cpu * LAST_HISTOGRAM * sizeof(mongoc_histogram_slots_t)));
 
    BSON_ASSERT ((counters->values_offset % 64) == 0);
+   BSON_ASSERT ((counters->histograms_offset % 64) == 0);
+   counters->n_keyed = 0;
+   counters->keyed_infos_offset = (uint32_t)(
+      counters->slow_ops_offset + sizeof(mongoc_slow_op_log_t));
+
+   BSON_ASSERT ((counters->slow_ops_offset % 64) == 0);
+   BSON_ASSERT ((counters->keyed_infos_offset % 64) == 0);
 
 #define COUNTER(ident, Category, Name, Desc) \
    off = mongoc_counters_register(counters, COUNTER_##ident, Category, Name, Desc); \
@@ -302,6 +609,19 @@ _mongoc_counters_init (void)
 #include "mongoc-counters.defs"
 #undef COUNTER
 
+#define HISTOGRAM(ident, Category, Name, Desc) \
+   off = mongoc_counters_register_histogram(counters, HISTOGRAM_##ident, \
+                                            Category, Name, Desc); \
+   __mongoc_histogram_##ident.cpus = \
+      (mongoc_histogram_slots_t *)(segment + off);
+#include "mongoc-histograms.defs"
+#undef HISTOGRAM
+
+   _mongoc_slow_ops_attach (
+      (mongoc_slow_op_log_t *)(segment + counters->slow_ops_offset));
+
+   mongoc_counters_init_keyed (counters);
+
    /*
     * NOTE:
     *
@@ -311,4 +631,54 @@ _mongoc_counters_init (void)
     */
    bson_memory_barrier ();
    counters->size = (uint32_t)size;
+
+   gCounterSegment = segment;
+}
+
+
+/**
+ * _mongoc_histogram_read:
+ * @num: The histogram number.
+ * @buckets: MONGOC_HISTOGRAM_BUCKETS counts to fill out.
+ * @sum: The sum of the values, to fill out.
+ *
+ * Sums a histogram's counts over all CPUs, finding them from the segment
+ * header the way mongoc-stat does, for tests.
+ */
+void
+_mongoc_histogram_read (uint32_t  num,
+                        int64_t  *buckets,
+                        int64_t  *sum)
+{
+   mongoc_counters_t *counters;
+   mongoc_histogram_info_t *info;
+   const int64_t *cpu;
+   uint32_t i;
+   uint32_t b;
+
+   BSON_ASSERT (gCounterSegment);
+   BSON_ASSERT (buckets);
+   BSON_ASSERT (sum);
+
+   counters = (mongoc_counters_t *)gCounterSegment;
+   BSON_ASSERT (num < counters->n_histograms);
+
+   info = (mongoc_histogram_info_t *)(gCounterSegment +
+                                      counters->histogram_infos_offset);
+   info = &info[num];
+   BSON_ASSERT (info->n_buckets == MONGOC_HISTOGRAM_BUCKETS);
+
+   memset (buckets, 0, info->n_buckets * sizeof *buckets);
+   *sum = 0;
+
+   for (i = 0; i < counters->n_cpu; i++) {
+      cpu = (const int64_t *)(gCounterSegment + info->offset +
+                              i * MONGOC_HISTOGRAM_CPU_SIZE(info->n_buckets));
+
+      for (b = 0; b < info->n_buckets; b++) {
+         buckets[b] += cpu[b];
+      }
+
+      *sum += cpu[info->n_buckets];
+   }
 }
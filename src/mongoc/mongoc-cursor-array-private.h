@@ -42,6 +42,10 @@ void
 _mongoc_cursor_array_set_bson (mongoc_cursor_t *cursor,
                                const bson_t    *bson);
 
+void
+_mongoc_cursor_array_set_error (mongoc_cursor_t    *cursor,
+                                const bson_error_t *error);
+
 
 BSON_END_DECLS
 
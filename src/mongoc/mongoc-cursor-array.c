@@ -38,6 +38,9 @@ typedef struct
    bson_iter_t    iter;
    bson_t         bson;   /* current document */
    const char    *field_name;
+   /* set on the cursor after the synthetic documents are iterated */
+   bool           has_error;
+   bson_error_t   error;
 } mongoc_cursor_array_t;
 
 
@@ -70,10 +73,6 @@ _mongoc_cursor_array_destroy (mongoc_cursor_t *cursor)
       bson_destroy (&arr->array);
    }
 
-   if (arr->has_synthetic_bson) {
-      bson_destroy(&arr->bson);
-   }
-
    bson_free (cursor->iface_data);
    _mongoc_cursor_destroy (cursor);
 
@@ -131,6 +130,8 @@ _mongoc_cursor_array_next (mongoc_cursor_t *cursor,
       bson_iter_document (&arr->iter, &document_len, &document);
       bson_init_static (&arr->bson, document, document_len);
       *bson = &arr->bson;
+   } else if (arr->has_error) {
+      memcpy (&cursor->error, &arr->error, sizeof (bson_error_t));
    }
 
    RETURN (ret);
@@ -187,7 +188,7 @@ _mongoc_cursor_array_error  (mongoc_cursor_t *cursor,
 
    arr = (mongoc_cursor_array_t *)cursor->iface_data;
 
-   if (arr->has_synthetic_bson) {
+   if (arr->has_synthetic_bson && !arr->has_error) {
       return false;
    } else {
       return _mongoc_cursor_error(cursor, error);
@@ -235,9 +236,29 @@ _mongoc_cursor_array_set_bson (mongoc_cursor_t *cursor,
    ENTRY;
 
    arr = (mongoc_cursor_array_t *)cursor->iface_data;
-   bson_copy_to(bson, &arr->bson);
+   /* arr->bson is only a view of the current document */
+   bson_copy_to(bson, &arr->array);
+   arr->has_array = true;
    arr->has_synthetic_bson = true;
-   bson_iter_init(&arr->iter, &arr->bson);
+   bson_iter_init(&arr->iter, &arr->array);
+
+   EXIT;
+}
+
+
+/* fail with @error once the documents from _mongoc_cursor_array_set_bson
+ * are iterated */
+void
+_mongoc_cursor_array_set_error (mongoc_cursor_t    *cursor,
+                                const bson_error_t *error)
+{
+   mongoc_cursor_array_t *arr;
+
+   ENTRY;
+
+   arr = (mongoc_cursor_array_t *)cursor->iface_data;
+   memcpy (&arr->error, error, sizeof (bson_error_t));
+   arr->has_error = true;
 
    EXIT;
 }
@@ -21,9 +21,11 @@
 #include "mongoc-counters-private.h"
 #include "mongoc-error.h"
 #include "mongoc-log.h"
+#include "mongoc-memory-private.h"
 #include "mongoc-trace-private.h"
 #include "mongoc-cursor-cursorid-private.h"
 #include "mongoc-read-concern-private.h"
+#include "mongoc-slow-op-private.h"
 #include "mongoc-util-private.h"
 #include "mongoc-write-concern-private.h"
 
@@ -228,7 +230,7 @@ _mongoc_cursor_new_with_opts (mongoc_client_t             *client,
 
    BSON_ASSERT (client);
 
-   cursor = (mongoc_cursor_t *) bson_malloc0 (sizeof *cursor);
+   cursor = (mongoc_cursor_t *) _mongoc_memory_malloc0 (CURSOR, sizeof *cursor);
    cursor->client = client;
    cursor->is_command = is_command ? 1 : 0;
 
@@ -316,7 +318,9 @@ _mongoc_cursor_new_with_opts (mongoc_client_t             *client,
       }
    }
 
-   _mongoc_buffer_init (&cursor->buffer, NULL, 0, NULL, NULL);
+   _mongoc_buffer_init (&cursor->buffer, NULL, 0,
+                        MONGOC_MEMORY_REALLOC_FUNC (CURSOR),
+                        MONGOC_MEMORY_REALLOC_CTX (CURSOR));
    _mongoc_read_prefs_validate (read_prefs, &cursor->error);
 
 finish:
@@ -494,8 +498,9 @@ _mongoc_cursor_destroy (mongoc_cursor_t *cursor)
       cursor->client->in_exhaust = false;
       if (!cursor->done) {
          /* The only way to stop an exhaust cursor is to kill the connection */
-         mongoc_cluster_disconnect_node (&cursor->client->cluster,
-                                         cursor->server_id);
+         mongoc_cluster_disconnect_node (
+            &cursor->client->cluster, cursor->server_id,
+            MONGOC_CONNECTION_CLOSED_EXHAUST_CURSOR);
       }
    } else if (cursor->rpc.reply.cursor_id) {
       bson_strncpy (db, cursor->ns, cursor->dblen + 1);
@@ -520,7 +525,7 @@ _mongoc_cursor_destroy (mongoc_cursor_t *cursor)
 
    bson_destroy (&cursor->filter);
    bson_destroy (&cursor->opts);
-   bson_free(cursor);
+   _mongoc_memory_free (cursor);
 
    mongoc_counter_cursors_active_dec();
    mongoc_counter_cursors_disposed_inc();
@@ -622,6 +627,7 @@ _mongoc_cursor_monitor_legacy_query (mongoc_cursor_t        *cursor,
    mongoc_client_t *client;
    mongoc_apm_command_started_t event;
    char db[MONGOC_NAMESPACE_MAX];
+   bool skip;
 
    ENTRY;
 
@@ -633,8 +639,9 @@ _mongoc_cursor_monitor_legacy_query (mongoc_cursor_t        *cursor,
 
    bson_init (&doc);
    bson_strncpy (db, cursor->ns, cursor->dblen + 1);
+   skip = (client->apm_callbacks.skip & MONGOC_APM_SKIP_COMMAND) != 0;
 
-   if (!cursor->is_command) {
+   if (!cursor->is_command && !skip) {
       /* simulate a MongoDB 3.2+ "find" command */
       if (!_mongoc_cursor_prepare_find_command (cursor, &doc, server_stream)) {
          /* cursor->error is set */
@@ -644,7 +651,11 @@ _mongoc_cursor_monitor_legacy_query (mongoc_cursor_t        *cursor,
    }
 
    mongoc_apm_command_started_init (&event,
-                                    cursor->is_command ? &cursor->filter : &doc,
+                                    skip ? NULL
+                                         : cursor->is_command ? &cursor->filter
+                                                              : &doc,
+                                    NULL,
+                                    0,
                                     db,
                                     cmd_name,
                                     client->cluster.request_id,
@@ -702,7 +713,10 @@ _mongoc_cursor_monitor_succeeded (mongoc_cursor_t        *cursor,
       EXIT;
    }
 
-   if (cursor->is_command) {
+   if (client->apm_callbacks.skip & MONGOC_APM_SKIP_REPLY) {
+      /* don't copy the batch into a fake reply */
+      bson_init (&reply);
+   } else if (cursor->is_command) {
       /* cursor is from mongoc_client_command. we're in mongoc_cursor_next. */
       if (!_mongoc_rpc_reply_get_first(&cursor->rpc.reply, &reply)) {
          MONGOC_ERROR ("_mongoc_cursor_monitor_succeeded can't parse reply");
@@ -784,6 +798,58 @@ _mongoc_cursor_monitor_failed (mongoc_cursor_t        *cursor,
 }
 
 
+/*
+ * log a legacy query or getmore in the slow op log if it took the
+ * cluster's slowOpThresholdMS or more. @query is the command, the filter,
+ * or NULL for a getmore
+ */
+static void
+_mongoc_cursor_check_slow_op (mongoc_cursor_t        *cursor,
+                              int64_t                 duration,
+                              mongoc_server_stream_t *stream,
+                              const char             *cmd_name,
+                              uint32_t                request_id,
+                              const bson_t           *query,
+                              bool                    succeeded)
+{
+   mongoc_span_t span;
+   char db[sizeof cursor->ns];
+   const char *coll;
+   bson_t command = BSON_INITIALIZER;
+
+   if (duration <
+       1000 * (int64_t) cursor->client->cluster.slowopthresholdms) {
+      return;
+   }
+
+   bson_strncpy (db, cursor->ns, cursor->dblen + 1);
+   coll = cursor->ns + BSON_MIN (cursor->dblen + 1, cursor->nslen);
+
+   if (!cursor->is_command || !query) {
+      /* like the find or getMore command */
+      BSON_APPEND_UTF8 (&command, cmd_name, coll);
+      if (query) {
+         BSON_APPEND_DOCUMENT (&command, "filter", query);
+      }
+
+      query = &command;
+   }
+
+   memset (&span, 0, sizeof span);
+   span.operation_id = cursor->operation_id;
+   span.request_id = request_id;
+   span.server_id = stream->sd->id;
+   span.command_name = cmd_name;
+   span.db_name = db;
+   span.succeeded = succeeded;
+
+   _mongoc_slow_op_record (duration, &span, &stream->sd->host, query,
+                           succeeded ? cursor->rpc.header.msg_len : 0);
+
+   bson_destroy (&command);
+}
+
+
 #define OPT_CHECK(_type) do { \
       if (!BSON_ITER_HOLDS_##_type (&iter)) { \
          bson_set_error (&cursor->error, \
@@ -1051,10 +1117,11 @@ _mongoc_cursor_op_query (mongoc_cursor_t        *cursor,
                          mongoc_server_stream_t *server_stream)
 {
    int64_t started;
+   int64_t duration;
    uint32_t request_id;
    mongoc_rpc_t rpc;
    const char *cmd_name; /* for command monitoring */
-   const bson_t *query_ptr;
+   const bson_t *query_ptr = NULL;
    bson_t query = BSON_INITIALIZER;
    bson_t fields = BSON_INITIALIZER;
    mongoc_query_flags_t flags;
@@ -1176,8 +1243,9 @@ _mongoc_cursor_op_query (mongoc_cursor_t        *cursor,
       cursor->client->in_exhaust = true;
    }
 
+   duration = bson_get_monotonic_time () - started;
    _mongoc_cursor_monitor_succeeded (cursor,
-                                     bson_get_monotonic_time () - started,
+                                     duration,
                                      true, /* first_batch */
                                      server_stream,
                                      cmd_name);
@@ -1190,9 +1258,17 @@ _mongoc_cursor_op_query (mongoc_cursor_t        *cursor,
 
 done:
    if (!succeeded) {
-      _mongoc_cursor_monitor_failed (cursor,
-                                     bson_get_monotonic_time () - started,
-                                     server_stream, cmd_name);
+      duration = bson_get_monotonic_time () - started;
+      _mongoc_cursor_monitor_failed (cursor, duration, server_stream,
+                                     cmd_name);
+   }
+
+   if (cursor->client->cluster.slowopthresholdms) {
+      _mongoc_cursor_check_slow_op (cursor, duration, server_stream,
+                                    cmd_name, request_id,
+                                    cursor->is_command ? &cursor->filter
+                                                       : query_ptr,
+                                    succeeded);
    }
 
    apply_read_prefs_result_cleanup (&result);
@@ -1485,7 +1561,10 @@ _mongoc_cursor_monitor_legacy_get_more (mongoc_cursor_t        *cursor,
 
    bson_strncpy (db, cursor->ns, cursor->dblen + 1);
    mongoc_apm_command_started_init (&event,
-                                    &doc,
+                                    (client->apm_callbacks.skip &
+                                     MONGOC_APM_SKIP_COMMAND) ? NULL : &doc,
+                                    NULL,
+                                    0,
                                     db,
                                     "getMore",
                                     client->cluster.request_id,
@@ -1507,8 +1586,9 @@ _mongoc_cursor_op_getmore (mongoc_cursor_t        *cursor,
                            mongoc_server_stream_t *server_stream)
 {
    int64_t started;
+   int64_t duration;
    mongoc_rpc_t rpc;
-   uint32_t request_id;
+   uint32_t request_id = 0;
    mongoc_cluster_t *cluster;
    mongoc_query_flags_t flags;
 
@@ -1592,19 +1672,32 @@ _mongoc_cursor_op_getmore (mongoc_cursor_t        *cursor,
       cursor->rpc.reply.documents,
       (size_t)cursor->rpc.reply.documents_len);
 
+   duration = bson_get_monotonic_time () - started;
    _mongoc_cursor_monitor_succeeded (cursor,
-                                     bson_get_monotonic_time () - started,
+                                     duration,
                                      false, /* not first batch */
                                      server_stream,
                                      "getMore");
 
+   if (cluster->slowopthresholdms) {
+      _mongoc_cursor_check_slow_op (cursor, duration, server_stream,
+                                    "getMore", request_id, NULL, true);
+   }
+
    RETURN (true);
 
 fail:
+   duration = bson_get_monotonic_time () - started;
    _mongoc_cursor_monitor_failed (cursor,
-                                  bson_get_monotonic_time () - started,
+                                  duration,
                                   server_stream,
                                   "getMore");
+
+   if (cluster->slowopthresholdms) {
+      _mongoc_cursor_check_slow_op (cursor, duration, server_stream,
+                                    "getMore", request_id, NULL, false);
+   }
+
    RETURN (false);
 }
 
@@ -1887,7 +1980,7 @@ _mongoc_cursor_clone (const mongoc_cursor_t *cursor)
 
    BSON_ASSERT (cursor);
 
-   _clone = (mongoc_cursor_t *)bson_malloc0 (sizeof *_clone);
+   _clone = (mongoc_cursor_t *) _mongoc_memory_malloc0 (CURSOR, sizeof *_clone);
 
    _clone->client = cursor->client;
    _clone->is_command = cursor->is_command;
@@ -1909,7 +2002,9 @@ _mongoc_cursor_clone (const mongoc_cursor_t *cursor)
 
    bson_strncpy (_clone->ns, cursor->ns, sizeof _clone->ns);
 
-   _mongoc_buffer_init (&_clone->buffer, NULL, 0, NULL, NULL);
+   _mongoc_buffer_init (&_clone->buffer, NULL, 0,
+                        MONGOC_MEMORY_REALLOC_FUNC (CURSOR),
+                        MONGOC_MEMORY_REALLOC_CTX (CURSOR));
 
    mongoc_counter_cursors_active_inc ();
 
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_DNS_CACHE_PRIVATE_H
+#define MONGOC_DNS_CACHE_PRIVATE_H
+
+#if !defined (MONGOC_COMPILATION)
+#error "Only <mongoc.h> can be included directly."
+#endif
+
+#include <bson.h>
+
+#include "mongoc-host-list.h"
+#include "mongoc-socket.h"
+
+/* getaddrinfo doesn't tell us the records' TTL, use a fixed one. the URI
+ * option "dnsCacheTTLMS" overrides it, a negative value bypasses the cache */
+#define MONGOC_DNS_CACHE_TTL_MS 60000
+
+
+BSON_BEGIN_DECLS
+
+
+/* looks up a name's stream socket addresses, allocated like the results
+ * of _mongoc_dns_resolve, or returns NULL and sets error. tests replace
+ * getaddrinfo with _mongoc_dns_cache_set_resolver */
+typedef struct addrinfo *(*mongoc_dns_resolver_t) (const mongoc_host_list_t *host,
+                                                   void                     *ctx,
+                                                   bson_error_t             *error);
+
+
+void _mongoc_dns_cache_init          (void);
+
+void _mongoc_dns_cache_cleanup       (void);
+
+bool _mongoc_dns_resolve             (const mongoc_host_list_t *host,
+                                      int32_t                   ttl_ms,
+                                      struct addrinfo         **results,
+                                      bson_error_t             *error);
+
+void _mongoc_dns_results_destroy     (struct addrinfo          *results);
+
+void _mongoc_dns_cache_clear         (void);
+
+void _mongoc_dns_cache_set_resolver  (mongoc_dns_resolver_t     resolver,
+                                      void                     *ctx);
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_DNS_CACHE_PRIVATE_H */
@@ -0,0 +1,351 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "mongoc-counters-private.h"
+#include "mongoc-dns-cache-private.h"
+#include "mongoc-error.h"
+#include "mongoc-thread-private.h"
+#include "mongoc-trace-private.h"
+#include "mongoc-util-private.h"
+#include "utlist.h"
+
+#undef MONGOC_LOG_DOMAIN
+#define MONGOC_LOG_DOMAIN "dns"
+
+/* A process-wide cache of successful name resolutions, shared by the
+ * topology scanner and client connections. Each caller passes its own TTL
+ * and only uses entries resolved more recently than that, so a client
+ * configured with a short "dnsCacheTTLMS" still fails over promptly. An
+ * entry is evicted once it is older than the longest TTL it was stored with.
+ * Failures aren't cached. The dns_success and dns_failure counters count
+ * only real lookups, not cache hits.
+ */
+
+typedef struct _mongoc_dns_cache_entry_t
+{
+   char                              *host;
+   uint16_t                           port;
+   int                                family;
+   struct addrinfo                   *results;
+   int64_t                            resolved_at;
+   int64_t                            expire_at;
+   struct _mongoc_dns_cache_entry_t  *next;
+   struct _mongoc_dns_cache_entry_t  *prev;
+} mongoc_dns_cache_entry_t;
+
+
+static struct addrinfo *
+_mongoc_dns_getaddrinfo (const mongoc_host_list_t *host,
+                         void                     *ctx,
+                         bson_error_t             *error);
+
+
+static mongoc_mutex_t gDnsCacheMutex;
+static mongoc_dns_cache_entry_t *gDnsCache;
+
+/* guarded by gDnsCacheMutex */
+static mongoc_dns_resolver_t gDnsResolver = _mongoc_dns_getaddrinfo;
+static void *gDnsResolverCtx;
+
+
+void
+_mongoc_dns_cache_init (void)
+{
+   mongoc_mutex_init (&gDnsCacheMutex);
+   gDnsCache = NULL;
+}
+
+
+void
+_mongoc_dns_cache_cleanup (void)
+{
+   _mongoc_dns_cache_clear ();
+   mongoc_mutex_destroy (&gDnsCacheMutex);
+}
+
+
+static void
+_mongoc_dns_cache_entry_destroy (mongoc_dns_cache_entry_t *entry)
+{
+   bson_free (entry->host);
+   _mongoc_dns_results_destroy (entry->results);
+   bson_free (entry);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_dns_cache_clear --
+ *
+ *       Forget all cached resolutions.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_dns_cache_clear (void)
+{
+   mongoc_dns_cache_entry_t *entry, *tmp;
+
+   mongoc_mutex_lock (&gDnsCacheMutex);
+
+   DL_FOREACH_SAFE (gDnsCache, entry, tmp) {
+      DL_DELETE (gDnsCache, entry);
+      _mongoc_dns_cache_entry_destroy (entry);
+   }
+
+   mongoc_mutex_unlock (&gDnsCacheMutex);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_dns_cache_set_resolver --
+ *
+ *       Resolve names with @resolver instead of getaddrinfo, for tests.
+ *       Pass NULL to restore getaddrinfo. Cached entries are kept; call
+ *       _mongoc_dns_cache_clear to forget them.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_dns_cache_set_resolver (mongoc_dns_resolver_t  resolver,
+                                void                  *ctx)
+{
+   mongoc_mutex_lock (&gDnsCacheMutex);
+   gDnsResolver = resolver ? resolver : _mongoc_dns_getaddrinfo;
+   gDnsResolverCtx = resolver ? ctx : NULL;
+   mongoc_mutex_unlock (&gDnsCacheMutex);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_dns_results_copy --
+ *
+ *       Deep-copy a list of addresses, without canonical names, so it
+ *       can outlive freeaddrinfo and be shared through the cache.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static struct addrinfo *
+_mongoc_dns_results_copy (const struct addrinfo *results)
+{
+   struct addrinfo *head = NULL;
+   struct addrinfo **tail = &head;
+   struct addrinfo *ai;
+
+   for (; results; results = results->ai_next) {
+      ai = (struct addrinfo *) bson_malloc0 (sizeof *ai);
+      ai->ai_flags = results->ai_flags;
+      ai->ai_family = results->ai_family;
+      ai->ai_socktype = results->ai_socktype;
+      ai->ai_protocol = results->ai_protocol;
+      ai->ai_addrlen = results->ai_addrlen;
+      ai->ai_addr = (struct sockaddr *) bson_malloc (results->ai_addrlen);
+      memcpy (ai->ai_addr, results->ai_addr, results->ai_addrlen);
+
+      *tail = ai;
+      tail = &ai->ai_next;
+   }
+
+   return head;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_dns_results_destroy --
+ *
+ *       Free addresses returned by _mongoc_dns_resolve.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_dns_results_destroy (struct addrinfo *results)
+{
+   struct addrinfo *next;
+
+   while (results) {
+      next = results->ai_next;
+      bson_free (results->ai_addr);
+      bson_free (results);
+      results = next;
+   }
+}
+
+
+/* find @host's entry, call with gDnsCacheMutex locked */
+static mongoc_dns_cache_entry_t *
+_mongoc_dns_cache_find (const mongoc_host_list_t *host)
+{
+   mongoc_dns_cache_entry_t *entry;
+
+   DL_FOREACH (gDnsCache, entry) {
+      if (entry->port == host->port &&
+          entry->family == host->family &&
+          !strcasecmp (entry->host, host->host)) {
+         return entry;
+      }
+   }
+
+   return NULL;
+}
+
+
+/* the default resolver */
+static struct addrinfo *
+_mongoc_dns_getaddrinfo (const mongoc_host_list_t *host,
+                         void                     *ctx,
+                         bson_error_t             *error)
+{
+   struct addrinfo hints;
+   struct addrinfo *resolved;
+   struct addrinfo *results;
+   char portstr [8];
+
+   bson_snprintf (portstr, sizeof portstr, "%hu", host->port);
+
+   memset (&hints, 0, sizeof hints);
+   hints.ai_family = host->family;
+   hints.ai_socktype = SOCK_STREAM;
+   hints.ai_flags = 0;
+   hints.ai_protocol = 0;
+
+   if (getaddrinfo (host->host, portstr, &hints, &resolved) != 0) {
+      bson_set_error (error,
+                      MONGOC_ERROR_STREAM,
+                      MONGOC_ERROR_STREAM_NAME_RESOLUTION,
+                      "Failed to resolve '%s'",
+                      host->host);
+      return NULL;
+   }
+
+   results = _mongoc_dns_results_copy (resolved);
+   freeaddrinfo (resolved);
+
+   return results;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_dns_resolve --
+ *
+ *       Resolve @host's name and port to a list of stream socket
+ *       addresses, from the cache if it has an entry resolved less than
+ *       @ttl_ms ago. If @ttl_ms is negative the cache is neither read nor
+ *       updated. Safe to call from several threads at once; lookups run
+ *       without the cache lock, so two threads may resolve the same name,
+ *       but the cache keeps one entry per host, port and family.
+ *
+ * Returns:
+ *       true and sets @results, which the caller must free with
+ *       _mongoc_dns_results_destroy. Otherwise false and sets @error.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_dns_resolve (const mongoc_host_list_t *host,
+                     int32_t                   ttl_ms,
+                     struct addrinfo         **results,
+                     bson_error_t             *error)
+{
+   mongoc_dns_cache_entry_t *entry, *tmp;
+   mongoc_dns_resolver_t resolver;
+   void *resolver_ctx;
+   int64_t ttl_usec;
+   int64_t now;
+
+   ENTRY;
+
+   BSON_ASSERT (host);
+   BSON_ASSERT (results);
+
+   *results = NULL;
+   now = bson_get_monotonic_time ();
+   ttl_usec = (int64_t) ttl_ms * 1000;
+
+   mongoc_mutex_lock (&gDnsCacheMutex);
+
+   DL_FOREACH_SAFE (gDnsCache, entry, tmp) {
+      if (entry->expire_at <= now) {
+         DL_DELETE (gDnsCache, entry);
+         _mongoc_dns_cache_entry_destroy (entry);
+      }
+   }
+
+   if (ttl_ms >= 0 && (entry = _mongoc_dns_cache_find (host)) &&
+       now - entry->resolved_at < ttl_usec) {
+      *results = _mongoc_dns_results_copy (entry->results);
+   }
+
+   resolver = gDnsResolver;
+   resolver_ctx = gDnsResolverCtx;
+
+   mongoc_mutex_unlock (&gDnsCacheMutex);
+
+   if (*results) {
+      RETURN (true);
+   }
+
+   *results = resolver (host, resolver_ctx, error);
+
+   if (!*results) {
+      mongoc_counter_dns_failure_inc ();
+      RETURN (false);
+   }
+
+   mongoc_counter_dns_success_inc ();
+
+   if (ttl_ms <= 0) {
+      RETURN (true);
+   }
+
+   now = bson_get_monotonic_time ();
+
+   mongoc_mutex_lock (&gDnsCacheMutex);
+
+   /* another thread may have resolved the same name meanwhile */
+   if ((entry = _mongoc_dns_cache_find (host))) {
+      _mongoc_dns_results_destroy (entry->results);
+   } else {
+      entry = (mongoc_dns_cache_entry_t *) bson_malloc0 (sizeof *entry);
+      entry->host = bson_strdup (host->host);
+      entry->port = host->port;
+      entry->family = host->family;
+      DL_APPEND (gDnsCache, entry);
+   }
+
+   entry->results = _mongoc_dns_results_copy (*results);
+   entry->resolved_at = now;
+   entry->expire_at = BSON_MAX (entry->expire_at, now + ttl_usec);
+
+   mongoc_mutex_unlock (&gDnsCacheMutex);
+
+   RETURN (true);
+}
@@ -42,6 +42,15 @@ BSON_BEGIN_DECLS
 #endif
 
 
+/* a socket read or write gives up with EAGAIN once its deadline passes,
+ * TLS streams set ETIMEDOUT */
+#if defined(_WIN32)
+# define MONGOC_ERRNO_IS_TIMEDOUT(_errno) ((_errno == ETIMEDOUT) || (_errno == WSAETIMEDOUT) || (_errno == EAGAIN) || (_errno == WSAEWOULDBLOCK))
+#else
+# define MONGOC_ERRNO_IS_TIMEDOUT(_errno) ((_errno == ETIMEDOUT) || (_errno == EAGAIN) || (_errno == EWOULDBLOCK))
+#endif
+
+
 BSON_END_DECLS
 
 
@@ -24,6 +24,10 @@
 #include <bson.h>
 #include "mongoc-write-command-private.h"
 
+/* commands mongoc_collection_find_and_modify_batch sends before reading
+ * the oldest reply */
+#define MONGOC_FIND_AND_MODIFY_PIPELINE_DEPTH 16
+
 BSON_BEGIN_DECLS
 
 struct _mongoc_find_and_modify_opts_t
@@ -25,6 +25,7 @@
 #include "mongoc-cursor.h"
 #include "mongoc-cursor-private.h"
 #include "mongoc-collection.h"
+#include "mongoc-counters-private.h"
 #include "mongoc-gridfs.h"
 #include "mongoc-gridfs-private.h"
 #include "mongoc-gridfs-file.h"
@@ -32,6 +33,7 @@
 #include "mongoc-gridfs-file-page.h"
 #include "mongoc-gridfs-file-page-private.h"
 #include "mongoc-iovec.h"
+#include "mongoc-memory-private.h"
 #include "mongoc-trace-private.h"
 #include "mongoc-error.h"
 
@@ -217,7 +219,8 @@ _mongoc_gridfs_file_new_from_bson (mongoc_gridfs_t *gridfs,
    BSON_ASSERT (gridfs);
    BSON_ASSERT (data);
 
-   file = (mongoc_gridfs_file_t *)bson_malloc0 (sizeof *file);
+   file = (mongoc_gridfs_file_t *) _mongoc_memory_malloc0 (GRIDFS,
+                                                           sizeof *file);
 
    file->gridfs = gridfs;
    file->chunk_callbacks = NULL;
@@ -315,7 +318,8 @@ _mongoc_gridfs_file_new (mongoc_gridfs_t          *gridfs,
       opt = &default_opt;
    }
 
-   file = (mongoc_gridfs_file_t *)bson_malloc0 (sizeof *file);
+   file = (mongoc_gridfs_file_t *) _mongoc_memory_malloc0 (GRIDFS,
+                                                           sizeof *file);
 
    file->gridfs = gridfs;
    file->is_dirty = 1;
@@ -414,7 +418,7 @@ mongoc_gridfs_file_destroy (mongoc_gridfs_file_t *file)
       bson_destroy (&file->bson_metadata);
    }
 
-   bson_free (file);
+   _mongoc_memory_free (file);
 
    EXIT;
 }
@@ -627,6 +631,7 @@ _mongoc_gridfs_file_flush_page (mongoc_gridfs_file_t *file)
    bool r;
    const uint8_t *buf;
    uint32_t len;
+   int64_t started;
 
    ENTRY;
    BSON_ASSERT (file);
@@ -650,8 +655,13 @@ _mongoc_gridfs_file_flush_page (mongoc_gridfs_file_t *file)
 
    bson_append_binary (update, "data", -1, BSON_SUBTYPE_BINARY, buf, len);
 
+   started = bson_get_monotonic_time ();
    r = mongoc_collection_update (file->gridfs->chunks, MONGOC_UPDATE_UPSERT,
                                  selector, update, NULL, &file->error);
+   if (r) {
+      mongoc_histogram_gridfs_chunk_write_record (bson_get_monotonic_time () -
+                                                  started);
+   }
 
    bson_destroy (selector);
    bson_destroy (update);
@@ -744,6 +754,7 @@ _mongoc_gridfs_file_refresh_page (mongoc_gridfs_file_t *file)
    bson_iter_t iter;
    int64_t existing_chunks;
    int64_t required_chunks;
+   int64_t started;
 
    const uint8_t *data = NULL;
    uint32_t len;
@@ -767,6 +778,8 @@ _mongoc_gridfs_file_refresh_page (mongoc_gridfs_file_t *file)
       data = (uint8_t *)"";
       len = 0;
    } else {
+      started = bson_get_monotonic_time ();
+
       /* if we have a cursor, but the cursor doesn't have the chunk we're going
        * to need, destroy it (we'll grab a new one immediately there after) */
       if (file->cursor && !_mongoc_gridfs_file_keep_cursor (file)) {
@@ -817,6 +830,9 @@ _mongoc_gridfs_file_refresh_page (mongoc_gridfs_file_t *file)
          file->cursor_range[0]++;
       }
 
+      mongoc_histogram_gridfs_chunk_read_record (bson_get_monotonic_time () -
+                                                 started);
+
       bson_iter_init (&iter, chunk);
 
       /* grab out what we need from the chunk */
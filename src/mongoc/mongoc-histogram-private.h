@@ -0,0 +1,152 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_HISTOGRAM_PRIVATE_H
+#define MONGOC_HISTOGRAM_PRIVATE_H
+
+/* no MONGOC_COMPILATION check: mongoc-stat includes this header to read
+ * the counters segment without linking libmongoc, so it needs only bson.h */
+
+#include <bson.h>
+
+
+BSON_BEGIN_DECLS
+
+
+/*
+ * Latency histograms are log-linear, like HDR histograms: values below
+ * MONGOC_HISTOGRAM_SUB_BUCKETS have a bucket each, then each power of two
+ * is split into MONGOC_HISTOGRAM_SUB_BUCKETS buckets, so a bucket's width
+ * is at most 1/8th of its values. The last bucket counts all values past
+ * the others, about 2.4 hours in microseconds.
+ */
+#define MONGOC_HISTOGRAM_SUB_BITS    3
+#define MONGOC_HISTOGRAM_SUB_BUCKETS (1 << MONGOC_HISTOGRAM_SUB_BITS)
+#define MONGOC_HISTOGRAM_BUCKETS     248
+
+/* each CPU's counts in the segment are n_buckets values, then their sum,
+ * padded to 64 bytes */
+#define MONGOC_HISTOGRAM_CPU_SIZE(n_buckets) \
+   ((((n_buckets) + 1) * sizeof (int64_t) + 63) / 64 * 64)
+
+
+static BSON_INLINE uint32_t
+_mongoc_histogram_bucket (int64_t value)
+{
+   uint64_t v;
+   uint32_t msb = 0;
+   uint32_t bucket;
+
+   if (value < MONGOC_HISTOGRAM_SUB_BUCKETS) {
+      return value < 0 ? 0 : (uint32_t) value;
+   }
+
+   v = (uint64_t) value;
+
+#if defined(__GNUC__)
+   msb = 63 - (uint32_t) __builtin_clzll (v);
+#else
+   while (v >> (msb + 1)) {
+      msb++;
+   }
+#endif
+
+   bucket = (uint32_t) (MONGOC_HISTOGRAM_SUB_BUCKETS +
+                        (msb - MONGOC_HISTOGRAM_SUB_BITS) *
+                           MONGOC_HISTOGRAM_SUB_BUCKETS +
+                        ((v >> (msb - MONGOC_HISTOGRAM_SUB_BITS)) &
+                         (MONGOC_HISTOGRAM_SUB_BUCKETS - 1)));
+
+   return BSON_MIN (bucket, MONGOC_HISTOGRAM_BUCKETS - 1);
+}
+
+
+/* the smallest value in a histogram bucket */
+static BSON_INLINE int64_t
+_mongoc_histogram_bucket_min (uint32_t bucket)
+{
+   uint32_t shift;
+   uint32_t sub;
+
+   if (bucket < MONGOC_HISTOGRAM_SUB_BUCKETS) {
+      return bucket;
+   }
+
+   shift = (bucket - MONGOC_HISTOGRAM_SUB_BUCKETS) /
+           MONGOC_HISTOGRAM_SUB_BUCKETS;
+   sub = (bucket - MONGOC_HISTOGRAM_SUB_BUCKETS) %
+         MONGOC_HISTOGRAM_SUB_BUCKETS;
+
+   return (int64_t) (MONGOC_HISTOGRAM_SUB_BUCKETS + sub) << shift;
+}
+
+
+/* the value at percentile @p of @count values, as its bucket's largest
+ * value, or -1 for a value in the last, unbounded bucket */
+static BSON_INLINE int64_t
+_mongoc_histogram_percentile (const int64_t *buckets,
+                              uint32_t       n_buckets,
+                              int64_t        count,
+                              double         p)
+{
+   int64_t rank;
+   int64_t seen = 0;
+   uint32_t b;
+
+   rank = (int64_t) ((p / 100.0) * (double) count + 0.5);
+   if (rank < 1) {
+      rank = 1;
+   }
+
+   for (b = 0; b < n_buckets; b++) {
+      seen += buckets[b];
+      if (seen >= rank) {
+         break;
+      }
+   }
+
+   if (b >= n_buckets - 1) {
+      return -1;
+   }
+
+   return _mongoc_histogram_bucket_min (b + 1) - 1;
+}
+
+
+/* the counts recorded between snapshots @old and @cur into @delta, or all
+ * of @cur if @old is NULL. returns the number of values */
+static BSON_INLINE int64_t
+_mongoc_histogram_delta (const int64_t *cur,
+                         const int64_t *old,
+                         uint32_t       n_buckets,
+                         int64_t       *delta)
+{
+   int64_t count = 0;
+   uint32_t b;
+
+   for (b = 0; b < n_buckets; b++) {
+      delta[b] = cur[b] - (old ? old[b] : 0);
+      count += delta[b];
+   }
+
+   return count;
+}
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_HISTOGRAM_PRIVATE_H */
@@ -19,7 +19,10 @@
 
 #include "mongoc-config.h"
 #include "mongoc-counters-private.h"
+#include "mongoc-dns-cache-private.h"
 #include "mongoc-init.h"
+#include "mongoc-memory-private.h"
+#include "mongoc-trace-buffer-private.h"
 
 #include "mongoc-handshake-private.h"
 
@@ -109,7 +112,10 @@ static MONGOC_ONCE_FUN( _mongoc_do_init)
    sasl_client_init (NULL);
 #endif
 
+   _mongoc_trace_buffer_init ();
    _mongoc_counters_init ();
+   _mongoc_memory_init ();
+   _mongoc_dns_cache_init ();
 
 #ifdef _WIN32
    {
@@ -145,6 +151,10 @@ static MONGOC_ONCE_FUN( _mongoc_do_cleanup)
    _mongoc_openssl_cleanup ();
 #endif
 
+#ifdef MONGOC_ENABLE_SSL
+   _mongoc_scram_cleanup ();
+#endif
+
 #ifdef MONGOC_ENABLE_SASL
 #ifdef MONGOC_HAVE_SASL_CLIENT_DONE
    sasl_client_done ();
@@ -158,9 +168,12 @@ static MONGOC_ONCE_FUN( _mongoc_do_cleanup)
    WSACleanup ();
 #endif
 
+   _mongoc_memory_cleanup ();
    _mongoc_counters_cleanup ();
+   _mongoc_dns_cache_cleanup ();
 
    _mongoc_handshake_cleanup ();
+   _mongoc_trace_buffer_cleanup ();
 
    MONGOC_ONCE_RETURN;
 }
@@ -23,10 +23,21 @@
 
 #include <bson.h>
 
+#ifndef _WIN32
+#include <sys/types.h>
+#include <regex.h>
+#endif
+
+#include "mongoc-array-private.h"
+
 
 BSON_BEGIN_DECLS
 
 
+/* $in and $nin arrays with at least this many values are hashed */
+#define MONGOC_MATCHER_IN_HASH_MIN 8
+
+
 typedef union  _mongoc_matcher_op_t         mongoc_matcher_op_t;
 typedef struct _mongoc_matcher_op_base_t    mongoc_matcher_op_base_t;
 typedef struct _mongoc_matcher_op_logical_t mongoc_matcher_op_logical_t;
@@ -34,6 +45,11 @@ typedef struct _mongoc_matcher_op_compare_t mongoc_matcher_op_compare_t;
 typedef struct _mongoc_matcher_op_exists_t  mongoc_matcher_op_exists_t;
 typedef struct _mongoc_matcher_op_type_t    mongoc_matcher_op_type_t;
 typedef struct _mongoc_matcher_op_not_t     mongoc_matcher_op_not_t;
+typedef struct _mongoc_matcher_op_regex_t   mongoc_matcher_op_regex_t;
+typedef struct _mongoc_matcher_op_elem_match_t mongoc_matcher_op_elem_match_t;
+typedef struct _mongoc_matcher_op_size_t    mongoc_matcher_op_size_t;
+typedef struct _mongoc_matcher_op_mod_t     mongoc_matcher_op_mod_t;
+typedef struct _mongoc_matcher_in_set_t     mongoc_matcher_in_set_t;
 
 
 typedef enum
@@ -52,6 +68,11 @@ typedef enum
    MONGOC_MATCHER_OPCODE_NOR,
    MONGOC_MATCHER_OPCODE_EXISTS,
    MONGOC_MATCHER_OPCODE_TYPE,
+   MONGOC_MATCHER_OPCODE_REGEX,
+   MONGOC_MATCHER_OPCODE_ELEM_MATCH,
+   MONGOC_MATCHER_OPCODE_SIZE,
+   MONGOC_MATCHER_OPCODE_ALL,
+   MONGOC_MATCHER_OPCODE_MOD,
 } mongoc_matcher_opcode_t;
 
 
@@ -74,6 +95,12 @@ struct _mongoc_matcher_op_compare_t
    mongoc_matcher_op_base_t base;
    char *path;
    bson_iter_t iter;
+   /* set by _mongoc_matcher_op_compile */
+   bool is_numeric;
+   bool is_double;
+   int64_t v_int64;
+   double v_double;
+   mongoc_matcher_in_set_t *in_set;
 };
 
 
@@ -101,6 +128,46 @@ struct _mongoc_matcher_op_not_t
 };
 
 
+struct _mongoc_matcher_op_regex_t
+{
+   mongoc_matcher_op_base_t base;
+   char *path;
+   char *pattern;
+   char *options;
+#ifndef _WIN32
+   regex_t regex;
+#endif
+};
+
+
+struct _mongoc_matcher_op_elem_match_t
+{
+   mongoc_matcher_op_base_t base;
+   char *path;
+   mongoc_matcher_op_t *child;
+   /* child is matched against each element, like {$elemMatch: {$gt: 1}},
+    * not against each subdocument, like {$elemMatch: {b: 1}} */
+   bool on_values;
+};
+
+
+struct _mongoc_matcher_op_size_t
+{
+   mongoc_matcher_op_base_t base;
+   char *path;
+   int64_t size;
+};
+
+
+struct _mongoc_matcher_op_mod_t
+{
+   mongoc_matcher_op_base_t base;
+   char *path;
+   int64_t divisor;
+   int64_t remainder;
+};
+
+
 union _mongoc_matcher_op_t
 {
    mongoc_matcher_op_base_t base;
@@ -109,6 +176,10 @@ union _mongoc_matcher_op_t
    mongoc_matcher_op_exists_t exists;
    mongoc_matcher_op_type_t type;
    mongoc_matcher_op_not_t not_;
+   mongoc_matcher_op_regex_t regex;
+   mongoc_matcher_op_elem_match_t elem_match;
+   mongoc_matcher_op_size_t size;
+   mongoc_matcher_op_mod_t mod;
 };
 
 
@@ -124,8 +195,24 @@ mongoc_matcher_op_t *_mongoc_matcher_op_type_new    (const char              *pa
                                                      bson_type_t              type);
 mongoc_matcher_op_t *_mongoc_matcher_op_not_new     (const char              *path,
                                                      mongoc_matcher_op_t     *child);
+mongoc_matcher_op_t *_mongoc_matcher_op_regex_new   (const char              *path,
+                                                     const char              *pattern,
+                                                     const char              *options,
+                                                     bson_error_t            *error);
+mongoc_matcher_op_t *_mongoc_matcher_op_elem_match_new (const char           *path,
+                                                        mongoc_matcher_op_t  *child,
+                                                        bool                  on_values);
+mongoc_matcher_op_t *_mongoc_matcher_op_size_new    (const char              *path,
+                                                     int64_t                  size);
+mongoc_matcher_op_t *_mongoc_matcher_op_mod_new     (const char              *path,
+                                                     int64_t                  divisor,
+                                                     int64_t                  remainder);
 bool                 _mongoc_matcher_op_match       (mongoc_matcher_op_t     *op,
                                                      const bson_t            *bson);
+bool                 _mongoc_matcher_op_match_value (mongoc_matcher_op_t     *op,
+                                                     bson_iter_t             *iter);
+const char          *_mongoc_matcher_op_path        (const mongoc_matcher_op_t *op);
+void                 _mongoc_matcher_op_compile     (mongoc_matcher_op_t     *op);
 void                 _mongoc_matcher_op_destroy     (mongoc_matcher_op_t     *op);
 void                 _mongoc_matcher_op_to_bson     (mongoc_matcher_op_t     *op,
                                                      bson_t                  *bson);
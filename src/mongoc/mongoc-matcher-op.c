@@ -15,10 +15,17 @@
  */
 
 
+#include <ctype.h>
+
+#include "mongoc-error.h"
 #include "mongoc-log.h"
 #include "mongoc-matcher-op-private.h"
 #include "mongoc-util-private.h"
 
+
+static void _mongoc_matcher_in_set_destroy (mongoc_matcher_in_set_t *set);
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -209,6 +216,549 @@ _mongoc_matcher_op_not_new (const char          *path,  /* IN */
 }
 
 
+#ifndef _WIN32
+/* PCRE's character class escapes, as the characters they match */
+static bool
+_mongoc_matcher_regex_class (char         escape,  /* IN */
+                             const char **set,     /* OUT */
+                             bool        *negated) /* OUT */
+{
+   switch (escape) {
+   case 'd':
+   case 'D':
+      *set = "0-9";
+      break;
+   case 'w':
+   case 'W':
+      *set = "A-Za-z0-9_";
+      break;
+   case 's':
+   case 'S':
+      *set = " \t\n\r\f\v";
+      break;
+   default:
+      return false;
+   }
+
+   *negated = (escape >= 'A' && escape <= 'Z');
+
+   return true;
+}
+
+
+/* PCRE's escapes for control characters */
+static bool
+_mongoc_matcher_regex_control (char  escape, /* IN */
+                               char *c)      /* OUT */
+{
+   switch (escape) {
+   case 'n': *c = '\n'; return true;
+   case 't': *c = '\t'; return true;
+   case 'r': *c = '\r'; return true;
+   case 'f': *c = '\f'; return true;
+   case 'v': *c = '\v'; return true;
+   default: return false;
+   }
+}
+
+
+/* a bracket expression, or a class escape like \d. with REG_NEWLINE a
+ * negated list never matches a newline, in PCRE it does */
+static void
+_mongoc_matcher_regex_append_list (bson_string_t *out,
+                                   bool           negated,
+                                   bool           close_bracket,
+                                   const char    *set,
+                                   bool           dash,
+                                   bool           multiline)
+{
+   if (negated && multiline) {
+      bson_string_append (out, "(");
+   }
+
+   bson_string_append_printf (out, "[%s%s%s%s]", negated ? "^" : "",
+                              close_bracket ? "]" : "", set, dash ? "-" : "");
+
+   if (negated && multiline) {
+      bson_string_append (out, "|\n)");
+   }
+}
+
+
+static bool
+_mongoc_matcher_regex_unsupported (const char   *pattern,
+                                   const char   *what,
+                                   const char   *at,
+                                   int           len,
+                                   bson_error_t *error)
+{
+   bson_set_error (error,
+                   MONGOC_ERROR_MATCHER,
+                   MONGOC_ERROR_MATCHER_INVALID,
+                   "Unsupported %s \"%.*s\" in $regex \"%s\"",
+                   what, len, at, pattern);
+
+   return false;
+}
+
+
+/* translate a bracket expression starting at **p, and advance *p past
+ * it. POSIX has no escapes in brackets, and "]" and "-" are literal only
+ * first and last */
+static bool
+_mongoc_matcher_regex_bracket (const char    *pattern,
+                               const char   **p,
+                               bool           multiline,
+                               bson_string_t *out,
+                               bson_error_t  *error)
+{
+   const char *q = *p + 1;
+   const char *end;
+   const char *set;
+   bson_string_t *items;
+   bool negated = false;
+   bool class_negated;
+   bool close_bracket = false;
+   bool dash = false;
+   char c;
+
+   items = bson_string_new (NULL);
+
+   if (*q == '^') {
+      negated = true;
+      q++;
+   }
+
+   if (*q == ']') {
+      close_bracket = true;
+      q++;
+   }
+
+   while (*q != ']') {
+      if (!*q) {
+         bson_set_error (error,
+                         MONGOC_ERROR_MATCHER,
+                         MONGOC_ERROR_MATCHER_INVALID,
+                         "Invalid $regex \"%s\": missing ]", pattern);
+         bson_string_free (items, true);
+         return false;
+      }
+
+      if (*q == '\\') {
+         q++;
+         if (_mongoc_matcher_regex_class (*q, &set, &class_negated) &&
+             !class_negated) {
+            bson_string_append (items, set);
+         } else if (_mongoc_matcher_regex_control (*q, &c)) {
+            bson_string_append_c (items, c);
+         } else if (*q == ']') {
+            close_bracket = true;
+         } else if (*q == '-') {
+            dash = true;
+         } else if (*q && ispunct ((unsigned char) *q)) {
+            bson_string_append_c (items, *q);
+         } else {
+            bson_string_free (items, true);
+            return _mongoc_matcher_regex_unsupported (
+               pattern, "escape in brackets", q - 1, *q ? 2 : 1, error);
+         }
+
+         q++;
+      } else if (q[0] == '[' && q[1] == ':' &&
+                 (end = strstr (q + 2, ":]"))) {
+         /* a POSIX class like [:alpha:] means the same in PCRE */
+         bson_string_append_printf (items, "%.*s", (int) (end + 2 - q), q);
+         q = end + 2;
+      } else if (*q == '-' && (q[1] == ']' || !items->len)) {
+         dash = true;
+         q++;
+      } else {
+         bson_string_append_c (items, *q);
+         q++;
+      }
+   }
+
+   _mongoc_matcher_regex_append_list (out, negated, close_bracket,
+                                      items->str, dash, multiline);
+   bson_string_free (items, true);
+   *p = q + 1;
+
+   return true;
+}
+
+
+/* an interval like {2} or {1,3} starting at @p, or 0 if "{" is literal */
+static int
+_mongoc_matcher_regex_interval_len (const char *p)
+{
+   const char *q = p + 1;
+
+   if (!isdigit ((unsigned char) *q)) {
+      return 0;
+   }
+
+   while (isdigit ((unsigned char) *q)) {
+      q++;
+   }
+
+   if (*q == ',') {
+      q++;
+      while (isdigit ((unsigned char) *q)) {
+         q++;
+      }
+   }
+
+   return *q == '}' ? (int) (q + 1 - p) : 0;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_regex_to_posix --
+ *
+ *       Translate a PCRE @pattern, as the server runs it, to a POSIX
+ *       extended regular expression with the same meaning. Class escapes
+ *       like \d and \w become bracket expressions, "." matches a newline
+ *       only if @dotall, and with @multiline (REG_NEWLINE) negated lists
+ *       still match newlines. "(?:" becomes a plain group. PCRE-only
+ *       syntax with no POSIX equivalent, like lookarounds, inline
+ *       options, backreferences and lazy or possessive quantifiers, is
+ *       an error rather than silently meaning something else.
+ *
+ * Returns:
+ *       true and appends the POSIX pattern to @out, or false and sets
+ *       @error.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_matcher_regex_to_posix (const char    *pattern,   /* IN */
+                                bool           dotall,    /* IN */
+                                bool           multiline, /* IN */
+                                bson_string_t *out,       /* OUT */
+                                bson_error_t  *error)     /* OUT */
+{
+   const char *p = pattern;
+   const char *set;
+   bool negated;
+   char c;
+   int len;
+
+   while (*p) {
+      switch (*p) {
+      case '\\':
+         p++;
+         if (_mongoc_matcher_regex_class (*p, &set, &negated)) {
+            _mongoc_matcher_regex_append_list (out, negated, false, set,
+                                               false, multiline);
+         } else if (_mongoc_matcher_regex_control (*p, &c)) {
+            bson_string_append_c (out, c);
+         } else if (*p && strchr (".[]()*+?{}|^$\\", *p)) {
+            bson_string_append_c (out, '\\');
+            bson_string_append_c (out, *p);
+         } else if (*p && ispunct ((unsigned char) *p)) {
+            /* like \/ or \-, not special in POSIX */
+            bson_string_append_c (out, *p);
+         } else {
+            return _mongoc_matcher_regex_unsupported (
+               pattern, "escape", p - 1, *p ? 2 : 1, error);
+         }
+
+         p++;
+         continue;
+      case '[':
+         if (!_mongoc_matcher_regex_bracket (pattern, &p, multiline, out,
+                                             error)) {
+            return false;
+         }
+
+         continue;
+      case '.':
+         if (!dotall) {
+            bson_string_append (out, "[^\n]");
+         } else if (multiline) {
+            /* REG_NEWLINE keeps "." from matching newlines */
+            bson_string_append (out, "(.|\n)");
+         } else {
+            bson_string_append_c (out, '.');
+         }
+
+         p++;
+         continue;
+      case '$':
+         /* PCRE's "$" also matches before a newline at the end */
+         bson_string_append (out, multiline ? "$" : "(\n?$)");
+         p++;
+         continue;
+      case '(':
+         if (p[1] == '?') {
+            if (p[2] != ':') {
+               return _mongoc_matcher_regex_unsupported (
+                  pattern, "group", p, p[2] ? 3 : 2, error);
+            }
+
+            bson_string_append_c (out, '(');
+            p += 3;
+            continue;
+         }
+
+         break;
+      case '{':
+         len = _mongoc_matcher_regex_interval_len (p);
+         if (!len) {
+            /* PCRE matches "{" literally if it isn't an interval */
+            bson_string_append (out, "\\{");
+            p++;
+            continue;
+         }
+
+         bson_string_append_printf (out, "%.*s", len, p);
+         p += len;
+
+         if (*p == '?' || *p == '+') {
+            return _mongoc_matcher_regex_unsupported (
+               pattern, "lazy or possessive quantifier", p - len, len + 1,
+               error);
+         }
+
+         continue;
+      case '*':
+      case '+':
+      case '?':
+         if (p[1] == '?' || p[1] == '+') {
+            return _mongoc_matcher_regex_unsupported (
+               pattern, "lazy or possessive quantifier", p, 2, error);
+         }
+
+         break;
+      default:
+         break;
+      }
+
+      bson_string_append_c (out, *p);
+      p++;
+   }
+
+   return true;
+}
+#endif
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_regex_new --
+ *
+ *       Create a new op for checking {$regex: ..., $options: ...} and
+ *       compile its regular expression. The PCRE pattern is translated
+ *       to a POSIX extended regular expression, see
+ *       _mongoc_matcher_regex_to_posix; options "i", "m" and "s" are
+ *       supported.
+ *
+ * Returns:
+ *       A newly allocated mongoc_matcher_op_t that should be freed with
+ *       _mongoc_matcher_op_destroy(), or NULL and @error is set if the
+ *       pattern or options are invalid or unsupported.
+ *
+ * Side effects:
+ *       @error may be set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_matcher_op_t *
+_mongoc_matcher_op_regex_new (const char   *path,    /* IN */
+                              const char   *pattern, /* IN */
+                              const char   *options, /* IN */
+                              bson_error_t *error)   /* OUT */
+{
+#ifdef _WIN32
+   bson_set_error (error,
+                   MONGOC_ERROR_MATCHER,
+                   MONGOC_ERROR_MATCHER_INVALID,
+                   "$regex is not supported on this platform");
+   return NULL;
+#else
+   mongoc_matcher_op_t *op;
+   int cflags = REG_EXTENDED | REG_NOSUB;
+   bool dotall = false;
+   bool multiline = false;
+   bson_string_t *posix;
+   const char *opt;
+   char msg[128];
+   int r;
+
+   BSON_ASSERT (path);
+   BSON_ASSERT (pattern);
+
+   for (opt = options ? options : ""; *opt; opt++) {
+      switch (*opt) {
+      case 'i':
+         cflags |= REG_ICASE;
+         break;
+      case 'm':
+         /* "^" and "$" match at each line */
+         cflags |= REG_NEWLINE;
+         multiline = true;
+         break;
+      case 's':
+         dotall = true;
+         break;
+      default:
+         bson_set_error (error,
+                         MONGOC_ERROR_MATCHER,
+                         MONGOC_ERROR_MATCHER_INVALID,
+                         "Unsupported $regex option \"%c\"",
+                         *opt);
+         return NULL;
+      }
+   }
+
+   posix = bson_string_new (NULL);
+   if (!_mongoc_matcher_regex_to_posix (pattern, dotall, multiline, posix,
+                                        error)) {
+      bson_string_free (posix, true);
+      return NULL;
+   }
+
+   op = (mongoc_matcher_op_t *)bson_malloc0 (sizeof *op);
+
+   r = regcomp (&op->regex.regex, posix->str, cflags);
+   bson_string_free (posix, true);
+
+   if (r != 0) {
+      regerror (r, &op->regex.regex, msg, sizeof msg);
+      bson_set_error (error,
+                      MONGOC_ERROR_MATCHER,
+                      MONGOC_ERROR_MATCHER_INVALID,
+                      "Invalid $regex \"%s\": %s",
+                      pattern, msg);
+      bson_free (op);
+      return NULL;
+   }
+
+   op->regex.base.opcode = MONGOC_MATCHER_OPCODE_REGEX;
+   op->regex.path = bson_strdup (path);
+   op->regex.pattern = bson_strdup (pattern);
+   op->regex.options = bson_strdup (options ? options : "");
+
+   return op;
+#endif
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_elem_match_new --
+ *
+ *       Create a new op for checking {$elemMatch: {...}}. If @on_values
+ *       then @child is matched against each array element's value,
+ *       otherwise against each element that is a document.
+ *
+ * Returns:
+ *       A newly allocated mongoc_matcher_op_t that should be freed with
+ *       _mongoc_matcher_op_destroy().
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_matcher_op_t *
+_mongoc_matcher_op_elem_match_new (const char          *path,      /* IN */
+                                   mongoc_matcher_op_t *child,     /* IN */
+                                   bool                 on_values) /* IN */
+{
+   mongoc_matcher_op_t *op;
+
+   BSON_ASSERT (path);
+   BSON_ASSERT (child);
+
+   op = (mongoc_matcher_op_t *)bson_malloc0 (sizeof *op);
+   op->elem_match.base.opcode = MONGOC_MATCHER_OPCODE_ELEM_MATCH;
+   op->elem_match.path = bson_strdup (path);
+   op->elem_match.child = child;
+   op->elem_match.on_values = on_values;
+
+   return op;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_size_new --
+ *
+ *       Create a new op for checking {$size: int}.
+ *
+ * Returns:
+ *       A newly allocated mongoc_matcher_op_t that should be freed with
+ *       _mongoc_matcher_op_destroy().
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_matcher_op_t *
+_mongoc_matcher_op_size_new (const char *path, /* IN */
+                             int64_t     size) /* IN */
+{
+   mongoc_matcher_op_t *op;
+
+   BSON_ASSERT (path);
+
+   op = (mongoc_matcher_op_t *)bson_malloc0 (sizeof *op);
+   op->size.base.opcode = MONGOC_MATCHER_OPCODE_SIZE;
+   op->size.path = bson_strdup (path);
+   op->size.size = size;
+
+   return op;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_mod_new --
+ *
+ *       Create a new op for checking {$mod: [divisor, remainder]}.
+ *
+ * Returns:
+ *       A newly allocated mongoc_matcher_op_t that should be freed with
+ *       _mongoc_matcher_op_destroy().
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_matcher_op_t *
+_mongoc_matcher_op_mod_new (const char *path,      /* IN */
+                            int64_t     divisor,   /* IN */
+                            int64_t     remainder) /* IN */
+{
+   mongoc_matcher_op_t *op;
+
+   BSON_ASSERT (path);
+   BSON_ASSERT (divisor != 0);
+
+   op = (mongoc_matcher_op_t *)bson_malloc0 (sizeof *op);
+   op->mod.base.opcode = MONGOC_MATCHER_OPCODE_MOD;
+   op->mod.path = bson_strdup (path);
+   op->mod.divisor = divisor;
+   op->mod.remainder = remainder;
+
+   return op;
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -238,6 +788,10 @@ _mongoc_matcher_op_destroy (mongoc_matcher_op_t *op) /* IN */
    case MONGOC_MATCHER_OPCODE_LTE:
    case MONGOC_MATCHER_OPCODE_NE:
    case MONGOC_MATCHER_OPCODE_NIN:
+   case MONGOC_MATCHER_OPCODE_ALL:
+      if (op->compare.in_set) {
+         _mongoc_matcher_in_set_destroy (op->compare.in_set);
+      }
       bson_free (op->compare.path);
       break;
    case MONGOC_MATCHER_OPCODE_OR:
@@ -258,6 +812,24 @@ _mongoc_matcher_op_destroy (mongoc_matcher_op_t *op) /* IN */
    case MONGOC_MATCHER_OPCODE_TYPE:
       bson_free (op->type.path);
       break;
+   case MONGOC_MATCHER_OPCODE_REGEX:
+#ifndef _WIN32
+      regfree (&op->regex.regex);
+#endif
+      bson_free (op->regex.path);
+      bson_free (op->regex.pattern);
+      bson_free (op->regex.options);
+      break;
+   case MONGOC_MATCHER_OPCODE_ELEM_MATCH:
+      _mongoc_matcher_op_destroy (op->elem_match.child);
+      bson_free (op->elem_match.path);
+      break;
+   case MONGOC_MATCHER_OPCODE_SIZE:
+      bson_free (op->size.path);
+      break;
+   case MONGOC_MATCHER_OPCODE_MOD:
+      bson_free (op->mod.path);
+      break;
    default:
       break;
    }
@@ -271,7 +843,7 @@ _mongoc_matcher_op_destroy (mongoc_matcher_op_t *op) /* IN */
  *
  * _mongoc_matcher_op_exists_match --
  *
- *       Checks to see if @bson matches @exists requirements. The
+ *       Checks to see if @iter matches @exists requirements. The
  *       {$exists: bool} query can be either true or fase so we must
  *       handle false as "not exists".
  *
@@ -289,19 +861,11 @@ _mongoc_matcher_op_destroy (mongoc_matcher_op_t *op) /* IN */
 
 static bool
 _mongoc_matcher_op_exists_match (mongoc_matcher_op_exists_t *exists, /* IN */
-                                 const bson_t               *bson)   /* IN */
+                                 bson_iter_t                *iter)   /* IN */
 {
-   bson_iter_t iter;
-   bson_iter_t desc;
-   bool found;
-
    BSON_ASSERT (exists);
-   BSON_ASSERT (bson);
-
-   found = (bson_iter_init (&iter, bson) &&
-            bson_iter_find_descendant (&iter, exists->path, &desc));
 
-   return (found == exists->exists);
+   return ((iter != NULL) == exists->exists);
 }
 
 
@@ -310,7 +874,7 @@ _mongoc_matcher_op_exists_match (mongoc_matcher_op_exists_t *exists, /* IN */
  *
  * _mongoc_matcher_op_type_match --
  *
- *       Checks if @bson matches the {$type: ...} op.
+ *       Checks if @iter matches the {$type: ...} op.
  *
  * Returns:
  *       true if the requested field was found and the type matched
@@ -324,20 +888,11 @@ _mongoc_matcher_op_exists_match (mongoc_matcher_op_exists_t *exists, /* IN */
 
 static bool
 _mongoc_matcher_op_type_match (mongoc_matcher_op_type_t *type, /* IN */
-                               const bson_t             *bson) /* IN */
+                               bson_iter_t              *iter) /* IN */
 {
-   bson_iter_t iter;
-   bson_iter_t desc;
-
    BSON_ASSERT (type);
-   BSON_ASSERT (bson);
-
-   if (bson_iter_init (&iter, bson) &&
-       bson_iter_find_descendant (&iter, type->path, &desc)) {
-      return (bson_iter_type (&iter) == type->type);
-   }
 
-   return false;
+   return iter && bson_iter_type (iter) == type->type;
 }
 
 
@@ -360,13 +915,12 @@ _mongoc_matcher_op_type_match (mongoc_matcher_op_type_t *type, /* IN */
  */
 
 static bool
-_mongoc_matcher_op_not_match (mongoc_matcher_op_not_t *not_,  /* IN */
-                              const bson_t            *bson) /* IN */
+_mongoc_matcher_op_not_match (mongoc_matcher_op_not_t *not_, /* IN */
+                              bson_iter_t             *iter) /* IN */
 {
    BSON_ASSERT (not_);
-   BSON_ASSERT (bson);
 
-   return !_mongoc_matcher_op_match (not_->child, bson);
+   return !_mongoc_matcher_op_match_value (not_->child, iter);
 }
 
 
@@ -694,17 +1248,210 @@ _mongoc_matcher_op_gte_match (mongoc_matcher_op_compare_t *compare, /* IN */
 }
 
 
-/*
- *--------------------------------------------------------------------------
- *
- * _mongoc_matcher_op_in_match --
- *
- *       Checks the spec {"path": {"$in": [value1, value2, ...]}}.
- *
- * Returns:
- *       true if the spec matched, otherwise false.
- *
- * Side effects:
+/* a double, bool, int32 or int64 as a double */
+static double
+_mongoc_matcher_iter_as_double (const bson_iter_t *iter) /* IN */
+{
+   switch (bson_iter_type (iter)) {
+   case BSON_TYPE_DOUBLE:
+      return bson_iter_double (iter);
+   case BSON_TYPE_BOOL:
+      return bson_iter_bool (iter) ? 1.0 : 0.0;
+   case BSON_TYPE_INT32:
+      return (double) bson_iter_int32 (iter);
+   case BSON_TYPE_INT64:
+      return (double) bson_iter_int64 (iter);
+   default:
+      return 0;
+   }
+}
+
+
+typedef struct
+{
+   bool        used;
+   uint32_t    hash;
+   bson_iter_t iter;
+} mongoc_matcher_in_entry_t;
+
+
+/* a $in or $nin array, hashed, see _mongoc_matcher_op_compile */
+struct _mongoc_matcher_in_set_t
+{
+   mongoc_matcher_in_entry_t *table;
+   uint32_t                   mask;      /* table size - 1 */
+   bool                       has_null;
+   /* documents and arrays, compared one by one */
+   mongoc_array_t             others;    /* of bson_iter_t */
+};
+
+
+/*
+ * hash a value so that values _mongoc_matcher_iter_eq_match finds equal
+ * hash the same: numbers and bools by their value as a double, strings
+ * by their bytes. false if the value's type isn't hashed
+ */
+static bool
+_mongoc_matcher_value_hash (const bson_iter_t *iter, /* IN */
+                            uint32_t          *hash) /* OUT */
+{
+   const uint8_t *data;
+   uint32_t len;
+   uint32_t h = 2166136261u;  /* FNV-1a */
+   double d;
+   uint32_t i;
+
+   switch (bson_iter_type (iter)) {
+   case BSON_TYPE_DOUBLE:
+   case BSON_TYPE_BOOL:
+   case BSON_TYPE_INT32:
+   case BSON_TYPE_INT64:
+      d = _mongoc_matcher_iter_as_double (iter);
+      if (d == 0) {
+         d = 0;  /* -0.0 == 0.0 */
+      }
+      data = (const uint8_t *) &d;
+      len = (uint32_t) sizeof d;
+      break;
+   case BSON_TYPE_UTF8:
+      data = (const uint8_t *) bson_iter_utf8 (iter, &len);
+      h = (h ^ 1) * 16777619u;  /* strings and numbers differ */
+      break;
+   default:
+      return false;
+   }
+
+   for (i = 0; i < len; i++) {
+      h = (h ^ data[i]) * 16777619u;
+   }
+
+   *hash = h;
+
+   return true;
+}
+
+
+static mongoc_matcher_in_set_t *
+_mongoc_matcher_in_set_new (const bson_iter_t *array) /* IN */
+{
+   mongoc_matcher_in_set_t *set;
+   mongoc_matcher_in_entry_t *entry;
+   bson_iter_t iter;
+   uint32_t n = 0;
+   uint32_t size = 16;
+   uint32_t hash;
+
+   bson_iter_recurse (array, &iter);
+   while (bson_iter_next (&iter)) {
+      n++;
+   }
+
+   while (size < 2 * n) {
+      size *= 2;
+   }
+
+   set = (mongoc_matcher_in_set_t *) bson_malloc0 (sizeof *set);
+   set->table = (mongoc_matcher_in_entry_t *) bson_malloc0 (
+      size * sizeof (mongoc_matcher_in_entry_t));
+   set->mask = size - 1;
+   _mongoc_array_init (&set->others, sizeof (bson_iter_t));
+
+   bson_iter_recurse (array, &iter);
+   while (bson_iter_next (&iter)) {
+      switch (bson_iter_type (&iter)) {
+      case BSON_TYPE_DOUBLE:
+      case BSON_TYPE_INT32:
+      case BSON_TYPE_INT64:
+      case BSON_TYPE_UTF8:
+         _mongoc_matcher_value_hash (&iter, &hash);
+         entry = &set->table[hash & set->mask];
+         while (entry->used) {
+            entry = &set->table[(entry - set->table + 1) & set->mask];
+         }
+         entry->used = true;
+         entry->hash = hash;
+         memcpy (&entry->iter, &iter, sizeof iter);
+         break;
+      case BSON_TYPE_NULL:
+         set->has_null = true;
+         break;
+      case BSON_TYPE_ARRAY:
+      case BSON_TYPE_DOCUMENT:
+         _mongoc_array_append_val (&set->others, iter);
+         break;
+      default:
+         /* like bools, never equal to anything */
+         break;
+      }
+   }
+
+   return set;
+}
+
+
+static void
+_mongoc_matcher_in_set_destroy (mongoc_matcher_in_set_t *set) /* IN */
+{
+   _mongoc_array_destroy (&set->others);
+   bson_free (set->table);
+   bson_free (set);
+}
+
+
+/* whether any value in @set is equal to @iter's */
+static bool
+_mongoc_matcher_in_set_contains (mongoc_matcher_in_set_t *set,  /* IN */
+                                 bson_iter_t             *iter) /* IN */
+{
+   mongoc_matcher_in_entry_t *entry;
+   uint32_t hash;
+   uint32_t i;
+
+   switch (bson_iter_type (iter)) {
+   case BSON_TYPE_NULL:
+   case BSON_TYPE_UNDEFINED:
+      return set->has_null;
+   case BSON_TYPE_ARRAY:
+   case BSON_TYPE_DOCUMENT:
+      for (i = 0; i < set->others.len; i++) {
+         if (_mongoc_matcher_iter_eq_match (
+                &_mongoc_array_index (&set->others, bson_iter_t, i), iter)) {
+            return true;
+         }
+      }
+      return false;
+   default:
+      break;
+   }
+
+   if (!_mongoc_matcher_value_hash (iter, &hash)) {
+      return false;
+   }
+
+   for (entry = &set->table[hash & set->mask];
+        entry->used;
+        entry = &set->table[(entry - set->table + 1) & set->mask]) {
+      if (entry->hash == hash &&
+          _mongoc_matcher_iter_eq_match (&entry->iter, iter)) {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_in_match --
+ *
+ *       Checks the spec {"path": {"$in": [value1, value2, ...]}}.
+ *
+ * Returns:
+ *       true if the spec matched, otherwise false.
+ *
+ * Side effects:
  *       None.
  *
  *--------------------------------------------------------------------------
@@ -716,6 +1463,10 @@ _mongoc_matcher_op_in_match (mongoc_matcher_op_compare_t *compare, /* IN */
 {
    mongoc_matcher_op_compare_t op;
 
+   if (compare->in_set) {
+      return _mongoc_matcher_in_set_contains (compare->in_set, iter);
+   }
+
    op.base.opcode = MONGOC_MATCHER_OPCODE_EQ;
    op.path = compare->path;
 
@@ -929,13 +1680,76 @@ _mongoc_matcher_op_nin_match (mongoc_matcher_op_compare_t *compare, /* IN */
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_numeric_match --
+ *
+ *       Compare a number or bool in @iter with a compiled op's number,
+ *       as the compiler would: in double if either is a double,
+ *       otherwise in int64.
+ *
+ * Returns:
+ *       true if the spec matched, otherwise false.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_matcher_op_numeric_match (mongoc_matcher_op_compare_t *compare, /* IN */
+                                  bson_iter_t                 *iter)    /* IN */
+{
+   int cmp;
+
+   if (compare->is_double || BSON_ITER_HOLDS_DOUBLE (iter)) {
+      double l = compare->v_double;
+      double r = _mongoc_matcher_iter_as_double (iter);
+
+      if (r == l) {
+         cmp = 0;
+      } else if (r > l) {
+         cmp = 1;
+      } else if (r < l) {
+         cmp = -1;
+      } else {
+         /* NaN: only != is true */
+         return compare->base.opcode == MONGOC_MATCHER_OPCODE_NE;
+      }
+   } else {
+      int64_t l = compare->v_int64;
+      int64_t r = bson_iter_as_int64 (iter);
+
+      cmp = r == l ? 0 : (r > l ? 1 : -1);
+   }
+
+   switch ((int)compare->base.opcode) {
+   case MONGOC_MATCHER_OPCODE_EQ:
+      return cmp == 0;
+   case MONGOC_MATCHER_OPCODE_NE:
+      return cmp != 0;
+   case MONGOC_MATCHER_OPCODE_GT:
+      return cmp > 0;
+   case MONGOC_MATCHER_OPCODE_GTE:
+      return cmp >= 0;
+   case MONGOC_MATCHER_OPCODE_LT:
+      return cmp < 0;
+   case MONGOC_MATCHER_OPCODE_LTE:
+      return cmp <= 0;
+   default:
+      BSON_ASSERT (false);
+      return false;
+   }
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
  * _mongoc_matcher_op_compare_match --
  *
  *       Dispatch function for mongoc_matcher_op_compare_t operations
- *       to perform a match.
+ *       to perform a match. @iter is the value at the op's path, or
+ *       NULL if there is none.
  *
  * Returns:
  *       Opcode dependent.
@@ -948,40 +1762,43 @@ _mongoc_matcher_op_nin_match (mongoc_matcher_op_compare_t *compare, /* IN */
 
 static bool
 _mongoc_matcher_op_compare_match (mongoc_matcher_op_compare_t *compare, /* IN */
-                                  const bson_t                *bson)    /* IN */
+                                  bson_iter_t                 *iter)    /* IN */
 {
-   bson_iter_t tmp;
-   bson_iter_t iter;
-
    BSON_ASSERT (compare);
-   BSON_ASSERT (bson);
 
-   if (strchr (compare->path, '.')) {
-      if (!bson_iter_init (&tmp, bson) ||
-          !bson_iter_find_descendant (&tmp, compare->path, &iter)) {
-         return false;
-      }
-   } else if (!bson_iter_init_find (&iter, bson, compare->path)) {
+   if (!iter) {
       return false;
    }
 
+   if (compare->is_numeric) {
+      switch (bson_iter_type (iter)) {
+      case BSON_TYPE_DOUBLE:
+      case BSON_TYPE_BOOL:
+      case BSON_TYPE_INT32:
+      case BSON_TYPE_INT64:
+         return _mongoc_matcher_op_numeric_match (compare, iter);
+      default:
+         break;
+      }
+   }
+
    switch ((int)compare->base.opcode) {
    case MONGOC_MATCHER_OPCODE_EQ:
-      return _mongoc_matcher_op_eq_match (compare, &iter);
+      return _mongoc_matcher_op_eq_match (compare, iter);
    case MONGOC_MATCHER_OPCODE_GT:
-      return _mongoc_matcher_op_gt_match (compare, &iter);
+      return _mongoc_matcher_op_gt_match (compare, iter);
    case MONGOC_MATCHER_OPCODE_GTE:
-      return _mongoc_matcher_op_gte_match (compare, &iter);
+      return _mongoc_matcher_op_gte_match (compare, iter);
    case MONGOC_MATCHER_OPCODE_IN:
-      return _mongoc_matcher_op_in_match (compare, &iter);
+      return _mongoc_matcher_op_in_match (compare, iter);
    case MONGOC_MATCHER_OPCODE_LT:
-      return _mongoc_matcher_op_lt_match (compare, &iter);
+      return _mongoc_matcher_op_lt_match (compare, iter);
    case MONGOC_MATCHER_OPCODE_LTE:
-      return _mongoc_matcher_op_lte_match (compare, &iter);
+      return _mongoc_matcher_op_lte_match (compare, iter);
    case MONGOC_MATCHER_OPCODE_NE:
-      return _mongoc_matcher_op_ne_match (compare, &iter);
+      return _mongoc_matcher_op_ne_match (compare, iter);
    case MONGOC_MATCHER_OPCODE_NIN:
-      return _mongoc_matcher_op_nin_match (compare, &iter);
+      return _mongoc_matcher_op_nin_match (compare, iter);
    default:
       BSON_ASSERT (false);
       break;
@@ -991,6 +1808,231 @@ _mongoc_matcher_op_compare_match (mongoc_matcher_op_compare_t *compare, /* IN */
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_regex_match --
+ *
+ *       Perform {$regex: ...} match using @regex.
+ *
+ * Returns:
+ *       true if @iter is a string the regular expression matches.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_matcher_op_regex_match (mongoc_matcher_op_regex_t *regex, /* IN */
+                                bson_iter_t               *iter)  /* IN */
+{
+   BSON_ASSERT (regex);
+
+   if (!iter || !BSON_ITER_HOLDS_UTF8 (iter)) {
+      return false;
+   }
+
+#ifdef _WIN32
+   return false;
+#else
+   return regexec (&regex->regex, bson_iter_utf8 (iter, NULL),
+                   0, NULL, 0) == 0;
+#endif
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_elem_match_match --
+ *
+ *       Perform {$elemMatch: {...}} match using @elem_match.
+ *
+ * Returns:
+ *       true if @iter is an array and any of its elements matched.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_matcher_op_elem_match_match (mongoc_matcher_op_elem_match_t *elem_match, /* IN */
+                                     bson_iter_t                    *iter)       /* IN */
+{
+   bson_iter_t child;
+   const uint8_t *data;
+   uint32_t len;
+   bson_t doc;
+
+   BSON_ASSERT (elem_match);
+
+   if (!iter || !BSON_ITER_HOLDS_ARRAY (iter) ||
+       !bson_iter_recurse (iter, &child)) {
+      return false;
+   }
+
+   while (bson_iter_next (&child)) {
+      if (elem_match->on_values) {
+         if (_mongoc_matcher_op_match_value (elem_match->child, &child)) {
+            return true;
+         }
+      } else if (BSON_ITER_HOLDS_DOCUMENT (&child)) {
+         bson_iter_document (&child, &len, &data);
+         if (bson_init_static (&doc, data, len) &&
+             _mongoc_matcher_op_match (elem_match->child, &doc)) {
+            return true;
+         }
+      }
+   }
+
+   return false;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_size_match --
+ *
+ *       Perform {$size: int} match using @size.
+ *
+ * Returns:
+ *       true if @iter is an array with exactly that many elements.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_matcher_op_size_match (mongoc_matcher_op_size_t *size, /* IN */
+                               bson_iter_t              *iter) /* IN */
+{
+   bson_iter_t child;
+   int64_t n = 0;
+
+   BSON_ASSERT (size);
+
+   if (!iter || !BSON_ITER_HOLDS_ARRAY (iter) ||
+       !bson_iter_recurse (iter, &child)) {
+      return false;
+   }
+
+   while (bson_iter_next (&child)) {
+      if (++n > size->size) {
+         return false;
+      }
+   }
+
+   return n == size->size;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_all_match --
+ *
+ *       Perform {$all: [...]} match using @compare. Each value must
+ *       equal @iter or, if @iter is an array, one of its elements.
+ *
+ * Returns:
+ *       true if all values were found; false if there are none.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_matcher_op_all_match (mongoc_matcher_op_compare_t *compare, /* IN */
+                              bson_iter_t                 *iter)    /* IN */
+{
+   bson_iter_t value;
+   bson_iter_t elem;
+   bool found;
+   bool any = false;
+
+   BSON_ASSERT (compare);
+
+   if (!iter || !bson_iter_recurse (&compare->iter, &value)) {
+      return false;
+   }
+
+   while (bson_iter_next (&value)) {
+      any = true;
+      found = _mongoc_matcher_iter_eq_match (&value, iter);
+
+      if (!found && BSON_ITER_HOLDS_ARRAY (iter) &&
+          bson_iter_recurse (iter, &elem)) {
+         while (!found && bson_iter_next (&elem)) {
+            found = _mongoc_matcher_iter_eq_match (&value, &elem);
+         }
+      }
+
+      if (!found) {
+         return false;
+      }
+   }
+
+   return any;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_mod_match --
+ *
+ *       Perform {$mod: [divisor, remainder]} match using @mod. Doubles
+ *       are truncated to integers first, like the server does.
+ *
+ * Returns:
+ *       true if @iter is a number with that remainder.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_matcher_op_mod_match (mongoc_matcher_op_mod_t *mod,  /* IN */
+                              bson_iter_t             *iter) /* IN */
+{
+   int64_t v;
+
+   BSON_ASSERT (mod);
+
+   if (!iter) {
+      return false;
+   }
+
+   switch (bson_iter_type (iter)) {
+   case BSON_TYPE_DOUBLE:
+   case BSON_TYPE_INT32:
+   case BSON_TYPE_INT64:
+      v = bson_iter_as_int64 (iter);
+      break;
+   default:
+      return false;
+   }
+
+   /* INT64_MIN % -1 overflows */
+   if (mod->divisor == -1) {
+      return mod->remainder == 0;
+   }
+
+   return v % mod->divisor == mod->remainder;
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -1054,9 +2096,60 @@ bool
 _mongoc_matcher_op_match (mongoc_matcher_op_t *op,   /* IN */
                           const bson_t        *bson) /* IN */
 {
+   const char *path;
+   bson_iter_t tmp;
+   bson_iter_t iter;
+   bool found;
+
    BSON_ASSERT (op);
    BSON_ASSERT (bson);
 
+   switch (op->base.opcode) {
+   case MONGOC_MATCHER_OPCODE_OR:
+   case MONGOC_MATCHER_OPCODE_AND:
+   case MONGOC_MATCHER_OPCODE_NOR:
+      return _mongoc_matcher_op_logical_match (&op->logical, bson);
+   default:
+      break;
+   }
+
+   path = _mongoc_matcher_op_path (op);
+
+   if (strchr (path, '.')) {
+      found = (bson_iter_init (&tmp, bson) &&
+               bson_iter_find_descendant (&tmp, path, &iter));
+   } else {
+      found = bson_iter_init_find (&iter, bson, path);
+   }
+
+   return _mongoc_matcher_op_match_value (op, found ? &iter : NULL);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_match_value --
+ *
+ *       Match an op with a path, not a logical op, against the value
+ *       at its path in a document.
+ *
+ * Returns:
+ *       Opcode specific. @iter is NULL if the path is not in the
+ *       document.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_matcher_op_match_value (mongoc_matcher_op_t *op,   /* IN */
+                                bson_iter_t         *iter) /* IN */
+{
+   BSON_ASSERT (op);
+
    switch (op->base.opcode) {
    case MONGOC_MATCHER_OPCODE_EQ:
    case MONGOC_MATCHER_OPCODE_GT:
@@ -1066,22 +2159,167 @@ _mongoc_matcher_op_match (mongoc_matcher_op_t *op,   /* IN */
    case MONGOC_MATCHER_OPCODE_LTE:
    case MONGOC_MATCHER_OPCODE_NE:
    case MONGOC_MATCHER_OPCODE_NIN:
-      return _mongoc_matcher_op_compare_match (&op->compare, bson);
+      return _mongoc_matcher_op_compare_match (&op->compare, iter);
+   case MONGOC_MATCHER_OPCODE_NOT:
+      return _mongoc_matcher_op_not_match (&op->not_, iter);
+   case MONGOC_MATCHER_OPCODE_EXISTS:
+      return _mongoc_matcher_op_exists_match (&op->exists, iter);
+   case MONGOC_MATCHER_OPCODE_TYPE:
+      return _mongoc_matcher_op_type_match (&op->type, iter);
+   case MONGOC_MATCHER_OPCODE_REGEX:
+      return _mongoc_matcher_op_regex_match (&op->regex, iter);
+   case MONGOC_MATCHER_OPCODE_ELEM_MATCH:
+      return _mongoc_matcher_op_elem_match_match (&op->elem_match, iter);
+   case MONGOC_MATCHER_OPCODE_SIZE:
+      return _mongoc_matcher_op_size_match (&op->size, iter);
+   case MONGOC_MATCHER_OPCODE_ALL:
+      return _mongoc_matcher_op_all_match (&op->compare, iter);
+   case MONGOC_MATCHER_OPCODE_MOD:
+      return _mongoc_matcher_op_mod_match (&op->mod, iter);
+   case MONGOC_MATCHER_OPCODE_AND:
+      /* several operators on one path, like {$gt: 1, $lt: 5} */
+      return (_mongoc_matcher_op_match_value (op->logical.left, iter) &&
+              (!op->logical.right ||
+               _mongoc_matcher_op_match_value (op->logical.right, iter)));
+   case MONGOC_MATCHER_OPCODE_OR:
+   case MONGOC_MATCHER_OPCODE_NOR:
+   default:
+      BSON_ASSERT (false);
+      break;
+   }
+
+   return false;
+}
+
+
+/* the path an op matches, or NULL for logical ops */
+const char *
+_mongoc_matcher_op_path (const mongoc_matcher_op_t *op) /* IN */
+{
+   switch (op->base.opcode) {
+   case MONGOC_MATCHER_OPCODE_EQ:
+   case MONGOC_MATCHER_OPCODE_GT:
+   case MONGOC_MATCHER_OPCODE_GTE:
+   case MONGOC_MATCHER_OPCODE_IN:
+   case MONGOC_MATCHER_OPCODE_LT:
+   case MONGOC_MATCHER_OPCODE_LTE:
+   case MONGOC_MATCHER_OPCODE_NE:
+   case MONGOC_MATCHER_OPCODE_NIN:
+      return op->compare.path;
+   case MONGOC_MATCHER_OPCODE_NOT:
+      return op->not_.path;
+   case MONGOC_MATCHER_OPCODE_EXISTS:
+      return op->exists.path;
+   case MONGOC_MATCHER_OPCODE_TYPE:
+      return op->type.path;
+   case MONGOC_MATCHER_OPCODE_ALL:
+      return op->compare.path;
+   case MONGOC_MATCHER_OPCODE_REGEX:
+      return op->regex.path;
+   case MONGOC_MATCHER_OPCODE_ELEM_MATCH:
+      return op->elem_match.path;
+   case MONGOC_MATCHER_OPCODE_SIZE:
+      return op->size.path;
+   case MONGOC_MATCHER_OPCODE_MOD:
+      return op->mod.path;
    case MONGOC_MATCHER_OPCODE_OR:
    case MONGOC_MATCHER_OPCODE_AND:
    case MONGOC_MATCHER_OPCODE_NOR:
-      return _mongoc_matcher_op_logical_match (&op->logical, bson);
+   default:
+      return NULL;
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_compile --
+ *
+ *       Prepare @op and its children for matching many documents: cache
+ *       numbers compared with, so they're compared without decoding
+ *       them again, and hash $in and $nin arrays of
+ *       MONGOC_MATCHER_IN_HASH_MIN or more values.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_matcher_op_compile (mongoc_matcher_op_t *op) /* IN */
+{
+   mongoc_matcher_op_compare_t *compare;
+   bson_iter_t iter;
+   uint32_t n = 0;
+
+   BSON_ASSERT (op);
+
+   switch (op->base.opcode) {
+   case MONGOC_MATCHER_OPCODE_EQ:
+   case MONGOC_MATCHER_OPCODE_GT:
+   case MONGOC_MATCHER_OPCODE_GTE:
+   case MONGOC_MATCHER_OPCODE_LT:
+   case MONGOC_MATCHER_OPCODE_LTE:
+   case MONGOC_MATCHER_OPCODE_NE:
+      compare = &op->compare;
+      switch (bson_iter_type (&compare->iter)) {
+      case BSON_TYPE_DOUBLE:
+         compare->is_numeric = true;
+         compare->is_double = true;
+         compare->v_double = bson_iter_double (&compare->iter);
+         break;
+      case BSON_TYPE_INT32:
+      case BSON_TYPE_INT64:
+         compare->is_numeric = true;
+         compare->v_int64 = bson_iter_as_int64 (&compare->iter);
+         compare->v_double = (double) compare->v_int64;
+         break;
+      default:
+         break;
+      }
+      break;
+   case MONGOC_MATCHER_OPCODE_IN:
+   case MONGOC_MATCHER_OPCODE_NIN:
+      compare = &op->compare;
+      if (BSON_ITER_HOLDS_ARRAY (&compare->iter) &&
+          bson_iter_recurse (&compare->iter, &iter)) {
+         while (bson_iter_next (&iter)) {
+            n++;
+         }
+
+         if (n >= MONGOC_MATCHER_IN_HASH_MIN) {
+            compare->in_set = _mongoc_matcher_in_set_new (&compare->iter);
+         }
+      }
+      break;
+   case MONGOC_MATCHER_OPCODE_OR:
+   case MONGOC_MATCHER_OPCODE_AND:
+   case MONGOC_MATCHER_OPCODE_NOR:
+      _mongoc_matcher_op_compile (op->logical.left);
+      if (op->logical.right) {
+         _mongoc_matcher_op_compile (op->logical.right);
+      }
+      break;
    case MONGOC_MATCHER_OPCODE_NOT:
-      return _mongoc_matcher_op_not_match (&op->not_, bson);
+      _mongoc_matcher_op_compile (op->not_.child);
+      break;
+   case MONGOC_MATCHER_OPCODE_ELEM_MATCH:
+      _mongoc_matcher_op_compile (op->elem_match.child);
+      break;
    case MONGOC_MATCHER_OPCODE_EXISTS:
-      return _mongoc_matcher_op_exists_match (&op->exists, bson);
    case MONGOC_MATCHER_OPCODE_TYPE:
-      return _mongoc_matcher_op_type_match (&op->type, bson);
+   case MONGOC_MATCHER_OPCODE_REGEX:
+   case MONGOC_MATCHER_OPCODE_SIZE:
+   case MONGOC_MATCHER_OPCODE_ALL:
+   case MONGOC_MATCHER_OPCODE_MOD:
    default:
       break;
    }
-
-   return false;
 }
 
 
@@ -1194,6 +2432,37 @@ _mongoc_matcher_op_to_bson (mongoc_matcher_op_t *op,   /* IN */
    case MONGOC_MATCHER_OPCODE_TYPE:
       BSON_APPEND_INT32 (bson, "$type", (int)op->type.type);
       break;
+   case MONGOC_MATCHER_OPCODE_REGEX:
+      bson_append_document_begin (bson, op->regex.path, -1, &child);
+      BSON_APPEND_UTF8 (&child, "$regex", op->regex.pattern);
+      BSON_APPEND_UTF8 (&child, "$options", op->regex.options);
+      bson_append_document_end (bson, &child);
+      break;
+   case MONGOC_MATCHER_OPCODE_ELEM_MATCH:
+      bson_append_document_begin (bson, op->elem_match.path, -1, &child);
+      bson_append_document_begin (&child, "$elemMatch", 10, &child2);
+      _mongoc_matcher_op_to_bson (op->elem_match.child, &child2);
+      bson_append_document_end (&child, &child2);
+      bson_append_document_end (bson, &child);
+      break;
+   case MONGOC_MATCHER_OPCODE_SIZE:
+      bson_append_document_begin (bson, op->size.path, -1, &child);
+      BSON_APPEND_INT64 (&child, "$size", op->size.size);
+      bson_append_document_end (bson, &child);
+      break;
+   case MONGOC_MATCHER_OPCODE_ALL:
+      bson_append_document_begin (bson, op->compare.path, -1, &child);
+      _ignore_value (bson_append_iter (&child, "$all", -1, &op->compare.iter));
+      bson_append_document_end (bson, &child);
+      break;
+   case MONGOC_MATCHER_OPCODE_MOD:
+      bson_append_document_begin (bson, op->mod.path, -1, &child);
+      bson_append_array_begin (&child, "$mod", 4, &child2);
+      BSON_APPEND_INT64 (&child2, "0", op->mod.divisor);
+      BSON_APPEND_INT64 (&child2, "1", op->mod.remainder);
+      bson_append_array_end (&child, &child2);
+      bson_append_document_end (bson, &child);
+      break;
    default:
       BSON_ASSERT (false);
       break;
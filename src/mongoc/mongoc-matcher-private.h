@@ -29,10 +29,50 @@
 BSON_BEGIN_DECLS
 
 
+/* at most this many fields are matched in one pass, see
+ * _mongoc_matcher_compile */
+#define MONGOC_MATCHER_MAX_GROUPS 64
+
+
+/* the ops of a top-level conjunction on paths in one field */
+typedef struct
+{
+   const char     *key;      /* the field's name, not NUL-terminated */
+   size_t          key_len;
+   mongoc_array_t  ops;      /* of mongoc_matcher_op_t pointers */
+} mongoc_matcher_group_t;
+
+
+/* a field's values in a batch of documents, see
+ * mongoc_matcher_match_batch */
+typedef enum
+{
+   MONGOC_MATCHER_VALUE_MISSING,
+   MONGOC_MATCHER_VALUE_INT,     /* int32, int64 or bool */
+   MONGOC_MATCHER_VALUE_DOUBLE,
+   MONGOC_MATCHER_VALUE_OTHER,
+} mongoc_matcher_value_kind_t;
+
+
+typedef struct
+{
+   uint32_t  n;
+   uint8_t  *kinds;      /* of mongoc_matcher_value_kind_t */
+   uint8_t  *is_double;
+   int64_t  *ints;
+   double   *doubles;    /* ints converted, if not a double */
+   uint8_t  *result;     /* of the last op compared */
+} mongoc_matcher_column_t;
+
+
 struct _mongoc_matcher_t
 {
    bson_t               query;
    mongoc_matcher_op_t *optree;
+   /* the optree's top-level conjunction, ops on paths grouped by field
+    * so each field is found once, and the other ops */
+   mongoc_array_t       groups;    /* of mongoc_matcher_group_t */
+   mongoc_array_t       residual;  /* of mongoc_matcher_op_t pointers */
 };
 
 
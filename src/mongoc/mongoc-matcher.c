@@ -28,18 +28,61 @@ _mongoc_matcher_parse_logical (mongoc_matcher_opcode_t  opcode,
                                bson_iter_t             *iter,
                                bool                     is_root,
                                bson_error_t            *error);
+static mongoc_matcher_op_t *
+_mongoc_matcher_parse_compare (bson_iter_t             *iter,
+                               const char              *path,
+                               bson_error_t            *error);
 
 
 /*
  *--------------------------------------------------------------------------
  *
- * _mongoc_matcher_parse_compare --
+ * _mongoc_matcher_parse_int64 --
  *
- *       Parse a compare spec such as $gt or $in.
+ *       Read the number @iter holds as the value for operator @name.
+ *       Doubles are truncated.
  *
- *       See the following link for more information.
+ * Returns:
+ *       true if successful; otherwise false and @error is set.
  *
- *          http://docs.mongodb.org/manual/reference/operator/query/
+ * Side effects:
+ *       @error may be set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_matcher_parse_int64 (const bson_iter_t *iter,  /* IN */
+                             const char        *name,  /* IN */
+                             int64_t           *v,     /* OUT */
+                             bson_error_t      *error) /* OUT */
+{
+   switch (bson_iter_type (iter)) {
+   case BSON_TYPE_DOUBLE:
+   case BSON_TYPE_INT32:
+   case BSON_TYPE_INT64:
+      *v = bson_iter_as_int64 (iter);
+      return true;
+   default:
+      bson_set_error (error,
+                      MONGOC_ERROR_MATCHER,
+                      MONGOC_ERROR_MATCHER_INVALID,
+                      "Invalid value for operator \"%s\"",
+                      name);
+      return false;
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_parse_regex --
+ *
+ *       Parse {$regex: ..., $options: ...} from the operator document
+ *       @iter, whose current key @child is "$regex". The pattern may be
+ *       a string or a BSON regular expression; $options, if present,
+ *       replaces the latter's options.
  *
  * Returns:
  *       A newly allocated mongoc_matcher_op_t if successful; otherwise
@@ -52,78 +95,326 @@ _mongoc_matcher_parse_logical (mongoc_matcher_opcode_t  opcode,
  */
 
 static mongoc_matcher_op_t *
-_mongoc_matcher_parse_compare (bson_iter_t  *iter,  /* IN */
-                               const char   *path,  /* IN */
-                               bson_error_t *error) /* OUT */
+_mongoc_matcher_parse_regex (const bson_iter_t *iter,  /* IN */
+                             const bson_iter_t *child, /* IN */
+                             const char        *path,  /* IN */
+                             bson_error_t      *error) /* OUT */
 {
-   const char * key;
-   mongoc_matcher_op_t * op = NULL, * op_child;
-   bson_iter_t child;
+   const char *pattern;
+   const char *options = NULL;
+   bson_iter_t options_iter;
 
-   BSON_ASSERT (iter);
-   BSON_ASSERT (path);
+   if (BSON_ITER_HOLDS_UTF8 (child)) {
+      pattern = bson_iter_utf8 (child, NULL);
+   } else if (BSON_ITER_HOLDS_REGEX (child)) {
+      pattern = bson_iter_regex (child, &options);
+   } else {
+      bson_set_error (error,
+                      MONGOC_ERROR_MATCHER,
+                      MONGOC_ERROR_MATCHER_INVALID,
+                      "Invalid value for operator \"$regex\"");
+      return NULL;
+   }
 
-   if (bson_iter_type (iter) == BSON_TYPE_DOCUMENT) {
-      if (!bson_iter_recurse (iter, &child) ||
-          !bson_iter_next (&child)) {
+   if (bson_iter_recurse (iter, &options_iter) &&
+       bson_iter_find (&options_iter, "$options")) {
+      if (!BSON_ITER_HOLDS_UTF8 (&options_iter)) {
          bson_set_error (error,
                          MONGOC_ERROR_MATCHER,
                          MONGOC_ERROR_MATCHER_INVALID,
-                         "Document contains no operations.");
+                         "Invalid value for operator \"$options\"");
          return NULL;
       }
 
-      key = bson_iter_key (&child);
+      options = bson_iter_utf8 (&options_iter, NULL);
+   }
 
-      if (key[0] != '$') {
-         op = _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_EQ, path,
-                                              iter);
-      } else if (strcmp(key, "$not") == 0) {
-         if (!(op_child = _mongoc_matcher_parse_compare (&child, path,
-                                                         error))) {
-            return NULL;
-         }
-         op = _mongoc_matcher_op_not_new (path, op_child);
-      } else if (strcmp(key, "$gt") == 0) {
-         op = _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_GT, path,
-                                              &child);
-      } else if (strcmp(key, "$gte") == 0) {
-         op = _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_GTE, path,
-                                              &child);
-      } else if (strcmp(key, "$in") == 0) {
-         op = _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_IN, path,
-                                              &child);
-      } else if (strcmp(key, "$lt") == 0) {
-         op = _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_LT, path,
-                                              &child);
-      } else if (strcmp(key, "$lte") == 0) {
-         op = _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_LTE, path,
-                                              &child);
-      } else if (strcmp(key, "$ne") == 0) {
-         op = _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_NE, path,
-                                              &child);
-      } else if (strcmp(key, "$nin") == 0) {
-         op = _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_NIN, path,
-                                              &child);
-      } else if (strcmp(key, "$exists") == 0) {
-         op = _mongoc_matcher_op_exists_new (path, bson_iter_bool (&child));
-      } else if (strcmp(key, "$type") == 0) {
-         op = _mongoc_matcher_op_type_new (path, bson_iter_type (&child));
-      } else {
+   return _mongoc_matcher_op_regex_new (path, pattern, options, error);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_parse_elem_match --
+ *
+ *       Parse {$elemMatch: {...}} at @child. If the spec's first key is
+ *       an operator like $gt, the array's elements are matched with the
+ *       spec's operators, otherwise the array's subdocuments are
+ *       matched with the spec as a query.
+ *
+ * Returns:
+ *       A newly allocated mongoc_matcher_op_t if successful; otherwise
+ *       NULL and @error is set.
+ *
+ * Side effects:
+ *       @error may be set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static mongoc_matcher_op_t *
+_mongoc_matcher_parse_elem_match (bson_iter_t  *child, /* IN */
+                                  const char   *path,  /* IN */
+                                  bson_error_t *error) /* OUT */
+{
+   mongoc_matcher_op_t *op_child;
+   bson_iter_t spec;
+   const char *key;
+   bool on_values;
+
+   if (!BSON_ITER_HOLDS_DOCUMENT (child) ||
+       !bson_iter_recurse (child, &spec) ||
+       !bson_iter_next (&spec)) {
+      bson_set_error (error,
+                      MONGOC_ERROR_MATCHER,
+                      MONGOC_ERROR_MATCHER_INVALID,
+                      "Invalid value for operator \"$elemMatch\"");
+      return NULL;
+   }
+
+   key = bson_iter_key (&spec);
+   on_values = (key[0] == '$' &&
+                strcmp (key, "$and") != 0 &&
+                strcmp (key, "$or") != 0 &&
+                strcmp (key, "$nor") != 0);
+
+   if (on_values) {
+      op_child = _mongoc_matcher_parse_compare (child, "", error);
+   } else {
+      bson_iter_recurse (child, &spec);
+      op_child = _mongoc_matcher_parse_logical (MONGOC_MATCHER_OPCODE_AND,
+                                                &spec, true, error);
+   }
+
+   if (!op_child) {
+      return NULL;
+   }
+
+   return _mongoc_matcher_op_elem_match_new (path, op_child, on_values);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_parse_operator --
+ *
+ *       Parse the operator at @child, such as $gt or $in, in the
+ *       operator document @iter.
+ *
+ * Returns:
+ *       A newly allocated mongoc_matcher_op_t if successful; otherwise
+ *       NULL and @error is set.
+ *
+ * Side effects:
+ *       @error may be set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static mongoc_matcher_op_t *
+_mongoc_matcher_parse_operator (const bson_iter_t *iter,  /* IN */
+                                bson_iter_t       *child, /* IN */
+                                const char        *path,  /* IN */
+                                bson_error_t      *error) /* OUT */
+{
+   const char *key;
+   mongoc_matcher_op_t *op_child;
+   bson_iter_t array;
+   int64_t divisor;
+   int64_t remainder;
+   int64_t size;
+
+   key = bson_iter_key (child);
+
+   if (strcmp(key, "$not") == 0) {
+      if (!(op_child = _mongoc_matcher_parse_compare (child, path, error))) {
+         return NULL;
+      }
+      return _mongoc_matcher_op_not_new (path, op_child);
+   } else if (strcmp(key, "$gt") == 0) {
+      return _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_GT, path,
+                                             child);
+   } else if (strcmp(key, "$gte") == 0) {
+      return _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_GTE, path,
+                                             child);
+   } else if (strcmp(key, "$in") == 0) {
+      return _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_IN, path,
+                                             child);
+   } else if (strcmp(key, "$lt") == 0) {
+      return _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_LT, path,
+                                             child);
+   } else if (strcmp(key, "$lte") == 0) {
+      return _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_LTE, path,
+                                             child);
+   } else if (strcmp(key, "$ne") == 0) {
+      return _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_NE, path,
+                                             child);
+   } else if (strcmp(key, "$nin") == 0) {
+      return _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_NIN, path,
+                                             child);
+   } else if (strcmp(key, "$exists") == 0) {
+      return _mongoc_matcher_op_exists_new (path, bson_iter_bool (child));
+   } else if (strcmp(key, "$type") == 0) {
+      return _mongoc_matcher_op_type_new (path, bson_iter_type (child));
+   } else if (strcmp(key, "$regex") == 0) {
+      return _mongoc_matcher_parse_regex (iter, child, path, error);
+   } else if (strcmp(key, "$elemMatch") == 0) {
+      return _mongoc_matcher_parse_elem_match (child, path, error);
+   } else if (strcmp(key, "$size") == 0) {
+      if (!_mongoc_matcher_parse_int64 (child, key, &size, error)) {
+         return NULL;
+      }
+      if (size < 0) {
          bson_set_error (error,
                          MONGOC_ERROR_MATCHER,
                          MONGOC_ERROR_MATCHER_INVALID,
-                         "Invalid operator \"%s\"",
+                         "$size may not be negative");
+         return NULL;
+      }
+      return _mongoc_matcher_op_size_new (path, size);
+   } else if (strcmp(key, "$all") == 0) {
+      if (!BSON_ITER_HOLDS_ARRAY (child)) {
+         bson_set_error (error,
+                         MONGOC_ERROR_MATCHER,
+                         MONGOC_ERROR_MATCHER_INVALID,
+                         "Invalid value for operator \"%s\"",
                          key);
          return NULL;
       }
-   } else {
-      op = _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_EQ, path, iter);
+      return _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_ALL, path,
+                                             child);
+   } else if (strcmp(key, "$mod") == 0) {
+      if (!BSON_ITER_HOLDS_ARRAY (child) ||
+          !bson_iter_recurse (child, &array) ||
+          !bson_iter_next (&array) ||
+          !_mongoc_matcher_parse_int64 (&array, key, &divisor, error) ||
+          !bson_iter_next (&array) ||
+          !_mongoc_matcher_parse_int64 (&array, key, &remainder, error) ||
+          bson_iter_next (&array)) {
+         bson_set_error (error,
+                         MONGOC_ERROR_MATCHER,
+                         MONGOC_ERROR_MATCHER_INVALID,
+                         "$mod needs an array of divisor and remainder");
+         return NULL;
+      }
+      if (divisor == 0) {
+         bson_set_error (error,
+                         MONGOC_ERROR_MATCHER,
+                         MONGOC_ERROR_MATCHER_INVALID,
+                         "$mod divisor may not be 0");
+         return NULL;
+      }
+      return _mongoc_matcher_op_mod_new (path, divisor, remainder);
+   }
+
+   bson_set_error (error,
+                   MONGOC_ERROR_MATCHER,
+                   MONGOC_ERROR_MATCHER_INVALID,
+                   "Invalid operator \"%s\"",
+                   key);
+   return NULL;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_parse_compare --
+ *
+ *       Parse a compare spec such as $gt or $in. Several operators in
+ *       one spec, like {$gt: 1, $lt: 5}, must all match.
+ *
+ *       See the following link for more information.
+ *
+ *          http://docs.mongodb.org/manual/reference/operator/query/
+ *
+ * Returns:
+ *       A newly allocated mongoc_matcher_op_t if successful; otherwise
+ *       NULL and @error is set.
+ *
+ * Side effects:
+ *       @error may be set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static mongoc_matcher_op_t *
+_mongoc_matcher_parse_compare (bson_iter_t  *iter,  /* IN */
+                               const char   *path,  /* IN */
+                               bson_error_t *error) /* OUT */
+{
+   const char *key;
+   const char *pattern;
+   const char *options;
+   mongoc_matcher_op_t *op = NULL, *op_child;
+   bson_iter_t child;
+   bson_iter_t regex;
+
+   BSON_ASSERT (iter);
+   BSON_ASSERT (path);
+
+   if (BSON_ITER_HOLDS_REGEX (iter)) {
+      pattern = bson_iter_regex (iter, &options);
+      return _mongoc_matcher_op_regex_new (path, pattern, options, error);
+   }
+
+   if (bson_iter_type (iter) != BSON_TYPE_DOCUMENT) {
+      return _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_EQ, path,
+                                             iter);
    }
 
+   if (!bson_iter_recurse (iter, &child) ||
+       !bson_iter_next (&child)) {
+      bson_set_error (error,
+                      MONGOC_ERROR_MATCHER,
+                      MONGOC_ERROR_MATCHER_INVALID,
+                      "Document contains no operations.");
+      return NULL;
+   }
+
+   key = bson_iter_key (&child);
+
+   if (key[0] != '$') {
+      return _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_EQ, path,
+                                             iter);
+   }
+
+   do {
+      /* $options is read along with $regex */
+      if (strcmp (bson_iter_key (&child), "$options") == 0) {
+         if (!bson_iter_recurse (iter, &regex) ||
+             !bson_iter_find (&regex, "$regex")) {
+            bson_set_error (error,
+                            MONGOC_ERROR_MATCHER,
+                            MONGOC_ERROR_MATCHER_INVALID,
+                            "$options needs a $regex");
+            goto failure;
+         }
+         continue;
+      }
+
+      if (!(op_child = _mongoc_matcher_parse_operator (iter, &child, path,
+                                                       error))) {
+         goto failure;
+      }
+
+      op = op ? _mongoc_matcher_op_logical_new (MONGOC_MATCHER_OPCODE_AND,
+                                                op, op_child)
+              : op_child;
+   } while (bson_iter_next (&child));
+
    BSON_ASSERT (op);
 
    return op;
+
+failure:
+   if (op) {
+      _mongoc_matcher_op_destroy (op);
+   }
+
+   return NULL;
 }
 
 
@@ -294,6 +585,159 @@ _mongoc_matcher_parse_logical (mongoc_matcher_opcode_t  opcode,  /* IN */
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_compile --
+ *
+ *       Flatten the optree's top-level $and into matcher->groups, one
+ *       per top-level field the ops' paths start with, and
+ *       matcher->residual for the rest, and compile each op.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_matcher_compile (mongoc_matcher_t    *matcher, /* IN */
+                         mongoc_matcher_op_t *op)      /* IN */
+{
+   mongoc_matcher_group_t *group;
+   mongoc_matcher_group_t new_group;
+   const char *path;
+   size_t key_len;
+   uint32_t i;
+
+   if (op->base.opcode == MONGOC_MATCHER_OPCODE_AND) {
+      _mongoc_matcher_compile (matcher, op->logical.left);
+      if (op->logical.right) {
+         _mongoc_matcher_compile (matcher, op->logical.right);
+      }
+      return;
+   }
+
+   _mongoc_matcher_op_compile (op);
+
+   path = _mongoc_matcher_op_path (op);
+   if (!path) {
+      _mongoc_array_append_val (&matcher->residual, op);
+      return;
+   }
+
+   key_len = strcspn (path, ".");
+
+   for (i = 0; i < matcher->groups.len; i++) {
+      group = &_mongoc_array_index (&matcher->groups,
+                                    mongoc_matcher_group_t, i);
+      if (group->key_len == key_len &&
+          memcmp (group->key, path, key_len) == 0) {
+         _mongoc_array_append_val (&group->ops, op);
+         return;
+      }
+   }
+
+   if (matcher->groups.len == MONGOC_MATCHER_MAX_GROUPS) {
+      _mongoc_array_append_val (&matcher->residual, op);
+      return;
+   }
+
+   new_group.key = path;
+   new_group.key_len = key_len;
+   _mongoc_array_init (&new_group.ops, sizeof (mongoc_matcher_op_t *));
+   _mongoc_array_append_val (&new_group.ops, op);
+   _mongoc_array_append_val (&matcher->groups, new_group);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_field_op_match --
+ *
+ *       Match @op, whose path starts with a field name of @key_len bytes,
+ *       against that field @iter, or NULL if the document has no such
+ *       field. Ops on dotted paths look for the rest of their path in
+ *       the field.
+ *
+ * Returns:
+ *       true if @op matched.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_matcher_field_op_match (mongoc_matcher_op_t *op,      /* IN */
+                                size_t               key_len, /* IN */
+                                bson_iter_t         *iter)    /* IN */
+{
+   const char *path;
+   bson_iter_t child;
+   bson_iter_t desc;
+   bool found;
+
+   path = _mongoc_matcher_op_path (op);
+
+   if (path[key_len] == '\0') {
+      found = (iter != NULL);
+      if (found) {
+         memcpy (&desc, iter, sizeof desc);
+      }
+   } else {
+      found = (iter &&
+               (BSON_ITER_HOLDS_DOCUMENT (iter) ||
+                BSON_ITER_HOLDS_ARRAY (iter)) &&
+               bson_iter_recurse (iter, &child) &&
+               bson_iter_find_descendant (&child, path + key_len + 1, &desc));
+   }
+
+   return _mongoc_matcher_op_match_value (op, found ? &desc : NULL);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_group_match --
+ *
+ *       Match each op in @group against the field @iter, or NULL if the
+ *       document has no such field.
+ *
+ * Returns:
+ *       true if all ops matched.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_matcher_group_match (const mongoc_matcher_group_t *group, /* IN */
+                             bson_iter_t                  *iter)  /* IN */
+{
+   mongoc_matcher_op_t *op;
+   uint32_t i;
+
+   for (i = 0; i < group->ops.len; i++) {
+      op = _mongoc_array_index (&group->ops, mongoc_matcher_op_t *, i);
+
+      if (!_mongoc_matcher_field_op_match (op, group->key_len, iter)) {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -330,6 +774,8 @@ mongoc_matcher_new (const bson_t *query, /* IN */
 
    matcher = (mongoc_matcher_t *)bson_malloc0 (sizeof *matcher);
    bson_copy_to (query, &matcher->query);
+   _mongoc_array_init (&matcher->groups, sizeof (mongoc_matcher_group_t));
+   _mongoc_array_init (&matcher->residual, sizeof (mongoc_matcher_op_t *));
 
    if (!bson_iter_init (&iter, &matcher->query)) {
       goto failure;
@@ -341,10 +787,13 @@ mongoc_matcher_new (const bson_t *query, /* IN */
    }
 
    matcher->optree = op;
+   _mongoc_matcher_compile (matcher, op);
 
    return matcher;
 
 failure:
+   _mongoc_array_destroy (&matcher->groups);
+   _mongoc_array_destroy (&matcher->residual);
    bson_destroy (&matcher->query);
    bson_free (matcher);
    return NULL;
@@ -359,6 +808,10 @@ failure:
  *       Checks to see if @bson matches the query specified when creating
  *       @matcher.
  *
+ *       The document's fields are iterated once, each matched with the
+ *       ops on paths in it, then the ops on missing fields and the other
+ *       ops are matched.
+ *
  * Returns:
  *       TRUE if @bson matched the query, otherwise FALSE.
  *
@@ -372,11 +825,460 @@ bool
 mongoc_matcher_match (const mongoc_matcher_t *matcher,  /* IN */
                       const bson_t           *document) /* IN */
 {
+   const mongoc_matcher_group_t *group;
+   const mongoc_matcher_group_t *groups;
+   uint32_t n_groups;
+   uint64_t all;
+   uint64_t seen = 0;
+   bson_iter_t iter;
+   const char *key;
+   size_t key_len;
+   uint32_t i;
+
    BSON_ASSERT (matcher);
    BSON_ASSERT (matcher->optree);
    BSON_ASSERT (document);
 
-   return _mongoc_matcher_op_match (matcher->optree, document);
+   groups = (const mongoc_matcher_group_t *) matcher->groups.data;
+   n_groups = matcher->groups.len;
+   all = n_groups == 64 ? UINT64_MAX : (((uint64_t) 1 << n_groups) - 1);
+
+   if (n_groups && bson_iter_init (&iter, document)) {
+      while (seen != all && bson_iter_next (&iter)) {
+         key = bson_iter_key (&iter);
+         key_len = strlen (key);
+
+         for (i = 0; i < n_groups; i++) {
+            group = &groups[i];
+            if (group->key_len == key_len &&
+                memcmp (group->key, key, key_len) == 0) {
+               break;
+            }
+         }
+
+         /* the first field with a name is matched, like bson_iter_find */
+         if (i == n_groups || (seen & ((uint64_t) 1 << i))) {
+            continue;
+         }
+
+         seen |= (uint64_t) 1 << i;
+
+         if (!_mongoc_matcher_group_match (group, &iter)) {
+            return false;
+         }
+      }
+   }
+
+   for (i = 0; i < n_groups; i++) {
+      if (!(seen & ((uint64_t) 1 << i)) &&
+          !_mongoc_matcher_group_match (&groups[i], NULL)) {
+         return false;
+      }
+   }
+
+   for (i = 0; i < matcher->residual.len; i++) {
+      if (!_mongoc_matcher_op_match (
+             _mongoc_array_index (&matcher->residual,
+                                  mongoc_matcher_op_t *, i),
+             document)) {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_locate --
+ *
+ *       Find each group's field in each of @documents with one pass over
+ *       each document. The field for group g in document i is stored in
+ *       @fields[g * n_documents + i] and @found is set there.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_matcher_locate (const mongoc_matcher_group_t *groups,      /* IN */
+                        uint32_t                      n_groups,    /* IN */
+                        const bson_t * const         *documents,   /* IN */
+                        uint32_t                      n_documents, /* IN */
+                        bson_iter_t                  *fields,      /* OUT */
+                        uint8_t                      *found)       /* OUT */
+{
+   bson_iter_t iter;
+   const char *key;
+   size_t key_len;
+   uint32_t n_found;
+   uint32_t at;
+   uint32_t i;
+   uint32_t g;
+
+   for (i = 0; i < n_documents; i++) {
+      if (!bson_iter_init (&iter, documents[i])) {
+         continue;
+      }
+
+      n_found = 0;
+
+      while (n_found < n_groups && bson_iter_next (&iter)) {
+         key = bson_iter_key (&iter);
+         key_len = strlen (key);
+
+         for (g = 0; g < n_groups; g++) {
+            if (groups[g].key_len == key_len &&
+                memcmp (groups[g].key, key, key_len) == 0) {
+               break;
+            }
+         }
+
+         at = g * n_documents + i;
+
+         /* the first field with a name is matched, like bson_iter_find */
+         if (g == n_groups || found[at]) {
+            continue;
+         }
+
+         memcpy (&fields[at], &iter, sizeof iter);
+         found[at] = 1;
+         n_found++;
+      }
+   }
+}
+
+
+/* a compare op that can be evaluated over a column of numbers */
+static bool
+_mongoc_matcher_column_op (const mongoc_matcher_op_t *op,      /* IN */
+                           size_t                     key_len) /* IN */
+{
+   switch (op->base.opcode) {
+   case MONGOC_MATCHER_OPCODE_EQ:
+   case MONGOC_MATCHER_OPCODE_GT:
+   case MONGOC_MATCHER_OPCODE_GTE:
+   case MONGOC_MATCHER_OPCODE_LT:
+   case MONGOC_MATCHER_OPCODE_LTE:
+   case MONGOC_MATCHER_OPCODE_NE:
+      return op->compare.is_numeric && op->compare.path[key_len] == '\0';
+   default:
+      return false;
+   }
+}
+
+
+static void
+_mongoc_matcher_column_init (mongoc_matcher_column_t *column, /* OUT */
+                             uint32_t                 n)      /* IN */
+{
+   column->n = n;
+   column->kinds = (uint8_t *) bson_malloc (n);
+   column->is_double = (uint8_t *) bson_malloc (n);
+   column->ints = (int64_t *) bson_malloc (n * sizeof (int64_t));
+   column->doubles = (double *) bson_malloc (n * sizeof (double));
+   column->result = (uint8_t *) bson_malloc (n);
+}
+
+
+static void
+_mongoc_matcher_column_destroy (mongoc_matcher_column_t *column) /* IN */
+{
+   bson_free (column->kinds);
+   bson_free (column->is_double);
+   bson_free (column->ints);
+   bson_free (column->doubles);
+   bson_free (column->result);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_column_load --
+ *
+ *       Decode a field's values in a batch of documents into @column:
+ *       numbers are stored as int64 and double, other values are only
+ *       marked as such.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_matcher_column_load (mongoc_matcher_column_t *column, /* IN */
+                             const bson_iter_t       *fields, /* IN */
+                             const uint8_t           *found)  /* IN */
+{
+   uint32_t i;
+
+   for (i = 0; i < column->n; i++) {
+      column->ints[i] = 0;
+      column->doubles[i] = 0;
+      column->is_double[i] = 0;
+
+      if (!found[i]) {
+         column->kinds[i] = MONGOC_MATCHER_VALUE_MISSING;
+         continue;
+      }
+
+      switch (bson_iter_type (&fields[i])) {
+      case BSON_TYPE_DOUBLE:
+         column->kinds[i] = MONGOC_MATCHER_VALUE_DOUBLE;
+         column->is_double[i] = 1;
+         column->doubles[i] = bson_iter_double (&fields[i]);
+         break;
+      case BSON_TYPE_BOOL:
+      case BSON_TYPE_INT32:
+      case BSON_TYPE_INT64:
+         column->kinds[i] = MONGOC_MATCHER_VALUE_INT;
+         column->ints[i] = bson_iter_as_int64 (&fields[i]);
+         column->doubles[i] = (double) column->ints[i];
+         break;
+      default:
+         column->kinds[i] = MONGOC_MATCHER_VALUE_OTHER;
+         break;
+      }
+   }
+}
+
+
+/*
+ * Compare every value in a column, without branches, so the compiler
+ * can vectorize the loop. Numbers are compared as doubles if either
+ * side is a double, like _mongoc_matcher_op_numeric_match.
+ */
+#define _COLUMN_COMPARE(op) \
+   if (compare->is_double) { \
+      for (i = 0; i < n; i++) { \
+         r[i] = (uint8_t) (d[i] op ld); \
+      } \
+   } else { \
+      for (i = 0; i < n; i++) { \
+         r[i] = (uint8_t) ((is_double[i] & (d[i] op ld)) | \
+                           (!is_double[i] & (v[i] op li))); \
+      } \
+   }
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_column_match --
+ *
+ *       Evaluate the numeric compare @op over @column, clearing @pass
+ *       for the documents it doesn't match. Non-numeric values are
+ *       matched one at a time.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_matcher_column_match (mongoc_matcher_op_t           *op,     /* IN */
+                              const mongoc_matcher_column_t *column, /* IN */
+                              bson_iter_t                   *fields, /* IN */
+                              uint8_t                       *pass)   /* INOUT */
+{
+   const mongoc_matcher_op_compare_t *compare = &op->compare;
+   const uint8_t *is_double = column->is_double;
+   const int64_t *v = column->ints;
+   const double *d = column->doubles;
+   const int64_t li = compare->v_int64;
+   const double ld = compare->v_double;
+   uint8_t *r = column->result;
+   uint32_t n = column->n;
+   uint32_t i;
+
+   switch ((int) compare->base.opcode) {
+   case MONGOC_MATCHER_OPCODE_EQ:
+      _COLUMN_COMPARE (==);
+      break;
+   case MONGOC_MATCHER_OPCODE_NE:
+      _COLUMN_COMPARE (!=);
+      break;
+   case MONGOC_MATCHER_OPCODE_GT:
+      _COLUMN_COMPARE (>);
+      break;
+   case MONGOC_MATCHER_OPCODE_GTE:
+      _COLUMN_COMPARE (>=);
+      break;
+   case MONGOC_MATCHER_OPCODE_LT:
+      _COLUMN_COMPARE (<);
+      break;
+   case MONGOC_MATCHER_OPCODE_LTE:
+      _COLUMN_COMPARE (<=);
+      break;
+   default:
+      BSON_ASSERT (false);
+      return;
+   }
+
+   for (i = 0; i < n; i++) {
+      switch (column->kinds[i]) {
+      case MONGOC_MATCHER_VALUE_INT:
+      case MONGOC_MATCHER_VALUE_DOUBLE:
+         pass[i] &= r[i];
+         break;
+      case MONGOC_MATCHER_VALUE_OTHER:
+         if (pass[i] && !_mongoc_matcher_op_match_value (op, &fields[i])) {
+            pass[i] = 0;
+         }
+         break;
+      case MONGOC_MATCHER_VALUE_MISSING:
+      default:
+         pass[i] = 0;
+         break;
+      }
+   }
+}
+
+
+#undef _COLUMN_COMPARE
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_matcher_match_batch --
+ *
+ *       Checks which of @documents match the query specified when
+ *       creating @matcher, and sets bit i % 8 of byte i / 8 of @bitmap
+ *       for each document i that does. @bitmap must have room for
+ *       (n_documents + 7) / 8 bytes.
+ *
+ *       Each document's fields are iterated once, then the ops are
+ *       evaluated one at a time over all documents: numeric comparisons
+ *       on a field are evaluated over a column of the field's values.
+ *
+ * Returns:
+ *       The number of documents that matched.
+ *
+ * Side effects:
+ *       @bitmap is overwritten.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+uint32_t
+mongoc_matcher_match_batch (const mongoc_matcher_t *matcher,     /* IN */
+                            const bson_t * const   *documents,   /* IN */
+                            uint32_t                n_documents, /* IN */
+                            uint8_t                *bitmap)      /* OUT */
+{
+   const mongoc_matcher_group_t *group;
+   mongoc_matcher_column_t column;
+   mongoc_matcher_op_t *op;
+   bson_iter_t *fields = NULL;
+   uint8_t *found = NULL;
+   uint8_t *pass;
+   bool loaded;
+   uint32_t n_groups;
+   uint32_t n_matched = 0;
+   uint32_t at;
+   uint32_t g;
+   uint32_t i;
+   uint32_t j;
+
+   BSON_ASSERT (matcher);
+   BSON_ASSERT (matcher->optree);
+   BSON_ASSERT (documents || !n_documents);
+   BSON_ASSERT (bitmap || !n_documents);
+
+   if (!n_documents) {
+      return 0;
+   }
+
+   memset (bitmap, 0, (n_documents + 7) / 8);
+
+   pass = (uint8_t *) bson_malloc (n_documents);
+   memset (pass, 1, n_documents);
+
+   n_groups = matcher->groups.len;
+
+   if (n_groups) {
+      fields = (bson_iter_t *) bson_malloc (
+         (size_t) n_groups * n_documents * sizeof (bson_iter_t));
+      found = (uint8_t *) bson_malloc0 ((size_t) n_groups * n_documents);
+      _mongoc_matcher_column_init (&column, n_documents);
+
+      _mongoc_matcher_locate ((const mongoc_matcher_group_t *)
+                                 matcher->groups.data,
+                              n_groups, documents, n_documents,
+                              fields, found);
+
+      for (g = 0; g < n_groups; g++) {
+         group = &_mongoc_array_index (&matcher->groups,
+                                       mongoc_matcher_group_t, g);
+         at = g * n_documents;
+         loaded = false;
+
+         for (j = 0; j < group->ops.len; j++) {
+            op = _mongoc_array_index (&group->ops, mongoc_matcher_op_t *, j);
+
+            if (_mongoc_matcher_column_op (op, group->key_len)) {
+               if (!loaded) {
+                  _mongoc_matcher_column_load (&column, &fields[at],
+                                               &found[at]);
+                  loaded = true;
+               }
+
+               _mongoc_matcher_column_match (op, &column, &fields[at], pass);
+               continue;
+            }
+
+            for (i = 0; i < n_documents; i++) {
+               if (pass[i] &&
+                   !_mongoc_matcher_field_op_match (
+                      op, group->key_len,
+                      found[at + i] ? &fields[at + i] : NULL)) {
+                  pass[i] = 0;
+               }
+            }
+         }
+      }
+
+      _mongoc_matcher_column_destroy (&column);
+      bson_free (found);
+      bson_free (fields);
+   }
+
+   for (i = 0; i < n_documents; i++) {
+      for (j = 0; pass[i] && j < matcher->residual.len; j++) {
+         if (!_mongoc_matcher_op_match (
+                _mongoc_array_index (&matcher->residual,
+                                     mongoc_matcher_op_t *, j),
+                documents[i])) {
+            pass[i] = 0;
+         }
+      }
+
+      if (pass[i]) {
+         bitmap[i / 8] |= (uint8_t) (1 << (i % 8));
+         n_matched++;
+      }
+   }
+
+   bson_free (pass);
+
+   return n_matched;
 }
 
 
@@ -399,8 +1301,19 @@ mongoc_matcher_match (const mongoc_matcher_t *matcher,  /* IN */
 void
 mongoc_matcher_destroy (mongoc_matcher_t *matcher) /* IN */
 {
+   mongoc_matcher_group_t *group;
+   uint32_t i;
+
    BSON_ASSERT (matcher);
 
+   for (i = 0; i < matcher->groups.len; i++) {
+      group = &_mongoc_array_index (&matcher->groups,
+                                    mongoc_matcher_group_t, i);
+      _mongoc_array_destroy (&group->ops);
+   }
+
+   _mongoc_array_destroy (&matcher->groups);
+   _mongoc_array_destroy (&matcher->residual);
    _mongoc_matcher_op_destroy (matcher->optree);
    bson_destroy (&matcher->query);
    bson_free (matcher);
@@ -37,6 +37,11 @@ BSON_API
 bool              mongoc_matcher_match   (const mongoc_matcher_t *matcher,
                                           const bson_t           *document)   BSON_GNUC_DEPRECATED;
 BSON_API
+uint32_t          mongoc_matcher_match_batch (const mongoc_matcher_t *matcher,
+                                              const bson_t * const   *documents,
+                                              uint32_t                n_documents,
+                                              uint8_t                *bitmap) BSON_GNUC_DEPRECATED;
+BSON_API
 void              mongoc_matcher_destroy (mongoc_matcher_t       *matcher)    BSON_GNUC_DEPRECATED;
 
 
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_MEMORY_PRIVATE_H
+#define MONGOC_MEMORY_PRIVATE_H
+
+#if !defined (MONGOC_COMPILATION)
+#error "Only <mongoc.h> can be included directly."
+#endif
+
+#include <bson.h>
+
+#include "mongoc-memory.h"
+
+
+BSON_BEGIN_DECLS
+
+
+/* who owns an allocation, each has "Memory" counters, see
+ * mongoc-counters.defs */
+typedef enum
+{
+   MONGOC_MEMORY_CLUSTER,
+   MONGOC_MEMORY_CURSOR,
+   MONGOC_MEMORY_GRIDFS,
+   MONGOC_MEMORY_BULK,
+   MONGOC_MEMORY_TOPOLOGY,
+   MONGOC_MEMORY_APM,
+   MONGOC_MEMORY_LAST
+} mongoc_memory_subsystem_t;
+
+
+void _mongoc_memory_init      (void);
+void _mongoc_memory_cleanup   (void);
+void _mongoc_memory_get_stats (mongoc_memory_subsystem_t  subsystem,
+                               int64_t                   *bytes,
+                               int64_t                   *allocs,
+                               int64_t                   *peak);
+
+
+/*
+ * With MONGOC_ENABLE_MEMORY_ACCOUNTING, memory from these macros has a
+ * header with its size and owner, so it must be freed with
+ * _mongoc_memory_free, never bson_free. Otherwise they are bson_malloc and
+ * friends. @sub is a mongoc_memory_subsystem_t without its prefix, like
+ * _mongoc_memory_malloc (CURSOR, sizeof *cursor).
+ */
+#ifdef MONGOC_ENABLE_MEMORY_ACCOUNTING
+
+extern const uint32_t _mongoc_memory_subsystems[MONGOC_MEMORY_LAST];
+
+void *_mongoc_memory_alloc_at   (mongoc_memory_subsystem_t  subsystem,
+                                 void                      *mem,
+                                 size_t                     size,
+                                 bool                       zero,
+                                 const char                *file,
+                                 int                        line);
+void  _mongoc_memory_release    (void                      *mem);
+void *_mongoc_memory_realloc_ctx (void                     *mem,
+                                  size_t                    num_bytes,
+                                  void                     *ctx);
+
+# define _mongoc_memory_malloc(sub, size) \
+   _mongoc_memory_alloc_at (MONGOC_MEMORY_##sub, NULL, (size), false, \
+                            __FILE__, __LINE__)
+# define _mongoc_memory_malloc0(sub, size) \
+   _mongoc_memory_alloc_at (MONGOC_MEMORY_##sub, NULL, (size), true, \
+                            __FILE__, __LINE__)
+# define _mongoc_memory_realloc(sub, mem, size) \
+   _mongoc_memory_alloc_at (MONGOC_MEMORY_##sub, (mem), (size), false, \
+                            __FILE__, __LINE__)
+# define _mongoc_memory_free(mem) _mongoc_memory_release (mem)
+
+/* for a mongoc_buffer_t that @sub owns */
+# define MONGOC_MEMORY_REALLOC_FUNC(sub) _mongoc_memory_realloc_ctx
+# define MONGOC_MEMORY_REALLOC_CTX(sub) \
+   ((void *) &_mongoc_memory_subsystems[MONGOC_MEMORY_##sub])
+
+#else
+
+# define _mongoc_memory_malloc(sub, size)       bson_malloc (size)
+# define _mongoc_memory_malloc0(sub, size)      bson_malloc0 (size)
+# define _mongoc_memory_realloc(sub, mem, size) bson_realloc ((mem), (size))
+# define _mongoc_memory_free(mem)               bson_free (mem)
+# define MONGOC_MEMORY_REALLOC_FUNC(sub)        NULL
+# define MONGOC_MEMORY_REALLOC_CTX(sub)         NULL
+
+#endif
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_MEMORY_PRIVATE_H */
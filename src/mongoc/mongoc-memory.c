@@ -0,0 +1,474 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <bson.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mongoc-counters-private.h"
+#include "mongoc-log.h"
+#include "mongoc-memory-private.h"
+#include "mongoc-thread-private.h"
+
+
+#undef MONGOC_LOG_DOMAIN
+#define MONGOC_LOG_DOMAIN "memory"
+
+
+/* the "Memory" counters of a subsystem */
+typedef struct
+{
+   const char       *name;
+   mongoc_counter_t *bytes;
+   uint32_t          bytes_slot;
+   mongoc_counter_t *allocs;
+   uint32_t          allocs_slot;
+   mongoc_counter_t *peak;
+   uint32_t          peak_slot;
+} mongoc_memory_counters_t;
+
+
+#define MEMORY_COUNTERS(ident) \
+   { #ident, \
+     &__mongoc_counter_mem_##ident##_bytes, \
+     COUNTER_mem_##ident##_bytes % SLOTS_PER_CACHELINE, \
+     &__mongoc_counter_mem_##ident##_allocs, \
+     COUNTER_mem_##ident##_allocs % SLOTS_PER_CACHELINE, \
+     &__mongoc_counter_mem_##ident##_peak, \
+     COUNTER_mem_##ident##_peak % SLOTS_PER_CACHELINE }
+
+static const mongoc_memory_counters_t gMemoryCounters[MONGOC_MEMORY_LAST] = {
+   MEMORY_COUNTERS (cluster),
+   MEMORY_COUNTERS (cursor),
+   MEMORY_COUNTERS (gridfs),
+   MEMORY_COUNTERS (bulk),
+   MEMORY_COUNTERS (topology),
+   MEMORY_COUNTERS (apm),
+};
+
+#undef MEMORY_COUNTERS
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_memory_get_stats --
+ *
+ *       Sum a subsystem's "Memory" counters over all CPUs.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       Sets @bytes, @allocs and @peak, all zero unless the driver was
+ *       built with MONGOC_ENABLE_MEMORY_ACCOUNTING.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_memory_get_stats (mongoc_memory_subsystem_t  subsystem,
+                          int64_t                   *bytes,
+                          int64_t                   *allocs,
+                          int64_t                   *peak)
+{
+   const mongoc_memory_counters_t *counters;
+   uint32_t i;
+
+   BSON_ASSERT (subsystem < MONGOC_MEMORY_LAST);
+
+   counters = &gMemoryCounters[subsystem];
+   *bytes = *allocs = *peak = 0;
+
+   if (!counters->bytes->cpus) {
+      return;
+   }
+
+   for (i = 0; i < _mongoc_get_cpu_count (); i++) {
+      *bytes += counters->bytes->cpus[i].slots[counters->bytes_slot];
+      *allocs += counters->allocs->cpus[i].slots[counters->allocs_slot];
+      *peak += counters->peak->cpus[i].slots[counters->peak_slot];
+   }
+}
+
+
+#ifdef MONGOC_ENABLE_MEMORY_ACCOUNTING
+
+/*
+ * Each allocation is preceded by a header, padded to keep the memory we
+ * return as aligned as malloc's.
+ */
+typedef struct
+{
+   size_t   size;
+   uint32_t subsystem;
+   uint32_t site;       /* its index in gSites plus one, or zero */
+} mongoc_memory_header_t;
+
+#define HEADER_SIZE 16
+
+BSON_STATIC_ASSERT (sizeof (mongoc_memory_header_t) <= HEADER_SIZE);
+
+#define HEADER(mem) \
+   ((mongoc_memory_header_t *) ((uint8_t *) (mem) - HEADER_SIZE))
+
+
+/* in debug mode, see MONGOC_MEMORY_SITES, allocations per file and line */
+typedef struct
+{
+   const char *file;
+   int         line;
+   uint32_t    subsystem;
+   int64_t     bytes;
+   int64_t     allocs;
+   int64_t     total_bytes;
+} mongoc_memory_site_t;
+
+#define MAX_SITES 4096
+
+const uint32_t _mongoc_memory_subsystems[MONGOC_MEMORY_LAST] = {
+   MONGOC_MEMORY_CLUSTER,
+   MONGOC_MEMORY_CURSOR,
+   MONGOC_MEMORY_GRIDFS,
+   MONGOC_MEMORY_BULK,
+   MONGOC_MEMORY_TOPOLOGY,
+   MONGOC_MEMORY_APM,
+};
+
+static bool                 gAccounting;
+static bool                 gSitesEnabled;
+static mongoc_mutex_t       gSitesMutex;
+static mongoc_memory_site_t gSites[MAX_SITES];
+static bool                 gSitesFull;
+
+
+static BSON_INLINE bool
+_mongoc_memory_cas (volatile int64_t *p,
+                    int64_t           old,
+                    int64_t           new_)
+{
+#if defined(__GNUC__)
+   return __sync_bool_compare_and_swap (p, old, new_);
+#elif defined(_WIN32)
+   return InterlockedCompareExchange64 (p, new_, old) == old;
+#else
+   /* racy, the peak may be a little low */
+   *p = new_;
+   return true;
+#endif
+}
+
+
+static void
+_mongoc_memory_account (uint32_t subsystem,
+                        int64_t  bytes,
+                        int64_t  allocs)
+{
+   const mongoc_memory_counters_t *counters = &gMemoryCounters[subsystem];
+   volatile int64_t *peak;
+   int64_t old_peak;
+   int64_t live;
+
+   if (!gAccounting) {
+      return;
+   }
+
+   /* the live bytes and peak are global, in the first CPU's slots, so
+    * each change can be compared to the peak */
+   live = bson_atomic_int64_add (
+      &counters->bytes->cpus[0].slots[counters->bytes_slot], bytes);
+
+   if (allocs) {
+      _mongoc_counter_add (
+         counters->allocs->cpus[_mongoc_sched_getcpu ()]
+            .slots[counters->allocs_slot], allocs);
+   }
+
+   peak = &counters->peak->cpus[0].slots[counters->peak_slot];
+   while (live > (old_peak = *peak)) {
+      if (_mongoc_memory_cas (peak, old_peak, live)) {
+         break;
+      }
+   }
+}
+
+
+/* find or add the site for @file and @line, returns its index plus one,
+ * or zero if the table is full */
+static uint32_t
+_mongoc_memory_site (uint32_t    subsystem,
+                     const char *file,
+                     int         line,
+                     int64_t     bytes)
+{
+   mongoc_memory_site_t *site;
+   uint32_t start;
+   uint32_t i;
+
+   if (!gSitesEnabled) {
+      return 0;
+   }
+
+   start = (uint32_t) (((uintptr_t) file >> 3) ^
+                       ((uint32_t) line * 2654435761u) ^ subsystem);
+
+   mongoc_mutex_lock (&gSitesMutex);
+
+   for (i = 0; i < MAX_SITES; i++) {
+      site = &gSites[(start + i) % MAX_SITES];
+
+      if (!site->file) {
+         site->file = file;
+         site->line = line;
+         site->subsystem = subsystem;
+      } else if (site->file != file || site->line != line ||
+                 site->subsystem != subsystem) {
+         continue;
+      }
+
+      site->bytes += bytes;
+      site->allocs++;
+      site->total_bytes += bytes;
+      mongoc_mutex_unlock (&gSitesMutex);
+
+      return (uint32_t) (site - gSites) + 1;
+   }
+
+   if (!gSitesFull) {
+      gSitesFull = true;
+      MONGOC_WARNING ("More than %d allocation sites, ignoring new ones",
+                      MAX_SITES);
+   }
+
+   mongoc_mutex_unlock (&gSitesMutex);
+
+   return 0;
+}
+
+
+static void
+_mongoc_memory_site_release (uint32_t site,
+                             int64_t  bytes)
+{
+   if (site && gSitesEnabled) {
+      mongoc_mutex_lock (&gSitesMutex);
+      gSites[site - 1].bytes -= bytes;
+      mongoc_mutex_unlock (&gSitesMutex);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_memory_alloc_at --
+ *
+ *       Allocate @size bytes for @subsystem, or resize @mem to @size bytes
+ *       if @mem is not NULL, like bson_realloc. @file and @line are the
+ *       caller's, for mongoc_memory_dump_sites.
+ *
+ * Returns:
+ *       The memory, which must be freed with _mongoc_memory_free, or NULL
+ *       if @size is zero.
+ *
+ * Side effects:
+ *       Aborts if out of memory, like bson_malloc.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void *
+_mongoc_memory_alloc_at (mongoc_memory_subsystem_t  subsystem,
+                         void                      *mem,
+                         size_t                     size,
+                         bool                       zero,
+                         const char                *file,
+                         int                        line)
+{
+   mongoc_memory_header_t *header = NULL;
+
+   BSON_ASSERT (subsystem < MONGOC_MEMORY_LAST);
+   BSON_ASSERT (size <= SIZE_MAX - HEADER_SIZE);
+
+   if (mem) {
+      header = HEADER (mem);
+      _mongoc_memory_site_release (header->site, (int64_t) header->size);
+      _mongoc_memory_account (header->subsystem, -(int64_t) header->size, 0);
+   }
+
+   if (!size) {
+      bson_free (header);
+      return NULL;
+   }
+
+   header = (mongoc_memory_header_t *) bson_realloc (header,
+                                                     HEADER_SIZE + size);
+   mem = (uint8_t *) header + HEADER_SIZE;
+
+   if (zero) {
+      memset (mem, 0, size);
+   }
+
+   header->size = size;
+   header->subsystem = subsystem;
+   header->site = _mongoc_memory_site (subsystem, file, line, (int64_t) size);
+   _mongoc_memory_account (subsystem, (int64_t) size, 1);
+
+   return mem;
+}
+
+
+void
+_mongoc_memory_release (void *mem)
+{
+   mongoc_memory_header_t *header;
+
+   if (mem) {
+      header = HEADER (mem);
+      _mongoc_memory_site_release (header->site, (int64_t) header->size);
+      _mongoc_memory_account (header->subsystem, -(int64_t) header->size, 0);
+      bson_free (header);
+   }
+}
+
+
+/* a bson_realloc_func for mongoc_buffer_t, see MONGOC_MEMORY_REALLOC_CTX */
+void *
+_mongoc_memory_realloc_ctx (void   *mem,
+                            size_t  num_bytes,
+                            void   *ctx)
+{
+   BSON_ASSERT (ctx);
+
+   return _mongoc_memory_alloc_at (
+      (mongoc_memory_subsystem_t) *(const uint32_t *) ctx, mem, num_bytes,
+      false, "(buffer)", 0);
+}
+
+
+static int
+_mongoc_memory_cmp_sites (const void *a,
+                          const void *b)
+{
+   const mongoc_memory_site_t *x = (const mongoc_memory_site_t *) a;
+   const mongoc_memory_site_t *y = (const mongoc_memory_site_t *) b;
+
+   if (x->bytes != y->bytes) {
+      return x->bytes > y->bytes ? -1 : 1;
+   }
+
+   if (x->total_bytes != y->total_bytes) {
+      return x->total_bytes > y->total_bytes ? -1 : 1;
+   }
+
+   return 0;
+}
+
+#endif /* MONGOC_ENABLE_MEMORY_ACCOUNTING */
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_memory_dump_sites --
+ *
+ *       Print up to @max_sites allocation sites to @stream, most live bytes
+ *       first, if the driver was built with memory accounting and the
+ *       MONGOC_MEMORY_SITES environment variable was set when it was
+ *       initialized.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+mongoc_memory_dump_sites (FILE     *stream,
+                          uint32_t  max_sites)
+{
+#ifdef MONGOC_ENABLE_MEMORY_ACCOUNTING
+   mongoc_memory_site_t *sites;
+   uint32_t n = 0;
+   uint32_t i;
+
+   BSON_ASSERT (stream);
+
+   if (!gSitesEnabled) {
+      return;
+   }
+
+   sites = (mongoc_memory_site_t *) bson_malloc (sizeof gSites);
+
+   mongoc_mutex_lock (&gSitesMutex);
+   for (i = 0; i < MAX_SITES; i++) {
+      if (gSites[i].file) {
+         sites[n++] = gSites[i];
+      }
+   }
+   mongoc_mutex_unlock (&gSitesMutex);
+
+   qsort (sites, n, sizeof *sites, _mongoc_memory_cmp_sites);
+
+   fprintf (stream, "%14s %10s %14s  %-9s %s\n",
+            "live bytes", "allocs", "total bytes", "subsystem", "site");
+
+   for (i = 0; i < n && i < max_sites; i++) {
+      fprintf (stream, "%14" PRId64 " %10" PRId64 " %14" PRId64 "  %-9s %s:%d\n",
+               sites[i].bytes, sites[i].allocs, sites[i].total_bytes,
+               gMemoryCounters[sites[i].subsystem].name, sites[i].file,
+               sites[i].line);
+   }
+
+   fflush (stream);
+   bson_free (sites);
+#endif
+}
+
+
+void
+_mongoc_memory_init (void)
+{
+#ifdef MONGOC_ENABLE_MEMORY_ACCOUNTING
+   mongoc_mutex_init (&gSitesMutex);
+   gSitesEnabled = getenv ("MONGOC_MEMORY_SITES") != NULL;
+   gAccounting = true;
+#endif
+}
+
+
+/* with MONGOC_MEMORY_SITES=n, print the top n sites, say leaks, at exit */
+void
+_mongoc_memory_cleanup (void)
+{
+#ifdef MONGOC_ENABLE_MEMORY_ACCOUNTING
+   const char *max_sites = getenv ("MONGOC_MEMORY_SITES");
+
+   if (gSitesEnabled && max_sites && atoi (max_sites) > 0) {
+      mongoc_memory_dump_sites (stderr, (uint32_t) atoi (max_sites));
+   }
+
+   /* the counters are about to be freed */
+   gAccounting = false;
+   gSitesEnabled = false;
+   memset (gSites, 0, sizeof gSites);
+   mongoc_mutex_destroy (&gSitesMutex);
+#endif
+}
@@ -28,6 +28,9 @@
 
 #include "mongoc-ssl.h"
 
+/* how many hosts' TLS sessions are kept for resumption */
+#define MONGOC_OPENSSL_SESSION_CACHE_SIZE 64
+
 
 BSON_BEGIN_DECLS
 
@@ -40,6 +43,11 @@ char    *_mongoc_openssl_extract_subject (const char       *filename,
                                           const char *passphrase);
 void     _mongoc_openssl_init            (void);
 void     _mongoc_openssl_cleanup         (void);
+void     _mongoc_openssl_session_resume  (SSL              *ssl,
+                                          const char       *key);
+void     _mongoc_openssl_session_save    (SSL_SESSION      *session,
+                                          const char       *key);
+void     _mongoc_openssl_session_clear   (void);
 
 
 BSON_END_DECLS
@@ -40,6 +40,19 @@
 #include <wincrypt.h>
 #endif
 
+/* Client sessions for resumption, so reconnecting to a host costs an
+ * abbreviated handshake instead of a full one. Each stream has its own
+ * SSL_CTX, so we can't use OpenSSL's per-context session cache. */
+typedef struct
+{
+   char        *key;
+   SSL_SESSION *session;
+} mongoc_openssl_session_t;
+
+static mongoc_mutex_t gMongocOpenSslSessionsMutex;
+static mongoc_openssl_session_t gMongocOpenSslSessions[MONGOC_OPENSSL_SESSION_CACHE_SIZE];
+static int gMongocOpenSslSessionsNext;
+
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
 static mongoc_mutex_t * gMongocOpenSslThreadLocks;
 
@@ -68,6 +81,8 @@ _mongoc_openssl_init (void)
    _mongoc_openssl_thread_startup ();
 #endif
 
+   mongoc_mutex_init (&gMongocOpenSslSessionsMutex);
+
    /*
     * Ensure we also load the ciphers now from the primary thread
     * or we can run into some weirdness on 64-bit Solaris 10 on
@@ -84,11 +99,110 @@ _mongoc_openssl_init (void)
 void
 _mongoc_openssl_cleanup (void)
 {
+   _mongoc_openssl_session_clear ();
+   mongoc_mutex_destroy (&gMongocOpenSslSessionsMutex);
+
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
    _mongoc_openssl_thread_cleanup ();
 #endif
 }
 
+/**
+ * _mongoc_openssl_session_resume:
+ *
+ * Offer the session last saved with @key, if any, in @ssl's next
+ * handshake. @key must identify the host and every option that affects
+ * certificate verification: resuming a session skips verification.
+ */
+void
+_mongoc_openssl_session_resume (SSL        *ssl,
+                                const char *key)
+{
+   int i;
+
+   mongoc_mutex_lock (&gMongocOpenSslSessionsMutex);
+
+   for (i = 0; i < MONGOC_OPENSSL_SESSION_CACHE_SIZE; i++) {
+      if (gMongocOpenSslSessions[i].key &&
+          !strcmp (gMongocOpenSslSessions[i].key, key)) {
+         /* takes its own reference */
+         SSL_set_session (ssl, gMongocOpenSslSessions[i].session);
+         break;
+      }
+   }
+
+   mongoc_mutex_unlock (&gMongocOpenSslSessionsMutex);
+}
+
+/**
+ * _mongoc_openssl_session_save:
+ *
+ * Save @session under @key after a verified handshake, replacing the
+ * session saved with @key or else the oldest one. Takes ownership of
+ * the caller's reference to @session.
+ */
+void
+_mongoc_openssl_session_save (SSL_SESSION *session,
+                              const char  *key)
+{
+   mongoc_openssl_session_t *entry = NULL;
+   int i;
+
+   mongoc_mutex_lock (&gMongocOpenSslSessionsMutex);
+
+   for (i = 0; i < MONGOC_OPENSSL_SESSION_CACHE_SIZE; i++) {
+      if (gMongocOpenSslSessions[i].key &&
+          !strcmp (gMongocOpenSslSessions[i].key, key)) {
+         entry = &gMongocOpenSslSessions[i];
+         break;
+      }
+   }
+
+   if (!entry) {
+      entry = &gMongocOpenSslSessions[gMongocOpenSslSessionsNext];
+      gMongocOpenSslSessionsNext = (gMongocOpenSslSessionsNext + 1) %
+                                   MONGOC_OPENSSL_SESSION_CACHE_SIZE;
+
+      bson_free (entry->key);
+      entry->key = bson_strdup (key);
+   }
+
+   if (entry->session) {
+      SSL_SESSION_free (entry->session);
+   }
+
+   entry->session = session;
+
+   mongoc_mutex_unlock (&gMongocOpenSslSessionsMutex);
+}
+
+/**
+ * _mongoc_openssl_session_clear:
+ *
+ * Forget all saved sessions.
+ */
+void
+_mongoc_openssl_session_clear (void)
+{
+   int i;
+
+   mongoc_mutex_lock (&gMongocOpenSslSessionsMutex);
+
+   for (i = 0; i < MONGOC_OPENSSL_SESSION_CACHE_SIZE; i++) {
+      bson_free (gMongocOpenSslSessions[i].key);
+      gMongocOpenSslSessions[i].key = NULL;
+
+      if (gMongocOpenSslSessions[i].session) {
+         SSL_SESSION_free (gMongocOpenSslSessions[i].session);
+         gMongocOpenSslSessions[i].session = NULL;
+      }
+   }
+
+   gMongocOpenSslSessionsNext = 0;
+
+   mongoc_mutex_unlock (&gMongocOpenSslSessionsMutex);
+}
+
 static int
 _mongoc_openssl_password_cb (char *buf,
                              int   num,
@@ -61,6 +61,12 @@ BSON_BEGIN_DECLS
 #pragma pack()
 
 
+/* OP_MSG of wire version 6, not the obsolete MONGOC_OPCODE_MSG. We only
+ * send it, with one body section, for unacknowledged commands */
+#define MONGOC_OPCODE_OP_MSG 2013
+#define MONGOC_OP_MSG_MORE_TO_COME (1u << 1)
+
+
 typedef union
 {
    mongoc_rpc_delete_t       delete_;
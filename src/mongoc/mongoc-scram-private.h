@@ -32,6 +32,9 @@ BSON_BEGIN_DECLS
 
 #define MONGOC_SCRAM_HASH_SIZE 20
 
+/* how many sets of derived keys are kept for reuse across connections */
+#define MONGOC_SCRAM_CACHE_SIZE 16
+
 typedef struct _mongoc_scram_t
 {
    bool                done;
@@ -39,6 +42,9 @@ typedef struct _mongoc_scram_t
    char               *user;
    char               *pass;
    uint8_t             salted_password[MONGOC_SCRAM_HASH_SIZE];
+   uint8_t             client_key[MONGOC_SCRAM_HASH_SIZE];
+   uint8_t             server_key[MONGOC_SCRAM_HASH_SIZE];
+   bool                cache_hit;
    char                encoded_nonce[48];
    int32_t             encoded_nonce_len;
    uint8_t            *auth_message;
@@ -52,6 +58,12 @@ typedef struct _mongoc_scram_t
 void
 _mongoc_scram_startup();
 
+void
+_mongoc_scram_cleanup (void);
+
+void
+_mongoc_scram_cache_clear (void);
+
 void
 _mongoc_scram_init (mongoc_scram_t *scram);
 
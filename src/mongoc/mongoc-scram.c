@@ -22,6 +22,7 @@
 #include "mongoc-error.h"
 #include "mongoc-scram-private.h"
 #include "mongoc-rand-private.h"
+#include "mongoc-thread-private.h"
 #include "mongoc-util-private.h"
 
 #include "mongoc-crypto-private.h"
@@ -37,11 +38,134 @@
 #define MONGOC_SCRAM_B64_HASH_SIZE \
    MONGOC_SCRAM_B64_ENCODED_SIZE (MONGOC_SCRAM_HASH_SIZE)
 
+#define MONGOC_SCRAM_SALT_SIZE 16
+
+
+/* Keys derived from a password by thousands of HMAC iterations, kept so
+ * new connections with the same credentials skip the derivation. An entry
+ * is keyed by everything the derivation depends on: the hashed password
+ * (which includes the user name), the salt and the iteration count. */
+typedef struct
+{
+   char    *hashed_password;
+   uint8_t  salt[MONGOC_SCRAM_SALT_SIZE];
+   uint32_t iterations;
+   uint8_t  salted_password[MONGOC_SCRAM_HASH_SIZE];
+   uint8_t  client_key[MONGOC_SCRAM_HASH_SIZE];
+   uint8_t  server_key[MONGOC_SCRAM_HASH_SIZE];
+} mongoc_scram_cache_entry_t;
+
+static mongoc_mutex_t gScramCacheMutex;
+static mongoc_scram_cache_entry_t gScramCache[MONGOC_SCRAM_CACHE_SIZE];
+static int gScramCacheNext;
+
 
 void
 _mongoc_scram_startup()
 {
    mongoc_b64_initialize_rmap();
+   mongoc_mutex_init (&gScramCacheMutex);
+}
+
+
+void
+_mongoc_scram_cleanup (void)
+{
+   _mongoc_scram_cache_clear ();
+   mongoc_mutex_destroy (&gScramCacheMutex);
+}
+
+
+static void
+_mongoc_scram_cache_entry_clear (mongoc_scram_cache_entry_t *entry)
+{
+   if (entry->hashed_password) {
+      bson_zero_free (entry->hashed_password,
+                      strlen (entry->hashed_password));
+   }
+
+   memset (entry, 0, sizeof *entry);
+}
+
+
+void
+_mongoc_scram_cache_clear (void)
+{
+   int i;
+
+   mongoc_mutex_lock (&gScramCacheMutex);
+
+   for (i = 0; i < MONGOC_SCRAM_CACHE_SIZE; i++) {
+      _mongoc_scram_cache_entry_clear (&gScramCache[i]);
+   }
+
+   gScramCacheNext = 0;
+
+   mongoc_mutex_unlock (&gScramCacheMutex);
+}
+
+
+/* copy cached keys for these credentials into @scram, if there are any */
+static bool
+_mongoc_scram_cache_get (mongoc_scram_t *scram,
+                         const char     *hashed_password,
+                         const uint8_t  *salt,
+                         uint32_t        iterations)
+{
+   mongoc_scram_cache_entry_t *entry;
+   bool found = false;
+   int i;
+
+   mongoc_mutex_lock (&gScramCacheMutex);
+
+   for (i = 0; i < MONGOC_SCRAM_CACHE_SIZE; i++) {
+      entry = &gScramCache[i];
+
+      if (entry->hashed_password &&
+          entry->iterations == iterations &&
+          !strcmp (entry->hashed_password, hashed_password) &&
+          !memcmp (entry->salt, salt, MONGOC_SCRAM_SALT_SIZE)) {
+         memcpy (scram->salted_password, entry->salted_password,
+                 MONGOC_SCRAM_HASH_SIZE);
+         memcpy (scram->client_key, entry->client_key,
+                 MONGOC_SCRAM_HASH_SIZE);
+         memcpy (scram->server_key, entry->server_key,
+                 MONGOC_SCRAM_HASH_SIZE);
+         found = true;
+         break;
+      }
+   }
+
+   mongoc_mutex_unlock (&gScramCacheMutex);
+
+   return found;
+}
+
+
+/* remember @scram's keys, replacing the oldest entry if the cache is full */
+static void
+_mongoc_scram_cache_put (mongoc_scram_t *scram,
+                         const char     *hashed_password,
+                         const uint8_t  *salt,
+                         uint32_t        iterations)
+{
+   mongoc_scram_cache_entry_t *entry;
+
+   mongoc_mutex_lock (&gScramCacheMutex);
+
+   entry = &gScramCache[gScramCacheNext];
+   gScramCacheNext = (gScramCacheNext + 1) % MONGOC_SCRAM_CACHE_SIZE;
+
+   _mongoc_scram_cache_entry_clear (entry);
+   entry->hashed_password = bson_strdup (hashed_password);
+   memcpy (entry->salt, salt, MONGOC_SCRAM_SALT_SIZE);
+   entry->iterations = iterations;
+   memcpy (entry->salted_password, scram->salted_password,
+           MONGOC_SCRAM_HASH_SIZE);
+   memcpy (entry->client_key, scram->client_key, MONGOC_SCRAM_HASH_SIZE);
+   memcpy (entry->server_key, scram->server_key, MONGOC_SCRAM_HASH_SIZE);
+
+   mongoc_mutex_unlock (&gScramCacheMutex);
 }
 
 
@@ -93,6 +217,10 @@ _mongoc_scram_destroy (mongoc_scram_t *scram)
    }
 
    bson_free (scram->auth_message);
+
+   memset (scram->salted_password, 0, sizeof scram->salted_password);
+   memset (scram->client_key, 0, sizeof scram->client_key);
+   memset (scram->server_key, 0, sizeof scram->server_key);
 }
 
 
@@ -300,27 +428,41 @@ _mongoc_scram_salt_password (mongoc_scram_t *scram,
 }
 
 
+/* Compute ClientKey and ServerKey from the salted password */
+static void
+_mongoc_scram_derive_keys (mongoc_scram_t *scram)
+{
+   /* ClientKey := HMAC(saltedPassword, "Client Key") */
+   mongoc_crypto_hmac_sha1 (&scram->crypto,
+                            scram->salted_password,
+                            MONGOC_SCRAM_HASH_SIZE,
+                            (uint8_t *)MONGOC_SCRAM_CLIENT_KEY,
+                            strlen (MONGOC_SCRAM_CLIENT_KEY),
+                            scram->client_key);
+
+   /* ServerKey := HMAC(SaltedPassword, "Server Key") */
+   mongoc_crypto_hmac_sha1 (&scram->crypto,
+                            scram->salted_password,
+                            MONGOC_SCRAM_HASH_SIZE,
+                            (uint8_t *)MONGOC_SCRAM_SERVER_KEY,
+                            strlen (MONGOC_SCRAM_SERVER_KEY),
+                            scram->server_key);
+}
+
+
 static bool
 _mongoc_scram_generate_client_proof (mongoc_scram_t *scram,
                                      uint8_t        *outbuf,
                                      uint32_t        outbufmax,
                                      uint32_t       *outbuflen)
 {
-   uint8_t client_key[MONGOC_SCRAM_HASH_SIZE];
+   uint8_t *client_key = scram->client_key;
    uint8_t stored_key[MONGOC_SCRAM_HASH_SIZE];
    uint8_t client_signature[MONGOC_SCRAM_HASH_SIZE];
    unsigned char client_proof[MONGOC_SCRAM_HASH_SIZE];
    int i;
    int r = 0;
 
-   /* ClientKey := HMAC(saltedPassword, "Client Key") */
-   mongoc_crypto_hmac_sha1 (&scram->crypto,
-                            scram->salted_password,
-                            MONGOC_SCRAM_HASH_SIZE,
-                            (uint8_t *)MONGOC_SCRAM_CLIENT_KEY,
-                            strlen (MONGOC_SCRAM_CLIENT_KEY),
-                            client_key);
-
    /* StoredKey := H(client_key) */
    mongoc_crypto_sha1 (&scram->crypto, client_key, MONGOC_SCRAM_HASH_SIZE, stored_key);
 
@@ -538,7 +680,7 @@ _mongoc_scram_step2 (mongoc_scram_t *scram,
       goto FAIL;
    }
 
-   if (16 != decoded_salt_len) {
+   if (MONGOC_SCRAM_SALT_SIZE != decoded_salt_len) {
       bson_set_error (error,
                       MONGOC_ERROR_SCRAM,
                       MONGOC_ERROR_SCRAM_PROTOCOL_ERROR,
@@ -559,9 +701,18 @@ _mongoc_scram_step2 (mongoc_scram_t *scram,
       goto FAIL;
    }
 
-   _mongoc_scram_salt_password (scram, hashed_password, (uint32_t) strlen (
-                                   hashed_password), decoded_salt, decoded_salt_len,
-                                iterations);
+   scram->cache_hit = _mongoc_scram_cache_get (scram, hashed_password,
+                                               decoded_salt,
+                                               (uint32_t) iterations);
+
+   if (!scram->cache_hit) {
+      _mongoc_scram_salt_password (scram, hashed_password, (uint32_t) strlen (
+                                      hashed_password), decoded_salt, decoded_salt_len,
+                                   iterations);
+      _mongoc_scram_derive_keys (scram);
+      _mongoc_scram_cache_put (scram, hashed_password, decoded_salt,
+                               (uint32_t) iterations);
+   }
 
    _mongoc_scram_generate_client_proof (scram, outbuf, outbufmax, outbuflen);
 
@@ -604,22 +755,13 @@ _mongoc_scram_verify_server_signature (mongoc_scram_t *scram,
                                        uint8_t        *verification,
                                        uint32_t        len)
 {
-   uint8_t server_key[MONGOC_SCRAM_HASH_SIZE];
    char encoded_server_signature[MONGOC_SCRAM_B64_HASH_SIZE];
    int32_t encoded_server_signature_len;
    uint8_t server_signature[MONGOC_SCRAM_HASH_SIZE];
 
-   /* ServerKey := HMAC(SaltedPassword, "Server Key") */
-   mongoc_crypto_hmac_sha1 (&scram->crypto,
-                            scram->salted_password,
-                            MONGOC_SCRAM_HASH_SIZE,
-                            (uint8_t *)MONGOC_SCRAM_SERVER_KEY,
-                            strlen (MONGOC_SCRAM_SERVER_KEY),
-                            server_key);
-
    /* ServerSignature := HMAC(ServerKey, AuthMessage) */
    mongoc_crypto_hmac_sha1 (&scram->crypto,
-                            server_key,
+                            scram->server_key,
                             MONGOC_SCRAM_HASH_SIZE,
                             scram->auth_message,
                             scram->auth_messagelen,
@@ -29,6 +29,9 @@
 /* represent a server or topology with no replica set config version */
 #define MONGOC_NO_SET_VERSION -1
 
+/* number of recent operation latencies kept per server for percentiles */
+#define MONGOC_SERVER_LOAD_SAMPLES 64
+
 typedef enum
    {
       MONGOC_SERVER_UNKNOWN,
@@ -43,6 +46,20 @@ typedef enum
       MONGOC_SERVER_DESCRIPTION_TYPES,
    } mongoc_server_description_type_t;
 
+/* Operation load observed by this client, not by the heartbeat monitor. Only
+ * maintained when a server selection policy is set. */
+typedef struct _mongoc_server_load_t
+{
+   int32_t  in_flight;
+   int64_t  samples_usec[MONGOC_SERVER_LOAD_SAMPLES];
+   uint32_t n_samples;
+   uint32_t next_sample;
+   uint64_t n_recorded;      /* samples ever recorded */
+   uint64_t percentiles_of;  /* n_recorded when p50 and p99 were computed */
+   int64_t  p50_usec;
+   int64_t  p99_usec;
+} mongoc_server_load_t;
+
 struct _mongoc_server_description_t
 {
    uint32_t                         id;
@@ -53,6 +70,7 @@ struct _mongoc_server_description_t
    bool                             has_is_master;
    const char                      *connection_address;
    const char                      *me;
+   mongoc_server_load_t             load;
 
    /* The following fields are filled from the last_is_master and are zeroed on
     * parse.  So order matters here.  DON'T move set_name */
@@ -111,6 +129,28 @@ void
 mongoc_server_description_update_rtt (mongoc_server_description_t *server,
                                       int64_t                      rtt_msec);
 
+void
+mongoc_server_description_op_started (mongoc_server_description_t *sd);
+
+uint32_t
+mongoc_server_description_op_finished (mongoc_server_description_t *sd,
+                                       int64_t                      duration_usec,
+                                       bool                         succeeded,
+                                       int64_t                     *samples_usec,
+                                       uint64_t                    *version);
+
+void
+mongoc_server_load_percentiles (int64_t  *samples_usec,
+                                uint32_t  n_samples,
+                                int64_t  *p50_usec,
+                                int64_t  *p99_usec);
+
+void
+mongoc_server_description_set_load_percentiles (mongoc_server_description_t *sd,
+                                                int64_t                      p50_usec,
+                                                int64_t                      p99_usec,
+                                                uint64_t                     version);
+
 void
 mongoc_server_description_handle_ismaster (mongoc_server_description_t   *sd,
                                            const bson_t                  *reply,
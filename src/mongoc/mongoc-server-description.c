@@ -25,6 +25,7 @@
 #include "mongoc-util-private.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #define ALPHA 0.2
 
@@ -120,6 +121,8 @@ mongoc_server_description_init (mongoc_server_description_t *sd,
    sd->max_bson_obj_size = MONGOC_DEFAULT_BSON_OBJ_SIZE;
    sd->max_write_batch_size = MONGOC_DEFAULT_WRITE_BATCH_SIZE;
    sd->last_write_date_ms = -1;
+   sd->load.p50_usec = -1;
+   sd->load.p99_usec = -1;
 
    bson_init_static (&sd->hosts, kMongocEmptyBson, sizeof (kMongocEmptyBson));
    bson_init_static (&sd->passives, kMongocEmptyBson, sizeof (kMongocEmptyBson));
@@ -300,6 +303,68 @@ mongoc_server_description_round_trip_time (const mongoc_server_description_t *de
    return description->round_trip_time_msec;
 }
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_server_description_in_flight --
+ *
+ *      Get the number of operations this client currently has running on
+ *      this server. Only maintained while a server selection policy is set,
+ *      see mongoc_client_set_server_selection_policy.
+ *
+ * Returns:
+ *      The number of in-flight operations.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+int32_t
+mongoc_server_description_in_flight (const mongoc_server_description_t *description)
+{
+   return description->load.in_flight;
+}
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_server_description_latency_p50 --
+ *
+ *      Get the median duration of recent commands this client ran on this
+ *      server. Unlike mongoc_server_description_round_trip_time, this
+ *      measures real operations, not heartbeats.
+ *
+ * Returns:
+ *      The median latency in microseconds, or -1 if there are no samples.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+int64_t
+mongoc_server_description_latency_p50 (const mongoc_server_description_t *description)
+{
+   return description->load.p50_usec;
+}
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_server_description_latency_p99 --
+ *
+ *      Get the 99th percentile duration of recent commands this client ran
+ *      on this server.
+ *
+ * Returns:
+ *      The latency in microseconds, or -1 if there are no samples.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+int64_t
+mongoc_server_description_latency_p99 (const mongoc_server_description_t *description)
+{
+   return description->load.p99_usec;
+}
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -447,6 +512,141 @@ mongoc_server_description_update_rtt (mongoc_server_description_t *server,
 }
 
 
+/*
+ *-------------------------------------------------------------------------
+ *
+ * mongoc_server_description_op_started --
+ *
+ *       Record that an operation was sent to this server.
+ *
+ *       NOTE: @sd must be the topology's own server description, and the
+ *       caller must hold the topology mutex.
+ *
+ *-------------------------------------------------------------------------
+ */
+void
+mongoc_server_description_op_started (mongoc_server_description_t *sd)
+{
+   sd->load.in_flight++;
+}
+
+
+static int
+_cmp_int64 (const void *a,
+            const void *b)
+{
+   int64_t x = *(const int64_t *) a;
+   int64_t y = *(const int64_t *) b;
+
+   return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+
+/*
+ *-------------------------------------------------------------------------
+ *
+ * mongoc_server_description_op_finished --
+ *
+ *       Record that an operation on this server completed. Successful
+ *       operations' durations are added to a ring of recent samples.
+ *
+ *       NOTE: @sd must be the topology's own server description, and the
+ *       caller must hold the topology mutex.
+ *
+ * Returns:
+ *       The number of samples copied to @samples_usec, which must hold
+ *       MONGOC_SERVER_LOAD_SAMPLES, or 0 if the operation failed. The
+ *       caller computes the percentiles with
+ *       mongoc_server_load_percentiles after releasing the mutex, and
+ *       passes @version to mongoc_server_description_set_load_percentiles.
+ *
+ *-------------------------------------------------------------------------
+ */
+uint32_t
+mongoc_server_description_op_finished (mongoc_server_description_t *sd,
+                                       int64_t                      duration_usec,
+                                       bool                         succeeded,
+                                       int64_t                     *samples_usec,
+                                       uint64_t                    *version)
+{
+   mongoc_server_load_t *load = &sd->load;
+
+   if (load->in_flight > 0) {
+      load->in_flight--;
+   }
+
+   if (!succeeded) {
+      return 0;
+   }
+
+   load->samples_usec[load->next_sample] = duration_usec;
+   load->next_sample = (load->next_sample + 1) % MONGOC_SERVER_LOAD_SAMPLES;
+   if (load->n_samples < MONGOC_SERVER_LOAD_SAMPLES) {
+      load->n_samples++;
+   }
+
+   *version = ++load->n_recorded;
+   memcpy (samples_usec, load->samples_usec,
+           load->n_samples * sizeof (int64_t));
+
+   return load->n_samples;
+}
+
+
+/*
+ *-------------------------------------------------------------------------
+ *
+ * mongoc_server_load_percentiles --
+ *
+ *       Sort @samples_usec in place and find their p50 and p99.
+ *
+ *-------------------------------------------------------------------------
+ */
+void
+mongoc_server_load_percentiles (int64_t  *samples_usec,
+                                uint32_t  n_samples,
+                                int64_t  *p50_usec,
+                                int64_t  *p99_usec)
+{
+   BSON_ASSERT (n_samples > 0);
+
+   qsort (samples_usec, n_samples, sizeof (int64_t), _cmp_int64);
+
+   *p50_usec = samples_usec[n_samples / 2];
+   *p99_usec = samples_usec[(n_samples * 99) / 100];
+}
+
+
+/*
+ *-------------------------------------------------------------------------
+ *
+ * mongoc_server_description_set_load_percentiles --
+ *
+ *       Cache the percentiles from mongoc_server_load_percentiles, of
+ *       the samples copied at @version. Percentiles of older samples,
+ *       from a thread that sorted more slowly, don't replace newer ones.
+ *
+ *       NOTE: @sd must be the topology's own server description, and the
+ *       caller must hold the topology mutex.
+ *
+ *-------------------------------------------------------------------------
+ */
+void
+mongoc_server_description_set_load_percentiles (mongoc_server_description_t *sd,
+                                                int64_t                      p50_usec,
+                                                int64_t                      p99_usec,
+                                                uint64_t                     version)
+{
+   if (version <= sd->load.percentiles_of) {
+      return;
+   }
+
+   sd->load.percentiles_of = version;
+   sd->load.p50_usec = p50_usec;
+   sd->load.p99_usec = p99_usec;
+}
+
+
 static void
 _mongoc_server_description_set_error (mongoc_server_description_t *sd,
                                       const bson_error_t          *error)
@@ -672,8 +872,9 @@ mongoc_server_description_new_copy (const mongoc_server_description_t *descripti
          description->round_trip_time_msec, &description->error);
    }
 
-   /* Preserve the error */
+   /* Preserve the error and the load statistics */
    memcpy (&copy->error, &description->error, sizeof copy->error);
+   memcpy (&copy->load, &description->load, sizeof copy->load);
    return copy;
 }
 
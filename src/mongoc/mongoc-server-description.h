@@ -24,6 +24,23 @@
 
 typedef struct _mongoc_server_description_t mongoc_server_description_t;
 
+/**
+ * mongoc_server_selection_policy_t:
+ * @candidates: The servers suitable for the operation, already filtered by
+ *              read preference and the latency window.
+ * @n_candidates: The number of candidates, always at least one.
+ * @context: The pointer passed when the policy was set.
+ *
+ * Chooses among suitable servers instead of the default uniformly random
+ * choice. Called with the topology locked: it must not block or call back
+ * into the driver.
+ *
+ * Returns: One of @candidates, or NULL to fall back to a random choice.
+ */
+typedef mongoc_server_description_t *(*mongoc_server_selection_policy_t) (mongoc_server_description_t **candidates,
+                                                                          size_t                        n_candidates,
+                                                                          void                         *context);
+
 BSON_API
 void
 mongoc_server_description_destroy (mongoc_server_description_t *description);
@@ -44,6 +61,24 @@ BSON_API
 int64_t
 mongoc_server_description_round_trip_time (const mongoc_server_description_t *description);
 
+BSON_API
+int32_t
+mongoc_server_description_in_flight (const mongoc_server_description_t *description);
+
+BSON_API
+int64_t
+mongoc_server_description_latency_p50 (const mongoc_server_description_t *description);
+
+BSON_API
+int64_t
+mongoc_server_description_latency_p99 (const mongoc_server_description_t *description);
+
+BSON_API
+mongoc_server_description_t *
+mongoc_server_selection_policy_power_of_two (mongoc_server_description_t **candidates,
+                                             size_t                        n_candidates,
+                                             void                         *context);
+
 BSON_API
 const char *
 mongoc_server_description_type (const mongoc_server_description_t *description);
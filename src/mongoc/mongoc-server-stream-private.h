@@ -25,6 +25,7 @@
 
 #include <bson.h>
 
+#include "mongoc-connection-stats-private.h"
 #include "mongoc-topology-description-private.h"
 #include "mongoc-server-description-private.h"
 #include "mongoc-stream.h"
@@ -36,6 +37,8 @@ typedef struct _mongoc_server_stream_t
    mongoc_topology_description_type_t  topology_type;
    mongoc_server_description_t        *sd;            /* owned */
    mongoc_stream_t                    *stream;        /* borrowed */
+   mongoc_connection_stats_server_t   *connection_stats;  /* NULL ok */
+   mongoc_counter_slots_t             *keyed_counters;    /* NULL ok */
 } mongoc_server_stream_t;
 
 
@@ -36,6 +36,8 @@ mongoc_server_stream_new (mongoc_topology_description_type_t topology_type,
    server_stream->topology_type = topology_type;
    server_stream->sd = sd;                       /* becomes owned */
    server_stream->stream = stream;               /* merely borrowed */
+   server_stream->connection_stats = NULL;
+   server_stream->keyed_counters = NULL;
 
    return server_stream;
 }
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_SHARD_MAP_PRIVATE_H
+#define MONGOC_SHARD_MAP_PRIVATE_H
+
+#if !defined (MONGOC_COMPILATION)
+#error "Only <mongoc.h> can be included directly."
+#endif
+
+#include <bson.h>
+
+#include "mongoc-array-private.h"
+#include "mongoc-client.h"
+
+/* how long a shard map is used before checking the chunk version again */
+#define MONGOC_SHARD_MAP_CHECK_INTERVAL_MS 10000
+
+/* we don't route collections with longer shard keys */
+#define MONGOC_SHARD_KEY_MAX_FIELDS 8
+
+
+BSON_BEGIN_DECLS
+
+
+typedef struct
+{
+   bson_t   *min;
+   bson_t   *max;
+   uint32_t  shard;  /* index into the map's shard names */
+} mongoc_shard_chunk_t;
+
+
+/* a collection's chunk ranges, as read from config.chunks */
+typedef struct _mongoc_shard_map_t
+{
+   char                       *ns;
+   /* false if the collection isn't sharded or we can't route its key */
+   bool                        sharded;
+   char                       *key_fields[MONGOC_SHARD_KEY_MAX_FIELDS];
+   uint32_t                    n_key_fields;
+   bson_oid_t                  epoch;
+   uint64_t                    version;  /* newest chunk's lastmod */
+   mongoc_array_t              chunks;   /* mongoc_shard_chunk_t by min */
+   mongoc_array_t              shards;   /* char *, each shard's name */
+   int64_t                     checked_at;
+   struct _mongoc_shard_map_t *next;
+} mongoc_shard_map_t;
+
+
+mongoc_shard_map_t *_mongoc_shard_map_new         (const char               *ns,
+                                                   const bson_t             *collection);
+
+bool                _mongoc_shard_map_add_chunk   (mongoc_shard_map_t       *map,
+                                                   const bson_t             *chunk);
+
+void                _mongoc_shard_map_destroy     (mongoc_shard_map_t       *map);
+
+mongoc_shard_map_t *_mongoc_shard_map_get         (mongoc_client_t          *client,
+                                                   const char               *db,
+                                                   const char               *collection);
+
+int32_t             _mongoc_shard_map_route_insert (const mongoc_shard_map_t *map,
+                                                    const bson_t             *document,
+                                                    const bson_oid_t         *generated_id);
+
+int32_t             _mongoc_shard_map_route_query (const mongoc_shard_map_t *map,
+                                                   const bson_t             *selector);
+
+void                _mongoc_shard_maps_destroy    (mongoc_shard_map_t       *maps);
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_SHARD_MAP_PRIVATE_H */
@@ -0,0 +1,780 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "mongoc-client-private.h"
+#include "mongoc-collection.h"
+#include "mongoc-cursor.h"
+#include "mongoc-shard-map-private.h"
+#include "mongoc-trace-private.h"
+#include "utlist.h"
+
+#undef MONGOC_LOG_DOMAIN
+#define MONGOC_LOG_DOMAIN "shard_map"
+
+/* Each client caches the chunk ranges of the sharded collections its bulk
+ * operations route, from config.collections and config.chunks. A map is
+ * only a routing hint: mongos still routes every write, so a stale map
+ * costs an extra hop to the right shard, never a misplaced document.
+ *
+ * We route a value only if we can compare it the way the server orders
+ * shard key values; documents whose key holds arrays, subdocuments,
+ * binary data and so on are unroutable, as are hashed shard keys.
+ */
+
+
+/* the server's canonical ordering of the types we compare, or -1 */
+static int
+_mongoc_shard_map_type_order (bson_type_t type)
+{
+   switch (type) {
+   case BSON_TYPE_MINKEY:
+      return 0;
+   case BSON_TYPE_NULL:
+      return 1;
+   case BSON_TYPE_INT32:
+   case BSON_TYPE_INT64:
+   case BSON_TYPE_DOUBLE:
+      return 2;
+   case BSON_TYPE_UTF8:
+      return 3;
+   case BSON_TYPE_OID:
+      return 4;
+   case BSON_TYPE_BOOL:
+      return 5;
+   case BSON_TYPE_DATE_TIME:
+      return 6;
+   case BSON_TYPE_TIMESTAMP:
+      return 7;
+   case BSON_TYPE_MAXKEY:
+      return 8;
+   default:
+      return -1;
+   }
+}
+
+
+static bool
+_mongoc_shard_map_value_as_double (const bson_value_t *value,
+                                   double             *d)
+{
+   switch (value->value_type) {
+   case BSON_TYPE_INT32:
+      *d = value->value.v_int32;
+      return true;
+   case BSON_TYPE_INT64:
+      /* beyond 2^53, a double can't hold the int64's exact value */
+      if (value->value.v_int64 > (1LL << 53) ||
+          value->value.v_int64 < -(1LL << 53)) {
+         return false;
+      }
+      *d = (double) value->value.v_int64;
+      return true;
+   case BSON_TYPE_DOUBLE:
+      *d = value->value.v_double;
+      return !isnan (*d);
+   default:
+      return false;
+   }
+}
+
+
+#define CMP(_a, _b) ((_a) < (_b) ? -1 : ((_a) > (_b) ? 1 : 0))
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_shard_map_compare_values --
+ *
+ *       Compare two shard key values in the server's order.
+ *
+ * Returns:
+ *       true and sets @cmp to a negative, zero or positive number, or
+ *       false if we can't compare @a and @b.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_shard_map_compare_values (const bson_value_t *a,
+                                  const bson_value_t *b,
+                                  int                *cmp)
+{
+   int order_a = _mongoc_shard_map_type_order (a->value_type);
+   int order_b = _mongoc_shard_map_type_order (b->value_type);
+   double da, db;
+   int64_t ia, ib;
+   uint32_t len;
+
+   if (order_a < 0 || order_b < 0) {
+      return false;
+   }
+
+   if (order_a != order_b) {
+      *cmp = CMP (order_a, order_b);
+      return true;
+   }
+
+   switch (a->value_type) {
+   case BSON_TYPE_MINKEY:
+   case BSON_TYPE_MAXKEY:
+   case BSON_TYPE_NULL:
+      *cmp = 0;
+      return true;
+   case BSON_TYPE_INT32:
+   case BSON_TYPE_INT64:
+   case BSON_TYPE_DOUBLE:
+      if (a->value_type != BSON_TYPE_DOUBLE &&
+          b->value_type != BSON_TYPE_DOUBLE) {
+         ia = a->value_type == BSON_TYPE_INT32 ? a->value.v_int32
+                                               : a->value.v_int64;
+         ib = b->value_type == BSON_TYPE_INT32 ? b->value.v_int32
+                                               : b->value.v_int64;
+         *cmp = CMP (ia, ib);
+         return true;
+      }
+
+      if (!_mongoc_shard_map_value_as_double (a, &da) ||
+          !_mongoc_shard_map_value_as_double (b, &db)) {
+         return false;
+      }
+
+      *cmp = CMP (da, db);
+      return true;
+   case BSON_TYPE_UTF8:
+      len = BSON_MIN (a->value.v_utf8.len, b->value.v_utf8.len);
+      *cmp = memcmp (a->value.v_utf8.str, b->value.v_utf8.str, len);
+      if (!*cmp) {
+         *cmp = CMP (a->value.v_utf8.len, b->value.v_utf8.len);
+      }
+      return true;
+   case BSON_TYPE_OID:
+      *cmp = bson_oid_compare (&a->value.v_oid, &b->value.v_oid);
+      return true;
+   case BSON_TYPE_BOOL:
+      *cmp = CMP (a->value.v_bool, b->value.v_bool);
+      return true;
+   case BSON_TYPE_DATE_TIME:
+      *cmp = CMP (a->value.v_datetime, b->value.v_datetime);
+      return true;
+   case BSON_TYPE_TIMESTAMP:
+      *cmp = CMP (a->value.v_timestamp.timestamp,
+                  b->value.v_timestamp.timestamp);
+      if (!*cmp) {
+         *cmp = CMP (a->value.v_timestamp.increment,
+                     b->value.v_timestamp.increment);
+      }
+      return true;
+   default:
+      return false;
+   }
+}
+
+
+/* compare a shard key's values with a chunk bound like {a: 1, b: MinKey} */
+static bool
+_mongoc_shard_map_compare_key (const mongoc_shard_map_t *map,
+                               const bson_value_t       *values,
+                               const bson_t             *bound,
+                               int                      *cmp)
+{
+   bson_iter_t iter;
+   uint32_t i = 0;
+
+   if (!bson_iter_init (&iter, bound)) {
+      return false;
+   }
+
+   *cmp = 0;
+
+   while (bson_iter_next (&iter)) {
+      if (i == map->n_key_fields ||
+          !_mongoc_shard_map_compare_values (&values[i],
+                                             bson_iter_value (&iter), cmp)) {
+         return false;
+      }
+
+      if (*cmp) {
+         return true;
+      }
+
+      i++;
+   }
+
+   return i == map->n_key_fields;
+}
+
+
+/* the index of the shard owning the key @values, or -1 */
+static int32_t
+_mongoc_shard_map_route (const mongoc_shard_map_t *map,
+                         const bson_value_t       *values)
+{
+   const mongoc_shard_chunk_t *chunk;
+   size_t lo = 0;
+   size_t hi = map->chunks.len;
+   size_t mid;
+   int cmp;
+
+   /* find the first chunk whose min is greater than the key */
+   while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      chunk = &_mongoc_array_index (&map->chunks, mongoc_shard_chunk_t, mid);
+
+      if (!_mongoc_shard_map_compare_key (map, values, chunk->min, &cmp)) {
+         return -1;
+      }
+
+      if (cmp < 0) {
+         hi = mid;
+      } else {
+         lo = mid + 1;
+      }
+   }
+
+   if (!lo) {
+      return -1;
+   }
+
+   chunk = &_mongoc_array_index (&map->chunks, mongoc_shard_chunk_t, lo - 1);
+
+   if (!_mongoc_shard_map_compare_key (map, values, chunk->max, &cmp) ||
+       cmp >= 0) {
+      return -1;
+   }
+
+   return (int32_t) chunk->shard;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_shard_map_new --
+ *
+ *       Create a map with no chunks for namespace @ns, from its document
+ *       in config.collections. If @collection is NULL, the collection is
+ *       dropped, or its shard key is hashed, the map isn't "sharded".
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_shard_map_t *
+_mongoc_shard_map_new (const char   *ns,
+                       const bson_t *collection)
+{
+   mongoc_shard_map_t *map;
+   bson_iter_t iter;
+   bson_iter_t key;
+
+   BSON_ASSERT (ns);
+
+   map = (mongoc_shard_map_t *) bson_malloc0 (sizeof *map);
+   map->ns = bson_strdup (ns);
+   _mongoc_array_init (&map->chunks, sizeof (mongoc_shard_chunk_t));
+   _mongoc_array_init (&map->shards, sizeof (char *));
+
+   if (!collection) {
+      return map;
+   }
+
+   if (bson_iter_init_find (&iter, collection, "dropped") &&
+       bson_iter_as_bool (&iter)) {
+      return map;
+   }
+
+   if (!bson_iter_init_find (&iter, collection, "key") ||
+       !BSON_ITER_HOLDS_DOCUMENT (&iter) ||
+       !bson_iter_recurse (&iter, &key)) {
+      return map;
+   }
+
+   while (bson_iter_next (&key)) {
+      /* a hashed key field's value is "hashed", a ranged one's is 1 */
+      if (BSON_ITER_HOLDS_UTF8 (&key) ||
+          map->n_key_fields == MONGOC_SHARD_KEY_MAX_FIELDS) {
+         return map;
+      }
+
+      map->key_fields[map->n_key_fields++] =
+         bson_strdup (bson_iter_key (&key));
+   }
+
+   map->sharded = map->n_key_fields > 0;
+
+   return map;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_shard_map_add_chunk --
+ *
+ *       Add a chunk from config.chunks to @map. Chunks must be added in
+ *       order of their "min" bounds, as a query sorted by "min" returns
+ *       them.
+ *
+ * Returns:
+ *       false if @chunk is malformed or out of order.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_shard_map_add_chunk (mongoc_shard_map_t *map,
+                             const bson_t       *chunk)
+{
+   mongoc_shard_chunk_t c = { 0 };
+   const mongoc_shard_chunk_t *prev;
+   bson_iter_t iter;
+   const uint8_t *data;
+   uint32_t len;
+   bson_t bound;
+   const char *shard = NULL;
+   char *name;
+   uint32_t t, i;
+   uint64_t version = 0;
+   bool has_epoch = false;
+   bson_oid_t epoch;
+
+   ENTRY;
+
+   BSON_ASSERT (map);
+   BSON_ASSERT (chunk);
+
+   if (!bson_iter_init (&iter, chunk)) {
+      RETURN (false);
+   }
+
+   while (bson_iter_next (&iter)) {
+      if (BSON_ITER_IS_KEY (&iter, "min") && BSON_ITER_HOLDS_DOCUMENT (&iter)) {
+         bson_iter_document (&iter, &len, &data);
+         bson_init_static (&bound, data, len);
+         c.min = bson_copy (&bound);
+      } else if (BSON_ITER_IS_KEY (&iter, "max") &&
+                 BSON_ITER_HOLDS_DOCUMENT (&iter)) {
+         bson_iter_document (&iter, &len, &data);
+         bson_init_static (&bound, data, len);
+         c.max = bson_copy (&bound);
+      } else if (BSON_ITER_IS_KEY (&iter, "shard") &&
+                 BSON_ITER_HOLDS_UTF8 (&iter)) {
+         shard = bson_iter_utf8 (&iter, NULL);
+      } else if (BSON_ITER_IS_KEY (&iter, "lastmod") &&
+                 BSON_ITER_HOLDS_TIMESTAMP (&iter)) {
+         bson_iter_timestamp (&iter, &t, &i);
+         version = ((uint64_t) t << 32) | i;
+      } else if (BSON_ITER_IS_KEY (&iter, "lastmodEpoch") &&
+                 BSON_ITER_HOLDS_OID (&iter)) {
+         bson_oid_copy (bson_iter_oid (&iter), &epoch);
+         has_epoch = true;
+      }
+   }
+
+   if (!c.min || !c.max || !shard || !has_epoch) {
+      GOTO (fail);
+   }
+
+   if (map->chunks.len) {
+      prev = &_mongoc_array_index (&map->chunks, mongoc_shard_chunk_t,
+                                   map->chunks.len - 1);
+
+      /* chunks are contiguous: each begins where the last one ended */
+      if (!bson_equal (prev->max, c.min)) {
+         GOTO (fail);
+      }
+   } else if (bson_count_keys (c.min) != map->n_key_fields) {
+      GOTO (fail);
+   }
+
+   for (c.shard = 0; c.shard < map->shards.len; c.shard++) {
+      if (!strcmp (_mongoc_array_index (&map->shards, char *, c.shard),
+                   shard)) {
+         break;
+      }
+   }
+
+   if (c.shard == map->shards.len) {
+      name = bson_strdup (shard);
+      _mongoc_array_append_val (&map->shards, name);
+   }
+
+   if (version >= map->version) {
+      map->version = version;
+      bson_oid_copy (&epoch, &map->epoch);
+   }
+
+   _mongoc_array_append_val (&map->chunks, c);
+
+   RETURN (true);
+
+fail:
+   if (c.min) {
+      bson_destroy (c.min);
+   }
+
+   if (c.max) {
+      bson_destroy (c.max);
+   }
+
+   RETURN (false);
+}
+
+
+void
+_mongoc_shard_map_destroy (mongoc_shard_map_t *map)
+{
+   mongoc_shard_chunk_t *chunk;
+   size_t i;
+
+   if (!map) {
+      return;
+   }
+
+   for (i = 0; i < map->chunks.len; i++) {
+      chunk = &_mongoc_array_index (&map->chunks, mongoc_shard_chunk_t, i);
+      bson_destroy (chunk->min);
+      bson_destroy (chunk->max);
+   }
+
+   for (i = 0; i < map->shards.len; i++) {
+      bson_free (_mongoc_array_index (&map->shards, char *, i));
+   }
+
+   for (i = 0; i < map->n_key_fields; i++) {
+      bson_free (map->key_fields[i]);
+   }
+
+   _mongoc_array_destroy (&map->chunks);
+   _mongoc_array_destroy (&map->shards);
+   bson_free (map->ns);
+   bson_free (map);
+}
+
+
+void
+_mongoc_shard_maps_destroy (mongoc_shard_map_t *maps)
+{
+   mongoc_shard_map_t *map, *tmp;
+
+   LL_FOREACH_SAFE (maps, map, tmp) {
+      _mongoc_shard_map_destroy (map);
+   }
+}
+
+
+/* load @ns's map from the config servers, through mongos */
+static mongoc_shard_map_t *
+_mongoc_shard_map_load (mongoc_client_t *client,
+                        const char      *ns)
+{
+   mongoc_shard_map_t *map;
+   mongoc_collection_t *coll;
+   mongoc_cursor_t *cursor;
+   const bson_t *doc;
+   bson_error_t error;
+   bson_t filter = BSON_INITIALIZER;
+   bson_t opts = BSON_INITIALIZER;
+   bson_t sort;
+
+   ENTRY;
+
+   BSON_APPEND_UTF8 (&filter, "_id", ns);
+   coll = mongoc_client_get_collection (client, "config", "collections");
+   cursor = mongoc_collection_find_with_opts (coll, &filter, NULL, NULL);
+
+   if (mongoc_cursor_next (cursor, &doc)) {
+      map = _mongoc_shard_map_new (ns, doc);
+   } else {
+      map = _mongoc_shard_map_new (ns, NULL);
+   }
+
+   if (mongoc_cursor_error (cursor, &error)) {
+      TRACE ("can't read config.collections: %s", error.message);
+      map->sharded = false;
+   }
+
+   mongoc_cursor_destroy (cursor);
+   mongoc_collection_destroy (coll);
+
+   if (!map->sharded) {
+      GOTO (done);
+   }
+
+   bson_reinit (&filter);
+   BSON_APPEND_UTF8 (&filter, "ns", ns);
+   bson_append_document_begin (&opts, "sort", 4, &sort);
+   BSON_APPEND_INT32 (&sort, "min", 1);
+   bson_append_document_end (&opts, &sort);
+
+   coll = mongoc_client_get_collection (client, "config", "chunks");
+   cursor = mongoc_collection_find_with_opts (coll, &filter, &opts, NULL);
+
+   while (mongoc_cursor_next (cursor, &doc)) {
+      if (!_mongoc_shard_map_add_chunk (map, doc)) {
+         TRACE ("can't route %s, bad chunk", ns);
+         map->sharded = false;
+         break;
+      }
+   }
+
+   if (mongoc_cursor_error (cursor, &error)) {
+      TRACE ("can't read config.chunks: %s", error.message);
+      map->sharded = false;
+   }
+
+   if (!map->chunks.len) {
+      map->sharded = false;
+   }
+
+   mongoc_cursor_destroy (cursor);
+   mongoc_collection_destroy (coll);
+
+done:
+   bson_destroy (&filter);
+   bson_destroy (&opts);
+
+   RETURN (map);
+}
+
+
+/* is @map's version still the newest chunk version in config.chunks? */
+static bool
+_mongoc_shard_map_is_current (mongoc_client_t          *client,
+                              const mongoc_shard_map_t *map)
+{
+   mongoc_collection_t *coll;
+   mongoc_cursor_t *cursor;
+   const bson_t *doc;
+   bson_iter_t iter;
+   bson_t filter = BSON_INITIALIZER;
+   bson_t opts = BSON_INITIALIZER;
+   bson_t child;
+   uint32_t t, i;
+   bool ret = false;
+
+   BSON_APPEND_UTF8 (&filter, "ns", map->ns);
+   bson_append_document_begin (&opts, "sort", 4, &child);
+   BSON_APPEND_INT32 (&child, "lastmod", -1);
+   bson_append_document_end (&opts, &child);
+   bson_append_document_begin (&opts, "projection", 10, &child);
+   BSON_APPEND_INT32 (&child, "lastmod", 1);
+   BSON_APPEND_INT32 (&child, "lastmodEpoch", 1);
+   bson_append_document_end (&opts, &child);
+   BSON_APPEND_INT32 (&opts, "limit", 1);
+
+   coll = mongoc_client_get_collection (client, "config", "chunks");
+   cursor = mongoc_collection_find_with_opts (coll, &filter, &opts, NULL);
+
+   if (mongoc_cursor_next (cursor, &doc) &&
+       bson_iter_init_find (&iter, doc, "lastmod") &&
+       BSON_ITER_HOLDS_TIMESTAMP (&iter)) {
+      bson_iter_timestamp (&iter, &t, &i);
+
+      ret = (((uint64_t) t << 32) | i) == map->version &&
+            bson_iter_init_find (&iter, doc, "lastmodEpoch") &&
+            BSON_ITER_HOLDS_OID (&iter) &&
+            bson_oid_equal (bson_iter_oid (&iter), &map->epoch);
+   }
+
+   mongoc_cursor_destroy (cursor);
+   mongoc_collection_destroy (coll);
+   bson_destroy (&filter);
+   bson_destroy (&opts);
+
+   return ret;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_shard_map_get --
+ *
+ *       Get the shard map for @db.@collection from @client's cache,
+ *       loading it from the config servers the first time. A cached map
+ *       older than MONGOC_SHARD_MAP_CHECK_INTERVAL_MS is reloaded if a
+ *       chunk was split or moved since. Namespaces we can't route are
+ *       cached too, so we don't query the config servers for every bulk
+ *       operation.
+ *
+ * Returns:
+ *       A map owned by @client, or NULL if we can't route the collection.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_shard_map_t *
+_mongoc_shard_map_get (mongoc_client_t *client,
+                       const char      *db,
+                       const char      *collection)
+{
+   mongoc_shard_map_t *map;
+   mongoc_shard_map_t *fresh;
+   int64_t now;
+   char *ns;
+
+   ENTRY;
+
+   BSON_ASSERT (client);
+   BSON_ASSERT (db);
+   BSON_ASSERT (collection);
+
+   ns = bson_strdup_printf ("%s.%s", db, collection);
+   now = bson_get_monotonic_time ();
+
+   LL_FOREACH (client->shard_maps, map) {
+      if (!strcmp (map->ns, ns)) {
+         break;
+      }
+   }
+
+   if (map && now - map->checked_at < MONGOC_SHARD_MAP_CHECK_INTERVAL_MS * 1000) {
+      GOTO (done);
+   }
+
+   if (map && map->sharded && _mongoc_shard_map_is_current (client, map)) {
+      map->checked_at = now;
+      GOTO (done);
+   }
+
+   fresh = _mongoc_shard_map_load (client, ns);
+   fresh->checked_at = now;
+
+   if (map) {
+      LL_DELETE (client->shard_maps, map);
+      _mongoc_shard_map_destroy (map);
+   }
+
+   LL_PREPEND (client->shard_maps, fresh);
+   map = fresh;
+
+done:
+   bson_free (ns);
+
+   RETURN (map->sharded ? map : NULL);
+}
+
+
+/* find a shard key field's value, or return false */
+static bool
+_mongoc_shard_map_find_value (const bson_t *doc,
+                              const char   *field,
+                              bool          query,
+                              bson_value_t *value)
+{
+   bson_iter_t iter;
+   bson_iter_t child;
+
+   /* a query can match a dotted field like {"a.b": 1} */
+   if (query && strchr (field, '.') && bson_iter_init_find (&iter, doc, field)) {
+      *value = *bson_iter_value (&iter);
+      return true;
+   }
+
+   if (bson_iter_init (&iter, doc) &&
+       bson_iter_find_descendant (&iter, field, &child)) {
+      *value = *bson_iter_value (&child);
+      return true;
+   }
+
+   return false;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_shard_map_route_insert --
+ *
+ *       Find the shard that owns @document. If @document has no "_id",
+ *       @generated_id is the one the driver adds.
+ *
+ * Returns:
+ *       An index into @map's shards, or -1 if we can't route @document.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+int32_t
+_mongoc_shard_map_route_insert (const mongoc_shard_map_t *map,
+                                const bson_t             *document,
+                                const bson_oid_t         *generated_id)
+{
+   bson_value_t values[MONGOC_SHARD_KEY_MAX_FIELDS];
+   uint32_t i;
+
+   BSON_ASSERT (map);
+   BSON_ASSERT (document);
+
+   for (i = 0; i < map->n_key_fields; i++) {
+      if (_mongoc_shard_map_find_value (document, map->key_fields[i], false,
+                                        &values[i])) {
+         continue;
+      }
+
+      if (generated_id && !strcmp (map->key_fields[i], "_id")) {
+         values[i].value_type = BSON_TYPE_OID;
+         bson_oid_copy (generated_id, &values[i].value.v_oid);
+         continue;
+      }
+
+      /* the server stores a missing shard key field as null */
+      values[i].value_type = BSON_TYPE_NULL;
+   }
+
+   return _mongoc_shard_map_route (map, values);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_shard_map_route_query --
+ *
+ *       Find the one shard an update or delete with @selector targets:
+ *       @selector must match each shard key field by equality.
+ *
+ * Returns:
+ *       An index into @map's shards, or -1 if we can't route @selector.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+int32_t
+_mongoc_shard_map_route_query (const mongoc_shard_map_t *map,
+                               const bson_t             *selector)
+{
+   bson_value_t values[MONGOC_SHARD_KEY_MAX_FIELDS];
+   uint32_t i;
+
+   BSON_ASSERT (map);
+   BSON_ASSERT (selector);
+
+   for (i = 0; i < map->n_key_fields; i++) {
+      /* operators like {$in: [...]} are subdocuments, we can't route them */
+      if (!_mongoc_shard_map_find_value (selector, map->key_fields[i], true,
+                                         &values[i]) ||
+          values[i].value_type == BSON_TYPE_NULL) {
+         return -1;
+      }
+   }
+
+   return _mongoc_shard_map_route (map, values);
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_SLOW_OP_PRIVATE_H
+#define MONGOC_SLOW_OP_PRIVATE_H
+
+#if !defined (MONGOC_COMPILATION)
+#error "Only <mongoc.h> can be included directly."
+#endif
+
+#include <bson.h>
+
+#include "mongoc-host-list.h"
+#include "mongoc-slow-op.h"
+#include "mongoc-span-private.h"
+
+
+BSON_BEGIN_DECLS
+
+
+/* how many slow operations the log keeps, the newest overwrite the
+ * oldest */
+#define MONGOC_SLOW_OPS 64
+
+#define MONGOC_SLOW_OP_PHASES 8
+
+
+/*
+ * A slow operation, as it is stored in the counters' shared memory
+ * segment for mongoc-stat. If mongoc-stat.c is out of sync with this
+ * struct, it cannot print the log.
+ */
+#pragma pack(1)
+struct _mongoc_slow_op_t
+{
+   int64_t  seq;          /* odd while being written, see mongoc-slow-op.c */
+   int64_t  time;         /* microseconds since the epoch */
+   int64_t  duration;     /* microseconds */
+   int64_t  operation_id;
+   int64_t  reply_size;
+   uint32_t request_id;
+   uint32_t server_id;
+   uint32_t phases;       /* bit per mongoc_span_phase_t that was recorded */
+   uint8_t  succeeded;
+   uint8_t  padding[3];
+   int64_t  phase_usec[MONGOC_SLOW_OP_PHASES];
+   char     command_name[32];
+   char     db_name[64];
+   char     host[64];
+   char     shape[744];   /* the command as JSON, values redacted */
+};
+#pragma pack()
+
+
+BSON_STATIC_ASSERT (sizeof (mongoc_slow_op_t) == 1024);
+BSON_STATIC_ASSERT (MONGOC_SPAN_LAST_PHASE <= MONGOC_SLOW_OP_PHASES);
+
+
+/* the log: the next ticket to write, then MONGOC_SLOW_OPS records */
+#pragma pack(1)
+typedef struct
+{
+   int64_t          head;
+   uint8_t          padding[56];
+   mongoc_slow_op_t ops[MONGOC_SLOW_OPS];
+} mongoc_slow_op_log_t;
+#pragma pack()
+
+
+BSON_STATIC_ASSERT (sizeof (mongoc_slow_op_log_t) % 64 == 0);
+
+
+void
+_mongoc_slow_ops_attach (mongoc_slow_op_log_t *log);
+
+void
+_mongoc_slow_ops_detach (void);
+
+void
+_mongoc_slow_op_record (int64_t                   duration,
+                        const mongoc_span_t      *span,
+                        const mongoc_host_list_t *host,
+                        const bson_t             *command,
+                        int64_t                   reply_size);
+
+void
+_mongoc_slow_op_shape (const bson_t  *command,
+                       bson_string_t *shape);
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_SLOW_OP_PRIVATE_H */
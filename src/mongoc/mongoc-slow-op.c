@@ -0,0 +1,522 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <bson.h>
+#include <string.h>
+
+#include "mongoc-counters-private.h"
+#include "mongoc-slow-op-private.h"
+#include "mongoc-thread-private.h"
+
+
+/* nested deeper than this, a document's shape is { ... } */
+#define MAX_SHAPE_DEPTH 8
+
+
+/*
+ * The log is a ring of MONGOC_SLOW_OPS records in the counters segment.
+ * A writer takes a ticket from "head" and owns the record at ticket %
+ * MONGOC_SLOW_OPS while its seq is 2 * ticket + 1; it sets seq to
+ * 2 * ticket + 2 when done. Readers copy a record and check its seq
+ * didn't change, so neither writers nor readers take a lock.
+ */
+static mongoc_slow_op_log_t *gSlowOps;
+static mongoc_mutex_t        gDrainMutex;
+static int64_t               gDrained;    /* the next ticket to drain */
+
+
+/* commands whose values may be credentials, even their first */
+static const char *gSensitiveCommands[] = {
+   "authenticate",
+   "saslStart",
+   "saslContinue",
+   "getnonce",
+   "createUser",
+   "updateUser",
+   "copydbgetnonce",
+   "copydbsaslstart",
+   "copydb",
+};
+
+
+static BSON_INLINE bool
+_mongoc_slow_op_cas (volatile int64_t *p,
+                     int64_t           old,
+                     int64_t           new_)
+{
+#if defined(__GNUC__)
+   return __sync_bool_compare_and_swap (p, old, new_);
+#elif defined(_WIN32)
+   return InterlockedCompareExchange64 (p, new_, old) == old;
+#else
+   if (*p != old) {
+      return false;
+   }
+
+   *p = new_;
+   return true;
+#endif
+}
+
+
+void
+_mongoc_slow_ops_attach (mongoc_slow_op_log_t *log)
+{
+   BSON_ASSERT (log);
+
+   mongoc_mutex_init (&gDrainMutex);
+   gDrained = 0;
+   gSlowOps = log;
+}
+
+
+void
+_mongoc_slow_ops_detach (void)
+{
+   if (gSlowOps) {
+      gSlowOps = NULL;
+      mongoc_mutex_destroy (&gDrainMutex);
+   }
+}
+
+
+static bool
+_mongoc_slow_op_is_sensitive (const char *command_name)
+{
+   size_t i;
+
+   for (i = 0; i < sizeof gSensitiveCommands / sizeof (char *); i++) {
+      if (!strcasecmp (command_name, gSensitiveCommands[i])) {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+
+static void
+_mongoc_slow_op_append_key (bson_string_t *shape,
+                            const char    *key)
+{
+   char *escaped;
+
+   escaped = bson_utf8_escape_for_json (key, -1);
+   bson_string_append_printf (shape, "\"%s\" : ", escaped ? escaped : "");
+   bson_free (escaped);
+}
+
+
+static void
+_mongoc_slow_op_shape_value (const bson_iter_t *iter,
+                             bson_string_t     *shape,
+                             int                depth);
+
+
+static void
+_mongoc_slow_op_shape_doc (const bson_iter_t *iter,
+                           bson_string_t     *shape,
+                           int                depth)
+{
+   bson_iter_t child;
+   bool first = true;
+
+   if (depth > MAX_SHAPE_DEPTH || !bson_iter_recurse (iter, &child)) {
+      bson_string_append (shape, "{ ... }");
+      return;
+   }
+
+   bson_string_append (shape, "{ ");
+
+   while (bson_iter_next (&child)) {
+      if (!first) {
+         bson_string_append (shape, ", ");
+      }
+
+      _mongoc_slow_op_append_key (shape, bson_iter_key (&child));
+      _mongoc_slow_op_shape_value (&child, shape, depth + 1);
+      first = false;
+   }
+
+   bson_string_append (shape, first ? "}" : " }");
+}
+
+
+/* an array's shape is its first element's, a long $in list is one "?" */
+static void
+_mongoc_slow_op_shape_array (const bson_iter_t *iter,
+                             bson_string_t     *shape,
+                             int                depth)
+{
+   bson_iter_t child;
+
+   if (depth > MAX_SHAPE_DEPTH || !bson_iter_recurse (iter, &child)) {
+      bson_string_append (shape, "[ ... ]");
+      return;
+   }
+
+   if (!bson_iter_next (&child)) {
+      bson_string_append (shape, "[ ]");
+      return;
+   }
+
+   bson_string_append (shape, "[ ");
+   _mongoc_slow_op_shape_value (&child, shape, depth + 1);
+   bson_string_append (shape, bson_iter_next (&child) ? ", ... ]" : " ]");
+}
+
+
+static void
+_mongoc_slow_op_shape_value (const bson_iter_t *iter,
+                             bson_string_t     *shape,
+                             int                depth)
+{
+   if (BSON_ITER_HOLDS_DOCUMENT (iter)) {
+      _mongoc_slow_op_shape_doc (iter, shape, depth);
+   } else if (BSON_ITER_HOLDS_ARRAY (iter)) {
+      _mongoc_slow_op_shape_array (iter, shape, depth);
+   } else {
+      bson_string_append (shape, "\"?\"");
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_slow_op_shape --
+ *
+ *       Append @command's shape to @shape, as JSON with every value
+ *       replaced by "?", except the command's first value, usually a
+ *       collection name. An array's shape is its first element's.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_slow_op_shape (const bson_t  *command,
+                       bson_string_t *shape)
+{
+   bson_iter_t iter;
+   char *escaped;
+   bool first = true;
+
+   if (!bson_iter_init (&iter, command)) {
+      return;
+   }
+
+   bson_string_append (shape, "{ ");
+
+   while (bson_iter_next (&iter)) {
+      if (!first) {
+         bson_string_append (shape, ", ");
+      }
+
+      _mongoc_slow_op_append_key (shape, bson_iter_key (&iter));
+
+      if (first && BSON_ITER_HOLDS_UTF8 (&iter) &&
+          !_mongoc_slow_op_is_sensitive (bson_iter_key (&iter))) {
+         escaped = bson_utf8_escape_for_json (bson_iter_utf8 (&iter, NULL),
+                                              -1);
+         bson_string_append_printf (shape, "\"%s\"", escaped ? escaped : "");
+         bson_free (escaped);
+      } else {
+         _mongoc_slow_op_shape_value (&iter, shape, 1);
+      }
+
+      first = false;
+   }
+
+   bson_string_append (shape, first ? "}" : " }");
+}
+
+
+/* copy @shape to @op, cut at a character boundary with "..." if long */
+static void
+_mongoc_slow_op_set_shape (mongoc_slow_op_t    *op,
+                           const bson_string_t *shape)
+{
+   size_t len = shape->len;
+
+   if (len < sizeof op->shape) {
+      memcpy (op->shape, shape->str, len + 1);
+      return;
+   }
+
+   len = sizeof op->shape - 4;
+   while (len && ((uint8_t) shape->str[len] & 0xC0) == 0x80) {
+      len--;
+   }
+
+   memcpy (op->shape, shape->str, len);
+   memcpy (op->shape + len, "...", 4);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_slow_op_record --
+ *
+ *       Add an operation that took @duration microseconds to the slow op
+ *       log. @span has its ids, names and phases, @host and @command may
+ *       be NULL.
+ *
+ *       If the record @span would overwrite is still being written, by a
+ *       thread MONGOC_SLOW_OPS slow operations behind, the operation is
+ *       dropped rather than waiting.
+ *
+ * Side effects:
+ *       Increments the "Slow Ops" counters.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_slow_op_record (int64_t                   duration,
+                        const mongoc_span_t      *span,
+                        const mongoc_host_list_t *host,
+                        const bson_t             *command,
+                        int64_t                   reply_size)
+{
+   mongoc_slow_op_log_t *log = gSlowOps;
+   mongoc_slow_op_t *op;
+   bson_string_t *shape;
+   struct timeval tv;
+   int64_t ticket;
+   int64_t seq;
+   int i;
+
+   BSON_ASSERT (span);
+
+   if (!log) {
+      return;
+   }
+
+   /* before taking a ticket, to hold the record briefly */
+   shape = bson_string_new (NULL);
+   if (command) {
+      _mongoc_slow_op_shape (command, shape);
+   }
+
+   ticket = bson_atomic_int64_add (&log->head, 1) - 1;
+   op = &log->ops[ticket % MONGOC_SLOW_OPS];
+
+   seq = op->seq;
+   if ((seq & 1) || seq > 2 * ticket ||
+       !_mongoc_slow_op_cas (&op->seq, seq, 2 * ticket + 1)) {
+      mongoc_counter_slow_ops_dropped_inc ();
+      bson_string_free (shape, true);
+      return;
+   }
+
+   bson_memory_barrier ();
+
+   bson_gettimeofday (&tv);
+   op->time = (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+   op->duration = duration;
+   op->operation_id = span->operation_id;
+   op->reply_size = reply_size;
+   op->request_id = span->request_id;
+   op->server_id = span->server_id;
+   op->phases = span->phases;
+   op->succeeded = span->succeeded;
+
+   for (i = 0; i < MONGOC_SLOW_OP_PHASES; i++) {
+      op->phase_usec[i] = (span->phases & (1u << i))
+                             ? span->end[i] - span->start[i] : 0;
+   }
+
+   bson_strncpy (op->command_name, span->command_name ? span->command_name
+                                                      : "",
+                 sizeof op->command_name);
+   bson_strncpy (op->db_name, span->db_name ? span->db_name : "",
+                 sizeof op->db_name);
+   bson_strncpy (op->host, host ? host->host_and_port : "",
+                 sizeof op->host);
+   _mongoc_slow_op_set_shape (op, shape);
+
+   bson_memory_barrier ();
+   op->seq = 2 * ticket + 2;
+
+   mongoc_counter_slow_ops_recorded_inc ();
+   bson_string_free (shape, true);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_slow_ops_drain --
+ *
+ *       Call @cb with each slow operation logged since the last drain,
+ *       oldest first. Operations overwritten before they were drained
+ *       are skipped. @cb must not call mongoc_slow_ops_drain.
+ *
+ * Returns:
+ *       The number of operations passed to @cb.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+size_t
+mongoc_slow_ops_drain (mongoc_slow_op_cb_t  cb,
+                       void                *context)
+{
+   mongoc_slow_op_log_t *log = gSlowOps;
+   mongoc_slow_op_t *slot;
+   mongoc_slow_op_t op;
+   int64_t ticket;
+   int64_t head;
+   int64_t seq;
+   size_t n = 0;
+
+   BSON_ASSERT (cb);
+
+   if (!log) {
+      return 0;
+   }
+
+   mongoc_mutex_lock (&gDrainMutex);
+
+   head = *(volatile int64_t *) &log->head;
+   ticket = BSON_MAX (gDrained, head - MONGOC_SLOW_OPS);
+
+   for (; ticket < head; ticket++) {
+      slot = &log->ops[ticket % MONGOC_SLOW_OPS];
+
+      seq = *(volatile int64_t *) &slot->seq;
+      bson_memory_barrier ();
+      memcpy (&op, slot, sizeof op);
+      bson_memory_barrier ();
+
+      if (seq == 2 * ticket + 1) {
+         /* still being written, drain it next time */
+         break;
+      }
+
+      if (seq != 2 * ticket + 2 ||
+          *(volatile int64_t *) &slot->seq != seq) {
+         /* overwritten, or dropped */
+         continue;
+      }
+
+      cb (&op, context);
+      n++;
+   }
+
+   gDrained = ticket;
+
+   mongoc_mutex_unlock (&gDrainMutex);
+
+   return n;
+}
+
+
+int64_t
+mongoc_slow_op_get_time (const mongoc_slow_op_t *op)
+{
+   return op->time;
+}
+
+
+int64_t
+mongoc_slow_op_get_duration (const mongoc_slow_op_t *op)
+{
+   return op->duration;
+}
+
+
+int64_t
+mongoc_slow_op_get_operation_id (const mongoc_slow_op_t *op)
+{
+   return op->operation_id;
+}
+
+
+int64_t
+mongoc_slow_op_get_request_id (const mongoc_slow_op_t *op)
+{
+   return op->request_id;
+}
+
+
+uint32_t
+mongoc_slow_op_get_server_id (const mongoc_slow_op_t *op)
+{
+   return op->server_id;
+}
+
+
+const char *
+mongoc_slow_op_get_host (const mongoc_slow_op_t *op)
+{
+   return op->host;
+}
+
+
+const char *
+mongoc_slow_op_get_command_name (const mongoc_slow_op_t *op)
+{
+   return op->command_name;
+}
+
+
+const char *
+mongoc_slow_op_get_database_name (const mongoc_slow_op_t *op)
+{
+   return op->db_name;
+}
+
+
+const char *
+mongoc_slow_op_get_shape (const mongoc_slow_op_t *op)
+{
+   return op->shape;
+}
+
+
+int64_t
+mongoc_slow_op_get_reply_size (const mongoc_slow_op_t *op)
+{
+   return op->reply_size;
+}
+
+
+bool
+mongoc_slow_op_get_succeeded (const mongoc_slow_op_t *op)
+{
+   return op->succeeded;
+}
+
+
+bool
+mongoc_slow_op_get_phase (const mongoc_slow_op_t *op,
+                          mongoc_span_phase_t     phase,
+                          int64_t                *usec)
+{
+   if ((unsigned) phase >= MONGOC_SPAN_LAST_PHASE ||
+       !(op->phases & (1u << phase))) {
+      return false;
+   }
+
+   if (usec) {
+      *usec = op->phase_usec[phase];
+   }
+
+   return true;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_SLOW_OP_H
+#define MONGOC_SLOW_OP_H
+
+#if !defined (MONGOC_INSIDE) && !defined (MONGOC_COMPILATION)
+# error "Only <mongoc.h> can be included directly."
+#endif
+
+#include <bson.h>
+
+#include "mongoc-span.h"
+
+BSON_BEGIN_DECLS
+
+/*
+ * The slow operation log: commands that took longer than a client's
+ * slowOpThresholdMS, kept in a bounded log for the whole process.
+ */
+
+typedef struct _mongoc_slow_op_t mongoc_slow_op_t;
+
+typedef void (*mongoc_slow_op_cb_t) (const mongoc_slow_op_t *op,
+                                     void                   *context);
+
+BSON_API
+size_t
+mongoc_slow_ops_drain              (mongoc_slow_op_cb_t     cb,
+                                    void                   *context);
+BSON_API
+int64_t
+mongoc_slow_op_get_time            (const mongoc_slow_op_t *op);
+BSON_API
+int64_t
+mongoc_slow_op_get_duration        (const mongoc_slow_op_t *op);
+BSON_API
+int64_t
+mongoc_slow_op_get_operation_id    (const mongoc_slow_op_t *op);
+BSON_API
+int64_t
+mongoc_slow_op_get_request_id      (const mongoc_slow_op_t *op);
+BSON_API
+uint32_t
+mongoc_slow_op_get_server_id       (const mongoc_slow_op_t *op);
+BSON_API
+const char *
+mongoc_slow_op_get_host            (const mongoc_slow_op_t *op);
+BSON_API
+const char *
+mongoc_slow_op_get_command_name    (const mongoc_slow_op_t *op);
+BSON_API
+const char *
+mongoc_slow_op_get_database_name   (const mongoc_slow_op_t *op);
+BSON_API
+const char *
+mongoc_slow_op_get_shape           (const mongoc_slow_op_t *op);
+BSON_API
+int64_t
+mongoc_slow_op_get_reply_size      (const mongoc_slow_op_t *op);
+BSON_API
+bool
+mongoc_slow_op_get_succeeded       (const mongoc_slow_op_t *op);
+BSON_API
+bool
+mongoc_slow_op_get_phase           (const mongoc_slow_op_t *op,
+                                    mongoc_span_phase_t     phase,
+                                    int64_t                *usec);
+
+BSON_END_DECLS
+
+#endif /* MONGOC_SLOW_OP_H */
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_SPAN_PRIVATE_H
+#define MONGOC_SPAN_PRIVATE_H
+
+#if !defined (MONGOC_COMPILATION)
+#error "Only <mongoc.h> can be included directly."
+#endif
+
+#include <bson.h>
+
+#include "mongoc-span.h"
+
+
+BSON_BEGIN_DECLS
+
+
+struct _mongoc_span_t
+{
+   int64_t      operation_id;
+   uint32_t     request_id;
+   uint32_t     server_id;
+   const char  *command_name;
+   const char  *db_name;
+   bool         succeeded;
+   uint32_t     phases;  /* bit per mongoc_span_phase_t that was recorded */
+   int64_t      start[MONGOC_SPAN_LAST_PHASE];
+   int64_t      end[MONGOC_SPAN_LAST_PHASE];
+};
+
+
+/* a client's tracing settings, see mongoc_client_set_span_cb */
+typedef struct
+{
+   mongoc_span_cb_t  cb;
+   void             *context;
+   double            sample_rate;
+   double            credit;  /* sample when it reaches 1 */
+} mongoc_span_tracer_t;
+
+
+static BSON_INLINE void
+_mongoc_span_record (mongoc_span_t       *span,
+                     mongoc_span_phase_t  phase,
+                     int64_t              start,
+                     int64_t              end)
+{
+   span->phases |= (1u << phase);
+   span->start[phase] = start;
+   span->end[phase] = end;
+}
+
+
+void
+_mongoc_span_tracer_set (mongoc_span_tracer_t *tracer,
+                         mongoc_span_cb_t      cb,
+                         void                 *context,
+                         double                sample_rate);
+
+bool
+_mongoc_span_tracer_sample (mongoc_span_tracer_t *tracer);
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_SPAN_PRIVATE_H */
@@ -0,0 +1,238 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "mongoc-span-private.h"
+
+
+static const char *gPhaseNames[] = {
+   "pool_checkout",
+   "server_selection",
+   "connect",
+   "send",
+   "server",
+   "recv",
+};
+
+BSON_STATIC_ASSERT (sizeof gPhaseNames / sizeof gPhaseNames[0] ==
+                    MONGOC_SPAN_LAST_PHASE);
+
+
+void
+_mongoc_span_tracer_set (mongoc_span_tracer_t *tracer,
+                         mongoc_span_cb_t      cb,
+                         void                 *context,
+                         double                sample_rate)
+{
+   tracer->cb = cb;
+   tracer->context = context;
+   tracer->sample_rate = BSON_MAX (0.0, BSON_MIN (sample_rate, 1.0));
+   /* sample the first span */
+   tracer->credit = 1.0;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_span_tracer_sample --
+ *
+ *       Decide whether to trace the next span. Each span adds sample_rate
+ *       to a credit and is traced when the credit reaches 1, so exactly
+ *       that fraction is traced, evenly spaced, without a random number
+ *       generator.
+ *
+ * Returns:
+ *       true if the span should be traced.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_span_tracer_sample (mongoc_span_tracer_t *tracer)
+{
+   if (!tracer->cb || tracer->sample_rate <= 0.0) {
+      return false;
+   }
+
+   if (tracer->credit >= 1.0) {
+      tracer->credit -= 1.0;
+      tracer->credit += tracer->sample_rate;
+      return true;
+   }
+
+   tracer->credit += tracer->sample_rate;
+   return false;
+}
+
+
+int64_t
+mongoc_span_get_operation_id (const mongoc_span_t *span)
+{
+   return span->operation_id;
+}
+
+
+int64_t
+mongoc_span_get_request_id (const mongoc_span_t *span)
+{
+   return span->request_id;
+}
+
+
+uint32_t
+mongoc_span_get_server_id (const mongoc_span_t *span)
+{
+   return span->server_id;
+}
+
+
+const char *
+mongoc_span_get_command_name (const mongoc_span_t *span)
+{
+   return span->command_name;
+}
+
+
+const char *
+mongoc_span_get_database_name (const mongoc_span_t *span)
+{
+   return span->db_name;
+}
+
+
+bool
+mongoc_span_get_succeeded (const mongoc_span_t *span)
+{
+   return span->succeeded;
+}
+
+
+bool
+mongoc_span_get_phase (const mongoc_span_t *span,
+                       mongoc_span_phase_t  phase,
+                       int64_t             *start_usec,
+                       int64_t             *end_usec)
+{
+   if ((unsigned) phase >= MONGOC_SPAN_LAST_PHASE ||
+       !(span->phases & (1u << phase))) {
+      return false;
+   }
+
+   if (start_usec) {
+      *start_usec = span->start[phase];
+   }
+
+   if (end_usec) {
+      *end_usec = span->end[phase];
+   }
+
+   return true;
+}
+
+
+const char *
+mongoc_span_phase_name (mongoc_span_phase_t phase)
+{
+   if ((unsigned) phase >= MONGOC_SPAN_LAST_PHASE) {
+      return NULL;
+   }
+
+   return gPhaseNames[phase];
+}
+
+
+static void
+_append_event (bson_string_t       *str,
+               const mongoc_span_t *span,
+               const char          *name,
+               int64_t              start,
+               int64_t              end)
+{
+   bson_string_append_printf (
+      str,
+      "{\"name\":\"%s\",\"cat\":\"mongoc\",\"ph\":\"X\","
+      "\"ts\":%" PRId64 ",\"dur\":%" PRId64 ","
+      "\"pid\":%" PRIu32 ",\"tid\":%" PRId64 ","
+      "\"args\":{\"operation_id\":%" PRId64 ",\"request_id\":%" PRIu32 "}}",
+      name, start, end - start, span->server_id, span->operation_id,
+      span->operation_id, span->request_id);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_span_as_chrome_trace --
+ *
+ *       Format @span as Chrome trace "complete" events: one for the whole
+ *       command, named for it, then one per recorded phase. The events
+ *       are separated by commas, without enclosing brackets, so spans
+ *       can be written one after another into a JSON array. Events for
+ *       one operation share a "tid", events for one server a "pid".
+ *
+ * Returns:
+ *       A string to free with bson_free. If @length is not NULL, it is
+ *       set to the string's length.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+char *
+mongoc_span_as_chrome_trace (const mongoc_span_t *span,
+                             size_t              *length)
+{
+   bson_string_t *str;
+   char *name;
+   int64_t start = 0;
+   int64_t end = 0;
+   bool first = true;
+   int i;
+
+   for (i = 0; i < MONGOC_SPAN_LAST_PHASE; i++) {
+      if (span->phases & (1u << i)) {
+         if (first || span->start[i] < start) {
+            start = span->start[i];
+         }
+
+         if (first || span->end[i] > end) {
+            end = span->end[i];
+         }
+
+         first = false;
+      }
+   }
+
+   str = bson_string_new (NULL);
+   name = bson_utf8_escape_for_json (
+      span->command_name ? span->command_name : "", -1);
+   _append_event (str, span, name, start, end);
+   bson_free (name);
+
+   for (i = 0; i < MONGOC_SPAN_LAST_PHASE; i++) {
+      if (span->phases & (1u << i)) {
+         bson_string_append (str, ",");
+         _append_event (str, span, gPhaseNames[i], span->start[i],
+                        span->end[i]);
+      }
+   }
+
+   if (length) {
+      *length = str->len;
+   }
+
+   return bson_string_free (str, false);
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_SPAN_H
+#define MONGOC_SPAN_H
+
+#if !defined (MONGOC_INSIDE) && !defined (MONGOC_COMPILATION)
+# error "Only <mongoc.h> can be included directly."
+#endif
+
+#include <bson.h>
+
+BSON_BEGIN_DECLS
+
+/*
+ * Tracing spans: where the time went for one command, phase by phase.
+ * Timestamps are from bson_get_monotonic_time, in microseconds.
+ */
+
+typedef enum
+{
+   MONGOC_SPAN_POOL_CHECKOUT,     /* mongoc_client_pool_pop */
+   MONGOC_SPAN_SERVER_SELECTION,
+   MONGOC_SPAN_CONNECT,           /* connect, handshake and auth */
+   MONGOC_SPAN_SEND,
+   MONGOC_SPAN_SERVER,            /* sent, until the reply header arrives */
+   MONGOC_SPAN_RECV,              /* read and check the reply body */
+   MONGOC_SPAN_LAST_PHASE,
+} mongoc_span_phase_t;
+
+typedef struct _mongoc_span_t mongoc_span_t;
+
+typedef void (*mongoc_span_cb_t) (const mongoc_span_t *span,
+                                  void                *context);
+
+BSON_API
+int64_t
+mongoc_span_get_operation_id     (const mongoc_span_t *span);
+BSON_API
+int64_t
+mongoc_span_get_request_id       (const mongoc_span_t *span);
+BSON_API
+uint32_t
+mongoc_span_get_server_id        (const mongoc_span_t *span);
+BSON_API
+const char *
+mongoc_span_get_command_name     (const mongoc_span_t *span);
+BSON_API
+const char *
+mongoc_span_get_database_name    (const mongoc_span_t *span);
+BSON_API
+bool
+mongoc_span_get_succeeded        (const mongoc_span_t *span);
+BSON_API
+bool
+mongoc_span_get_phase            (const mongoc_span_t *span,
+                                  mongoc_span_phase_t  phase,
+                                  int64_t             *start_usec,
+                                  int64_t             *end_usec);
+BSON_API
+const char *
+mongoc_span_phase_name           (mongoc_span_phase_t  phase);
+BSON_API
+char *
+mongoc_span_as_chrome_trace      (const mongoc_span_t *span,
+                                  size_t              *length);
+
+BSON_END_DECLS
+
+#endif /* MONGOC_SPAN_H */
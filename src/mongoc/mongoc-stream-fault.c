@@ -0,0 +1,626 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <errno.h>
+
+#include "mongoc-client-private.h"
+#include "mongoc-error.h"
+#include "mongoc-log.h"
+#include "mongoc-stream-fault.h"
+#include "mongoc-stream-private.h"
+#include "mongoc-trace-private.h"
+#include "mongoc-util-private.h"
+
+
+#undef MONGOC_LOG_DOMAIN
+#define MONGOC_LOG_DOMAIN "stream-fault"
+
+
+typedef struct
+{
+   mongoc_stream_t            stream;
+   mongoc_stream_t           *base_stream;
+   mongoc_stream_fault_opt_t  opt;
+   uint32_t                   rand_state;
+   int64_t                    n_bytes;
+   bool                       awaiting_reply;
+   bool                       disconnected;
+} mongoc_stream_fault_t;
+
+
+/* xorshift, so a seed gives the same faults on every platform */
+static uint32_t
+_mongoc_stream_fault_rand (mongoc_stream_fault_t *fault)
+{
+   uint32_t x = fault->rand_state;
+
+   x ^= x << 13;
+   x ^= x >> 17;
+   x ^= x << 5;
+   fault->rand_state = x;
+
+   return x;
+}
+
+
+static void
+_mongoc_stream_fault_disconnect (mongoc_stream_fault_t *fault)
+{
+   if (!fault->disconnected) {
+      MONGOC_DEBUG ("Injecting a disconnect after %" PRId64 " bytes.",
+                    fault->n_bytes);
+      mongoc_stream_close (fault->base_stream);
+      fault->disconnected = true;
+   }
+
+   errno = ECONNRESET;
+}
+
+
+/* decide whether to disconnect before this read or write */
+static bool
+_mongoc_stream_fault_roll (mongoc_stream_fault_t *fault)
+{
+   if (fault->disconnected) {
+      errno = ECONNRESET;
+      return false;
+   }
+
+   if (fault->opt.disconnect_per_million &&
+       _mongoc_stream_fault_rand (fault) % 1000000 <
+          fault->opt.disconnect_per_million) {
+      _mongoc_stream_fault_disconnect (fault);
+      return false;
+   }
+
+   return true;
+}
+
+
+/* how many of @len bytes may be moved before disconnect_after_bytes */
+static size_t
+_mongoc_stream_fault_allowance (mongoc_stream_fault_t *fault,
+                                size_t                 len)
+{
+   int64_t left;
+
+   if (fault->opt.disconnect_after_bytes <= 0) {
+      return len;
+   }
+
+   left = BSON_MAX (0, fault->opt.disconnect_after_bytes - fault->n_bytes);
+
+   return (size_t) BSON_MIN ((int64_t) len, left);
+}
+
+
+/* sleep @usec, or until @expire_at and fail with ETIMEDOUT */
+static bool
+_mongoc_stream_fault_sleep (int64_t usec,
+                            int64_t expire_at)
+{
+   int64_t now;
+
+   if (usec <= 0) {
+      return true;
+   }
+
+   if (expire_at >= 0) {
+      now = bson_get_monotonic_time ();
+      if (now + usec > expire_at) {
+         if (expire_at > now) {
+            _mongoc_usleep (expire_at - now);
+         }
+
+         errno = ETIMEDOUT;
+         return false;
+      }
+   }
+
+   _mongoc_usleep (usec);
+
+   return true;
+}
+
+
+/* the time a read or write of @n_bytes takes at the capped bandwidth */
+static bool
+_mongoc_stream_fault_throttle (mongoc_stream_fault_t *fault,
+                               ssize_t                n_bytes,
+                               int64_t                expire_at)
+{
+   fault->n_bytes += n_bytes;
+
+   if (fault->opt.bytes_per_sec <= 0 || n_bytes <= 0) {
+      return true;
+   }
+
+   return _mongoc_stream_fault_sleep (
+      (int64_t) n_bytes * 1000000 / fault->opt.bytes_per_sec, expire_at);
+}
+
+
+/* the base stream's timeout for what is left of the caller's */
+static bool
+_mongoc_stream_fault_remaining (int64_t  expire_at,
+                                int32_t  timeout_msec,
+                                int32_t *remaining)
+{
+   int64_t msec;
+
+   if (expire_at < 0) {
+      *remaining = timeout_msec;
+      return true;
+   }
+
+   msec = (expire_at - bson_get_monotonic_time ()) / 1000;
+   if (msec <= 0) {
+      errno = ETIMEDOUT;
+      return false;
+   }
+
+   *remaining = (int32_t) BSON_MIN (msec, INT32_MAX);
+
+   return true;
+}
+
+
+/* point @out at up to @limit bytes of @iov, starting @skip bytes in */
+static size_t
+_mongoc_stream_fault_slice (mongoc_iovec_t *iov,
+                            size_t          iovcnt,
+                            size_t          skip,
+                            size_t          limit,
+                            mongoc_iovec_t *out)
+{
+   size_t n = 0;
+   size_t i;
+
+   for (i = 0; i < iovcnt && limit > 0; i++) {
+      if (skip >= iov[i].iov_len) {
+         skip -= iov[i].iov_len;
+         continue;
+      }
+
+      out[n].iov_base = (char *) iov[i].iov_base + skip;
+      out[n].iov_len = BSON_MIN (iov[i].iov_len - skip, limit);
+      limit -= out[n].iov_len;
+      skip = 0;
+      n++;
+   }
+
+   return n;
+}
+
+
+static void
+_mongoc_stream_fault_destroy (mongoc_stream_t *stream)
+{
+   mongoc_stream_fault_t *fault = (mongoc_stream_fault_t *) stream;
+
+   BSON_ASSERT (fault);
+
+   mongoc_stream_destroy (fault->base_stream);
+   bson_free (fault);
+}
+
+
+static void
+_mongoc_stream_fault_failed (mongoc_stream_t *stream)
+{
+   mongoc_stream_fault_t *fault = (mongoc_stream_fault_t *) stream;
+
+   BSON_ASSERT (fault);
+
+   mongoc_stream_failed (fault->base_stream);
+   bson_free (fault);
+}
+
+
+static int
+_mongoc_stream_fault_close (mongoc_stream_t *stream)
+{
+   mongoc_stream_fault_t *fault = (mongoc_stream_fault_t *) stream;
+
+   BSON_ASSERT (fault);
+
+   if (fault->disconnected) {
+      return 0;
+   }
+
+   return mongoc_stream_close (fault->base_stream);
+}
+
+
+static int
+_mongoc_stream_fault_flush (mongoc_stream_t *stream)
+{
+   mongoc_stream_fault_t *fault = (mongoc_stream_fault_t *) stream;
+
+   BSON_ASSERT (fault);
+
+   return mongoc_stream_flush (fault->base_stream);
+}
+
+
+static int
+_mongoc_stream_fault_setsockopt (mongoc_stream_t *stream,
+                                 int              level,
+                                 int              optname,
+                                 void            *optval,
+                                 socklen_t        optlen)
+{
+   mongoc_stream_fault_t *fault = (mongoc_stream_fault_t *) stream;
+
+   BSON_ASSERT (fault);
+
+   return mongoc_stream_setsockopt (fault->base_stream, level, optname,
+                                    optval, optlen);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_stream_fault_writev --
+ *
+ *       Write @iov to the base stream in pieces of at most max_write_size
+ *       bytes, each delayed by the bandwidth cap. Disconnect instead if
+ *       the dice say so, or once disconnect_after_bytes have been moved,
+ *       even partway through the message.
+ *
+ * Returns:
+ *       The number of bytes written, or -1 with errno set to ECONNRESET,
+ *       ETIMEDOUT, or the base stream's error.
+ *
+ * Side effects:
+ *       The next read waits for latency_ms.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static ssize_t
+_mongoc_stream_fault_writev (mongoc_stream_t *stream,
+                             mongoc_iovec_t  *iov,
+                             size_t           iovcnt,
+                             int32_t          timeout_msec)
+{
+   mongoc_stream_fault_t *fault = (mongoc_stream_fault_t *) stream;
+   mongoc_iovec_t *slice;
+   size_t total_bytes = 0;
+   size_t written = 0;
+   size_t limit;
+   size_t n;
+   int64_t expire_at;
+   int32_t remaining;
+   ssize_t r;
+   ssize_t ret = -1;
+   size_t i;
+
+   ENTRY;
+
+   BSON_ASSERT (fault);
+
+   expire_at = timeout_msec > 0
+               ? bson_get_monotonic_time () + (int64_t) timeout_msec * 1000
+               : -1;
+
+   if (!_mongoc_stream_fault_roll (fault)) {
+      RETURN (-1);
+   }
+
+   for (i = 0; i < iovcnt; i++) {
+      total_bytes += iov[i].iov_len;
+   }
+
+   slice = (mongoc_iovec_t *) bson_malloc (
+      BSON_MAX (1, iovcnt) * sizeof (mongoc_iovec_t));
+
+   while (written < total_bytes) {
+      limit = total_bytes - written;
+      if (fault->opt.max_write_size) {
+         limit = BSON_MIN (limit, fault->opt.max_write_size);
+      }
+
+      limit = _mongoc_stream_fault_allowance (fault, limit);
+      if (limit == 0) {
+         _mongoc_stream_fault_disconnect (fault);
+         GOTO (done);
+      }
+
+      if (!_mongoc_stream_fault_remaining (expire_at, timeout_msec,
+                                           &remaining)) {
+         GOTO (done);
+      }
+
+      n = _mongoc_stream_fault_slice (iov, iovcnt, written, limit, slice);
+      r = mongoc_stream_writev (fault->base_stream, slice, n, remaining);
+      if (r < 0) {
+         GOTO (done);
+      }
+
+      written += (size_t) r;
+
+      if (!_mongoc_stream_fault_throttle (fault, r, expire_at)) {
+         GOTO (done);
+      }
+
+      if ((size_t) r < limit) {
+         /* a short write from the base stream */
+         break;
+      }
+   }
+
+   fault->awaiting_reply = true;
+   ret = (ssize_t) written;
+
+done:
+   bson_free (slice);
+
+   RETURN (ret);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_stream_fault_readv --
+ *
+ *       Wait for latency_ms plus up to jitter_ms if this is the first
+ *       read since a write, then read from the base stream in pieces of
+ *       at most max_read_size bytes, each delayed by the bandwidth cap,
+ *       until at least @min_bytes have arrived. Stopping there may be a
+ *       short read, as from a socket. Disconnects like writev.
+ *
+ * Returns:
+ *       The number of bytes read, or -1 with errno set to ECONNRESET,
+ *       ETIMEDOUT, or the base stream's error.
+ *
+ * Side effects:
+ *       @iov is filled.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static ssize_t
+_mongoc_stream_fault_readv (mongoc_stream_t *stream,
+                            mongoc_iovec_t  *iov,
+                            size_t           iovcnt,
+                            size_t           min_bytes,
+                            int32_t          timeout_msec)
+{
+   mongoc_stream_fault_t *fault = (mongoc_stream_fault_t *) stream;
+   mongoc_iovec_t *slice;
+   size_t total_bytes = 0;
+   size_t nread = 0;
+   size_t limit;
+   size_t n;
+   int64_t expire_at;
+   int64_t delay;
+   int32_t remaining;
+   ssize_t r;
+   ssize_t ret = -1;
+   size_t i;
+
+   ENTRY;
+
+   BSON_ASSERT (fault);
+
+   expire_at = timeout_msec > 0
+               ? bson_get_monotonic_time () + (int64_t) timeout_msec * 1000
+               : -1;
+
+   if (fault->awaiting_reply) {
+      /* the round trip to the server and back */
+      fault->awaiting_reply = false;
+      delay = (int64_t) fault->opt.latency_ms * 1000;
+      if (fault->opt.jitter_ms > 0) {
+         delay += _mongoc_stream_fault_rand (fault) %
+                  ((uint32_t) fault->opt.jitter_ms * 1000 + 1);
+      }
+
+      if (!_mongoc_stream_fault_sleep (delay, expire_at)) {
+         RETURN (-1);
+      }
+   }
+
+   if (!_mongoc_stream_fault_roll (fault)) {
+      RETURN (-1);
+   }
+
+   for (i = 0; i < iovcnt; i++) {
+      total_bytes += iov[i].iov_len;
+   }
+
+   slice = (mongoc_iovec_t *) bson_malloc (
+      BSON_MAX (1, iovcnt) * sizeof (mongoc_iovec_t));
+
+   while (nread < total_bytes) {
+      limit = total_bytes - nread;
+      if (fault->opt.max_read_size) {
+         limit = BSON_MIN (limit, fault->opt.max_read_size);
+      }
+
+      limit = _mongoc_stream_fault_allowance (fault, limit);
+      if (limit == 0) {
+         _mongoc_stream_fault_disconnect (fault);
+         GOTO (done);
+      }
+
+      if (!_mongoc_stream_fault_remaining (expire_at, timeout_msec,
+                                           &remaining)) {
+         GOTO (done);
+      }
+
+      n = _mongoc_stream_fault_slice (iov, iovcnt, nread, limit, slice);
+      r = mongoc_stream_readv (fault->base_stream, slice, n,
+                               BSON_MIN (limit, min_bytes > nread
+                                                ? min_bytes - nread
+                                                : 0),
+                               remaining);
+      if (r < 0) {
+         GOTO (done);
+      }
+
+      nread += (size_t) r;
+
+      if (!_mongoc_stream_fault_throttle (fault, r, expire_at)) {
+         GOTO (done);
+      }
+
+      /* stop at the end of the stream, or return a short read */
+      if (r == 0 || nread >= min_bytes) {
+         break;
+      }
+   }
+
+   ret = (ssize_t) nread;
+
+done:
+   bson_free (slice);
+
+   RETURN (ret);
+}
+
+
+static mongoc_stream_t *
+_mongoc_stream_fault_get_base_stream (mongoc_stream_t *stream)
+{
+   return ((mongoc_stream_fault_t *) stream)->base_stream;
+}
+
+
+static bool
+_mongoc_stream_fault_check_closed (mongoc_stream_t *stream)
+{
+   mongoc_stream_fault_t *fault = (mongoc_stream_fault_t *) stream;
+
+   BSON_ASSERT (fault);
+
+   return fault->disconnected ||
+          mongoc_stream_check_closed (fault->base_stream);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_stream_fault_new --
+ *
+ *       Creates a stream that reads and writes through @base_stream with
+ *       the latency, bandwidth cap, piecemeal reads and writes, and
+ *       disconnects in @opt, for testing how an application behaves on
+ *       a slow or unreliable network.
+ *
+ *       @base_stream is considered owned by the resulting stream after
+ *       calling this function. @opt is copied.
+ *
+ * Returns:
+ *       A newly allocated mongoc_stream_t.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_stream_t *
+mongoc_stream_fault_new (mongoc_stream_t                 *base_stream,
+                         const mongoc_stream_fault_opt_t *opt)
+{
+   mongoc_stream_fault_t *stream;
+
+   BSON_ASSERT (base_stream);
+   BSON_ASSERT (opt);
+
+   stream = (mongoc_stream_fault_t *) bson_malloc0 (sizeof *stream);
+   stream->stream.type = MONGOC_STREAM_FAULT;
+   stream->stream.destroy = _mongoc_stream_fault_destroy;
+   stream->stream.failed = _mongoc_stream_fault_failed;
+   stream->stream.close = _mongoc_stream_fault_close;
+   stream->stream.flush = _mongoc_stream_fault_flush;
+   stream->stream.writev = _mongoc_stream_fault_writev;
+   stream->stream.readv = _mongoc_stream_fault_readv;
+   stream->stream.setsockopt = _mongoc_stream_fault_setsockopt;
+   stream->stream.get_base_stream = _mongoc_stream_fault_get_base_stream;
+   stream->stream.check_closed = _mongoc_stream_fault_check_closed;
+
+   stream->base_stream = base_stream;
+   memcpy (&stream->opt, opt, sizeof stream->opt);
+
+   /* xorshift's state must not be zero */
+   stream->rand_state = opt->seed + 0x9e3779b9;
+   if (!stream->rand_state) {
+      stream->rand_state = 1;
+   }
+
+   return (mongoc_stream_t *) stream;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_stream_fault_initiator --
+ *
+ *       A mongoc_stream_initiator_t that connects with the initiator in
+ *       the mongoc_stream_fault_opt_t @user_data, or the default one,
+ *       and wraps the stream with mongoc_stream_fault_new.
+ *
+ * Returns:
+ *       A mongoc_stream_t if successful; otherwise NULL and @error is set.
+ *
+ * Side effects:
+ *       @error is set if return value is NULL.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_stream_t *
+mongoc_stream_fault_initiator (const mongoc_uri_t       *uri,
+                               const mongoc_host_list_t *host,
+                               void                     *user_data,
+                               bson_error_t             *error)
+{
+   const mongoc_stream_fault_opt_t *opt;
+   mongoc_stream_t *base_stream;
+
+   BSON_ASSERT (user_data);
+
+   opt = (const mongoc_stream_fault_opt_t *) user_data;
+
+   if (opt->initiator) {
+      base_stream = opt->initiator (uri, host, opt->initiator_data, error);
+   } else if (!opt->initiator_data && mongoc_uri_get_ssl (uri)) {
+      /* the default initiator finds the SSL options in the client */
+      bson_set_error (error,
+                      MONGOC_ERROR_CLIENT,
+                      MONGOC_ERROR_CLIENT_NO_ACCEPTABLE_PEER,
+                      "Set initiator_data to the client to use SSL with "
+                      "mongoc_stream_fault_initiator.");
+      return NULL;
+   } else {
+      base_stream = mongoc_client_default_stream_initiator (
+         uri, host, opt->initiator_data, error);
+   }
+
+   if (!base_stream) {
+      return NULL;
+   }
+
+   return mongoc_stream_fault_new (base_stream, opt);
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_STREAM_FAULT_H
+#define MONGOC_STREAM_FAULT_H
+
+#if !defined (MONGOC_INSIDE) && !defined (MONGOC_COMPILATION)
+# error "Only <mongoc.h> can be included directly."
+#endif
+
+#include <bson.h>
+
+#include "mongoc-client.h"
+#include "mongoc-stream.h"
+
+
+BSON_BEGIN_DECLS
+
+
+typedef struct _mongoc_stream_fault_opt_t mongoc_stream_fault_opt_t;
+
+
+struct _mongoc_stream_fault_opt_t
+{
+   int32_t                    latency_ms;
+   int32_t                    jitter_ms;
+   int64_t                    bytes_per_sec;
+   size_t                     max_read_size;
+   size_t                     max_write_size;
+   int64_t                    disconnect_after_bytes;
+   uint32_t                   disconnect_per_million;
+   uint32_t                   seed;
+   mongoc_stream_initiator_t  initiator;
+   void                      *initiator_data;
+   void                      *padding [8];
+};
+
+
+BSON_API
+mongoc_stream_t *mongoc_stream_fault_new       (mongoc_stream_t                 *base_stream,
+                                                const mongoc_stream_fault_opt_t *opt);
+BSON_API
+mongoc_stream_t *mongoc_stream_fault_initiator (const mongoc_uri_t              *uri,
+                                                const mongoc_host_list_t        *host,
+                                                void                            *user_data,
+                                                bson_error_t                    *error);
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_STREAM_FAULT_H */
@@ -37,9 +37,18 @@ typedef struct
    BIO                *bio;
    BIO_METHOD         *meth;
    SSL_CTX            *ctx;
+   char               *session_key;
+   /* a session received before the certificate was verified */
+   SSL_SESSION        *pending_session;
+   bool                verified;
 } mongoc_stream_tls_openssl_t;
 
 
+void
+_mongoc_stream_tls_openssl_resume_session (mongoc_stream_t *stream,
+                                           const char      *host_and_port);
+
+
 BSON_END_DECLS
 
 #endif /* MONGOC_ENABLE_SSL_OPENSSL */
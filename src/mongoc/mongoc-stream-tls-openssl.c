@@ -91,6 +91,11 @@ _mongoc_stream_tls_openssl_destroy (mongoc_stream_t *stream)
    SSL_CTX_free (openssl->ctx);
    openssl->ctx = NULL;
 
+   if (openssl->pending_session) {
+      SSL_SESSION_free (openssl->pending_session);
+   }
+
+   bson_free (openssl->session_key);
    bson_free (openssl);
    bson_free (stream);
 
@@ -556,6 +561,14 @@ mongoc_stream_tls_openssl_handshake (mongoc_stream_t *stream,
    if (BIO_do_handshake (openssl->bio) == 1) {
 
       if (_mongoc_openssl_check_cert (ssl, host, tls->ssl_opts.allow_invalid_hostname)) {
+         openssl->verified = true;
+
+         if (openssl->pending_session) {
+            _mongoc_openssl_session_save (openssl->pending_session,
+                                          openssl->session_key);
+            openssl->pending_session = NULL;
+         }
+
          RETURN (true);
       }
 
@@ -592,6 +605,112 @@ mongoc_stream_tls_openssl_handshake (mongoc_stream_t *stream,
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_stream_tls_openssl_session_key --
+ *
+ *       A session may be resumed only with the server it was negotiated
+ *       with, and only by a stream that would verify the server the same
+ *       way, since resumption skips certificate verification. Servers on
+ *       one host but different ports are different servers.
+ *
+ * Returns:
+ *       A string to be freed with bson_free().
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static char *
+_mongoc_stream_tls_openssl_session_key (const char       *host_and_port,
+                                        mongoc_ssl_opt_t *opt)
+{
+   return bson_strdup_printf ("%s\n%s\n%s\n%s\n%s\n%d\n%d",
+                              host_and_port,
+                              opt->pem_file ? opt->pem_file : "",
+                              opt->ca_file ? opt->ca_file : "",
+                              opt->ca_dir ? opt->ca_dir : "",
+                              opt->crl_file ? opt->crl_file : "",
+                              (int) opt->weak_cert_validation,
+                              (int) opt->allow_invalid_hostname);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_stream_tls_openssl_new_session --
+ *
+ *       OpenSSL's callback for a new client session: with TLS 1.2 during
+ *       the handshake, with TLS 1.3 when a ticket arrives after it. Save
+ *       the session once the server's certificate is verified.
+ *
+ * Returns:
+ *       1 if we took the reference to @session, else 0.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static int
+_mongoc_stream_tls_openssl_new_session (SSL         *ssl,
+                                        SSL_SESSION *session)
+{
+   mongoc_stream_tls_openssl_t *openssl;
+
+   openssl = (mongoc_stream_tls_openssl_t *) SSL_get_app_data (ssl);
+   if (!openssl || !openssl->session_key) {
+      return 0;
+   }
+
+   if (openssl->verified) {
+      _mongoc_openssl_session_save (session, openssl->session_key);
+   } else {
+      if (openssl->pending_session) {
+         SSL_SESSION_free (openssl->pending_session);
+      }
+
+      openssl->pending_session = session;
+   }
+
+   return 1;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_stream_tls_openssl_resume_session --
+ *
+ *       Offer the last session saved for @host_and_port in this client
+ *       stream's handshake, and save the session it negotiates. Call
+ *       before the handshake. Without this, the stream neither resumes
+ *       nor saves sessions.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_stream_tls_openssl_resume_session (mongoc_stream_t *stream,
+                                           const char      *host_and_port)
+{
+   mongoc_stream_tls_t *tls = (mongoc_stream_tls_t *) stream;
+   mongoc_stream_tls_openssl_t *openssl;
+   SSL *ssl;
+
+   BSON_ASSERT (tls);
+   BSON_ASSERT (host_and_port);
+
+   openssl = (mongoc_stream_tls_openssl_t *) tls->ctx;
+   BIO_get_ssl (openssl->bio, &ssl);
+
+   bson_free (openssl->session_key);
+   openssl->session_key = _mongoc_stream_tls_openssl_session_key (
+      host_and_port, &tls->ssl_opts);
+
+   _mongoc_openssl_session_resume (ssl, openssl->session_key);
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -661,6 +780,15 @@ mongoc_stream_tls_openssl_new (mongoc_stream_t  *base_stream,
       SSL_CTX_set_verify (ssl_ctx, SSL_VERIFY_PEER, NULL);
    }
 
+   if (client) {
+      /* sessions are kept in our own cache, see
+       * _mongoc_stream_tls_openssl_resume_session */
+      SSL_CTX_set_session_cache_mode (
+         ssl_ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+      SSL_CTX_sess_set_new_cb (ssl_ctx,
+                               _mongoc_stream_tls_openssl_new_session);
+   }
+
    bio_ssl = BIO_new_ssl (ssl_ctx, client);
    if (!bio_ssl) {
       SSL_CTX_free (ssl_ctx);
@@ -682,6 +810,13 @@ mongoc_stream_tls_openssl_new (mongoc_stream_t  *base_stream,
    openssl->meth = meth;
    openssl->ctx = ssl_ctx;
 
+   if (client) {
+      SSL *ssl;
+
+      BIO_get_ssl (bio_ssl, &ssl);
+      SSL_set_app_data (ssl, openssl);
+   }
+
    tls = (mongoc_stream_tls_t *)bson_malloc0 (sizeof *tls);
    tls->parent.type = MONGOC_STREAM_TLS;
    tls->parent.destroy = _mongoc_stream_tls_openssl_destroy;
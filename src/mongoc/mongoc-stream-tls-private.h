@@ -23,6 +23,7 @@
 
 #include <bson.h>
 
+#include "mongoc-host-list.h"
 #include "mongoc-ssl.h"
 #include "mongoc-stream.h"
 
@@ -49,6 +50,11 @@ struct _mongoc_stream_tls_t
 };
 
 
+void
+_mongoc_stream_tls_resume_session (mongoc_stream_t          *stream,
+                                   const mongoc_host_list_t *host);
+
+
 BSON_END_DECLS
 
 #endif /* MONGOC_STREAM_TLS_PRIVATE_H */
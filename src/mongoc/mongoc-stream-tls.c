@@ -31,6 +31,7 @@
 #if defined(MONGOC_ENABLE_SSL_OPENSSL)
 # include "mongoc-stream-tls-openssl.h"
 # include "mongoc-openssl-private.h"
+# include "mongoc-stream-tls-openssl-private.h"
 #elif defined(MONGOC_ENABLE_SSL_LIBRESSL)
 # include "mongoc-libressl-private.h"
 # include "mongoc-stream-tls-libressl.h"
@@ -224,6 +225,30 @@ mongoc_stream_tls_new_with_hostname (mongoc_stream_t  *base_stream,
 #endif
 }
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_stream_tls_resume_session --
+ *
+ *       Tell a new client stream which server it connects to, so it can
+ *       resume that server's last TLS session. Only the OpenSSL stream
+ *       resumes sessions; the others ignore this.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_stream_tls_resume_session (mongoc_stream_t          *stream,
+                                   const mongoc_host_list_t *host)
+{
+   BSON_ASSERT (stream);
+   BSON_ASSERT (host);
+
+#if defined(MONGOC_ENABLE_SSL_OPENSSL)
+   _mongoc_stream_tls_openssl_resume_session (stream, host->host_and_port);
+#endif
+}
+
 mongoc_stream_t *
 mongoc_stream_tls_new (mongoc_stream_t  *base_stream,
                        mongoc_ssl_opt_t *opt,
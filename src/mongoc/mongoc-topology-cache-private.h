@@ -0,0 +1,50 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_TOPOLOGY_CACHE_PRIVATE_H
+#define MONGOC_TOPOLOGY_CACHE_PRIVATE_H
+
+#if !defined (MONGOC_COMPILATION)
+#error "Only <mongoc.h> can be included directly."
+#endif
+
+#include <bson.h>
+
+#include "mongoc-topology-private.h"
+
+/* a cache file older than this is ignored */
+#define MONGOC_TOPOLOGY_CACHE_MAX_AGE_SEC 600
+
+
+BSON_BEGIN_DECLS
+
+
+bool _mongoc_topology_cache_load     (mongoc_topology_t *topology);
+
+void _mongoc_topology_cache_save     (mongoc_topology_t *topology);
+
+void _mongoc_topology_cache_distrust (mongoc_topology_t *topology);
+
+bool _mongoc_topology_cache_unverified (
+   mongoc_topology_t                *topology,
+   uint32_t                          server_id,
+   mongoc_server_description_type_t *type);
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_TOPOLOGY_CACHE_PRIVATE_H */
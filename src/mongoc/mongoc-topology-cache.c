@@ -0,0 +1,481 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#ifdef _WIN32
+# include <io.h>
+# include <process.h>
+#else
+# include <unistd.h>
+#endif
+
+#include "mongoc-log.h"
+#include "mongoc-trace-private.h"
+#include "mongoc-topology-cache-private.h"
+#include "mongoc-server-description-private.h"
+#include "utlist.h"
+
+#undef MONGOC_LOG_DOMAIN
+#define MONGOC_LOG_DOMAIN "topology_cache"
+
+/* The topology cache is a file holding one BSON document:
+ *
+ *   { "seeds": "host:port,host:port/replicaSet",
+ *     "savedAt": <seconds since the epoch>,
+ *     "servers": [ { "address": "host:port",
+ *                    "rtt": <msec>,
+ *                    "ismaster": { <last ismaster reply> } }, ... ] }
+ *
+ * A cache written for other seeds, or older than
+ * MONGOC_TOPOLOGY_CACHE_MAX_AGE_SEC, is ignored. The URI itself isn't
+ * stored, it may hold credentials; the file is only readable by its owner.
+ */
+
+
+/* the URI's hosts and replicaSet, which determine the topology */
+static char *
+_mongoc_topology_cache_seeds (mongoc_topology_t *topology)
+{
+   const mongoc_host_list_t *host;
+   const char *replica_set;
+   bson_string_t *seeds;
+
+   seeds = bson_string_new (NULL);
+
+   for (host = mongoc_uri_get_hosts (topology->uri); host; host = host->next) {
+      bson_string_append_printf (seeds, "%s%s", seeds->len ? "," : "",
+                                 host->host_and_port);
+   }
+
+   replica_set = mongoc_uri_get_replica_set (topology->uri);
+   bson_string_append_printf (seeds, "/%s", replica_set ? replica_set : "");
+
+   return bson_string_free (seeds, false);
+}
+
+
+static bool
+_mongoc_topology_cache_matches (mongoc_topology_t *topology,
+                                const bson_t      *doc)
+{
+   bson_iter_t iter;
+   int64_t saved_at;
+   char *seeds;
+   bool match;
+
+   if (!bson_iter_init_find (&iter, doc, "seeds") ||
+       !BSON_ITER_HOLDS_UTF8 (&iter)) {
+      return false;
+   }
+
+   seeds = _mongoc_topology_cache_seeds (topology);
+   match = !strcmp (bson_iter_utf8 (&iter, NULL), seeds);
+   bson_free (seeds);
+
+   if (!match) {
+      return false;
+   }
+
+   if (!bson_iter_init_find (&iter, doc, "savedAt") ||
+       !BSON_ITER_HOLDS_INT64 (&iter)) {
+      return false;
+   }
+
+   saved_at = bson_iter_int64 (&iter);
+
+   return saved_at <= (int64_t) time (NULL) &&
+          (int64_t) time (NULL) - saved_at < MONGOC_TOPOLOGY_CACHE_MAX_AGE_SEC;
+}
+
+
+static bool
+_mongoc_topology_cache_add_nodes (void *item,
+                                  void *ctx)
+{
+   mongoc_server_description_t *sd = (mongoc_server_description_t *) item;
+   mongoc_topology_scanner_t *scanner = (mongoc_topology_scanner_t *) ctx;
+
+   if (!mongoc_topology_scanner_get_node (scanner, sd->id)) {
+      mongoc_topology_scanner_add (scanner, &sd->host, sd->id);
+   }
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_topology_cache_reconcile --
+ *
+ *      Like mongoc_topology_reconcile, but only add and retire scanner
+ *      nodes; nothing is scanned until the first server selection.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_topology_cache_reconcile (mongoc_topology_t *topology)
+{
+   mongoc_topology_scanner_node_t *ele, *tmp;
+
+   mongoc_set_for_each (topology->description.servers,
+                        _mongoc_topology_cache_add_nodes,
+                        topology->scanner);
+
+   DL_FOREACH_SAFE (topology->scanner->nodes, ele, tmp) {
+      if (!mongoc_topology_description_server_by_id (&topology->description,
+                                                     ele->id, NULL)) {
+         mongoc_topology_scanner_node_retire (ele);
+      }
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_topology_cache_load --
+ *
+ *      Seed @topology's description from its cache file, as though each
+ *      cached ismaster reply had just been received. Called from
+ *      mongoc_topology_new, before the topology is shared.
+ *
+ *      Until a full scan confirms the cached state, the topology is
+ *      "unverified": a server whose handshake disagrees with the cache
+ *      makes the client distrust the cache and select again after a
+ *      real scan, see _mongoc_topology_cache_distrust.
+ *
+ * Returns:
+ *      true if any server was seeded from the cache.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_topology_cache_load (mongoc_topology_t *topology)
+{
+   bson_reader_t *reader;
+   const bson_t *doc;
+   bson_error_t error;
+   bson_error_t no_error = { 0 };
+   bson_iter_t iter;
+   bson_iter_t servers;
+   bson_iter_t server;
+   bson_t ismaster;
+   bool has_ismaster;
+   const char *address;
+   const uint8_t *data;
+   uint32_t len;
+   int64_t rtt_msec;
+   uint32_t id;
+   int n_seeded = 0;
+
+   ENTRY;
+
+   BSON_ASSERT (topology);
+   BSON_ASSERT (topology->cache_path);
+
+   reader = bson_reader_new_from_file (topology->cache_path, &error);
+   if (!reader) {
+      /* no cache yet */
+      TRACE ("%s", error.message);
+      RETURN (false);
+   }
+
+   doc = bson_reader_read (reader, NULL);
+
+   if (!doc || !_mongoc_topology_cache_matches (topology, doc)) {
+      GOTO (done);
+   }
+
+   if (!bson_iter_init_find (&iter, doc, "servers") ||
+       !BSON_ITER_HOLDS_ARRAY (&iter) ||
+       !bson_iter_recurse (&iter, &servers)) {
+      GOTO (done);
+   }
+
+   while (bson_iter_next (&servers)) {
+      if (!BSON_ITER_HOLDS_DOCUMENT (&servers) ||
+          !bson_iter_recurse (&servers, &server)) {
+         continue;
+      }
+
+      address = NULL;
+      rtt_msec = -1;
+      has_ismaster = false;
+
+      while (bson_iter_next (&server)) {
+         if (!strcmp (bson_iter_key (&server), "address") &&
+             BSON_ITER_HOLDS_UTF8 (&server)) {
+            address = bson_iter_utf8 (&server, NULL);
+         } else if (!strcmp (bson_iter_key (&server), "rtt") &&
+                    BSON_ITER_HOLDS_INT64 (&server)) {
+            rtt_msec = bson_iter_int64 (&server);
+         } else if (!strcmp (bson_iter_key (&server), "ismaster") &&
+                    BSON_ITER_HOLDS_DOCUMENT (&server)) {
+            bson_iter_document (&server, &len, &data);
+            has_ismaster = bson_init_static (&ismaster, data, len);
+         }
+      }
+
+      if (!address || !has_ismaster || rtt_msec < 0) {
+         continue;
+      }
+
+      mongoc_topology_description_add_server (&topology->description,
+                                              address, &id);
+      mongoc_topology_description_handle_ismaster (&topology->description,
+                                                   id, &ismaster, rtt_msec,
+                                                   &no_error);
+      n_seeded++;
+   }
+
+   if (n_seeded) {
+      _mongoc_topology_cache_reconcile (topology);
+
+      /* selection trusts the cache until the next heartbeat */
+      topology->last_scan = bson_get_monotonic_time ();
+      topology->cache_unverified = true;
+   }
+
+done:
+   bson_reader_destroy (reader);
+
+   RETURN (n_seeded > 0);
+}
+
+
+static bool
+_mongoc_topology_cache_append_server (void *item,
+                                      void *ctx)
+{
+   mongoc_server_description_t *sd = (mongoc_server_description_t *) item;
+   bson_t *servers = (bson_t *) ctx;
+   bson_t server;
+   char str[16];
+   const char *key;
+
+   if (sd->type == MONGOC_SERVER_UNKNOWN || sd->round_trip_time_msec < 0) {
+      return true;
+   }
+
+   bson_uint32_to_string (bson_count_keys (servers), &key, str, sizeof str);
+   bson_append_document_begin (servers, key, -1, &server);
+   BSON_APPEND_UTF8 (&server, "address", sd->host.host_and_port);
+   BSON_APPEND_INT64 (&server, "rtt", sd->round_trip_time_msec);
+   BSON_APPEND_DOCUMENT (&server, "ismaster", &sd->last_is_master);
+   bson_append_document_end (servers, &server);
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_topology_cache_save --
+ *
+ *      Write @topology's known servers to its cache file, if it has one.
+ *      The file is replaced whole so a concurrent reader never sees a
+ *      partial write, by a temporary file that only the user can read.
+ *      Failure only logs a warning.
+ *
+ *      NOTE: this method uses @topology's mutex.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_topology_cache_save (mongoc_topology_t *topology)
+{
+   bson_t doc = BSON_INITIALIZER;
+   bson_t servers;
+   uint32_t n_servers;
+   char *seeds;
+   char *tmp_path;
+   FILE *f = NULL;
+   int fd;
+   int pid;
+   bool r;
+
+   ENTRY;
+
+   BSON_ASSERT (topology);
+
+   if (!topology->cache_path) {
+      EXIT;
+   }
+
+   seeds = _mongoc_topology_cache_seeds (topology);
+   BSON_APPEND_UTF8 (&doc, "seeds", seeds);
+   bson_free (seeds);
+   BSON_APPEND_INT64 (&doc, "savedAt", (int64_t) time (NULL));
+   bson_append_array_begin (&doc, "servers", 7, &servers);
+
+   mongoc_mutex_lock (&topology->mutex);
+   mongoc_set_for_each (topology->description.servers,
+                        _mongoc_topology_cache_append_server,
+                        &servers);
+   mongoc_mutex_unlock (&topology->mutex);
+
+   n_servers = bson_count_keys (&servers);
+   bson_append_array_end (&doc, &servers);
+
+   if (!n_servers) {
+      /* don't replace a useful cache with an empty one */
+      bson_destroy (&doc);
+      EXIT;
+   }
+
+#ifdef _WIN32
+   pid = (int) _getpid ();
+#else
+   pid = (int) getpid ();
+#endif
+
+   /* a new file: never follow a link or reuse another writer's file */
+   tmp_path = bson_strdup_printf ("%s.%d.tmp", topology->cache_path, pid);
+#ifdef _WIN32
+   fd = _open (tmp_path, _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY,
+               _S_IREAD | _S_IWRITE);
+   if (fd != -1) {
+      f = _fdopen (fd, "wb");
+   }
+#else
+   fd = open (tmp_path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+   if (fd != -1) {
+      f = fdopen (fd, "wb");
+   }
+#endif
+
+   if (fd != -1 && !f) {
+#ifdef _WIN32
+      _close (fd);
+#else
+      close (fd);
+#endif
+   }
+
+   r = f && fwrite (bson_get_data (&doc), 1, doc.len, f) == doc.len;
+
+   if (f && fclose (f) != 0) {
+      r = false;
+   }
+
+#ifdef _WIN32
+   /* rename doesn't replace an existing file on Windows */
+   if (r) {
+      remove (topology->cache_path);
+   }
+#endif
+
+   if (!r || rename (tmp_path, topology->cache_path) != 0) {
+      MONGOC_WARNING ("Couldn't write topology cache \"%s\"",
+                      topology->cache_path);
+      if (fd != -1) {
+         /* ours to remove, an existing file isn't */
+         remove (tmp_path);
+      }
+   }
+
+   bson_free (tmp_path);
+   bson_destroy (&doc);
+
+   EXIT;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_topology_cache_distrust --
+ *
+ *      A server disagreed with the cache: stop trusting cached state and
+ *      have the next server selection wait for a real scan.
+ *
+ *      NOTE: this method uses @topology's mutex.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_topology_cache_distrust (mongoc_topology_t *topology)
+{
+   BSON_ASSERT (topology);
+
+   mongoc_mutex_lock (&topology->mutex);
+
+   topology->cache_unverified = false;
+
+   if (topology->single_threaded) {
+      /* scan now, without waiting out the minimum heartbeat interval */
+      topology->last_scan = 0;
+      topology->stale = true;
+   } else {
+      topology->scan_requested = true;
+      mongoc_cond_signal (&topology->cond_server);
+   }
+
+   mongoc_mutex_unlock (&topology->mutex);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_topology_cache_unverified --
+ *
+ *      Whether servers are being selected from the cache, before any
+ *      heartbeat has confirmed it. If so, sets @type to the cached type
+ *      of @server_id, or MONGOC_SERVER_UNKNOWN.
+ *
+ *      NOTE: this method uses @topology's mutex, if it has a cache file.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_topology_cache_unverified (mongoc_topology_t                *topology,
+                                   uint32_t                          server_id,
+                                   mongoc_server_description_type_t *type)
+{
+   mongoc_server_description_t *sd;
+   bool unverified;
+
+   BSON_ASSERT (topology);
+   BSON_ASSERT (type);
+
+   /* set once in mongoc_topology_new */
+   if (!topology->cache_path) {
+      return false;
+   }
+
+   mongoc_mutex_lock (&topology->mutex);
+   unverified = topology->cache_unverified;
+   if (unverified) {
+      sd = mongoc_topology_description_server_by_id (&topology->description,
+                                                     server_id, NULL);
+      *type = sd ? sd->type : MONGOC_SERVER_UNKNOWN;
+   }
+   mongoc_mutex_unlock (&topology->mutex);
+
+   return unverified;
+}
@@ -52,6 +52,9 @@ struct _mongoc_topology_description_t
 
    mongoc_apm_callbacks_t             apm_callbacks;
    void                              *apm_context;
+
+   mongoc_server_selection_policy_t   selection_policy;
+   void                              *selection_policy_context;
 };
 
 typedef enum
@@ -131,6 +131,8 @@ _mongoc_topology_description_copy_to (const mongoc_topology_description_t *src,
            sizeof (mongoc_apm_callbacks_t));
 
    dst->apm_context = src->apm_context;
+   dst->selection_policy = src->selection_policy;
+   dst->selection_policy_context = src->selection_policy_context;
 
    EXIT;
 }
@@ -768,7 +770,18 @@ mongoc_topology_description_select (mongoc_topology_description_t *topology,
    mongoc_topology_description_suitable_servers (&suitable_servers, optype,
                                                  topology, read_pref,
                                                  local_threshold_ms);
-   if (suitable_servers.len != 0) {
+   if (suitable_servers.len != 0 && topology->selection_policy) {
+      /* the built-in policy draws from the topology's seed, like below */
+      sd = topology->selection_policy (
+         (mongoc_server_description_t **) suitable_servers.data,
+         suitable_servers.len,
+         topology->selection_policy ==
+               mongoc_server_selection_policy_power_of_two
+            ? (void *) &topology->rand_seed
+            : topology->selection_policy_context);
+   }
+
+   if (suitable_servers.len != 0 && !sd) {
       rand_n = MONGOC_RAND_R (&topology->rand_seed);
       sd = _mongoc_array_index(&suitable_servers, mongoc_server_description_t*,
                                rand_n % suitable_servers.len);
@@ -785,6 +798,84 @@ mongoc_topology_description_select (mongoc_topology_description_t *topology,
    RETURN (sd);
 }
 
+
+/* expected cost of sending one more operation to @sd, lower is better */
+static int64_t
+_mongoc_server_load_score (const mongoc_server_description_t *sd)
+{
+   int64_t latency_usec;
+
+   latency_usec = sd->load.p50_usec;
+   if (latency_usec < 0) {
+      /* no operations yet, estimate from the heartbeat */
+      latency_usec = BSON_MAX (sd->round_trip_time_msec, 0) * 1000;
+   }
+
+   return (sd->load.in_flight + 1) * BSON_MAX (latency_usec, 1);
+}
+
+
+/*
+ *-------------------------------------------------------------------------
+ *
+ * mongoc_server_selection_policy_power_of_two --
+ *
+ *      A server selection policy that samples two random candidates and
+ *      picks the one with the lower expected cost: its in-flight operation
+ *      count times its median operation latency. Ties go to the server
+ *      with the lower 99th percentile latency.
+ *
+ *      Pass to mongoc_client_set_server_selection_policy or
+ *      mongoc_client_pool_set_server_selection_policy. The topology then
+ *      passes its random seed as @context; if @context is NULL, a seed is
+ *      made from the clock.
+ *
+ * Returns:
+ *      One of @candidates.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+mongoc_server_description_t *
+mongoc_server_selection_policy_power_of_two (
+   mongoc_server_description_t **candidates,
+   size_t                        n_candidates,
+   void                         *context)
+{
+   unsigned int local_seed;
+   unsigned int *seed = (unsigned int *) context;
+   size_t a;
+   size_t b;
+   int64_t score_a;
+   int64_t score_b;
+
+   BSON_ASSERT (candidates);
+
+   if (n_candidates == 1) {
+      return candidates[0];
+   }
+
+   if (!seed) {
+      local_seed = (unsigned int) bson_get_monotonic_time ();
+      seed = &local_seed;
+   }
+
+   a = (size_t) MONGOC_RAND_R (seed) % n_candidates;
+   /* a different server than "a" */
+   b = (a + 1 + (size_t) MONGOC_RAND_R (seed) % (n_candidates - 1))
+       % n_candidates;
+
+   score_a = _mongoc_server_load_score (candidates[a]);
+   score_b = _mongoc_server_load_score (candidates[b]);
+
+   if (score_a == score_b) {
+      return candidates[a]->load.p99_usec <= candidates[b]->load.p99_usec ?
+             candidates[a] : candidates[b];
+   }
+
+   return score_a < score_b ? candidates[a] : candidates[b];
+}
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -17,6 +17,7 @@
 #ifndef MONGOC_TOPOLOGY_PRIVATE_H
 #define MONGOC_TOPOLOGY_PRIVATE_H
 
+#include "mongoc-connection-stats-private.h"
 #include "mongoc-read-prefs-private.h"
 #include "mongoc-topology-scanner-private.h"
 #include "mongoc-server-description-private.h"
@@ -61,6 +62,17 @@ typedef struct _mongoc_topology_t
    bool                               shutdown_requested;
    bool                               single_threaded;
    bool                               stale;
+
+   /* set with a server selection policy, see mongoc_topology_op_started.
+    * written with the mutex held, read atomically without it */
+   volatile int32_t                   track_server_load;
+
+   /* the application's connections, see mongoc_client_get_connection_stats */
+   mongoc_connection_stats_t         *connection_stats;
+
+   /* see mongoc-topology-cache.c */
+   char                              *cache_path;
+   bool                               cache_unverified;
 } mongoc_topology_t;
 
 mongoc_topology_t *
@@ -72,6 +84,12 @@ mongoc_topology_set_apm_callbacks (mongoc_topology_t      *topology,
                                    mongoc_apm_callbacks_t *callbacks,
                                    void                   *context);
 
+void
+mongoc_topology_set_server_selection_policy (
+   mongoc_topology_t                *topology,
+   mongoc_server_selection_policy_t  policy,
+   void                             *context);
+
 void
 mongoc_topology_destroy (mongoc_topology_t *topology);
 
@@ -107,6 +125,16 @@ mongoc_topology_invalidate_server (mongoc_topology_t  *topology,
                                    uint32_t            id,
                                    const bson_error_t *error);
 
+void
+mongoc_topology_op_started (mongoc_topology_t *topology,
+                            uint32_t           id);
+
+void
+mongoc_topology_op_finished (mongoc_topology_t *topology,
+                             uint32_t           id,
+                             int64_t            duration_usec,
+                             bool               succeeded);
+
 bool
 _mongoc_topology_update_from_handshake (mongoc_topology_t                 *topology,
                                         const mongoc_server_description_t *sd);
@@ -28,11 +28,20 @@
 #include "mongoc-async-cmd-private.h"
 #include "mongoc-host-list.h"
 #include "mongoc-apm-private.h"
+#include "mongoc-connection-stats-private.h"
 
 #ifdef MONGOC_ENABLE_SSL
 #include "mongoc-ssl.h"
 #endif
 
+/* RFC 8305 "Connection Attempt Delay": how long to wait for a connection to
+ * one of a host's addresses before also trying the next */
+#define MONGOC_TOPOLOGY_CONNECTION_ATTEMPT_DELAY_MS 250
+
+/* most threads resolving host names at once during a scan, counting the
+ * scanning thread itself */
+#define MONGOC_TOPOLOGY_SCANNER_RESOLVE_THREADS 4
+
 BSON_BEGIN_DECLS
 
 typedef void (*mongoc_topology_scanner_setup_err_cb_t)(uint32_t            id,
@@ -55,6 +64,8 @@ typedef struct mongoc_topology_scanner_node
    int64_t                         timestamp;
    int64_t                         last_used;
    int64_t                         last_failed;
+   /* when the last check began, not counting awaitable re-checks */
+   int64_t                         checked_at;
    bool                            has_auth;
    mongoc_host_list_t              host;
    struct addrinfo                *dns_results;
@@ -66,6 +77,22 @@ typedef struct mongoc_topology_scanner_node
 
    bool                            retired;
    bson_error_t                    last_error;
+
+   /* connections racing to the host's addresses, while it has no stream */
+   int                             n_attempts;
+
+   /* streaming monitoring: the server's last topologyVersion, if any. while
+    * set, ismaster is awaitable and rtt is measured on rtt_stream instead */
+   bson_t                          topology_version;
+   bool                            has_topology_version;
+   mongoc_stream_t                *rtt_stream;
+   mongoc_async_cmd_t             *rtt_cmd;
+   int64_t                         rtt_msec;
+
+   /* stream's connection stats, if the scanner has connection_stats */
+   mongoc_connection_stats_conn_t  conn;
+   /* the server's keyed counter group, looked up on first use */
+   mongoc_counter_slots_t         *keyed_counters;
 } mongoc_topology_scanner_node_t;
 
 typedef struct mongoc_topology_scanner
@@ -87,6 +114,9 @@ typedef struct mongoc_topology_scanner
    mongoc_stream_initiator_t               initiator;
    void                                   *initiator_context;
    bson_error_t                            error;
+   int64_t                                 max_await_time_msec;
+   /* the current checks' connect and ismaster timeout */
+   int64_t                                 check_timeout_msec;
 
 #ifdef MONGOC_ENABLE_SSL
    mongoc_ssl_opt_t *ssl_opts;
@@ -94,6 +124,9 @@ typedef struct mongoc_topology_scanner
 
    mongoc_apm_callbacks_t          apm_callbacks;
    void                           *apm_context;
+
+   /* set if single-threaded, when node streams are the client's */
+   mongoc_connection_stats_t      *connection_stats;
 } mongoc_topology_scanner_t;
 
 mongoc_topology_scanner_t *
@@ -132,6 +165,11 @@ mongoc_topology_scanner_start (mongoc_topology_scanner_t *ts,
                                int64_t timeout_msec,
                                bool obey_cooldown);
 
+void
+mongoc_topology_scanner_start_due (mongoc_topology_scanner_t *ts,
+                                   int64_t                    timeout_msec,
+                                   int64_t                    interval_msec);
+
 void
 mongoc_topology_scanner_work (mongoc_topology_scanner_t *ts,
                               int64_t                    timeout_msec);
@@ -162,6 +200,13 @@ void
 mongoc_topology_scanner_set_stream_initiator (mongoc_topology_scanner_t *ts,
                                               mongoc_stream_initiator_t  si,
                                               void                      *ctx);
+void
+mongoc_topology_scanner_set_max_await_time (mongoc_topology_scanner_t *ts,
+                                            int64_t                    max_await_time_msec);
+
+bool
+mongoc_topology_scanner_is_streaming (mongoc_topology_scanner_t *ts);
+
 bool
 _mongoc_topology_scanner_set_appname (mongoc_topology_scanner_t *ts,
                                       const char                *name);
@@ -28,24 +28,52 @@
 
 #ifdef MONGOC_ENABLE_SSL
 #include "mongoc-stream-tls.h"
+#include "mongoc-stream-tls-private.h"
 #endif
 
 #include "mongoc-counters-private.h"
+#include "mongoc-dns-cache-private.h"
+#include "mongoc-thread-private.h"
 #include "utlist.h"
 #include "mongoc-topology-private.h"
 #include "mongoc-host-list-private.h"
+#include "mongoc-memory-private.h"
 
 #undef MONGOC_LOG_DOMAIN
 #define MONGOC_LOG_DOMAIN "topology_scanner"
 
 /* forward declarations */
 static void
-mongoc_topology_scanner_ismaster_handler (mongoc_async_cmd_result_t async_status,
+mongoc_topology_scanner_ismaster_handler (mongoc_async_cmd_t       *acmd,
+                                          mongoc_async_cmd_result_t async_status,
                                           const bson_t             *ismaster_response,
                                           int64_t                   rtt_msec,
                                           void                     *data,
                                           bson_error_t             *error);
 
+static void
+mongoc_topology_scanner_rtt_handler (mongoc_async_cmd_t       *acmd,
+                                     mongoc_async_cmd_result_t async_status,
+                                     const bson_t             *ismaster_response,
+                                     int64_t                   rtt_msec,
+                                     void                     *data,
+                                     bson_error_t             *error);
+
+static mongoc_stream_t *
+mongoc_topology_scanner_node_connect (mongoc_topology_scanner_node_t *node,
+                                      bson_error_t                   *error);
+
+static void
+_mongoc_topology_scanner_check_nodes (mongoc_topology_scanner_t       *ts,
+                                      mongoc_topology_scanner_node_t **nodes,
+                                      size_t                           n_nodes,
+                                      int64_t                          timeout_msec);
+
+static void
+_mongoc_topology_scanner_node_set_topology_version (
+   mongoc_topology_scanner_node_t *node,
+   const bson_t                   *ismaster_response);
+
 static void
 _mongoc_topology_scanner_monitor_heartbeat_started (const mongoc_topology_scanner_t *ts,
                                                     const mongoc_host_list_t        *host);
@@ -110,12 +138,95 @@ _get_ismaster_doc (mongoc_topology_scanner_t      *ts,
    return &ts->ismaster_cmd_with_handshake;
 }
 
+static bool
+_is_awaitable (mongoc_topology_scanner_t      *ts,
+               mongoc_topology_scanner_node_t *node)
+{
+   return ts->max_await_time_msec > 0 && node->has_topology_version;
+}
+
+/* whether a connection attempt or plain ismaster is still running */
+static bool
+_mongoc_topology_scanner_checking (mongoc_topology_scanner_t *ts)
+{
+   mongoc_topology_scanner_node_t *node;
+
+   DL_FOREACH (ts->nodes, node) {
+      if (node->n_attempts > 0 || (node->cmd && !_is_awaitable (ts, node))) {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _begin_rtt_cmd --
+ *
+ *      While a node's ismaster is awaitable, its reply time says nothing
+ *      about the network, so measure round trip time with a plain
+ *      ismaster on a second connection.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_begin_rtt_cmd (mongoc_topology_scanner_t      *ts,
+                mongoc_topology_scanner_node_t *node,
+                int64_t                         timeout_msec)
+{
+   bson_error_t error;
+
+   if (node->rtt_cmd) {
+      return;
+   }
+
+   if (!node->rtt_stream) {
+      node->rtt_stream = mongoc_topology_scanner_node_connect (node, &error);
+      if (!node->rtt_stream) {
+         /* not fatal, the awaitable ismaster reports on the server */
+         return;
+      }
+   }
+
+   node->rtt_cmd = mongoc_async_cmd (
+      ts->async, node->rtt_stream, ts->setup,
+      node->host.host, "admin",
+      &ts->ismaster_cmd,
+      &mongoc_topology_scanner_rtt_handler,
+      node, timeout_msec);
+}
+
 static void
 _begin_ismaster_cmd (mongoc_topology_scanner_t      *ts,
                      mongoc_topology_scanner_node_t *node,
                      int64_t                         timeout_msec)
 {
    const bson_t *ismaster_cmd_to_send = _get_ismaster_doc (ts, node);
+   bson_t awaitable_cmd;
+
+   if (_is_awaitable (ts, node)) {
+      /* the server replies when its topologyVersion changes or after
+       * maxAwaitTimeMS, allow for both */
+      bson_copy_to (ismaster_cmd_to_send, &awaitable_cmd);
+      BSON_APPEND_DOCUMENT (&awaitable_cmd, "topologyVersion",
+                            &node->topology_version);
+      BSON_APPEND_INT64 (&awaitable_cmd, "maxAwaitTimeMS",
+                         ts->max_await_time_msec);
+
+      node->cmd = mongoc_async_cmd (
+         ts->async, node->stream, ts->setup,
+         node->host.host, "admin",
+         &awaitable_cmd,
+         &mongoc_topology_scanner_ismaster_handler,
+         node, timeout_msec + ts->max_await_time_msec);
+
+      bson_destroy (&awaitable_cmd);
+      _begin_rtt_cmd (ts, node, timeout_msec);
+      return;
+   }
 
    node->cmd = mongoc_async_cmd (
       ts->async, node->stream, ts->setup,
@@ -132,7 +243,8 @@ mongoc_topology_scanner_new (const mongoc_uri_t                     *uri,
                              mongoc_topology_scanner_cb_t            cb,
                              void                                   *data)
 {
-   mongoc_topology_scanner_t *ts = (mongoc_topology_scanner_t *)bson_malloc0 (sizeof (*ts));
+   mongoc_topology_scanner_t *ts = (mongoc_topology_scanner_t *)
+      _mongoc_memory_malloc0 (TOPOLOGY, sizeof (*ts));
 
    ts->async = mongoc_async_new ();
 
@@ -186,7 +298,7 @@ mongoc_topology_scanner_destroy (mongoc_topology_scanner_t *ts)
    /* This field can be set by a mongoc_client */
    bson_free ((char *) ts->appname);
 
-   bson_free (ts);
+   _mongoc_memory_free (ts);
 }
 
 mongoc_topology_scanner_node_t *
@@ -196,7 +308,8 @@ mongoc_topology_scanner_add (mongoc_topology_scanner_t *ts,
 {
    mongoc_topology_scanner_node_t *node;
 
-   node = (mongoc_topology_scanner_node_t *) bson_malloc0 (sizeof (*node));
+   node = (mongoc_topology_scanner_node_t *) _mongoc_memory_malloc0 (
+      TOPOLOGY, sizeof (*node));
 
    memcpy (&node->host, host, sizeof (*host));
 
@@ -204,6 +317,9 @@ mongoc_topology_scanner_add (mongoc_topology_scanner_t *ts,
    node->ts = ts;
    node->last_failed = -1;
    node->last_used = -1;
+   node->checked_at = -1;
+   node->rtt_msec = -1;
+   bson_init (&node->topology_version);
 
    DL_APPEND(ts->nodes, node);
 
@@ -223,20 +339,32 @@ mongoc_topology_scanner_add_and_scan (mongoc_topology_scanner_t *ts,
    node = mongoc_topology_scanner_add (ts, host, id);
 
    /* begin non-blocking connection, don't wait for success */
-   if (node && mongoc_topology_scanner_node_setup (node, &node->last_error)) {
-      _begin_ismaster_cmd (ts, node, timeout_msec);
+   if (node) {
+      _mongoc_topology_scanner_check_nodes (ts, &node, 1, timeout_msec);
    }
 
    /* if setup fails the node stays in the scanner. destroyed after the scan. */
    return;
 }
 
+/* cancel the node's ismasters and connection attempts, except @except */
+static void
+_mongoc_topology_scanner_node_cancel_cmds (mongoc_topology_scanner_node_t *node,
+                                           mongoc_async_cmd_t             *except)
+{
+   mongoc_async_cmd_t *acmd;
+
+   DL_FOREACH (node->ts->async->cmds, acmd) {
+      if (acmd->data == node && acmd != except) {
+         acmd->state = MONGOC_ASYNC_CMD_CANCELED_STATE;
+      }
+   }
+}
+
 void
 mongoc_topology_scanner_node_retire (mongoc_topology_scanner_node_t *node)
 {
-   if (node->cmd) {
-      node->cmd->state = MONGOC_ASYNC_CMD_CANCELED_STATE;
-   }
+   _mongoc_topology_scanner_node_cancel_cmds (node, NULL);
 
    node->retired = true;
 }
@@ -245,18 +373,30 @@ void
 mongoc_topology_scanner_node_disconnect (mongoc_topology_scanner_node_t *node,
                                          bool failed)
 {
+   mongoc_async_cmd_t *acmd, *tmp;
+
+   /* ismasters and connection attempts; they may refer to dns_results */
+   DL_FOREACH_SAFE (node->ts->async->cmds, acmd, tmp) {
+      if (acmd->data == node) {
+         mongoc_async_cmd_destroy (acmd);
+      }
+   }
+
+   node->cmd = NULL;
+   node->rtt_cmd = NULL;
+   node->n_attempts = 0;
+
    if (node->dns_results) {
-      freeaddrinfo (node->dns_results);
+      _mongoc_dns_results_destroy (node->dns_results);
       node->dns_results = NULL;
       node->current_dns_result = NULL;
    }
 
-   if (node->cmd) {
-      mongoc_async_cmd_destroy (node->cmd);
-      node->cmd = NULL;
-   }
-
    if (node->stream) {
+      _mongoc_connection_stats_closed (
+         &node->conn, failed ? MONGOC_CONNECTION_CLOSED_NETWORK_ERROR
+                             : MONGOC_CONNECTION_CLOSED_CLIENT);
+
       if (failed) {
          mongoc_stream_failed (node->stream);
       } else {
@@ -265,6 +405,11 @@ mongoc_topology_scanner_node_disconnect (mongoc_topology_scanner_node_t *node,
 
       node->stream = NULL;
    }
+
+   if (node->rtt_stream) {
+      mongoc_stream_destroy (node->rtt_stream);
+      node->rtt_stream = NULL;
+   }
 }
 
 void
@@ -272,7 +417,8 @@ mongoc_topology_scanner_node_destroy (mongoc_topology_scanner_node_t *node, bool
 {
    DL_DELETE (node->ts->nodes, node);
    mongoc_topology_scanner_node_disconnect (node, failed);
-   bson_free (node);
+   bson_destroy (&node->topology_version);
+   _mongoc_memory_free (node);
 }
 
 /*
@@ -329,17 +475,80 @@ mongoc_topology_scanner_has_node_for_host (mongoc_topology_scanner_t *ts,
    return false;
 }
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_topology_scanner_node_set_topology_version --
+ *
+ *      Remember the topologyVersion from @ismaster_response, or forget
+ *      the last one if @ismaster_response is NULL or has none. The next
+ *      ismaster sent to a node with a topologyVersion is awaitable.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_topology_scanner_node_set_topology_version (
+   mongoc_topology_scanner_node_t *node,
+   const bson_t                   *ismaster_response)
+{
+   bson_iter_t iter;
+   const uint8_t *data;
+   uint32_t len;
+   bson_t topology_version;
+
+   bson_reinit (&node->topology_version);
+   node->has_topology_version = false;
+
+   if (ismaster_response &&
+       bson_iter_init_find (&iter, ismaster_response, "topologyVersion") &&
+       BSON_ITER_HOLDS_DOCUMENT (&iter)) {
+      bson_iter_document (&iter, &len, &data);
+      if (bson_init_static (&topology_version, data, len)) {
+         bson_concat (&node->topology_version, &topology_version);
+         node->has_topology_version = true;
+      }
+   }
+}
+
+/* a connection attempt failed, start the next one without waiting out
+ * the connection attempt delay */
+static void
+_mongoc_topology_scanner_node_hurry_attempt (mongoc_topology_scanner_node_t *node)
+{
+   mongoc_async_cmd_t *acmd;
+   mongoc_async_cmd_t *next = NULL;
+
+   DL_FOREACH (node->ts->async->cmds, acmd) {
+      if (acmd->data == node &&
+          acmd->state == MONGOC_ASYNC_CMD_INITIATE &&
+          (!next || acmd->initiate_at < next->initiate_at)) {
+         next = acmd;
+      }
+   }
+
+   if (next) {
+      next->initiate_at = bson_get_monotonic_time ();
+   }
+}
+
 /*
  *-----------------------------------------------------------------------
  *
  * This is the callback passed to async_cmd when we're running
  * ismasters from within the topology monitor.
  *
+ * If the node has several addresses, it's also the callback for each
+ * connection attempt: the first to get an ismaster reply wins the
+ * race and becomes the node's stream, the rest are canceled. The node
+ * has failed only when its last attempt fails.
+ *
  *-----------------------------------------------------------------------
  */
 
 static void
-mongoc_topology_scanner_ismaster_handler (mongoc_async_cmd_result_t async_status,
+mongoc_topology_scanner_ismaster_handler (mongoc_async_cmd_t       *acmd,
+                                          mongoc_async_cmd_result_t async_status,
                                           const bson_t             *ismaster_response,
                                           int64_t                   rtt_msec,
                                           void                     *data,
@@ -349,25 +558,70 @@ mongoc_topology_scanner_ismaster_handler (mongoc_async_cmd_result_t async_status
    mongoc_topology_scanner_t *ts;
    int64_t now;
    const char *message;
+   bool awaited;
+   bool failed;
 
    BSON_ASSERT (data);
 
    node = (mongoc_topology_scanner_node_t *) data;
    ts = node->ts;
-   node->cmd = NULL;
+
+   if (node->cmd == acmd) {
+      node->cmd = NULL;
+   }
+
+   if (acmd->initiator) {
+      node->n_attempts--;
+   }
 
    if (node->retired) {
       return;
    }
 
    now = bson_get_monotonic_time ();
+   awaited = _is_awaitable (ts, node);
+   failed = (!ismaster_response ||
+             async_status == MONGOC_ASYNC_CMD_ERROR ||
+             async_status == MONGOC_ASYNC_CMD_TIMEOUT);
+
+   if (acmd->initiator) {
+      if (acmd->state == MONGOC_ASYNC_CMD_CANCELED_STATE) {
+         /* another attempt won */
+         return;
+      }
+
+      if (failed && node->n_attempts > 0) {
+         _mongoc_topology_scanner_node_hurry_attempt (node);
+         return;
+      }
+
+      if (!failed) {
+         /* take the winning attempt's stream */
+         node->stream = acmd->stream;
+         acmd->stream = NULL;
+         node->has_auth = false;
+         node->timestamp = now;
+
+         _mongoc_topology_scanner_node_cancel_cmds (node, acmd);
+      }
+   }
 
    /* if no ismaster response, async cmd had an error or timed out */
-   if (!ismaster_response ||
-       async_status == MONGOC_ASYNC_CMD_ERROR ||
-       async_status == MONGOC_ASYNC_CMD_TIMEOUT) {
-      mongoc_stream_failed (node->stream);
-      node->stream = NULL;
+   if (failed) {
+      if (node->conn.server) {
+         _mongoc_connection_stats_closed (
+            &node->conn, MONGOC_CONNECTION_CLOSED_NETWORK_ERROR);
+      } else if (acmd->initiator || node->stream) {
+         _mongoc_connection_stats_connect_failed (ts->connection_stats,
+                                                  node->id,
+                                                  node->host.host_and_port);
+      }
+
+      if (node->stream) {
+         mongoc_stream_failed (node->stream);
+         node->stream = NULL;
+      }
+
       node->last_failed = now;
       if (error->code) {
          message = error->message;
@@ -388,17 +642,122 @@ mongoc_topology_scanner_ismaster_handler (mongoc_async_cmd_result_t async_status
       
       _mongoc_topology_scanner_monitor_heartbeat_failed (ts, &node->host,
                                                          &node->last_error);
+
+      /* the next check is a plain ismaster on a new connection */
+      _mongoc_topology_scanner_node_set_topology_version (node, NULL);
    } else {
+      if (!node->conn.server) {
+         /* a new connection, from the winning attempt or from
+          * mongoc_topology_scanner_node_setup */
+         _mongoc_connection_stats_opened (
+            ts->connection_stats, &node->conn, node->id,
+            node->host.host_and_port,
+            acmd->initiator ? acmd->start_time : node->timestamp, false);
+      }
+
       node->last_failed = -1;
       _mongoc_topology_scanner_monitor_heartbeat_succeeded (ts, &node->host,
                                                             ismaster_response);
+
+      if (ts->max_await_time_msec > 0) {
+         _mongoc_topology_scanner_node_set_topology_version (
+            node, ismaster_response);
+      }
+
+      /* an awaited reply's rtt is mostly the server's wait */
+      if (awaited && node->rtt_msec != -1) {
+         rtt_msec = node->rtt_msec;
+      }
    }
 
    node->last_used = now;
    ts->cb (node->id, ismaster_response, rtt_msec, ts->cb_data, error);
+
+   /* streaming: await this server's next state change at once, rather than
+    * after the other servers' awaitable ismasters return */
+   if (!failed && !node->retired && !node->cmd && node->stream &&
+       _is_awaitable (ts, node)) {
+      _begin_ismaster_cmd (ts, node, ts->check_timeout_msec);
+   }
+}
+
+/*
+ *-----------------------------------------------------------------------
+ *
+ * This is the callback passed to async_cmd for the plain ismasters
+ * that measure round trip time while a node is streaming.
+ *
+ *-----------------------------------------------------------------------
+ */
+
+static void
+mongoc_topology_scanner_rtt_handler (mongoc_async_cmd_t       *acmd,
+                                     mongoc_async_cmd_result_t async_status,
+                                     const bson_t             *ismaster_response,
+                                     int64_t                   rtt_msec,
+                                     void                     *data,
+                                     bson_error_t             *error)
+{
+   mongoc_topology_scanner_node_t *node;
+
+   BSON_ASSERT (data);
+
+   node = (mongoc_topology_scanner_node_t *) data;
+   node->rtt_cmd = NULL;
+
+   if (node->retired) {
+      return;
+   }
+
+   if (!ismaster_response ||
+       async_status == MONGOC_ASYNC_CMD_ERROR ||
+       async_status == MONGOC_ASYNC_CMD_TIMEOUT) {
+      /* reconnect next time; the last measurement stands until then */
+      mongoc_stream_failed (node->rtt_stream);
+      node->rtt_stream = NULL;
+      return;
+   }
+
+   node->rtt_msec = rtt_msec;
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_topology_scanner_node_resolve --
+ *
+ *      Look up this node's addresses, unless we still have them from
+ *      the last connection. Lookups go through the DNS cache.
+ *
+ * Returns:
+ *      true on success, or false and error is set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_topology_scanner_node_resolve (mongoc_topology_scanner_node_t *node,
+                                       bson_error_t                   *error)
+{
+   if (node->dns_results) {
+      return true;
+   }
+
+   if (!_mongoc_dns_resolve (&node->host,
+                             mongoc_uri_get_option_as_int32 (
+                                node->ts->uri, "dnscachettlms",
+                                MONGOC_DNS_CACHE_TTL_MS),
+                             &node->dns_results,
+                             error)) {
+      return false;
+   }
+
+   node->current_dns_result = node->dns_results;
+
+   return true;
+}
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -418,40 +777,15 @@ mongoc_topology_scanner_node_connect_tcp (mongoc_topology_scanner_node_t *node,
                                           bson_error_t                   *error)
 {
    mongoc_socket_t *sock = NULL;
-   struct addrinfo hints;
    struct addrinfo *rp;
-   char portstr [8];
    mongoc_host_list_t *host;
-   int s;
 
    ENTRY;
 
    host = &node->host;
 
-   if (!node->dns_results) {
-      bson_snprintf (portstr, sizeof portstr, "%hu", host->port);
-
-      memset (&hints, 0, sizeof hints);
-      hints.ai_family = host->family;
-      hints.ai_socktype = SOCK_STREAM;
-      hints.ai_flags = 0;
-      hints.ai_protocol = 0;
-
-      s = getaddrinfo (host->host, portstr, &hints, &node->dns_results);
-
-      if (s != 0) {
-         mongoc_counter_dns_failure_inc ();
-         bson_set_error (error,
-                         MONGOC_ERROR_STREAM,
-                         MONGOC_ERROR_STREAM_NAME_RESOLUTION,
-                         "Failed to resolve '%s'",
-                         host->host);
-         RETURN (NULL);
-      }
-
-      node->current_dns_result = node->dns_results;
-
-      mongoc_counter_dns_success_inc ();
+   if (!_mongoc_topology_scanner_node_resolve (node, error)) {
+      RETURN (NULL);
    }
 
    for (; node->current_dns_result;
@@ -478,7 +812,7 @@ mongoc_topology_scanner_node_connect_tcp (mongoc_topology_scanner_node_t *node,
                       MONGOC_ERROR_STREAM_CONNECT,
                       "Failed to connect to target host: '%s'",
                       host->host_and_port);
-      freeaddrinfo (node->dns_results);
+      _mongoc_dns_results_destroy (node->dns_results);
       node->dns_results = NULL;
       node->current_dns_result = NULL;
       RETURN (NULL);
@@ -551,27 +885,58 @@ mongoc_topology_scanner_node_connect_unix (mongoc_topology_scanner_node_t *node,
 /*
  *--------------------------------------------------------------------------
  *
- * mongoc_topology_scanner_node_setup --
+ * _mongoc_topology_scanner_node_wrap_tls --
  *
- *      Create a stream and begin a non-blocking connect.
+ *      Wrap a socket stream to this node in TLS, if the scanner uses it.
  *
  * Returns:
- *      true on success, or false and error is set.
+ *      The wrapped stream, or NULL after destroying @sock_stream.
  *
  *--------------------------------------------------------------------------
  */
 
-bool
-mongoc_topology_scanner_node_setup (mongoc_topology_scanner_node_t *node,
-                                    bson_error_t                   *error)
+static mongoc_stream_t *
+_mongoc_topology_scanner_node_wrap_tls (mongoc_topology_scanner_node_t *node,
+                                        mongoc_stream_t                *sock_stream)
 {
-   mongoc_stream_t *sock_stream;
+#ifdef MONGOC_ENABLE_SSL
+   if (sock_stream && node->ts->ssl_opts) {
+      mongoc_stream_t *original = sock_stream;
+
+      sock_stream = mongoc_stream_tls_new_with_hostname (sock_stream,
+                                                         node->host.host,
+                                                         node->ts->ssl_opts, 1);
+      if (sock_stream) {
+         _mongoc_stream_tls_resume_session (sock_stream, &node->host);
+      } else {
+         mongoc_stream_destroy (original);
+      }
+   }
+#endif
 
-   _mongoc_topology_scanner_monitor_heartbeat_started (node->ts, &node->host);
+   return sock_stream;
+}
 
-   if (node->stream) { return true; }
 
-   BSON_ASSERT (!node->retired);
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_topology_scanner_node_connect --
+ *
+ *      Create a stream to this node's host and begin a non-blocking
+ *      connect.
+ *
+ * Returns:
+ *      A stream. On failure, return NULL and fill out the error.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static mongoc_stream_t *
+mongoc_topology_scanner_node_connect (mongoc_topology_scanner_node_t *node,
+                                      bson_error_t                   *error)
+{
+   mongoc_stream_t *sock_stream;
 
    if (node->ts->initiator) {
       sock_stream = node->ts->initiator (node->ts->uri, &node->host,
@@ -583,25 +948,186 @@ mongoc_topology_scanner_node_setup (mongoc_topology_scanner_node_t *node,
          sock_stream = mongoc_topology_scanner_node_connect_tcp (node, error);
       }
 
-#ifdef MONGOC_ENABLE_SSL
-      if (sock_stream && node->ts->ssl_opts) {
-         mongoc_stream_t *original = sock_stream;
-
-         sock_stream = mongoc_stream_tls_new_with_hostname (sock_stream,
-                                                            node->host.host,
-                                                            node->ts->ssl_opts, 1);
-         if (!sock_stream) {
-            mongoc_stream_destroy (original);
-         }
+      sock_stream = _mongoc_topology_scanner_node_wrap_tls (node, sock_stream);
+   }
+
+   return sock_stream;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_topology_scanner_tcp_initiate --
+ *
+ *      The stream initiator for a connection attempt: begin a
+ *      non-blocking connect to the attempt's address.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static mongoc_stream_t *
+_mongoc_topology_scanner_tcp_initiate (mongoc_async_cmd_t *acmd)
+{
+   mongoc_topology_scanner_node_t *node;
+   struct addrinfo *rp;
+   mongoc_socket_t *sock;
+   mongoc_stream_t *stream;
+
+   node = (mongoc_topology_scanner_node_t *) acmd->data;
+   rp = (struct addrinfo *) acmd->initiate_ctx;
+
+   sock = mongoc_socket_new (rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+   if (!sock) {
+      bson_set_error (&acmd->error,
+                      MONGOC_ERROR_STREAM,
+                      MONGOC_ERROR_STREAM_SOCKET,
+                      "Failed to create socket.");
+      return NULL;
+   }
+
+   mongoc_socket_connect (sock, rp->ai_addr, (socklen_t)rp->ai_addrlen, 0);
+
+   stream = _mongoc_topology_scanner_node_wrap_tls (
+      node, mongoc_stream_socket_new (sock));
+
+   if (!stream) {
+      bson_set_error (&acmd->error,
+                      MONGOC_ERROR_STREAM,
+                      MONGOC_ERROR_STREAM_CONNECT,
+                      "Failed to connect to target host: '%s'",
+                      node->host.host_and_port);
+   }
+
+   return stream;
+}
+
+
+static void
+_begin_ismaster_attempt (mongoc_topology_scanner_t      *ts,
+                         mongoc_topology_scanner_node_t *node,
+                         struct addrinfo                *rp,
+                         const bson_t                   *ismaster_cmd,
+                         int64_t                         timeout_msec)
+{
+   mongoc_async_cmd_with_initiator (
+      ts->async, _mongoc_topology_scanner_tcp_initiate, rp,
+      node->n_attempts * MONGOC_TOPOLOGY_CONNECTION_ATTEMPT_DELAY_MS,
+      ts->setup, node->host.host, "admin", ismaster_cmd,
+      &mongoc_topology_scanner_ismaster_handler, node, timeout_msec);
+
+   node->n_attempts++;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _begin_ismaster_attempts --
+ *
+ *      Race connections to each of a node's addresses, "Happy Eyeballs"
+ *      style (RFC 8305): address families alternate, beginning with the
+ *      resolver's first choice, and each attempt starts
+ *      MONGOC_TOPOLOGY_CONNECTION_ATTEMPT_DELAY_MS after the previous
+ *      one, or as soon as the previous one fails. Each attempt sends
+ *      ismaster as soon as it connects; the ismaster handler keeps the
+ *      first connection to reply.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_begin_ismaster_attempts (mongoc_topology_scanner_t      *ts,
+                          mongoc_topology_scanner_node_t *node,
+                          int64_t                         timeout_msec)
+{
+   const bson_t *ismaster_cmd_to_send;
+   struct addrinfo *rp;
+   struct addrinfo **preferred;
+   struct addrinfo **others;
+   size_t n_preferred = 0;
+   size_t n_others = 0;
+   size_t n = 0;
+   size_t i;
+
+   BSON_ASSERT (!node->stream);
+   BSON_ASSERT (node->dns_results);
+
+   /* the first ismaster on a new connection is never awaitable */
+   _mongoc_topology_scanner_node_set_topology_version (node, NULL);
+   ismaster_cmd_to_send = _get_ismaster_doc (ts, node);
+
+   for (rp = node->dns_results; rp; rp = rp->ai_next) {
+      n++;
+   }
+
+   preferred = (struct addrinfo **) _mongoc_memory_malloc (
+      TOPOLOGY, 2 * n * sizeof (*preferred));
+   others = preferred + n;
+
+   for (rp = node->dns_results; rp; rp = rp->ai_next) {
+      if (rp->ai_family == node->dns_results->ai_family) {
+         preferred[n_preferred++] = rp;
+      } else {
+         others[n_others++] = rp;
       }
-#endif
    }
 
-   if (!sock_stream) {
-      _mongoc_topology_scanner_monitor_heartbeat_failed (node->ts, &node->host,
-                                                         error);
+   for (i = 0; i < n_preferred || i < n_others; i++) {
+      if (i < n_preferred) {
+         _begin_ismaster_attempt (ts, node, preferred[i], ismaster_cmd_to_send,
+                                  timeout_msec);
+      }
+
+      if (i < n_others) {
+         _begin_ismaster_attempt (ts, node, others[i], ismaster_cmd_to_send,
+                                  timeout_msec);
+      }
+   }
+
+   _mongoc_memory_free (preferred);
+}
 
-      node->ts->setup_err_cb (node->id, node->ts->cb_data, error);
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_topology_scanner_node_setup --
+ *
+ *      Create a stream and begin a non-blocking connect.
+ *
+ * Returns:
+ *      true on success, or false and error is set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_topology_scanner_node_setup_failed (mongoc_topology_scanner_node_t *node,
+                                            const bson_error_t             *error)
+{
+   _mongoc_topology_scanner_monitor_heartbeat_failed (node->ts, &node->host,
+                                                      error);
+
+   node->ts->setup_err_cb (node->id, node->ts->cb_data, error);
+}
+
+bool
+mongoc_topology_scanner_node_setup (mongoc_topology_scanner_node_t *node,
+                                    bson_error_t                   *error)
+{
+   mongoc_stream_t *sock_stream;
+
+   _mongoc_topology_scanner_monitor_heartbeat_started (node->ts, &node->host);
+
+   if (node->stream) { return true; }
+
+   BSON_ASSERT (!node->retired);
+
+   sock_stream = mongoc_topology_scanner_node_connect (node, error);
+
+   if (!sock_stream) {
+      _mongoc_topology_scanner_node_setup_failed (node, error);
       return false;
    }
 
@@ -612,6 +1138,159 @@ mongoc_topology_scanner_node_setup (mongoc_topology_scanner_node_t *node,
    return true;
 }
 
+
+typedef struct
+{
+   mongoc_topology_scanner_node_t *node;
+   bool                            needs_resolve;
+   bool                            resolved;
+   bson_error_t                    error;
+} mongoc_topology_scanner_check_t;
+
+
+/* names to resolve, shared by the resolver threads */
+typedef struct
+{
+   mongoc_mutex_t                   mutex;
+   mongoc_topology_scanner_check_t *checks;
+   size_t                           n_checks;
+   size_t                           next;
+} mongoc_topology_scanner_resolve_queue_t;
+
+
+static void *
+_mongoc_topology_scanner_resolve_thread (void *data)
+{
+   mongoc_topology_scanner_resolve_queue_t *queue;
+   mongoc_topology_scanner_check_t *check;
+
+   queue = (mongoc_topology_scanner_resolve_queue_t *) data;
+
+   for (;;) {
+      check = NULL;
+
+      mongoc_mutex_lock (&queue->mutex);
+      while (queue->next < queue->n_checks) {
+         check = &queue->checks[queue->next++];
+         if (check->needs_resolve) {
+            break;
+         }
+         check = NULL;
+      }
+      mongoc_mutex_unlock (&queue->mutex);
+
+      if (!check) {
+         return NULL;
+      }
+
+      check->resolved = _mongoc_topology_scanner_node_resolve (check->node,
+                                                               &check->error);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_topology_scanner_check_nodes --
+ *
+ *      Begin checking each of @nodes. Names that aren't resolved yet are
+ *      resolved first. If there are several, up to
+ *      MONGOC_TOPOLOGY_SCANNER_RESOLVE_THREADS threads resolve them, so a
+ *      slow DNS lookup doesn't delay checking the other hosts.
+ *
+ *      A node with one address connects and sends ismaster as before. A
+ *      node with several races connections to them, see
+ *      _begin_ismaster_attempts.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_topology_scanner_check_nodes (mongoc_topology_scanner_t       *ts,
+                                      mongoc_topology_scanner_node_t **nodes,
+                                      size_t                           n_nodes,
+                                      int64_t                          timeout_msec)
+{
+   mongoc_topology_scanner_resolve_queue_t queue;
+   mongoc_thread_t threads[MONGOC_TOPOLOGY_SCANNER_RESOLVE_THREADS - 1];
+   mongoc_topology_scanner_check_t *checks;
+   mongoc_topology_scanner_check_t *check;
+   mongoc_topology_scanner_node_t *node;
+   size_t n_resolve = 0;
+   size_t n_threads = 0;
+   size_t i;
+   int64_t now;
+
+   checks = (mongoc_topology_scanner_check_t *) _mongoc_memory_malloc0 (
+      TOPOLOGY, n_nodes * sizeof (*checks));
+
+   now = bson_get_monotonic_time ();
+   ts->check_timeout_msec = timeout_msec;
+
+   for (i = 0; i < n_nodes; i++) {
+      node = nodes[i];
+      node->checked_at = now;
+      checks[i].node = node;
+      checks[i].needs_resolve = !ts->initiator &&
+                                !node->stream &&
+                                !node->dns_results &&
+                                node->host.family != AF_UNIX;
+
+      if (checks[i].needs_resolve) {
+         n_resolve++;
+      }
+   }
+
+   if (n_resolve) {
+      mongoc_mutex_init (&queue.mutex);
+      queue.checks = checks;
+      queue.n_checks = n_nodes;
+      queue.next = 0;
+
+      /* this thread resolves names too */
+      while (n_threads + 1 < n_resolve &&
+             n_threads < MONGOC_TOPOLOGY_SCANNER_RESOLVE_THREADS - 1 &&
+             mongoc_thread_create (&threads[n_threads],
+                                   _mongoc_topology_scanner_resolve_thread,
+                                   &queue) == 0) {
+         n_threads++;
+      }
+
+      _mongoc_topology_scanner_resolve_thread (&queue);
+
+      for (i = 0; i < n_threads; i++) {
+         mongoc_thread_join (threads[i]);
+      }
+
+      mongoc_mutex_destroy (&queue.mutex);
+   }
+
+   for (i = 0; i < n_nodes; i++) {
+      check = &checks[i];
+      node = check->node;
+
+      if (check->needs_resolve && !check->resolved) {
+         _mongoc_topology_scanner_monitor_heartbeat_started (ts, &node->host);
+         memcpy (&node->last_error, &check->error, sizeof (bson_error_t));
+         _mongoc_topology_scanner_node_setup_failed (node, &node->last_error);
+      } else if (!node->stream &&
+                 !ts->initiator &&
+                 node->host.family != AF_UNIX &&
+                 node->dns_results &&
+                 node->dns_results->ai_next) {
+         BSON_ASSERT (!node->retired);
+         _mongoc_topology_scanner_monitor_heartbeat_started (ts, &node->host);
+         _begin_ismaster_attempts (ts, node, timeout_msec);
+      } else if (mongoc_topology_scanner_node_setup (node, &node->last_error)) {
+         BSON_ASSERT (!node->cmd);
+         _begin_ismaster_cmd (ts, node, timeout_msec);
+      }
+   }
+
+   _mongoc_memory_free (checks);
+}
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -636,36 +1315,92 @@ mongoc_topology_scanner_node_setup (mongoc_topology_scanner_node_t *node,
  *--------------------------------------------------------------------------
  */
 
+/* check nodes that last failed before @cooldown and were last checked
+ * before @checked_before, and that aren't awaiting a reply */
+static void
+_mongoc_topology_scanner_start (mongoc_topology_scanner_t *ts,
+                                int64_t                    timeout_msec,
+                                int64_t                    cooldown,
+                                int64_t                    checked_before)
+{
+   mongoc_topology_scanner_node_t *node;
+   mongoc_topology_scanner_node_t **nodes;
+   size_t n_nodes = 0;
+
+   if (ts->in_progress) {
+      return;
+   }
+
+   DL_FOREACH (ts->nodes, node) {
+      n_nodes++;
+   }
+
+   if (!n_nodes) {
+      return;
+   }
+
+   nodes = (mongoc_topology_scanner_node_t **) _mongoc_memory_malloc (
+      TOPOLOGY, n_nodes * sizeof (*nodes));
+
+   n_nodes = 0;
+   DL_FOREACH (ts->nodes, node) {
+      /* check node if it last failed before current cooldown period began,
+       * and if it's due */
+      if (!node->cmd &&
+          node->last_failed < cooldown &&
+          node->checked_at < checked_before) {
+         nodes[n_nodes++] = node;
+      }
+   }
+
+   if (n_nodes) {
+      _mongoc_topology_scanner_check_nodes (ts, nodes, n_nodes, timeout_msec);
+   }
+
+   _mongoc_memory_free (nodes);
+}
+
 void
 mongoc_topology_scanner_start (mongoc_topology_scanner_t *ts,
                                int64_t timeout_msec,
                                bool obey_cooldown)
 {
-   mongoc_topology_scanner_node_t *node, *tmp;
    int64_t cooldown = INT64_MAX;
    BSON_ASSERT (ts);
 
-   if (ts->in_progress) {
-      return;
-   }
-
-
    if (obey_cooldown) {
       /* when current cooldown period began */
       cooldown = bson_get_monotonic_time ()
                  - 1000 * MONGOC_TOPOLOGY_COOLDOWN_MS;
    }
 
-   DL_FOREACH_SAFE (ts->nodes, node, tmp)
-   {
-      /* check node if it last failed before current cooldown period began */
-      if (node->last_failed < cooldown) {
-         if (mongoc_topology_scanner_node_setup (node, &node->last_error)) {
-            BSON_ASSERT (!node->cmd);
-            _begin_ismaster_cmd (ts, node, timeout_msec);
-         }
-      }
-   }
+   _mongoc_topology_scanner_start (ts, timeout_msec, cooldown, INT64_MAX);
+}
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_topology_scanner_start_due --
+ *
+ *      Like mongoc_topology_scanner_start, but only check nodes whose last
+ *      check began at least @interval_msec ago. Nodes awaiting a reply to
+ *      an awaitable ismaster are never due: they are re-checked as soon
+ *      as the server replies. For the background scanner, whose scans
+ *      keep running while any node streams.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+mongoc_topology_scanner_start_due (mongoc_topology_scanner_t *ts,
+                                   int64_t                    timeout_msec,
+                                   int64_t                    interval_msec)
+{
+   BSON_ASSERT (ts);
+
+   _mongoc_topology_scanner_start (
+      ts, timeout_msec, INT64_MAX,
+      bson_get_monotonic_time () - 1000 * interval_msec + 1);
 }
 
 /*
@@ -726,7 +1461,23 @@ void
 mongoc_topology_scanner_work (mongoc_topology_scanner_t *ts,
                               int64_t                    timeout_msec)
 {
-   mongoc_async_run (ts->async, timeout_msec);
+   int64_t expire_at;
+
+   if (ts->max_await_time_msec <= 0) {
+      mongoc_async_run (ts->async, timeout_msec);
+      return;
+   }
+
+   /* streaming: awaitable ismasters outlive the scan, and each node's is
+    * re-sent from its reply handler. wait only for plain checks, but
+    * handle awaited replies for at least the minimum heartbeat interval */
+   expire_at = bson_get_monotonic_time () + timeout_msec * 1000;
+
+   do {
+      mongoc_async_run_for (ts->async,
+                            MONGOC_TOPOLOGY_MIN_HEARTBEAT_FREQUENCY_MS);
+   } while (_mongoc_topology_scanner_checking (ts) &&
+            bson_get_monotonic_time () < expire_at);
 }
 
 /*
@@ -767,11 +1518,64 @@ mongoc_topology_scanner_reset (mongoc_topology_scanner_t *ts)
 
    DL_FOREACH_SAFE (ts->nodes, node, tmp) {
       if (node->retired) {
+         _mongoc_connection_stats_closed (&node->conn,
+                                          MONGOC_CONNECTION_CLOSED_REMOVED);
          mongoc_topology_scanner_node_destroy (node, true);
       }
    }
 }
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_topology_scanner_set_max_await_time --
+ *
+ *      Enable streaming monitoring: once a server reports a
+ *      topologyVersion, send it awaitable ismasters that it answers as
+ *      soon as its state changes, or after @max_await_time_msec. Pass 0
+ *      to poll instead.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+mongoc_topology_scanner_set_max_await_time (mongoc_topology_scanner_t *ts,
+                                            int64_t                    max_await_time_msec)
+{
+   BSON_ASSERT (ts);
+   BSON_ASSERT (max_await_time_msec >= 0);
+
+   ts->max_await_time_msec = max_await_time_msec;
+}
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_topology_scanner_is_streaming --
+ *
+ *      Whether any node is awaiting a reply to an awaitable ismaster. If
+ *      so, the servers pace the checks and the scanner must keep working
+ *      to handle their replies as they come.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+mongoc_topology_scanner_is_streaming (mongoc_topology_scanner_t *ts)
+{
+   mongoc_topology_scanner_node_t *node;
+
+   BSON_ASSERT (ts);
+
+   DL_FOREACH (ts->nodes, node) {
+      if (node->cmd && !node->retired && _is_awaitable (ts, node)) {
+         return true;
+      }
+   }
+
+   return false;
+}
+
 /*
  * Set a field in the topology scanner.
  */
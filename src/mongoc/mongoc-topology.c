@@ -21,9 +21,12 @@
 
 #include "mongoc-error.h"
 #include "mongoc-log.h"
+#include "mongoc-memory-private.h"
 #include "mongoc-topology-private.h"
+#include "mongoc-topology-cache-private.h"
 #include "mongoc-topology-description-apm-private.h"
 #include "mongoc-client-private.h"
+#include "mongoc-counters-private.h"
 #include "mongoc-util-private.h"
 
 #include "utlist.h"
@@ -184,6 +187,8 @@ mongoc_topology_new (const mongoc_uri_t *uri,
 {
    int64_t heartbeat_default;
    int64_t heartbeat;
+   const char *mode;
+   const char *cache_path;
    mongoc_topology_t *topology;
    mongoc_topology_description_type_t init_type;
    uint32_t id;
@@ -191,7 +196,8 @@ mongoc_topology_new (const mongoc_uri_t *uri,
 
    BSON_ASSERT (uri);
 
-   topology = (mongoc_topology_t *)bson_malloc0(sizeof *topology);
+   topology = (mongoc_topology_t *) _mongoc_memory_malloc0 (TOPOLOGY,
+                                                            sizeof *topology);
 
    /*
     * Not ideal, but there's no great way to do this.
@@ -231,7 +237,11 @@ mongoc_topology_new (const mongoc_uri_t *uri,
                                                     topology);
 
    topology->single_threaded = single_threaded;
+   topology->connection_stats = _mongoc_connection_stats_new ();
    if (single_threaded) {
+      /* the scanner's connections are the client's own */
+      topology->scanner->connection_stats = topology->connection_stats;
+
       /* Server Selection Spec:
        *
        *   "Single-threaded drivers MUST provide a "serverSelectionTryOnce"
@@ -247,6 +257,17 @@ mongoc_topology_new (const mongoc_uri_t *uri,
          true);
    } else {
       topology->server_selection_try_once = false;
+
+      /* a single-threaded scan blocks the application, never await there */
+      mode = mongoc_uri_get_option_as_utf8 (uri, "servermonitoringmode",
+                                            "poll");
+      if (!strcasecmp (mode, "stream")) {
+         mongoc_topology_scanner_set_max_await_time (topology->scanner,
+                                                     heartbeat);
+      } else if (strcasecmp (mode, "poll")) {
+         MONGOC_WARNING ("Unsupported serverMonitoringMode \"%s\", "
+                         "using \"poll\"", mode);
+      }
    }
 
    topology->server_selection_timeout_msec = mongoc_uri_get_option_as_int32(
@@ -279,6 +300,13 @@ mongoc_topology_new (const mongoc_uri_t *uri,
       mongoc_topology_scanner_add (topology->scanner, hl, id);
    }
 
+   cache_path = mongoc_uri_get_option_as_utf8 (uri, "topologycachefile",
+                                               NULL);
+   if (cache_path && *cache_path) {
+      topology->cache_path = bson_strdup (cache_path);
+      _mongoc_topology_cache_load (topology);
+   }
+
    return topology;
 }
 /*
@@ -306,6 +334,33 @@ mongoc_topology_set_apm_callbacks (mongoc_topology_t      *topology,
    topology->scanner->apm_context = context;
 }
 
+/*
+ *-------------------------------------------------------------------------
+ *
+ * mongoc_topology_set_server_selection_policy --
+ *
+ *       Set the policy that chooses among suitable servers, or NULL to
+ *       restore random selection. While a policy is set, the topology
+ *       tracks each server's in-flight operations and latencies.
+ *
+ *       NOTE: this method uses @topology's mutex.
+ *
+ *-------------------------------------------------------------------------
+ */
+void
+mongoc_topology_set_server_selection_policy (
+   mongoc_topology_t                *topology,
+   mongoc_server_selection_policy_t  policy,
+   void                             *context)
+{
+   mongoc_mutex_lock (&topology->mutex);
+   topology->description.selection_policy = policy;
+   topology->description.selection_policy_context = context;
+   topology->track_server_load = (policy != NULL);
+   bson_memory_barrier ();
+   mongoc_mutex_unlock (&topology->mutex);
+}
+
 /*
  *-------------------------------------------------------------------------
  *
@@ -334,11 +389,13 @@ mongoc_topology_destroy (mongoc_topology_t *topology)
    mongoc_uri_destroy (topology->uri);
    mongoc_topology_description_destroy(&topology->description);
    mongoc_topology_scanner_destroy (topology->scanner);
+   _mongoc_connection_stats_destroy (topology->connection_stats);
    mongoc_cond_destroy (&topology->cond_client);
    mongoc_cond_destroy (&topology->cond_server);
    mongoc_mutex_destroy (&topology->mutex);
 
-   bson_free(topology);
+   bson_free (topology->cache_path);
+   _mongoc_memory_free (topology);
 }
 
 
@@ -378,7 +435,10 @@ _mongoc_topology_do_blocking_scan (mongoc_topology_t *topology,
    mongoc_topology_scanner_reset (scanner);
    topology->last_scan = bson_get_monotonic_time ();
    topology->stale = false;
+   topology->cache_unverified = false;
    mongoc_mutex_unlock (&topology->mutex);
+
+   _mongoc_topology_cache_save (topology);
 }
 
 
@@ -494,7 +554,7 @@ mongoc_topology_select (mongoc_topology_t         *topology,
 /*
  *-------------------------------------------------------------------------
  *
- * mongoc_topology_select_server_id --
+ * _mongoc_topology_select_server_id --
  *
  *       Alternative to mongoc_topology_select when you only need the id.
  *
@@ -503,11 +563,11 @@ mongoc_topology_select (mongoc_topology_t         *topology,
  *
  *-------------------------------------------------------------------------
  */
-uint32_t
-mongoc_topology_select_server_id (mongoc_topology_t         *topology,
-                                  mongoc_ss_optype_t         optype,
-                                  const mongoc_read_prefs_t *read_prefs,
-                                  bson_error_t              *error)
+static uint32_t
+_mongoc_topology_select_server_id (mongoc_topology_t         *topology,
+                                   mongoc_ss_optype_t         optype,
+                                   const mongoc_read_prefs_t *read_prefs,
+                                   bson_error_t              *error)
 {
    static const char *timeout_msg =
       "No suitable servers found: `serverSelectionTimeoutMS` expired";
@@ -676,6 +736,25 @@ mongoc_topology_select_server_id (mongoc_topology_t         *topology,
    }
 }
 
+/* select a server with _mongoc_topology_select_server_id, timed */
+uint32_t
+mongoc_topology_select_server_id (mongoc_topology_t         *topology,
+                                  mongoc_ss_optype_t         optype,
+                                  const mongoc_read_prefs_t *read_prefs,
+                                  bson_error_t              *error)
+{
+   int64_t started;
+   uint32_t server_id;
+
+   started = bson_get_monotonic_time ();
+   server_id = _mongoc_topology_select_server_id (topology, optype,
+                                                  read_prefs, error);
+   mongoc_histogram_server_selection_record (bson_get_monotonic_time () -
+                                             started);
+
+   return server_id;
+}
+
 /*
  *-------------------------------------------------------------------------
  *
@@ -790,7 +869,8 @@ _mongoc_topology_request_scan (mongoc_topology_t *topology)
  * mongoc_topology_invalidate_server --
  *
  *      Invalidate the given server after receiving a network error in
- *      another part of the client.
+ *      another part of the client. A background scanner is asked to
+ *      rescan as soon as the minimum heartbeat interval allows.
  *
  *      NOTE: this method uses @topology's mutex.
  *
@@ -806,6 +886,108 @@ mongoc_topology_invalidate_server (mongoc_topology_t  *topology,
    mongoc_mutex_lock (&topology->mutex);
    mongoc_topology_description_invalidate_server (&topology->description,
                                                   id, error);
+
+   /* don't wait for the next heartbeat to learn the new topology, e.g.
+    * after a primary steps down */
+   if (!topology->single_threaded) {
+      _mongoc_topology_request_scan (topology);
+   }
+
+   mongoc_mutex_unlock (&topology->mutex);
+}
+
+/* read without the mutex, on every operation */
+static BSON_INLINE bool
+_mongoc_topology_tracks_server_load (mongoc_topology_t *topology)
+{
+   return bson_atomic_int_add (&topology->track_server_load, 0) != 0;
+}
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_topology_op_started --
+ *
+ *      Count an operation in flight on server @id, for load-aware server
+ *      selection. Does nothing unless a selection policy is set.
+ *
+ *      NOTE: this method uses @topology's mutex.
+ *
+ *--------------------------------------------------------------------------
+ */
+void
+mongoc_topology_op_started (mongoc_topology_t *topology,
+                            uint32_t           id)
+{
+   mongoc_server_description_t *sd;
+
+   if (!_mongoc_topology_tracks_server_load (topology)) {
+      return;
+   }
+
+   mongoc_mutex_lock (&topology->mutex);
+   sd = mongoc_topology_description_server_by_id (&topology->description,
+                                                  id, NULL);
+   if (sd) {
+      mongoc_server_description_op_started (sd);
+   }
+   mongoc_mutex_unlock (&topology->mutex);
+}
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_topology_op_finished --
+ *
+ *      Complete an operation begun with mongoc_topology_op_started and
+ *      record its duration. The server's recent durations are copied
+ *      and sorted outside the mutex, so pooled clients don't wait on
+ *      each other's sorts; of two concurrent updates, the percentiles
+ *      of the later copy are kept.
+ *
+ *      NOTE: this method uses @topology's mutex.
+ *
+ *--------------------------------------------------------------------------
+ */
+void
+mongoc_topology_op_finished (mongoc_topology_t *topology,
+                             uint32_t           id,
+                             int64_t            duration_usec,
+                             bool               succeeded)
+{
+   mongoc_server_description_t *sd;
+   int64_t samples[MONGOC_SERVER_LOAD_SAMPLES];
+   uint32_t n_samples = 0;
+   uint64_t version;
+   int64_t p50;
+   int64_t p99;
+
+   if (!_mongoc_topology_tracks_server_load (topology)) {
+      return;
+   }
+
+   mongoc_mutex_lock (&topology->mutex);
+   sd = mongoc_topology_description_server_by_id (&topology->description,
+                                                  id, NULL);
+   if (sd) {
+      n_samples = mongoc_server_description_op_finished (
+         sd, duration_usec, succeeded, samples, &version);
+   }
+   mongoc_mutex_unlock (&topology->mutex);
+
+   if (!n_samples) {
+      return;
+   }
+
+   mongoc_server_load_percentiles (samples, n_samples, &p50, &p99);
+
+   mongoc_mutex_lock (&topology->mutex);
+   sd = mongoc_topology_description_server_by_id (&topology->description,
+                                                  id, NULL);
+   if (sd) {
+      mongoc_server_description_set_load_percentiles (sd, p50, p99,
+                                                      version);
+   }
    mongoc_mutex_unlock (&topology->mutex);
 }
 
@@ -926,6 +1108,8 @@ void * _mongoc_topology_run_background (void *data)
    mongoc_topology_t *topology;
    int64_t now;
    int64_t last_scan;
+   int64_t scan_started;
+   int64_t last_saved;
    int64_t timeout;
    int64_t force_timeout;
    int64_t heartbeat_msec;
@@ -934,6 +1118,8 @@ void * _mongoc_topology_run_background (void *data)
    BSON_ASSERT (data);
 
    last_scan = 0;
+   scan_started = 0;
+   last_saved = 0;
    topology = (mongoc_topology_t *)data;
    heartbeat_msec = topology->description.heartbeat_msec;
 
@@ -963,11 +1149,26 @@ void * _mongoc_topology_run_background (void *data)
             timeout = BSON_MIN (timeout, force_timeout);
          }
 
-         /* if we can start scanning, do so immediately */
+         /* when streaming, keep scanning to handle awaited replies as they
+          * come; the scanner re-sends each node's awaitable ismaster when
+          * it replies. still, never start scans more often than the
+          * minimum heartbeat frequency */
+         if (mongoc_topology_scanner_is_streaming (topology->scanner)) {
+            force_timeout = MONGOC_TOPOLOGY_MIN_HEARTBEAT_FREQUENCY_MS
+                            - ((now - scan_started) / 1000);
+
+            timeout = BSON_MIN (timeout, force_timeout);
+         }
+
+         /* if we can start scanning, do so immediately. nodes that are
+          * streaming, or were checked too recently, are skipped */
          if (timeout <= 0) {
-            mongoc_topology_scanner_start (topology->scanner,
-                                           topology->connect_timeout_msec,
-                                           false);
+            mongoc_topology_scanner_start_due (
+               topology->scanner,
+               topology->connect_timeout_msec,
+               topology->scan_requested
+                  ? MONGOC_TOPOLOGY_MIN_HEARTBEAT_FREQUENCY_MS
+                  : heartbeat_msec);
             break;
          } else {
             /* otherwise wait until someone:
@@ -992,6 +1193,7 @@ void * _mongoc_topology_run_background (void *data)
       }
 
       topology->scan_requested = false;
+      scan_started = bson_get_monotonic_time ();
 
       /* scanning locks and unlocks the mutex itself until the scan is done */
       mongoc_mutex_unlock (&topology->mutex);
@@ -1005,8 +1207,16 @@ void * _mongoc_topology_run_background (void *data)
       mongoc_topology_scanner_reset (topology->scanner);
 
       topology->last_scan = bson_get_monotonic_time ();
+      topology->cache_unverified = false;
       mongoc_mutex_unlock (&topology->mutex);
 
+      /* streaming scans end every half-second, save at the heartbeat */
+      if (!last_saved ||
+          bson_get_monotonic_time () - last_saved >= heartbeat_msec * 1000) {
+         _mongoc_topology_cache_save (topology);
+         last_saved = bson_get_monotonic_time ();
+      }
+
       last_scan = bson_get_monotonic_time();
    }
 
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_TRACE_BUFFER_PRIVATE_H
+#define MONGOC_TRACE_BUFFER_PRIVATE_H
+
+#if !defined (MONGOC_COMPILATION)
+#error "Only <mongoc.h> can be included directly."
+#endif
+
+#include <bson.h>
+
+#include "mongoc-trace-buffer.h"
+
+
+BSON_BEGIN_DECLS
+
+
+/*
+ * The trace buffer: with MONGOC_ENABLE_TRACE_BUFFER, ENTRY, EXIT, RETURN,
+ * GOTO, TRACE, DUMP_BYTES and DUMP_IOVEC each record a 16-byte event in a
+ * ring of the calling thread's most recent events, if their log domain is
+ * enabled with mongoc_trace_buffer_set_domains. Nothing is formatted: an
+ * event is its call site's id, a timestamp and a small payload, and
+ * mongoc_trace_buffer_dump writes the call sites and the rings for the
+ * mongoc-trace-decode tool. See mongoc-trace-private.h.
+ */
+
+/* events per thread, a power of two */
+#define MONGOC_TRACE_RING_SIZE 4096
+
+/* threads with a ring at once, more record nothing */
+#define MONGOC_TRACE_RINGS 256
+
+/* log domains that can be toggled apart, the last is shared by any more */
+#define MONGOC_TRACE_DOMAINS 64
+
+
+typedef enum
+{
+   MONGOC_TRACE_EVENT_ENTRY,
+   MONGOC_TRACE_EVENT_EXIT,
+   MONGOC_TRACE_EVENT_GOTO,
+   MONGOC_TRACE_EVENT_TRACE,
+   MONGOC_TRACE_EVENT_BYTES,
+   MONGOC_TRACE_EVENT_IOVEC,
+} mongoc_trace_event_t;
+
+
+/* a call site, a static variable at each ENTRY, RETURN, etc. */
+typedef struct
+{
+   const char       *domain;
+   const char       *func;
+   const char       *label;   /* GOTO's label, TRACE's format, or NULL */
+   int32_t           line;
+   uint32_t          event;
+   uint32_t          domain_id;
+   volatile uint32_t id;      /* 0 until the site is first recorded */
+} mongoc_trace_site_t;
+
+
+typedef struct
+{
+   int64_t  time;             /* monotonic microseconds */
+   uint32_t site;
+   uint32_t payload;
+} mongoc_trace_record_t;
+
+
+BSON_STATIC_ASSERT (sizeof (mongoc_trace_record_t) == 16);
+
+
+/* nonzero if any domain is enabled, checked at each call site */
+extern volatile int32_t _mongoc_trace_buffer_on;
+
+void _mongoc_trace_buffer_init    (void);
+void _mongoc_trace_buffer_cleanup (void);
+void _mongoc_trace_buffer_record  (mongoc_trace_site_t *site,
+                                   uint32_t             payload);
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_TRACE_BUFFER_PRIVATE_H */
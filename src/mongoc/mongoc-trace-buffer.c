@@ -0,0 +1,541 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <bson.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mongoc-trace-buffer-private.h"
+#include "mongoc-thread-private.h"
+
+
+/*
+ * Each thread writes its events to its own ring without a lock: it writes
+ * the record at head % MONGOC_TRACE_RING_SIZE, then increments head. A
+ * dump copies a ring and keeps the records that could not have been
+ * overwritten while it copied. A thread's ring is released when the
+ * thread exits, and reused once there are MONGOC_TRACE_RINGS rings.
+ */
+typedef struct
+{
+   volatile int64_t      head;     /* records written since acquired */
+   uint32_t              thread;   /* which thread, in acquisition order */
+   bool                  owned;
+   mongoc_trace_record_t records[MONGOC_TRACE_RING_SIZE];
+} mongoc_trace_ring_t;
+
+
+/* the dump's magic and version, see mongoc-trace-decode.c */
+#define DUMP_MAGIC   "MONGOCTB"
+#define DUMP_VERSION 1
+
+
+volatile int32_t _mongoc_trace_buffer_on = 0;
+
+#ifdef MONGOC_ENABLE_TRACE_BUFFER
+/* the mutex guards everything else, but the enabled domains are read
+ * without it */
+static mongoc_mutex_t         gMutex;
+static volatile uint64_t      gEnabledDomains;
+static char                  *gPatterns;
+static const char            *gDomains[MONGOC_TRACE_DOMAINS];
+static uint32_t               gNDomains;
+static mongoc_trace_site_t  **gSites;
+static uint32_t               gNSites;
+static uint32_t               gSitesAllocated;
+static mongoc_trace_ring_t   *gRings[MONGOC_TRACE_RINGS];
+static uint32_t               gNRings;
+static uint32_t               gNThreads;
+
+#ifdef _WIN32
+static DWORD                  gRingKey;
+#else
+static pthread_key_t          gRingKey;
+#endif
+
+
+#ifdef _WIN32
+static VOID WINAPI
+#else
+static void
+#endif
+_mongoc_trace_buffer_release_ring (void *data)
+{
+   mongoc_trace_ring_t *ring = (mongoc_trace_ring_t *) data;
+
+   if (!ring) {
+      return;
+   }
+
+   mongoc_mutex_lock (&gMutex);
+   ring->owned = false;
+   mongoc_mutex_unlock (&gMutex);
+}
+
+
+static mongoc_trace_ring_t *
+_mongoc_trace_buffer_get_ring (void)
+{
+#ifdef _WIN32
+   return (mongoc_trace_ring_t *) FlsGetValue (gRingKey);
+#else
+   return (mongoc_trace_ring_t *) pthread_getspecific (gRingKey);
+#endif
+}
+
+
+/* give the calling thread a ring, or NULL if MONGOC_TRACE_RINGS threads
+ * have one */
+static mongoc_trace_ring_t *
+_mongoc_trace_buffer_acquire_ring (void)
+{
+   mongoc_trace_ring_t *ring = NULL;
+   uint32_t i;
+
+   mongoc_mutex_lock (&gMutex);
+
+   /* keep exited threads' events until there's no room for a new ring */
+   if (gNRings < MONGOC_TRACE_RINGS) {
+      ring = (mongoc_trace_ring_t *) bson_malloc0 (sizeof *ring);
+      gRings[gNRings++] = ring;
+   } else {
+      for (i = 0; i < gNRings; i++) {
+         if (!gRings[i]->owned) {
+            ring = gRings[i];
+            break;
+         }
+      }
+   }
+
+   if (ring) {
+      ring->head = 0;
+      ring->thread = ++gNThreads;
+      ring->owned = true;
+#ifdef _WIN32
+      FlsSetValue (gRingKey, ring);
+#else
+      pthread_setspecific (gRingKey, ring);
+#endif
+   }
+
+   mongoc_mutex_unlock (&gMutex);
+
+   return ring;
+}
+
+
+/* "stream" matches the domains "stream", "stream-tls", "stream_foo" */
+static bool
+_mongoc_trace_buffer_match (const char *patterns,
+                            const char *domain)
+{
+   const char *p = patterns;
+   size_t len;
+
+   while (p && *p) {
+      len = strcspn (p, ",");
+
+      if ((len == 1 && *p == '*') ||
+          (len && 0 == strncmp (p, domain, len) &&
+           (domain[len] == '\0' || domain[len] == '-' ||
+            domain[len] == '_'))) {
+         return true;
+      }
+
+      p += len;
+      if (*p == ',') {
+         p++;
+      }
+   }
+
+   return false;
+}
+
+
+/* with gMutex held */
+static void
+_mongoc_trace_buffer_update_mask (void)
+{
+   uint64_t mask = 0;
+   uint32_t i;
+
+   for (i = 0; i < gNDomains; i++) {
+      if (_mongoc_trace_buffer_match (gPatterns, gDomains[i])) {
+         mask |= (uint64_t) 1 << i;
+      }
+   }
+
+   gEnabledDomains = mask;
+   bson_memory_barrier ();
+   _mongoc_trace_buffer_on = (gPatterns && *gPatterns) ? 1 : 0;
+}
+
+
+/* give @site an id, and its domain one if it's the first of its domain */
+static void
+_mongoc_trace_buffer_register (mongoc_trace_site_t *site)
+{
+   uint32_t i;
+
+   mongoc_mutex_lock (&gMutex);
+
+   if (site->id) {
+      /* another thread registered it */
+      mongoc_mutex_unlock (&gMutex);
+      return;
+   }
+
+   for (i = 0; i < gNDomains; i++) {
+      if (!strcmp (gDomains[i], site->domain)) {
+         break;
+      }
+   }
+
+   if (i == gNDomains) {
+      if (gNDomains < MONGOC_TRACE_DOMAINS - 1) {
+         gDomains[gNDomains++] = site->domain;
+      } else {
+         /* the last domain is shared, only "*" enables it */
+         i = MONGOC_TRACE_DOMAINS - 1;
+         gDomains[i] = "(other)";
+         gNDomains = MONGOC_TRACE_DOMAINS;
+      }
+
+      _mongoc_trace_buffer_update_mask ();
+   }
+
+   site->domain_id = i;
+
+   if (gNSites == gSitesAllocated) {
+      gSitesAllocated = gSitesAllocated ? 2 * gSitesAllocated : 256;
+      gSites = (mongoc_trace_site_t **) bson_realloc (
+         gSites, gSitesAllocated * sizeof *gSites);
+   }
+
+   gSites[gNSites++] = site;
+
+   bson_memory_barrier ();
+   site->id = gNSites;
+
+   mongoc_mutex_unlock (&gMutex);
+}
+#endif /* MONGOC_ENABLE_TRACE_BUFFER */
+
+
+void
+_mongoc_trace_buffer_init (void)
+{
+#ifdef MONGOC_ENABLE_TRACE_BUFFER
+   mongoc_mutex_init (&gMutex);
+#ifdef _WIN32
+   gRingKey = FlsAlloc (_mongoc_trace_buffer_release_ring);
+#else
+   pthread_key_create (&gRingKey, _mongoc_trace_buffer_release_ring);
+#endif
+
+   if (getenv ("MONGOC_TRACE_BUFFER")) {
+      mongoc_trace_buffer_set_domains (getenv ("MONGOC_TRACE_BUFFER"));
+   }
+#endif
+}
+
+
+void
+_mongoc_trace_buffer_cleanup (void)
+{
+#ifdef MONGOC_ENABLE_TRACE_BUFFER
+   uint32_t i;
+
+   _mongoc_trace_buffer_on = 0;
+
+   /* before freeing the rings, FlsFree releases them */
+#ifdef _WIN32
+   FlsFree (gRingKey);
+#else
+   pthread_key_delete (gRingKey);
+#endif
+
+   for (i = 0; i < gNSites; i++) {
+      gSites[i]->id = 0;
+   }
+
+   for (i = 0; i < gNRings; i++) {
+      bson_free (gRings[i]);
+   }
+
+   bson_free (gSites);
+   bson_free (gPatterns);
+   gSites = NULL;
+   gPatterns = NULL;
+   gNSites = gSitesAllocated = gNRings = gNDomains = 0;
+   gEnabledDomains = 0;
+
+   mongoc_mutex_destroy (&gMutex);
+#endif
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_trace_buffer_record --
+ *
+ *       Record an event at @site in the calling thread's ring, if @site's
+ *       domain is enabled. Called by the macros in mongoc-trace-private.h
+ *       once any domain is.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       Registers @site the first time. Acquires a ring the first time the
+ *       thread records an event.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_trace_buffer_record (mongoc_trace_site_t *site,
+                             uint32_t             payload)
+{
+#ifdef MONGOC_ENABLE_TRACE_BUFFER
+   mongoc_trace_ring_t *ring;
+   mongoc_trace_record_t *record;
+   int64_t head;
+
+   if (BSON_UNLIKELY (!site->id)) {
+      _mongoc_trace_buffer_register (site);
+   }
+
+   if (!(gEnabledDomains & ((uint64_t) 1 << site->domain_id))) {
+      return;
+   }
+
+   ring = _mongoc_trace_buffer_get_ring ();
+   if (BSON_UNLIKELY (!ring)) {
+      ring = _mongoc_trace_buffer_acquire_ring ();
+      if (!ring) {
+         return;
+      }
+   }
+
+   head = ring->head;
+   record = &ring->records[head & (MONGOC_TRACE_RING_SIZE - 1)];
+   record->time = bson_get_monotonic_time ();
+   record->site = site->id;
+   record->payload = payload;
+
+   bson_memory_barrier ();
+   ring->head = head + 1;
+#endif
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_trace_buffer_set_domains --
+ *
+ *       Record events from the log domains in the comma-separated list
+ *       @domains, like "cluster,stream", or "*" for all, from now on. A
+ *       domain also matches its sub-domains, "stream" matches
+ *       "stream-tls". NULL or "" stops recording.
+ *
+ * Returns:
+ *       false if the driver was built without the trace buffer.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+mongoc_trace_buffer_set_domains (const char *domains)
+{
+#ifdef MONGOC_ENABLE_TRACE_BUFFER
+   mongoc_mutex_lock (&gMutex);
+   bson_free (gPatterns);
+   gPatterns = bson_strdup (domains);
+   _mongoc_trace_buffer_update_mask ();
+   mongoc_mutex_unlock (&gMutex);
+
+   return true;
+#else
+   return false;
+#endif
+}
+
+
+#ifdef MONGOC_ENABLE_TRACE_BUFFER
+static bool
+_mongoc_trace_buffer_write (FILE       *stream,
+                            const void *data,
+                            size_t      len)
+{
+   return len == 0 || fwrite (data, 1, len, stream) == len;
+}
+
+
+static bool
+_mongoc_trace_buffer_write_str (FILE       *stream,
+                                const char *str)
+{
+   str = str ? str : "";
+
+   return _mongoc_trace_buffer_write (stream, str, strlen (str) + 1);
+}
+
+
+static bool
+_mongoc_trace_buffer_write_u32 (FILE     *stream,
+                                uint32_t  value)
+{
+   return _mongoc_trace_buffer_write (stream, &value, sizeof value);
+}
+
+
+static bool
+_mongoc_trace_buffer_write_i64 (FILE    *stream,
+                                int64_t  value)
+{
+   return _mongoc_trace_buffer_write (stream, &value, sizeof value);
+}
+
+
+/* write a ring's records, oldest first, skipping any overwritten while
+ * they were copied */
+static bool
+_mongoc_trace_buffer_write_ring (FILE                  *stream,
+                                 mongoc_trace_ring_t   *ring,
+                                 mongoc_trace_record_t *copy)
+{
+   int64_t before;
+   int64_t after;
+   int64_t first;
+   int64_t i;
+
+   before = ring->head;
+   bson_memory_barrier ();
+   memcpy (copy, ring->records, sizeof ring->records);
+   bson_memory_barrier ();
+   after = ring->head;
+
+   /* the writer may be writing record "after", over "after" - size */
+   first = BSON_MAX (0, after - MONGOC_TRACE_RING_SIZE + 1);
+
+   if (!_mongoc_trace_buffer_write_u32 (stream, ring->thread) ||
+       !_mongoc_trace_buffer_write_u32 (
+          stream, (uint32_t) BSON_MAX (0, before - first))) {
+      return false;
+   }
+
+   for (i = first; i < before; i++) {
+      if (!_mongoc_trace_buffer_write (
+             stream, &copy[i & (MONGOC_TRACE_RING_SIZE - 1)],
+             sizeof (mongoc_trace_record_t))) {
+         return false;
+      }
+   }
+
+   return true;
+}
+#endif
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_trace_buffer_dump --
+ *
+ *       Write the call sites and each thread's recent events to @stream,
+ *       in a binary format for the mongoc-trace-decode tool. Threads keep
+ *       recording while they are written.
+ *
+ * Returns:
+ *       false if the driver was built without the trace buffer, or
+ *       writing failed.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+mongoc_trace_buffer_dump (FILE *stream)
+{
+#ifdef MONGOC_ENABLE_TRACE_BUFFER
+   mongoc_trace_ring_t *rings[MONGOC_TRACE_RINGS];
+   mongoc_trace_record_t *copy;
+   mongoc_trace_site_t *site;
+   struct timeval tv;
+   uint32_t n_rings = 0;
+   uint32_t i;
+   bool ret = true;
+
+   BSON_ASSERT (stream);
+
+   copy = (mongoc_trace_record_t *) bson_malloc (
+      MONGOC_TRACE_RING_SIZE * sizeof *copy);
+
+   mongoc_mutex_lock (&gMutex);
+
+   /* rings that start recording during the dump are skipped */
+   for (i = 0; i < gNRings; i++) {
+      if (gRings[i]->head) {
+         rings[n_rings++] = gRings[i];
+      }
+   }
+
+   /* header, to convert monotonic times to the wall clock */
+   bson_gettimeofday (&tv);
+   ret = (_mongoc_trace_buffer_write (stream, DUMP_MAGIC, 8) &&
+          _mongoc_trace_buffer_write_u32 (stream, DUMP_VERSION) &&
+          _mongoc_trace_buffer_write_u32 (stream, gNSites) &&
+          _mongoc_trace_buffer_write_u32 (stream, n_rings) &&
+          _mongoc_trace_buffer_write_u32 (stream,
+                                          sizeof (mongoc_trace_record_t)) &&
+          _mongoc_trace_buffer_write_i64 (stream,
+                                          bson_get_monotonic_time ()) &&
+          _mongoc_trace_buffer_write_i64 (stream,
+                                          (int64_t) tv.tv_sec * 1000000 +
+                                             tv.tv_usec));
+
+   for (i = 0; ret && i < gNSites; i++) {
+      site = gSites[i];
+      ret = (_mongoc_trace_buffer_write_u32 (stream, site->id) &&
+             _mongoc_trace_buffer_write_u32 (stream, site->event) &&
+             _mongoc_trace_buffer_write_u32 (stream, (uint32_t) site->line) &&
+             _mongoc_trace_buffer_write_str (stream, site->domain) &&
+             _mongoc_trace_buffer_write_str (stream, site->func) &&
+             _mongoc_trace_buffer_write_str (stream, site->label));
+   }
+
+   for (i = 0; ret && i < n_rings; i++) {
+      ret = _mongoc_trace_buffer_write_ring (stream, rings[i], copy);
+   }
+
+   mongoc_mutex_unlock (&gMutex);
+
+   bson_free (copy);
+
+   return ret && fflush (stream) == 0;
+#else
+   return false;
+#endif
+}
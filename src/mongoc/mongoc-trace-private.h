@@ -24,26 +24,59 @@
 
 #include "mongoc-log.h"
 #include "mongoc-log-private.h"
+#include "mongoc-trace-buffer-private.h"
 
 
 BSON_BEGIN_DECLS
 
 
+/*
+ * With MONGOC_ENABLE_TRACE_BUFFER, each macro records a binary event in
+ * the trace buffer if its domain is enabled at runtime, see
+ * mongoc-trace-buffer-private.h. When tracing is off that costs a load and
+ * a branch. With MONGOC_TRACE, each also logs a message.
+ */
+#ifdef MONGOC_ENABLE_TRACE_BUFFER
+#define _MONGOC_TRACE_BUFFER(_event, _label, _payload) \
+   do { \
+      static mongoc_trace_site_t _mongoc_trace_site = { \
+         MONGOC_LOG_DOMAIN, BSON_FUNC, _label, __LINE__, \
+         MONGOC_TRACE_EVENT_##_event, 0, 0 }; \
+      if (BSON_UNLIKELY (_mongoc_trace_buffer_on)) { \
+         _mongoc_trace_buffer_record (&_mongoc_trace_site, \
+                                      (uint32_t) (_payload)); \
+      } \
+   } while (0)
+#else
+#define _MONGOC_TRACE_BUFFER(_event, _label, _payload) do { } while (0)
+#endif
+
+
 #ifdef MONGOC_TRACE
 #define TRACE(msg, ...) \
-                    do { mongoc_log(MONGOC_LOG_LEVEL_TRACE, MONGOC_LOG_DOMAIN, "TRACE: %s():%d " msg, BSON_FUNC, __LINE__, __VA_ARGS__); } while (0)
-#define ENTRY       do { mongoc_log(MONGOC_LOG_LEVEL_TRACE, MONGOC_LOG_DOMAIN, "ENTRY: %s():%d", BSON_FUNC, __LINE__); } while (0)
-#define EXIT        do { mongoc_log(MONGOC_LOG_LEVEL_TRACE, MONGOC_LOG_DOMAIN, " EXIT: %s():%d", BSON_FUNC, __LINE__); return; } while (0)
-#define RETURN(ret) do { mongoc_log(MONGOC_LOG_LEVEL_TRACE, MONGOC_LOG_DOMAIN, " EXIT: %s():%d", BSON_FUNC, __LINE__); return ret; } while (0)
-#define GOTO(label) do { mongoc_log(MONGOC_LOG_LEVEL_TRACE, MONGOC_LOG_DOMAIN, " GOTO: %s():%d %s", BSON_FUNC, __LINE__, #label); goto label; } while (0)
+                    do { _MONGOC_TRACE_BUFFER(TRACE, msg, 0); mongoc_log(MONGOC_LOG_LEVEL_TRACE, MONGOC_LOG_DOMAIN, "TRACE: %s():%d " msg, BSON_FUNC, __LINE__, __VA_ARGS__); } while (0)
+#define ENTRY       do { _MONGOC_TRACE_BUFFER(ENTRY, NULL, 0); mongoc_log(MONGOC_LOG_LEVEL_TRACE, MONGOC_LOG_DOMAIN, "ENTRY: %s():%d", BSON_FUNC, __LINE__); } while (0)
+#define EXIT        do { _MONGOC_TRACE_BUFFER(EXIT, NULL, 0); mongoc_log(MONGOC_LOG_LEVEL_TRACE, MONGOC_LOG_DOMAIN, " EXIT: %s():%d", BSON_FUNC, __LINE__); return; } while (0)
+#define RETURN(ret) do { _MONGOC_TRACE_BUFFER(EXIT, NULL, 0); mongoc_log(MONGOC_LOG_LEVEL_TRACE, MONGOC_LOG_DOMAIN, " EXIT: %s():%d", BSON_FUNC, __LINE__); return ret; } while (0)
+#define GOTO(label) do { _MONGOC_TRACE_BUFFER(GOTO, #label, 0); mongoc_log(MONGOC_LOG_LEVEL_TRACE, MONGOC_LOG_DOMAIN, " GOTO: %s():%d %s", BSON_FUNC, __LINE__, #label); goto label; } while (0)
 #define DUMP_BYTES(_n, _b, _l) do { \
+   _MONGOC_TRACE_BUFFER(BYTES, #_n, _l); \
    mongoc_log(MONGOC_LOG_LEVEL_TRACE, MONGOC_LOG_DOMAIN, "TRACE: %s():%d %s = %p [%d]", BSON_FUNC, __LINE__, #_n, _b, (int)_l); \
    mongoc_log_trace_bytes(MONGOC_LOG_DOMAIN, _b, _l); \
 } while (0)
 #define DUMP_IOVEC(_n, _iov, _iovcnt) do { \
+   _MONGOC_TRACE_BUFFER(IOVEC, #_n, _iovcnt); \
    mongoc_log(MONGOC_LOG_LEVEL_TRACE, MONGOC_LOG_DOMAIN, "TRACE: %s():%d %s = %p [%d]", BSON_FUNC, __LINE__, #_n, _iov, (int)_iovcnt); \
    mongoc_log_trace_iovec(MONGOC_LOG_DOMAIN, _iov, _iovcnt); \
 } while (0)
+#elif defined(MONGOC_ENABLE_TRACE_BUFFER)
+#define TRACE(msg, ...)               _MONGOC_TRACE_BUFFER(TRACE, msg, 0)
+#define ENTRY                         _MONGOC_TRACE_BUFFER(ENTRY, NULL, 0)
+#define EXIT        do { _MONGOC_TRACE_BUFFER(EXIT, NULL, 0); return; } while (0)
+#define RETURN(ret) do { _MONGOC_TRACE_BUFFER(EXIT, NULL, 0); return ret; } while (0)
+#define GOTO(label) do { _MONGOC_TRACE_BUFFER(GOTO, #label, 0); goto label; } while (0)
+#define DUMP_BYTES(_n, _b, _l)        _MONGOC_TRACE_BUFFER(BYTES, #_n, _l)
+#define DUMP_IOVEC(_n, _iov, _iovcnt) _MONGOC_TRACE_BUFFER(IOVEC, #_n, _iovcnt)
 #else
 #define TRACE(msg,...)
 #define ENTRY
@@ -562,8 +562,10 @@ bool
 mongoc_uri_option_is_int32 (const char *key)
 {
    return !strcasecmp(key, "connecttimeoutms") ||
+       !strcasecmp(key, "dnscachettlms") ||
        !strcasecmp(key, "heartbeatfrequencyms") ||
        !strcasecmp(key, "serverselectiontimeoutms") ||
+       !strcasecmp(key, "slowopthresholdms") ||
        !strcasecmp(key, "socketcheckintervalms") ||
        !strcasecmp(key, "sockettimeoutms") ||
        !strcasecmp(key, "localthresholdms") ||
@@ -23,10 +23,12 @@
 
 #include <bson.h>
 
+#include "mongoc-array-private.h"
 #include "mongoc-client.h"
 #include "mongoc-error.h"
 #include "mongoc-write-concern.h"
 #include "mongoc-server-stream-private.h"
+#include "mongoc-shard-map-private.h"
 
 
 BSON_BEGIN_DECLS
@@ -36,6 +38,15 @@ BSON_BEGIN_DECLS
 #define MONGOC_WRITE_COMMAND_INSERT 1
 #define MONGOC_WRITE_COMMAND_UPDATE 2
 
+/* batches an unordered bulk write sends before reading the oldest reply */
+#define MONGOC_WRITE_PIPELINE_DEPTH 8
+
+/* and bytes: no more batches are sent once this many are unanswered, so at
+ * most one batch's worth more. a deep pipeline of large batches could leave
+ * us blocked sending while the server is blocked sending replies we aren't
+ * reading yet */
+#define MONGOC_WRITE_PIPELINE_MAX_BYTES (16 * 1024 * 1024)
+
 
 typedef enum
 {
@@ -52,21 +63,52 @@ struct _mongoc_bulk_write_flags_t
 };
 
 
+/* an insert document the caller still owns, see
+ * mongoc_bulk_operation_insert_borrowed */
+typedef struct
+{
+   const bson_t *document;
+   bool          has_id;
+   bson_oid_t    oid;      /* generated "_id", if the document has none */
+} mongoc_write_borrowed_doc_t;
+
+
+/* where a document's value sits in a command's documents buffer */
+typedef struct
+{
+   uint32_t offset;  /* of its length prefix, from the buffer's start */
+   uint32_t len;
+} mongoc_write_doc_span_t;
+
+
 typedef struct
 {
    int      type;
    bson_t  *documents;
    uint32_t n_documents;
+   /* a mongoc_write_doc_span_t per document in documents, so batches are
+    * cut and sent without walking the buffer */
+   mongoc_array_t spans;
    mongoc_bulk_write_flags_t flags;
    int64_t operation_id;
+   /* if set, each document's index in the bulk operation, otherwise they
+    * are numbered from the offset the command is executed with */
+   uint32_t *bulk_indexes;
    union {
       struct {
          bool allow_bulk_op_insert;
+         /* if true, documents is empty and borrowed_docs has the inserts */
+         bool borrowed;
+         mongoc_array_t borrowed_docs;
       } insert;
    } u;
 } mongoc_write_command_t;
 
 
+/* a write command sent as one batch, see _mongoc_write_command_send */
+typedef struct _mongoc_write_batch_t mongoc_write_batch_t;
+
+
 typedef struct
 {
    /* true after a legacy update prevents us from calculating nModified */
@@ -96,6 +138,11 @@ void _mongoc_write_command_init_insert (mongoc_write_command_t        *command,
                                         mongoc_bulk_write_flags_t      flags,
                                         int64_t                        operation_id,
                                         bool                           allow_bulk_op_insert);
+void _mongoc_write_command_init_insert_borrowed (mongoc_write_command_t   *command,
+                                                 const bson_t             *document,
+                                                 mongoc_bulk_write_flags_t flags,
+                                                 int64_t                   operation_id,
+                                                 bool                      allow_bulk_op_insert);
 void _mongoc_write_command_init_delete (mongoc_write_command_t        *command,
                                         const bson_t                  *selectors,
                                         const bson_t                  *opts,
@@ -109,6 +156,8 @@ void _mongoc_write_command_init_update (mongoc_write_command_t        *command,
                                         int64_t                        operation_id);
 void _mongoc_write_command_insert_append (mongoc_write_command_t      *command,
                                           const bson_t                *document);
+void _mongoc_write_command_insert_append_borrowed (mongoc_write_command_t *command,
+                                                   const bson_t           *document);
 void _mongoc_write_command_update_append (mongoc_write_command_t      *command,
                                           const bson_t                *selector,
                                           const bson_t                *update,
@@ -126,6 +175,50 @@ void _mongoc_write_command_execute     (mongoc_write_command_t        *command,
                                         const mongoc_write_concern_t  *write_concern,
                                         uint32_t                       offset,
                                         mongoc_write_result_t         *result);
+bool _mongoc_write_command_can_pipeline      (mongoc_write_command_t       *commands,
+                                              uint32_t                      n_commands,
+                                              mongoc_client_t              *client,
+                                              mongoc_server_stream_t       *server_stream,
+                                              const mongoc_write_concern_t *write_concern);
+void _mongoc_write_command_execute_pipelined (mongoc_write_command_t       *commands,
+                                              uint32_t                      n_commands,
+                                              mongoc_client_t              *client,
+                                              mongoc_server_stream_t       *server_stream,
+                                              const char                   *database,
+                                              const char                   *collection,
+                                              const mongoc_write_concern_t *write_concern,
+                                              uint32_t                      offset,
+                                              mongoc_write_result_t        *result);
+void _mongoc_write_command_execute_sharded  (mongoc_array_t               *commands,
+                                              mongoc_server_stream_t      **server_streams,
+                                              uint32_t                      n_streams,
+                                              mongoc_client_t              *client,
+                                              const char                   *database,
+                                              const char                   *collection,
+                                              const mongoc_write_concern_t *write_concern,
+                                              mongoc_write_result_t        *result);
+bool _mongoc_write_command_send        (mongoc_write_command_t        *command,
+                                        mongoc_write_batch_t          *batch,
+                                        mongoc_client_t               *client,
+                                        mongoc_server_stream_t        *server_stream,
+                                        const char                    *database,
+                                        const char                    *collection,
+                                        const mongoc_write_concern_t  *write_concern,
+                                        bson_error_t                  *error);
+mongoc_write_batch_t *_mongoc_write_batch_new        (void);
+bool                  _mongoc_write_batch_recv_reply (mongoc_write_batch_t   *batch,
+                                                      mongoc_client_t        *client,
+                                                      mongoc_server_stream_t *server_stream,
+                                                      bson_t                 *reply,
+                                                      bson_error_t           *error);
+void                  _mongoc_write_batch_abandon    (mongoc_write_batch_t   *batch,
+                                                      mongoc_client_t        *client,
+                                                      const bson_error_t     *error);
+void                  _mongoc_write_batch_free       (mongoc_write_batch_t   *batch);
+void _mongoc_write_command_partition   (mongoc_write_command_t        *command,
+                                        uint32_t                       offset,
+                                        const mongoc_shard_map_t      *map,
+                                        mongoc_write_command_t        *parts);
 void _mongoc_write_result_init         (mongoc_write_result_t         *result);
 void _mongoc_write_result_merge        (mongoc_write_result_t         *result,
                                         mongoc_write_command_t        *command,
@@ -18,6 +18,7 @@
 
 #include "mongoc-client-private.h"
 #include "mongoc-error.h"
+#include "mongoc-memory-private.h"
 #include "mongoc-trace-private.h"
 #include "mongoc-write-command-private.h"
 #include "mongoc-write-concern-private.h"
@@ -54,10 +55,11 @@ static const char *gCommandFields[] = { "deletes", "documents", "updates"};
 static const uint32_t gCommandFieldLens[] = { 7, 9, 7 };
 
 static int32_t
-_mongoc_write_result_merge_arrays (uint32_t               offset,
-                                   mongoc_write_result_t *result,
-                                   bson_t                *dest,
-                                   bson_iter_t           *iter);
+_mongoc_write_result_merge_arrays (const mongoc_write_command_t *command,
+                                   uint32_t                      offset,
+                                   mongoc_write_result_t        *result,
+                                   bson_t                       *dest,
+                                   bson_iter_t                  *iter);
 
 static bool
 _is_duplicate_key_error (int32_t code)
@@ -69,57 +71,196 @@ _is_duplicate_key_error (int32_t code)
 }
 
 
+/* append @document to command->documents as element @index, and note
+ * where its value landed in command->spans */
+static void
+_mongoc_write_command_push (mongoc_write_command_t *command,
+                            uint32_t                index,
+                            const bson_t           *document)
+{
+   mongoc_write_doc_span_t span;
+   const char *key;
+   char keydata [16];
+
+   key = NULL;
+   bson_uint32_to_string (index, &key, keydata, sizeof keydata);
+
+   BSON_ASSERT (key);
+
+   BSON_APPEND_DOCUMENT (command->documents, key, document);
+
+   /* the value is the last thing before the buffer's terminating NUL */
+   span.len = document->len;
+   span.offset = command->documents->len - 1 - span.len;
+   _mongoc_array_append_val (&command->spans, span);
+}
+
+
+/* point @document at the command's document @index, without copying */
+static void
+_mongoc_write_command_get_doc (const mongoc_write_command_t *command,
+                               uint32_t                      index,
+                               bson_t                       *document)
+{
+   const mongoc_write_doc_span_t *span;
+
+   BSON_ASSERT (index < command->spans.len);
+
+   span = &_mongoc_array_index (&command->spans, mongoc_write_doc_span_t,
+                                index);
+
+   if (!bson_init_static (document,
+                          bson_get_data (command->documents) + span->offset,
+                          span->len)) {
+      BSON_ASSERT (false);
+   }
+}
+
+
+/* append @document to the command as element @index, prefixed with an
+ * "_id" of @oid unless @oid is NULL */
+static void
+_mongoc_write_command_append_insert_doc (mongoc_write_command_t *command,
+                                         uint32_t                index,
+                                         const bson_t           *document,
+                                         const bson_oid_t       *oid)
+{
+   bson_t tmp;
+
+   if (oid) {
+      bson_init (&tmp);
+      BSON_APPEND_OID (&tmp, "_id", oid);
+      bson_concat (&tmp, document);
+      _mongoc_write_command_push (command, index, &tmp);
+      bson_destroy (&tmp);
+   } else {
+      _mongoc_write_command_push (command, index, document);
+   }
+}
+
+
 void
 _mongoc_write_command_insert_append (mongoc_write_command_t *command,
                                      const bson_t           *document)
 {
-   const char *key;
    bson_iter_t iter;
    bson_oid_t oid;
-   bson_t tmp;
-   char keydata [16];
 
    ENTRY;
 
    BSON_ASSERT (command);
    BSON_ASSERT (command->type == MONGOC_WRITE_COMMAND_INSERT);
+   BSON_ASSERT (!command->u.insert.borrowed);
    BSON_ASSERT (document);
    BSON_ASSERT (document->len >= 5);
 
-   key = NULL;
-   bson_uint32_to_string (command->n_documents,
-                          &key, keydata, sizeof keydata);
-
-   BSON_ASSERT (key);
-
    /*
     * If the document does not contain an "_id" field, we need to generate
     * a new oid for "_id".
     */
    if (!bson_iter_init_find (&iter, document, "_id")) {
-      bson_init (&tmp);
       bson_oid_init (&oid, NULL);
-      BSON_APPEND_OID (&tmp, "_id", &oid);
-      bson_concat (&tmp, document);
-      BSON_APPEND_DOCUMENT (command->documents, key, &tmp);
-      bson_destroy (&tmp);
+      _mongoc_write_command_append_insert_doc (command,
+                                               command->n_documents,
+                                               document, &oid);
    } else {
-      BSON_APPEND_DOCUMENT (command->documents, key, document);
+      _mongoc_write_command_append_insert_doc (command,
+                                               command->n_documents,
+                                               document, NULL);
+   }
+
+   command->n_documents++;
+
+   EXIT;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_write_command_insert_append_borrowed --
+ *
+ *       Add a reference to @document to a borrowing insert command. The
+ *       document isn't copied; if it has no "_id" one is generated now
+ *       and sent in front of the document's own elements.
+ *
+ *       NOTE: @document must not be modified or freed until the command
+ *       is destroyed.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_write_command_insert_append_borrowed (mongoc_write_command_t *command,
+                                              const bson_t           *document)
+{
+   mongoc_write_borrowed_doc_t borrowed;
+   bson_iter_t iter;
+
+   ENTRY;
+
+   BSON_ASSERT (command);
+   BSON_ASSERT (command->type == MONGOC_WRITE_COMMAND_INSERT);
+   BSON_ASSERT (command->u.insert.borrowed);
+   BSON_ASSERT (document);
+   BSON_ASSERT (document->len >= 5);
+
+   borrowed.document = document;
+   borrowed.has_id = bson_iter_init_find (&iter, document, "_id");
+
+   if (!borrowed.has_id) {
+      bson_oid_init (&borrowed.oid, NULL);
    }
 
+   _mongoc_array_append_val (&command->u.insert.borrowed_docs, borrowed);
    command->n_documents++;
 
    EXIT;
 }
 
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_write_command_materialize --
+ *
+ *       Copy a borrowing insert command's documents into
+ *       command->documents, for code paths that need them contiguous,
+ *       and make it an ordinary insert command.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_write_command_materialize (mongoc_write_command_t *command)
+{
+   mongoc_write_borrowed_doc_t *borrowed;
+   uint32_t i;
+
+   if (command->type != MONGOC_WRITE_COMMAND_INSERT ||
+       !command->u.insert.borrowed) {
+      return;
+   }
+
+   for (i = 0; i < command->n_documents; i++) {
+      borrowed = &_mongoc_array_index (&command->u.insert.borrowed_docs,
+                                       mongoc_write_borrowed_doc_t, i);
+
+      _mongoc_write_command_append_insert_doc (
+         command, i, borrowed->document,
+         borrowed->has_id ? NULL : &borrowed->oid);
+   }
+
+   _mongoc_array_destroy (&command->u.insert.borrowed_docs);
+   command->u.insert.borrowed = false;
+}
+
 void
 _mongoc_write_command_update_append (mongoc_write_command_t *command,
                                      const bson_t           *selector,
                                      const bson_t           *update,
                                      const bson_t           *opts)
 {
-   const char *key;
-   char keydata [16];
    bson_t doc;
 
    ENTRY;
@@ -136,10 +277,7 @@ _mongoc_write_command_update_append (mongoc_write_command_t *command,
       command->flags.has_collation |= bson_has_field (opts, "collation");
    }
 
-   key = NULL;
-   bson_uint32_to_string (command->n_documents, &key, keydata, sizeof keydata);
-   BSON_ASSERT (key);
-   BSON_APPEND_DOCUMENT (command->documents, key, &doc);
+   _mongoc_write_command_push (command, command->n_documents, &doc);
    command->n_documents++;
 
    bson_destroy (&doc);
@@ -152,8 +290,6 @@ _mongoc_write_command_delete_append (mongoc_write_command_t *command,
                                      const bson_t           *selector,
                                      const bson_t           *opts)
 {
-   const char *key;
-   char keydata [16];
    bson_t doc;
 
    ENTRY;
@@ -171,10 +307,7 @@ _mongoc_write_command_delete_append (mongoc_write_command_t *command,
       command->flags.has_collation |= bson_has_field (opts, "collation");
    }
 
-   key = NULL;
-   bson_uint32_to_string (command->n_documents, &key, keydata, sizeof keydata);
-   BSON_ASSERT (key);
-   BSON_APPEND_DOCUMENT (command->documents, key, &doc);
+   _mongoc_write_command_push (command, command->n_documents, &doc);
    command->n_documents++;
 
    bson_destroy (&doc);
@@ -196,9 +329,12 @@ _mongoc_write_command_init_insert (mongoc_write_command_t    *command,
    command->type = MONGOC_WRITE_COMMAND_INSERT;
    command->documents = bson_new ();
    command->n_documents = 0;
+   _mongoc_array_init (&command->spans, sizeof (mongoc_write_doc_span_t));
    command->flags = flags;
    command->u.insert.allow_bulk_op_insert = (uint8_t)allow_bulk_op_insert;
+   command->u.insert.borrowed = false;
    command->operation_id = operation_id;
+   command->bulk_indexes = NULL;
 
    /* must handle NULL document from mongoc_collection_insert_bulk */
    if (document) {
@@ -209,6 +345,37 @@ _mongoc_write_command_init_insert (mongoc_write_command_t    *command,
 }
 
 
+void
+_mongoc_write_command_init_insert_borrowed (mongoc_write_command_t   *command,              /* IN */
+                                            const bson_t             *document,             /* IN */
+                                            mongoc_bulk_write_flags_t flags,                /* IN */
+                                            int64_t                   operation_id,         /* IN */
+                                            bool                      allow_bulk_op_insert) /* IN */
+{
+   ENTRY;
+
+   BSON_ASSERT (command);
+   BSON_ASSERT (document);
+
+   command->type = MONGOC_WRITE_COMMAND_INSERT;
+   command->documents = bson_new ();
+   command->n_documents = 0;
+   _mongoc_array_init (&command->spans, sizeof (mongoc_write_doc_span_t));
+   command->flags = flags;
+   command->u.insert.allow_bulk_op_insert = (uint8_t)allow_bulk_op_insert;
+   command->u.insert.borrowed = true;
+   command->operation_id = operation_id;
+   command->bulk_indexes = NULL;
+
+   _mongoc_array_init (&command->u.insert.borrowed_docs,
+                       sizeof (mongoc_write_borrowed_doc_t));
+
+   _mongoc_write_command_insert_append_borrowed (command, document);
+
+   EXIT;
+}
+
+
 void
 _mongoc_write_command_init_delete (mongoc_write_command_t   *command,       /* IN */
                                    const bson_t             *selector,      /* IN */
@@ -224,8 +391,10 @@ _mongoc_write_command_init_delete (mongoc_write_command_t   *command,       /* I
    command->type = MONGOC_WRITE_COMMAND_DELETE;
    command->documents = bson_new ();
    command->n_documents = 0;
+   _mongoc_array_init (&command->spans, sizeof (mongoc_write_doc_span_t));
    command->flags = flags;
    command->operation_id = operation_id;
+   command->bulk_indexes = NULL;
 
    _mongoc_write_command_delete_append (command, selector, opts);
 
@@ -250,8 +419,10 @@ _mongoc_write_command_init_update (mongoc_write_command_t   *command,       /* I
    command->type = MONGOC_WRITE_COMMAND_UPDATE;
    command->documents = bson_new ();
    command->n_documents = 0;
+   _mongoc_array_init (&command->spans, sizeof (mongoc_write_doc_span_t));
    command->flags = flags;
    command->operation_id = operation_id;
+   command->bulk_indexes = NULL;
 
    _mongoc_write_command_update_append (command, selector, update, opts);
 
@@ -270,9 +441,14 @@ _mongoc_write_command_init (bson_t                       *doc,
 
    ENTRY;
 
-   if (!command->n_documents ||
-       !bson_iter_init (&iter, command->documents) ||
-       !bson_iter_next (&iter)) {
+   if (!command->n_documents) {
+      EXIT;
+   }
+
+   if (!(command->type == MONGOC_WRITE_COMMAND_INSERT &&
+         command->u.insert.borrowed) &&
+       (!bson_iter_init (&iter, command->documents) ||
+        !bson_iter_next (&iter))) {
       EXIT;
    }
 
@@ -302,6 +478,7 @@ _mongoc_monitor_legacy_write (mongoc_client_t              *client,
 {
    bson_t doc;
    mongoc_apm_command_started_t event;
+   bool skip;
 
    ENTRY;
 
@@ -310,15 +487,21 @@ _mongoc_monitor_legacy_write (mongoc_client_t              *client,
    }
 
    bson_init (&doc);
-   _mongoc_write_command_init (&doc, command, collection, write_concern);
+   skip = (client->apm_callbacks.skip & MONGOC_APM_SKIP_COMMAND) != 0;
+
+   if (!skip) {
+      _mongoc_write_command_init (&doc, command, collection, write_concern);
 
-   /* copy the whole documents buffer as e.g. "updates": [...] */
-   BSON_APPEND_ARRAY (&doc,
-                      gCommandFields[command->type],
-                      command->documents);
+      /* copy the whole documents buffer as e.g. "updates": [...] */
+      BSON_APPEND_ARRAY (&doc,
+                         gCommandFields[command->type],
+                         command->documents);
+   }
 
    mongoc_apm_command_started_init (&event,
-                                    &doc,
+                                    skip ? NULL : &doc,
+                                    NULL,
+                                    0,
                                     db,
                                     gCommandNames[command->type],
                                     request_id,
@@ -481,6 +664,7 @@ _mongoc_monitor_legacy_write_succeeded (mongoc_client_t        *client,
    bool updated_existing = false;
 
    mongoc_apm_command_succeeded_t event;
+   bool skip;
 
    ENTRY;
 
@@ -488,6 +672,12 @@ _mongoc_monitor_legacy_write_succeeded (mongoc_client_t        *client,
       EXIT;
    }
 
+   skip = (client->apm_callbacks.skip & MONGOC_APM_SKIP_REPLY) != 0;
+   if (skip) {
+      /* the callback won't see the reply, don't parse getlasterror */
+      gle = NULL;
+   }
+
    /* first extract interesting fields from getlasterror response */
    if (gle) {
       bson_iter_init (&iter, gle);
@@ -562,7 +752,7 @@ _mongoc_monitor_legacy_write_succeeded (mongoc_client_t        *client,
 
    mongoc_apm_command_succeeded_init (&event,
                                       duration,
-                                      &doc,
+                                      skip ? NULL : &doc,
                                       gCommandNames[command->type],
                                       request_id,
                                       command->operation_id,
@@ -822,7 +1012,8 @@ _mongoc_write_command_insert_legacy (mongoc_write_command_t       *command,
 
    bson_snprintf (ns, sizeof ns, "%s.%s", database, collection);
 
-   iov = (mongoc_iovec_t *)bson_malloc ((sizeof *iov) * command->n_documents);
+   iov = (mongoc_iovec_t *) _mongoc_memory_malloc (
+      BULK, (sizeof *iov) * command->n_documents);
 
 again:
    has_more = false;
@@ -951,7 +1142,7 @@ cleanup:
       GOTO (again);
    }
 
-   bson_free (iov);
+   _mongoc_memory_free (iov);
 
    EXIT;
 }
@@ -1201,196 +1392,1261 @@ static mongoc_write_op_t gLegacyWriteOps[3] = {
    _mongoc_write_command_update_legacy };
 
 
-static void
-_mongoc_write_command(mongoc_write_command_t       *command,
-                      mongoc_client_t              *client,
-                      mongoc_server_stream_t       *server_stream,
-                      const char                   *database,
-                      const char                   *collection,
-                      const mongoc_write_concern_t *write_concern,
-                      uint32_t                      offset,
-                      mongoc_write_result_t        *result,
-                      bson_error_t                 *error)
-{
-   const uint8_t *data;
-   bson_iter_t iter;
-   const char *key;
-   uint32_t len = 0;
-   bson_t tmp;
-   bson_t ar;
-   bson_t cmd;
-   bson_t reply;
-   char str [16];
-   bool has_more;
-   bool ret = false;
-   uint32_t i;
-   int32_t max_bson_obj_size;
-   int32_t max_write_batch_size;
-   int32_t min_wire_version;
-   uint32_t overhead;
-   uint32_t key_len;
+/* type, key up to "4294967295", length, and a generated "_id" */
+#define BORROWED_HEADER_MAX (1 + 11 + 4 + 1 + 4 + 12)
 
-   ENTRY;
+/* type and key up to "4294967295" */
+#define ELEMENT_HEADER_MAX (1 + 11)
 
-   BSON_ASSERT (command);
-   BSON_ASSERT (client);
-   BSON_ASSERT (database);
-   BSON_ASSERT (server_stream);
-   BSON_ASSERT (collection);
 
-   bson_init (&cmd);
+/* splits a write command into batches the server accepts */
+typedef struct
+{
+   mongoc_write_command_t       *command;
+   const char                   *collection;
+   const mongoc_write_concern_t *write_concern;
+   int32_t                       max_bson_obj_size;
+   int32_t                       max_write_batch_size;
+   uint32_t                      idx;   /* next document's index */
+} mongoc_write_splitter_t;
 
-   max_bson_obj_size = mongoc_server_stream_max_bson_obj_size (server_stream);
-   max_write_batch_size = mongoc_server_stream_max_write_batch_size (server_stream);
 
-   /*
-    * If we have an unacknowledged write and the server supports the legacy
-    * opcodes, then submit the legacy opcode so we don't need to wait for
-    * a response from the server.
-    */
+/* one batch of a write command, as one "insert", "update" or "delete" */
+struct _mongoc_write_batch_t
+{
+   mongoc_write_command_t   *command;
+   uint32_t                  offset;      /* first document's bulk index */
+   uint32_t                  n_documents;
+   bson_t                    cmd;
+   /* the batch's "documents", "updates" or "deletes" array, gathered
+    * from the command's or the caller's buffers: array_header, then
+    * headers and bodies of the documents, then array_end */
+   mongoc_array_t            payload;
+   uint8_t                  *headers;
+   uint32_t                  headers_len;
+   uint8_t                   array_header[1 + 10 + 4];
+   uint8_t                   array_end;
+   mongoc_cluster_request_t  request;
+};
+
+
+/* the bytes @batch puts on the wire, not counting the message header */
+static int64_t
+_mongoc_write_batch_len (const mongoc_write_batch_t *batch)
+{
+   const mongoc_iovec_t *iov;
+   int64_t len;
+   size_t i;
 
-   min_wire_version = server_stream->sd->min_wire_version;
-   if ((min_wire_version == 0) &&
-       !mongoc_write_concern_is_acknowledged (write_concern)) {
-      if (command->flags.bypass_document_validation != MONGOC_BYPASS_DOCUMENT_VALIDATION_DEFAULT) {
-         bson_set_error (error,
-                         MONGOC_ERROR_COMMAND,
-                         MONGOC_ERROR_COMMAND_INVALID_ARG,
-                         "Cannot set bypassDocumentValidation for unacknowledged writes");
-         EXIT;
-      }
-      if (command->flags.has_collation) {
-         bson_set_error (error,
-                         MONGOC_ERROR_COMMAND,
-                         MONGOC_ERROR_COMMAND_INVALID_ARG,
-                         "Cannot set collation for unacknowledged writes");
-         EXIT;
-      }
-      gLegacyWriteOps[command->type] (command, client, server_stream, database,
-                                      collection, write_concern, offset,
-                                      result, error);
-      EXIT;
-   }
-   if (command->flags.has_collation &&
-       server_stream->sd->max_wire_version < WIRE_VERSION_COLLATION) {
-      bson_set_error (error,
-                      MONGOC_ERROR_COMMAND,
-                      MONGOC_ERROR_PROTOCOL_BAD_WIRE_VERSION,
-                      "Collation is not supported by the selected server");
-      EXIT;
-   }
+   len = batch->cmd.len;
+   iov = (const mongoc_iovec_t *) batch->payload.data;
 
-   if (!command->n_documents ||
-       !bson_iter_init (&iter, command->documents) ||
-       !bson_iter_next (&iter)) {
-      _empty_error (command, error);
-      result->failed = true;
-      EXIT;
+   for (i = 0; i < batch->payload.len; i++) {
+      len += (int64_t) iov[i].iov_len;
    }
 
-again:
-   has_more = false;
-   i = 0;
+   return len;
+}
 
-   _mongoc_write_command_init (&cmd, command, collection, write_concern);
 
-   /* 1 byte to specify array type, 1 byte for field name's null terminator */
-   overhead = cmd.len + 2 + gCommandFieldLens[command->type];
+static bool
+_mongoc_write_splitter_init (mongoc_write_splitter_t      *splitter,
+                             mongoc_write_command_t       *command,
+                             mongoc_server_stream_t       *server_stream,
+                             const char                   *collection,
+                             const mongoc_write_concern_t *write_concern)
+{
+   splitter->command = command;
+   splitter->collection = collection;
+   splitter->write_concern = write_concern;
+   splitter->max_bson_obj_size =
+      mongoc_server_stream_max_bson_obj_size (server_stream);
+   splitter->max_write_batch_size =
+      mongoc_server_stream_max_write_batch_size (server_stream);
+   splitter->idx = 0;
+
+   return command->n_documents > 0;
+}
 
-   if (!_mongoc_write_command_will_overflow (overhead,
-                                             command->documents->len,
-                                             command->n_documents,
-                                             max_bson_obj_size,
-                                             max_write_batch_size)) {
-      /* copy the whole documents buffer as e.g. "updates": [...] */
-      bson_append_array (&cmd,
-                         gCommandFields[command->type],
-                         gCommandFieldLens[command->type],
-                         command->documents);
-      i = command->n_documents;
-   } else {
-      bson_append_array_begin (&cmd,
-                               gCommandFields[command->type],
-                               gCommandFieldLens[command->type],
-                               &ar);
 
-      do {
-         if (!BSON_ITER_HOLDS_DOCUMENT (&iter)) {
-            BSON_ASSERT (false);
-         }
+static bool
+_mongoc_write_splitter_has_more (const mongoc_write_splitter_t *splitter)
+{
+   return splitter->idx < splitter->command->n_documents;
+}
 
-         bson_iter_document (&iter, &len, &data);
 
-         /* append array element like "0": { ... doc ... } */
-         key_len = (uint32_t) bson_uint32_to_string (i, &key, str, sizeof str);
+static void
+_mongoc_write_batch_init (mongoc_write_batch_t *batch)
+{
+   memset (batch, 0, sizeof *batch);
+   bson_init (&batch->cmd);
+   _mongoc_array_init (&batch->payload, sizeof (mongoc_iovec_t));
+}
 
-         /* 1 byte to specify document type, 1 byte for key's null terminator */
-         if (_mongoc_write_command_will_overflow (overhead,
-                                                  key_len + len + 2 + ar.len,
-                                                  i,
-                                                  max_bson_obj_size,
-                                                  max_write_batch_size)) {
-            has_more = true;
-            break;
-         }
 
-         if (!bson_init_static (&tmp, data, len)) {
-            BSON_ASSERT (false);
-         }
+static void
+_mongoc_write_batch_reset (mongoc_write_batch_t *batch)
+{
+   bson_reinit (&batch->cmd);
+   batch->payload.len = 0;
+   batch->n_documents = 0;
+}
 
-         BSON_APPEND_DOCUMENT (&ar, key, &tmp);
 
-         bson_destroy (&tmp);
+static void
+_mongoc_write_batch_destroy (mongoc_write_batch_t *batch)
+{
+   bson_destroy (&batch->cmd);
+   _mongoc_array_destroy (&batch->payload);
+   _mongoc_memory_free (batch->headers);
+}
 
-         i++;
-      } while (bson_iter_next (&iter));
 
-      bson_append_array_end (&cmd, &ar);
+/* total length of the decimal keys "0" through "n - 1" */
+static uint64_t
+_mongoc_write_keys_len (uint32_t n)
+{
+   uint64_t total = 0;
+   uint64_t start = 0;
+   uint64_t end = 10;
+   uint32_t digits = 1;
+
+   while (n > start) {
+      total += (BSON_MIN ((uint64_t) n, end) - start) * digits;
+      start = end;
+      end *= 10;
+      digits++;
    }
 
-   if (!i) {
-      too_large_error (error, i, len, max_bson_obj_size, NULL);
-      result->failed = true;
-      ret = false;
-   } else {
-      ret = mongoc_cluster_run_command_monitored (&client->cluster,
-                                                  server_stream,
-                                                  MONGOC_QUERY_NONE, database,
-                                                  &cmd, &reply, error);
-
-      if (!ret) {
-         result->failed = true;
-         if (bson_empty (&reply)) {
-            /* The command not only failed,
-             * the roundtrip to the server failed and the node was disconnected */
-            result->must_stop = true;
-         }
-      }
-
-      _mongoc_write_result_merge (result, command, &reply, offset);
-      offset += i;
-      bson_destroy (&reply);
-   }
+   return total;
+}
 
-   if (has_more && (ret || !command->flags.ordered) && !result->must_stop) {
-      bson_reinit (&cmd);
-      GOTO (again);
-   }
 
-   bson_destroy (&cmd);
-   EXIT;
+/* length of an array of the command's documents @first through
+ * @first + @n - 1, renumbered from "0" */
+static uint64_t
+_mongoc_write_command_array_len (const mongoc_write_command_t *command,
+                                 uint32_t                      first,
+                                 uint32_t                      n)
+{
+   const mongoc_write_doc_span_t *spans;
+   const mongoc_write_doc_span_t *last;
+   uint64_t docs_len;
+
+   spans = (const mongoc_write_doc_span_t *) command->spans.data;
+   last = &spans[first + n - 1];
+
+   /* from the first value to the end of the last, less the original
+    * headers (type, key, NUL) of the elements in between */
+   docs_len = (uint64_t) last->offset + last->len - spans[first].offset -
+              2 * (uint64_t) (n - 1) -
+              (_mongoc_write_keys_len (first + n) -
+               _mongoc_write_keys_len (first + 1));
+
+   /* length, terminating NUL, and new headers */
+   return 5 + docs_len + 2 * (uint64_t) n + _mongoc_write_keys_len (n);
 }
 
 
-void
-_mongoc_write_command_execute (mongoc_write_command_t       *command,       /* IN */
-                               mongoc_client_t              *client,        /* IN */
-                               mongoc_server_stream_t       *server_stream, /* IN */
-                               const char                   *database,      /* IN */
-                               const char                   *collection,    /* IN */
-                               const mongoc_write_concern_t *write_concern, /* IN */
-                               uint32_t                      offset,        /* IN */
-                               mongoc_write_result_t        *result)        /* OUT */
+/*
+ * gather whole documents from command->documents: the spans give the
+ * batch's size without walking the buffer, so its last document is found
+ * by bisection. A batch from the command's first document keeps its keys
+ * and goes on the wire as one slice of the buffer; a later batch's
+ * documents each get a small header with the new key, then their value
+ * straight from the buffer
+ */
+static void
+_mongoc_write_splitter_next_documents (mongoc_write_splitter_t *splitter,
+                                       mongoc_write_batch_t    *batch,
+                                       uint32_t                 overhead,
+                                       uint32_t                *len)
+{
+   mongoc_write_command_t *command = splitter->command;
+   const mongoc_write_doc_span_t *spans;
+   const uint8_t *data;
+   mongoc_iovec_t iov;
+   uint64_t max_cmd_size;
+   uint64_t ar_len;
+   uint32_t field_len;
+   uint32_t len_le;
+   uint32_t first;
+   uint32_t lo;
+   uint32_t hi;
+   uint32_t mid;
+   uint32_t i;
+   uint8_t *header;
+   uint8_t *p;
+   const char *key;
+   char str [16];
+   uint32_t key_len;
+
+   BSON_ASSERT (command->spans.len == command->n_documents);
+
+   spans = (const mongoc_write_doc_span_t *) command->spans.data;
+   data = bson_get_data (command->documents);
+   first = splitter->idx;
+
+   /* as in _mongoc_write_command_will_overflow */
+   max_cmd_size = (uint64_t) splitter->max_bson_obj_size + 16384;
+
+   /* the most documents that fit */
+   lo = 0;
+   hi = command->n_documents - first;
+   if (splitter->max_write_batch_size > 0 &&
+       hi > (uint32_t) splitter->max_write_batch_size) {
+      hi = (uint32_t) splitter->max_write_batch_size;
+   }
+
+   while (lo < hi) {
+      mid = lo + (hi - lo + 1) / 2;
+      if (overhead + _mongoc_write_command_array_len (command, first, mid) >
+          max_cmd_size) {
+         hi = mid - 1;
+      } else {
+         lo = mid;
+      }
+   }
+
+   if (!lo) {
+      /* too large to send at all */
+      *len = spans[first].len;
+      return;
+   }
+
+   ar_len = _mongoc_write_command_array_len (command, first, lo);
+
+   /* e.g. "updates": [ ... ] */
+   field_len = gCommandFieldLens[command->type];
+   batch->array_header[0] = BSON_TYPE_ARRAY;
+   memcpy (batch->array_header + 1, gCommandFields[command->type],
+           field_len + 1);
+   len_le = BSON_UINT32_TO_LE ((uint32_t) ar_len);
+   memcpy (batch->array_header + 2 + field_len, &len_le, 4);
+
+   iov.iov_base = (void *) batch->array_header;
+   iov.iov_len = 1 + field_len + 1 + 4;
+   _mongoc_array_append_val (&batch->payload, iov);
+
+   if (!first) {
+      /* from the first element to the end of the last value */
+      iov.iov_base = (void *) (data + 4);
+      iov.iov_len = spans[lo - 1].offset + spans[lo - 1].len - 4;
+      _mongoc_array_append_val (&batch->payload, iov);
+   } else {
+      if (batch->headers_len < ELEMENT_HEADER_MAX * lo) {
+         batch->headers_len = ELEMENT_HEADER_MAX * lo;
+         batch->headers = (uint8_t *) _mongoc_memory_realloc (
+            BULK, batch->headers, batch->headers_len);
+      }
+
+      for (i = 0; i < lo; i++) {
+         key_len = (uint32_t) bson_uint32_to_string (i, &key, str, sizeof str);
+
+         header = p = batch->headers + ELEMENT_HEADER_MAX * i;
+         *p++ = BSON_TYPE_DOCUMENT;
+         memcpy (p, key, key_len + 1);
+         p += key_len + 1;
+
+         iov.iov_base = (void *) header;
+         iov.iov_len = (size_t) (p - header);
+         _mongoc_array_append_val (&batch->payload, iov);
+
+         iov.iov_base = (void *) (data + spans[first + i].offset);
+         iov.iov_len = spans[first + i].len;
+         _mongoc_array_append_val (&batch->payload, iov);
+      }
+   }
+
+   batch->array_end = 0;
+   iov.iov_base = (void *) &batch->array_end;
+   iov.iov_len = 1;
+   _mongoc_array_append_val (&batch->payload, iov);
+
+   batch->n_documents = lo;
+   splitter->idx += lo;
+}
+
+
+/*
+ * gather a borrowed insert's documents: each goes on the wire straight
+ * from the caller's buffer, after a small header with the array element's
+ * type, key and length, plus the generated "_id" if there is one
+ */
+static void
+_mongoc_write_splitter_next_borrowed (mongoc_write_splitter_t *splitter,
+                                      mongoc_write_batch_t    *batch,
+                                      uint32_t                 overhead,
+                                      uint32_t                *len)
+{
+   mongoc_write_command_t *command = splitter->command;
+   mongoc_write_borrowed_doc_t *borrowed;
+   mongoc_iovec_t iov;
+   uint8_t *header;
+   uint8_t *p;
+   const char *key;
+   char str [16];
+   uint32_t key_len;
+   uint32_t ar_len = 5;
+   uint32_t len_le;
+   uint32_t n;
+
+   n = command->n_documents - splitter->idx;
+   if (batch->headers_len < BORROWED_HEADER_MAX * n) {
+      batch->headers_len = BORROWED_HEADER_MAX * n;
+      batch->headers = (uint8_t *) _mongoc_memory_realloc (
+         BULK, batch->headers, batch->headers_len);
+   }
+
+   /* "documents": [ ... ], its length is filled in below */
+   iov.iov_base = (void *) batch->array_header;
+   iov.iov_len = sizeof batch->array_header;
+   _mongoc_array_append_val (&batch->payload, iov);
+
+   while (_mongoc_write_splitter_has_more (splitter)) {
+      borrowed = &_mongoc_array_index (&command->u.insert.borrowed_docs,
+                                       mongoc_write_borrowed_doc_t,
+                                       splitter->idx);
+
+      *len = borrowed->document->len;
+      if (!borrowed->has_id) {
+         *len += 1 + 4 + 12;
+      }
+
+      key_len = (uint32_t) bson_uint32_to_string (batch->n_documents, &key,
+                                                  str, sizeof str);
+
+      /* 1 byte to specify document type, 1 byte for key's null terminator */
+      if (_mongoc_write_command_will_overflow (overhead,
+                                               key_len + *len + 2 + ar_len,
+                                               batch->n_documents,
+                                               splitter->max_bson_obj_size,
+                                               splitter->max_write_batch_size)) {
+         break;
+      }
+
+      header = p = batch->headers + BORROWED_HEADER_MAX * batch->n_documents;
+      *p++ = BSON_TYPE_DOCUMENT;
+      memcpy (p, key, key_len + 1);
+      p += key_len + 1;
+      len_le = BSON_UINT32_TO_LE (*len);
+      memcpy (p, &len_le, 4);
+      p += 4;
+
+      if (!borrowed->has_id) {
+         *p++ = BSON_TYPE_OID;
+         memcpy (p, "_id", 4);
+         p += 4;
+         memcpy (p, borrowed->oid.bytes, 12);
+         p += 12;
+      }
+
+      iov.iov_base = (void *) header;
+      iov.iov_len = (size_t) (p - header);
+      _mongoc_array_append_val (&batch->payload, iov);
+
+      /* the document's elements and its terminating NUL */
+      iov.iov_base = (void *) (bson_get_data (borrowed->document) + 4);
+      iov.iov_len = borrowed->document->len - 4;
+      _mongoc_array_append_val (&batch->payload, iov);
+
+      ar_len += key_len + *len + 2;
+      batch->n_documents++;
+      splitter->idx++;
+   }
+
+   batch->array_end = 0;
+   iov.iov_base = (void *) &batch->array_end;
+   iov.iov_len = 1;
+   _mongoc_array_append_val (&batch->payload, iov);
+
+   batch->array_header[0] = BSON_TYPE_ARRAY;
+   memcpy (batch->array_header + 1, gCommandFields[command->type], 10);
+   len_le = BSON_UINT32_TO_LE (ar_len);
+   memcpy (batch->array_header + 11, &len_le, 4);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_write_splitter_next --
+ *
+ *       Fill out @batch with as many of the command's remaining documents
+ *       as fit in one command. @offset is the command's first document's
+ *       index in the bulk operation.
+ *
+ * Returns:
+ *       true if @batch is ready to send. False if the next document is
+ *       too large to send at all: it is skipped and @error is set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_write_splitter_next (mongoc_write_splitter_t *splitter,
+                             mongoc_write_batch_t    *batch,
+                             uint32_t                 offset,
+                             bson_error_t            *error)
+{
+   mongoc_write_command_t *command = splitter->command;
+   uint32_t overhead;
+   uint32_t len = 0;
+
+   BSON_ASSERT (_mongoc_write_splitter_has_more (splitter));
+
+   _mongoc_write_batch_reset (batch);
+   batch->command = command;
+   batch->offset = offset + splitter->idx;
+
+   _mongoc_write_command_init (&batch->cmd, command, splitter->collection,
+                               splitter->write_concern);
+
+   /* 1 byte to specify array type, 1 byte for field name's null terminator */
+   overhead = batch->cmd.len + 2 + gCommandFieldLens[command->type];
+
+   if (command->type == MONGOC_WRITE_COMMAND_INSERT &&
+       command->u.insert.borrowed) {
+      _mongoc_write_splitter_next_borrowed (splitter, batch, overhead, &len);
+   } else {
+      _mongoc_write_splitter_next_documents (splitter, batch, overhead, &len);
+   }
+
+   if (!batch->n_documents) {
+      too_large_error (error, splitter->idx, len,
+                       splitter->max_bson_obj_size, NULL);
+
+      /* skip it, an unordered write continues with the next document */
+      splitter->idx++;
+
+      return false;
+   }
+
+   return true;
+}
+
+
+/* read a batch's reply and merge it into @result. @disconnected is set if
+ * the roundtrip to the server failed, not only the command */
+static bool
+_mongoc_write_batch_recv (mongoc_write_batch_t   *batch,
+                          mongoc_client_t        *client,
+                          mongoc_server_stream_t *server_stream,
+                          mongoc_write_result_t  *result,
+                          bool                   *disconnected,
+                          bson_error_t           *error)
+{
+   bson_t reply;
+   bool ret;
+
+   ret = mongoc_cluster_recv_reply (&client->cluster, server_stream,
+                                    &batch->request, &reply, error);
+
+   *disconnected = false;
+
+   if (!ret) {
+      result->failed = true;
+      if (bson_empty (&reply)) {
+         /* The command not only failed,
+          * the roundtrip to the server failed and the node was disconnected */
+         *disconnected = true;
+      }
+   }
+
+   _mongoc_write_result_merge (result, batch->command, &reply, batch->offset);
+   bson_destroy (&reply);
+
+   return ret;
+}
+
+
+static void
+_mongoc_write_command(mongoc_write_command_t       *command,
+                      mongoc_client_t              *client,
+                      mongoc_server_stream_t       *server_stream,
+                      const char                   *database,
+                      const char                   *collection,
+                      const mongoc_write_concern_t *write_concern,
+                      uint32_t                      offset,
+                      mongoc_write_result_t        *result,
+                      bson_error_t                 *error)
+{
+   mongoc_write_splitter_t splitter;
+   mongoc_write_batch_t batch;
+   bool disconnected;
+   bool unacknowledged;
+   bool ret;
+   int32_t min_wire_version;
+
+   ENTRY;
+
+   BSON_ASSERT (command);
+   BSON_ASSERT (client);
+   BSON_ASSERT (database);
+   BSON_ASSERT (server_stream);
+   BSON_ASSERT (collection);
+
+   /*
+    * If we have an unacknowledged write, send it as OP_MSG with moreToCome
+    * if the server supports it, otherwise submit the legacy opcode, so we
+    * don't need to wait for a response from the server.
+    */
+
+   min_wire_version = server_stream->sd->min_wire_version;
+   unacknowledged =
+      !mongoc_write_concern_is_acknowledged (write_concern) &&
+      server_stream->sd->max_wire_version >= WIRE_VERSION_OP_MSG;
+
+   if ((min_wire_version == 0) && !unacknowledged &&
+       !mongoc_write_concern_is_acknowledged (write_concern)) {
+      if (command->flags.bypass_document_validation != MONGOC_BYPASS_DOCUMENT_VALIDATION_DEFAULT) {
+         bson_set_error (error,
+                         MONGOC_ERROR_COMMAND,
+                         MONGOC_ERROR_COMMAND_INVALID_ARG,
+                         "Cannot set bypassDocumentValidation for unacknowledged writes");
+         EXIT;
+      }
+      if (command->flags.has_collation) {
+         bson_set_error (error,
+                         MONGOC_ERROR_COMMAND,
+                         MONGOC_ERROR_COMMAND_INVALID_ARG,
+                         "Cannot set collation for unacknowledged writes");
+         EXIT;
+      }
+      _mongoc_write_command_materialize (command);
+      gLegacyWriteOps[command->type] (command, client, server_stream, database,
+                                      collection, write_concern, offset,
+                                      result, error);
+      EXIT;
+   }
+   if (command->flags.has_collation &&
+       server_stream->sd->max_wire_version < WIRE_VERSION_COLLATION) {
+      bson_set_error (error,
+                      MONGOC_ERROR_COMMAND,
+                      MONGOC_ERROR_PROTOCOL_BAD_WIRE_VERSION,
+                      "Collation is not supported by the selected server");
+      EXIT;
+   }
+
+   if (!_mongoc_write_splitter_init (&splitter, command, server_stream,
+                                     collection, write_concern)) {
+      _empty_error (command, error);
+      result->failed = true;
+      EXIT;
+   }
+
+   _mongoc_write_batch_init (&batch);
+
+   while (_mongoc_write_splitter_has_more (&splitter)) {
+      if (!_mongoc_write_splitter_next (&splitter, &batch, offset, error)) {
+         result->failed = true;
+         ret = false;
+      } else if (unacknowledged) {
+         ret = mongoc_cluster_send_unacknowledged (
+            &client->cluster, server_stream, database, &batch.cmd,
+            (mongoc_iovec_t *) batch.payload.data, batch.payload.len, error);
+         if (!ret) {
+            /* the node was disconnected */
+            result->failed = true;
+            result->must_stop = true;
+         }
+      } else if (mongoc_cluster_send_command (
+                    &client->cluster, server_stream, MONGOC_QUERY_NONE,
+                    database, &batch.cmd,
+                    (mongoc_iovec_t *) batch.payload.data, batch.payload.len,
+                    &batch.request, error)) {
+         ret = _mongoc_write_batch_recv (&batch, client, server_stream,
+                                         result, &disconnected, error);
+         if (disconnected) {
+            result->must_stop = true;
+         }
+      } else {
+         /* the node was disconnected */
+         result->failed = true;
+         result->must_stop = true;
+         ret = false;
+      }
+
+      if ((!ret && command->flags.ordered) || result->must_stop) {
+         break;
+      }
+   }
+
+   _mongoc_write_batch_destroy (&batch);
+
+   EXIT;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_write_command_can_pipeline --
+ *
+ *       Whether _mongoc_write_command_execute_pipelined can execute
+ *       @commands on @server_stream: they would all be sent as write
+ *       commands, not legacy opcodes, and none would fail its checks
+ *       before being sent. Unacknowledged writes sent as legacy opcodes or
+ *       OP_MSG aren't pipelined, they have no replies to wait for anyway.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_write_command_can_pipeline (mongoc_write_command_t       *commands,
+                                    uint32_t                      n_commands,
+                                    mongoc_client_t              *client,
+                                    mongoc_server_stream_t       *server_stream,
+                                    const mongoc_write_concern_t *write_concern)
+{
+   uint32_t i;
+
+   if (!write_concern) {
+      write_concern = client->write_concern;
+   }
+
+   if (!mongoc_write_concern_is_valid (write_concern) ||
+       server_stream->sd->max_wire_version < WIRE_VERSION_WRITE_CMD ||
+       (!mongoc_write_concern_is_acknowledged (write_concern) &&
+        (server_stream->sd->min_wire_version == 0 ||
+         server_stream->sd->max_wire_version >= WIRE_VERSION_OP_MSG))) {
+      return false;
+   }
+
+   for (i = 0; i < n_commands; i++) {
+      if (!commands[i].n_documents ||
+          (commands[i].flags.has_collation &&
+           server_stream->sd->max_wire_version < WIRE_VERSION_COLLATION)) {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+
+mongoc_write_batch_t *
+_mongoc_write_batch_new (void)
+{
+   mongoc_write_batch_t *batch;
+
+   batch = (mongoc_write_batch_t *) _mongoc_memory_malloc (BULK, sizeof *batch);
+   _mongoc_write_batch_init (batch);
+
+   return batch;
+}
+
+
+void
+_mongoc_write_batch_free (mongoc_write_batch_t *batch)
+{
+   if (batch) {
+      _mongoc_write_batch_destroy (batch);
+      _mongoc_memory_free (batch);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_write_command_send --
+ *
+ *       Send all of @command as one write command in @batch, without
+ *       waiting for the reply: read it with _mongoc_write_batch_recv_reply.
+ *       Unlike _mongoc_write_command_execute, never falls back to legacy
+ *       opcodes, even for unacknowledged writes.
+ *
+ * Returns:
+ *       false and sets @error if @command doesn't fit in one batch, the
+ *       server can't execute it, or the stream failed.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_write_command_send (mongoc_write_command_t       *command,       /* IN */
+                            mongoc_write_batch_t         *batch,         /* OUT */
+                            mongoc_client_t              *client,        /* IN */
+                            mongoc_server_stream_t       *server_stream, /* IN */
+                            const char                   *database,      /* IN */
+                            const char                   *collection,    /* IN */
+                            const mongoc_write_concern_t *write_concern, /* IN */
+                            bson_error_t                 *error)         /* OUT */
+{
+   mongoc_write_splitter_t splitter;
+
+   ENTRY;
+
+   BSON_ASSERT (command);
+   BSON_ASSERT (batch);
+   BSON_ASSERT (client);
+   BSON_ASSERT (server_stream);
+
+   if (!write_concern) {
+      write_concern = client->write_concern;
+   }
+
+   if (server_stream->sd->max_wire_version < WIRE_VERSION_WRITE_CMD) {
+      bson_set_error (error,
+                      MONGOC_ERROR_PROTOCOL,
+                      MONGOC_ERROR_PROTOCOL_BAD_WIRE_VERSION,
+                      "The selected server does not support write commands");
+      RETURN (false);
+   }
+
+   if (command->flags.has_collation &&
+       server_stream->sd->max_wire_version < WIRE_VERSION_COLLATION) {
+      bson_set_error (error,
+                      MONGOC_ERROR_COMMAND,
+                      MONGOC_ERROR_PROTOCOL_BAD_WIRE_VERSION,
+                      "Collation is not supported by the selected server");
+      RETURN (false);
+   }
+
+   if (!_mongoc_write_splitter_init (&splitter, command, server_stream,
+                                     collection, write_concern)) {
+      _empty_error (command, error);
+      RETURN (false);
+   }
+
+   if (!_mongoc_write_splitter_next (&splitter, batch, 0, error)) {
+      RETURN (false);
+   }
+
+   if (_mongoc_write_splitter_has_more (&splitter)) {
+      bson_set_error (error,
+                      MONGOC_ERROR_BSON,
+                      MONGOC_ERROR_BSON_INVALID,
+                      "The %s is too large to send in one batch",
+                      gCommandNames[command->type]);
+      RETURN (false);
+   }
+
+   RETURN (mongoc_cluster_send_command (
+      &client->cluster, server_stream, MONGOC_QUERY_NONE, database,
+      &batch->cmd, (mongoc_iovec_t *) batch->payload.data, batch->payload.len,
+      &batch->request, error));
+}
+
+
+/* read the reply to a batch sent with _mongoc_write_command_send */
+bool
+_mongoc_write_batch_recv_reply (mongoc_write_batch_t   *batch,
+                                mongoc_client_t        *client,
+                                mongoc_server_stream_t *server_stream,
+                                bson_t                 *reply,
+                                bson_error_t           *error)
+{
+   BSON_ASSERT (batch);
+
+   return mongoc_cluster_recv_reply (&client->cluster, server_stream,
+                                     &batch->request, reply, error);
+}
+
+
+/* give up on the reply to a batch sent with _mongoc_write_command_send,
+ * its connection was closed */
+void
+_mongoc_write_batch_abandon (mongoc_write_batch_t *batch,
+                             mongoc_client_t      *client,
+                             const bson_error_t   *error)
+{
+   BSON_ASSERT (batch);
+
+   mongoc_cluster_abandon_request (&client->cluster, &batch->request, error);
+}
+
+
+/* batches of write commands in flight on one connection */
+typedef struct
+{
+   mongoc_write_command_t  *commands;
+   uint32_t                 n_commands;
+   mongoc_server_stream_t  *server_stream;
+   uint32_t                 next;            /* next command to split */
+   uint32_t                 offset;          /* its first document's bulk index */
+   uint32_t                 command_offset;  /* offset of the command being split */
+   bool                     splitting;
+   mongoc_write_splitter_t  splitter;
+   mongoc_write_batch_t     batches[MONGOC_WRITE_PIPELINE_DEPTH];
+   int64_t                  batch_lens[MONGOC_WRITE_PIPELINE_DEPTH];
+   uint32_t                 oldest;
+   uint32_t                 n_in_flight;
+   int64_t                  bytes_in_flight;
+   bool                     disconnected;
+} mongoc_write_pipeline_t;
+
+
+static void
+_mongoc_write_pipeline_init (mongoc_write_pipeline_t *pipeline,
+                             mongoc_write_command_t  *commands,
+                             uint32_t                 n_commands,
+                             mongoc_server_stream_t  *server_stream,
+                             uint32_t                 offset)
+{
+   uint32_t i;
+
+   memset (pipeline, 0, sizeof *pipeline);
+   pipeline->commands = commands;
+   pipeline->n_commands = n_commands;
+   pipeline->server_stream = server_stream;
+   pipeline->offset = offset;
+
+   for (i = 0; i < MONGOC_WRITE_PIPELINE_DEPTH; i++) {
+      _mongoc_write_batch_init (&pipeline->batches[i]);
+   }
+}
+
+
+static void
+_mongoc_write_pipeline_destroy (mongoc_write_pipeline_t *pipeline)
+{
+   uint32_t i;
+
+   for (i = 0; i < MONGOC_WRITE_PIPELINE_DEPTH; i++) {
+      _mongoc_write_batch_destroy (&pipeline->batches[i]);
+   }
+}
+
+
+/* send batches until the pipeline is full, by batches or bytes, or there
+ * are no more */
+static void
+_mongoc_write_pipeline_send (mongoc_write_pipeline_t      *pipeline,
+                             mongoc_client_t              *client,
+                             const char                   *database,
+                             const char                   *collection,
+                             const mongoc_write_concern_t *write_concern,
+                             mongoc_write_result_t        *result)
+{
+   mongoc_write_command_t *command;
+   mongoc_write_batch_t *batch;
+   uint32_t slot;
+
+   while (!pipeline->disconnected &&
+          pipeline->n_in_flight < MONGOC_WRITE_PIPELINE_DEPTH &&
+          pipeline->bytes_in_flight < MONGOC_WRITE_PIPELINE_MAX_BYTES) {
+      if (!pipeline->splitting ||
+          !_mongoc_write_splitter_has_more (&pipeline->splitter)) {
+         if (pipeline->next == pipeline->n_commands) {
+            return;
+         }
+
+         command = &pipeline->commands[pipeline->next++];
+         if (!_mongoc_write_splitter_init (&pipeline->splitter, command,
+                                           pipeline->server_stream,
+                                           collection, write_concern)) {
+            BSON_ASSERT (false);
+         }
+
+         /* a command with bulk_indexes numbers its own documents */
+         pipeline->command_offset = command->bulk_indexes ? 0
+                                                          : pipeline->offset;
+         pipeline->offset += command->n_documents;
+         pipeline->splitting = true;
+      }
+
+      slot = (pipeline->oldest + pipeline->n_in_flight) %
+             MONGOC_WRITE_PIPELINE_DEPTH;
+      batch = &pipeline->batches[slot];
+
+      if (!_mongoc_write_splitter_next (&pipeline->splitter, batch,
+                                        pipeline->command_offset,
+                                        &result->error)) {
+         result->failed = true;
+         continue;
+      }
+
+      if (!mongoc_cluster_send_command (
+             &client->cluster, pipeline->server_stream, MONGOC_QUERY_NONE,
+             database, &batch->cmd,
+             (mongoc_iovec_t *) batch->payload.data, batch->payload.len,
+             &batch->request, &result->error)) {
+         /* the node was disconnected */
+         result->failed = true;
+         pipeline->disconnected = true;
+         return;
+      }
+
+      pipeline->batch_lens[slot] = _mongoc_write_batch_len (batch);
+      pipeline->bytes_in_flight += pipeline->batch_lens[slot];
+      pipeline->n_in_flight++;
+   }
+}
+
+
+/* read the oldest batch's reply */
+static void
+_mongoc_write_pipeline_recv (mongoc_write_pipeline_t *pipeline,
+                             mongoc_client_t         *client,
+                             mongoc_write_result_t   *result)
+{
+   BSON_ASSERT (pipeline->n_in_flight);
+
+   _mongoc_write_batch_recv (&pipeline->batches[pipeline->oldest], client,
+                             pipeline->server_stream, result,
+                             &pipeline->disconnected, &result->error);
+
+   pipeline->bytes_in_flight -= pipeline->batch_lens[pipeline->oldest];
+   pipeline->oldest = (pipeline->oldest + 1) % MONGOC_WRITE_PIPELINE_DEPTH;
+   pipeline->n_in_flight--;
+}
+
+
+/* the connection failed: the batches still in flight get no replies */
+static void
+_mongoc_write_pipeline_abandon (mongoc_write_pipeline_t *pipeline,
+                                mongoc_client_t         *client,
+                                const bson_error_t      *error)
+{
+   while (pipeline->n_in_flight) {
+      _mongoc_write_batch_abandon (&pipeline->batches[pipeline->oldest],
+                                   client, error);
+      pipeline->bytes_in_flight -= pipeline->batch_lens[pipeline->oldest];
+      pipeline->oldest = (pipeline->oldest + 1) % MONGOC_WRITE_PIPELINE_DEPTH;
+      pipeline->n_in_flight--;
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_write_pipelines_run --
+ *
+ *       Keep each pipeline full, reading one reply from each connection
+ *       in turn, until all commands are executed. A pipeline whose
+ *       connection fails stops; replies still in flight on it are lost,
+ *       their requests are abandoned.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_write_pipelines_run (mongoc_write_pipeline_t      *pipelines,
+                             uint32_t                      n_pipelines,
+                             mongoc_client_t              *client,
+                             const char                   *database,
+                             const char                   *collection,
+                             const mongoc_write_concern_t *write_concern,
+                             mongoc_write_result_t        *result)
+{
+   bool busy;
+   uint32_t i;
+
+   do {
+      busy = false;
+
+      for (i = 0; i < n_pipelines; i++) {
+         _mongoc_write_pipeline_send (&pipelines[i], client, database,
+                                      collection, write_concern, result);
+      }
+
+      for (i = 0; i < n_pipelines; i++) {
+         if (pipelines[i].n_in_flight && !pipelines[i].disconnected) {
+            _mongoc_write_pipeline_recv (&pipelines[i], client, result);
+            busy = true;
+         }
+      }
+   } while (busy);
+
+   for (i = 0; i < n_pipelines; i++) {
+      if (pipelines[i].disconnected) {
+         _mongoc_write_pipeline_abandon (&pipelines[i], client,
+                                         &result->error);
+         result->must_stop = true;
+      }
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_write_command_execute_pipelined --
+ *
+ *       Execute @commands without ordering: their batches are pipelined
+ *       on @server_stream, with up to MONGOC_WRITE_PIPELINE_DEPTH sent
+ *       (see also MONGOC_WRITE_PIPELINE_MAX_BYTES) before the oldest
+ *       reply is read, instead of waiting a round trip
+ *       for each. Replies are merged into @result in the order sent, each
+ *       batch with its documents' offset into the bulk operation.
+ *
+ *       Only call this if _mongoc_write_command_can_pipeline is true.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_write_command_execute_pipelined (mongoc_write_command_t       *commands,      /* IN */
+                                         uint32_t                      n_commands,    /* IN */
+                                         mongoc_client_t              *client,        /* IN */
+                                         mongoc_server_stream_t       *server_stream, /* IN */
+                                         const char                   *database,      /* IN */
+                                         const char                   *collection,    /* IN */
+                                         const mongoc_write_concern_t *write_concern, /* IN */
+                                         uint32_t                      offset,        /* IN */
+                                         mongoc_write_result_t        *result)        /* OUT */
+{
+   mongoc_write_pipeline_t pipeline;
+
+   ENTRY;
+
+   BSON_ASSERT (commands);
+   BSON_ASSERT (client);
+   BSON_ASSERT (server_stream);
+   BSON_ASSERT (database);
+   BSON_ASSERT (collection);
+   BSON_ASSERT (result);
+
+   if (!write_concern) {
+      write_concern = client->write_concern;
+   }
+
+   _mongoc_write_pipeline_init (&pipeline, commands, n_commands,
+                                server_stream, offset);
+   _mongoc_write_pipelines_run (&pipeline, 1, client, database, collection,
+                                write_concern, result);
+   _mongoc_write_pipeline_destroy (&pipeline);
+
+   EXIT;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_write_command_execute_sharded --
+ *
+ *       Like _mongoc_write_command_execute_pipelined, but on several
+ *       mongos at once: @commands[i] is an array of the commands to run
+ *       on @server_streams[i]. Each command must have bulk_indexes, see
+ *       _mongoc_write_command_partition. Sends on each connection are
+ *       interleaved with reads from the others, so batches for different
+ *       shards are in flight at the same time.
+ *
+ *       Only call this if _mongoc_write_command_can_pipeline is true for
+ *       each stream's commands.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_write_command_execute_sharded (mongoc_array_t               *commands,       /* IN */
+                                       mongoc_server_stream_t      **server_streams, /* IN */
+                                       uint32_t                      n_streams,      /* IN */
+                                       mongoc_client_t              *client,         /* IN */
+                                       const char                   *database,       /* IN */
+                                       const char                   *collection,     /* IN */
+                                       const mongoc_write_concern_t *write_concern,  /* IN */
+                                       mongoc_write_result_t        *result)         /* OUT */
+{
+   mongoc_write_pipeline_t *pipelines;
+   uint32_t i;
+
+   ENTRY;
+
+   BSON_ASSERT (commands);
+   BSON_ASSERT (server_streams);
+   BSON_ASSERT (client);
+   BSON_ASSERT (database);
+   BSON_ASSERT (collection);
+   BSON_ASSERT (result);
+
+   if (!write_concern) {
+      write_concern = client->write_concern;
+   }
+
+   pipelines = (mongoc_write_pipeline_t *) _mongoc_memory_malloc (
+      BULK, n_streams * sizeof (mongoc_write_pipeline_t));
+
+   for (i = 0; i < n_streams; i++) {
+      _mongoc_write_pipeline_init (
+         &pipelines[i], (mongoc_write_command_t *) commands[i].data,
+         (uint32_t) commands[i].len, server_streams[i], 0);
+   }
+
+   _mongoc_write_pipelines_run (pipelines, n_streams, client, database,
+                                collection, write_concern, result);
+
+   for (i = 0; i < n_streams; i++) {
+      _mongoc_write_pipeline_destroy (&pipelines[i]);
+   }
+
+   _mongoc_memory_free (pipelines);
+
+   EXIT;
+}
+
+
+/* copy @command's type and flags to an empty command */
+static void
+_mongoc_write_command_init_part (mongoc_write_command_t       *part,
+                                 const mongoc_write_command_t *command,
+                                 uint32_t                      n_documents)
+{
+   memset (part, 0, sizeof *part);
+
+   part->type = command->type;
+   part->documents = bson_new ();
+   part->n_documents = 0;
+   _mongoc_array_init (&part->spans, sizeof (mongoc_write_doc_span_t));
+   part->flags = command->flags;
+   part->operation_id = command->operation_id;
+   part->bulk_indexes = n_documents ? (uint32_t *) _mongoc_memory_malloc (
+      BULK, n_documents * sizeof (uint32_t)) : NULL;
+
+   if (command->type == MONGOC_WRITE_COMMAND_INSERT) {
+      part->u.insert.allow_bulk_op_insert =
+         command->u.insert.allow_bulk_op_insert;
+      part->u.insert.borrowed = command->u.insert.borrowed;
+
+      if (part->u.insert.borrowed) {
+         _mongoc_array_init (&part->u.insert.borrowed_docs,
+                             sizeof (mongoc_write_borrowed_doc_t));
+      }
+   }
+}
+
+
+/* the shard a document of @command targets, or -1 */
+static int32_t
+_mongoc_write_command_route (const mongoc_write_command_t *command,
+                             const mongoc_shard_map_t     *map,
+                             const bson_t                 *document)
+{
+   bson_iter_t iter;
+   const uint8_t *data;
+   uint32_t len;
+   bson_t selector;
+
+   if (command->type == MONGOC_WRITE_COMMAND_INSERT) {
+      return _mongoc_shard_map_route_insert (map, document, NULL);
+   }
+
+   /* an update or delete like {"q": {...}, ...} */
+   if (!bson_iter_init_find (&iter, document, "q") ||
+       !BSON_ITER_HOLDS_DOCUMENT (&iter)) {
+      return -1;
+   }
+
+   bson_iter_document (&iter, &len, &data);
+   if (!bson_init_static (&selector, data, len)) {
+      return -1;
+   }
+
+   return _mongoc_shard_map_route_query (map, &selector);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_write_command_partition --
+ *
+ *       Split @command by the shard each of its documents targets.
+ *       @parts must have room for one command per shard in @map, plus a
+ *       last one for documents we can't route. Each part's bulk_indexes
+ *       maps its documents back to the bulk operation, where @command's
+ *       first document is at @offset. Borrowed inserts are still borrowed
+ *       in the parts.
+ *
+ *       Parts are always initialized, some may have no documents; the
+ *       caller must destroy them all.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_write_command_partition (mongoc_write_command_t   *command, /* IN */
+                                 uint32_t                  offset,  /* IN */
+                                 const mongoc_shard_map_t *map,     /* IN */
+                                 mongoc_write_command_t   *parts)   /* OUT */
+{
+   mongoc_write_borrowed_doc_t *borrowed_doc;
+   mongoc_write_command_t *part;
+   uint32_t n_parts;
+   uint32_t *targets;
+   uint32_t *counts;
+   bson_t document;
+   int32_t shard;
+   bool borrowed;
+   uint32_t i;
+
+   ENTRY;
+
+   BSON_ASSERT (command);
+   BSON_ASSERT (map);
+   BSON_ASSERT (parts);
+
+   n_parts = (uint32_t) map->shards.len + 1;
+   targets = (uint32_t *) _mongoc_memory_malloc (
+      BULK, BSON_MAX (command->n_documents, 1) * sizeof (uint32_t));
+   counts = (uint32_t *) _mongoc_memory_malloc0 (BULK,
+                                                 n_parts * sizeof (uint32_t));
+   borrowed = command->type == MONGOC_WRITE_COMMAND_INSERT &&
+              command->u.insert.borrowed;
+
+   /* route each document, then copy each to its part */
+   if (borrowed) {
+      for (i = 0; i < command->n_documents; i++) {
+         borrowed_doc = &_mongoc_array_index (&command->u.insert.borrowed_docs,
+                                              mongoc_write_borrowed_doc_t, i);
+         shard = _mongoc_shard_map_route_insert (
+            map, borrowed_doc->document,
+            borrowed_doc->has_id ? NULL : &borrowed_doc->oid);
+         targets[i] = shard < 0 ? n_parts - 1 : (uint32_t) shard;
+         counts[targets[i]]++;
+      }
+   } else {
+      for (i = 0; i < command->n_documents; i++) {
+         _mongoc_write_command_get_doc (command, i, &document);
+         shard = _mongoc_write_command_route (command, map, &document);
+         targets[i] = shard < 0 ? n_parts - 1 : (uint32_t) shard;
+         counts[targets[i]]++;
+      }
+   }
+
+   for (i = 0; i < n_parts; i++) {
+      _mongoc_write_command_init_part (&parts[i], command, counts[i]);
+   }
+
+   if (borrowed) {
+      for (i = 0; i < command->n_documents; i++) {
+         part = &parts[targets[i]];
+         borrowed_doc = &_mongoc_array_index (&command->u.insert.borrowed_docs,
+                                              mongoc_write_borrowed_doc_t, i);
+         _mongoc_array_append_val (&part->u.insert.borrowed_docs,
+                                   *borrowed_doc);
+         part->bulk_indexes[part->n_documents++] = offset + i;
+      }
+   } else {
+      for (i = 0; i < command->n_documents; i++) {
+         part = &parts[targets[i]];
+         _mongoc_write_command_get_doc (command, i, &document);
+         _mongoc_write_command_push (part, part->n_documents, &document);
+         part->bulk_indexes[part->n_documents++] = offset + i;
+      }
+   }
+
+   _mongoc_memory_free (targets);
+   _mongoc_memory_free (counts);
+
+   EXIT;
+}
+
+
+void
+_mongoc_write_command_execute (mongoc_write_command_t       *command,       /* IN */
+                               mongoc_client_t              *client,        /* IN */
+                               mongoc_server_stream_t       *server_stream, /* IN */
+                               const char                   *database,      /* IN */
+                               const char                   *collection,    /* IN */
+                               const mongoc_write_concern_t *write_concern, /* IN */
+                               uint32_t                      offset,        /* IN */
+                               mongoc_write_result_t        *result)        /* OUT */
 {
    ENTRY;
 
@@ -1436,6 +2692,7 @@ _mongoc_write_command_execute (mongoc_write_command_t       *command,       /* I
          result->failed = true;
          EXIT;
       }
+      _mongoc_write_command_materialize (command);
       gLegacyWriteOps[command->type] (command, client, server_stream, database,
                                       collection, write_concern, offset,
                                       result, &result->error);
@@ -1452,6 +2709,13 @@ _mongoc_write_command_destroy (mongoc_write_command_t *command)
 
    if (command) {
       bson_destroy (command->documents);
+      _mongoc_array_destroy (&command->spans);
+      _mongoc_memory_free (command->bulk_indexes);
+
+      if (command->type == MONGOC_WRITE_COMMAND_INSERT &&
+          command->u.insert.borrowed) {
+         _mongoc_array_destroy (&command->u.insert.borrowed_docs);
+      }
    }
 
    EXIT;
@@ -1573,7 +2837,7 @@ _append_write_err_legacy (mongoc_write_result_t *result,
    bson_iter_init (&iter, &holder);
    bson_iter_next (&iter);
 
-   _mongoc_write_result_merge_arrays (offset, result,
+   _mongoc_write_result_merge_arrays (NULL, offset, result,
                                       &result->writeErrors, &iter);
 
    bson_destroy (&holder);
@@ -1698,11 +2962,28 @@ _mongoc_write_result_merge_legacy (mongoc_write_result_t  *result,  /* IN */
 }
 
 
+/* the bulk operation index of a batch's @idx'th document, given the
+ * batch's @offset */
+static int32_t
+_mongoc_write_command_bulk_index (const mongoc_write_command_t *command,
+                                  uint32_t                      offset,
+                                  int32_t                       idx)
+{
+   if (command && command->bulk_indexes &&
+       idx >= 0 && offset + idx < command->n_documents) {
+      return (int32_t) command->bulk_indexes[offset + idx];
+   }
+
+   return (int32_t) offset + idx;
+}
+
+
 static int32_t
-_mongoc_write_result_merge_arrays (uint32_t               offset,
-                                   mongoc_write_result_t *result, /* IN */
-                                   bson_t                *dest,   /* IN */
-                                   bson_iter_t           *iter)   /* IN */
+_mongoc_write_result_merge_arrays (const mongoc_write_command_t *command, /* IN */
+                                   uint32_t                      offset,
+                                   mongoc_write_result_t        *result,  /* IN */
+                                   bson_t                       *dest,    /* IN */
+                                   bson_iter_t                  *iter)    /* IN */
 {
    const bson_value_t *value;
    bson_iter_t ar;
@@ -1733,7 +3014,8 @@ _mongoc_write_result_merge_arrays (uint32_t               offset,
             bson_append_document_begin (dest, keyptr, len, &child);
             while (bson_iter_next (&citer)) {
                if (BSON_ITER_IS_KEY (&citer, "index")) {
-                  idx = bson_iter_int32 (&citer) + offset;
+                  idx = _mongoc_write_command_bulk_index (
+                     command, offset, bson_iter_int32 (&citer));
                   BSON_APPEND_INT32 (&child, "index", idx);
                } else {
                   value = bson_iter_value (&citer);
@@ -1806,9 +3088,11 @@ _mongoc_write_result_merge (mongoc_write_result_t  *result,  /* IN */
                   if (bson_iter_recurse (&ar, &citer) &&
                       bson_iter_find (&citer, "_id")) {
                      value = bson_iter_value (&citer);
-                     _mongoc_write_result_append_upsert (result,
-                                                         offset + server_index,
-                                                         value);
+                     _mongoc_write_result_append_upsert (
+                        result,
+                        _mongoc_write_command_bulk_index (command, offset,
+                                                          server_index),
+                        value);
                      n_upserted++;
                   }
                }
@@ -1846,8 +3130,8 @@ _mongoc_write_result_merge (mongoc_write_result_t  *result,  /* IN */
 
    if (bson_iter_init_find (&iter, reply, "writeErrors") &&
        BSON_ITER_HOLDS_ARRAY (&iter)) {
-      _mongoc_write_result_merge_arrays (offset, result, &result->writeErrors,
-                                         &iter);
+      _mongoc_write_result_merge_arrays (command, offset, result,
+                                         &result->writeErrors, &iter);
    }
 
    if (bson_iter_init_find (&iter, reply, "writeConcernError") &&
@@ -24,6 +24,7 @@
 #define MONGOC_INSIDE
 #include "mongoc-apm.h"
 #include "mongoc-bulk-operation.h"
+#include "mongoc-bulk-writer.h"
 #include "mongoc-client.h"
 #include "mongoc-client-pool.h"
 #include "mongoc-collection.h"
@@ -40,15 +41,20 @@
 #include "mongoc-host-list.h"
 #include "mongoc-init.h"
 #include "mongoc-matcher.h"
+#include "mongoc-memory.h"
 #include "mongoc-handshake.h"
 #include "mongoc-opcode.h"
 #include "mongoc-log.h"
+#include "mongoc-slow-op.h"
 #include "mongoc-socket.h"
+#include "mongoc-span.h"
 #include "mongoc-stream.h"
 #include "mongoc-stream-buffered.h"
+#include "mongoc-stream-fault.h"
 #include "mongoc-stream-file.h"
 #include "mongoc-stream-gridfs.h"
 #include "mongoc-stream-socket.h"
+#include "mongoc-trace-buffer.h"
 #include "mongoc-uri.h"
 #include "mongoc-write-concern.h"
 #include "mongoc-version.h"
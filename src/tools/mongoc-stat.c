@@ -24,10 +24,14 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "mongoc-histogram-private.h"
+
 
 #pragma pack(1)
 typedef struct
@@ -52,7 +56,14 @@ typedef struct
    uint32_t n_counters;
    uint32_t infos_offset;
    uint32_t values_offset;
-   uint8_t  padding[44];
+   uint32_t n_histograms;
+   uint32_t histogram_infos_offset;
+   uint32_t histograms_offset;
+   uint32_t n_slow_ops;
+   uint32_t slow_ops_offset;
+   uint32_t n_keyed;
+   uint32_t keyed_infos_offset;
+   uint8_t  padding[16];
 } mongoc_counters_t;
 #pragma pack()
 
@@ -75,6 +86,105 @@ typedef struct
 } mongoc_counter_t;
 
 
+#pragma pack(1)
+typedef struct
+{
+   uint32_t offset;
+   uint32_t n_buckets;
+   char          category[24];
+   char          name[32];
+   char          description[64];
+} mongoc_histogram_info_t;
+#pragma pack()
+
+
+BSON_STATIC_ASSERT(sizeof(mongoc_histogram_info_t) == 128);
+
+
+/* like mongoc-slow-op-private.h */
+#pragma pack(1)
+typedef struct
+{
+   int64_t  seq;
+   int64_t  time;
+   int64_t  duration;
+   int64_t  operation_id;
+   int64_t  reply_size;
+   uint32_t request_id;
+   uint32_t server_id;
+   uint32_t phases;
+   uint8_t  succeeded;
+   uint8_t  padding[3];
+   int64_t  phase_usec[8];
+   char     command_name[32];
+   char     db_name[64];
+   char     host[64];
+   char     shape[744];
+} mongoc_slow_op_t;
+#pragma pack()
+
+
+BSON_STATIC_ASSERT(sizeof(mongoc_slow_op_t) == 1024);
+
+
+/* like mongoc-counters.c */
+#pragma pack(1)
+typedef struct
+{
+   uint32_t kind;
+   int32_t  state;
+   uint32_t offset;
+   uint32_t padding;
+   char     key[240];
+} mongoc_keyed_info_t;
+#pragma pack()
+
+
+BSON_STATIC_ASSERT(sizeof(mongoc_keyed_info_t) == 256);
+
+
+#define KEYED_READY 2
+
+
+/* a keyed group's counters, their slots in order */
+static const char *gKeyedKinds[] = {
+   "Server",
+   "Namespace",
+};
+
+static const char *gKeyedNames[] = {
+   "ops",
+   "bytes_out",
+   "bytes_in",
+   "errors",
+   "timeouts",
+   "in_flight",
+};
+
+#define KEYED_SLOTS (sizeof gKeyedNames / sizeof gKeyedNames[0])
+#define KEYED_IN_FLIGHT 5
+
+
+static const char *gPhaseNames[] = {
+   "pool_checkout",
+   "server_selection",
+   "connect",
+   "send",
+   "server",
+   "recv",
+};
+
+
+/* the counters' and histograms' values at one time, summed over CPUs */
+typedef struct
+{
+   int64_t *values;  /* per counter */
+   int64_t *buckets; /* per histogram, n_buckets each */
+   int64_t *sums;    /* per histogram */
+   int64_t *keyed;   /* per keyed group, KEYED_SLOTS each */
+} mongoc_counters_snapshot_t;
+
+
 static mongoc_counters_t *
 mongoc_counters_new_from_pid (unsigned pid)
 {
@@ -165,32 +275,379 @@ mongoc_counters_get_value (mongoc_counters_t     *counters,
 }
 
 
+static mongoc_histogram_info_t *
+mongoc_counters_get_histogram_infos (mongoc_counters_t *counters,
+                                     uint32_t          *n_infos)
+{
+   char *base = (char *)counters;
+
+   BSON_ASSERT(counters);
+   BSON_ASSERT(n_infos);
+
+   /* segments from before histograms were added have none */
+   *n_infos = counters->n_histograms;
+
+   return (mongoc_histogram_info_t *)(base + counters->histogram_infos_offset);
+}
+
+
+static mongoc_keyed_info_t *
+mongoc_counters_get_keyed_infos (mongoc_counters_t *counters,
+                                 uint32_t          *n_infos)
+{
+   char *base = (char *)counters;
+
+   BSON_ASSERT(counters);
+   BSON_ASSERT(n_infos);
+
+   /* segments from before keyed groups were added have none */
+   *n_infos = counters->n_keyed;
+
+   return (mongoc_keyed_info_t *)(base + counters->keyed_infos_offset);
+}
+
+
 static void
-mongoc_counters_print_info (mongoc_counters_t     *counters,
-                            mongoc_counter_info_t *info,
-                            FILE                  *file)
+mongoc_counters_snapshot_init (mongoc_counters_snapshot_t *snapshot,
+                               uint32_t                    n_counters,
+                               mongoc_histogram_info_t    *hinfos,
+                               uint32_t                    n_histograms)
+{
+   size_t n_buckets = 0;
+   uint32_t i;
+
+   for (i = 0; i < n_histograms; i++) {
+      n_buckets += hinfos[i].n_buckets;
+   }
+
+   snapshot->values = (int64_t *)calloc (n_counters + 1, sizeof (int64_t));
+   snapshot->buckets = (int64_t *)calloc (n_buckets + 1, sizeof (int64_t));
+   snapshot->sums = (int64_t *)calloc (n_histograms + 1, sizeof (int64_t));
+   snapshot->keyed = NULL;
+}
+
+
+static void
+mongoc_counters_snapshot_destroy (mongoc_counters_snapshot_t *snapshot)
+{
+   free (snapshot->values);
+   free (snapshot->buckets);
+   free (snapshot->sums);
+   free (snapshot->keyed);
+}
+
+
+static void
+mongoc_counters_snapshot_take (mongoc_counters_snapshot_t *snapshot,
+                               mongoc_counters_t          *counters,
+                               mongoc_counter_info_t      *infos,
+                               uint32_t                    n_counters,
+                               mongoc_histogram_info_t    *hinfos,
+                               uint32_t                    n_histograms)
 {
    mongoc_counter_t ctr;
-   int64_t value;
+   const int64_t *cpu;
+   int64_t *buckets;
+   uint32_t i;
+   uint32_t j;
+   uint32_t b;
+
+   for (i = 0; i < n_counters; i++) {
+      BSON_ASSERT ((infos[i].offset & 0x7) == 0);
+
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wcast-align"
+#endif
+      ctr.cpus = (mongoc_counter_slots_t *)(((char *)counters) +
+                                            infos[i].offset);
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+
+      snapshot->values[i] = mongoc_counters_get_value (counters, &infos[i],
+                                                       &ctr);
+   }
+
+   buckets = snapshot->buckets;
+
+   for (i = 0; i < n_histograms; i++) {
+      memset (buckets, 0, hinfos[i].n_buckets * sizeof (int64_t));
+      snapshot->sums[i] = 0;
+
+      for (j = 0; j < counters->n_cpu; j++) {
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wcast-align"
+#endif
+         cpu = (const int64_t *)(((char *)counters) + hinfos[i].offset +
+                                 j * MONGOC_HISTOGRAM_CPU_SIZE (hinfos[i].n_buckets));
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+
+         for (b = 0; b < hinfos[i].n_buckets; b++) {
+            buckets[b] += cpu[b];
+         }
+
+         snapshot->sums[i] += cpu[hinfos[i].n_buckets];
+      }
+
+      buckets += hinfos[i].n_buckets;
+   }
+}
+
+
+/* groups are claimed while the process runs: take their values even if
+ * they are free, those are zero */
+static void
+mongoc_counters_snapshot_take_keyed (mongoc_counters_snapshot_t *snapshot,
+                                     mongoc_counters_t          *counters,
+                                     mongoc_keyed_info_t        *kinfos,
+                                     uint32_t                    n_keyed)
+{
+   const mongoc_counter_slots_t *cpus;
+   uint32_t i;
+   uint32_t j;
+   uint32_t s;
+
+   if (!snapshot->keyed) {
+      snapshot->keyed = (int64_t *)calloc (n_keyed * KEYED_SLOTS + 1,
+                                           sizeof (int64_t));
+   }
+
+   for (i = 0; i < n_keyed; i++) {
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wcast-align"
+#endif
+      cpus = (const mongoc_counter_slots_t *)(((char *)counters) +
+                                              kinfos[i].offset);
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+
+      for (s = 0; s < KEYED_SLOTS; s++) {
+         snapshot->keyed[i * KEYED_SLOTS + s] = 0;
+
+         for (j = 0; j < counters->n_cpu; j++) {
+            snapshot->keyed[i * KEYED_SLOTS + s] += cpus[j].slots[s];
+         }
+      }
+   }
+}
+
+
+static void
+mongoc_histogram_print_value (FILE    *file,
+                              int64_t  value,
+                              int64_t  last_min)
+{
+   if (value < 0) {
+      fprintf (file, " : >%lld", (long long)last_min);
+   } else {
+      fprintf (file, " : %lld", (long long)value);
+   }
+}
+
+
+static void
+mongoc_counters_print (mongoc_counter_info_t            *infos,
+                       uint32_t                          n_counters,
+                       mongoc_histogram_info_t          *hinfos,
+                       uint32_t                          n_histograms,
+                       const mongoc_counters_snapshot_t *snapshot,
+                       const mongoc_counters_snapshot_t *prev,
+                       FILE                             *file)
+{
+   static const double percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+   int64_t buckets[256];
+   const int64_t *cur;
+   const int64_t *old;
+   int64_t count;
+   int64_t sum;
+   uint32_t n_buckets;
+   uint32_t i;
+   size_t p;
+
+   for (i = 0; i < n_counters; i++) {
+      fprintf(file, "%24s : %-24s : %-50s : %lld\n",
+              infos[i].category, infos[i].name, infos[i].description,
+              (long long)(snapshot->values[i] -
+                          (prev ? prev->values[i] : 0)));
+   }
+
+   cur = snapshot->buckets;
+   old = prev ? prev->buckets : NULL;
+
+   for (i = 0; i < n_histograms; i++) {
+      n_buckets = BSON_MIN (hinfos[i].n_buckets, 256);
+      count = _mongoc_histogram_delta (cur, old, n_buckets, buckets);
 
-   BSON_ASSERT (info);
-   BSON_ASSERT (file);
-   BSON_ASSERT ((info->offset & 0x7) == 0);
+      sum = snapshot->sums[i] - (prev ? prev->sums[i] : 0);
+
+      fprintf(file, "%24s : %-24s : %-50s : n=%lld",
+              hinfos[i].category, hinfos[i].name, hinfos[i].description,
+              (long long)count);
+
+      if (count) {
+         fprintf (file, " mean=%lld", (long long)(sum / count));
+
+         for (p = 0; p < sizeof percentiles / sizeof percentiles[0]; p++) {
+            fprintf (file, " p%g", percentiles[p]);
+            mongoc_histogram_print_value (
+               file,
+               _mongoc_histogram_percentile (buckets, n_buckets, count,
+                                             percentiles[p]),
+               _mongoc_histogram_bucket_min (n_buckets - 1));
+         }
+
+         fprintf (file, " max");
+         mongoc_histogram_print_value (
+            file,
+            _mongoc_histogram_percentile (buckets, n_buckets, count, 100.0),
+            _mongoc_histogram_bucket_min (n_buckets - 1));
+      }
+
+      fprintf (file, "\n");
+
+      cur += hinfos[i].n_buckets;
+      if (old) {
+         old += hinfos[i].n_buckets;
+      }
+   }
+}
+
+
+/* print the keyed groups in use; in_flight is a gauge, never a change */
+static void
+mongoc_counters_print_keyed (mongoc_keyed_info_t              *kinfos,
+                             uint32_t                          n_keyed,
+                             const mongoc_counters_snapshot_t *snapshot,
+                             const mongoc_counters_snapshot_t *prev,
+                             FILE                             *file)
+{
+   const int64_t *cur;
+   const int64_t *old;
+   char key[sizeof kinfos->key];
+   uint32_t i;
+   uint32_t s;
+
+   for (i = 0; i < n_keyed; i++) {
+      if (kinfos[i].state != KEYED_READY) {
+         continue;
+      }
+
+      cur = &snapshot->keyed[i * KEYED_SLOTS];
+      old = prev ? &prev->keyed[i * KEYED_SLOTS] : NULL;
+
+      /* skip groups with nothing counted, like "(other)" before a table
+       * fills */
+      if (!cur[0]) {
+         continue;
+      }
+
+      memcpy (key, kinfos[i].key, sizeof key);
+      key[sizeof key - 1] = '\0';
+
+      fprintf (file, "%24s : %-24s :",
+               kinfos[i].kind < 2 ? gKeyedKinds[kinfos[i].kind] : "?", key);
+
+      for (s = 0; s < KEYED_SLOTS; s++) {
+         fprintf (file, " %s=%lld", gKeyedNames[s],
+                  (long long)(cur[s] - ((old && s != KEYED_IN_FLIGHT) ? old[s]
+                                                                      : 0)));
+      }
+
+      fprintf (file, "\n");
+   }
+}
+
+
+/* print the slow op log, oldest first, skipping records being written */
+static void
+mongoc_slow_ops_print (mongoc_counters_t *counters,
+                       FILE              *file)
+{
+   const char *base = (const char *)counters;
+   const volatile int64_t *head;
+   const volatile mongoc_slow_op_t *ops;
+   const volatile mongoc_slow_op_t *slot;
+   mongoc_slow_op_t op;
+   struct tm tm;
+   time_t secs;
+   char when[32];
+   int64_t ticket;
+   int64_t seq;
+   uint32_t p;
+
+   /* segments from before the log was added have none */
+   if (!counters->n_slow_ops) {
+      fprintf (stderr, "No slow op log in this process.\n");
+      return;
+   }
 
 #ifdef __clang__
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wcast-align"
 #endif
-   ctr.cpus = (mongoc_counter_slots_t *)(((char *)counters)+ info->offset);
+   head = (const volatile int64_t *)(base + counters->slow_ops_offset);
+   ops = (const volatile mongoc_slow_op_t *)(base +
+                                             counters->slow_ops_offset + 64);
 #ifdef __clang__
 #pragma clang diagnostic pop
 #endif
 
-   value = mongoc_counters_get_value(counters, info, &ctr);
+   ticket = BSON_MAX (0, *head - (int64_t)counters->n_slow_ops);
+
+   for (; ticket < *head; ticket++) {
+      slot = &ops[ticket % counters->n_slow_ops];
+      seq = slot->seq;
+      bson_memory_barrier ();
+      memcpy (&op, (const void *)slot, sizeof op);
+      bson_memory_barrier ();
+
+      /* being written, or overwritten while we copied it */
+      if (seq != 2 * ticket + 2 || slot->seq != seq) {
+         continue;
+      }
+
+      op.command_name[sizeof op.command_name - 1] = '\0';
+      op.db_name[sizeof op.db_name - 1] = '\0';
+      op.host[sizeof op.host - 1] = '\0';
+      op.shape[sizeof op.shape - 1] = '\0';
+
+      secs = (time_t)(op.time / 1000000);
+      localtime_r (&secs, &tm);
+      strftime (when, sizeof when, "%Y-%m-%d %H:%M:%S", &tm);
+
+      fprintf (file, "%s.%06lld %10lldus %s %s.%s reply=%lld%s",
+               when, (long long)(op.time % 1000000),
+               (long long)op.duration, op.host, op.db_name,
+               op.command_name, (long long)op.reply_size,
+               op.succeeded ? "" : " failed");
+
+      for (p = 0; p < sizeof gPhaseNames / sizeof gPhaseNames[0]; p++) {
+         if (op.phases & (1u << p)) {
+            fprintf (file, " %s=%lld", gPhaseNames[p],
+                     (long long)op.phase_usec[p]);
+         }
+      }
+
+      fprintf (file, " %s\n", op.shape);
+   }
+}
+
 
-   fprintf(file, "%24s : %-24s : %-50s : %lld\n",
-           info->category, info->name, info->description,
-           (long long)value);
+static void
+usage (const char *prog)
+{
+   fprintf(stderr, "usage: %s [-i SECONDS | -s] PID\n", prog);
+   fprintf(stderr, "\n"
+                   "  -i SECONDS  Print the changes every SECONDS instead of "
+                   "the totals once.\n"
+                   "  -s          Print the slow op log instead of the "
+                   "counters.\n");
 }
 
 
@@ -199,13 +656,34 @@ main (int   argc,
       char *argv[])
 {
    mongoc_counter_info_t *infos;
+   mongoc_histogram_info_t *hinfos;
+   mongoc_keyed_info_t *kinfos;
    mongoc_counters_t *counters;
+   mongoc_counters_snapshot_t snapshots[2];
    uint32_t n_counters = 0;
-   unsigned i;
+   uint32_t n_histograms = 0;
+   uint32_t n_keyed = 0;
+   unsigned interval = 0;
+   unsigned i = 0;
+   bool slow_ops = false;
    int pid;
 
+   if (argc == 4 && strcmp (argv[1], "-i") == 0) {
+      interval = (unsigned)strtol(argv[2], NULL, 10);
+      if (!interval) {
+         usage (argv[0]);
+         return 1;
+      }
+      argv += 2;
+      argc -= 2;
+   } else if (argc == 3 && strcmp (argv[1], "-s") == 0) {
+      slow_ops = true;
+      argv++;
+      argc--;
+   }
+
    if (argc != 2) {
-      fprintf(stderr, "usage: %s PID\n", argv[0]);
+      usage (argv[0]);
       return 1;
    }
 
@@ -215,11 +693,49 @@ main (int   argc,
       return EXIT_FAILURE;
    }
 
+   if (slow_ops) {
+      mongoc_slow_ops_print (counters, stdout);
+      mongoc_counters_destroy (counters);
+      return EXIT_SUCCESS;
+   }
+
    infos = mongoc_counters_get_infos (counters, &n_counters);
-   for (i = 0; i < n_counters; i++) {
-      mongoc_counters_print_info (counters, &infos[i], stdout);
+   hinfos = mongoc_counters_get_histogram_infos (counters, &n_histograms);
+   kinfos = mongoc_counters_get_keyed_infos (counters, &n_keyed);
+
+   mongoc_counters_snapshot_init (&snapshots[0], n_counters,
+                                  hinfos, n_histograms);
+   mongoc_counters_snapshot_take (&snapshots[0], counters, infos, n_counters,
+                                  hinfos, n_histograms);
+   mongoc_counters_snapshot_take_keyed (&snapshots[0], counters, kinfos,
+                                        n_keyed);
+
+   if (!interval) {
+      mongoc_counters_print (infos, n_counters, hinfos, n_histograms,
+                             &snapshots[0], NULL, stdout);
+      mongoc_counters_print_keyed (kinfos, n_keyed, &snapshots[0], NULL,
+                                   stdout);
+   } else {
+      mongoc_counters_snapshot_init (&snapshots[1], n_counters,
+                                     hinfos, n_histograms);
+
+      for (;;) {
+         sleep (interval);
+         mongoc_counters_snapshot_take (&snapshots[!i], counters, infos,
+                                        n_counters, hinfos, n_histograms);
+         mongoc_counters_snapshot_take_keyed (&snapshots[!i], counters,
+                                              kinfos, n_keyed);
+         mongoc_counters_print (infos, n_counters, hinfos, n_histograms,
+                                &snapshots[!i], &snapshots[i], stdout);
+         mongoc_counters_print_keyed (kinfos, n_keyed, &snapshots[!i],
+                                      &snapshots[i], stdout);
+         fprintf (stdout, "\n");
+         fflush (stdout);
+         i = !i;
+      }
    }
 
+   mongoc_counters_snapshot_destroy (&snapshots[0]);
    mongoc_counters_destroy (counters);
 
    return EXIT_SUCCESS;
@@ -0,0 +1,354 @@
+/*
+ * Copyright 2017 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Print a trace buffer dump, written by mongoc_trace_buffer_dump, as
+ * text: every thread's events merged in time order, each indented by its
+ * depth in its thread's calls.
+ */
+
+
+#include <bson.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+/* like mongoc-trace-buffer.c */
+#define DUMP_MAGIC   "MONGOCTB"
+#define DUMP_VERSION 1
+
+
+/* like mongoc-trace-buffer-private.h */
+typedef struct
+{
+   int64_t  time;
+   uint32_t site;
+   uint32_t payload;
+} mongoc_trace_record_t;
+
+
+BSON_STATIC_ASSERT(sizeof(mongoc_trace_record_t) == 16);
+
+
+enum
+{
+   EVENT_ENTRY,
+   EVENT_EXIT,
+   EVENT_GOTO,
+   EVENT_TRACE,
+   EVENT_BYTES,
+   EVENT_IOVEC,
+};
+
+
+typedef struct
+{
+   uint32_t    event;
+   uint32_t    line;
+   const char *domain;
+   const char *func;
+   const char *label;
+} site_t;
+
+
+typedef struct
+{
+   mongoc_trace_record_t record;
+   uint32_t              thread;
+   uint32_t              seq;     /* its order in its thread */
+} event_t;
+
+
+typedef struct
+{
+   const uint8_t *data;
+   size_t         len;
+   size_t         off;
+} reader_t;
+
+
+static bool
+read_bytes (reader_t *reader,
+            void     *out,
+            size_t    len)
+{
+   if (reader->len - reader->off < len) {
+      return false;
+   }
+
+   memcpy (out, reader->data + reader->off, len);
+   reader->off += len;
+
+   return true;
+}
+
+
+static bool
+read_str (reader_t    *reader,
+          const char **out)
+{
+   const char *str = (const char *)(reader->data + reader->off);
+   const void *nul;
+
+   nul = memchr (str, '\0', reader->len - reader->off);
+   if (!nul) {
+      return false;
+   }
+
+   *out = str;
+   reader->off += (size_t)((const char *)nul - str) + 1;
+
+   return true;
+}
+
+
+static uint8_t *
+read_file (const char *path,
+           size_t     *len)
+{
+   FILE *file;
+   uint8_t *data = NULL;
+   size_t allocated = 0;
+   size_t n;
+
+   file = strcmp (path, "-") ? fopen (path, "rb") : stdin;
+   if (!file) {
+      perror ("Failed to open trace buffer dump");
+      return NULL;
+   }
+
+   *len = 0;
+
+   do {
+      if (*len == allocated) {
+         allocated = allocated ? 2 * allocated : 1 << 20;
+         data = (uint8_t *)realloc (data, allocated);
+      }
+
+      n = fread (data + *len, 1, allocated - *len, file);
+      *len += n;
+   } while (n);
+
+   if (file != stdin) {
+      fclose (file);
+   }
+
+   return data;
+}
+
+
+static int
+event_cmp (const void *a,
+           const void *b)
+{
+   const event_t *x = (const event_t *)a;
+   const event_t *y = (const event_t *)b;
+
+   if (x->record.time != y->record.time) {
+      return x->record.time < y->record.time ? -1 : 1;
+   }
+
+   if (x->thread != y->thread) {
+      return x->thread < y->thread ? -1 : 1;
+   }
+
+   return x->seq < y->seq ? -1 : (x->seq > y->seq);
+}
+
+
+static void
+print_event (const event_t *event,
+             const site_t  *site,
+             int64_t        wall_offset,
+             int            depth,
+             FILE          *file)
+{
+   static const char *names[] = {
+      "ENTRY", " EXIT", " GOTO", "TRACE", "BYTES", "IOVEC",
+   };
+   int64_t usec = event->record.time + wall_offset;
+   struct tm tm;
+   time_t secs;
+   char when[32];
+
+   secs = (time_t)(usec / 1000000);
+#ifdef _WIN32
+   localtime_s (&tm, &secs);
+#else
+   localtime_r (&secs, &tm);
+#endif
+   strftime (when, sizeof when, "%Y/%m/%d %H:%M:%S", &tm);
+
+   fprintf (file, "%s.%06lld %4u %-16s %*s%s %s():%u", when,
+            (long long)(usec % 1000000), event->thread, site->domain,
+            2 * depth, "",
+            site->event <= EVENT_IOVEC ? names[site->event] : "    ?",
+            site->func, site->line);
+
+   if (site->event == EVENT_BYTES || site->event == EVENT_IOVEC) {
+      fprintf (file, " %s [%u]", site->label, event->record.payload);
+   } else if (*site->label) {
+      fprintf (file, " %s", site->label);
+   }
+
+   fprintf (file, "\n");
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+   reader_t reader;
+   char magic[8];
+   uint32_t version;
+   uint32_t n_sites;
+   uint32_t n_threads;
+   uint32_t record_size;
+   int64_t dumped_monotonic;
+   int64_t dumped_wall;
+   uint32_t id;
+   uint32_t thread;
+   uint32_t n_records;
+   uint32_t max_thread = 0;
+   site_t *sites;
+   site_t tmp;
+   event_t *events = NULL;
+   size_t n_events = 0;
+   int *depths;
+   uint8_t *data;
+   size_t len;
+   site_t *site;
+   uint32_t i;
+   uint32_t j;
+   size_t e;
+
+   if (argc != 2) {
+      fprintf (stderr, "usage: %s FILE\n", argv[0]);
+      fprintf (stderr, "\n"
+                       "Print a dump from mongoc_trace_buffer_dump(), or "
+                       "from stdin if FILE is \"-\".\n");
+      return EXIT_FAILURE;
+   }
+
+   if (!(data = read_file (argv[1], &len))) {
+      return EXIT_FAILURE;
+   }
+
+   reader.data = data;
+   reader.len = len;
+   reader.off = 0;
+
+   if (!read_bytes (&reader, magic, sizeof magic) ||
+       memcmp (magic, DUMP_MAGIC, sizeof magic) ||
+       !read_bytes (&reader, &version, 4) ||
+       version != DUMP_VERSION ||
+       !read_bytes (&reader, &n_sites, 4) ||
+       !read_bytes (&reader, &n_threads, 4) ||
+       !read_bytes (&reader, &record_size, 4) ||
+       record_size != sizeof (mongoc_trace_record_t) ||
+       !read_bytes (&reader, &dumped_monotonic, 8) ||
+       !read_bytes (&reader, &dumped_wall, 8)) {
+      fprintf (stderr, "Not a trace buffer dump, or from another version.\n");
+      free (data);
+      return EXIT_FAILURE;
+   }
+
+   /* ids start at 1 */
+   sites = (site_t *)calloc (n_sites + 1, sizeof (site_t));
+
+   for (i = 0; i < n_sites; i++) {
+      if (!read_bytes (&reader, &id, 4) ||
+          !read_bytes (&reader, &tmp.event, 4) ||
+          !read_bytes (&reader, &tmp.line, 4) ||
+          !read_str (&reader, &tmp.domain) ||
+          !read_str (&reader, &tmp.func) ||
+          !read_str (&reader, &tmp.label) ||
+          id == 0 || id > n_sites) {
+         fprintf (stderr, "Truncated or corrupt call sites.\n");
+         goto fail;
+      }
+
+      sites[id] = tmp;
+   }
+
+   for (i = 0; i < n_threads; i++) {
+      if (!read_bytes (&reader, &thread, 4) ||
+          !read_bytes (&reader, &n_records, 4) ||
+          reader.len - reader.off < (size_t)n_records * record_size) {
+         fprintf (stderr, "Truncated thread %u.\n", i);
+         goto fail;
+      }
+
+      events = (event_t *)realloc (events,
+                                   (n_events + n_records + 1) *
+                                   sizeof (event_t));
+
+      for (j = 0; j < n_records; j++) {
+         read_bytes (&reader, &events[n_events].record, record_size);
+         events[n_events].thread = thread;
+         events[n_events].seq = j;
+         n_events++;
+      }
+
+      if (thread > max_thread) {
+         max_thread = thread;
+      }
+   }
+
+   qsort (events, n_events, sizeof (event_t), event_cmp);
+
+   depths = (int *)calloc (max_thread + 1, sizeof (int));
+
+   for (e = 0; e < n_events; e++) {
+      id = events[e].record.site;
+      if (id == 0 || id > n_sites) {
+         continue;
+      }
+
+      site = &sites[id];
+      thread = events[e].thread;
+
+      if (site->event == EVENT_EXIT && depths[thread] > 0) {
+         depths[thread]--;
+      }
+
+      print_event (&events[e], site, dumped_wall - dumped_monotonic,
+                   depths[thread], stdout);
+
+      if (site->event == EVENT_ENTRY) {
+         depths[thread]++;
+      }
+   }
+
+   free (depths);
+   free (events);
+   free (sites);
+   free (data);
+
+   return EXIT_SUCCESS;
+
+fail:
+   free (events);
+   free (sites);
+   free (data);
+
+   return EXIT_FAILURE;
+}
@@ -37,7 +37,10 @@ static void request_from_killcursors (request_t *request, const mongoc_rpc_t *rp
 
 static void request_from_getmore (request_t *request, const mongoc_rpc_t *rpc);
 
+static void request_from_op_msg (request_t *request);
+
 static char *query_flags_str (uint32_t flags);
+static uint32_t length_prefix (void *data);
 static char *insert_flags_str (uint32_t flags);
 static char *update_flags_str (uint32_t flags);
 static char *delete_flags_str (uint32_t flags);
@@ -59,6 +62,18 @@ request_new (const mongoc_buffer_t *buffer,
    request->data_len = (size_t) msg_len;
    request->replies = replies;
 
+   if (msg_len >= 21 && length_prefix (data + 12) == MONGOC_OPCODE_OP_MSG) {
+      /* mongoc_rpc_t predates OP_MSG, parse it here */
+      request->opcode = (mongoc_opcode_t) MONGOC_OPCODE_OP_MSG;
+      request->server = server;
+      request->client = client;
+      request->client_port = client_port;
+      _mongoc_array_init (&request->docs, sizeof (bson_t *));
+      request_from_op_msg (request);
+
+      return request;
+   }
+
    if (!_mongoc_rpc_scatter (&request->request_rpc, data,
                              (size_t) msg_len)) {
       MONGOC_WARNING ("%s():%d: %s", BSON_FUNC, __LINE__,
@@ -702,6 +717,71 @@ length_prefix (void *data)
 }
 
 
+/* the header, flagBits, then sections: kind 0 is the command, kind 1 a
+ * sequence of documents */
+static void
+request_from_op_msg (request_t *request)
+{
+   uint8_t *pos = request->data + 16;
+   uint8_t *end = request->data + request->data_len;
+   bson_string_t *msg_as_str = bson_string_new ("OP_MSG");
+   bson_iter_t iter;
+   uint32_t flags;
+   uint8_t *seq_end;
+   uint32_t len;
+   bson_t *doc;
+   char *str;
+
+   request->request_rpc.header.msg_len = (int32_t) request->data_len;
+   request->request_rpc.header.request_id =
+      (int32_t) length_prefix (request->data + 4);
+   request->request_rpc.header.response_to =
+      (int32_t) length_prefix (request->data + 8);
+   request->request_rpc.header.opcode = MONGOC_OPCODE_OP_MSG;
+
+   flags = length_prefix (pos);
+   pos += 4;
+
+   while (pos < end) {
+      if (*pos++ == 0) {
+         len = length_prefix (pos);
+         doc = bson_new_from_data (pos, len);
+         assert (doc);
+         _mongoc_array_append_val (&request->docs, doc);
+         pos += len;
+      } else {
+         seq_end = pos + length_prefix (pos);
+         pos += 4;
+         pos += strlen ((const char *) pos) + 1;
+         while (pos < seq_end) {
+            len = length_prefix (pos);
+            doc = bson_new_from_data (pos, len);
+            assert (doc);
+            _mongoc_array_append_val (&request->docs, doc);
+            pos += len;
+         }
+      }
+   }
+
+   assert (request->docs.len);
+   request->is_command = true;
+   if (bson_iter_init (&iter, request_get_doc (request, 0)) &&
+       bson_iter_next (&iter)) {
+      request->command_name = bson_strdup (bson_iter_key (&iter));
+   }
+
+   str = bson_as_json (request_get_doc (request, 0), NULL);
+   bson_string_append_printf (msg_as_str, " %s", str);
+   bson_free (str);
+
+   if (flags & MONGOC_OP_MSG_MORE_TO_COME) {
+      bson_string_append (msg_as_str, " flags=MORE_TO_COME");
+   }
+
+   request->as_str = bson_string_free (msg_as_str, false);
+}
+
+
 static void
 request_from_insert (request_t *request,
                      const mongoc_rpc_t *rpc)
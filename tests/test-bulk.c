@@ -2,6 +2,7 @@
 #include <mongoc-bulk-operation-private.h>
 #include <mongoc-client-private.h>
 #include <mongoc-cursor-private.h>
+#include <mongoc-thread-private.h>
 
 #include "TestSuite.h"
 
@@ -388,6 +389,157 @@ test_bulk_error_unordered (void)
    mongoc_client_destroy (client);
 }
 
+static void
+_test_insert_borrowed (bool ordered)
+{
+   mock_server_t *mock_server;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_bulk_operation_t *bulk;
+   bson_t *with_id;
+   bson_t *without_id;
+   bson_t reply;
+   bson_error_t error;
+   request_t *request;
+   future_t *future;
+   const bson_t *cmd;
+   bson_iter_t iter;
+   bson_iter_t docs;
+   bson_iter_t doc;
+
+   mock_server = mock_server_with_autoismaster (WIRE_VERSION_WRITE_CMD);
+   mock_server_run (mock_server);
+
+   client = mongoc_client_new_from_uri (mock_server_get_uri (mock_server));
+   collection = mongoc_client_get_collection (client, "test", "test");
+
+   with_id = BCON_NEW ("_id", BCON_INT32 (1), "a", BCON_INT32 (1));
+   without_id = BCON_NEW ("b", BCON_UTF8 ("x"));
+
+   bulk = mongoc_collection_create_bulk_operation (collection, ordered, NULL);
+   mongoc_bulk_operation_insert_borrowed (bulk, with_id);
+   mongoc_bulk_operation_insert_borrowed (bulk, without_id);
+
+   future = future_bulk_operation_execute (bulk, &reply, &error);
+
+   request = mock_server_receives_command (
+      mock_server,
+      "test",
+      MONGOC_QUERY_NONE,
+      "{'insert': 'test',"
+      " 'ordered': %s,"
+      " 'documents': [{'_id': 1, 'a': 1},"
+      "               {'_id': {'$exists': true}, 'b': 'x'}]}",
+      ordered ? "true" : "false");
+
+   /* the generated _id is the first field */
+   cmd = request_get_doc (request, 0);
+   BSON_ASSERT (bson_iter_init_find (&iter, cmd, "documents"));
+   BSON_ASSERT (bson_iter_recurse (&iter, &docs));
+   BSON_ASSERT (bson_iter_next (&docs) && bson_iter_next (&docs));
+   BSON_ASSERT (bson_iter_recurse (&docs, &doc));
+   BSON_ASSERT (bson_iter_next (&doc));
+   ASSERT_CMPSTR (bson_iter_key (&doc), "_id");
+   BSON_ASSERT (BSON_ITER_HOLDS_OID (&doc));
+   BSON_ASSERT (!bson_iter_next (&docs));
+
+   mock_server_replies_simple (request, "{'ok': 1, 'n': 2}");
+   ASSERT_OR_PRINT (future_get_uint32_t (future), error);
+   ASSERT_MATCH (&reply, "{'nInserted': 2}");
+
+   /* the caller's documents are untouched */
+   ASSERT_MATCH (without_id, "{'_id': {'$exists': false}, 'b': 'x'}");
+
+   request_destroy (request);
+   future_destroy (future);
+   bson_destroy (&reply);
+   mongoc_bulk_operation_destroy (bulk);
+   bson_destroy (with_id);
+   bson_destroy (without_id);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mock_server_destroy (mock_server);
+}
+
+
+static void
+test_insert_borrowed_ordered (void)
+{
+   _test_insert_borrowed (true);
+}
+
+
+static void
+test_insert_borrowed_unordered (void)
+{
+   _test_insert_borrowed (false);
+}
+
+
+static void
+test_unordered_pipelined (void)
+{
+   mock_server_t *mock_server;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_bulk_operation_t *bulk;
+   bson_t reply;
+   bson_error_t error;
+   request_t *requests[3];
+   future_t *future;
+   int i;
+
+   mock_server = mock_server_with_autoismaster (WIRE_VERSION_WRITE_CMD);
+   mock_server_run (mock_server);
+
+   client = mongoc_client_new_from_uri (mock_server_get_uri (mock_server));
+   collection = mongoc_client_get_collection (client, "test", "test");
+
+   bulk = mongoc_collection_create_bulk_operation (collection, false, NULL);
+   mongoc_bulk_operation_insert (bulk, tmp_bson ("{'_id': 1}"));
+   mongoc_bulk_operation_remove_one (bulk, tmp_bson ("{'_id': 2}"));
+   mongoc_bulk_operation_insert (bulk, tmp_bson ("{'_id': 3}"));
+
+   future = future_bulk_operation_execute (bulk, &reply, &error);
+
+   /* all three commands are sent before the first reply */
+   requests[0] = mock_server_receives_command (
+      mock_server, "test", MONGOC_QUERY_NONE,
+      "{'insert': 'test', 'ordered': false, 'documents': [{'_id': 1}]}");
+   requests[1] = mock_server_receives_command (
+      mock_server, "test", MONGOC_QUERY_NONE,
+      "{'delete': 'test', 'ordered': false,"
+      " 'deletes': [{'q': {'_id': 2}, 'limit': 1}]}");
+   requests[2] = mock_server_receives_command (
+      mock_server, "test", MONGOC_QUERY_NONE,
+      "{'insert': 'test', 'ordered': false, 'documents': [{'_id': 3}]}");
+
+   mock_server_replies_simple (requests[0], "{'ok': 1, 'n': 1}");
+   mock_server_replies_simple (
+      requests[1],
+      "{'ok': 1, 'n': 0,"
+      " 'writeErrors': [{'index': 0, 'code': 42, 'errmsg': 'foo'}]}");
+   mock_server_replies_simple (requests[2], "{'ok': 1, 'n': 1}");
+
+   /* the write error's index is offset into the bulk operation */
+   ASSERT (!future_get_uint32_t (future));
+   ASSERT_MATCH (&reply, "{'nInserted': 2,"
+                         " 'nRemoved': 0,"
+                         " 'writeErrors': [{'index': 1, 'code': 42}]}");
+
+   for (i = 0; i < 3; i++) {
+      request_destroy (requests[i]);
+   }
+
+   future_destroy (future);
+   bson_destroy (&reply);
+   mongoc_bulk_operation_destroy (bulk);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mock_server_destroy (mock_server);
+}
+
+
 static void
 test_insert (bool ordered)
 {
@@ -3327,6 +3479,442 @@ test_bulk_update_one_error_message (void)
 }
 
 
+/* reply to each insert command with a duplicate key error for {_id: 'dup'} */
+static bool
+bulk_writer_responder (request_t *request,
+                       void      *data)
+{
+   mongoc_array_t *batch_sizes = (mongoc_array_t *) data;
+   const bson_t *cmd;
+   bson_iter_t iter;
+   bson_iter_t docs;
+   bson_string_t *reply;
+   int32_t n = 0;
+   int32_t dup = -1;
+
+   if (strcmp (request->command_name, "insert")) {
+      return false;
+   }
+
+   cmd = request_get_doc (request, 0);
+   BSON_ASSERT (bson_iter_init_find (&iter, cmd, "documents"));
+   BSON_ASSERT (bson_iter_recurse (&iter, &docs));
+
+   while (bson_iter_next (&docs)) {
+      BSON_ASSERT (bson_iter_recurse (&docs, &iter));
+      if (bson_iter_find (&iter, "_id") && BSON_ITER_HOLDS_UTF8 (&iter) &&
+          !strcmp (bson_iter_utf8 (&iter, NULL), "dup")) {
+         dup = n;
+      }
+
+      n++;
+   }
+
+   _mongoc_array_append_val (batch_sizes, n);
+
+   reply = bson_string_new (NULL);
+   if (dup >= 0) {
+      bson_string_append_printf (
+         reply, "{'ok': 1, 'n': %d, 'writeErrors': [{'index': %d,"
+         " 'code': 11000, 'errmsg': 'duplicate key'}]}", n - 1, dup);
+   } else {
+      bson_string_append_printf (reply, "{'ok': 1, 'n': %d}", n);
+   }
+
+   mock_server_replies_simple (request, reply->str);
+   bson_string_free (reply, true);
+   request_destroy (request);
+
+   return true;
+}
+
+
+typedef struct
+{
+   int     n_results;
+   int64_t failed_op;
+   uint32_t failed_code;
+} bulk_writer_results_t;
+
+
+static void
+bulk_writer_cb (int64_t             op_id,
+                const bson_error_t *error,
+                const bson_t       *details,
+                void               *ctx)
+{
+   bulk_writer_results_t *results = (bulk_writer_results_t *) ctx;
+
+   /* results arrive in order */
+   ASSERT_CMPINT ((int) op_id, ==, results->n_results);
+   results->n_results++;
+
+   if (error) {
+      results->failed_op = op_id;
+      results->failed_code = error->code;
+      BSON_ASSERT (details);
+      ASSERT_MATCH (details, "{'index': 1, 'code': 11000}");
+   }
+}
+
+
+static void
+test_bulk_writer (void)
+{
+   mock_server_t *mock_server;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_bulk_writer_t *writer;
+   mongoc_array_t batch_sizes;
+   bulk_writer_results_t results = { 0, -1, 0 };
+   bson_error_t error;
+
+   _mongoc_array_init (&batch_sizes, sizeof (int32_t));
+
+   mock_server = mock_server_with_autoismaster (WIRE_VERSION_MAX);
+   mock_server_autoresponds (mock_server, bulk_writer_responder,
+                             &batch_sizes, NULL);
+   mock_server_run (mock_server);
+
+   client = mongoc_client_new_from_uri (mock_server_get_uri (mock_server));
+   collection = mongoc_client_get_collection (client, "test", "test");
+
+   writer = mongoc_bulk_writer_new (collection,
+                                    tmp_bson ("{'maxBatchAgeMS': 'a'}"),
+                                    &error);
+   BSON_ASSERT (!writer);
+   ASSERT_ERROR_CONTAINS (error, MONGOC_ERROR_COMMAND,
+                          MONGOC_ERROR_COMMAND_INVALID_ARG,
+                          "Invalid bulk writer option \"maxBatchAgeMS\"");
+
+   writer = mongoc_bulk_writer_new (
+      collection,
+      tmp_bson ("{'maxBatchDocs': 2, 'maxBatchAgeMS': 60000,"
+                " 'maxInFlight': 2}"),
+      &error);
+   ASSERT_OR_PRINT (writer, error);
+   mongoc_bulk_writer_set_callback (writer, bulk_writer_cb, &results);
+
+   ASSERT_CMPINT ((int) mongoc_bulk_writer_insert (
+      writer, tmp_bson ("{'_id': 0}"), &error), ==, 0);
+   ASSERT_CMPINT ((int) mongoc_bulk_writer_insert (
+      writer, tmp_bson ("{'_id': 1}"), &error), ==, 1);
+   ASSERT_CMPINT ((int) mongoc_bulk_writer_insert (
+      writer, tmp_bson ("{'_id': 2}"), &error), ==, 2);
+   ASSERT_CMPINT ((int) mongoc_bulk_writer_insert (
+      writer, tmp_bson ("{'_id': 'dup'}"), &error), ==, 3);
+   ASSERT_CMPINT ((int) mongoc_bulk_writer_insert (
+      writer, tmp_bson ("{'_id': 4}"), &error), ==, 4);
+   ASSERT_CMPINT (results.n_results, ==, 0);
+   /* two batches are in flight, the third waits for the first reply */
+   ASSERT_CMPINT ((int) mongoc_bulk_writer_insert (
+      writer, tmp_bson ("{'_id': 5}"), &error), ==, 5);
+   ASSERT_CMPINT (results.n_results, ==, 2);
+
+   BSON_ASSERT (!mongoc_bulk_writer_flush (writer, &error));
+   ASSERT_ERROR_CONTAINS (error, MONGOC_ERROR_COMMAND, 11000,
+                          "duplicate key");
+
+   ASSERT_CMPINT (results.n_results, ==, 6);
+   ASSERT_CMPINT ((int) results.failed_op, ==, 3);
+   ASSERT_CMPINT ((int) results.failed_code, ==, 11000);
+
+   ASSERT_CMPINT ((int) batch_sizes.len, ==, 3);
+   ASSERT_CMPINT (_mongoc_array_index (&batch_sizes, int32_t, 0), ==, 2);
+   ASSERT_CMPINT (_mongoc_array_index (&batch_sizes, int32_t, 1), ==, 2);
+   ASSERT_CMPINT (_mongoc_array_index (&batch_sizes, int32_t, 2), ==, 2);
+
+   /* the error was reported */
+   ASSERT_OR_PRINT (mongoc_bulk_writer_flush (writer, &error), error);
+
+   mongoc_bulk_writer_destroy (writer);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mock_server_destroy (mock_server);
+   _mongoc_array_destroy (&batch_sizes);
+}
+
+
+/* each operation's error domain, or 0 if it succeeded */
+typedef struct
+{
+   int      n_results;
+   uint32_t domains[8];
+} bulk_writer_domains_t;
+
+
+static void
+bulk_writer_domains_cb (int64_t             op_id,
+                        const bson_error_t *error,
+                        const bson_t       *details,
+                        void               *ctx)
+{
+   bulk_writer_domains_t *results = (bulk_writer_domains_t *) ctx;
+
+   ASSERT_CMPINT ((int) op_id, ==, results->n_results);
+   BSON_ASSERT (op_id < 8);
+   results->domains[op_id] = error ? error->domain : 0;
+   results->n_results++;
+}
+
+
+/* reply to the first insert, hang up on the second */
+static bool
+bulk_writer_hangup_responder (request_t *request,
+                              void      *data)
+{
+   int *n_inserts = (int *) data;
+
+   if (strcmp (request->command_name, "insert")) {
+      return false;
+   }
+
+   if (++(*n_inserts) == 2) {
+      mock_server_hangs_up (request);
+   } else {
+      mock_server_replies_simple (request, "{'ok': 1, 'n': 1}");
+   }
+
+   request_destroy (request);
+
+   return true;
+}
+
+
+static void
+test_bulk_writer_disconnect (void)
+{
+   mock_server_t *mock_server;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_bulk_writer_t *writer;
+   bulk_writer_domains_t results = { 0 };
+   bson_error_t error;
+   int n_inserts = 0;
+
+   mock_server = mock_server_with_autoismaster (WIRE_VERSION_MAX);
+   mock_server_autoresponds (mock_server, bulk_writer_hangup_responder,
+                             &n_inserts, NULL);
+   mock_server_run (mock_server);
+
+   client = mongoc_client_new_from_uri (mock_server_get_uri (mock_server));
+   collection = mongoc_client_get_collection (client, "test", "test");
+
+   writer = mongoc_bulk_writer_new (
+      collection,
+      tmp_bson ("{'maxBatchDocs': 1, 'maxBatchAgeMS': 60000,"
+                " 'maxInFlight': 3}"),
+      &error);
+   ASSERT_OR_PRINT (writer, error);
+   mongoc_bulk_writer_set_callback (writer, bulk_writer_domains_cb, &results);
+
+   /* three batches in flight */
+   ASSERT_CMPINT ((int) mongoc_bulk_writer_insert (
+      writer, tmp_bson ("{'_id': 0}"), &error), ==, 0);
+   ASSERT_CMPINT ((int) mongoc_bulk_writer_insert (
+      writer, tmp_bson ("{'_id': 1}"), &error), ==, 1);
+   ASSERT_CMPINT ((int) mongoc_bulk_writer_insert (
+      writer, tmp_bson ("{'_id': 2}"), &error), ==, 2);
+
+   /* the first succeeds, the second's reply is lost, so is the third's */
+   BSON_ASSERT (!mongoc_bulk_writer_flush (writer, &error));
+   ASSERT_CMPINT (error.domain, ==, MONGOC_ERROR_STREAM);
+   ASSERT_CMPINT (results.n_results, ==, 3);
+   ASSERT_CMPINT (results.domains[0], ==, 0);
+   ASSERT_CMPINT (results.domains[1], ==, MONGOC_ERROR_STREAM);
+   ASSERT_CMPINT (results.domains[2], ==, MONGOC_ERROR_STREAM);
+
+   /* the writer reconnects */
+   ASSERT_CMPINT ((int) mongoc_bulk_writer_insert (
+      writer, tmp_bson ("{'_id': 3}"), &error), ==, 3);
+   ASSERT_OR_PRINT (mongoc_bulk_writer_flush (writer, &error), error);
+   ASSERT_CMPINT (results.n_results, ==, 4);
+   ASSERT_CMPINT (results.domains[3], ==, 0);
+
+   mongoc_bulk_writer_destroy (writer);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mock_server_destroy (mock_server);
+}
+
+
+/* another operation on the client closes the writer's connection */
+static void
+test_bulk_writer_closed_by_other_op (void)
+{
+   mock_server_t *mock_server;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_bulk_writer_t *writer;
+   bulk_writer_domains_t results = { 0 };
+   bson_error_t error;
+   future_t *future;
+   request_t *request;
+   int i;
+
+   mock_server = mock_server_with_autoismaster (WIRE_VERSION_MAX);
+   mock_server_run (mock_server);
+
+   client = mongoc_client_new_from_uri (mock_server_get_uri (mock_server));
+   collection = mongoc_client_get_collection (client, "test", "test");
+
+   writer = mongoc_bulk_writer_new (
+      collection,
+      tmp_bson ("{'maxBatchDocs': 1, 'maxBatchAgeMS': 60000,"
+                " 'maxInFlight': 4}"),
+      &error);
+   ASSERT_OR_PRINT (writer, error);
+   mongoc_bulk_writer_set_callback (writer, bulk_writer_domains_cb, &results);
+
+   ASSERT_CMPINT ((int) mongoc_bulk_writer_insert (
+      writer, tmp_bson ("{'_id': 0}"), &error), ==, 0);
+   ASSERT_CMPINT ((int) mongoc_bulk_writer_insert (
+      writer, tmp_bson ("{'_id': 1}"), &error), ==, 1);
+
+   for (i = 0; i < 2; i++) {
+      request = mock_server_receives_command (mock_server, "test",
+                                              MONGOC_QUERY_NONE,
+                                              "{'insert': 'test'}");
+      request_destroy (request);
+   }
+
+   /* the ping's network error disconnects the node, freeing its stream */
+   future = future_client_command_simple (client, "test",
+                                          tmp_bson ("{'ping': 1}"),
+                                          NULL, NULL, NULL);
+   request = mock_server_receives_command (mock_server, "test",
+                                           MONGOC_QUERY_SLAVE_OK,
+                                           "{'ping': 1}");
+   mock_server_hangs_up (request);
+   BSON_ASSERT (!future_get_bool (future));
+   future_destroy (future);
+   request_destroy (request);
+
+   /* the writer doesn't read from the freed stream */
+   BSON_ASSERT (!mongoc_bulk_writer_flush (writer, &error));
+   ASSERT_ERROR_CONTAINS (error, MONGOC_ERROR_STREAM,
+                          MONGOC_ERROR_STREAM_NOT_ESTABLISHED,
+                          "Connection closed with 2 batches in flight");
+   ASSERT_CMPINT (results.n_results, ==, 2);
+   ASSERT_CMPINT (results.domains[0], ==, MONGOC_ERROR_STREAM);
+   ASSERT_CMPINT (results.domains[1], ==, MONGOC_ERROR_STREAM);
+
+   mongoc_bulk_writer_destroy (writer);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mock_server_destroy (mock_server);
+}
+
+
+typedef struct
+{
+   mongoc_collection_t   *collection;
+   bulk_writer_domains_t  results;
+   bool                   flushed;
+} bulk_writer_producer_t;
+
+
+static void *
+bulk_writer_producer (void *data)
+{
+   bulk_writer_producer_t *producer = (bulk_writer_producer_t *) data;
+   mongoc_bulk_writer_t *writer;
+   bson_error_t error;
+   bson_t opts = BSON_INITIALIZER;
+   bson_t doc;
+   int i;
+
+   /* not tmp_bson, it isn't thread safe */
+   BSON_APPEND_INT32 (&opts, "maxBatchDocs", 1);
+   BSON_APPEND_INT32 (&opts, "maxBatchAgeMS", 60000);
+   BSON_APPEND_INT32 (&opts, "maxInFlight", 2);
+   writer = mongoc_bulk_writer_new (producer->collection, &opts, &error);
+   ASSERT_OR_PRINT (writer, error);
+   bson_destroy (&opts);
+   mongoc_bulk_writer_set_callback (writer, bulk_writer_domains_cb,
+                                    &producer->results);
+
+   for (i = 0; i < 5; i++) {
+      bson_init (&doc);
+      BSON_APPEND_INT32 (&doc, "_id", i);
+      ASSERT_CMPINT ((int) mongoc_bulk_writer_insert (writer, &doc, &error),
+                     ==, i);
+      bson_destroy (&doc);
+   }
+
+   producer->flushed = mongoc_bulk_writer_flush (writer, &error);
+   mongoc_bulk_writer_destroy (writer);
+
+   return NULL;
+}
+
+
+/* assert the producer can't send another batch until we reply */
+static void
+bulk_writer_assert_blocked (mock_server_t *mock_server)
+{
+   int64_t timeout_msec;
+
+   timeout_msec = mock_server_get_request_timeout_msec (mock_server);
+   mock_server_set_request_timeout_msec (mock_server, 100);
+   BSON_ASSERT (!mock_server_receives_request (mock_server));
+   mock_server_set_request_timeout_msec (mock_server, timeout_msec);
+}
+
+
+/* a producer faster than the server waits, with at most maxInFlight
+ * batches sent and not answered */
+static void
+test_bulk_writer_backpressure (void)
+{
+   mock_server_t *mock_server;
+   mongoc_client_t *client;
+   bulk_writer_producer_t producer = { 0 };
+   mongoc_thread_t thread;
+   request_t *requests[5];
+   int i;
+
+   mock_server = mock_server_with_autoismaster (WIRE_VERSION_MAX);
+   mock_server_run (mock_server);
+
+   client = mongoc_client_new_from_uri (mock_server_get_uri (mock_server));
+   producer.collection = mongoc_client_get_collection (client, "test", "test");
+
+   BSON_ASSERT (!mongoc_thread_create (&thread, bulk_writer_producer,
+                                       &producer));
+
+   for (i = 0; i < 2; i++) {
+      requests[i] = mock_server_receives_command (
+         mock_server, "test", MONGOC_QUERY_NONE,
+         "{'insert': 'test', 'documents': [{'_id': %d}]}", i);
+   }
+
+   /* each reply lets one more batch through */
+   for (i = 0; i < 5; i++) {
+      if (i + 2 < 5) {
+         bulk_writer_assert_blocked (mock_server);
+      }
+
+      mock_server_replies_simple (requests[i], "{'ok': 1, 'n': 1}");
+      request_destroy (requests[i]);
+
+      if (i + 2 < 5) {
+         requests[i + 2] = mock_server_receives_command (
+            mock_server, "test", MONGOC_QUERY_NONE,
+            "{'insert': 'test', 'documents': [{'_id': %d}]}", i + 2);
+      }
+   }
+
+   BSON_ASSERT (!mongoc_thread_join (thread));
+   BSON_ASSERT (producer.flushed);
+   ASSERT_CMPINT (producer.results.n_results, ==, 5);
+
+   mongoc_collection_destroy (producer.collection);
+   mongoc_client_destroy (client);
+   mock_server_destroy (mock_server);
+}
+
+
 void
 test_bulk_install (TestSuite *suite)
 {
@@ -3369,6 +3957,12 @@ test_bulk_install (TestSuite *suite)
    TestSuite_Add (suite, "/BulkOperation/error", test_bulk_error);
    TestSuite_Add (suite, "/BulkOperation/error/unordered",
                   test_bulk_error_unordered);
+   TestSuite_Add (suite, "/BulkOperation/unordered_pipelined",
+                  test_unordered_pipelined);
+   TestSuite_Add (suite, "/BulkOperation/insert_borrowed/ordered",
+                  test_insert_borrowed_ordered);
+   TestSuite_Add (suite, "/BulkOperation/insert_borrowed/unordered",
+                  test_insert_borrowed_unordered);
    TestSuite_AddLive  (suite, "/BulkOperation/insert_ordered",
                        test_insert_ordered);
    TestSuite_AddLive  (suite, "/BulkOperation/insert_unordered",
@@ -3492,4 +4086,11 @@ test_bulk_install (TestSuite *suite)
    TestSuite_Add (suite, "/BulkOperation/opts/collation/multi/w1/wire4", test_bulk_collation_multi_w1_wire5);
    TestSuite_Add (suite, "/BulkOperation/opts/collation/multi/w1/wire4", test_bulk_collation_multi_w1_wire4);
    TestSuite_Add (suite, "/BulkOperation/update_one/error_message", test_bulk_update_one_error_message);
+   TestSuite_Add (suite, "/BulkWriter/insert", test_bulk_writer);
+   TestSuite_Add (suite, "/BulkWriter/disconnect",
+                  test_bulk_writer_disconnect);
+   TestSuite_Add (suite, "/BulkWriter/closed_by_other_op",
+                  test_bulk_writer_closed_by_other_op);
+   TestSuite_Add (suite, "/BulkWriter/backpressure",
+                  test_bulk_writer_backpressure);
 }
@@ -50,6 +50,8 @@ extern void test_collection_install                (TestSuite *suite);
 extern void test_collection_find_install           (TestSuite *suite);
 extern void test_collection_find_with_opts_install (TestSuite *suite);
 extern void test_command_monitoring_install        (TestSuite *suite);
+extern void test_connection_stats_install          (TestSuite *suite);
+extern void test_counters_install                  (TestSuite *suite);
 extern void test_cursor_install                    (TestSuite *suite);
 extern void test_database_install                  (TestSuite *suite);
 extern void test_error_install                     (TestSuite *suite);
@@ -61,6 +63,7 @@ extern void test_linux_distro_scanner_install      (TestSuite *suite);
 extern void test_list_install                      (TestSuite *suite);
 extern void test_log_install                       (TestSuite *suite);
 extern void test_matcher_install                   (TestSuite *suite);
+extern void test_memory_install                    (TestSuite *suite);
 extern void test_handshake_install                 (TestSuite *suite);
 extern void test_queue_install                     (TestSuite *suite);
 extern void test_read_prefs_install                (TestSuite *suite);
@@ -72,13 +75,18 @@ extern void test_server_selection_install          (TestSuite *suite);
 extern void test_server_selection_errors_install (TestSuite *suite);
 #endif
 extern void test_set_install                       (TestSuite *suite);
+extern void test_shard_map_install                 (TestSuite *suite);
+extern void test_slow_op_install                   (TestSuite *suite);
 extern void test_socket_install                    (TestSuite *suite);
+extern void test_span_install                      (TestSuite *suite);
 extern void test_stream_install                    (TestSuite *suite);
+extern void test_stream_fault_install              (TestSuite *suite);
 extern void test_thread_install                    (TestSuite *suite);
 extern void test_topology_install                  (TestSuite *suite);
 extern void test_topology_description_install      (TestSuite *suite);
 extern void test_topology_reconcile_install        (TestSuite *suite);
 extern void test_topology_scanner_install          (TestSuite *suite);
+extern void test_trace_buffer_install               (TestSuite *suite);
 extern void test_uri_install                       (TestSuite *suite);
 extern void test_usleep_install                    (TestSuite *suite);
 extern void test_util_install                      (TestSuite *suite);
@@ -86,6 +94,7 @@ extern void test_version_install                   (TestSuite *suite);
 extern void test_write_command_install             (TestSuite *suite);
 extern void test_write_concern_install             (TestSuite *suite);
 #ifdef MONGOC_ENABLE_SSL
+extern void test_scram_install                     (TestSuite *suite);
 extern void test_stream_tls_install                (TestSuite *suite);
 extern void test_x509_install                      (TestSuite *suite);
 extern void test_stream_tls_error_install          (TestSuite *suite);
@@ -1835,6 +1844,8 @@ main (int   argc,
    test_collection_find_install (&suite);
    test_collection_find_with_opts_install (&suite);
    test_command_monitoring_install (&suite);
+   test_connection_stats_install (&suite);
+   test_counters_install (&suite);
    test_cursor_install (&suite);
    test_database_install (&suite);
    test_error_install (&suite);
@@ -1847,10 +1858,13 @@ main (int   argc,
    test_list_install (&suite);
    test_log_install (&suite);
    test_matcher_install (&suite);
+   test_memory_install (&suite);
    test_queue_install (&suite);
    test_read_prefs_install (&suite);
    test_rpc_install (&suite);
+   test_slow_op_install (&suite);
    test_socket_install (&suite);
+   test_span_install (&suite);
    test_topology_scanner_install (&suite);
    test_topology_reconcile_install (&suite);
    test_sdam_install (&suite);
@@ -1860,16 +1874,20 @@ main (int   argc,
    test_server_selection_errors_install (&suite);
 #endif
    test_set_install (&suite);
+   test_shard_map_install (&suite);
    test_stream_install (&suite);
+   test_stream_fault_install (&suite);
    test_thread_install (&suite);
    test_topology_install (&suite);
    test_topology_description_install (&suite);
+   test_trace_buffer_install (&suite);
    test_uri_install (&suite);
    test_usleep_install (&suite);
    test_util_install (&suite);
    test_version_install (&suite);
    test_write_concern_install (&suite);
 #ifdef MONGOC_ENABLE_SSL
+   test_scram_install (&suite);
    test_stream_tls_install (&suite);
    test_x509_install (&suite);
    test_stream_tls_error_install (&suite);
@@ -19,7 +19,8 @@ struct result {
 
 
 static void
-test_ismaster_helper (mongoc_async_cmd_result_t result,
+test_ismaster_helper (mongoc_async_cmd_t       *acmd,
+                      mongoc_async_cmd_result_t result,
                       const bson_t             *bson,
                       int64_t                   rtt_msec,
                       void                     *data,
@@ -168,10 +169,108 @@ test_ismaster_ssl (void)
 #endif
 
 
+typedef struct
+{
+   uint16_t port;
+   int64_t  initiated_at;
+   bool     finished;
+   mongoc_async_cmd_result_t result;
+} initiator_test_t;
+
+
+static mongoc_stream_t *
+test_initiator (mongoc_async_cmd_t *acmd)
+{
+   initiator_test_t *test = (initiator_test_t *) acmd->initiate_ctx;
+   mongoc_socket_t *conn_sock;
+   struct sockaddr_in server_addr = { 0 };
+
+   test->initiated_at = bson_get_monotonic_time ();
+
+   if (!test->port) {
+      bson_set_error (&acmd->error, MONGOC_ERROR_STREAM,
+                      MONGOC_ERROR_STREAM_CONNECT, "no port");
+      return NULL;
+   }
+
+   conn_sock = mongoc_socket_new (AF_INET, SOCK_STREAM, 0);
+   assert (conn_sock);
+
+   server_addr.sin_family = AF_INET;
+   server_addr.sin_port = htons (test->port);
+   server_addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+   mongoc_socket_connect (conn_sock, (struct sockaddr *) &server_addr,
+                          sizeof (server_addr), 0);
+
+   return mongoc_stream_socket_new (conn_sock);
+}
+
+
+static void
+test_initiator_helper (mongoc_async_cmd_t       *acmd,
+                       mongoc_async_cmd_result_t result,
+                       const bson_t             *bson,
+                       int64_t                   rtt_msec,
+                       void                     *data,
+                       bson_error_t             *error)
+{
+   initiator_test_t *test = (initiator_test_t *) data;
+
+   test->result = result;
+   test->finished = true;
+}
+
+
+/* commands with initiators connect after their delay, and an initiator's
+ * failure only fails its own command */
+static void
+test_ismaster_delayed_initiator (void)
+{
+   mock_server_t *server;
+   mongoc_async_t *async;
+   initiator_test_t failing = { 0 };
+   initiator_test_t delayed = { 0 };
+   bson_t q = BSON_INITIALIZER;
+   int64_t start;
+
+   server = mock_server_with_autoismaster (0);
+   delayed.port = mock_server_run (server);
+
+   BSON_APPEND_INT32 (&q, "isMaster", 1);
+   async = mongoc_async_new ();
+   start = bson_get_monotonic_time ();
+
+   mongoc_async_cmd_with_initiator (async, test_initiator, &failing, 0,
+                                    NULL, NULL, "admin", &q,
+                                    &test_initiator_helper, &failing,
+                                    TIMEOUT);
+
+   mongoc_async_cmd_with_initiator (async, test_initiator, &delayed, 200,
+                                    NULL, NULL, "admin", &q,
+                                    &test_initiator_helper, &delayed,
+                                    TIMEOUT);
+
+   mongoc_async_run (async, TIMEOUT);
+
+   assert (failing.finished);
+   ASSERT_CMPINT (failing.result, ==, MONGOC_ASYNC_CMD_ERROR);
+
+   assert (delayed.finished);
+   ASSERT_CMPINT (delayed.result, ==, MONGOC_ASYNC_CMD_SUCCESS);
+   ASSERT_CMPINT64 (delayed.initiated_at - start, >=, (int64_t) 200 * 1000);
+
+   mongoc_async_destroy (async);
+   bson_destroy (&q);
+   mock_server_destroy (server);
+}
+
+
 void
 test_async_install (TestSuite *suite)
 {
    TestSuite_Add (suite, "/Async/ismaster", test_ismaster);
+   TestSuite_Add (suite, "/Async/ismaster_delayed_initiator",
+                  test_ismaster_delayed_initiator);
 #ifdef MONGOC_ENABLE_SSL_OPENSSL
    TestSuite_Add (suite, "/Async/ismaster_ssl", test_ismaster_ssl);
 #endif
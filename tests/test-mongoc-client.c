@@ -2576,7 +2576,8 @@ _test_null_error_pointer (bool pooled)
    /* disconnect */
    mock_server_destroy (server);
    if (pooled) {
-      mongoc_cluster_disconnect_node (&client->cluster, 1);
+      mongoc_cluster_disconnect_node (&client->cluster, 1,
+                                      MONGOC_CONNECTION_CLOSED_NETWORK_ERROR);
    } else {
       mongoc_topology_scanner_node_t *scanner_node;
 
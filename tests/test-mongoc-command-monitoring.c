@@ -315,7 +315,8 @@ started_cb (const mongoc_apm_command_started_t *event)
    bson_t *new_event;
 
    if (context->verbose) {
-      cmd_json = bson_as_json (event->command, NULL);
+      cmd_json = bson_as_json (
+         mongoc_apm_command_started_get_command (event), NULL);
       printf ("%s\n", cmd_json);
       fflush (stdout);
       bson_free (cmd_json);
@@ -334,7 +335,9 @@ started_cb (const mongoc_apm_command_started_t *event)
       ASSERT_CMPINT64 (context->operation_id, ==, operation_id);
    }
 
-   convert_command_for_test (context, event->command, &cmd, NULL);
+   convert_command_for_test (context,
+                             mongoc_apm_command_started_get_command (event),
+                             &cmd, NULL);
    new_event = BCON_NEW ("command_started_event", "{",
                          "command", BCON_DOCUMENT (&cmd),
                          "command_name", BCON_UTF8 (event->command_name),
@@ -858,6 +861,116 @@ test_get_error (void)
 }
 
 
+typedef struct
+{
+   int  n_started;
+   int  n_succeeded;
+   bool empty_command;
+   bool empty_reply;
+} skip_test_t;
+
+
+static void
+test_skip_started_cb (const mongoc_apm_command_started_t *event)
+{
+   skip_test_t *test;
+   const bson_t *command;
+
+   test = (skip_test_t *) mongoc_apm_command_started_get_context (event);
+   test->n_started++;
+   ASSERT_CMPSTR (mongoc_apm_command_started_get_command_name (event), "foo");
+
+   /* built once, the same document on every call */
+   command = mongoc_apm_command_started_get_command (event);
+   ASSERT (command == mongoc_apm_command_started_get_command (event));
+
+   if (test->empty_command) {
+      ASSERT (bson_empty (command));
+   } else {
+      ASSERT_MATCH (command, "{'foo': 1}");
+   }
+}
+
+
+static void
+test_skip_succeeded_cb (const mongoc_apm_command_succeeded_t *event)
+{
+   skip_test_t *test;
+   const bson_t *reply;
+
+   test = (skip_test_t *) mongoc_apm_command_succeeded_get_context (event);
+   test->n_succeeded++;
+   reply = mongoc_apm_command_succeeded_get_reply (event);
+
+   if (test->empty_reply) {
+      ASSERT (bson_empty (reply));
+   } else {
+      ASSERT_MATCH (reply, "{'ok': 1, 'bar': 2}");
+   }
+}
+
+
+static void
+_test_skip (int flags)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_apm_callbacks_t *callbacks;
+   skip_test_t test = { 0 };
+   future_t *future;
+   request_t *request;
+
+   test.empty_command = (flags & MONGOC_APM_SKIP_COMMAND) != 0;
+   test.empty_reply = (flags & MONGOC_APM_SKIP_REPLY) != 0;
+
+   server = mock_server_with_autoismaster (0);
+   mock_server_run (server);
+
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   callbacks = mongoc_apm_callbacks_new ();
+   mongoc_apm_set_command_started_cb (callbacks, test_skip_started_cb);
+   mongoc_apm_set_command_succeeded_cb (callbacks, test_skip_succeeded_cb);
+   mongoc_apm_set_skip_flags (callbacks, flags);
+   mongoc_client_set_apm_callbacks (client, callbacks, (void *) &test);
+   future = future_client_command_simple (client, "db",
+                                          tmp_bson ("{'foo': 1}"),
+                                          NULL, NULL, NULL);
+   request = mock_server_receives_command (server, "db", MONGOC_QUERY_SLAVE_OK,
+                                           "{'foo': 1}");
+   mock_server_replies_simple (request, "{'ok': 1, 'bar': 2}");
+   ASSERT (future_get_bool (future));
+   ASSERT_CMPINT (test.n_started, ==, 1);
+   ASSERT_CMPINT (test.n_succeeded, ==, 1);
+
+   future_destroy (future);
+   request_destroy (request);
+   mongoc_apm_callbacks_destroy (callbacks);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+static void
+test_skip_none (void)
+{
+   _test_skip (MONGOC_APM_SKIP_NONE);
+}
+
+
+static void
+test_skip_command (void)
+{
+   _test_skip (MONGOC_APM_SKIP_COMMAND);
+}
+
+
+static void
+test_skip_reply (void)
+{
+   _test_skip (MONGOC_APM_SKIP_REPLY);
+}
+
+
 static void
 insert_200_docs (mongoc_collection_t *collection)
 {
@@ -1620,6 +1733,10 @@ test_command_monitoring_install (TestSuite *suite)
 {
    test_all_spec_tests (suite);
    TestSuite_Add (suite, "/command_monitoring/get_error", test_get_error);
+   TestSuite_Add (suite, "/command_monitoring/skip/none", test_skip_none);
+   TestSuite_Add (suite, "/command_monitoring/skip/command",
+                  test_skip_command);
+   TestSuite_Add (suite, "/command_monitoring/skip/reply", test_skip_reply);
    TestSuite_AddLive (suite, "/command_monitoring/set_callbacks/single",
                   test_set_callbacks_single);
    TestSuite_AddLive (suite, "/command_monitoring/set_callbacks/pooled",
@@ -0,0 +1,176 @@
+#include <mongoc.h>
+
+#include "TestSuite.h"
+#include "test-conveniences.h"
+#include "test-libmongoc.h"
+#include "mock_server/mock-server.h"
+#include "mock_server/future.h"
+#include "mock_server/future-functions.h"
+
+
+/* run a ping through the mock server, and have it reply or hang up */
+static bool
+ping (mock_server_t   *server,
+      mongoc_client_t *client,
+      bool             hang_up)
+{
+   future_t *future;
+   request_t *request;
+   bool ret;
+
+   future = future_client_command_simple (client, "db",
+                                          tmp_bson ("{'ping': 1}"),
+                                          NULL, NULL, NULL);
+   request = mock_server_receives_command (server, "db", MONGOC_QUERY_SLAVE_OK,
+                                           "{'ping': 1}");
+   if (hang_up) {
+      mock_server_hangs_up (request);
+   } else {
+      mock_server_replies_simple (request, "{'ok': 1}");
+   }
+
+   ret = future_get_bool (future);
+   future_destroy (future);
+   request_destroy (request);
+
+   return ret;
+}
+
+
+static int64_t
+stat_value (const bson_t *stats,
+            const char   *key)
+{
+   char path[64];
+
+   bson_snprintf (path, sizeof path, "servers.0.%s", key);
+
+   return bson_lookup_int64 (stats, path);
+}
+
+
+static void
+test_connection_stats_single (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   bson_t stats;
+   bson_t servers;
+
+   server = mock_server_with_autoismaster (0);
+   mock_server_run (server);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+
+   /* nothing connected yet */
+   mongoc_client_get_connection_stats (client, &stats);
+   bson_lookup_doc (&stats, "servers", &servers);
+   ASSERT_CMPUINT32 (bson_count_keys (&servers), ==, (uint32_t) 0);
+   bson_destroy (&stats);
+
+   ASSERT (ping (server, client, false));
+
+   mongoc_client_get_connection_stats (client, &stats);
+   ASSERT_CMPSTR (bson_lookup_utf8 (&stats, "servers.0.host"),
+                  mock_server_get_host_and_port (server));
+   ASSERT_CMPINT64 (stat_value (&stats, "open"), ==, (int64_t) 1);
+   /* a single client's connections are idle between operations */
+   ASSERT_CMPINT64 (stat_value (&stats, "inUse"), ==, (int64_t) 0);
+   ASSERT_CMPINT64 (stat_value (&stats, "idle"), ==, (int64_t) 1);
+   ASSERT_CMPINT64 (stat_value (&stats, "created"), ==, (int64_t) 1);
+   ASSERT_CMPINT64 (stat_value (&stats, "closed"), ==, (int64_t) 0);
+   ASSERT_CMPINT64 (stat_value (&stats, "connectUsec.count"), ==,
+                    (int64_t) 1);
+   ASSERT_CMPINT64 (stat_value (&stats, "connectUsec.min"), <=,
+                    stat_value (&stats, "connectUsec.p50"));
+   ASSERT_CMPINT64 (stat_value (&stats, "connectUsec.p99"), <=,
+                    stat_value (&stats, "connectUsec.max"));
+   ASSERT_CMPINT64 (stat_value (&stats, "bytesOut"), >, (int64_t) 0);
+   ASSERT_CMPINT64 (stat_value (&stats, "bytesIn"), >, (int64_t) 0);
+   ASSERT_CMPINT64 (stat_value (&stats, "meanAgeUsec"), >=, (int64_t) 0);
+   bson_destroy (&stats);
+
+   /* a network error closes the connection, the next ping reconnects */
+   ASSERT (!ping (server, client, true));
+   ASSERT (ping (server, client, false));
+
+   mongoc_client_get_connection_stats (client, &stats);
+   ASSERT_CMPINT64 (stat_value (&stats, "open"), ==, (int64_t) 1);
+   ASSERT_CMPINT64 (stat_value (&stats, "created"), ==, (int64_t) 2);
+   ASSERT_CMPINT64 (stat_value (&stats, "closed"), ==, (int64_t) 1);
+   ASSERT_CMPINT64 (stat_value (&stats, "closeReasons.networkError"), ==,
+                    (int64_t) 1);
+   bson_destroy (&stats);
+
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+static void
+test_connection_stats_pooled (void)
+{
+   mock_server_t *server;
+   mongoc_client_pool_t *pool;
+   mongoc_client_t *client;
+   bson_t stats;
+
+   server = mock_server_with_autoismaster (0);
+   mock_server_run (server);
+   pool = mongoc_client_pool_new (mock_server_get_uri (server));
+   client = mongoc_client_pool_pop (pool);
+
+   ASSERT (ping (server, client, false));
+
+   /* the pool's monitoring connection is not counted */
+   mongoc_client_pool_get_connection_stats (pool, &stats);
+   ASSERT_CMPINT64 (stat_value (&stats, "open"), ==, (int64_t) 1);
+   ASSERT_CMPINT64 (stat_value (&stats, "inUse"), ==, (int64_t) 1);
+   ASSERT_CMPINT64 (stat_value (&stats, "idle"), ==, (int64_t) 0);
+   ASSERT_CMPINT64 (stat_value (&stats, "created"), ==, (int64_t) 1);
+   bson_destroy (&stats);
+
+   /* a pooled client reports the pool's connections */
+   mongoc_client_get_connection_stats (client, &stats);
+   ASSERT_CMPINT64 (stat_value (&stats, "open"), ==, (int64_t) 1);
+   bson_destroy (&stats);
+
+   mongoc_client_pool_push (pool, client);
+
+   mongoc_client_pool_get_connection_stats (pool, &stats);
+   ASSERT_CMPINT64 (stat_value (&stats, "open"), ==, (int64_t) 1);
+   ASSERT_CMPINT64 (stat_value (&stats, "inUse"), ==, (int64_t) 0);
+   ASSERT_CMPINT64 (stat_value (&stats, "idle"), ==, (int64_t) 1);
+   bson_destroy (&stats);
+
+   /* the same client and connection are reused */
+   client = mongoc_client_pool_pop (pool);
+   ASSERT (ping (server, client, false));
+
+   mongoc_client_pool_get_connection_stats (pool, &stats);
+   ASSERT_CMPINT64 (stat_value (&stats, "inUse"), ==, (int64_t) 1);
+   ASSERT_CMPINT64 (stat_value (&stats, "created"), ==, (int64_t) 1);
+   bson_destroy (&stats);
+
+   ASSERT (!ping (server, client, true));
+
+   mongoc_client_pool_get_connection_stats (pool, &stats);
+   ASSERT_CMPINT64 (stat_value (&stats, "open"), ==, (int64_t) 0);
+   ASSERT_CMPINT64 (stat_value (&stats, "inUse"), ==, (int64_t) 0);
+   ASSERT_CMPINT64 (stat_value (&stats, "closeReasons.networkError"), ==,
+                    (int64_t) 1);
+   bson_destroy (&stats);
+
+   mongoc_client_pool_push (pool, client);
+   mongoc_client_pool_destroy (pool);
+   mock_server_destroy (server);
+}
+
+
+void
+test_connection_stats_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/ConnectionStats/single",
+                  test_connection_stats_single);
+   TestSuite_Add (suite, "/ConnectionStats/pooled",
+                  test_connection_stats_pooled);
+}
@@ -0,0 +1,344 @@
+#include <mongoc.h>
+#include <mongoc-client-private.h>
+#include <mongoc-counters-private.h>
+
+#include "TestSuite.h"
+#include "test-conveniences.h"
+#include "test-libmongoc.h"
+#include "mock_server/mock-server.h"
+#include "mock_server/future.h"
+#include "mock_server/future-functions.h"
+
+
+static int64_t
+keyed_value (mongoc_keyed_kind_t  kind,
+             const char          *key,
+             mongoc_keyed_slot_t  slot)
+{
+   mongoc_counter_slots_t *group;
+   int64_t value = 0;
+   uint32_t i;
+
+   group = _mongoc_counters_keyed (kind, key);
+
+   for (i = 0; i < _mongoc_get_cpu_count (); i++) {
+      value += group[i].slots[slot];
+   }
+
+   return value;
+}
+
+
+static void
+test_counters_keyed_lookup (void)
+{
+   char long_key[MONGOC_KEYED_KEY_SIZE + 10];
+   mongoc_counter_slots_t *group;
+
+   group = _mongoc_counters_keyed (MONGOC_KEYED_NAMESPACE, "keyed.lookup");
+   ASSERT (group);
+   ASSERT (group == _mongoc_counters_keyed (MONGOC_KEYED_NAMESPACE,
+                                            "keyed.lookup"));
+   ASSERT (group != _mongoc_counters_keyed (MONGOC_KEYED_NAMESPACE,
+                                            "keyed.lookup2"));
+
+   /* the tables are separate */
+   ASSERT (group != _mongoc_counters_keyed (MONGOC_KEYED_SERVER,
+                                            "keyed.lookup"));
+
+   /* long keys are truncated */
+   memset (long_key, 'a', sizeof long_key);
+   long_key[sizeof long_key - 1] = '\0';
+   group = _mongoc_counters_keyed (MONGOC_KEYED_NAMESPACE, long_key);
+   long_key[sizeof long_key - 2] = 'b';
+   ASSERT (group == _mongoc_counters_keyed (MONGOC_KEYED_NAMESPACE,
+                                            long_key));
+}
+
+
+static void
+test_counters_keyed_command (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   future_t *future;
+   request_t *request;
+   const char *host;
+   int64_t server_ops;
+   int64_t errors;
+
+   server = mock_server_with_autoismaster (0);
+   mock_server_run (server);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   host = mock_server_get_host_and_port (server);
+
+   server_ops = keyed_value (MONGOC_KEYED_SERVER, host, MONGOC_KEYED_OPS);
+   errors = keyed_value (MONGOC_KEYED_NAMESPACE, "keyed.coll",
+                         MONGOC_KEYED_ERRORS);
+
+   future = future_client_command_simple (client, "keyed",
+                                          tmp_bson ("{'count': 'coll'}"),
+                                          NULL, NULL, NULL);
+   request = mock_server_receives_command (server, "keyed",
+                                           MONGOC_QUERY_SLAVE_OK,
+                                           "{'count': 'coll'}");
+
+   ASSERT_CMPINT64 (keyed_value (MONGOC_KEYED_NAMESPACE, "keyed.coll",
+                                 MONGOC_KEYED_IN_FLIGHT), ==, (int64_t) 1);
+
+   mock_server_replies_simple (request, "{'ok': 1, 'n': 1}");
+   ASSERT (future_get_bool (future));
+   future_destroy (future);
+   request_destroy (request);
+
+   ASSERT_CMPINT64 (keyed_value (MONGOC_KEYED_SERVER, host, MONGOC_KEYED_OPS),
+                    ==, server_ops + 1);
+   ASSERT_CMPINT64 (keyed_value (MONGOC_KEYED_NAMESPACE, "keyed.coll",
+                                 MONGOC_KEYED_BYTES_OUT), >, (int64_t) 0);
+   ASSERT_CMPINT64 (keyed_value (MONGOC_KEYED_NAMESPACE, "keyed.coll",
+                                 MONGOC_KEYED_BYTES_IN), >, (int64_t) 0);
+   ASSERT_CMPINT64 (keyed_value (MONGOC_KEYED_NAMESPACE, "keyed.coll",
+                                 MONGOC_KEYED_IN_FLIGHT), ==, (int64_t) 0);
+
+   /* a command error is counted */
+   future = future_client_command_simple (client, "keyed",
+                                          tmp_bson ("{'count': 'coll'}"),
+                                          NULL, NULL, NULL);
+   request = mock_server_receives_command (server, "keyed",
+                                           MONGOC_QUERY_SLAVE_OK,
+                                           "{'count': 'coll'}");
+   mock_server_replies_simple (request, "{'ok': 0, 'errmsg': 'foo'}");
+   ASSERT (!future_get_bool (future));
+   future_destroy (future);
+   request_destroy (request);
+
+   ASSERT_CMPINT64 (keyed_value (MONGOC_KEYED_NAMESPACE, "keyed.coll",
+                                 MONGOC_KEYED_ERRORS), ==, errors + 1);
+   ASSERT_CMPINT64 (keyed_value (MONGOC_KEYED_NAMESPACE, "keyed.coll",
+                                 MONGOC_KEYED_TIMEOUTS), ==, (int64_t) 0);
+   ASSERT_CMPINT64 (keyed_value (MONGOC_KEYED_NAMESPACE, "keyed.coll",
+                                 MONGOC_KEYED_IN_FLIGHT), ==, (int64_t) 0);
+
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+/* reply to the first insert, hang up on the second */
+static bool
+hangup_responder (request_t *request,
+                  void      *data)
+{
+   int *n_inserts = (int *) data;
+
+   if (strcmp (request->command_name, "insert")) {
+      return false;
+   }
+
+   if (++(*n_inserts) == 2) {
+      mock_server_hangs_up (request);
+   } else {
+      mock_server_replies_simple (request, "{'ok': 1, 'n': 1}");
+   }
+
+   request_destroy (request);
+
+   return true;
+}
+
+
+/* replies lost with their connection are not left in flight */
+static void
+test_counters_keyed_abandoned (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_bulk_writer_t *writer;
+   bson_error_t error;
+   int64_t errors;
+   int n_inserts = 0;
+   int i;
+
+   server = mock_server_with_autoismaster (WIRE_VERSION_MAX);
+   mock_server_autoresponds (server, hangup_responder, &n_inserts, NULL);
+   mock_server_run (server);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   collection = mongoc_client_get_collection (client, "keyed", "abandoned");
+
+   errors = keyed_value (MONGOC_KEYED_NAMESPACE, "keyed.abandoned",
+                         MONGOC_KEYED_ERRORS);
+
+   writer = mongoc_bulk_writer_new (
+      collection,
+      tmp_bson ("{'maxBatchDocs': 1, 'maxBatchAgeMS': 60000,"
+                " 'maxInFlight': 3}"),
+      &error);
+   ASSERT_OR_PRINT (writer, error);
+
+   /* three batches in flight, the second's and third's replies are lost */
+   for (i = 0; i < 3; i++) {
+      ASSERT_CMPINT ((int) mongoc_bulk_writer_insert (
+         writer, tmp_bson ("{'_id': %d}", i), &error), ==, i);
+   }
+
+   ASSERT (!mongoc_bulk_writer_flush (writer, &error));
+
+   ASSERT_CMPINT64 (keyed_value (MONGOC_KEYED_NAMESPACE, "keyed.abandoned",
+                                 MONGOC_KEYED_IN_FLIGHT), ==, (int64_t) 0);
+   ASSERT_CMPINT64 (keyed_value (MONGOC_KEYED_NAMESPACE, "keyed.abandoned",
+                                 MONGOC_KEYED_ERRORS), >, errors);
+
+   mongoc_bulk_writer_destroy (writer);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+static void
+test_counters_histogram_bucket (void)
+{
+   uint32_t b;
+   uint32_t k;
+   int64_t v;
+
+   /* a bucket for each value below MONGOC_HISTOGRAM_SUB_BUCKETS */
+   ASSERT_CMPUINT32 (_mongoc_histogram_bucket (-1), ==, (uint32_t) 0);
+   for (v = 0; v < MONGOC_HISTOGRAM_SUB_BUCKETS; v++) {
+      ASSERT_CMPUINT32 (_mongoc_histogram_bucket (v), ==, (uint32_t) v);
+   }
+
+   /* then eight for each power of two */
+   ASSERT_CMPUINT32 (_mongoc_histogram_bucket (15), ==, (uint32_t) 15);
+   ASSERT_CMPUINT32 (_mongoc_histogram_bucket (16), ==, (uint32_t) 16);
+   ASSERT_CMPUINT32 (_mongoc_histogram_bucket (17), ==, (uint32_t) 16);
+   ASSERT_CMPUINT32 (_mongoc_histogram_bucket (18), ==, (uint32_t) 17);
+   ASSERT_CMPUINT32 (_mongoc_histogram_bucket (31), ==, (uint32_t) 23);
+   ASSERT_CMPUINT32 (_mongoc_histogram_bucket (35), ==, (uint32_t) 24);
+   ASSERT_CMPUINT32 (_mongoc_histogram_bucket (36), ==, (uint32_t) 25);
+
+   for (k = MONGOC_HISTOGRAM_SUB_BITS; k <= 32; k++) {
+      v = (int64_t) 1 << k;
+      b = (k - MONGOC_HISTOGRAM_SUB_BITS + 1) * MONGOC_HISTOGRAM_SUB_BUCKETS;
+      ASSERT_CMPUINT32 (_mongoc_histogram_bucket (v), ==, b);
+      ASSERT_CMPUINT32 (_mongoc_histogram_bucket (v - 1), ==, b - 1);
+      ASSERT_CMPINT64 (_mongoc_histogram_bucket_min (b), ==, v);
+   }
+
+   /* each bucket holds the values from its minimum to the next's */
+   for (b = 0; b < MONGOC_HISTOGRAM_BUCKETS - 1; b++) {
+      v = _mongoc_histogram_bucket_min (b);
+      ASSERT_CMPUINT32 (_mongoc_histogram_bucket (v), ==, b);
+      v = _mongoc_histogram_bucket_min (b + 1) - 1;
+      ASSERT_CMPUINT32 (_mongoc_histogram_bucket (v), ==, b);
+   }
+
+   /* the last bucket counts everything from 2^33 - 2^29 on */
+   b = MONGOC_HISTOGRAM_BUCKETS - 1;
+   ASSERT_CMPINT64 (_mongoc_histogram_bucket_min (b), ==,
+                    ((int64_t) 1 << 33) - ((int64_t) 1 << 29));
+   ASSERT_CMPUINT32 (_mongoc_histogram_bucket (((int64_t) 1 << 33) - 1), ==, b);
+   ASSERT_CMPUINT32 (_mongoc_histogram_bucket ((int64_t) 1 << 33), ==, b);
+   ASSERT_CMPUINT32 (_mongoc_histogram_bucket (INT64_MAX), ==, b);
+}
+
+
+/* values recorded on any CPU are read back through the counters segment,
+ * and their percentiles are computed the way mongoc-stat prints them */
+static void
+test_counters_histogram_record (void)
+{
+   int64_t before[MONGOC_HISTOGRAM_BUCKETS];
+   int64_t after[MONGOC_HISTOGRAM_BUCKETS];
+   int64_t later[MONGOC_HISTOGRAM_BUCKETS];
+   int64_t delta[MONGOC_HISTOGRAM_BUCKETS];
+   int64_t sum_before;
+   int64_t sum_after;
+   int64_t sum_later;
+   int64_t count;
+   int64_t v;
+
+   _mongoc_histogram_read (HISTOGRAM_gridfs_chunk_write, before, &sum_before);
+
+   /* 1 through 100 microseconds, and one past the last bucket's start */
+   for (v = 1; v <= 100; v++) {
+      mongoc_histogram_gridfs_chunk_write_record (v);
+   }
+
+   mongoc_histogram_gridfs_chunk_write_record ((int64_t) 1 << 34);
+
+   _mongoc_histogram_read (HISTOGRAM_gridfs_chunk_write, after, &sum_after);
+   count = _mongoc_histogram_delta (after, before, MONGOC_HISTOGRAM_BUCKETS,
+                                    delta);
+
+   ASSERT_CMPINT64 (count, ==, (int64_t) 101);
+   ASSERT_CMPINT64 (sum_after - sum_before, ==,
+                    (int64_t) 5050 + ((int64_t) 1 << 34));
+   ASSERT_CMPINT64 (delta[0], ==, (int64_t) 0);
+   ASSERT_CMPINT64 (delta[1], ==, (int64_t) 1);
+   /* 48 through 51 */
+   ASSERT_CMPINT64 (delta[_mongoc_histogram_bucket (48)], ==, (int64_t) 4);
+   /* 96 through 100, of the bucket from 96 through 103 */
+   ASSERT_CMPINT64 (delta[_mongoc_histogram_bucket (96)], ==, (int64_t) 5);
+   ASSERT_CMPINT64 (delta[MONGOC_HISTOGRAM_BUCKETS - 1], ==, (int64_t) 1);
+
+   /* each percentile is its bucket's largest value */
+   ASSERT_CMPINT64 (_mongoc_histogram_percentile (
+                       delta, MONGOC_HISTOGRAM_BUCKETS, count, 0.0),
+                    ==, (int64_t) 1);
+   ASSERT_CMPINT64 (_mongoc_histogram_percentile (
+                       delta, MONGOC_HISTOGRAM_BUCKETS, count, 50.0),
+                    ==, (int64_t) 51);
+   ASSERT_CMPINT64 (_mongoc_histogram_percentile (
+                       delta, MONGOC_HISTOGRAM_BUCKETS, count, 90.0),
+                    ==, (int64_t) 95);
+   ASSERT_CMPINT64 (_mongoc_histogram_percentile (
+                       delta, MONGOC_HISTOGRAM_BUCKETS, count, 99.0),
+                    ==, (int64_t) 103);
+   /* the maximum is in the unbounded last bucket */
+   ASSERT_CMPINT64 (_mongoc_histogram_percentile (
+                       delta, MONGOC_HISTOGRAM_BUCKETS, count, 100.0),
+                    ==, (int64_t) -1);
+
+   /* like mongoc-stat -i, the next interval counts only newer values */
+   for (v = 0; v < 3; v++) {
+      mongoc_histogram_gridfs_chunk_write_record (1000);
+   }
+
+   _mongoc_histogram_read (HISTOGRAM_gridfs_chunk_write, later, &sum_later);
+   count = _mongoc_histogram_delta (later, after, MONGOC_HISTOGRAM_BUCKETS,
+                                    delta);
+
+   ASSERT_CMPINT64 (count, ==, (int64_t) 3);
+   ASSERT_CMPINT64 (sum_later - sum_after, ==, (int64_t) 3000);
+   ASSERT_CMPINT64 (delta[_mongoc_histogram_bucket (1000)], ==, (int64_t) 3);
+   /* 1000 is in the bucket from 960 through 1023 */
+   ASSERT_CMPINT64 (_mongoc_histogram_percentile (
+                       delta, MONGOC_HISTOGRAM_BUCKETS, count, 50.0),
+                    ==, (int64_t) 1023);
+   ASSERT_CMPINT64 (_mongoc_histogram_percentile (
+                       delta, MONGOC_HISTOGRAM_BUCKETS, count, 100.0),
+                    ==, (int64_t) 1023);
+
+   /* without a previous snapshot, all values since the process started */
+   ASSERT_CMPINT64 (_mongoc_histogram_delta (later, NULL,
+                                             MONGOC_HISTOGRAM_BUCKETS, delta),
+                    >=, (int64_t) 104);
+}
+
+
+void
+test_counters_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/Counters/keyed/lookup",
+                  test_counters_keyed_lookup);
+   TestSuite_Add (suite, "/Counters/keyed/command",
+                  test_counters_keyed_command);
+   TestSuite_Add (suite, "/Counters/keyed/abandoned",
+                  test_counters_keyed_abandoned);
+   TestSuite_Add (suite, "/Counters/histogram/bucket",
+                  test_counters_histogram_bucket);
+   TestSuite_Add (suite, "/Counters/histogram/record",
+                  test_counters_histogram_record);
+}
@@ -450,6 +450,122 @@ test_find_and_modify_collation_fail (void)
    test_find_and_modify_collation (WIRE_VERSION_COLLATION-1);
 }
 
+typedef struct
+{
+   int n_commands;
+   int n_documents;  /* documents to return before null */
+   int fail_at;      /* command to reply to with an error, or 0 */
+} batch_test_t;
+
+
+static bool
+batch_responder (request_t *request,
+                 void      *data)
+{
+   batch_test_t *test = (batch_test_t *) data;
+   char *reply;
+
+   if (!request->is_command ||
+       strcmp (request->command_name, "findAndModify")) {
+      return false;
+   }
+
+   ASSERT_MATCH (request_get_doc (request, 0),
+                 "{'findAndModify': 'collection', 'query': {'state': 'ready'},"
+                 " 'update': {'$set': {'state': 'running'}}}");
+
+   test->n_commands++;
+   if (test->n_commands == test->fail_at) {
+      reply = bson_strdup ("{'ok': 0, 'code': 2, 'errmsg': 'failed'}");
+   } else if (test->n_commands <= test->n_documents) {
+      reply = bson_strdup_printf ("{'ok': 1, 'value': {'_id': %d}}",
+                                  test->n_commands);
+   } else {
+      reply = bson_strdup ("{'ok': 1, 'value': null}");
+   }
+
+   mock_server_replies_simple (request, reply);
+   bson_free (reply);
+   request_destroy (request);
+
+   return true;
+}
+
+
+static void
+test_find_and_modify_batch (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_find_and_modify_opts_t *opts;
+   mongoc_cursor_t *cursor;
+   const bson_t *doc;
+   bson_error_t error;
+   batch_test_t test = { 0 };
+   int i;
+
+   server = mock_server_with_autoismaster (WIRE_VERSION_MAX);
+   mock_server_autoresponds (server, batch_responder, &test, NULL);
+   mock_server_run (server);
+
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   collection = mongoc_client_get_collection (client, "db", "collection");
+   opts = mongoc_find_and_modify_opts_new ();
+   mongoc_find_and_modify_opts_set_update (
+      opts, tmp_bson ("{'$set': {'state': 'running'}}"));
+
+   /* stops at the first null */
+   test.n_documents = 3;
+   cursor = mongoc_collection_find_and_modify_batch (
+      collection, tmp_bson ("{'state': 'ready'}"), opts, 5);
+
+   for (i = 1; i <= 3; i++) {
+      ASSERT (mongoc_cursor_next (cursor, &doc));
+      ASSERT_MATCH (doc, "{'_id': %d}", i);
+   }
+
+   ASSERT (!mongoc_cursor_next (cursor, &doc));
+   ASSERT_OR_PRINT (!mongoc_cursor_error (cursor, &error), error);
+   /* the commands were in flight when the null arrived */
+   ASSERT_CMPINT (test.n_commands, ==, 5);
+   mongoc_cursor_destroy (cursor);
+
+   /* documents claimed before an error are returned */
+   memset (&test, 0, sizeof test);
+   test.n_documents = 10;
+   test.fail_at = 3;
+   cursor = mongoc_collection_find_and_modify_batch (
+      collection, tmp_bson ("{'state': 'ready'}"), opts, 4);
+
+   ASSERT (mongoc_cursor_next (cursor, &doc));
+   ASSERT_MATCH (doc, "{'_id': 1}");
+   ASSERT (mongoc_cursor_next (cursor, &doc));
+   ASSERT_MATCH (doc, "{'_id': 2}");
+   ASSERT (mongoc_cursor_next (cursor, &doc));
+   ASSERT_MATCH (doc, "{'_id': 4}");
+   ASSERT (!mongoc_cursor_next (cursor, &doc));
+   ASSERT (mongoc_cursor_error (cursor, &error));
+   ASSERT_ERROR_CONTAINS (error, MONGOC_ERROR_QUERY, 2, "failed");
+   mongoc_cursor_destroy (cursor);
+
+   /* upsert would claim forever */
+   mongoc_find_and_modify_opts_set_flags (opts, MONGOC_FIND_AND_MODIFY_UPSERT);
+   cursor = mongoc_collection_find_and_modify_batch (
+      collection, tmp_bson ("{'state': 'ready'}"), opts, 4);
+   ASSERT (!mongoc_cursor_next (cursor, &doc));
+   ASSERT (mongoc_cursor_error (cursor, &error));
+   ASSERT_ERROR_CONTAINS (error, MONGOC_ERROR_COMMAND,
+                          MONGOC_ERROR_COMMAND_INVALID_ARG, "upsert");
+   mongoc_cursor_destroy (cursor);
+
+   mongoc_find_and_modify_opts_destroy (opts);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
 void
 test_find_and_modify_install (TestSuite *suite)
 {
@@ -468,4 +584,5 @@ test_find_and_modify_install (TestSuite *suite)
    TestSuite_Add (suite, "/find_and_modify/opts", test_find_and_modify_opts);
    TestSuite_Add (suite, "/find_and_modify/collation/ok", test_find_and_modify_collation_ok);
    TestSuite_Add (suite, "/find_and_modify/collation/fail", test_find_and_modify_collation_fail);
+   TestSuite_Add (suite, "/find_and_modify/batch", test_find_and_modify_batch);
 }
@@ -4,6 +4,7 @@
 #include <mongoc-matcher-private.h>
 
 #include "TestSuite.h"
+#include "test-conveniences.h"
 
 BEGIN_IGNORE_DEPRECATIONS;
 
@@ -533,6 +534,439 @@ test_mongoc_matcher_in_basic (void)
    mongoc_matcher_destroy (matcher);
 }
 
+
+typedef struct {
+   const char *doc;
+   bool match;
+} match_test_t;
+
+
+static void
+check_matches (const char         *spec,
+               const match_test_t *tests)
+{
+   mongoc_matcher_t *matcher;
+   bson_error_t error;
+   int i;
+
+   matcher = mongoc_matcher_new (tmp_bson (spec), &error);
+   ASSERT_OR_PRINT (matcher, error);
+
+   for (i = 0; tests[i].doc; i++) {
+      if (mongoc_matcher_match (matcher, tmp_bson (tests[i].doc)) !=
+          tests[i].match) {
+         fprintf (stderr, "%s should%s match %s\n", spec,
+                  tests[i].match ? "" : " not", tests[i].doc);
+         abort ();
+      }
+   }
+
+   mongoc_matcher_destroy (matcher);
+}
+
+
+static void
+test_mongoc_matcher_in_hashed (void)
+{
+   match_test_t in_tests[] = {
+      { "{'a': 1}", true },
+      { "{'a': {'$numberLong': '2'}}", true },
+      { "{'a': 3.0}", true },
+      { "{'a': -0.0}", true },
+      { "{'a': 4.5}", true },
+      { "{'a': true}", true },
+      { "{'a': 'x'}", true },
+      { "{'a': 'xy'}", false },
+      { "{'a': null}", true },
+      { "{'a': {'b': 1}}", true },
+      { "{'a': {'b': 2}}", false },
+      { "{'a': [1]}", true },
+      { "{'a': 5}", false },
+      { "{'b': 1}", false },
+      { NULL }
+   };
+   match_test_t nin_tests[] = {
+      { "{'a': 1}", false },
+      { "{'a': 5}", true },
+      { "{'a': 'xy'}", true },
+      { NULL }
+   };
+   const char *values =
+      "[0, 1, {'$numberLong': '2'}, 3, 4.5, 'x', 'y', false, null,"
+      " {'b': 1}, [1]]";
+   char *spec;
+
+   /* a bool in $in never matched, nor does it here */
+   spec = bson_strdup_printf ("{'a': {'$in': %s}}", values);
+   check_matches (spec, in_tests);
+   bson_free (spec);
+
+   spec = bson_strdup_printf ("{'a': {'$nin': %s}}", values);
+   check_matches (spec, nin_tests);
+   bson_free (spec);
+}
+
+
+static void
+test_mongoc_matcher_grouped (void)
+{
+   match_test_t tests[] = {
+      { "{'a': {'b': 2, 'c': 'x'}, 'd': 1}", true },
+      { "{'d': 1, 'a': {'c': 'x', 'b': 2}}", true },
+      { "{'a': {'b': 2, 'c': 'y'}, 'd': 1}", false },
+      { "{'a': {'b': 0, 'c': 'x'}, 'd': 1}", false },
+      { "{'a': {'b': 2, 'c': 'x'}, 'd': 1, 'e': 1}", false },
+      { "{'a': {'b': 2, 'c': 'x'}}", false },
+      { "{'a': 1, 'd': 1}", false },
+      /* the first "d" is matched */
+      { "{'a': {'b': 2, 'c': 'x'}, 'd': 1, 'd': 2}", true },
+      { "{'a': {'b': 2, 'c': 'x'}, 'd': 2, 'd': 1}", false },
+      { NULL }
+   };
+   match_test_t compare_tests[] = {
+      { "{'a': 2}", true },
+      { "{'a': 2.5}", true },
+      { "{'a': {'$numberLong': '3'}}", true },
+      { "{'a': 1}", false },
+      { "{'a': 4}", false },
+      { "{'a': true}", false },
+      { NULL }
+   };
+
+   check_matches ("{'a.b': {'$gt': 1}, 'd': {'$in': [1, 3]},"
+                  " 'a.c': 'x', 'a.b': {'$lte': 2.0},"
+                  " 'e': {'$exists': false}, '$or': [{'d': 1}, {'f': 1}]}",
+                  tests);
+   check_matches ("{'a': {'$gte': 2}, 'a': {'$lt': {'$numberLong': '4'}},"
+                  " 'a': {'$ne': 2.25}}",
+                  compare_tests);
+}
+
+static void
+check_invalid (const char *spec)
+{
+   mongoc_matcher_t *matcher;
+   bson_error_t error;
+
+   matcher = mongoc_matcher_new (tmp_bson (spec), &error);
+   if (matcher) {
+      fprintf (stderr, "%s should be invalid\n", spec);
+      abort ();
+   }
+
+   ASSERT_CMPINT (error.domain, ==, MONGOC_ERROR_MATCHER);
+   ASSERT_CMPINT (error.code, ==, MONGOC_ERROR_MATCHER_INVALID);
+}
+
+
+#ifndef _WIN32
+static void
+test_mongoc_matcher_regex (void)
+{
+   match_test_t tests[] = {
+      { "{'a': 'abc'}", true },
+      { "{'a': 'ABBC'}", true },
+      { "{'a': 'xabc'}", false },
+      { "{'a': 1}", false },
+      { "{'b': 'abc'}", false },
+      { NULL }
+   };
+   match_test_t not_tests[] = {
+      { "{'a': 'abc'}", false },
+      { "{'a': 'xabc'}", true },
+      { "{'b': 'abc'}", true },
+      { NULL }
+   };
+   mongoc_matcher_t *matcher;
+   bson_error_t error;
+   bson_t *spec;
+   int i;
+
+   check_matches ("{'a': {'$regex': '^ab+c', '$options': 'i'}}", tests);
+   check_matches ("{'a': {'$not': {'$regex': '^ab+c', '$options': 'i'}}}",
+                  not_tests);
+
+   /* a string pattern with separate options */
+   spec = BCON_NEW ("a", "{", "$options", "i", "$regex", "^ab+c", "}");
+   matcher = mongoc_matcher_new (spec, &error);
+   ASSERT_OR_PRINT (matcher, error);
+   for (i = 0; tests[i].doc; i++) {
+      ASSERT (mongoc_matcher_match (matcher, tmp_bson (tests[i].doc)) ==
+              tests[i].match);
+   }
+   mongoc_matcher_destroy (matcher);
+   bson_destroy (spec);
+
+   check_invalid ("{'a': {'$regex': '(', '$options': ''}}");
+   check_invalid ("{'a': {'$regex': 'a', '$options': 'x'}}");
+
+   spec = BCON_NEW ("a", "{", "$options", "i", "}");
+   ASSERT (!mongoc_matcher_new (spec, &error));
+   bson_destroy (spec);
+}
+
+
+/* patterns mean what they mean to the server's PCRE */
+static void
+test_mongoc_matcher_regex_pcre (void)
+{
+   match_test_t dot_tests[] = {
+      { "{'a': 'abc'}", true },
+      { "{'a': 'a\\nc'}", false },
+      { NULL }
+   };
+   match_test_t dotall_tests[] = {
+      { "{'a': 'abc'}", true },
+      { "{'a': 'a\\nc'}", true },
+      { NULL }
+   };
+   match_test_t multiline_tests[] = {
+      { "{'a': 'x\\nab'}", true },
+      { "{'a': 'a\\nb'}", false },
+      { "{'a': 'xab'}", false },
+      { NULL }
+   };
+   match_test_t end_tests[] = {
+      { "{'a': 'ab'}", true },
+      { "{'a': 'ab\\n'}", true },
+      { "{'a': 'ab\\nc'}", false },
+      { NULL }
+   };
+   match_test_t digit_tests[] = {
+      { "{'a': '2017-01-31'}", true },
+      { "{'a': '2017-1-31'}", false },
+      { "{'a': 'dddd-dd-dd'}", false },
+      { NULL }
+   };
+   match_test_t word_tests[] = {
+      { "{'a': 'a_1 b'}", true },
+      { "{'a': 'a-1 b'}", false },
+      { "{'a': 'a_1\\tb'}", true },
+      { NULL }
+   };
+   match_test_t not_digit_tests[] = {
+      { "{'a': '1\\n2'}", true },
+      { "{'a': '12'}", false },
+      { NULL }
+   };
+   match_test_t bracket_tests[] = {
+      { "{'a': '1.5'}", true },
+      { "{'a': '-]'}", true },
+      { "{'a': 'x'}", false },
+      { NULL }
+   };
+   match_test_t group_tests[] = {
+      { "{'a': 'abab'}", true },
+      { "{'a': 'aba'}", false },
+      { "{'a': 'x{y}'}", false },
+      { NULL }
+   };
+   match_test_t brace_tests[] = {
+      { "{'a': 'x{y}'}", true },
+      { NULL }
+   };
+
+   /* "." doesn't match a newline unless the "s" option is set */
+   check_matches ("{'a': {'$regex': '^a.c$'}}", dot_tests);
+   check_matches ("{'a': {'$regex': '^a.c$', '$options': 'm'}}", dot_tests);
+   check_matches ("{'a': {'$regex': '^a.c$', '$options': 's'}}",
+                  dotall_tests);
+   check_matches ("{'a': {'$regex': '^a.c$', '$options': 'ms'}}",
+                  dotall_tests);
+
+   /* "m" only changes "^" and "$" */
+   check_matches ("{'a': {'$regex': '^ab$', '$options': 'm'}}",
+                  multiline_tests);
+   check_matches ("{'a': {'$regex': '^ab$'}}", end_tests);
+   check_matches ("{'a': {'$regex': '\\\\D', '$options': 'm'}}",
+                  not_digit_tests);
+
+   check_matches ("{'a': {'$regex': '^\\\\d{4}-\\\\d\\\\d-\\\\d{2}$'}}",
+                  digit_tests);
+   check_matches ("{'a': {'$regex': '^\\\\w+\\\\s\\\\w$'}}", word_tests);
+   check_matches ("{'a': {'$regex': '^[\\\\d.]+$|^[\\\\-\\\\]]+$'}}",
+                  bracket_tests);
+   check_matches ("{'a': {'$regex': '^(?:ab)+$'}}", group_tests);
+   check_matches ("{'a': {'$regex': '^x{y}$'}}", brace_tests);
+
+   /* PCRE-only syntax is an error, not silently something else */
+   check_invalid ("{'a': {'$regex': '(?i)abc'}}");
+   check_invalid ("{'a': {'$regex': 'a(?=b)'}}");
+   check_invalid ("{'a': {'$regex': 'a.*?b'}}");
+   check_invalid ("{'a': {'$regex': 'a+?'}}");
+   check_invalid ("{'a': {'$regex': 'a{1,3}?'}}");
+   check_invalid ("{'a': {'$regex': 'a*+'}}");
+   check_invalid ("{'a': {'$regex': '(a)\\\\1'}}");
+   check_invalid ("{'a': {'$regex': '\\\\bword'}}");
+   check_invalid ("{'a': {'$regex': '[\\\\W]'}}");
+   check_invalid ("{'a': {'$regex': '[abc'}}");
+}
+#endif
+
+
+static void
+test_mongoc_matcher_elem_match (void)
+{
+   match_test_t doc_tests[] = {
+      { "{'a': [{'b': 1, 'c': 2}]}", true },
+      { "{'a': [{'b': 2, 'c': 2}, 0, {'b': 1, 'c': 3}]}", true },
+      /* no one element matches both */
+      { "{'a': [{'b': 1, 'c': 0}, {'b': 2, 'c': 2}]}", false },
+      { "{'a': {'b': 1, 'c': 2}}", false },
+      { "{'a': []}", false },
+      { "{'b': 1}", false },
+      { NULL }
+   };
+   match_test_t value_tests[] = {
+      { "{'a': [1, 5, 3]}", true },
+      { "{'a': [1, 5]}", false },
+      { "{'a': 3}", false },
+      { NULL }
+   };
+
+   check_matches ("{'a': {'$elemMatch': {'b': 1, 'c': {'$gt': 1}}}}",
+                  doc_tests);
+   check_matches ("{'a': {'$elemMatch': {'$gte': 2, '$lt': 4}}}",
+                  value_tests);
+   check_invalid ("{'a': {'$elemMatch': 1}}");
+   check_invalid ("{'a': {'$elemMatch': {}}}");
+}
+
+
+static void
+test_mongoc_matcher_size_all_mod (void)
+{
+   match_test_t size_tests[] = {
+      { "{'a': [1, 2]}", true },
+      { "{'a': [[], {}]}", true },
+      { "{'a': [1]}", false },
+      { "{'a': [1, 2, 3]}", false },
+      { "{'a': {'x': 1, 'y': 2}}", false },
+      { "{'a': 2}", false },
+      { NULL }
+   };
+   match_test_t all_tests[] = {
+      { "{'a': [1, 'x', 3]}", true },
+      { "{'a': ['x', 1.0]}", true },
+      { "{'a': [1]}", false },
+      { "{'a': 1}", false },
+      { "{'b': [1, 'x']}", false },
+      { NULL }
+   };
+   match_test_t all_scalar_tests[] = {
+      { "{'a': 1}", true },
+      { "{'a': [2, 1]}", true },
+      { "{'a': 2}", false },
+      { NULL }
+   };
+   match_test_t mod_tests[] = {
+      { "{'a': 5}", true },
+      { "{'a': 5.5}", true },
+      { "{'a': {'$numberLong': '9'}}", true },
+      { "{'a': 4}", false },
+      { "{'a': -3}", false },
+      { "{'a': '5'}", false },
+      { NULL }
+   };
+   match_test_t range_tests[] = {
+      { "{'a': 3}", true },
+      { "{'a': 1}", false },
+      { "{'a': 5}", false },
+      { NULL }
+   };
+
+   check_matches ("{'a': {'$size': 2}}", size_tests);
+   check_matches ("{'a': {'$all': [1, 'x']}}", all_tests);
+   check_matches ("{'a': {'$all': [1]}}", all_scalar_tests);
+   check_matches ("{'a': {'$mod': [4, 1]}}", mod_tests);
+   /* all operators in a spec must match */
+   check_matches ("{'a': {'$gt': 1, '$lt': 5, '$mod': [3, 0]}}", range_tests);
+
+   check_invalid ("{'a': {'$size': -1}}");
+   check_invalid ("{'a': {'$size': 'x'}}");
+   check_invalid ("{'a': {'$all': 1}}");
+   check_invalid ("{'a': {'$mod': [0, 1]}}");
+   check_invalid ("{'a': {'$mod': [2]}}");
+   check_invalid ("{'a': {'$mod': [2, 1, 0]}}");
+}
+
+static void
+test_mongoc_matcher_batch (void)
+{
+   const char *specs[] = {
+      "{'a': {'$gt': 2}}",
+      "{'a': {'$gte': 2.5, '$lt': 10}, 'b': 'x'}",
+      "{'a': {'$ne': 3}}",
+      "{'a': {'$lte': {'$numberLong': '9007199254740993'}}}",
+      "{'a': 3, 'c.d': {'$exists': true}}",
+      "{'$or': [{'a': 1}, {'b': 'y'}], 'a': {'$lt': 5}}",
+      "{}",
+      NULL
+   };
+   const char *json[] = {
+      "{'a': 1}",
+      "{'a': 2.5, 'b': 'x'}",
+      "{'a': 3, 'c': {'d': null}}",
+      "{'a': {'$numberLong': '9007199254740993'}}",
+      "{'a': {'$numberLong': '9007199254740994'}}",
+      "{'a': 9007199254740992.0}",
+      "{'a': true, 'b': 'y'}",
+      "{'a': 'x', 'b': 'x'}",
+      "{'b': 'x'}",
+      "{'a': 3, 'a': 1}",
+      "{'b': 'y', 'a': 4}",
+      "{'a': [1, 2]}",
+      "{'a': 9.5, 'b': 'x', 'c': {'d': 1}}",
+      NULL
+   };
+   const bson_t *documents[sizeof json / sizeof json[0]];
+   mongoc_matcher_t *matcher;
+   bson_error_t error;
+   uint8_t bitmap[2];
+   uint32_t n_documents;
+   uint32_t n_matched;
+   uint32_t expected;
+   bool match;
+   int i;
+   int j;
+
+   for (n_documents = 0; json[n_documents]; n_documents++) {
+      documents[n_documents] = bson_copy (tmp_bson (json[n_documents]));
+   }
+
+   for (i = 0; specs[i]; i++) {
+      matcher = mongoc_matcher_new (tmp_bson (specs[i]), &error);
+      ASSERT_OR_PRINT (matcher, error);
+
+      memset (bitmap, 0xff, sizeof bitmap);
+      n_matched = mongoc_matcher_match_batch (matcher, documents, n_documents,
+                                              bitmap);
+      expected = 0;
+
+      for (j = 0; j < (int) n_documents; j++) {
+         match = mongoc_matcher_match (matcher, documents[j]);
+         if (match != !!(bitmap[j / 8] & (1 << (j % 8)))) {
+            fprintf (stderr, "%s should%s match %s in a batch\n", specs[i],
+                     match ? "" : " not", json[j]);
+            abort ();
+         }
+         expected += match;
+      }
+
+      /* bits past the last document are cleared */
+      ASSERT_CMPINT (bitmap[1] >> (n_documents - 8), ==, 0);
+      ASSERT_CMPUINT32 (n_matched, ==, expected);
+      ASSERT_CMPUINT32 (
+         mongoc_matcher_match_batch (matcher, documents, 0, NULL), ==, 0);
+
+      mongoc_matcher_destroy (matcher);
+   }
+
+   for (j = 0; j < (int) n_documents; j++) {
+      bson_destroy ((bson_t *) documents[j]);
+   }
+}
+
 END_IGNORE_DEPRECATIONS;
 
 void
@@ -548,4 +982,16 @@ test_matcher_install (TestSuite *suite)
    TestSuite_Add (suite, "/Matcher/eq/int64", test_mongoc_matcher_eq_int64);
    TestSuite_Add (suite, "/Matcher/eq/doc", test_mongoc_matcher_eq_doc);
    TestSuite_Add (suite, "/Matcher/in/basic", test_mongoc_matcher_in_basic);
+   TestSuite_Add (suite, "/Matcher/in/hashed", test_mongoc_matcher_in_hashed);
+   TestSuite_Add (suite, "/Matcher/grouped", test_mongoc_matcher_grouped);
+#ifndef _WIN32
+   TestSuite_Add (suite, "/Matcher/regex", test_mongoc_matcher_regex);
+   TestSuite_Add (suite, "/Matcher/regex_pcre",
+                  test_mongoc_matcher_regex_pcre);
+#endif
+   TestSuite_Add (suite, "/Matcher/elem_match",
+                  test_mongoc_matcher_elem_match);
+   TestSuite_Add (suite, "/Matcher/size_all_mod",
+                  test_mongoc_matcher_size_all_mod);
+   TestSuite_Add (suite, "/Matcher/batch", test_mongoc_matcher_batch);
 }
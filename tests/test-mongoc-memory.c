@@ -0,0 +1,110 @@
+#include <mongoc.h>
+#include <mongoc-buffer-private.h>
+#include <mongoc-memory-private.h>
+
+#include "TestSuite.h"
+#include "test-libmongoc.h"
+
+
+#ifdef MONGOC_ENABLE_MEMORY_ACCOUNTING
+static void
+test_memory_accounting (void)
+{
+   int64_t bytes, allocs, peak;
+   int64_t bytes0, allocs0, peak0;
+   uint8_t *mem;
+   int i;
+
+   _mongoc_memory_get_stats (MONGOC_MEMORY_GRIDFS, &bytes0, &allocs0, &peak0);
+
+   mem = (uint8_t *) _mongoc_memory_malloc0 (GRIDFS, 100);
+   for (i = 0; i < 100; i++) {
+      ASSERT_CMPINT (mem[i], ==, 0);
+   }
+
+   _mongoc_memory_get_stats (MONGOC_MEMORY_GRIDFS, &bytes, &allocs, &peak);
+   ASSERT_CMPINT64 (bytes - bytes0, ==, (int64_t) 100);
+   ASSERT_CMPINT64 (allocs - allocs0, ==, (int64_t) 1);
+   ASSERT_CMPINT64 (peak, >=, bytes);
+
+   /* a realloc counts the difference and another allocation */
+   mem[99] = 'x';
+   mem = (uint8_t *) _mongoc_memory_realloc (GRIDFS, mem, 1000);
+   ASSERT_CMPINT (mem[99], ==, 'x');
+
+   _mongoc_memory_get_stats (MONGOC_MEMORY_GRIDFS, &bytes, &allocs, &peak);
+   ASSERT_CMPINT64 (bytes - bytes0, ==, (int64_t) 1000);
+   ASSERT_CMPINT64 (allocs - allocs0, ==, (int64_t) 2);
+   ASSERT_CMPINT64 (peak, >=, bytes0 + 1000);
+
+   _mongoc_memory_free (mem);
+
+   /* the peak stays */
+   _mongoc_memory_get_stats (MONGOC_MEMORY_GRIDFS, &bytes, &allocs, &peak);
+   ASSERT_CMPINT64 (bytes, ==, bytes0);
+   ASSERT_CMPINT64 (allocs - allocs0, ==, (int64_t) 2);
+   ASSERT_CMPINT64 (peak, >=, bytes0 + 1000);
+
+   _mongoc_memory_free (NULL);
+}
+
+
+static void
+test_memory_buffer (void)
+{
+   mongoc_buffer_t buffer;
+   int64_t bytes, allocs, peak;
+   int64_t bytes0, allocs0, peak0;
+
+   _mongoc_memory_get_stats (MONGOC_MEMORY_CURSOR, &bytes0, &allocs0, &peak0);
+
+   _mongoc_buffer_init (&buffer, NULL, 0, MONGOC_MEMORY_REALLOC_FUNC (CURSOR),
+                        MONGOC_MEMORY_REALLOC_CTX (CURSOR));
+
+   _mongoc_memory_get_stats (MONGOC_MEMORY_CURSOR, &bytes, &allocs, &peak);
+   ASSERT_CMPINT64 (bytes - bytes0, ==, (int64_t) buffer.datalen);
+   ASSERT_CMPINT64 (allocs - allocs0, ==, (int64_t) 1);
+
+   _mongoc_buffer_destroy (&buffer);
+
+   _mongoc_memory_get_stats (MONGOC_MEMORY_CURSOR, &bytes, &allocs, &peak);
+   ASSERT_CMPINT64 (bytes, ==, bytes0);
+}
+
+
+static void
+test_memory_dump_sites (void)
+{
+   char buf[4096] = { 0 };
+   FILE *stream;
+   void *mem;
+
+   stream = tmpfile ();
+   ASSERT (stream);
+
+   mem = _mongoc_memory_malloc (APM, 10);
+   mongoc_memory_dump_sites (stream, 10);
+   _mongoc_memory_free (mem);
+
+   rewind (stream);
+   if (fread (buf, 1, sizeof buf - 1, stream) > 0) {
+      ASSERT_CONTAINS (buf, "test-mongoc-memory.c");
+   } else {
+      /* sites are only recorded with MONGOC_MEMORY_SITES */
+      ASSERT (!getenv ("MONGOC_MEMORY_SITES"));
+   }
+
+   fclose (stream);
+}
+#endif
+
+
+void
+test_memory_install (TestSuite *suite)
+{
+#ifdef MONGOC_ENABLE_MEMORY_ACCOUNTING
+   TestSuite_Add (suite, "/Memory/accounting", test_memory_accounting);
+   TestSuite_Add (suite, "/Memory/buffer", test_memory_buffer);
+   TestSuite_Add (suite, "/Memory/dump_sites", test_memory_dump_sites);
+#endif
+}
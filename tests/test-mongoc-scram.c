@@ -0,0 +1,100 @@
+#include <mongoc.h>
+
+#ifdef MONGOC_ENABLE_SSL
+
+#include "mongoc-scram-private.h"
+
+#include "TestSuite.h"
+
+
+/* base64 of the 16-byte salt "saltsaltsaltsalt" */
+#define TEST_SCRAM_SALT "c2FsdHNhbHRzYWx0c2FsdA=="
+
+
+typedef struct
+{
+   bool    cache_hit;
+   uint8_t client_key[MONGOC_SCRAM_HASH_SIZE];
+   uint8_t server_key[MONGOC_SCRAM_HASH_SIZE];
+} scram_test_result_t;
+
+
+/* run the client's first two SCRAM steps against a made-up server reply */
+static void
+_scram_steps (const char          *pass,
+              scram_test_result_t *result)
+{
+   mongoc_scram_t scram;
+   uint8_t buf[4096] = { 0 };
+   uint32_t buflen = 0;
+   char *server_first;
+   const char *nonce;
+   bson_error_t error;
+
+   _mongoc_scram_init (&scram);
+   _mongoc_scram_set_user (&scram, "user");
+   _mongoc_scram_set_pass (&scram, pass);
+
+   ASSERT_OR_PRINT (_mongoc_scram_step (&scram, buf, 0, buf, sizeof buf - 1,
+                                        &buflen, &error),
+                    error);
+
+   buf[buflen] = '\0';
+   nonce = strstr ((char *) buf, "r=");
+   BSON_ASSERT (nonce);
+
+   server_first = bson_strdup_printf ("%sserver,s=%s,i=4096",
+                                      nonce, TEST_SCRAM_SALT);
+
+   buflen = 0;
+   ASSERT_OR_PRINT (_mongoc_scram_step (&scram, (uint8_t *) server_first,
+                                        (uint32_t) strlen (server_first),
+                                        buf, sizeof buf - 1, &buflen, &error),
+                    error);
+
+   result->cache_hit = scram.cache_hit;
+   memcpy (result->client_key, scram.client_key, MONGOC_SCRAM_HASH_SIZE);
+   memcpy (result->server_key, scram.server_key, MONGOC_SCRAM_HASH_SIZE);
+
+   bson_free (server_first);
+   _mongoc_scram_destroy (&scram);
+}
+
+
+static void
+test_scram_cache (void)
+{
+   scram_test_result_t first;
+   scram_test_result_t second;
+   scram_test_result_t other;
+
+   _mongoc_scram_cache_clear ();
+
+   _scram_steps ("pass", &first);
+   BSON_ASSERT (!first.cache_hit);
+
+   /* same credentials, salt and iterations: the keys come from the cache */
+   _scram_steps ("pass", &second);
+   BSON_ASSERT (second.cache_hit);
+   ASSERT_MEMCMP (first.client_key, second.client_key,
+                  MONGOC_SCRAM_HASH_SIZE);
+   ASSERT_MEMCMP (first.server_key, second.server_key,
+                  MONGOC_SCRAM_HASH_SIZE);
+
+   /* a different password never hits another password's entry */
+   _scram_steps ("other", &other);
+   BSON_ASSERT (!other.cache_hit);
+   BSON_ASSERT (memcmp (first.client_key, other.client_key,
+                        MONGOC_SCRAM_HASH_SIZE));
+
+   _mongoc_scram_cache_clear ();
+}
+
+
+void
+test_scram_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/Scram/cache", test_scram_cache);
+}
+
+#endif /* MONGOC_ENABLE_SSL */
@@ -0,0 +1,488 @@
+#include <mongoc.h>
+
+#include "mongoc-client-private.h"
+#include "mongoc-shard-map-private.h"
+#include "mongoc-thread-private.h"
+#include "mongoc-write-command-private.h"
+
+#include "TestSuite.h"
+#include "test-conveniences.h"
+#include "mock_server/mock-server.h"
+
+
+#define TEST_EPOCH "{'$oid': '000000000000000000000001'}"
+
+
+/* db.coll, sharded on x: [MinKey, 0) and [100, MaxKey) on s0, [0, 100) on s1 */
+static mongoc_shard_map_t *
+_test_shard_map_new (void)
+{
+   mongoc_shard_map_t *map;
+
+   map = _mongoc_shard_map_new (
+      "db.coll", tmp_bson ("{'_id': 'db.coll', 'key': {'x': 1}}"));
+
+   BSON_ASSERT (map->sharded);
+
+   BSON_ASSERT (_mongoc_shard_map_add_chunk (map, tmp_bson (
+      "{'ns': 'db.coll', 'min': {'x': {'$minKey': 1}}, 'max': {'x': 0},"
+      " 'shard': 's0', 'lastmod': {'$timestamp': {'t': 1, 'i': 0}},"
+      " 'lastmodEpoch': " TEST_EPOCH "}")));
+   BSON_ASSERT (_mongoc_shard_map_add_chunk (map, tmp_bson (
+      "{'ns': 'db.coll', 'min': {'x': 0}, 'max': {'x': 100},"
+      " 'shard': 's1', 'lastmod': {'$timestamp': {'t': 1, 'i': 2}},"
+      " 'lastmodEpoch': " TEST_EPOCH "}")));
+   BSON_ASSERT (_mongoc_shard_map_add_chunk (map, tmp_bson (
+      "{'ns': 'db.coll', 'min': {'x': 100}, 'max': {'x': {'$maxKey': 1}},"
+      " 'shard': 's0', 'lastmod': {'$timestamp': {'t': 1, 'i': 1}},"
+      " 'lastmodEpoch': " TEST_EPOCH "}")));
+
+   return map;
+}
+
+
+static void
+test_shard_map_route (void)
+{
+   mongoc_shard_map_t *map;
+
+   map = _test_shard_map_new ();
+
+   ASSERT_CMPINT ((int) map->shards.len, ==, 2);
+   ASSERT_CMPINT ((int) map->chunks.len, ==, 3);
+   BSON_ASSERT (map->version == (((uint64_t) 1 << 32) | 2));
+
+#define ROUTE_INSERT(_json) \
+   _mongoc_shard_map_route_insert (map, tmp_bson (_json), NULL)
+#define ROUTE_QUERY(_json) \
+   _mongoc_shard_map_route_query (map, tmp_bson (_json))
+
+   ASSERT_CMPINT (ROUTE_INSERT ("{'x': -5}"), ==, 0);
+   ASSERT_CMPINT (ROUTE_INSERT ("{'x': 0}"), ==, 1);
+   ASSERT_CMPINT (ROUTE_INSERT ("{'x': 99.5}"), ==, 1);
+   ASSERT_CMPINT (ROUTE_INSERT ("{'x': {'$numberLong': '50'}}"), ==, 1);
+   ASSERT_CMPINT (ROUTE_INSERT ("{'x': 100}"), ==, 0);
+   /* strings sort after numbers, a missing key is null, before numbers */
+   ASSERT_CMPINT (ROUTE_INSERT ("{'x': 'a'}"), ==, 0);
+   ASSERT_CMPINT (ROUTE_INSERT ("{'y': 1}"), ==, 0);
+   /* we don't compare arrays or subdocuments */
+   ASSERT_CMPINT (ROUTE_INSERT ("{'x': [1]}"), ==, -1);
+   ASSERT_CMPINT (ROUTE_INSERT ("{'x': {'a': 1}}"), ==, -1);
+
+   ASSERT_CMPINT (ROUTE_QUERY ("{'x': 50, 'y': 1}"), ==, 1);
+   ASSERT_CMPINT (ROUTE_QUERY ("{'x': {'$gt': 50}}"), ==, -1);
+   ASSERT_CMPINT (ROUTE_QUERY ("{'y': 1}"), ==, -1);
+   ASSERT_CMPINT (ROUTE_QUERY ("{'x': null}"), ==, -1);
+
+#undef ROUTE_INSERT
+#undef ROUTE_QUERY
+
+   _mongoc_shard_map_destroy (map);
+}
+
+
+static void
+test_shard_map_unroutable (void)
+{
+   mongoc_shard_map_t *map;
+
+   map = _mongoc_shard_map_new (
+      "db.coll", tmp_bson ("{'_id': 'db.coll', 'key': {'x': 'hashed'}}"));
+   BSON_ASSERT (!map->sharded);
+   _mongoc_shard_map_destroy (map);
+
+   map = _mongoc_shard_map_new (
+      "db.coll", tmp_bson ("{'_id': 'db.coll', 'key': {'x': 1},"
+                           " 'dropped': true}"));
+   BSON_ASSERT (!map->sharded);
+   _mongoc_shard_map_destroy (map);
+
+   /* chunks must be contiguous */
+   map = _mongoc_shard_map_new (
+      "db.coll", tmp_bson ("{'_id': 'db.coll', 'key': {'x': 1}}"));
+   BSON_ASSERT (_mongoc_shard_map_add_chunk (map, tmp_bson (
+      "{'ns': 'db.coll', 'min': {'x': {'$minKey': 1}}, 'max': {'x': 0},"
+      " 'shard': 's0', 'lastmod': {'$timestamp': {'t': 1, 'i': 0}},"
+      " 'lastmodEpoch': " TEST_EPOCH "}")));
+   BSON_ASSERT (!_mongoc_shard_map_add_chunk (map, tmp_bson (
+      "{'ns': 'db.coll', 'min': {'x': 1}, 'max': {'x': {'$maxKey': 1}},"
+      " 'shard': 's1', 'lastmod': {'$timestamp': {'t': 1, 'i': 1}},"
+      " 'lastmodEpoch': " TEST_EPOCH "}")));
+   _mongoc_shard_map_destroy (map);
+}
+
+
+static void
+test_shard_map_partition (void)
+{
+   mongoc_shard_map_t *map;
+   mongoc_write_command_t command;
+   mongoc_write_command_t parts[3];
+   mongoc_bulk_write_flags_t flags = MONGOC_BULK_WRITE_FLAGS_INIT;
+   int i;
+
+   map = _test_shard_map_new ();
+
+   _mongoc_write_command_init_insert (&command, tmp_bson ("{'_id': 1, 'x': -1}"),
+                                      flags, 0, false);
+   _mongoc_write_command_insert_append (&command,
+                                        tmp_bson ("{'_id': 2, 'x': 50}"));
+   _mongoc_write_command_insert_append (&command,
+                                        tmp_bson ("{'_id': 3, 'x': [1]}"));
+   _mongoc_write_command_insert_append (&command,
+                                        tmp_bson ("{'_id': 4, 'x': 60}"));
+
+   /* the command's first document is the bulk operation's 11th */
+   _mongoc_write_command_partition (&command, 10, map, parts);
+
+   ASSERT_CMPINT (parts[0].n_documents, ==, 1);
+   ASSERT_CMPINT (parts[0].bulk_indexes[0], ==, 10);
+   ASSERT_MATCH (parts[0].documents, "{'0': {'_id': 1}}");
+
+   ASSERT_CMPINT (parts[1].n_documents, ==, 2);
+   ASSERT_CMPINT (parts[1].bulk_indexes[0], ==, 11);
+   ASSERT_CMPINT (parts[1].bulk_indexes[1], ==, 13);
+   ASSERT_MATCH (parts[1].documents, "{'0': {'_id': 2}, '1': {'_id': 4}}");
+
+   /* unroutable */
+   ASSERT_CMPINT (parts[2].n_documents, ==, 1);
+   ASSERT_CMPINT (parts[2].bulk_indexes[0], ==, 12);
+
+   for (i = 0; i < 3; i++) {
+      _mongoc_write_command_destroy (&parts[i]);
+   }
+
+   _mongoc_write_command_destroy (&command);
+   _mongoc_shard_map_destroy (map);
+}
+
+
+#define TEST_CHUNK(_min, _max, _shard, _i) \
+   "{'ns': 'db.coll', 'min': {'x': " _min "}, 'max': {'x': " _max "}," \
+   " 'shard': '" _shard "', 'lastmod': {'$timestamp': {'t': 1, 'i': " _i "}}," \
+   " 'lastmodEpoch': " TEST_EPOCH "}"
+
+/* before: [MinKey, 0) on s0, [0, MaxKey) on s1 */
+#define TEST_CHUNKS_V1 \
+   TEST_CHUNK ("{'$minKey': 1}", "0", "s0", "0") ", " \
+   TEST_CHUNK ("0", "{'$maxKey': 1}", "s1", "1")
+#define TEST_NEWEST_V1 TEST_CHUNK ("0", "{'$maxKey': 1}", "s1", "1")
+
+/* after [100, MaxKey) is split off and moved to s0 */
+#define TEST_CHUNKS_V2 \
+   TEST_CHUNK ("{'$minKey': 1}", "0", "s0", "0") ", " \
+   TEST_CHUNK ("0", "100", "s1", "2") ", " \
+   TEST_CHUNK ("100", "{'$maxKey': 1}", "s0", "3")
+#define TEST_NEWEST_V2 TEST_CHUNK ("100", "{'$maxKey': 1}", "s0", "3")
+
+
+typedef struct
+{
+   uint16_t  port;
+   bson_t   *documents;
+} shard_map_batch_t;
+
+
+/* both mock mongos share this, each answers on its own thread */
+typedef struct
+{
+   mongoc_mutex_t  mutex;
+   bool            moved;             /* serve TEST_CHUNKS_V2 */
+   int             n_loads;           /* full reads of config.chunks */
+   int             n_checks;          /* reads of the newest chunk only */
+   mongoc_array_t  batches;           /* shard_map_batch_t */
+} shard_map_test_t;
+
+
+static void
+_shard_map_test_clear_batches (shard_map_test_t *test)
+{
+   size_t i;
+
+   mongoc_mutex_lock (&test->mutex);
+   for (i = 0; i < test->batches.len; i++) {
+      bson_destroy (_mongoc_array_index (&test->batches, shard_map_batch_t,
+                                         i).documents);
+   }
+
+   test->batches.len = 0;
+   mongoc_mutex_unlock (&test->mutex);
+}
+
+
+/* play the config servers, and the shards behind each mongos. an insert
+ * fails for each document with "dup": true, at its index in the batch */
+static bool
+shard_map_responder (request_t *request,
+                     void      *data)
+{
+   shard_map_test_t *test = (shard_map_test_t *) data;
+   const bson_t *cmd;
+   const char *coll;
+   bson_iter_t iter;
+   bson_iter_t docs;
+   bson_string_t *reply;
+   shard_map_batch_t batch;
+   int n = 0;
+   int n_errors = 0;
+
+   if (!request->is_command) {
+      return false;
+   }
+
+   cmd = request_get_doc (request, 0);
+   reply = bson_string_new (NULL);
+
+   mongoc_mutex_lock (&test->mutex);
+
+   if (!strcmp (request->command_name, "find")) {
+      coll = bson_lookup_utf8 (cmd, "find");
+      if (!strcmp (coll, "collections")) {
+         bson_string_append (
+            reply, "{'ok': 1, 'cursor': {'id': 0, 'ns': 'config.collections',"
+            " 'firstBatch': [{'_id': 'db.coll', 'key': {'x': 1}}]}}");
+      } else {
+         ASSERT_CMPSTR (coll, "chunks");
+         bson_string_append (reply, "{'ok': 1, 'cursor': {'id': 0,"
+                             " 'ns': 'config.chunks', 'firstBatch': [");
+         if (bson_has_field (cmd, "projection")) {
+            /* _mongoc_shard_map_is_current */
+            test->n_checks++;
+            bson_string_append (reply, test->moved ? TEST_NEWEST_V2
+                                                   : TEST_NEWEST_V1);
+         } else {
+            test->n_loads++;
+            bson_string_append (reply, test->moved ? TEST_CHUNKS_V2
+                                                   : TEST_CHUNKS_V1);
+         }
+
+         bson_string_append (reply, "]}}");
+      }
+   } else if (!strcmp (request->command_name, "insert")) {
+      ASSERT_CMPSTR (bson_lookup_utf8 (cmd, "insert"), "coll");
+      BSON_ASSERT (bson_iter_init_find (&iter, cmd, "documents"));
+
+      batch.port = request_get_server_port (request);
+      batch.documents = bson_new ();
+      bson_iter_bson (&iter, batch.documents);
+      _mongoc_array_append_val (&test->batches, batch);
+
+      bson_string_append (reply, "{'ok': 1, 'writeErrors': [");
+      BSON_ASSERT (bson_iter_recurse (&iter, &docs));
+      while (bson_iter_next (&docs)) {
+         BSON_ASSERT (bson_iter_recurse (&docs, &iter));
+         if (bson_iter_find (&iter, "dup")) {
+            bson_string_append_printf (
+               reply, "%s{'index': %d, 'code': 11000,"
+               " 'errmsg': 'duplicate key'}", n_errors ? ", " : "", n);
+            n_errors++;
+         }
+
+         n++;
+      }
+
+      bson_string_append_printf (reply, "], 'n': %d}", n - n_errors);
+   } else {
+      mongoc_mutex_unlock (&test->mutex);
+      bson_string_free (reply, true);
+      return false;
+   }
+
+   mongoc_mutex_unlock (&test->mutex);
+
+   mock_server_replies_simple (request, reply->str);
+   bson_string_free (reply, true);
+   request_destroy (request);
+
+   return true;
+}
+
+
+/* the index of the batch that inserted {_id: @id} */
+static int
+_shard_map_test_batch_of (shard_map_test_t *test,
+                          int32_t           id)
+{
+   shard_map_batch_t *batch;
+   bson_iter_t iter;
+   bson_iter_t doc;
+   size_t i;
+
+   for (i = 0; i < test->batches.len; i++) {
+      batch = &_mongoc_array_index (&test->batches, shard_map_batch_t, i);
+      BSON_ASSERT (bson_iter_init (&iter, batch->documents));
+      while (bson_iter_next (&iter)) {
+         BSON_ASSERT (bson_iter_recurse (&iter, &doc));
+         if (bson_iter_find (&doc, "_id") && bson_iter_int32 (&doc) == id) {
+            return (int) i;
+         }
+      }
+   }
+
+   fprintf (stderr, "no batch inserted {_id: %d}\n", id);
+   abort ();
+}
+
+
+static uint16_t
+_shard_map_test_port_of (shard_map_test_t *test,
+                         int32_t           id)
+{
+   return _mongoc_array_index (&test->batches, shard_map_batch_t,
+                               _shard_map_test_batch_of (test, id)).port;
+}
+
+
+/* insert {_id: 0, x: -1}, {_id: 1, x: 5}, {_id: 2, x: -2}, {_id: 3, x: 150}
+ * and {_id: 4, x: 7}. the inserts of _id 2 and 3 fail */
+static void
+_shard_map_test_bulk (mongoc_collection_t *collection,
+                      shard_map_test_t    *test)
+{
+   mongoc_bulk_operation_t *bulk;
+   bson_t reply;
+   bson_error_t error;
+   bson_iter_t iter;
+   bson_iter_t errors;
+   bool failed[5] = { false };
+
+   _shard_map_test_clear_batches (test);
+
+   bulk = mongoc_collection_create_bulk_operation (collection, false, NULL);
+   mongoc_bulk_operation_set_shard_aware (bulk, true);
+   mongoc_bulk_operation_insert (bulk, tmp_bson ("{'_id': 0, 'x': -1}"));
+   mongoc_bulk_operation_insert (bulk, tmp_bson ("{'_id': 1, 'x': 5}"));
+   mongoc_bulk_operation_insert (bulk,
+                                 tmp_bson ("{'_id': 2, 'x': -2, 'dup': 1}"));
+   mongoc_bulk_operation_insert (bulk,
+                                 tmp_bson ("{'_id': 3, 'x': 150, 'dup': 1}"));
+   mongoc_bulk_operation_insert (bulk, tmp_bson ("{'_id': 4, 'x': 7}"));
+
+   BSON_ASSERT (!mongoc_bulk_operation_execute (bulk, &reply, &error));
+   ASSERT_ERROR_CONTAINS (error, MONGOC_ERROR_COMMAND, 11000,
+                          "duplicate key");
+   ASSERT_CMPINT32 (bson_lookup_int32 (&reply, "nInserted"), ==, 3);
+
+   /* each shard's errors are at its batch's indexes, the reply has the
+    * caller's */
+   BSON_ASSERT (bson_iter_init_find (&iter, &reply, "writeErrors"));
+   BSON_ASSERT (bson_iter_recurse (&iter, &errors));
+   while (bson_iter_next (&errors)) {
+      BSON_ASSERT (bson_iter_recurse (&errors, &iter));
+      BSON_ASSERT (bson_iter_find (&iter, "index"));
+      ASSERT_CMPINT32 (bson_iter_int32 (&iter), >=, 0);
+      ASSERT_CMPINT32 (bson_iter_int32 (&iter), <, 5);
+      BSON_ASSERT (!failed[bson_iter_int32 (&iter)]);
+      failed[bson_iter_int32 (&iter)] = true;
+   }
+
+   BSON_ASSERT (!failed[0] && !failed[1] && failed[2] && failed[3] &&
+                !failed[4]);
+
+   bson_destroy (&reply);
+   mongoc_bulk_operation_destroy (bulk);
+}
+
+
+static void
+test_shard_map_bulk (void)
+{
+   shard_map_test_t test;
+   mock_server_t *servers[2];
+   mongoc_uri_t *uri;
+   char *uri_str;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   int i;
+
+   memset (&test, 0, sizeof test);
+   mongoc_mutex_init (&test.mutex);
+   _mongoc_array_init (&test.batches, sizeof (shard_map_batch_t));
+
+   for (i = 0; i < 2; i++) {
+      servers[i] = mock_mongos_new (WIRE_VERSION_MAX);
+      mock_server_autoresponds (servers[i], shard_map_responder, &test, NULL);
+      mock_server_run (servers[i]);
+   }
+
+   uri_str = bson_strdup_printf ("mongodb://%s,%s",
+                                 mock_server_get_host_and_port (servers[0]),
+                                 mock_server_get_host_and_port (servers[1]));
+   uri = mongoc_uri_new (uri_str);
+   client = mongoc_client_new_from_uri (uri);
+   collection = mongoc_client_get_collection (client, "db", "coll");
+
+   /* the first bulk loads the map, each shard's writes are one batch and
+    * the two shards' batches go through different mongos */
+   _shard_map_test_bulk (collection, &test);
+   ASSERT_CMPINT (test.n_loads, ==, 1);
+   ASSERT_CMPINT (test.n_checks, ==, 0);
+   ASSERT_CMPINT ((int) test.batches.len, ==, 2);
+   ASSERT_CMPINT (_shard_map_test_batch_of (&test, 0), ==,
+                  _shard_map_test_batch_of (&test, 2));
+   ASSERT_CMPINT (_shard_map_test_batch_of (&test, 1), ==,
+                  _shard_map_test_batch_of (&test, 3));
+   ASSERT_CMPINT (_shard_map_test_batch_of (&test, 1), ==,
+                  _shard_map_test_batch_of (&test, 4));
+   ASSERT_CMPINT (_shard_map_test_port_of (&test, 0), !=,
+                  _shard_map_test_port_of (&test, 1));
+
+   /* [100, MaxKey) moves to s0, we don't notice until the map is checked */
+   mongoc_mutex_lock (&test.mutex);
+   test.moved = true;
+   mongoc_mutex_unlock (&test.mutex);
+
+   _shard_map_test_bulk (collection, &test);
+   ASSERT_CMPINT (test.n_loads, ==, 1);
+   ASSERT_CMPINT (test.n_checks, ==, 0);
+   ASSERT_CMPINT (_shard_map_test_batch_of (&test, 1), ==,
+                  _shard_map_test_batch_of (&test, 3));
+
+   /* after the check interval the newest chunk's version changed, reload */
+   client->shard_maps->checked_at -= MONGOC_SHARD_MAP_CHECK_INTERVAL_MS * 1000;
+
+   _shard_map_test_bulk (collection, &test);
+   ASSERT_CMPINT (test.n_loads, ==, 2);
+   ASSERT_CMPINT (test.n_checks, ==, 1);
+   ASSERT_CMPINT ((int) test.batches.len, ==, 2);
+   ASSERT_CMPINT (_shard_map_test_batch_of (&test, 0), ==,
+                  _shard_map_test_batch_of (&test, 2));
+   ASSERT_CMPINT (_shard_map_test_batch_of (&test, 0), ==,
+                  _shard_map_test_batch_of (&test, 3));
+   ASSERT_CMPINT (_shard_map_test_batch_of (&test, 1), ==,
+                  _shard_map_test_batch_of (&test, 4));
+   ASSERT_CMPINT (_shard_map_test_port_of (&test, 0), !=,
+                  _shard_map_test_port_of (&test, 1));
+
+   /* no change since, the check keeps the map */
+   client->shard_maps->checked_at -= MONGOC_SHARD_MAP_CHECK_INTERVAL_MS * 1000;
+
+   _shard_map_test_bulk (collection, &test);
+   ASSERT_CMPINT (test.n_loads, ==, 2);
+   ASSERT_CMPINT (test.n_checks, ==, 2);
+   ASSERT_CMPINT (_shard_map_test_batch_of (&test, 0), ==,
+                  _shard_map_test_batch_of (&test, 3));
+
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mongoc_uri_destroy (uri);
+   bson_free (uri_str);
+
+   for (i = 0; i < 2; i++) {
+      mock_server_destroy (servers[i]);
+   }
+
+   _shard_map_test_clear_batches (&test);
+   _mongoc_array_destroy (&test.batches);
+   mongoc_mutex_destroy (&test.mutex);
+}
+
+
+void
+test_shard_map_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/ShardMap/route", test_shard_map_route);
+   TestSuite_Add (suite, "/ShardMap/unroutable", test_shard_map_unroutable);
+   TestSuite_Add (suite, "/ShardMap/partition", test_shard_map_partition);
+   TestSuite_Add (suite, "/ShardMap/bulk", test_shard_map_bulk);
+}
@@ -0,0 +1,229 @@
+#include <mongoc.h>
+#include <mongoc-slow-op-private.h>
+#include <mongoc-util-private.h>
+
+#include "TestSuite.h"
+#include "test-conveniences.h"
+#include "test-libmongoc.h"
+#include "mock_server/mock-server.h"
+#include "mock_server/future.h"
+#include "mock_server/future-functions.h"
+
+
+typedef struct
+{
+   int              n_ops;
+   mongoc_slow_op_t last;
+} slow_op_test_t;
+
+
+static void
+test_slow_op_cb (const mongoc_slow_op_t *op,
+                 void                   *context)
+{
+   slow_op_test_t *test = (slow_op_test_t *) context;
+
+   memcpy (&test->last, op, sizeof test->last);
+   test->n_ops++;
+}
+
+
+static void
+drain_all (void)
+{
+   slow_op_test_t test = { 0 };
+
+   mongoc_slow_ops_drain (test_slow_op_cb, &test);
+}
+
+
+static mongoc_client_t *
+slow_op_client (mock_server_t *server,
+                int32_t        threshold_ms)
+{
+   mongoc_client_t *client;
+   mongoc_uri_t *uri;
+
+   uri = mongoc_uri_copy (mock_server_get_uri (server));
+   mongoc_uri_set_option_as_int32 (uri, "slowOpThresholdMS", threshold_ms);
+   client = mongoc_client_new_from_uri (uri);
+   mongoc_uri_destroy (uri);
+
+   return client;
+}
+
+
+static void
+assert_shape (const char *command_json,
+              const char *expected)
+{
+   bson_string_t *shape = bson_string_new (NULL);
+
+   _mongoc_slow_op_shape (tmp_bson (command_json), shape);
+   ASSERT_CMPSTR (shape->str, expected);
+   bson_string_free (shape, true);
+}
+
+
+static void
+test_slow_op_shape (void)
+{
+   assert_shape ("{'find': 'coll', 'filter': {'a': 1, 'b': {'$in': [1, 2]}},"
+                 " 'limit': 1}",
+                 "{ \"find\" : \"coll\", \"filter\" : { \"a\" : \"?\", "
+                 "\"b\" : { \"$in\" : [ \"?\", ... ] } }, \"limit\" : \"?\" }");
+
+   assert_shape ("{'insert': 'coll', 'documents': [{'_id': 1}]}",
+                 "{ \"insert\" : \"coll\", "
+                 "\"documents\" : [ { \"_id\" : \"?\" } ] }");
+
+   assert_shape ("{'ping': 1, 'empty': {}, 'none': []}",
+                 "{ \"ping\" : \"?\", \"empty\" : { }, \"none\" : [ ] }");
+
+   /* even the first value of a sensitive command is redacted */
+   assert_shape ("{'saslStart': 'secret', 'payload': 'secret'}",
+                 "{ \"saslStart\" : \"?\", \"payload\" : \"?\" }");
+}
+
+
+static void
+test_slow_op_command (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   future_t *future;
+   request_t *request;
+   slow_op_test_t test = { 0 };
+   int64_t usec;
+
+   drain_all ();
+
+   server = mock_server_with_autoismaster (0);
+   mock_server_run (server);
+   client = slow_op_client (server, 10);
+
+   future = future_client_command_simple (client, "db",
+                                          tmp_bson ("{'count': 'coll', "
+                                                    "'query': {'a': 1}}"),
+                                          NULL, NULL, NULL);
+   request = mock_server_receives_command (server, "db", MONGOC_QUERY_SLAVE_OK,
+                                           "{'count': 'coll'}");
+   _mongoc_usleep (20 * 1000);
+   mock_server_replies_simple (request, "{'ok': 1, 'n': 1}");
+   ASSERT (future_get_bool (future));
+   future_destroy (future);
+   request_destroy (request);
+
+   ASSERT_CMPSIZE_T (mongoc_slow_ops_drain (test_slow_op_cb, &test), ==,
+                     (size_t) 1);
+   ASSERT_CMPINT64 (mongoc_slow_op_get_duration (&test.last), >=,
+                    (int64_t) 10 * 1000);
+   ASSERT_CMPSTR (mongoc_slow_op_get_command_name (&test.last), "count");
+   ASSERT_CMPSTR (mongoc_slow_op_get_database_name (&test.last), "db");
+   ASSERT_CMPSTR (mongoc_slow_op_get_host (&test.last),
+                  mock_server_get_host_and_port (server));
+   ASSERT_CMPSTR (mongoc_slow_op_get_shape (&test.last),
+                  "{ \"count\" : \"coll\", \"query\" : { \"a\" : \"?\" } }");
+   ASSERT_CMPINT64 (mongoc_slow_op_get_reply_size (&test.last), >,
+                    (int64_t) 0);
+   ASSERT (mongoc_slow_op_get_succeeded (&test.last));
+   ASSERT (mongoc_slow_op_get_phase (&test.last,
+                                     MONGOC_SPAN_SERVER_SELECTION, &usec));
+
+   /* drained */
+   ASSERT_CMPSIZE_T (mongoc_slow_ops_drain (test_slow_op_cb, &test), ==,
+                     (size_t) 0);
+
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+static void
+test_slow_op_fast (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   future_t *future;
+   request_t *request;
+   slow_op_test_t test = { 0 };
+
+   drain_all ();
+
+   server = mock_server_with_autoismaster (0);
+   mock_server_run (server);
+   client = slow_op_client (server, 10 * 1000);
+
+   future = future_client_command_simple (client, "db",
+                                          tmp_bson ("{'ping': 1}"),
+                                          NULL, NULL, NULL);
+   request = mock_server_receives_command (server, "db", MONGOC_QUERY_SLAVE_OK,
+                                           "{'ping': 1}");
+   mock_server_replies_simple (request, "{'ok': 1}");
+   ASSERT (future_get_bool (future));
+   future_destroy (future);
+   request_destroy (request);
+
+   ASSERT_CMPSIZE_T (mongoc_slow_ops_drain (test_slow_op_cb, &test), ==,
+                     (size_t) 0);
+
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+static void
+test_slow_op_legacy_query (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_cursor_t *cursor;
+   const bson_t *doc;
+   future_t *future;
+   request_t *request;
+   slow_op_test_t test = { 0 };
+
+   drain_all ();
+
+   server = mock_server_with_autoismaster (0);
+   mock_server_run (server);
+   client = slow_op_client (server, 10);
+   collection = mongoc_client_get_collection (client, "db", "coll");
+   cursor = mongoc_collection_find_with_opts (collection,
+                                              tmp_bson ("{'a': 1}"),
+                                              NULL, NULL);
+
+   future = future_cursor_next (cursor, &doc);
+   request = mock_server_receives_query (server, "db.coll",
+                                         MONGOC_QUERY_SLAVE_OK, 0, 0,
+                                         "{'a': 1}", NULL);
+   _mongoc_usleep (20 * 1000);
+   mock_server_replies_simple (request, "{'a': 1}");
+   ASSERT (future_get_bool (future));
+   future_destroy (future);
+   request_destroy (request);
+
+   ASSERT_CMPSIZE_T (mongoc_slow_ops_drain (test_slow_op_cb, &test), ==,
+                     (size_t) 1);
+   ASSERT_CMPSTR (mongoc_slow_op_get_command_name (&test.last), "find");
+   ASSERT_CMPSTR (mongoc_slow_op_get_database_name (&test.last), "db");
+   ASSERT_CMPSTR (mongoc_slow_op_get_shape (&test.last),
+                  "{ \"find\" : \"coll\", \"filter\" : { \"a\" : \"?\" } }");
+   ASSERT (mongoc_slow_op_get_succeeded (&test.last));
+
+   mongoc_cursor_destroy (cursor);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+void
+test_slow_op_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/SlowOp/shape", test_slow_op_shape);
+   TestSuite_Add (suite, "/SlowOp/command", test_slow_op_command);
+   TestSuite_Add (suite, "/SlowOp/fast", test_slow_op_fast);
+   TestSuite_Add (suite, "/SlowOp/legacy_query", test_slow_op_legacy_query);
+}
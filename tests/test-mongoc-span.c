@@ -0,0 +1,206 @@
+#include <mongoc.h>
+#include <mongoc-span-private.h>
+
+#include "TestSuite.h"
+#include "test-conveniences.h"
+#include "test-libmongoc.h"
+#include "mock_server/mock-server.h"
+#include "mock_server/future.h"
+#include "mock_server/future-functions.h"
+
+
+typedef struct
+{
+   int            n_spans;
+   mongoc_span_t  last;
+   bson_string_t *trace;
+} span_test_t;
+
+
+static void
+test_span_cb (const mongoc_span_t *span,
+              void                *context)
+{
+   span_test_t *test = (span_test_t *) context;
+   char *json;
+
+   json = mongoc_span_as_chrome_trace (span, NULL);
+   if (test->n_spans) {
+      bson_string_append (test->trace, ",");
+   }
+
+   bson_string_append (test->trace, json);
+   bson_free (json);
+
+   memcpy (&test->last, span, sizeof test->last);
+   test->n_spans++;
+}
+
+
+static void
+run_command (mock_server_t   *server,
+             mongoc_client_t *client)
+{
+   future_t *future;
+   request_t *request;
+
+   future = future_client_command_simple (client, "db",
+                                          tmp_bson ("{'foo': 1}"),
+                                          NULL, NULL, NULL);
+   request = mock_server_receives_command (server, "db", MONGOC_QUERY_SLAVE_OK,
+                                           "{'foo': 1}");
+   mock_server_replies_simple (request, "{'ok': 1}");
+   ASSERT (future_get_bool (future));
+
+   future_destroy (future);
+   request_destroy (request);
+}
+
+
+static void
+assert_phase (const mongoc_span_t *span,
+              mongoc_span_phase_t  phase)
+{
+   int64_t start;
+   int64_t end;
+
+   if (!mongoc_span_get_phase (span, phase, &start, &end)) {
+      test_error ("no \"%s\" phase", mongoc_span_phase_name (phase));
+   }
+
+   ASSERT_CMPINT64 (start, >, (int64_t) 0);
+   ASSERT_CMPINT64 (start, <=, end);
+}
+
+
+static void
+_test_span (bool pooled)
+{
+   mock_server_t *server;
+   mongoc_client_pool_t *pool = NULL;
+   mongoc_client_t *client;
+   span_test_t test = { 0 };
+   const mongoc_span_t *span = &test.last;
+   char *json;
+   bson_t *trace;
+   bson_iter_t iter;
+   bson_iter_t event_iter;
+   uint32_t len;
+   const uint8_t *data;
+   bson_t event;
+   bson_error_t error;
+
+   test.trace = bson_string_new (NULL);
+   server = mock_server_with_autoismaster (0);
+   mock_server_run (server);
+
+   if (pooled) {
+      pool = mongoc_client_pool_new (mock_server_get_uri (server));
+      ASSERT (mongoc_client_pool_set_span_cb (pool, test_span_cb,
+                                              (void *) &test, 1.0));
+      client = mongoc_client_pool_pop (pool);
+   } else {
+      client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+      ASSERT (mongoc_client_set_span_cb (client, test_span_cb,
+                                         (void *) &test, 1.0));
+   }
+
+   run_command (server, client);
+   ASSERT_CMPINT (test.n_spans, ==, 1);
+   ASSERT_CMPSTR (mongoc_span_get_command_name (span), "foo");
+   ASSERT_CMPSTR (mongoc_span_get_database_name (span), "db");
+   ASSERT (mongoc_span_get_succeeded (span));
+   ASSERT_CMPINT64 (mongoc_span_get_request_id (span), >, (int64_t) 0);
+   ASSERT_CMPINT64 (mongoc_span_get_operation_id (span), !=, (int64_t) 0);
+   ASSERT_CMPUINT32 (mongoc_span_get_server_id (span), ==, (uint32_t) 1);
+
+   assert_phase (span, MONGOC_SPAN_SERVER_SELECTION);
+   assert_phase (span, MONGOC_SPAN_SEND);
+   assert_phase (span, MONGOC_SPAN_SERVER);
+   assert_phase (span, MONGOC_SPAN_RECV);
+   ASSERT (pooled == mongoc_span_get_phase (span, MONGOC_SPAN_POOL_CHECKOUT,
+                                            NULL, NULL));
+
+   /* the next command's span only has its own phases */
+   run_command (server, client);
+   ASSERT_CMPINT (test.n_spans, ==, 2);
+   ASSERT (!mongoc_span_get_phase (span, MONGOC_SPAN_POOL_CHECKOUT,
+                                   NULL, NULL));
+   ASSERT (!mongoc_span_get_phase (span, MONGOC_SPAN_CONNECT, NULL, NULL));
+
+   /* the JSON Object Format of the Chrome trace viewer */
+   json = bson_strdup_printf ("{\"traceEvents\": [%s]}", test.trace->str);
+   trace = bson_new_from_json ((const uint8_t *) json, -1, &error);
+   ASSERT_OR_PRINT (trace, error);
+   ASSERT (bson_iter_init (&iter, trace));
+   ASSERT (bson_iter_find_descendant (&iter, "traceEvents.0", &event_iter));
+   ASSERT (BSON_ITER_HOLDS_DOCUMENT (&event_iter));
+   bson_iter_document (&event_iter, &len, &data);
+   ASSERT (bson_init_static (&event, data, len));
+   ASSERT_MATCH (&event, "{'name': 'foo', 'cat': 'mongoc', 'ph': 'X',"
+                         " 'pid': 1}");
+
+   bson_destroy (trace);
+   bson_free (json);
+
+   if (pooled) {
+      mongoc_client_pool_push (pool, client);
+      mongoc_client_pool_destroy (pool);
+   } else {
+      mongoc_client_destroy (client);
+   }
+
+   mock_server_destroy (server);
+   bson_string_free (test.trace, true);
+}
+
+
+static void
+test_span_single (void)
+{
+   _test_span (false);
+}
+
+
+static void
+test_span_pooled (void)
+{
+   _test_span (true);
+}
+
+
+static void
+test_span_sample_rate (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   span_test_t test = { 0 };
+   int i;
+
+   test.trace = bson_string_new (NULL);
+   server = mock_server_with_autoismaster (0);
+   mock_server_run (server);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   ASSERT (mongoc_client_set_span_cb (client, test_span_cb,
+                                      (void *) &test, 0.25));
+
+   for (i = 0; i < 8; i++) {
+      run_command (server, client);
+   }
+
+   /* the first command, then every fourth */
+   ASSERT_CMPINT (test.n_spans, ==, 2);
+
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+   bson_string_free (test.trace, true);
+}
+
+
+void
+test_span_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/Span/single", test_span_single);
+   TestSuite_Add (suite, "/Span/pooled", test_span_pooled);
+   TestSuite_Add (suite, "/Span/sample_rate", test_span_sample_rate);
+}
@@ -0,0 +1,169 @@
+#include <mongoc.h>
+
+#include "TestSuite.h"
+#include "test-conveniences.h"
+#include "test-libmongoc.h"
+#include "mock_server/mock-server.h"
+#include "mock_server/future.h"
+#include "mock_server/future-functions.h"
+
+
+static mongoc_client_t *
+fault_client (mock_server_t                   *server,
+              const mongoc_stream_fault_opt_t *opt,
+              int32_t                          socket_timeout_ms)
+{
+   mongoc_client_t *client;
+   mongoc_uri_t *uri;
+
+   uri = mongoc_uri_copy (mock_server_get_uri (server));
+   if (socket_timeout_ms) {
+      mongoc_uri_set_option_as_int32 (uri, "socketTimeoutMS",
+                                      socket_timeout_ms);
+   }
+
+   client = mongoc_client_new_from_uri (uri);
+   mongoc_client_set_stream_initiator (client, mongoc_stream_fault_initiator,
+                                       (void *) opt);
+   mongoc_uri_destroy (uri);
+
+   return client;
+}
+
+
+/* run a ping through the mock server, return whether it succeeded */
+static bool
+fault_ping (mock_server_t   *server,
+            mongoc_client_t *client,
+            bson_error_t    *error)
+{
+   future_t *future;
+   request_t *request;
+   bool ret;
+
+   future = future_client_command_simple (client, "db",
+                                          tmp_bson ("{'ping': 1}"),
+                                          NULL, NULL, error);
+   request = mock_server_receives_command (server, "db", MONGOC_QUERY_SLAVE_OK,
+                                           "{'ping': 1}");
+   if (request) {
+      mock_server_replies_simple (request, "{'ok': 1}");
+      request_destroy (request);
+   }
+
+   ret = future_get_bool (future);
+   future_destroy (future);
+
+   return ret;
+}
+
+
+static void
+test_stream_fault_latency (void)
+{
+   mongoc_stream_fault_opt_t opt = { 0 };
+   mock_server_t *server;
+   mongoc_client_t *client;
+   bson_error_t error;
+   int64_t start;
+
+   opt.latency_ms = 100;
+   opt.jitter_ms = 10;
+
+   server = mock_server_with_autoismaster (0);
+   mock_server_run (server);
+   client = fault_client (server, &opt, 0);
+
+   /* the isMaster and the ping each take a round trip */
+   start = bson_get_monotonic_time ();
+   ASSERT_OR_PRINT (fault_ping (server, client, &error), error);
+   ASSERT_CMPINT64 (bson_get_monotonic_time () - start, >=,
+                    (int64_t) 2 * 100 * 1000);
+
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+static void
+test_stream_fault_pieces (void)
+{
+   mongoc_stream_fault_opt_t opt = { 0 };
+   mock_server_t *server;
+   mongoc_client_t *client;
+   bson_error_t error;
+
+   /* messages are sent and received a few bytes at a time */
+   opt.max_read_size = 5;
+   opt.max_write_size = 3;
+
+   server = mock_server_with_autoismaster (0);
+   mock_server_run (server);
+   client = fault_client (server, &opt, 0);
+
+   ASSERT_OR_PRINT (fault_ping (server, client, &error), error);
+   ASSERT_OR_PRINT (fault_ping (server, client, &error), error);
+
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+static void
+test_stream_fault_disconnect (void)
+{
+   mongoc_stream_fault_opt_t opt = { 0 };
+   mock_server_t *server;
+   mongoc_client_t *client;
+   bson_error_t error;
+
+   /* disconnect partway through the isMaster */
+   opt.disconnect_after_bytes = 10;
+
+   server = mock_server_with_autoismaster (0);
+   mock_server_run (server);
+   client = fault_client (server, &opt, 0);
+
+   ASSERT (!mongoc_client_command_simple (client, "db",
+                                          tmp_bson ("{'ping': 1}"),
+                                          NULL, NULL, &error));
+   ASSERT_CMPINT (error.domain, ==, MONGOC_ERROR_SERVER_SELECTION);
+
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+static void
+test_stream_fault_timeout (void)
+{
+   mongoc_stream_fault_opt_t opt = { 0 };
+   mock_server_t *server;
+   mongoc_client_t *client;
+   bson_error_t error;
+
+   /* the isMaster waits out the latency, the ping times out */
+   opt.latency_ms = 500;
+
+   server = mock_server_with_autoismaster (0);
+   mock_server_run (server);
+   client = fault_client (server, &opt, 100);
+
+   ASSERT (!fault_ping (server, client, &error));
+   ASSERT_CMPINT (error.domain, ==, MONGOC_ERROR_STREAM);
+   ASSERT_CMPINT (error.code, ==, MONGOC_ERROR_STREAM_SOCKET);
+
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+void
+test_stream_fault_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/StreamFault/latency", test_stream_fault_latency);
+   TestSuite_Add (suite, "/StreamFault/pieces", test_stream_fault_pieces);
+   TestSuite_Add (suite, "/StreamFault/disconnect",
+                  test_stream_fault_disconnect);
+   TestSuite_Add (suite, "/StreamFault/timeout", test_stream_fault_timeout);
+}
@@ -3,6 +3,10 @@
 
 #ifdef MONGOC_ENABLE_SSL_OPENSSL
 # include <openssl/err.h>
+# include "mongoc-host-list-private.h"
+# include "mongoc-openssl-private.h"
+# include "mongoc-stream-tls-private.h"
+# include "mongoc-stream-tls-openssl-private.h"
 #endif
 
 #include "ssl-test.h"
@@ -378,6 +382,186 @@ test_mongoc_tls_trust_dir (void)
 #endif
 
 
+#if !defined(_WIN32) && defined(MONGOC_ENABLE_SSL_OPENSSL)
+#define SESSION_TEST_TIMEOUT 10000
+
+/* a plain OpenSSL server: OpenSSL only resumes sessions that were
+ * negotiated with the same SSL_CTX, and each server-side mongoc stream
+ * makes its own */
+typedef struct
+{
+   SSL_CTX  *ctx;
+   int       listen_fd;
+   uint16_t  port;
+   int       n_conns;
+   int       n_reused;
+} session_server_t;
+
+
+static void
+session_server_listen (session_server_t *server,
+                       SSL_CTX          *ctx,
+                       int               n_conns)
+{
+   struct sockaddr_in addr = { 0 };
+   socklen_t len = sizeof addr;
+
+   server->ctx = ctx;
+   server->n_conns = n_conns;
+   server->n_reused = 0;
+   server->listen_fd = socket (AF_INET, SOCK_STREAM, 0);
+   ASSERT_CMPINT (server->listen_fd, >=, 0);
+
+   addr.sin_family = AF_INET;
+   addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+   ASSERT_CMPINT (bind (server->listen_fd, (struct sockaddr *) &addr,
+                        sizeof addr), ==, 0);
+   ASSERT_CMPINT (listen (server->listen_fd, 10), ==, 0);
+   ASSERT_CMPINT (getsockname (server->listen_fd, (struct sockaddr *) &addr,
+                               &len), ==, 0);
+
+   server->port = ntohs (addr.sin_port);
+}
+
+
+/* for each connection: handshake, send one byte, and wait for the client
+ * to hang up */
+static void *
+session_server_thread (void *data)
+{
+   session_server_t *server = (session_server_t *) data;
+   SSL *ssl;
+   char buf[1];
+   int fd;
+   int i;
+
+   for (i = 0; i < server->n_conns; i++) {
+      fd = accept (server->listen_fd, NULL, NULL);
+      ASSERT_CMPINT (fd, >=, 0);
+
+      ssl = SSL_new (server->ctx);
+      SSL_set_fd (ssl, fd);
+      ASSERT_CMPINT (SSL_accept (ssl), ==, 1);
+
+      if (SSL_session_reused (ssl)) {
+         server->n_reused++;
+      }
+
+      ASSERT_CMPINT (SSL_write (ssl, "x", 1), ==, 1);
+      while (SSL_read (ssl, buf, sizeof buf) > 0) {}
+
+      SSL_free (ssl);
+      close (fd);
+   }
+
+   close (server->listen_fd);
+
+   return NULL;
+}
+
+
+/* connect a client stream to "localhost:port", return whether it resumed
+ * a session */
+static bool
+session_client_connect (uint16_t          port,
+                        mongoc_ssl_opt_t *copt)
+{
+   mongoc_socket_t *sock;
+   mongoc_stream_t *stream;
+   mongoc_stream_tls_openssl_t *openssl;
+   struct sockaddr_in addr = { 0 };
+   mongoc_host_list_t host;
+   mongoc_iovec_t iov;
+   char host_and_port[32];
+   char buf[1];
+   bson_error_t error;
+   SSL *ssl;
+   bool reused;
+
+   sock = mongoc_socket_new (AF_INET, SOCK_STREAM, 0);
+   ASSERT (sock);
+
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons (port);
+   addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+   ASSERT_CMPINT (mongoc_socket_connect (sock, (struct sockaddr *) &addr,
+                                         sizeof addr, -1), ==, 0);
+
+   stream = mongoc_stream_tls_new_with_hostname (
+      mongoc_stream_socket_new (sock), "localhost", copt, 1);
+   ASSERT (stream);
+
+   bson_snprintf (host_and_port, sizeof host_and_port, "localhost:%hu", port);
+   ASSERT (_mongoc_host_list_from_string (&host, host_and_port));
+   _mongoc_stream_tls_resume_session (stream, &host);
+
+   ASSERT_OR_PRINT (mongoc_stream_tls_handshake_block (
+                       stream, "localhost", SESSION_TEST_TIMEOUT, &error),
+                    error);
+
+   /* with TLS 1.3, session tickets arrive with the first read */
+   iov.iov_base = buf;
+   iov.iov_len = sizeof buf;
+   ASSERT_CMPINT ((int) mongoc_stream_readv (stream, &iov, 1, 1,
+                                             SESSION_TEST_TIMEOUT), ==, 1);
+
+   openssl = (mongoc_stream_tls_openssl_t *)
+      ((mongoc_stream_tls_t *) stream)->ctx;
+   BIO_get_ssl (openssl->bio, &ssl);
+   reused = SSL_session_reused (ssl) ? true : false;
+
+   mongoc_stream_destroy (stream);
+
+   return reused;
+}
+
+
+/* a second connection to a server resumes the first one's session, a
+ * connection to the same host on another port does not */
+static void
+test_mongoc_tls_session_resumption (void)
+{
+   mongoc_ssl_opt_t copt = { 0 };
+   SSL_CTX *ctx;
+   session_server_t server_a;
+   session_server_t server_b;
+   mongoc_thread_t threads[2];
+
+   _mongoc_openssl_session_clear ();
+
+   /* one context for both servers, so either could resume the session */
+   ctx = SSL_CTX_new (SSLv23_server_method ());
+   ASSERT_CMPINT (SSL_CTX_use_certificate_chain_file (ctx, CERT_SERVER),
+                  ==, 1);
+   ASSERT_CMPINT (SSL_CTX_use_PrivateKey_file (ctx, CERT_SERVER,
+                                               SSL_FILETYPE_PEM), ==, 1);
+
+   session_server_listen (&server_a, ctx, 2);
+   session_server_listen (&server_b, ctx, 2);
+   ASSERT_CMPINT (mongoc_thread_create (&threads[0], session_server_thread,
+                                        &server_a), ==, 0);
+   ASSERT_CMPINT (mongoc_thread_create (&threads[1], session_server_thread,
+                                        &server_b), ==, 0);
+
+   copt.ca_file = CERT_CA;
+
+   ASSERT (!session_client_connect (server_a.port, &copt));
+   ASSERT (session_client_connect (server_a.port, &copt));
+   ASSERT (!session_client_connect (server_b.port, &copt));
+   ASSERT (session_client_connect (server_b.port, &copt));
+
+   mongoc_thread_join (threads[0]);
+   mongoc_thread_join (threads[1]);
+
+   ASSERT_CMPINT (server_a.n_reused, ==, 1);
+   ASSERT_CMPINT (server_b.n_reused, ==, 1);
+
+   SSL_CTX_free (ctx);
+   _mongoc_openssl_session_clear ();
+}
+#endif
+
+
 void
 test_stream_tls_install (TestSuite *suite)
 {
@@ -404,5 +588,10 @@ test_stream_tls_install (TestSuite *suite)
 #if !defined(__APPLE__) && !defined(_WIN32) && defined(MONGOC_ENABLE_SSL_OPENSSL)
    TestSuite_Add (suite, "/TLS/trust_dir", test_mongoc_tls_trust_dir);
 #endif
+
+#if !defined(_WIN32) && defined(MONGOC_ENABLE_SSL_OPENSSL)
+   TestSuite_Add (suite, "/TLS/session_resumption",
+                  test_mongoc_tls_session_resumption);
+#endif
 #endif
 }
@@ -139,6 +139,94 @@ test_get_servers (void)
 }
 
 
+static mongoc_server_description_t *
+_select_last (mongoc_server_description_t **candidates,
+              size_t                        n_candidates,
+              void                         *context)
+{
+   *(size_t *) context = n_candidates;
+
+   return candidates[n_candidates - 1];
+}
+
+
+static void
+test_selection_policy (void)
+{
+   mongoc_uri_t *uri;
+   mongoc_topology_t *topology;
+   mongoc_topology_description_t *td;
+   mongoc_server_description_t *sd_a;
+   mongoc_server_description_t *sd_b;
+   mongoc_server_description_t *selected;
+   size_t n_candidates = 0;
+   int i;
+
+   uri = mongoc_uri_new ("mongodb://a,b");
+   topology = mongoc_topology_new (uri, true /* single-threaded */);
+   td = &topology->description;
+
+   sd_a = _sd_for_host (td, "a");
+   mongoc_topology_description_handle_ismaster (
+      td, sd_a->id, tmp_bson ("{'ok': 1, 'msg': 'isdbgrid'}"), 10, NULL);
+
+   sd_b = _sd_for_host (td, "b");
+   mongoc_topology_description_handle_ismaster (
+      td, sd_b->id, tmp_bson ("{'ok': 1, 'msg': 'isdbgrid'}"), 10, NULL);
+
+   /* custom policy sees both servers in the latency window */
+   mongoc_topology_set_server_selection_policy (topology, _select_last,
+                                                &n_candidates);
+   ASSERT (topology->track_server_load);
+   selected = mongoc_topology_description_select (td, MONGOC_SS_READ, NULL,
+                                                  15);
+   ASSERT_CMPSIZE_T (n_candidates, ==, (size_t) 2);
+   ASSERT (selected);
+
+   /* "a" is busy and slow, "b" is idle and fast */
+   mongoc_topology_set_server_selection_policy (
+      topology, mongoc_server_selection_policy_power_of_two, NULL);
+
+   for (i = 0; i < 10; i++) {
+      mongoc_topology_op_started (topology, sd_a->id);
+      mongoc_topology_op_started (topology, sd_b->id);
+      mongoc_topology_op_finished (topology, sd_b->id, 100, true);
+   }
+
+   mongoc_topology_op_finished (topology, sd_a->id, 50 * 1000, true);
+
+   ASSERT_CMPINT (mongoc_server_description_in_flight (sd_a), ==, 9);
+   ASSERT_CMPINT (mongoc_server_description_in_flight (sd_b), ==, 0);
+   ASSERT_CMPINT64 (mongoc_server_description_latency_p50 (sd_a), ==,
+                    (int64_t) 50 * 1000);
+   ASSERT_CMPINT64 (mongoc_server_description_latency_p99 (sd_b), ==,
+                    (int64_t) 100);
+
+   /* with two candidates the policy always compares both */
+   for (i = 0; i < 100; i++) {
+      selected = mongoc_topology_description_select (td, MONGOC_SS_READ,
+                                                     NULL, 15);
+      ASSERT_CMPSTR (selected->host.host, "b");
+   }
+
+   /* percentiles sorted from an older copy of the samples are dropped */
+   mongoc_server_description_set_load_percentiles (sd_b, 1, 1, 1);
+   ASSERT_CMPINT64 (mongoc_server_description_latency_p50 (sd_b), ==,
+                    (int64_t) 100);
+   mongoc_server_description_set_load_percentiles (sd_b, 200, 200, 11);
+   ASSERT_CMPINT64 (mongoc_server_description_latency_p50 (sd_b), ==,
+                    (int64_t) 200);
+
+   /* stats survive copying the description */
+   selected = mongoc_server_description_new_copy (sd_a);
+   ASSERT_CMPINT (mongoc_server_description_in_flight (selected), ==, 9);
+   mongoc_server_description_destroy (selected);
+
+   mongoc_topology_destroy (topology);
+   mongoc_uri_destroy (uri);
+}
+
+
 void
 test_topology_description_install (TestSuite *suite)
 {
@@ -148,4 +236,6 @@ test_topology_description_install (TestSuite *suite)
                       test_has_readable_writable_server_pooled);
    TestSuite_Add (suite, "/TopologyDescription/get_servers",
                   test_get_servers);
+   TestSuite_Add (suite, "/TopologyDescription/selection_policy",
+                  test_selection_policy);
 }
@@ -2,6 +2,8 @@
 
 #include "mongoc-util-private.h"
 #include "mongoc-client-private.h"
+#include "mongoc-dns-cache-private.h"
+#include "mongoc-host-list-private.h"
 
 #include "TestSuite.h"
 #include "mock_server/mock-server.h"
@@ -9,6 +11,7 @@
 #include "mock_server/future.h"
 #include "mock_server/future-functions.h"
 #include "test-conveniences.h"
+#include "test-libmongoc.h"
 
 #undef MONGOC_LOG_DOMAIN
 #define MONGOC_LOG_DOMAIN "topology-scanner-test"
@@ -401,6 +404,421 @@ test_topology_scanner_blocking_initiator (void)
 }
 
 
+typedef struct
+{
+   mongoc_mutex_t mutex;
+   bool           hang;
+   int            n_plain;
+   int            n_awaitable;
+} streaming_test_t;
+
+
+static bool
+_streaming_ismaster (request_t *request,
+                     void      *data)
+{
+   streaming_test_t *test = (streaming_test_t *) data;
+   const bson_t *cmd;
+   bool awaitable;
+
+   if (!request->is_command || strcasecmp (request->command_name, "ismaster")) {
+      return false;
+   }
+
+   cmd = request_get_doc (request, 0);
+   awaitable = bson_has_field (cmd, "topologyVersion");
+
+   mongoc_mutex_lock (&test->mutex);
+   if (awaitable) {
+      test->n_awaitable++;
+   } else {
+      test->n_plain++;
+   }
+   mongoc_mutex_unlock (&test->mutex);
+
+   if (awaitable) {
+      ASSERT_CMPINT64 (bson_lookup_int64 (cmd, "maxAwaitTimeMS"), ==,
+                       (int64_t) 10000);
+
+      if (test->hang) {
+         /* the server's state never changes */
+         request_destroy (request);
+         return true;
+      }
+
+      /* the server's state changes every 50ms */
+      _mongoc_usleep (50 * 1000);
+   }
+
+   mock_server_replies_simple (request,
+                               "{'ok': 1, 'ismaster': true,"
+                               " 'topologyVersion': {'counter': 1}}");
+   request_destroy (request);
+   return true;
+}
+
+
+static void
+_streaming_scanner_cb (uint32_t            id,
+                       const bson_t       *bson,
+                       int64_t             rtt_msec,
+                       void               *data,
+                       const bson_error_t *error /* IN */)
+{
+   ASSERT_OR_PRINT (bson, (*error));
+   ((int *) data)[id]++;
+}
+
+
+/* once a server reports a topologyVersion, the scanner sends it awaitable
+ * ismasters and measures rtt with plain ismasters on a second connection.
+ * each server's next awaitable ismaster is sent as soon as it replies,
+ * even while another server's is still awaited */
+static void
+test_topology_scanner_streaming (void)
+{
+   mock_server_t *fast;
+   mock_server_t *slow;
+   mongoc_topology_scanner_t *ts;
+   streaming_test_t fast_test = { 0 };
+   streaming_test_t slow_test = { 0 };
+   int n_replies[3] = { 0 };
+
+   mongoc_mutex_init (&fast_test.mutex);
+   mongoc_mutex_init (&slow_test.mutex);
+   slow_test.hang = true;
+
+   fast = mock_server_new ();
+   mock_server_autoresponds (fast, _streaming_ismaster, &fast_test, NULL);
+   mock_server_run (fast);
+
+   slow = mock_server_new ();
+   mock_server_autoresponds (slow, _streaming_ismaster, &slow_test, NULL);
+   mock_server_run (slow);
+
+   ts = mongoc_topology_scanner_new (NULL, NULL, &_streaming_scanner_cb,
+                                     n_replies);
+   mongoc_topology_scanner_set_max_await_time (ts, 10000);
+   mongoc_topology_scanner_add (ts,
+                                mongoc_uri_get_hosts (mock_server_get_uri (fast)),
+                                1);
+   mongoc_topology_scanner_add (ts,
+                                mongoc_uri_get_hosts (mock_server_get_uri (slow)),
+                                2);
+
+   ASSERT (!mongoc_topology_scanner_is_streaming (ts));
+
+   /* the plain checks, then at least half a second of awaited replies */
+   mongoc_topology_scanner_start (ts, TIMEOUT, false);
+   mongoc_topology_scanner_work (ts, TIMEOUT);
+   ASSERT (mongoc_topology_scanner_is_streaming (ts));
+
+   mongoc_mutex_lock (&slow_test.mutex);
+   ASSERT_CMPINT (slow_test.n_awaitable, ==, 1);
+   mongoc_mutex_unlock (&slow_test.mutex);
+   ASSERT_CMPINT (n_replies[2], ==, 1);
+
+   mongoc_mutex_lock (&fast_test.mutex);
+   ASSERT_CMPINT (fast_test.n_awaitable, >=, 3);
+   /* the first check and at least one rtt probe */
+   ASSERT_CMPINT (fast_test.n_plain, >=, 2);
+   /* rtt probes' replies aren't passed to the scanner callback */
+   ASSERT_CMPINT (n_replies[1], >=, 3);
+   ASSERT_CMPINT (n_replies[1], <=, fast_test.n_awaitable + 1);
+   mongoc_mutex_unlock (&fast_test.mutex);
+
+   /* nodes awaiting a reply aren't checked again */
+   mongoc_topology_scanner_start (ts, TIMEOUT, false);
+   mongoc_mutex_lock (&slow_test.mutex);
+   ASSERT_CMPINT (slow_test.n_awaitable, ==, 1);
+   mongoc_mutex_unlock (&slow_test.mutex);
+
+   mongoc_topology_scanner_destroy (ts);
+   mock_server_destroy (fast);
+   mock_server_destroy (slow);
+   mongoc_mutex_destroy (&fast_test.mutex);
+   mongoc_mutex_destroy (&slow_test.mutex);
+}
+
+
+typedef struct
+{
+   struct sockaddr_storage addrs[2];
+   socklen_t               addrlens[2];
+   int                     n_addrs;
+   int                     n_calls;
+} fake_resolver_t;
+
+
+/* resolve any name to the fake's addresses, ignoring the port */
+static struct addrinfo *
+fake_resolve (const mongoc_host_list_t *host,
+              void                     *ctx,
+              bson_error_t             *error)
+{
+   fake_resolver_t *fake = (fake_resolver_t *) ctx;
+   struct addrinfo *head = NULL;
+   struct addrinfo **tail = &head;
+   struct addrinfo *ai;
+   int i;
+
+   fake->n_calls++;
+
+   for (i = 0; i < fake->n_addrs; i++) {
+      ai = (struct addrinfo *) bson_malloc0 (sizeof *ai);
+      ai->ai_family = fake->addrs[i].ss_family;
+      ai->ai_socktype = SOCK_STREAM;
+      ai->ai_addrlen = fake->addrlens[i];
+      ai->ai_addr = (struct sockaddr *) bson_malloc (fake->addrlens[i]);
+      memcpy (ai->ai_addr, &fake->addrs[i], fake->addrlens[i]);
+
+      *tail = ai;
+      tail = &ai->ai_next;
+   }
+
+   return head;
+}
+
+
+static void
+fake_resolver_add_loopback (fake_resolver_t *fake,
+                            int              family,
+                            uint16_t         port)
+{
+   struct sockaddr_in *sin;
+   struct sockaddr_in6 *sin6;
+
+   ASSERT_CMPINT (fake->n_addrs, <, 2);
+
+   memset (&fake->addrs[fake->n_addrs], 0, sizeof fake->addrs[0]);
+
+   if (family == AF_INET6) {
+      sin6 = (struct sockaddr_in6 *) &fake->addrs[fake->n_addrs];
+      sin6->sin6_family = AF_INET6;
+      sin6->sin6_port = htons (port);
+      sin6->sin6_addr = in6addr_loopback;
+      fake->addrlens[fake->n_addrs] = sizeof *sin6;
+   } else {
+      sin = (struct sockaddr_in *) &fake->addrs[fake->n_addrs];
+      sin->sin_family = AF_INET;
+      sin->sin_port = htons (port);
+      sin->sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+      fake->addrlens[fake->n_addrs] = sizeof *sin;
+   }
+
+   fake->n_addrs++;
+}
+
+
+static void
+fake_resolver_install (fake_resolver_t *fake)
+{
+   _mongoc_dns_cache_clear ();
+   _mongoc_dns_cache_set_resolver (fake_resolve, fake);
+}
+
+
+static void
+fake_resolver_uninstall (void)
+{
+   _mongoc_dns_cache_set_resolver (NULL, NULL);
+   _mongoc_dns_cache_clear ();
+}
+
+
+/* a name is resolved once until its cache entry expires */
+static void
+test_topology_scanner_dns_cache_ttl (void)
+{
+   fake_resolver_t fake = { { { 0 } } };
+   mongoc_host_list_t host;
+   mongoc_host_list_t other_port;
+   struct addrinfo *results;
+   bson_error_t error;
+
+   fake_resolver_add_loopback (&fake, AF_INET, 27017);
+   fake_resolver_install (&fake);
+
+   ASSERT (_mongoc_host_list_from_string (&host, "fake.test:27017"));
+   ASSERT (_mongoc_host_list_from_string (&other_port, "fake.test:27018"));
+
+   ASSERT_OR_PRINT (_mongoc_dns_resolve (&host, 200, &results, &error), error);
+   ASSERT (results);
+   ASSERT_CMPINT (results->ai_family, ==, AF_INET);
+   _mongoc_dns_results_destroy (results);
+   ASSERT_CMPINT (fake.n_calls, ==, 1);
+
+   /* cached */
+   ASSERT_OR_PRINT (_mongoc_dns_resolve (&host, 200, &results, &error), error);
+   _mongoc_dns_results_destroy (results);
+   ASSERT_CMPINT (fake.n_calls, ==, 1);
+
+   /* a different port is a different entry */
+   ASSERT_OR_PRINT (_mongoc_dns_resolve (&other_port, 200, &results, &error),
+                    error);
+   _mongoc_dns_results_destroy (results);
+   ASSERT_CMPINT (fake.n_calls, ==, 2);
+
+   /* expired */
+   _mongoc_usleep (300 * 1000);
+   ASSERT_OR_PRINT (_mongoc_dns_resolve (&host, 200, &results, &error), error);
+   _mongoc_dns_results_destroy (results);
+   ASSERT_CMPINT (fake.n_calls, ==, 3);
+
+   ASSERT_OR_PRINT (_mongoc_dns_resolve (&host, 200, &results, &error), error);
+   _mongoc_dns_results_destroy (results);
+   ASSERT_CMPINT (fake.n_calls, ==, 3);
+
+   /* a caller with a shorter TTL doesn't use the entry, and replaces it */
+   _mongoc_usleep (100 * 1000);
+   ASSERT_OR_PRINT (_mongoc_dns_resolve (&host, 50, &results, &error), error);
+   _mongoc_dns_results_destroy (results);
+   ASSERT_CMPINT (fake.n_calls, ==, 4);
+
+   ASSERT_OR_PRINT (_mongoc_dns_resolve (&host, 200, &results, &error), error);
+   _mongoc_dns_results_destroy (results);
+   ASSERT_CMPINT (fake.n_calls, ==, 4);
+
+   /* a negative TTL bypasses the cache */
+   ASSERT_OR_PRINT (_mongoc_dns_resolve (&host, -1, &results, &error), error);
+   _mongoc_dns_results_destroy (results);
+   ASSERT_CMPINT (fake.n_calls, ==, 5);
+
+   fake_resolver_uninstall ();
+}
+
+
+/* a listening socket that accepts connections but never replies */
+static mongoc_socket_t *
+silent_listener_new (int       family,
+                     uint16_t *port)
+{
+   mongoc_socket_t *sock;
+   struct sockaddr_storage addr = { 0 };
+   socklen_t addrlen;
+
+   sock = mongoc_socket_new (family, SOCK_STREAM, 0);
+   ASSERT (sock);
+
+   if (family == AF_INET6) {
+      ((struct sockaddr_in6 *) &addr)->sin6_family = AF_INET6;
+      ((struct sockaddr_in6 *) &addr)->sin6_addr = in6addr_loopback;
+      addrlen = sizeof (struct sockaddr_in6);
+   } else {
+      ((struct sockaddr_in *) &addr)->sin_family = AF_INET;
+      ((struct sockaddr_in *) &addr)->sin_addr.s_addr =
+         htonl (INADDR_LOOPBACK);
+      addrlen = sizeof (struct sockaddr_in);
+   }
+
+   ASSERT_CMPINT (mongoc_socket_bind (sock, (struct sockaddr *) &addr,
+                                      addrlen), ==, 0);
+   ASSERT_CMPINT (mongoc_socket_listen (sock, 10), ==, 0);
+   ASSERT_CMPINT (mongoc_socket_getsockname (sock, (struct sockaddr *) &addr,
+                                             &addrlen), ==, 0);
+
+   if (family == AF_INET6) {
+      *port = ntohs (((struct sockaddr_in6 *) &addr)->sin6_port);
+   } else {
+      *port = ntohs (((struct sockaddr_in *) &addr)->sin_port);
+   }
+
+   return sock;
+}
+
+
+static void
+_happy_eyeballs_cb (uint32_t            id,
+                    const bson_t       *bson,
+                    int64_t             rtt_msec,
+                    void               *data,
+                    const bson_error_t *error /* IN */)
+{
+   ASSERT_OR_PRINT (bson, (*error));
+
+   /* the winner's reply */
+   ASSERT_CMPINT (bson_lookup_int32 (bson, "maxWireVersion"), ==, 5);
+   (*(int *) data)++;
+}
+
+
+/* a name with two addresses: the first attempt connects but never answers,
+ * the second starts after the connection attempt delay and wins. the
+ * loser's connection is closed. with MONGOC_CHECK_IPV6, the loser is IPv6
+ * and the winner IPv4, so the families alternate */
+static void
+test_topology_scanner_happy_eyeballs (void)
+{
+   fake_resolver_t fake = { { { 0 } } };
+   mock_server_t *winner;
+   mongoc_socket_t *loser;
+   mongoc_socket_t *loser_conn;
+   mongoc_topology_scanner_t *ts;
+   mongoc_topology_scanner_node_t *node;
+   mongoc_host_list_t host;
+   int loser_family;
+   uint16_t loser_port;
+   uint16_t winner_port;
+   char buf[512];
+   ssize_t r;
+   ssize_t received = 0;
+   int n_replies = 0;
+   int64_t start;
+
+   loser_family = test_framework_getenv_bool ("MONGOC_CHECK_IPV6")
+                  ? AF_INET6 : AF_INET;
+   loser = silent_listener_new (loser_family, &loser_port);
+
+   winner = mock_server_with_autoismaster (5);
+   winner_port = mock_server_run (winner);
+
+   /* the loser is the resolver's first choice */
+   fake_resolver_add_loopback (&fake, loser_family, loser_port);
+   fake_resolver_add_loopback (&fake, AF_INET, winner_port);
+   fake_resolver_install (&fake);
+
+   ASSERT (_mongoc_host_list_from_string (&host, "fake.test:27017"));
+   ts = mongoc_topology_scanner_new (NULL, NULL, &_happy_eyeballs_cb,
+                                     &n_replies);
+   mongoc_topology_scanner_add (ts, &host, 1);
+
+   start = bson_get_monotonic_time ();
+   mongoc_topology_scanner_start (ts, TIMEOUT, false);
+   mongoc_topology_scanner_work (ts, TIMEOUT);
+
+   ASSERT_CMPINT (n_replies, ==, 1);
+   ASSERT_CMPINT (fake.n_calls, ==, 1);
+   ASSERT_CMPINT64 (bson_get_monotonic_time () - start, >=,
+                    (int64_t) MONGOC_TOPOLOGY_CONNECTION_ATTEMPT_DELAY_MS *
+                    1000);
+
+   node = mongoc_topology_scanner_get_node (ts, 1);
+   ASSERT (node->stream);
+   ASSERT_CMPINT (node->n_attempts, ==, 0);
+
+   /* the loser sent ismaster, then was closed: read to EOF */
+   loser_conn = mongoc_socket_accept (loser,
+                                      bson_get_monotonic_time () +
+                                      TIMEOUT * 1000);
+   ASSERT (loser_conn);
+
+   do {
+      r = mongoc_socket_recv (loser_conn, buf, sizeof buf, 0,
+                              bson_get_monotonic_time () + TIMEOUT * 1000);
+      ASSERT_CMPINT ((int) r, >=, 0);
+      received += r;
+   } while (r > 0);
+
+   ASSERT_CMPINT ((int) received, >, 0);
+
+   mongoc_socket_destroy (loser_conn);
+   mongoc_topology_scanner_destroy (ts);
+   mongoc_socket_destroy (loser);
+   mock_server_destroy (winner);
+   fake_resolver_uninstall ();
+}
+
+
 void
 test_topology_scanner_install (TestSuite *suite)
 {
@@ -420,4 +838,10 @@ test_topology_scanner_install (TestSuite *suite)
                   test_topology_scanner_socket_timeout);
    TestSuite_Add (suite, "/TOPOLOGY/blocking_initiator",
                   test_topology_scanner_blocking_initiator);
+   TestSuite_Add (suite, "/TOPOLOGY/scanner_streaming",
+                  test_topology_scanner_streaming);
+   TestSuite_Add (suite, "/TOPOLOGY/dns_cache_ttl",
+                  test_topology_scanner_dns_cache_ttl);
+   TestSuite_Add (suite, "/TOPOLOGY/scanner_happy_eyeballs",
+                  test_topology_scanner_happy_eyeballs);
 }
@@ -1,5 +1,6 @@
 #include <mongoc.h>
 #include <mongoc-uri-private.h>
+#include <sys/stat.h>
 
 #include "mongoc-client-private.h"
 #include "mongoc-util-private.h"
@@ -841,7 +842,8 @@ _test_server_removed_during_handshake (bool pooled)
                               mock_server_get_host_and_port (server));
 
    /* pretend to close a connection. does NOT affect server description yet */
-   mongoc_cluster_disconnect_node (&client->cluster, 1);
+   mongoc_cluster_disconnect_node (&client->cluster, 1,
+                                   MONGOC_CONNECTION_CLOSED_NETWORK_ERROR);
    sd = mongoc_client_get_server_description (client, 1);
    /* still primary */
    ASSERT_CMPINT ((int) MONGOC_SERVER_RS_PRIMARY, ==, sd->type);
@@ -984,6 +986,104 @@ test_add_and_scan_failure (void)
    mock_server_destroy (server);
 }
 
+
+static void
+_cache_test_ping (mongoc_client_t *client,
+                  mock_server_t   *server)
+{
+   future_t *future;
+   request_t *request;
+   bson_error_t error;
+
+   future = future_client_command_simple (client, "db",
+                                          tmp_bson ("{'ping': 1}"),
+                                          NULL, NULL, &error);
+
+   request = mock_server_receives_command (server, "db", MONGOC_QUERY_SLAVE_OK,
+                                           "{'ping': 1}");
+   mock_server_replies_ok_and_destroys (request);
+   ASSERT_OR_PRINT (future_get_bool (future), error);
+   future_destroy (future);
+}
+
+
+static void
+test_topology_cache (void)
+{
+   const char *path = "test-topology-cache.bson";
+   mock_server_t *server;
+   mongoc_uri_t *uri;
+   mongoc_client_t *client;
+   mongoc_server_description_t *sd;
+   bson_reader_t *reader;
+   const bson_t *doc;
+   bson_error_t error;
+   struct stat st;
+   char *seeds;
+   int responder;
+
+   remove (path);
+
+   server = mock_server_new ();
+   mock_server_run (server);
+   responder = mock_server_auto_ismaster (server, "{'ok': 1, 'ismaster': true}");
+
+   uri = mongoc_uri_copy (mock_server_get_uri (server));
+   mongoc_uri_set_option_as_utf8 (uri, "topologyCacheFile", path);
+
+   /* no cache yet: the first selection scans, then writes the cache */
+   client = mongoc_client_new_from_uri (uri);
+   ASSERT (!client->topology->cache_unverified);
+   _cache_test_ping (client, server);
+   mongoc_client_destroy (client);
+
+   /* keyed by the seeds, not the URI with its credentials, and private */
+   reader = bson_reader_new_from_file (path, &error);
+   ASSERT_OR_PRINT (reader, error);
+   doc = bson_reader_read (reader, NULL);
+   ASSERT (doc);
+   ASSERT (!bson_has_field (doc, "uri"));
+   seeds = bson_strdup_printf ("%s/", mock_server_get_host_and_port (server));
+   ASSERT_CMPSTR (bson_lookup_utf8 (doc, "seeds"), seeds);
+   bson_free (seeds);
+   bson_reader_destroy (reader);
+
+   ASSERT_CMPINT (stat (path, &st), ==, 0);
+#ifndef _WIN32
+   ASSERT_CMPINT ((int) (st.st_mode & 0777), ==, 0600);
+#endif
+
+   /* seeded from the cache, the handshake agrees, no scan */
+   client = mongoc_client_new_from_uri (uri);
+   ASSERT (client->topology->cache_unverified);
+   sd = mongoc_topology_server_by_id (client->topology, 1, NULL);
+   ASSERT (sd);
+   ASSERT_CMPSTR (mongoc_server_description_type (sd), "Standalone");
+   mongoc_server_description_destroy (sd);
+   _cache_test_ping (client, server);
+   ASSERT (client->topology->cache_unverified);
+   mongoc_client_destroy (client);
+
+   /* the server's type changed since the cache was written */
+   mock_server_remove_autoresponder (server, responder);
+   mock_server_auto_ismaster (server, "{'ok': 1, 'ismaster': false,"
+                                      " 'secondary': true, 'setName': 'rs'}");
+
+   client = mongoc_client_new_from_uri (uri);
+   ASSERT (client->topology->cache_unverified);
+   _cache_test_ping (client, server);
+   ASSERT (!client->topology->cache_unverified);
+   sd = mongoc_topology_server_by_id (client->topology, 1, NULL);
+   ASSERT (sd);
+   ASSERT_CMPSTR (mongoc_server_description_type (sd), "RSSecondary");
+   mongoc_server_description_destroy (sd);
+   mongoc_client_destroy (client);
+
+   remove (path);
+   mongoc_uri_destroy (uri);
+   mock_server_destroy (server);
+}
+
 void
 test_topology_install (TestSuite *suite)
 {
@@ -1024,4 +1124,5 @@ test_topology_install (TestSuite *suite)
                       test_framework_skip_if_slow);
    TestSuite_AddLive (suite, "/Topology/add_and_scan_failure",
                       test_add_and_scan_failure);
+   TestSuite_Add (suite, "/Topology/cache", test_topology_cache);
 }
@@ -0,0 +1,234 @@
+#include <mongoc.h>
+#include <mongoc-trace-buffer-private.h>
+
+#include "TestSuite.h"
+#include "test-conveniences.h"
+#include "test-libmongoc.h"
+#include "mock_server/mock-server.h"
+#include "mock_server/future.h"
+#include "mock_server/future-functions.h"
+
+
+#ifdef MONGOC_ENABLE_TRACE_BUFFER
+typedef struct
+{
+   uint32_t id;
+   char     domain[64];
+   char     func[128];
+} trace_site_t;
+
+
+typedef struct
+{
+   trace_site_t *sites;
+   uint32_t      n_sites;
+   uint32_t      n_events;
+   uint32_t      n_cluster_events;
+   uint32_t      n_other_events;
+} trace_dump_t;
+
+
+static void
+read_u32 (FILE     *stream,
+          uint32_t *value)
+{
+   ASSERT (fread (value, sizeof *value, 1, stream) == 1);
+}
+
+
+static void
+read_str (FILE   *stream,
+          char   *str,
+          size_t  size)
+{
+   size_t i = 0;
+   int c;
+
+   while ((c = fgetc (stream)) > 0) {
+      if (i < size - 1) {
+         str[i++] = (char) c;
+      }
+   }
+
+   ASSERT (c == 0);
+   str[i] = '\0';
+}
+
+
+static const trace_site_t *
+find_site (const trace_dump_t *dump,
+           uint32_t            id)
+{
+   uint32_t i;
+
+   for (i = 0; i < dump->n_sites; i++) {
+      if (dump->sites[i].id == id) {
+         return &dump->sites[i];
+      }
+   }
+
+   return NULL;
+}
+
+
+/* count the events recorded since @since, by domain */
+static void
+read_dump (FILE         *stream,
+           int64_t       since,
+           trace_dump_t *dump)
+{
+   mongoc_trace_record_t record;
+   const trace_site_t *site;
+   char magic[8];
+   char label[256];
+   uint32_t version;
+   uint32_t n_rings;
+   uint32_t record_size;
+   uint32_t thread;
+   uint32_t n;
+   uint32_t u;
+   int64_t times[2];
+   uint32_t i;
+   uint32_t j;
+
+   memset (dump, 0, sizeof *dump);
+   rewind (stream);
+
+   ASSERT (fread (magic, 1, sizeof magic, stream) == sizeof magic);
+   ASSERT (!memcmp (magic, "MONGOCTB", sizeof magic));
+   read_u32 (stream, &version);
+   ASSERT_CMPUINT32 (version, ==, (uint32_t) 1);
+   read_u32 (stream, &dump->n_sites);
+   read_u32 (stream, &n_rings);
+   read_u32 (stream, &record_size);
+   ASSERT_CMPUINT32 (record_size, ==, (uint32_t) sizeof record);
+   ASSERT (fread (times, sizeof times, 1, stream) == 1);
+
+   dump->sites = (trace_site_t *) bson_malloc0 (
+      BSON_MAX (1, dump->n_sites) * sizeof (trace_site_t));
+
+   for (i = 0; i < dump->n_sites; i++) {
+      read_u32 (stream, &dump->sites[i].id);
+      read_u32 (stream, &u); /* event */
+      read_u32 (stream, &u); /* line */
+      read_str (stream, dump->sites[i].domain,
+                sizeof dump->sites[i].domain);
+      read_str (stream, dump->sites[i].func, sizeof dump->sites[i].func);
+      read_str (stream, label, sizeof label);
+   }
+
+   for (i = 0; i < n_rings; i++) {
+      read_u32 (stream, &thread);
+      read_u32 (stream, &n);
+      ASSERT_CMPUINT32 (n, <=, (uint32_t) MONGOC_TRACE_RING_SIZE);
+
+      for (j = 0; j < n; j++) {
+         ASSERT (fread (&record, sizeof record, 1, stream) == 1);
+         site = find_site (dump, record.site);
+         ASSERT (site);
+
+         if (record.time < since) {
+            continue;
+         }
+
+         dump->n_events++;
+         if (!strcmp (site->domain, "cluster")) {
+            dump->n_cluster_events++;
+         } else {
+            dump->n_other_events++;
+         }
+      }
+   }
+
+   ASSERT (fgetc (stream) == EOF);
+}
+
+
+static void
+run_ping (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   future_t *future;
+   request_t *request;
+
+   server = mock_server_with_autoismaster (0);
+   mock_server_run (server);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+
+   future = future_client_command_simple (client, "db",
+                                          tmp_bson ("{'ping': 1}"),
+                                          NULL, NULL, NULL);
+   request = mock_server_receives_command (server, "db", MONGOC_QUERY_SLAVE_OK,
+                                           "{'ping': 1}");
+   mock_server_replies_simple (request, "{'ok': 1}");
+   ASSERT (future_get_bool (future));
+   future_destroy (future);
+   request_destroy (request);
+
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+/* dump the trace buffer and count the events recorded since @since */
+static void
+dump_since (int64_t       since,
+            trace_dump_t *dump)
+{
+   FILE *stream;
+
+   stream = tmpfile ();
+   ASSERT (stream);
+   ASSERT (mongoc_trace_buffer_dump (stream));
+   read_dump (stream, since, dump);
+   fclose (stream);
+}
+
+
+static void
+test_trace_buffer_domains (void)
+{
+   trace_dump_t dump;
+   int64_t since;
+
+   /* only the cluster is recorded */
+   since = bson_get_monotonic_time ();
+   ASSERT (mongoc_trace_buffer_set_domains ("cluster"));
+   run_ping ();
+   ASSERT (mongoc_trace_buffer_set_domains (NULL));
+
+   dump_since (since, &dump);
+   ASSERT_CMPUINT32 (dump.n_cluster_events, >, (uint32_t) 0);
+   ASSERT_CMPUINT32 (dump.n_other_events, ==, (uint32_t) 0);
+   bson_free (dump.sites);
+
+   /* nothing is recorded once disabled */
+   since = bson_get_monotonic_time ();
+   run_ping ();
+
+   dump_since (since, &dump);
+   ASSERT_CMPUINT32 (dump.n_events, ==, (uint32_t) 0);
+   bson_free (dump.sites);
+
+   /* "*" records every domain */
+   since = bson_get_monotonic_time ();
+   ASSERT (mongoc_trace_buffer_set_domains ("*"));
+   run_ping ();
+   ASSERT (mongoc_trace_buffer_set_domains (NULL));
+
+   dump_since (since, &dump);
+   ASSERT_CMPUINT32 (dump.n_cluster_events, >, (uint32_t) 0);
+   ASSERT_CMPUINT32 (dump.n_other_events, >, (uint32_t) 0);
+   bson_free (dump.sites);
+}
+#endif
+
+
+void
+test_trace_buffer_install (TestSuite *suite)
+{
+#ifdef MONGOC_ENABLE_TRACE_BUFFER
+   TestSuite_Add (suite, "/TraceBuffer/domains", test_trace_buffer_domains);
+#endif
+}
@@ -10,6 +10,7 @@
 
 #include "test-libmongoc.h"
 #include "test-conveniences.h"
+#include "mock_server/mock-server.h"
 
 
 static void
@@ -81,6 +82,199 @@ test_split_insert (void)
 }
 
 
+/* record each insert command's "documents" array */
+static bool
+split_responder (request_t *request,
+                 void      *data)
+{
+   mongoc_array_t *batches = (mongoc_array_t *) data;
+   bson_iter_t iter;
+   bson_t *documents;
+   char *reply;
+
+   if (strcmp (request->command_name, "insert")) {
+      return false;
+   }
+
+   BSON_ASSERT (bson_iter_init_find (&iter, request_get_doc (request, 0),
+                                     "documents"));
+   documents = bson_new ();
+   bson_iter_bson (&iter, documents);
+   _mongoc_array_append_val (batches, documents);
+
+   reply = bson_strdup_printf ("{'ok': 1, 'n': %d}", bson_count_keys (documents));
+   mock_server_replies_simple (request, reply);
+   bson_free (reply);
+   request_destroy (request);
+
+   return true;
+}
+
+
+static void
+test_split_insert_batches (void)
+{
+   mongoc_bulk_write_flags_t write_flags = MONGOC_BULK_WRITE_FLAGS_INIT;
+   mock_server_t *server;
+   mongoc_write_command_t command;
+   mongoc_write_result_t result;
+   mongoc_client_t *client;
+   mongoc_server_stream_t *server_stream;
+   mongoc_array_t batches;
+   bson_error_t error;
+   char *big;
+   int i;
+
+   _mongoc_array_init (&batches, sizeof (bson_t *));
+
+   /* commands may be maxBsonObjectSize + 16k long */
+   server = mock_server_new ();
+   mock_server_auto_ismaster (server, "{'ok': 1, 'ismaster': true,"
+                                      " 'maxWireVersion': %d,"
+                                      " 'maxBsonObjectSize': 1000,"
+                                      " 'maxWriteBatchSize': 3}",
+                              WIRE_VERSION_MAX);
+   mock_server_autoresponds (server, split_responder, &batches, NULL);
+   mock_server_run (server);
+
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   big = (char *) bson_malloc0 (10000);
+   memset (big, 'a', 9999);
+
+   _mongoc_write_command_init_insert (&command, tmp_bson ("{'_id': 0}"),
+                                      write_flags, 0, true);
+   for (i = 1; i < 7; i++) {
+      if (i == 3 || i == 4) {
+         _mongoc_write_command_insert_append (
+            &command, tmp_bson ("{'_id': %d, 'big': '%s'}", i, big));
+      } else {
+         _mongoc_write_command_insert_append (&command,
+                                              tmp_bson ("{'_id': %d}", i));
+      }
+   }
+
+   server_stream = mongoc_cluster_stream_for_writes (&client->cluster, &error);
+   ASSERT_OR_PRINT (server_stream, error);
+
+   _mongoc_write_result_init (&result);
+   _mongoc_write_command_execute (&command, client, server_stream, "db",
+                                  "collection", NULL, 0, &result);
+   ASSERT_OR_PRINT (!result.failed, result.error);
+   ASSERT_CMPINT (result.nInserted, ==, 7);
+
+   /* split by count, then by size, keys renumbered from "0" */
+   ASSERT_CMPINT ((int) batches.len, ==, 3);
+   ASSERT_MATCH (_mongoc_array_index (&batches, bson_t *, 0),
+                 "{'0': {'_id': 0}, '1': {'_id': 1}, '2': {'_id': 2},"
+                 " '3': {'$exists': false}}");
+   ASSERT_MATCH (_mongoc_array_index (&batches, bson_t *, 1),
+                 "{'0': {'_id': 3}, '1': {'$exists': false}}");
+   ASSERT_MATCH (_mongoc_array_index (&batches, bson_t *, 2),
+                 "{'0': {'_id': 4}, '1': {'_id': 5}, '2': {'_id': 6},"
+                 " '3': {'$exists': false}}");
+
+   for (i = 0; i < (int) batches.len; i++) {
+      bson_destroy (_mongoc_array_index (&batches, bson_t *, i));
+   }
+
+   _mongoc_array_destroy (&batches);
+   _mongoc_write_command_destroy (&command);
+   _mongoc_write_result_destroy (&result);
+   bson_free (big);
+   mongoc_server_stream_cleanup (server_stream);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+static bool
+ping_responder (request_t *request,
+                void      *data)
+{
+   if (!request->is_command || strcmp (request->command_name, "ping")) {
+      return false;
+   }
+
+   (*(int *) data)++;
+   mock_server_replies_simple (request, "{'ok': 1}");
+   request_destroy (request);
+
+   return true;
+}
+
+
+static void
+test_unacknowledged_op_msg (void)
+{
+   mongoc_bulk_write_flags_t write_flags = MONGOC_BULK_WRITE_FLAGS_INIT;
+   mock_server_t *server;
+   mongoc_write_command_t command;
+   mongoc_write_result_t result;
+   mongoc_write_concern_t *write_concern;
+   mongoc_client_t *client;
+   mongoc_server_stream_t *server_stream;
+   request_t *request;
+   bson_error_t error;
+   int pings = 0;
+
+   server = mock_server_new ();
+   mock_server_auto_ismaster (server, "{'ok': 1, 'ismaster': true,"
+                                      " 'maxWireVersion': %d}",
+                              WIRE_VERSION_OP_MSG);
+   mock_server_autoresponds (server, ping_responder, &pings, NULL);
+   mock_server_run (server);
+
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   write_concern = mongoc_write_concern_new ();
+   mongoc_write_concern_set_w (write_concern, 0);
+
+   _mongoc_write_command_init_insert (&command, tmp_bson ("{'_id': 0}"),
+                                      write_flags, 0, true);
+   _mongoc_write_command_insert_append (&command, tmp_bson ("{'_id': 1}"));
+
+   server_stream = mongoc_cluster_stream_for_writes (&client->cluster, &error);
+   ASSERT_OR_PRINT (server_stream, error);
+
+   /* returns without a reply */
+   _mongoc_write_result_init (&result);
+   _mongoc_write_command_execute (&command, client, server_stream, "db",
+                                  "collection", write_concern, 0, &result);
+   ASSERT_OR_PRINT (!result.failed, result.error);
+   _mongoc_write_result_destroy (&result);
+
+   request = mock_server_receives_request (server);
+   ASSERT (request);
+   ASSERT_CMPINT ((int) request->opcode, ==, MONGOC_OPCODE_OP_MSG);
+   ASSERT_CMPSTR (request->command_name, "insert");
+   ASSERT_MATCH (request_get_doc (request, 0),
+                 "{'insert': 'collection', 'writeConcern': {'w': 0},"
+                 " '$db': 'db', 'documents': [{'_id': 0}, {'_id': 1}]}");
+   ASSERT (strstr (request->as_str, "MORE_TO_COME"));
+   request_destroy (request);
+   ASSERT_CMPINT (pings, ==, 0);
+
+   /* the next send after socketCheckIntervalMS checks the connection */
+   client->cluster.socketcheckintervalms = 0;
+   _mongoc_write_result_init (&result);
+   _mongoc_write_command_execute (&command, client, server_stream, "db",
+                                  "collection", write_concern, 0, &result);
+   ASSERT_OR_PRINT (!result.failed, result.error);
+   _mongoc_write_result_destroy (&result);
+
+   request = mock_server_receives_request (server);
+   ASSERT (request);
+   ASSERT_CMPINT ((int) request->opcode, ==, MONGOC_OPCODE_OP_MSG);
+   request_destroy (request);
+   ASSERT_CMPINT (pings, ==, 1);
+
+   _mongoc_write_command_destroy (&command);
+   mongoc_write_concern_destroy (write_concern);
+   mongoc_server_stream_cleanup (server_stream);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
 static void
 test_invalid_write_concern (void)
 {
@@ -245,6 +439,8 @@ void
 test_write_command_install (TestSuite *suite)
 {
    TestSuite_AddLive (suite, "/WriteCommand/split_insert", test_split_insert);
+   TestSuite_Add (suite, "/WriteCommand/split_insert/batches", test_split_insert_batches);
+   TestSuite_Add (suite, "/WriteCommand/unacknowledged/op_msg", test_unacknowledged_op_msg);
    TestSuite_AddLive (suite, "/WriteCommand/invalid_write_concern", test_invalid_write_concern);
    TestSuite_AddFull (suite, "/WriteCommand/bypass_validation", test_bypass_validation,
                       NULL, NULL,